@@ -117,8 +117,9 @@ static UINT ainput_server_open_channel(ainput_server* ainput)
 			return Error;
 		}
 
-		ainput->ainput_channel = WTSVirtualChannelOpenEx(ainput->SessionId, AINPUT_DVC_CHANNEL_NAME,
-		                                                 WTS_CHANNEL_OPTION_DYNAMIC);
+		ainput->ainput_channel = WTSVirtualChannelOpenEx(
+		    ainput->SessionId, AINPUT_DVC_CHANNEL_NAME,
+		    WTS_CHANNEL_OPTION_DYNAMIC | WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL);
 
 		Error = GetLastError();
 
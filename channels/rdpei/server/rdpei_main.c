@@ -93,7 +93,8 @@ static UINT rdpei_server_open_channel(RdpeiServerContext* context)
 	WTSFreeMemory(pSessionId);
 
 	priv->channelHandle =
-	    WTSVirtualChannelOpenEx(sessionId, RDPEI_DVC_CHANNEL_NAME, WTS_CHANNEL_OPTION_DYNAMIC);
+	    WTSVirtualChannelOpenEx(sessionId, RDPEI_DVC_CHANNEL_NAME,
+	                            WTS_CHANNEL_OPTION_DYNAMIC | WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL);
 	if (!priv->channelHandle)
 	{
 		error = GetLastError();
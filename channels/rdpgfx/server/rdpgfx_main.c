@@ -41,6 +41,10 @@
 
 #define TAG CHANNELS_TAG("rdpgfx.server")
 
+/* Flush a frame batch before it grows beyond this many ZGFX segments */
+#define RDPGFX_BATCH_MAX_SEGMENTS 16
+#define RDPGFX_BATCH_MAX_SIZE (RDPGFX_BATCH_MAX_SEGMENTS * ZGFX_SEGMENTED_MAXSIZE)
+
 static BOOL rdpgfx_server_close(RdpgfxServerContext* context);
 
 #define checkCapsAreExchanged(context) \
@@ -113,65 +117,169 @@ WINPR_ATTR_NODISCARD static inline BOOL rdpgfx_server_packet_complete_header(wSt
 
 /**
  * Function description
- * Send the stream for rdpgfx server packet.
- * The packet would be compressed according to [MS-RDPEGFX].
+ * Send one or more rdpgfx PDUs as a single channel message.
+ * The data would be compressed according to [MS-RDPEGFX].
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-WINPR_ATTR_NODISCARD static UINT rdpgfx_server_packet_send(RdpgfxServerContext* context, wStream* s)
+WINPR_ATTR_NODISCARD static UINT rdpgfx_server_data_send(RdpgfxServerContext* context,
+                                                         const BYTE* const* ppSrcData,
+                                                         const UINT32* pSrcSizes, size_t count)
 {
 	UINT error = 0;
 	UINT32 flags = 0;
-	ULONG written = 0;
-	BYTE* pSrcData = Stream_Buffer(s);
-	const size_t SrcSize = Stream_GetPosition(s);
-	if (SrcSize > UINT32_MAX)
-		return ERROR_INTERNAL_ERROR;
+	size_t SrcSize = 0;
 
 	WINPR_ASSERT(context);
 	WINPR_ASSERT(context->priv);
+	WINPR_ASSERT(ppSrcData);
+	WINPR_ASSERT(pSrcSizes);
+
+	for (size_t x = 0; x < count; x++)
+		SrcSize += pSrcSizes[x];
+	if (SrcSize > UINT32_MAX)
+		return ERROR_INTERNAL_ERROR;
 
 	/* Allocate new stream with enough capacity. Additional overhead is
 	 * descriptor (1 bytes) + segmentCount (2 bytes) + uncompressedSize (4 bytes)
 	 * + segmentCount * size (4 bytes) */
-	wStream* fs = Stream_New(nullptr, SrcSize + 7 + (SrcSize / ZGFX_SEGMENTED_MAXSIZE + 1) * 4);
+	wStream* fs =
+	    WTSVirtualChannelStreamNew(context->priv->rdpgfx_channel,
+	                               SrcSize + 7 + (SrcSize / ZGFX_SEGMENTED_MAXSIZE + 1) * 4);
 
 	if (!fs)
 	{
-		WLog_Print(context->priv->log, WLOG_ERROR, "Stream_New failed!");
+		WLog_Print(context->priv->log, WLOG_ERROR, "WTSVirtualChannelStreamNew failed!");
 		error = CHANNEL_RC_NO_MEMORY;
 		goto out;
 	}
 
-	if (zgfx_compress_to_stream(context->priv->zgfx, fs, pSrcData, (UINT32)SrcSize, &flags) < 0)
+	/* The PDUs are only copied once, into the channel stream */
+	if (zgfx_compress_gather_to_stream(context->priv->zgfx, fs, ppSrcData, pSrcSizes, count,
+	                                   &flags) < 0)
 	{
-		WLog_Print(context->priv->log, WLOG_ERROR, "zgfx_compress_to_stream failed!");
+		WLog_Print(context->priv->log, WLOG_ERROR, "zgfx_compress_gather_to_stream failed!");
 		error = ERROR_INTERNAL_ERROR;
 		goto out;
 	}
 
+	/* The channel takes ownership of the stream and sends it without another copy */
 	{
-		const size_t pos = Stream_GetPosition(fs);
-		WINPR_ASSERT(pos <= UINT32_MAX);
-		if (!WTSVirtualChannelWrite(context->priv->rdpgfx_channel, Stream_BufferAs(fs, char),
-		                            (UINT32)pos, &written))
+		const BOOL rc = WTSVirtualChannelWriteStream(context->priv->rdpgfx_channel, fs);
+		fs = nullptr;
+		if (!rc)
 		{
-			WLog_Print(context->priv->log, WLOG_ERROR, "WTSVirtualChannelWrite failed!");
+			WLog_Print(context->priv->log, WLOG_ERROR, "WTSVirtualChannelWriteStream failed!");
 			error = ERROR_INTERNAL_ERROR;
 			goto out;
 		}
 	}
 
-	if (written < Stream_GetPosition(fs))
+	error = CHANNEL_RC_OK;
+out:
+	if (fs)
+		Stream_Release(fs);
+	return error;
+}
+
+WINPR_ATTR_NODISCARD static BOOL rdpgfx_server_is_batching(RdpgfxServerPrivate* priv)
+{
+	WINPR_ASSERT(priv);
+
+	EnterCriticalSection(&priv->batchLock);
+	const BOOL batching = priv->batching && (priv->batchThreadId == GetCurrentThreadId());
+	LeaveCriticalSection(&priv->batchLock);
+	return batching;
+}
+
+static void rdpgfx_server_batch_clear(RdpgfxServerPrivate* priv)
+{
+	WINPR_ASSERT(priv);
+
+	for (size_t x = 0; x < priv->batchCount; x++)
 	{
-		WLog_Print(context->priv->log, WLOG_WARN,
-		           "Unexpected bytes written: %" PRIu32 "/%" PRIuz "", written,
-		           Stream_GetPosition(fs));
+		Stream_Free(priv->batch[x], TRUE);
+		priv->batch[x] = nullptr;
 	}
+	priv->batchCount = 0;
+	priv->batchSize = 0;
+}
+
+/**
+ * Function description
+ * Send the PDUs collected since rdpgfx_server_batch_begin
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+WINPR_ATTR_NODISCARD static UINT rdpgfx_server_batch_flush(RdpgfxServerContext* context)
+{
+	const BYTE* data[RDPGFX_BATCH_MAX_PDUS] = WINPR_C_ARRAY_INIT;
+	UINT32 sizes[RDPGFX_BATCH_MAX_PDUS] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(context);
+
+	RdpgfxServerPrivate* priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	if (priv->batchCount == 0)
+		return CHANNEL_RC_OK;
+
+	for (size_t x = 0; x < priv->batchCount; x++)
+	{
+		data[x] = Stream_Buffer(priv->batch[x]);
+		sizes[x] = WINPR_ASSERTING_INT_CAST(UINT32, Stream_GetPosition(priv->batch[x]));
+	}
+
+	const UINT error = rdpgfx_server_data_send(context, data, sizes, priv->batchCount);
+	rdpgfx_server_batch_clear(priv);
+	return error;
+}
+
+/**
+ * Function description
+ * Send the stream for rdpgfx server packet, or keep it in the current
+ * frame batch. The stream is freed in any case.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+WINPR_ATTR_NODISCARD static UINT rdpgfx_server_packet_send(RdpgfxServerContext* context, wStream* s)
+{
+	UINT error = CHANNEL_RC_OK;
+
+	WINPR_ASSERT(context);
+
+	RdpgfxServerPrivate* priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	const size_t length = Stream_GetPosition(s);
+	if (length > UINT32_MAX)
+	{
+		error = ERROR_INTERNAL_ERROR;
+		goto out;
+	}
+
+	if (!rdpgfx_server_is_batching(priv))
+	{
+		const BYTE* data = Stream_Buffer(s);
+		const UINT32 size = (UINT32)length;
+		error = rdpgfx_server_data_send(context, &data, &size, 1);
+		goto out;
+	}
+
+	if ((priv->batchCount == ARRAYSIZE(priv->batch)) ||
+	    (priv->batchSize + length > RDPGFX_BATCH_MAX_SIZE))
+	{
+		error = rdpgfx_server_batch_flush(context);
+		if (error != CHANNEL_RC_OK)
+			goto out;
+	}
+
+	/* The stream is sent from the batch by rdpgfx_server_batch_flush */
+	priv->batch[priv->batchCount++] = s;
+	priv->batchSize += length;
+	return CHANNEL_RC_OK;
 
-	error = CHANNEL_RC_OK;
 out:
-	Stream_Free(fs, TRUE);
 	Stream_Free(s, TRUE);
 	return error;
 }
@@ -1714,8 +1822,10 @@ WINPR_ATTR_NODISCARD static BOOL rdpgfx_server_open(RdpgfxServerContext* context
 
 		priv->SessionId = (DWORD)*pSessionId;
 		WTSFreeMemory(pSessionId);
-		priv->rdpgfx_channel = WTSVirtualChannelOpenEx(priv->SessionId, RDPGFX_DVC_CHANNEL_NAME,
-		                                               WTS_CHANNEL_OPTION_DYNAMIC);
+		/* The PDUs carry their own ZGFX framing, they are not compressed again */
+		priv->rdpgfx_channel = WTSVirtualChannelOpenEx(
+		    priv->SessionId, RDPGFX_DVC_CHANNEL_NAME,
+		    WTS_CHANNEL_OPTION_DYNAMIC | WTS_CHANNEL_OPTION_DYNAMIC_NO_COMPRESS);
 
 		if (!priv->rdpgfx_channel)
 		{
@@ -1823,6 +1933,13 @@ BOOL rdpgfx_server_close(RdpgfxServerContext* context)
 	priv->channelEvent = nullptr;
 	priv->isOpened = FALSE;
 	priv->isReady = FALSE;
+	if (priv->haveBatchLock)
+	{
+		EnterCriticalSection(&priv->batchLock);
+		priv->batching = FALSE;
+		LeaveCriticalSection(&priv->batchLock);
+	}
+	rdpgfx_server_batch_clear(priv);
 	const RDPGFX_CAPSET empty = WINPR_C_ARRAY_INIT;
 	priv->activeCapSet = empty;
 	return TRUE;
@@ -1890,6 +2007,10 @@ RdpgfxServerContext* rdpgfx_server_context_new(HANDLE vcm)
 	if (!priv->log)
 		goto fail;
 
+	priv->haveBatchLock = InitializeCriticalSectionAndSpinCount(&priv->batchLock, 4000);
+	if (!priv->haveBatchLock)
+		goto fail;
+
 	/* Create shared input stream */
 	priv->input_stream = Stream_New(nullptr, 4);
 
@@ -1925,7 +2046,11 @@ void rdpgfx_server_context_free(RdpgfxServerContext* context)
 	(void)rdpgfx_server_close(context);
 
 	if (context->priv)
+	{
 		Stream_Free(context->priv->input_stream, TRUE);
+		if (context->priv->haveBatchLock)
+			DeleteCriticalSection(&context->priv->batchLock);
+	}
 
 	free(context->priv);
 	free(context);
@@ -2031,3 +2156,49 @@ UINT rdpgfx_server_handle_messages(RdpgfxServerContext* context)
 
 	return ret;
 }
+
+BOOL rdpgfx_server_batch_begin(RdpgfxServerContext* context)
+{
+	WINPR_ASSERT(context);
+
+	RdpgfxServerPrivate* priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	EnterCriticalSection(&priv->batchLock);
+	const BOOL active = priv->batching;
+	if (!active)
+	{
+		priv->batchThreadId = GetCurrentThreadId();
+		priv->batching = TRUE;
+	}
+	LeaveCriticalSection(&priv->batchLock);
+
+	if (active)
+	{
+		WLog_Print(priv->log, WLOG_ERROR, "A frame batch is already active");
+		return FALSE;
+	}
+	return TRUE;
+}
+
+UINT rdpgfx_server_batch_end(RdpgfxServerContext* context)
+{
+	WINPR_ASSERT(context);
+
+	RdpgfxServerPrivate* priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	if (!rdpgfx_server_is_batching(priv))
+	{
+		WLog_Print(priv->log, WLOG_ERROR, "No frame batch active on this thread");
+		return ERROR_INVALID_STATE;
+	}
+
+	/* Other threads do not use the batch, it is sent before a new one can start */
+	const UINT error = rdpgfx_server_batch_flush(context);
+
+	EnterCriticalSection(&priv->batchLock);
+	priv->batching = FALSE;
+	LeaveCriticalSection(&priv->batchLock);
+	return error;
+}
@@ -23,6 +23,9 @@
 #include <freerdp/server/rdpgfx.h>
 #include <freerdp/codec/zgfx.h>
 
+/* Flush a frame batch before it holds more PDUs */
+#define RDPGFX_BATCH_MAX_PDUS 256
+
 struct s_rdpgfx_server_private
 {
 	ZGFX_CONTEXT* zgfx;
@@ -37,6 +40,13 @@ struct s_rdpgfx_server_private
 	BOOL isReady;
 	wLog* log;
 	RDPGFX_CAPSET activeCapSet;
+	wStream* batch[RDPGFX_BATCH_MAX_PDUS]; /* only used by the batching thread */
+	size_t batchCount;
+	size_t batchSize;
+	CRITICAL_SECTION batchLock; /* protects batchThreadId and batching */
+	BOOL haveBatchLock;
+	DWORD batchThreadId;
+	BOOL batching;
 };
 
 #endif /* FREERDP_CHANNEL_RDPGFX_SERVER_MAIN_H */
@@ -0,0 +1,501 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/thread.h>
+#include <winpr/wtsapi.h>
+#include <winpr/collections.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/codec/zgfx.h>
+#include <freerdp/channels/drdynvc.h>
+#include <freerdp/channels/wtsvc.h>
+#include <freerdp/server/rdpgfx.h>
+
+#include "core/rdp.h"
+#include "core/mcs.h"
+
+#include "../rdpgfx_main.h"
+
+#define TEST_DRDYNVC_ID 1004
+#define TEST_MAX_MESSAGES 8
+#define TEST_MAX_PDUS (2 * RDPGFX_BATCH_MAX_PDUS)
+#define TEST_BITMAP_SIZE 400000
+
+/* The PDUs of a channel message as the client decodes them */
+typedef struct
+{
+	size_t count;
+	UINT16 cmdIds[TEST_MAX_PDUS];
+} test_message_t;
+
+typedef struct
+{
+	UINT32 channelId;
+	ZGFX_CONTEXT* zgfx;
+	wStream* data;
+	size_t expected;
+	size_t count;
+	test_message_t messages[TEST_MAX_MESSAGES];
+} test_client_t;
+
+static wArrayList* g_Sent = nullptr;
+
+static void test_free_pdu(void* obj)
+{
+	Stream_Free((wStream*)obj, TRUE);
+}
+
+static BOOL test_send_channel_data(WINPR_ATTR_UNUSED freerdp_peer* peer, UINT16 channelId,
+                                   const BYTE* data, size_t size)
+{
+	if (channelId != TEST_DRDYNVC_ID)
+		return FALSE;
+
+	wStream* s = Stream_New(nullptr, size);
+	if (!s)
+		return FALSE;
+
+	Stream_Write(s, data, size);
+	Stream_SealLength(s);
+	Stream_ResetPosition(s);
+	if (!ArrayList_Append(g_Sent, s))
+	{
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static UINT32 test_read_variable_uint(wStream* s, BYTE cbLen)
+{
+	switch (cbLen)
+	{
+		case 0:
+			return Stream_Get_UINT8(s);
+		case 1:
+			return Stream_Get_UINT16(s);
+		default:
+			return Stream_Get_UINT32(s);
+	}
+}
+
+static BOOL test_fail(const char* what)
+{
+	(void)fprintf(stderr, "%s\n", what);
+	return FALSE;
+}
+
+/* Decompress a complete channel message and split it into rdpgfx PDUs */
+static BOOL test_decode_message(test_client_t* client)
+{
+	BYTE* data = nullptr;
+	UINT32 size = 0;
+
+	if (client->count >= TEST_MAX_MESSAGES)
+		return test_fail("too many messages");
+	test_message_t* message = &client->messages[client->count++];
+	message->count = 0;
+
+	const UINT32 length = (UINT32)Stream_GetPosition(client->data);
+	Stream_ResetPosition(client->data);
+	client->expected = 0;
+	if (zgfx_decompress(client->zgfx, Stream_Buffer(client->data), length, &data, &size, 0) < 0)
+		return test_fail("zgfx_decompress failed");
+
+	BOOL rc = FALSE;
+	wStream sbuffer = WINPR_C_ARRAY_INIT;
+	wStream* s = Stream_StaticConstInit(&sbuffer, data, size);
+	while (Stream_GetRemainingLength(s) > 0)
+	{
+		UINT16 cmdId = 0;
+		UINT32 pduLength = 0;
+
+		if ((message->count >= TEST_MAX_PDUS) || !Stream_CheckAndLogRequiredLength("", s, 8))
+			goto fail;
+		Stream_Read_UINT16(s, cmdId);
+		Stream_Seek_UINT16(s); /* flags */
+		Stream_Read_UINT32(s, pduLength);
+		if ((pduLength < 8) || !Stream_SafeSeek(s, pduLength - 8))
+			goto fail;
+		message->cmdIds[message->count++] = cmdId;
+	}
+	rc = TRUE;
+
+fail:
+	free(data);
+	if (!rc)
+		return test_fail("malformed rdpgfx PDU");
+	return TRUE;
+}
+
+/* Send the queued data and reassemble the channel messages of the gfx channel */
+static BOOL test_flush(HANDLE hServer, test_client_t* client)
+{
+	client->count = 0;
+	ArrayList_Clear(g_Sent);
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(hServer))
+		return FALSE;
+
+	for (size_t x = 0; x < ArrayList_Count(g_Sent); x++)
+	{
+		wStream* s = ArrayList_GetItem(g_Sent, x);
+		const BYTE header = Stream_Get_UINT8(s);
+		const BYTE Cmd = header >> 4;
+		const BYTE Sp = (header >> 2) & 0x03;
+		const BYTE cbChId = header & 0x03;
+
+		if (Cmd == CREATE_REQUEST_PDU)
+			continue;
+		if (test_read_variable_uint(s, cbChId) != client->channelId)
+			return test_fail("data of an unexpected channel");
+
+		switch (Cmd)
+		{
+			case DATA_FIRST_PDU:
+				client->expected = test_read_variable_uint(s, Sp);
+				break;
+			case DATA_PDU:
+				break;
+			default:
+				return test_fail("unexpected dynamic channel PDU");
+		}
+
+		const size_t length = Stream_GetRemainingLength(s);
+		if (!Stream_EnsureRemainingCapacity(client->data, length))
+			return FALSE;
+		Stream_Write(client->data, Stream_ConstPointer(s), length);
+
+		/* A message without DATA_FIRST is a single PDU */
+		if ((client->expected == 0) || (Stream_GetPosition(client->data) >= client->expected))
+		{
+			if (!test_decode_message(client))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static BOOL test_check_message(const test_client_t* client, size_t index, const UINT16* cmdIds,
+                               size_t count)
+{
+	if (index >= client->count)
+		return test_fail("message missing");
+
+	const test_message_t* message = &client->messages[index];
+	if ((message->count != count) ||
+	    (memcmp(message->cmdIds, cmdIds, count * sizeof(UINT16)) != 0))
+		return test_fail("unexpected PDUs in a message");
+	return TRUE;
+}
+
+static BOOL test_channel_id_assigned(RdpgfxServerContext* context, UINT32 channelId)
+{
+	test_client_t* client = context->custom;
+	client->channelId = channelId;
+	return TRUE;
+}
+
+static BOOL test_start_frame(RdpgfxServerContext* context, UINT32 frameId)
+{
+	const RDPGFX_START_FRAME_PDU startFrame = { .timestamp = 0, .frameId = frameId };
+	return context->StartFrame(context, &startFrame) == CHANNEL_RC_OK;
+}
+
+static BOOL test_end_frame(RdpgfxServerContext* context, UINT32 frameId)
+{
+	const RDPGFX_END_FRAME_PDU endFrame = { .frameId = frameId };
+	return context->EndFrame(context, &endFrame) == CHANNEL_RC_OK;
+}
+
+static BOOL test_solid_fill(RdpgfxServerContext* context)
+{
+	RECTANGLE_16 rect = { .left = 0, .top = 0, .right = 64, .bottom = 64 };
+	const RDPGFX_SOLID_FILL_PDU solidFill = { .surfaceId = 1,
+		                                      .fillPixel = WINPR_C_ARRAY_INIT,
+		                                      .fillRectCount = 1,
+		                                      .fillRects = &rect };
+	return context->SolidFill(context, &solidFill) == CHANNEL_RC_OK;
+}
+
+static BOOL test_surface_command(RdpgfxServerContext* context, BYTE* bitmap)
+{
+	const RDPGFX_SURFACE_COMMAND cmd = { .surfaceId = 1,
+		                                 .codecId = RDPGFX_CODECID_UNCOMPRESSED,
+		                                 .format = PIXEL_FORMAT_BGRX32,
+		                                 .right = 500,
+		                                 .bottom = 200,
+		                                 .width = 500,
+		                                 .height = 200,
+		                                 .length = TEST_BITMAP_SIZE,
+		                                 .data = bitmap };
+	return context->SurfaceCommand(context, &cmd) == CHANNEL_RC_OK;
+}
+
+/* Without a batch every PDU is a message of its own */
+static BOOL test_unbatched(HANDLE hServer, RdpgfxServerContext* context, test_client_t* client)
+{
+	const UINT16 start[] = { RDPGFX_CMDID_STARTFRAME };
+	const UINT16 end[] = { RDPGFX_CMDID_ENDFRAME };
+
+	if (!test_start_frame(context, 1) || !test_end_frame(context, 1))
+		return test_fail("sending the frame failed");
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if (client->count != 2)
+		return test_fail("unexpected number of messages");
+	return test_check_message(client, 0, start, ARRAYSIZE(start)) &&
+	       test_check_message(client, 1, end, ARRAYSIZE(end));
+}
+
+static BOOL test_batched(HANDLE hServer, RdpgfxServerContext* context, test_client_t* client)
+{
+	const UINT16 frame[] = { RDPGFX_CMDID_STARTFRAME, RDPGFX_CMDID_SOLIDFILL,
+		                     RDPGFX_CMDID_ENDFRAME };
+
+	if (!rdpgfx_server_batch_begin(context))
+		return test_fail("rdpgfx_server_batch_begin failed");
+	if (!test_start_frame(context, 2) || !test_solid_fill(context) || !test_end_frame(context, 2))
+		return test_fail("sending the frame failed");
+
+	/* Nothing is sent before the batch ends */
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if (client->count != 0)
+		return test_fail("a batched PDU was sent early");
+
+	if (rdpgfx_server_batch_end(context) != CHANNEL_RC_OK)
+		return test_fail("rdpgfx_server_batch_end failed");
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if (client->count != 1)
+		return test_fail("the frame was not sent as one message");
+	return test_check_message(client, 0, frame, ARRAYSIZE(frame));
+}
+
+static BOOL test_batch_errors(HANDLE hServer, RdpgfxServerContext* context, test_client_t* client)
+{
+	if (rdpgfx_server_batch_end(context) != ERROR_INVALID_STATE)
+		return test_fail("a batch ended that was not started");
+	if (!rdpgfx_server_batch_begin(context))
+		return test_fail("rdpgfx_server_batch_begin failed");
+	if (rdpgfx_server_batch_begin(context))
+		return test_fail("a batch started twice");
+
+	/* An empty batch sends nothing */
+	if (rdpgfx_server_batch_end(context) != CHANNEL_RC_OK)
+		return test_fail("rdpgfx_server_batch_end failed");
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if (client->count != 0)
+		return test_fail("an empty batch was sent");
+	return TRUE;
+}
+
+static DWORD WINAPI test_other_thread(LPVOID arg)
+{
+	RdpgfxServerContext* context = arg;
+	return test_start_frame(context, 3) ? 0 : 1;
+}
+
+/* PDUs of other threads are not held back by the batch of this thread */
+static BOOL test_batch_other_thread(HANDLE hServer, RdpgfxServerContext* context,
+                                    test_client_t* client)
+{
+	const UINT16 start[] = { RDPGFX_CMDID_STARTFRAME };
+	const UINT16 end[] = { RDPGFX_CMDID_ENDFRAME };
+	DWORD exitCode = 1;
+
+	if (!rdpgfx_server_batch_begin(context))
+		return test_fail("rdpgfx_server_batch_begin failed");
+
+	HANDLE thread = CreateThread(nullptr, 0, test_other_thread, context, 0, nullptr);
+	if (!thread)
+		return FALSE;
+	(void)WaitForSingleObject(thread, INFINITE);
+	(void)GetExitCodeThread(thread, &exitCode);
+	(void)CloseHandle(thread);
+	if (exitCode != 0)
+		return test_fail("sending from another thread failed");
+
+	if (!test_end_frame(context, 3))
+		return test_fail("sending the frame failed");
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if (!test_check_message(client, 0, start, ARRAYSIZE(start)) || (client->count != 1))
+		return test_fail("the PDU of the other thread was batched");
+
+	if (rdpgfx_server_batch_end(context) != CHANNEL_RC_OK)
+		return test_fail("rdpgfx_server_batch_end failed");
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if (client->count != 1)
+		return test_fail("unexpected number of messages");
+	return test_check_message(client, 0, end, ARRAYSIZE(end));
+}
+
+/* A batch that would exceed the segment limit is flushed before the PDU that does not fit */
+static BOOL test_batch_limit(HANDLE hServer, RdpgfxServerContext* context, test_client_t* client,
+                             BYTE* bitmap)
+{
+	const UINT16 first[] = { RDPGFX_CMDID_STARTFRAME, RDPGFX_CMDID_WIRETOSURFACE_1,
+		                     RDPGFX_CMDID_WIRETOSURFACE_1 };
+	const UINT16 second[] = { RDPGFX_CMDID_WIRETOSURFACE_1, RDPGFX_CMDID_ENDFRAME };
+
+	if (!rdpgfx_server_batch_begin(context))
+		return test_fail("rdpgfx_server_batch_begin failed");
+	if (!test_start_frame(context, 4))
+		return test_fail("sending the frame failed");
+	for (size_t x = 0; x < 3; x++)
+	{
+		if (!test_surface_command(context, bitmap))
+			return test_fail("sending the surface command failed");
+	}
+	if (!test_end_frame(context, 4))
+		return test_fail("sending the frame failed");
+	if (rdpgfx_server_batch_end(context) != CHANNEL_RC_OK)
+		return test_fail("rdpgfx_server_batch_end failed");
+
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if (client->count != 2)
+		return test_fail("the batch was not split");
+	return test_check_message(client, 0, first, ARRAYSIZE(first)) &&
+	       test_check_message(client, 1, second, ARRAYSIZE(second));
+}
+
+/* A batch is also flushed when it holds RDPGFX_BATCH_MAX_PDUS PDUs */
+static BOOL test_batch_count(HANDLE hServer, RdpgfxServerContext* context, test_client_t* client)
+{
+	const size_t fills = RDPGFX_BATCH_MAX_PDUS + 10;
+
+	if (!rdpgfx_server_batch_begin(context))
+		return test_fail("rdpgfx_server_batch_begin failed");
+	if (!test_start_frame(context, 5))
+		return test_fail("sending the frame failed");
+	for (size_t x = 0; x < fills; x++)
+	{
+		if (!test_solid_fill(context))
+			return test_fail("sending the solid fill failed");
+	}
+	if (!test_end_frame(context, 5))
+		return test_fail("sending the frame failed");
+	if (rdpgfx_server_batch_end(context) != CHANNEL_RC_OK)
+		return test_fail("rdpgfx_server_batch_end failed");
+
+	if (!test_flush(hServer, client))
+		return FALSE;
+	if ((client->count != 2) || (client->messages[0].count != RDPGFX_BATCH_MAX_PDUS) ||
+	    (client->messages[1].count != fills + 2 - RDPGFX_BATCH_MAX_PDUS))
+		return test_fail("the batch was not split by the number of PDUs");
+
+	const test_message_t* first = &client->messages[0];
+	const test_message_t* second = &client->messages[1];
+	if ((first->cmdIds[0] != RDPGFX_CMDID_STARTFRAME) ||
+	    (first->cmdIds[first->count - 1] != RDPGFX_CMDID_SOLIDFILL) ||
+	    (second->cmdIds[second->count - 1] != RDPGFX_CMDID_ENDFRAME))
+		return test_fail("unexpected PDUs in a message");
+	return TRUE;
+}
+
+int TestRdpgfxServerBatch(int argc, char* argv[])
+{
+	int rc = -1;
+	HANDLE hServer = INVALID_HANDLE_VALUE;
+	RdpgfxServerContext* context = nullptr;
+	test_client_t client = WINPR_C_ARRAY_INIT;
+	BYTE* bitmap = calloc(TEST_BITMAP_SIZE, 1);
+	freerdp_peer* peer = calloc(1, sizeof(freerdp_peer));
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	g_Sent = ArrayList_New(FALSE);
+	client.zgfx = zgfx_context_new(FALSE);
+	client.data = Stream_New(nullptr, 1024);
+	if (!bitmap || !peer || !g_Sent || !client.zgfx || !client.data)
+		goto fail;
+	ArrayList_Object(g_Sent)->fnObjectFree = test_free_pdu;
+
+	for (size_t x = 0; x < TEST_BITMAP_SIZE; x++)
+		bitmap[x] = (BYTE)(rand() & 0xFF);
+
+	peer->ContextSize = sizeof(rdpContext);
+	if (!freerdp_peer_context_new(peer))
+		goto fail;
+	peer->SendChannelData = test_send_channel_data;
+
+	{
+		rdpMcs* mcs = peer->context->rdp->mcs;
+		rdpMcsChannel* mchannel = &mcs->channels[0];
+		(void)strncpy(mchannel->Name, DRDYNVC_SVC_CHANNEL_NAME, sizeof(mchannel->Name) - 1);
+		mchannel->ChannelId = TEST_DRDYNVC_ID;
+		mchannel->joined = TRUE;
+		mcs->channelCount = 1;
+	}
+
+	if (!WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi()))
+		goto fail;
+
+	hServer = WTSOpenServerA((LPSTR)peer->context);
+	if (hServer == INVALID_HANDLE_VALUE)
+		goto fail;
+
+	/* Send the capabilities request and answer it with version 3 */
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(hServer))
+		goto fail;
+
+	{
+		const BYTE caps[] = { 0x50, 0x00, 0x03, 0x00 };
+		if (!peer->ReceiveChannelData(peer, TEST_DRDYNVC_ID, caps, sizeof(caps),
+		                              CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, sizeof(caps)))
+			goto fail;
+	}
+
+	context = rdpgfx_server_context_new(hServer);
+	if (!context)
+		goto fail;
+	context->custom = &client;
+	context->ChannelIdAssigned = test_channel_id_assigned;
+	if (!context->Initialize(context, TRUE) || !context->Open(context))
+		goto fail;
+
+	{
+		RDPGFX_CAPSET capsSet = { .version = RDPGFX_CAPVERSION_10, .length = 4, .flags = 0 };
+		const RDPGFX_CAPS_CONFIRM_PDU capsConfirm = { .capsSet = &capsSet };
+		const UINT16 confirm[] = { RDPGFX_CMDID_CAPSCONFIRM };
+
+		if (context->CapsConfirm(context, &capsConfirm) != CHANNEL_RC_OK)
+			goto fail;
+		if (!test_flush(hServer, &client) || (client.count != 1) ||
+		    !test_check_message(&client, 0, confirm, ARRAYSIZE(confirm)))
+			goto fail;
+	}
+
+	if (!test_unbatched(hServer, context, &client))
+		goto fail;
+	if (!test_batched(hServer, context, &client))
+		goto fail;
+	if (!test_batch_errors(hServer, context, &client))
+		goto fail;
+	if (!test_batch_other_thread(hServer, context, &client))
+		goto fail;
+	if (!test_batch_limit(hServer, context, &client, bitmap))
+		goto fail;
+
+	if (!test_batch_count(hServer, context, &client))
+		goto fail;
+
+	rc = 0;
+fail:
+	rdpgfx_server_context_free(context);
+	if (hServer != INVALID_HANDLE_VALUE)
+		WTSCloseServer(hServer);
+	if (peer)
+		freerdp_peer_context_free(peer);
+	free(peer);
+	zgfx_context_free(client.zgfx);
+	Stream_Free(client.data, TRUE);
+	ArrayList_Free(g_Sent);
+	free(bitmap);
+	return rc;
+}
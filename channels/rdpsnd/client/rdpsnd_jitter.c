@@ -0,0 +1,250 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - adaptive jitter buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+
+#include <freerdp/types.h>
+
+#include "rdpsnd_jitter.h"
+
+void rdpsnd_jitter_reset(RDPSND_JITTER_BUFFER* jb, UINT32 latency, UINT32 maxDelay)
+{
+	WINPR_ASSERT(jb);
+
+	const RDPSND_JITTER_BUFFER empty = WINPR_C_ARRAY_INIT;
+	*jb = empty;
+	jb->minDelay = MAX(RDPSND_JITTER_MIN_DELAY, latency);
+	jb->adaptive = maxDelay != 0;
+	jb->maxDelay = MAX(maxDelay, jb->minDelay);
+	if (!jb->adaptive)
+		jb->minDelay = latency;
+	jb->targetDelay = jb->minDelay;
+}
+
+void rdpsnd_jitter_arrival(RDPSND_JITTER_BUFFER* jb, UINT16 wTimeStamp, UINT64 arrival,
+                           UINT32 duration)
+{
+	WINPR_ASSERT(jb);
+
+	/* wTimeStamp wraps every 65536 ms, so compare the transit times in the same domain */
+	const UINT16 transit = (UINT16)((arrival & UINT16_MAX) - wTimeStamp);
+	if (jb->haveTransit)
+	{
+		const INT16 d = (INT16)(transit - (UINT16)jb->lastTransit);
+		const UINT32 ad = (UINT32)abs(d);
+
+		/* J += (|D| - J) / 16, kept in 1/16 ms for precision */
+		jb->jitter = jb->jitter + ad - ((jb->jitter + 8) >> 4);
+	}
+	jb->lastTransit = transit;
+	jb->haveTransit = TRUE;
+
+	if (!jb->adaptive)
+		return;
+
+	/* Hold one wave plus four times the mean deviation (jitter / 4 in 1/16 ms) */
+	const UINT32 target = duration + jb->jitter / 4;
+	jb->targetDelay = MIN(MAX(target, jb->minDelay), jb->maxDelay);
+}
+
+UINT32 rdpsnd_jitter_playout_delay(const RDPSND_JITTER_BUFFER* jb, UINT64 now)
+{
+	WINPR_ASSERT(jb);
+	if (jb->queueEnd <= now)
+		return 0;
+	return (UINT32)MIN(UINT32_MAX, jb->queueEnd - now);
+}
+
+RDPSND_JITTER_ACTION rdpsnd_jitter_schedule(RDPSND_JITTER_BUFFER* jb, UINT64 now, UINT32 duration)
+{
+	WINPR_ASSERT(jb);
+
+	/* Compressed formats where the duration is unknown can not be scheduled */
+	if (duration == 0)
+		return RDPSND_JITTER_PLAY;
+
+	const UINT32 buffered = rdpsnd_jitter_playout_delay(jb, now);
+	if (!jb->adaptive)
+	{
+		/* Legacy behaviour: Drop everything above two waves plus the configured latency */
+		if ((jb->queueEnd != 0) && (buffered + duration > duration * 2 + jb->minDelay))
+		{
+			jb->dropped++;
+			return RDPSND_JITTER_DROP;
+		}
+		return RDPSND_JITTER_PLAY;
+	}
+
+	if (buffered == 0)
+	{
+		/* Stream start or device underrun: rebuild the playout delay */
+		if (rdpsnd_jitter_conceal_amount(jb, duration) == 0)
+			return RDPSND_JITTER_PLAY;
+		jb->concealed++;
+		return RDPSND_JITTER_CONCEAL;
+	}
+
+	/* Older servers do not limit the amount of data sent ahead. Far above the upper
+	 * bound there is no way to catch up by stretching, so drop the wave */
+	if (buffered > jb->maxDelay)
+	{
+		jb->dropped++;
+		return RDPSND_JITTER_DROP;
+	}
+
+	if (buffered > jb->targetDelay + duration / 2)
+	{
+		if (rdpsnd_jitter_stretch_amount(jb, now, duration) == 0)
+			return RDPSND_JITTER_PLAY;
+		jb->stretched++;
+		return RDPSND_JITTER_STRETCH;
+	}
+
+	return RDPSND_JITTER_PLAY;
+}
+
+UINT32 rdpsnd_jitter_stretch_amount(const RDPSND_JITTER_BUFFER* jb, UINT64 now, UINT32 duration)
+{
+	WINPR_ASSERT(jb);
+
+	const UINT32 buffered = rdpsnd_jitter_playout_delay(jb, now);
+	if (buffered <= jb->targetDelay)
+		return 0;
+
+	const UINT32 excess = buffered - jb->targetDelay;
+	return MIN(excess, duration * RDPSND_JITTER_MAX_STRETCH / 100);
+}
+
+UINT32 rdpsnd_jitter_conceal_amount(const RDPSND_JITTER_BUFFER* jb, UINT32 duration)
+{
+	WINPR_ASSERT(jb);
+
+	if (jb->targetDelay <= duration)
+		return 0;
+	return jb->targetDelay - duration;
+}
+
+void rdpsnd_jitter_commit(RDPSND_JITTER_BUFFER* jb, UINT64 now, UINT32 duration)
+{
+	WINPR_ASSERT(jb);
+
+	if (duration == 0)
+		return;
+
+	if (jb->queueEnd < now)
+		jb->queueEnd = now;
+	jb->queueEnd += duration;
+	jb->played++;
+}
+
+UINT32 rdpsnd_jitter_duration(const AUDIO_FORMAT* format, size_t size)
+{
+	WINPR_ASSERT(format);
+
+	/* Only formats with a constant bitrate allow calculating the duration
+	 * without decompressing the sample first. */
+	switch (format->wFormatTag)
+	{
+		case WAVE_FORMAT_PCM:
+		case WAVE_FORMAT_DVI_ADPCM:
+		case WAVE_FORMAT_ADPCM:
+		case WAVE_FORMAT_ALAW:
+		case WAVE_FORMAT_MULAW:
+			break;
+		default:
+			return 0;
+	}
+
+	const size_t bps = 1ull * format->nChannels * format->wBitsPerSample * format->nSamplesPerSec;
+	if (bps < 8)
+		return 0;
+
+	return (UINT32)MIN(UINT32_MAX, 8000ull * size / bps);
+}
+
+static BOOL rdpsnd_jitter_is_pcm16(const AUDIO_FORMAT* format)
+{
+	WINPR_ASSERT(format);
+	return (format->wFormatTag == WAVE_FORMAT_PCM) && (format->wBitsPerSample == 16) &&
+	       (format->nChannels > 0) && (format->nSamplesPerSec > 0);
+}
+
+BOOL rdpsnd_jitter_stretch_pcm(const AUDIO_FORMAT* format, const BYTE* data, size_t size,
+                               UINT32 ms, wStream* out)
+{
+	WINPR_ASSERT(data || (size == 0));
+	WINPR_ASSERT(out);
+
+	if (!rdpsnd_jitter_is_pcm16(format))
+		return FALSE;
+
+	const size_t channels = format->nChannels;
+	const size_t frames = size / (2ull * channels);
+	const size_t remove = 1ull * ms * format->nSamplesPerSec / 1000ull;
+	if ((frames < 2) || (remove == 0) || (remove > frames / 2))
+		return FALSE;
+
+	const size_t outFrames = frames - remove;
+	if (!Stream_EnsureRemainingCapacity(out, outFrames * channels * 2ull))
+		return FALSE;
+
+	/* Linear interpolation over the whole wave spreads the pitch change evenly,
+	 * which is far less audible than cutting out a block of samples. */
+	const UINT64 step = ((1ull * (frames - 1)) << 16) / (outFrames - 1);
+	const INT16* src = (const INT16*)data;
+	for (size_t x = 0; x < outFrames; x++)
+	{
+		const UINT64 pos = step * x;
+		const size_t idx = MIN((size_t)(pos >> 16), frames - 1);
+		const size_t next = MIN(idx + 1, frames - 1);
+		const INT32 frac = (INT32)(pos & 0xFFFF);
+
+		for (size_t c = 0; c < channels; c++)
+		{
+			const INT32 a = src[idx * channels + c];
+			const INT32 b = src[next * channels + c];
+			const INT32 v = a + (INT32)(((INT64)(b - a) * frac) >> 16);
+			Stream_Write_INT16(out, (INT16)v);
+		}
+	}
+	return TRUE;
+}
+
+BOOL rdpsnd_jitter_silence_pcm(const AUDIO_FORMAT* format, UINT32 ms, wStream* out)
+{
+	WINPR_ASSERT(format);
+	WINPR_ASSERT(out);
+
+	if ((format->wFormatTag != WAVE_FORMAT_PCM) || (format->nChannels == 0))
+		return FALSE;
+
+	const size_t bpf = 1ull * format->nChannels * ((format->wBitsPerSample + 7) / 8);
+	const size_t frames = 1ull * ms * format->nSamplesPerSec / 1000ull;
+	const size_t size = frames * bpf;
+	if (!Stream_EnsureRemainingCapacity(out, size))
+		return FALSE;
+
+	/* 8bit PCM is unsigned, silence is the center value */
+	Stream_Fill(out, (format->wBitsPerSample == 8) ? 0x80 : 0x00, size);
+	return TRUE;
+}
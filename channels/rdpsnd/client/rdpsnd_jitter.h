@@ -0,0 +1,116 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - adaptive jitter buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_RDPSND_CLIENT_JITTER_H
+#define FREERDP_CHANNEL_RDPSND_CLIENT_JITTER_H
+
+#include <winpr/wtypes.h>
+#include <winpr/stream.h>
+
+#include <freerdp/api.h>
+#include <freerdp/codec/audio.h>
+
+/** Lower bound of the adaptive playout delay in ms */
+#define RDPSND_JITTER_MIN_DELAY 20
+/** Default upper bound of the adaptive playout delay in ms */
+#define RDPSND_JITTER_DEFAULT_MAX_DELAY 300
+/** Maximum amount of a single wave (in percent) removed by time stretching */
+#define RDPSND_JITTER_MAX_STRETCH 10
+
+typedef enum
+{
+	RDPSND_JITTER_PLAY,    /** play the wave unmodified */
+	RDPSND_JITTER_STRETCH, /** play the wave time compressed to drain excess delay */
+	RDPSND_JITTER_CONCEAL, /** the device ran dry, prepend silence to rebuild the delay */
+	RDPSND_JITTER_DROP     /** the queue is far above target, drop the wave */
+} RDPSND_JITTER_ACTION;
+
+typedef struct
+{
+	/* configuration */
+	UINT32 minDelay;
+	UINT32 maxDelay;
+	BOOL adaptive;
+
+	/* RFC 3550 interarrival jitter estimate, in 1/16 ms */
+	BOOL haveTransit;
+	INT32 lastTransit;
+	UINT32 jitter;
+	UINT32 targetDelay;
+
+	/* estimated time at which the device runs out of queued audio */
+	UINT64 queueEnd;
+
+	/* statistics */
+	UINT64 played;
+	UINT64 stretched;
+	UINT64 concealed;
+	UINT64 dropped;
+} RDPSND_JITTER_BUFFER;
+
+/** @brief (Re)initialize the jitter buffer, called whenever the device is (re)opened
+ *
+ *  @param latency The user configured minimum latency in ms (0 for default)
+ *  @param maxDelay The upper bound of the playout delay in ms, 0 disables the adaptive buffer
+ */
+FREERDP_LOCAL void rdpsnd_jitter_reset(RDPSND_JITTER_BUFFER* jb, UINT32 latency, UINT32 maxDelay);
+
+/** @brief Update the jitter estimate with the arrival of a wave
+ *
+ *  @param wTimeStamp The server timestamp of the wave in ms
+ *  @param arrival The local arrival time of the wave (GetTickCount64)
+ *  @param duration The wave duration in ms, 0 if unknown
+ */
+FREERDP_LOCAL void rdpsnd_jitter_arrival(RDPSND_JITTER_BUFFER* jb, UINT16 wTimeStamp,
+                                         UINT64 arrival, UINT32 duration);
+
+/** @brief Decide how to play a wave of \b duration ms at time \b now */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL RDPSND_JITTER_ACTION rdpsnd_jitter_schedule(RDPSND_JITTER_BUFFER* jb, UINT64 now,
+                                                          UINT32 duration);
+
+/** @brief Number of ms to remove from the next wave when stretching */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL UINT32 rdpsnd_jitter_stretch_amount(const RDPSND_JITTER_BUFFER* jb, UINT64 now,
+                                                  UINT32 duration);
+
+/** @brief Number of ms of silence to insert when concealing an underrun */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL UINT32 rdpsnd_jitter_conceal_amount(const RDPSND_JITTER_BUFFER* jb,
+                                                  UINT32 duration);
+
+/** @brief Account \b duration ms of audio handed to the device at time \b now */
+FREERDP_LOCAL void rdpsnd_jitter_commit(RDPSND_JITTER_BUFFER* jb, UINT64 now, UINT32 duration);
+
+/** @brief The estimated delay until audio queued now is audible, in ms */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL UINT32 rdpsnd_jitter_playout_delay(const RDPSND_JITTER_BUFFER* jb, UINT64 now);
+
+/** @brief Duration of \b size bytes of \b format in ms, 0 if it can not be calculated */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL UINT32 rdpsnd_jitter_duration(const AUDIO_FORMAT* format, size_t size);
+
+/** @brief Time compress 16bit PCM by \b ms milliseconds into \b out */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL rdpsnd_jitter_stretch_pcm(const AUDIO_FORMAT* format, const BYTE* data,
+                                             size_t size, UINT32 ms, wStream* out);
+
+/** @brief Write \b ms milliseconds of silence of \b format to \b out */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL rdpsnd_jitter_silence_pcm(const AUDIO_FORMAT* format, UINT32 ms, wStream* out);
+
+#endif /* FREERDP_CHANNEL_RDPSND_CLIENT_JITTER_H */
@@ -50,6 +50,7 @@
 
 #include "rdpsnd_common.h"
 #include "rdpsnd_main.h"
+#include "rdpsnd_jitter.h"
 
 struct rdpsnd_plugin
 {
@@ -92,8 +93,8 @@ struct rdpsnd_plugin
 	BOOL isOpen;
 	AUDIO_FORMAT* fixed_format;
 
-	UINT32 startPlayTime;
-	size_t totalPlaySize;
+	UINT32 maxDelay;
+	RDPSND_JITTER_BUFFER jitter;
 
 	char* subsystem;
 	char* device_name;
@@ -444,8 +445,7 @@ static BOOL rdpsnd_ensure_device_is_open(rdpsndPlugin* rdpsnd, UINT16 wFormatNo,
 
 		rdpsnd->isOpen = TRUE;
 		rdpsnd->wCurrentFormatNo = wFormatNo;
-		rdpsnd->startPlayTime = 0;
-		rdpsnd->totalPlaySize = 0;
+		rdpsnd_jitter_reset(&rdpsnd->jitter, rdpsnd->latency, rdpsnd->maxDelay);
 	}
 
 	return rdpsnd_apply_volume(rdpsnd);
@@ -517,92 +517,93 @@ static UINT rdpsnd_send_wave_confirm_pdu(rdpsndPlugin* rdpsnd, UINT16 wTimeStamp
 	return rdpsnd_virtual_channel_write(rdpsnd, pdu);
 }
 
-static BOOL rdpsnd_detect_overrun(rdpsndPlugin* rdpsnd, const AUDIO_FORMAT* format, size_t size)
+static UINT rdpsnd_device_play(rdpsndPlugin* rdpsnd, const AUDIO_FORMAT* format, const BYTE* data,
+                               size_t size)
 {
-	UINT32 bpf = 0;
-	UINT32 now = 0;
-	UINT32 duration = 0;
-	UINT32 totalDuration = 0;
-	UINT32 remainingDuration = 0;
-	UINT32 maxDuration = 0;
-
-	if (!rdpsnd || !format)
-		return FALSE;
+	WINPR_ASSERT(rdpsnd);
+	WINPR_ASSERT(rdpsnd->device);
 
-	/* Older windows RDP servers do not limit the send buffer, which can
-	 * cause quite a large amount of sound data buffered client side.
-	 * If e.g. sound is paused server side the client will keep playing
-	 * for a long time instead of pausing playback.
-	 *
-	 * To avoid this we check:
-	 *
-	 * 1. Is the sound sample received from a known format these servers
-	 *    support
-	 * 2. If it is calculate the size of the client side sound buffer
-	 * 3. If the buffer is too large silently drop the sample which will
-	 *    trigger a retransmit later on.
-	 *
-	 * This check must only be applied to these known formats, because
-	 * with newer and other formats the sample size can not be calculated
-	 * without decompressing the sample first.
-	 */
-	switch (format->wFormatTag)
-	{
-		case WAVE_FORMAT_PCM:
-		case WAVE_FORMAT_DVI_ADPCM:
-		case WAVE_FORMAT_ADPCM:
-		case WAVE_FORMAT_ALAW:
-		case WAVE_FORMAT_MULAW:
-			break;
-		case WAVE_FORMAT_MSG723:
-		case WAVE_FORMAT_GSM610:
-		case WAVE_FORMAT_AAC_MS:
-		default:
-			return FALSE;
-	}
+	if (rdpsnd->device->PlayEx)
+		return rdpsnd->device->PlayEx(rdpsnd->device, format, data, size);
+	return IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device, data, size);
+}
 
-	audio_format_print(WLog_Get(TAG), WLOG_DEBUG, format);
-	bpf = format->nChannels * format->wBitsPerSample * format->nSamplesPerSec / 8;
-	if (bpf == 0)
-		return FALSE;
+/* Time compress or prefix the wave with silence, returns the modified wave or nullptr */
+static wStream* rdpsnd_jitter_adjust(rdpsndPlugin* rdpsnd, RDPSND_JITTER_ACTION action,
+                                     const AUDIO_FORMAT* pcmFormat, const BYTE* data, size_t size,
+                                     UINT32 amount)
+{
+	WINPR_ASSERT(rdpsnd);
 
-	duration = (UINT32)(1000 * size / bpf);
-	totalDuration = (UINT32)(1000 * rdpsnd->totalPlaySize / bpf);
-	now = GetTickCountPrecise();
-	if (rdpsnd->startPlayTime == 0)
+	if (!pcmFormat)
+		return nullptr;
+
+	wStream* out = StreamPool_Take(rdpsnd->pool, size);
+	if (!out)
+		return nullptr;
+
+	if (action == RDPSND_JITTER_STRETCH)
 	{
-		rdpsnd->startPlayTime = now;
-		rdpsnd->totalPlaySize = size;
-		return FALSE;
+		if (rdpsnd_jitter_stretch_pcm(pcmFormat, data, size, amount, out))
+			return out;
 	}
-	else if (now - rdpsnd->startPlayTime > totalDuration + 10)
+	else if (rdpsnd_jitter_silence_pcm(pcmFormat, amount, out) &&
+	         Stream_EnsureRemainingCapacity(out, size))
 	{
-		/* Buffer underrun */
-		WLog_Print(rdpsnd->log, WLOG_DEBUG, "%s Buffer underrun by %u ms",
-		           rdpsnd_is_dyn_str(rdpsnd->dynamic),
-		           (UINT)(now - rdpsnd->startPlayTime - totalDuration));
-		rdpsnd->startPlayTime = now;
-		rdpsnd->totalPlaySize = size;
-		return FALSE;
+		Stream_Write(out, data, size);
+		return out;
 	}
-	else
+
+	Stream_Release(out);
+	return nullptr;
+}
+
+/* Hand a wave to the device according to the jitter buffer decision and
+ * return the number of ms of audio actually queued. */
+static UINT32 rdpsnd_jitter_play(rdpsndPlugin* rdpsnd, const AUDIO_FORMAT* format,
+                                 const AUDIO_FORMAT* pcmFormat, const BYTE* data, size_t size,
+                                 UINT32 duration, UINT64 now, UINT* latency)
+{
+	WINPR_ASSERT(rdpsnd);
+	WINPR_ASSERT(latency);
+
+	RDPSND_JITTER_BUFFER* jb = &rdpsnd->jitter;
+	const RDPSND_JITTER_ACTION action = rdpsnd_jitter_schedule(jb, now, duration);
+
+	if (action == RDPSND_JITTER_DROP)
 	{
-		/* Calculate remaining duration to be played */
-		remainingDuration = totalDuration - (now - rdpsnd->startPlayTime);
+		/* Dropped samples trigger a retransmit later on */
+		WLog_Print(rdpsnd->log, WLOG_DEBUG,
+		           "%s Buffer overrun pending %" PRIu32 " ms dropping %" PRIu32 " ms",
+		           rdpsnd_is_dyn_str(rdpsnd->dynamic), rdpsnd_jitter_playout_delay(jb, now),
+		           duration);
+		return 0;
+	}
 
-		/* Maximum allow duration calculation */
-		maxDuration = duration * 2 + rdpsnd->latency;
+	if (action != RDPSND_JITTER_PLAY)
+	{
+		const BOOL stretch = action == RDPSND_JITTER_STRETCH;
+		const UINT32 amount = stretch ? rdpsnd_jitter_stretch_amount(jb, now, duration)
+		                              : rdpsnd_jitter_conceal_amount(jb, duration);
+		wStream* out = rdpsnd_jitter_adjust(rdpsnd, action, pcmFormat, data, size, amount);
 
-		if (remainingDuration + duration > maxDuration)
+		/* Formats other than PCM are played unmodified */
+		if (out)
 		{
-			WLog_Print(rdpsnd->log, WLOG_DEBUG, "%s Buffer overrun pending %u ms dropping %u ms",
-			           rdpsnd_is_dyn_str(rdpsnd->dynamic), remainingDuration, duration);
-			return TRUE;
+			WLog_Print(rdpsnd->log, WLOG_DEBUG,
+			           "%s Jitter %" PRIu32 " ms, target delay %" PRIu32 " ms: %s %" PRIu32
+			           " ms",
+			           rdpsnd_is_dyn_str(rdpsnd->dynamic), jb->jitter / 16, jb->targetDelay,
+			           stretch ? "compressing" : "concealing", amount);
+			*latency = rdpsnd_device_play(rdpsnd, format, Stream_Buffer(out),
+			                              Stream_GetPosition(out));
+			Stream_Release(out);
+			return stretch ? duration - amount : duration + amount;
 		}
-
-		rdpsnd->totalPlaySize += size;
-		return FALSE;
 	}
+
+	*latency = rdpsnd_device_play(rdpsnd, format, data, size);
+	return duration;
 }
 
 static UINT rdpsnd_treat_wave(rdpsndPlugin* rdpsnd, wStream* s, size_t size)
@@ -635,31 +636,51 @@ static UINT rdpsnd_treat_wave(rdpsndPlugin* rdpsnd, wStream* s, size_t size)
 	           "%s Wave: cBlockNo: %" PRIu8 " wTimeStamp: %" PRIu16 ", size: %" PRIuz,
 	           rdpsnd_is_dyn_str(rdpsnd->dynamic), rdpsnd->cBlockNo, rdpsnd->wTimeStamp, size);
 
-	if (rdpsnd->device && rdpsnd->attached && !rdpsnd_detect_overrun(rdpsnd, format, size))
+	if (rdpsnd->device && rdpsnd->attached)
 	{
 		UINT status = CHANNEL_RC_OK;
 		wStream* pcmData = StreamPool_Take(rdpsnd->pool, 4096);
-
-		if (rdpsnd->device->FormatSupported(rdpsnd->device, format))
+		AUDIO_FORMAT pcmFormat = *format;
+		const BYTE* playData = data;
+		size_t playSize = size;
+
+		/* Older windows RDP servers do not limit the send buffer, which can
+		 * cause quite a large amount of sound data buffered client side.
+		 * If e.g. sound is paused server side the client will keep playing
+		 * for a long time instead of pausing playback.
+		 *
+		 * The duration of each wave is therefore tracked by the jitter buffer,
+		 * which keeps the client side queue close to the measured network jitter.
+		 * For compressed formats the duration is only known after decoding, if
+		 * the device plays them directly the wave is passed on unmodified.
+		 */
+		if (!rdpsnd->device->FormatSupported(rdpsnd->device, format))
 		{
-			if (rdpsnd->device->PlayEx)
-				latency = rdpsnd->device->PlayEx(rdpsnd->device, format, data, size);
+			if (freerdp_dsp_decode(rdpsnd->dsp_context, format, data, size, pcmData))
+			{
+				Stream_SealLength(pcmData);
+				pcmFormat.wFormatTag = WAVE_FORMAT_PCM;
+				pcmFormat.wBitsPerSample = 16;
+				playData = Stream_Buffer(pcmData);
+				playSize = Stream_Length(pcmData);
+			}
 			else
-				latency = IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device, data, size);
+				status = ERROR_INTERNAL_ERROR;
 		}
-		else if (freerdp_dsp_decode(rdpsnd->dsp_context, format, data, size, pcmData))
-		{
-			Stream_SealLength(pcmData);
 
-			if (rdpsnd->device->PlayEx)
-				latency = rdpsnd->device->PlayEx(rdpsnd->device, format, Stream_Buffer(pcmData),
-				                                 Stream_Length(pcmData));
-			else
-				latency = IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device,
-				                       Stream_Buffer(pcmData), Stream_Length(pcmData));
+		if (status == CHANNEL_RC_OK)
+		{
+			const UINT64 now = GetTickCount64();
+			const UINT32 duration = rdpsnd_jitter_duration(&pcmFormat, playSize);
+			const BOOL isPcm = pcmFormat.wFormatTag == WAVE_FORMAT_PCM;
+
+			rdpsnd_jitter_arrival(&rdpsnd->jitter, rdpsnd->wTimeStamp, rdpsnd->wArrivalTime,
+			                      duration);
+			const UINT32 queued =
+			    rdpsnd_jitter_play(rdpsnd, format, isPcm ? &pcmFormat : nullptr, playData,
+			                       playSize, duration, now, &latency);
+			rdpsnd_jitter_commit(&rdpsnd->jitter, now, queued);
 		}
-		else
-			status = ERROR_INTERNAL_ERROR;
 
 		Stream_Release(pcmData);
 
@@ -667,7 +688,12 @@ static UINT rdpsnd_treat_wave(rdpsndPlugin* rdpsnd, wStream* s, size_t size)
 			return status;
 	}
 
+	/*
+	 * Report the estimated playout delay of the queued audio, the device
+	 * latency alone does not account for the jitter buffer.
+	 */
 	end = GetTickCount64();
+	latency = MAX(latency, rdpsnd_jitter_playout_delay(&rdpsnd->jitter, end));
 	diffMS = end - rdpsnd->wArrivalTime + latency;
 	ts = (rdpsnd->wTimeStamp + diffMS) % UINT16_MAX;
 
@@ -922,6 +948,8 @@ static UINT rdpsnd_process_addin_args(rdpsndPlugin* rdpsnd, const ADDIN_ARGV* ar
 		  "latency" },
 		{ "quality", COMMAND_LINE_VALUE_REQUIRED, "<quality mode>", nullptr, nullptr, -1, nullptr,
 		  "quality mode" },
+		{ "jitter", COMMAND_LINE_VALUE_REQUIRED, "<max delay>", nullptr, nullptr, -1, nullptr,
+		  "adaptive jitter buffer" },
 		{ nullptr, 0, nullptr, nullptr, nullptr, -1, nullptr, nullptr }
 	};
 	rdpsnd->wQualityMode = HIGH_QUALITY; /* default quality mode */
@@ -989,6 +1017,17 @@ static UINT rdpsnd_process_addin_args(rdpsndPlugin* rdpsnd, const ADDIN_ARGV* ar
 
 				rdpsnd->latency = (UINT32)val;
 			}
+			CommandLineSwitchCase(arg, "jitter")
+			{
+				errno = 0;
+				unsigned long val = strtoul(arg->Value, nullptr, 0);
+
+				if ((errno != 0) || (val > UINT32_MAX))
+					return CHANNEL_RC_INITIALIZATION_ERROR;
+
+				/* 0 disables the adaptive buffer */
+				rdpsnd->maxDelay = (UINT32)val;
+			}
 			CommandLineSwitchCase(arg, "quality")
 			{
 				long wQualityMode = DYNAMIC_QUALITY;
@@ -1064,6 +1103,7 @@ static UINT rdpsnd_process_connect(rdpsndPlugin* rdpsnd)
 	UINT status = ERROR_INTERNAL_ERROR;
 	WINPR_ASSERT(rdpsnd);
 	rdpsnd->latency = 0;
+	rdpsnd->maxDelay = RDPSND_JITTER_DEFAULT_MAX_DELAY;
 	args = (const ADDIN_ARGV*)rdpsnd->channelEntryPoints.pExtendedData;
 
 	if (args)
@@ -1256,6 +1296,60 @@ static VOID VCAPITYPE rdpsnd_virtual_channel_open_event_ex(LPVOID lpUserParam, D
 	}
 }
 
+static void queue_free(void* obj)
+{
+	wMessage* msg = obj;
+	if (!msg)
+		return;
+	if (msg->id != 0)
+		return;
+	wStream* s = msg->wParam;
+	Stream_Release(s);
+}
+
+static void rdpsnd_terminate_thread(rdpsndPlugin* rdpsnd)
+{
+	WINPR_ASSERT(rdpsnd);
+	if (rdpsnd->queue)
+		MessageQueue_PostQuit(rdpsnd->queue, 0);
+
+	if (rdpsnd->thread)
+	{
+		(void)WaitForSingleObject(rdpsnd->thread, INFINITE);
+		(void)CloseHandle(rdpsnd->thread);
+	}
+
+	MessageQueue_Free(rdpsnd->queue);
+	rdpsnd->thread = nullptr;
+	rdpsnd->queue = nullptr;
+}
+
+static BOOL rdpsnd_start_thread(rdpsndPlugin* rdpsnd)
+{
+	WINPR_ASSERT(rdpsnd);
+	if (!rdpsnd->async)
+		return TRUE;
+
+	if (!rdpsnd->queue)
+	{
+		wObject obj = WINPR_C_ARRAY_INIT;
+
+		obj.fnObjectFree = queue_free;
+		rdpsnd->queue = MessageQueue_New(&obj);
+		if (!rdpsnd->queue)
+			return FALSE;
+	}
+
+	if (!rdpsnd->thread)
+	{
+		rdpsnd->thread = CreateThread(nullptr, 0, play_thread, rdpsnd, 0, nullptr);
+		if (!rdpsnd->thread)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
 /**
  * Function description
  *
@@ -1272,6 +1366,10 @@ static UINT rdpsnd_virtual_channel_event_connected(rdpsndPlugin* rdpsnd, LPVOID
 	WINPR_ASSERT(rdpsnd);
 	WINPR_ASSERT(!rdpsnd->dynamic);
 
+	/* A previous disconnect stopped the playback thread */
+	if (!rdpsnd_start_thread(rdpsnd))
+		return CHANNEL_RC_NO_MEMORY;
+
 	status = rdpsnd->channelEntryPoints.pVirtualChannelOpenEx(
 	    rdpsnd->InitHandle, &opened, rdpsnd->channelDef.name, rdpsnd_virtual_channel_open_event_ex);
 
@@ -1293,23 +1391,6 @@ fail:
 	return CHANNEL_RC_NO_MEMORY;
 }
 
-static void rdpsnd_terminate_thread(rdpsndPlugin* rdpsnd)
-{
-	WINPR_ASSERT(rdpsnd);
-	if (rdpsnd->queue)
-		MessageQueue_PostQuit(rdpsnd->queue, 0);
-
-	if (rdpsnd->thread)
-	{
-		(void)WaitForSingleObject(rdpsnd->thread, INFINITE);
-		(void)CloseHandle(rdpsnd->thread);
-	}
-
-	MessageQueue_Free(rdpsnd->queue);
-	rdpsnd->thread = nullptr;
-	rdpsnd->queue = nullptr;
-}
-
 static void cleanup_internals(rdpsndPlugin* rdpsnd)
 {
 	if (!rdpsnd)
@@ -1340,10 +1421,16 @@ static UINT rdpsnd_virtual_channel_event_disconnected(rdpsndPlugin* rdpsnd)
 
 	WINPR_ASSERT(rdpsnd);
 	WINPR_ASSERT(!rdpsnd->dynamic);
-	if (rdpsnd->OpenHandle != 0)
+
+	const DWORD opened = rdpsnd->OpenHandle;
+	rdpsnd->OpenHandle = 0;
+
+	/* No more PDUs are queued now, but the playback thread might still process one with the
+	 * device */
+	rdpsnd_terminate_thread(rdpsnd);
+
+	if (opened != 0)
 	{
-		DWORD opened = rdpsnd->OpenHandle;
-		rdpsnd->OpenHandle = 0;
 		if (rdpsnd->device)
 			IFCALL(rdpsnd->device->Close, rdpsnd->device);
 
@@ -1368,17 +1455,6 @@ static UINT rdpsnd_virtual_channel_event_disconnected(rdpsndPlugin* rdpsnd)
 	return CHANNEL_RC_OK;
 }
 
-static void queue_free(void* obj)
-{
-	wMessage* msg = obj;
-	if (!msg)
-		return;
-	if (msg->id != 0)
-		return;
-	wStream* s = msg->wParam;
-	Stream_Release(s);
-}
-
 static void free_internals(rdpsndPlugin* rdpsnd)
 {
 	if (!rdpsnd)
@@ -1415,25 +1491,8 @@ static BOOL allocate_internals(rdpsndPlugin* rdpsnd)
 			return FALSE;
 	}
 
-	if (rdpsnd->async)
-	{
-		if (!rdpsnd->queue)
-		{
-			wObject obj = WINPR_C_ARRAY_INIT;
-
-			obj.fnObjectFree = queue_free;
-			rdpsnd->queue = MessageQueue_New(&obj);
-			if (!rdpsnd->queue)
-				return CHANNEL_RC_NO_MEMORY;
-		}
-
-		if (!rdpsnd->thread)
-		{
-			rdpsnd->thread = CreateThread(nullptr, 0, play_thread, rdpsnd, 0, nullptr);
-			if (!rdpsnd->thread)
-				return CHANNEL_RC_INITIALIZATION_ERROR;
-		}
-	}
+	if (!rdpsnd_start_thread(rdpsnd))
+		return FALSE;
 
 	rdpsnd->references++;
 
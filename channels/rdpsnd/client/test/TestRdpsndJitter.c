@@ -0,0 +1,343 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/codec/audio.h>
+
+#include "../rdpsnd_jitter.h"
+
+static AUDIO_FORMAT pcm_format(UINT16 channels, UINT32 rate, UINT16 bits)
+{
+	const AUDIO_FORMAT format = { .wFormatTag = WAVE_FORMAT_PCM,
+		                          .nChannels = channels,
+		                          .nSamplesPerSec = rate,
+		                          .nAvgBytesPerSec = rate * channels * bits / 8,
+		                          .nBlockAlign = channels * bits / 8,
+		                          .wBitsPerSample = bits,
+		                          .cbSize = 0,
+		                          .data = nullptr };
+	return format;
+}
+
+static int test_reset(void)
+{
+	RDPSND_JITTER_BUFFER jb = WINPR_C_ARRAY_INIT;
+
+	rdpsnd_jitter_reset(&jb, 0, RDPSND_JITTER_DEFAULT_MAX_DELAY);
+	if (!jb.adaptive || (jb.minDelay != RDPSND_JITTER_MIN_DELAY) ||
+	    (jb.maxDelay != RDPSND_JITTER_DEFAULT_MAX_DELAY) ||
+	    (jb.targetDelay != RDPSND_JITTER_MIN_DELAY))
+	{
+		(void)fprintf(stderr, "adaptive reset: wrong delays\n");
+		return -1;
+	}
+
+	/* The configured latency raises the lower bound, the upper bound follows */
+	rdpsnd_jitter_reset(&jb, 500, RDPSND_JITTER_DEFAULT_MAX_DELAY);
+	if ((jb.minDelay != 500) || (jb.maxDelay != 500) || (jb.targetDelay != 500))
+	{
+		(void)fprintf(stderr, "reset with latency: wrong delays\n");
+		return -1;
+	}
+
+	rdpsnd_jitter_reset(&jb, 40, 0);
+	if (jb.adaptive || (jb.minDelay != 40) || (jb.targetDelay != 40))
+	{
+		(void)fprintf(stderr, "legacy reset: wrong delays\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int test_arrival(void)
+{
+	const UINT32 duration = 20;
+	RDPSND_JITTER_BUFFER jb = WINPR_C_ARRAY_INIT;
+	rdpsnd_jitter_reset(&jb, 0, RDPSND_JITTER_DEFAULT_MAX_DELAY);
+
+	/* Waves arriving exactly in time do not add jitter, the target is one wave */
+	UINT64 arrival = 65000;
+	UINT16 timestamp = 1000;
+	for (size_t x = 0; x < 100; x++)
+	{
+		rdpsnd_jitter_arrival(&jb, timestamp, arrival, duration);
+		timestamp += duration;
+		arrival += duration;
+	}
+	if ((jb.jitter != 0) || (jb.targetDelay != RDPSND_JITTER_MIN_DELAY))
+	{
+		(void)fprintf(stderr, "steady arrival: jitter %" PRIu32 " target %" PRIu32 "\n",
+		              jb.jitter, jb.targetDelay);
+		return -1;
+	}
+
+	/* Every second wave arrives 30 ms late: J converges to the 30 ms transit delta */
+	for (size_t x = 0; x < 500; x++)
+	{
+		const UINT64 late = (x & 1) ? 30 : 0;
+		rdpsnd_jitter_arrival(&jb, timestamp, arrival + late, duration);
+		timestamp += duration;
+		arrival += duration;
+	}
+	if ((jb.jitter / 16 < 28) || (jb.jitter / 16 > 30))
+	{
+		(void)fprintf(stderr, "jittery arrival: jitter %" PRIu32 "\n", jb.jitter / 16);
+		return -1;
+	}
+	if (jb.targetDelay != duration + jb.jitter / 4)
+	{
+		(void)fprintf(stderr, "jittery arrival: target %" PRIu32 "\n", jb.targetDelay);
+		return -1;
+	}
+
+	/* Huge jitter is limited by the upper bound */
+	for (size_t x = 0; x < 500; x++)
+	{
+		const UINT64 late = (x & 1) ? 1000 : 0;
+		rdpsnd_jitter_arrival(&jb, timestamp, arrival + late, duration);
+		timestamp += duration;
+		arrival += duration;
+	}
+	if (jb.targetDelay != RDPSND_JITTER_DEFAULT_MAX_DELAY)
+	{
+		(void)fprintf(stderr, "bounded arrival: target %" PRIu32 "\n", jb.targetDelay);
+		return -1;
+	}
+	return 0;
+}
+
+static int test_schedule(void)
+{
+	const UINT32 duration = 20;
+	UINT64 now = 1000;
+	RDPSND_JITTER_BUFFER jb = WINPR_C_ARRAY_INIT;
+	rdpsnd_jitter_reset(&jb, 100, RDPSND_JITTER_DEFAULT_MAX_DELAY);
+
+	/* Unknown durations are played as they are */
+	if (rdpsnd_jitter_schedule(&jb, now, 0) != RDPSND_JITTER_PLAY)
+		return -1;
+
+	/* An empty queue is filled up to the target delay with silence */
+	if ((rdpsnd_jitter_schedule(&jb, now, duration) != RDPSND_JITTER_CONCEAL) ||
+	    (rdpsnd_jitter_conceal_amount(&jb, duration) != 100 - duration))
+	{
+		(void)fprintf(stderr, "underrun not concealed\n");
+		return -1;
+	}
+	rdpsnd_jitter_commit(&jb, now, 100);
+	if (rdpsnd_jitter_playout_delay(&jb, now) != 100)
+		return -1;
+
+	/* At the target delay the wave is played unmodified */
+	if (rdpsnd_jitter_schedule(&jb, now, duration) != RDPSND_JITTER_PLAY)
+	{
+		(void)fprintf(stderr, "wave at target delay not played\n");
+		return -1;
+	}
+
+	/* Above target the wave is stretched by at most RDPSND_JITTER_MAX_STRETCH percent */
+	rdpsnd_jitter_commit(&jb, now, 50);
+	if (rdpsnd_jitter_schedule(&jb, now, duration) != RDPSND_JITTER_STRETCH)
+	{
+		(void)fprintf(stderr, "excess delay not stretched\n");
+		return -1;
+	}
+	if (rdpsnd_jitter_stretch_amount(&jb, now, duration) !=
+	    duration * RDPSND_JITTER_MAX_STRETCH / 100)
+	{
+		(void)fprintf(stderr, "stretch amount %" PRIu32 "\n",
+		              rdpsnd_jitter_stretch_amount(&jb, now, duration));
+		return -1;
+	}
+
+	/* Above the upper bound waves are dropped */
+	rdpsnd_jitter_commit(&jb, now, RDPSND_JITTER_DEFAULT_MAX_DELAY);
+	if (rdpsnd_jitter_schedule(&jb, now, duration) != RDPSND_JITTER_DROP)
+	{
+		(void)fprintf(stderr, "overflow not dropped\n");
+		return -1;
+	}
+
+	/* Once the device played the queue the delay is gone */
+	now += 1000;
+	if (rdpsnd_jitter_playout_delay(&jb, now) != 0)
+		return -1;
+
+	if ((jb.concealed != 1) || (jb.stretched != 1) || (jb.dropped != 1) || (jb.played != 3))
+	{
+		(void)fprintf(stderr, "wrong statistics\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int test_schedule_legacy(void)
+{
+	const UINT32 duration = 20;
+	const UINT64 now = 1000;
+	RDPSND_JITTER_BUFFER jb = WINPR_C_ARRAY_INIT;
+	rdpsnd_jitter_reset(&jb, 40, 0);
+
+	/* Without the adaptive buffer nothing is concealed or stretched, only dropped */
+	for (size_t x = 0; x < 4; x++)
+	{
+		if (rdpsnd_jitter_schedule(&jb, now, duration) != RDPSND_JITTER_PLAY)
+		{
+			(void)fprintf(stderr, "legacy wave %" PRIuz " not played\n", x);
+			return -1;
+		}
+		rdpsnd_jitter_commit(&jb, now, duration);
+	}
+
+	/* A wave that would queue more than two waves plus the latency is dropped */
+	if (rdpsnd_jitter_schedule(&jb, now, duration) != RDPSND_JITTER_DROP)
+	{
+		(void)fprintf(stderr, "legacy overflow not dropped\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int test_duration(void)
+{
+	const AUDIO_FORMAT pcm = pcm_format(2, 44100, 16);
+	AUDIO_FORMAT aac = pcm;
+	aac.wFormatTag = WAVE_FORMAT_AAC_MS;
+
+	if (rdpsnd_jitter_duration(&pcm, 17640) != 100)
+	{
+		(void)fprintf(stderr, "PCM duration %" PRIu32 "\n", rdpsnd_jitter_duration(&pcm, 17640));
+		return -1;
+	}
+
+	/* Variable bitrate formats have no known duration */
+	if (rdpsnd_jitter_duration(&aac, 17640) != 0)
+		return -1;
+	return 0;
+}
+
+static int test_stretch(void)
+{
+	int rc = -1;
+	const AUDIO_FORMAT format = pcm_format(2, 48000, 16);
+	const size_t frames = 4800;
+	INT16* data = calloc(frames * 2, sizeof(INT16));
+	wStream* out = Stream_New(nullptr, 1024);
+
+	if (!data || !out)
+		goto fail;
+
+	/* A ramp on the left channel, the negative ramp on the right one */
+	for (size_t x = 0; x < frames; x++)
+	{
+		data[2 * x] = (INT16)x;
+		data[2 * x + 1] = (INT16)(-(INT32)x);
+	}
+
+	if (!rdpsnd_jitter_stretch_pcm(&format, (const BYTE*)data, frames * 4, 10, out))
+	{
+		(void)fprintf(stderr, "stretch failed\n");
+		goto fail;
+	}
+
+	/* 10 ms at 48 kHz are 480 frames */
+	const size_t outFrames = Stream_GetPosition(out) / 4;
+	if (outFrames != frames - 480)
+	{
+		(void)fprintf(stderr, "stretched to %" PRIuz " frames\n", outFrames);
+		goto fail;
+	}
+
+	/* The interpolated wave keeps both ends (up to the fixed point rounding) and stays
+	 * monotonic */
+	const INT16* res = Stream_BufferAs(out, INT16);
+	const INT32 last = (INT32)frames - 1;
+	if ((res[0] != 0) || (res[1] != 0) || (abs(res[2 * (outFrames - 1)] - last) > 1) ||
+	    (abs(res[2 * (outFrames - 1) + 1] + last) > 1))
+	{
+		(void)fprintf(stderr, "stretch changed the wave boundaries\n");
+		goto fail;
+	}
+	for (size_t x = 1; x < outFrames; x++)
+	{
+		if ((res[2 * x] <= res[2 * (x - 1)]) || (abs(res[2 * x + 1] + res[2 * x]) > 1))
+		{
+			(void)fprintf(stderr, "stretched wave broken at frame %" PRIuz "\n", x);
+			goto fail;
+		}
+	}
+
+	/* More than half of the wave can not be removed, other formats are rejected */
+	Stream_ResetPosition(out);
+	if (rdpsnd_jitter_stretch_pcm(&format, (const BYTE*)data, frames * 4, 60, out))
+		goto fail;
+
+	const AUDIO_FORMAT pcm8 = pcm_format(2, 48000, 8);
+	if (rdpsnd_jitter_stretch_pcm(&pcm8, (const BYTE*)data, frames * 4, 10, out))
+		goto fail;
+
+	rc = 0;
+fail:
+	Stream_Free(out, TRUE);
+	free(data);
+	return rc;
+}
+
+static int test_silence(void)
+{
+	int rc = -1;
+	const AUDIO_FORMAT pcm16 = pcm_format(2, 48000, 16);
+	const AUDIO_FORMAT pcm8 = pcm_format(1, 8000, 8);
+	wStream* out = Stream_New(nullptr, 1024);
+
+	if (!out)
+		goto fail;
+
+	if (!rdpsnd_jitter_silence_pcm(&pcm16, 10, out) || (Stream_GetPosition(out) != 480 * 4))
+		goto fail;
+	for (size_t x = 0; x < Stream_GetPosition(out); x++)
+	{
+		if (Stream_Buffer(out)[x] != 0)
+			goto fail;
+	}
+
+	/* 8 bit PCM is unsigned */
+	Stream_ResetPosition(out);
+	if (!rdpsnd_jitter_silence_pcm(&pcm8, 10, out) || (Stream_GetPosition(out) != 80))
+		goto fail;
+	for (size_t x = 0; x < Stream_GetPosition(out); x++)
+	{
+		if (Stream_Buffer(out)[x] != 0x80)
+			goto fail;
+	}
+
+	rc = 0;
+fail:
+	if (rc != 0)
+		(void)fprintf(stderr, "silence test failed\n");
+	Stream_Free(out, TRUE);
+	return rc;
+}
+
+int TestRdpsndJitter(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (test_reset() != 0)
+		return -1;
+	if (test_arrival() != 0)
+		return -1;
+	if (test_schedule() != 0)
+		return -1;
+	if (test_schedule_legacy() != 0)
+		return -1;
+	if (test_duration() != 0)
+		return -1;
+	if (test_stretch() != 0)
+		return -1;
+	if (test_silence() != 0)
+		return -1;
+	return 0;
+}
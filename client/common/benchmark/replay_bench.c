@@ -0,0 +1,555 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * session replay benchmarking tool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/assert.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/streamdump.h>
+#include <freerdp/transport_io.h>
+#include <freerdp/client/cmdline.h>
+#include <freerdp/client/channels.h>
+#include <freerdp/client/rdpgfx.h>
+#include <freerdp/log.h>
+
+#define TAG CLIENT_TAG("replay-bench")
+
+/** The stages of the client pipeline that are timed separately */
+typedef enum
+{
+	RB_STAGE_PDU,
+	RB_STAGE_UPDATE,
+	RB_STAGE_SURFACE_BITS,
+	RB_STAGE_GFX_COMMAND,
+	RB_STAGE_GFX_FRAME,
+	RB_STAGE_COUNT
+} rbStageId;
+
+typedef struct
+{
+	const char* name;
+	UINT64* samples; /* duration of each run in ns */
+	size_t count;
+	size_t capacity;
+	UINT64 bytes;
+	UINT64 busy;
+	UINT64 start;
+} rbStage;
+
+typedef struct
+{
+	rdpClientContext common;
+
+	CRITICAL_SECTION lock;
+	rbStage stages[RB_STAGE_COUNT];
+
+	/* wrapped callbacks */
+	pTransportRWFkt ReadPdu;
+	pSurfaceBits SurfaceBits;
+	pcRdpgfxSurfaceCommand SurfaceCommand;
+	pcRdpgfxStartFrame StartFrame;
+	pcRdpgfxEndFrame EndFrame;
+
+	BOOL pduPending;
+	size_t pduBytes;
+} rbContext;
+
+static const char* rb_stage_names[RB_STAGE_COUNT] = { "pdu", "update", "surface-bits",
+	                                                  "gfx-command", "gfx-frame" };
+
+static void rb_stage_begin(rbContext* rb, rbStageId id)
+{
+	WINPR_ASSERT(rb);
+	WINPR_ASSERT(id < RB_STAGE_COUNT);
+
+	EnterCriticalSection(&rb->lock);
+	rb->stages[id].start = winpr_GetTickCount64NS();
+	LeaveCriticalSection(&rb->lock);
+}
+
+static void rb_stage_end(rbContext* rb, rbStageId id, size_t bytes)
+{
+	WINPR_ASSERT(rb);
+	WINPR_ASSERT(id < RB_STAGE_COUNT);
+
+	const UINT64 now = winpr_GetTickCount64NS();
+
+	EnterCriticalSection(&rb->lock);
+	rbStage* stage = &rb->stages[id];
+	if (stage->start == 0)
+		goto out;
+
+	if (stage->count == stage->capacity)
+	{
+		const size_t capacity = MAX(1024, stage->capacity * 2);
+		UINT64* tmp = realloc(stage->samples, capacity * sizeof(UINT64));
+		if (!tmp)
+		{
+			WLog_ERR(TAG, "failed to allocate samples for stage %s", stage->name);
+			goto out;
+		}
+		stage->samples = tmp;
+		stage->capacity = capacity;
+	}
+
+	const UINT64 duration = now - stage->start;
+	stage->samples[stage->count++] = duration;
+	stage->busy += duration;
+	stage->bytes += bytes;
+	stage->start = 0;
+
+out:
+	LeaveCriticalSection(&rb->lock);
+}
+
+static int rb_compare_samples(const void* a, const void* b)
+{
+	const UINT64* pa = a;
+	const UINT64* pb = b;
+
+	if (*pa < *pb)
+		return -1;
+	if (*pa > *pb)
+		return 1;
+	return 0;
+}
+
+static double rb_percentile(const rbStage* stage, size_t percent)
+{
+	WINPR_ASSERT(stage);
+	if (stage->count == 0)
+		return 0.0;
+
+	const size_t index = (stage->count - 1) * percent / 100;
+	return (double)stage->samples[index] / 1000.0;
+}
+
+static void rb_print_report(rbContext* rb, UINT64 wall)
+{
+	WINPR_ASSERT(rb);
+
+	const double seconds = (double)wall / 1000000000.0;
+
+	printf("session finished in %.3f s\n\n", seconds);
+	printf("%-14s %10s %12s %10s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "bytes",
+	       "busy[ms]", "MB/s", "rate[1/s]", "p50[us]", "p90[us]", "p99[us]", "max[us]");
+
+	for (size_t x = 0; x < RB_STAGE_COUNT; x++)
+	{
+		rbStage* stage = &rb->stages[x];
+		if (stage->count == 0)
+			continue;
+
+		qsort(stage->samples, stage->count, sizeof(UINT64), rb_compare_samples);
+
+		const double busy = (double)stage->busy / 1000000000.0;
+		const double mbps = (busy > 0.0) ? (double)stage->bytes / busy / 1024.0 / 1024.0 : 0.0;
+		const double rate = (seconds > 0.0) ? (double)stage->count / seconds : 0.0;
+
+		printf("%-14s %10" PRIuz " %12" PRIu64 " %10.3f %10.2f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		       stage->name, stage->count, stage->bytes, busy * 1000.0, mbps, rate,
+		       rb_percentile(stage, 50), rb_percentile(stage, 90), rb_percentile(stage, 99),
+		       rb_percentile(stage, 100));
+	}
+}
+
+/* The time from the end of one read to the start of the next one is spent processing the PDU
+ * that was just read: parsing, bulk decompression, fastpath and slowpath updates. */
+static int rb_transport_read(rdpTransport* transport, wStream* s)
+{
+	rdpContext* context = transport_get_context(transport);
+	rbContext* rb = (rbContext*)context;
+
+	WINPR_ASSERT(rb);
+	WINPR_ASSERT(rb->ReadPdu);
+
+	if (rb->pduPending)
+		rb_stage_end(rb, RB_STAGE_PDU, rb->pduBytes);
+	rb->pduPending = FALSE;
+
+	const int rc = rb->ReadPdu(transport, s);
+	if (rc > 0)
+	{
+		rb->pduBytes = Stream_Length(s);
+		rb->pduPending = TRUE;
+		rb_stage_begin(rb, RB_STAGE_PDU);
+	}
+	return rc;
+}
+
+static BOOL rb_register_io(rbContext* rb)
+{
+	WINPR_ASSERT(rb);
+
+	rdpContext* context = &rb->common.context;
+	const rdpTransportIo* dfl = freerdp_get_io_callbacks(context);
+	if (!dfl)
+		return FALSE;
+
+	rdpTransportIo io = *dfl;
+	rb->ReadPdu = io.ReadPdu;
+	io.ReadPdu = rb_transport_read;
+	return freerdp_set_io_callbacks(context, &io);
+}
+
+static BOOL rb_begin_paint(rdpContext* context)
+{
+	rbContext* rb = (rbContext*)context;
+
+	WINPR_ASSERT(rb);
+	WINPR_ASSERT(context->gdi);
+	WINPR_ASSERT(context->gdi->primary);
+	WINPR_ASSERT(context->gdi->primary->hdc);
+	WINPR_ASSERT(context->gdi->primary->hdc->hwnd);
+
+	HGDI_WND hwnd = context->gdi->primary->hdc->hwnd;
+	WINPR_ASSERT(hwnd->invalid);
+	hwnd->invalid->null = TRUE;
+	hwnd->ninvalid = 0;
+
+	rb_stage_begin(rb, RB_STAGE_UPDATE);
+	return TRUE;
+}
+
+static BOOL rb_end_paint(rdpContext* context)
+{
+	rbContext* rb = (rbContext*)context;
+
+	WINPR_ASSERT(rb);
+	rb_stage_end(rb, RB_STAGE_UPDATE, 0);
+	return TRUE;
+}
+
+static BOOL rb_surface_bits(rdpContext* context, const SURFACE_BITS_COMMAND* cmd)
+{
+	rbContext* rb = (rbContext*)context;
+
+	WINPR_ASSERT(rb);
+	WINPR_ASSERT(rb->SurfaceBits);
+	WINPR_ASSERT(cmd);
+
+	rb_stage_begin(rb, RB_STAGE_SURFACE_BITS);
+	const BOOL rc = rb->SurfaceBits(context, cmd);
+	rb_stage_end(rb, RB_STAGE_SURFACE_BITS, cmd->bmp.bitmapDataLength);
+	return rc;
+}
+
+static BOOL rb_desktop_resize(rdpContext* context)
+{
+	WINPR_ASSERT(context);
+
+	rdpSettings* settings = context->settings;
+	WINPR_ASSERT(settings);
+
+	return gdi_resize(context->gdi, freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth),
+	                  freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight));
+}
+
+static rbContext* rb_gfx_get_context(RdpgfxClientContext* context)
+{
+	WINPR_ASSERT(context);
+
+	/* gdi_graphics_pipeline_init stores the rdpGdi in custom */
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	WINPR_ASSERT(gdi);
+
+	rbContext* rb = (rbContext*)gdi->context;
+	WINPR_ASSERT(rb);
+	return rb;
+}
+
+static UINT rb_gfx_surface_command(RdpgfxClientContext* context, const RDPGFX_SURFACE_COMMAND* cmd)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(cmd);
+
+	rbContext* rb = rb_gfx_get_context(context);
+	WINPR_ASSERT(rb->SurfaceCommand);
+
+	rb_stage_begin(rb, RB_STAGE_GFX_COMMAND);
+	const UINT rc = rb->SurfaceCommand(context, cmd);
+	rb_stage_end(rb, RB_STAGE_GFX_COMMAND, cmd->length);
+	return rc;
+}
+
+static UINT rb_gfx_start_frame(RdpgfxClientContext* context,
+                               const RDPGFX_START_FRAME_PDU* startFrame)
+{
+	WINPR_ASSERT(context);
+
+	rbContext* rb = rb_gfx_get_context(context);
+	WINPR_ASSERT(rb->StartFrame);
+
+	rb_stage_begin(rb, RB_STAGE_GFX_FRAME);
+	return rb->StartFrame(context, startFrame);
+}
+
+static UINT rb_gfx_end_frame(RdpgfxClientContext* context, const RDPGFX_END_FRAME_PDU* endFrame)
+{
+	WINPR_ASSERT(context);
+
+	rbContext* rb = rb_gfx_get_context(context);
+	WINPR_ASSERT(rb->EndFrame);
+
+	const UINT rc = rb->EndFrame(context, endFrame);
+	rb_stage_end(rb, RB_STAGE_GFX_FRAME, 0);
+	return rc;
+}
+
+static void rb_OnChannelConnectedEventHandler(void* context, const ChannelConnectedEventArgs* e)
+{
+	rbContext* rb = (rbContext*)context;
+
+	WINPR_ASSERT(rb);
+	WINPR_ASSERT(e);
+
+	freerdp_client_OnChannelConnectedEventHandler(&rb->common, e);
+
+	if (strcmp(e->name, RDPGFX_DVC_CHANNEL_NAME) == 0)
+	{
+		RdpgfxClientContext* gfx = (RdpgfxClientContext*)e->pInterface;
+		WINPR_ASSERT(gfx);
+
+		rb->SurfaceCommand = gfx->SurfaceCommand;
+		rb->StartFrame = gfx->StartFrame;
+		rb->EndFrame = gfx->EndFrame;
+		gfx->SurfaceCommand = rb_gfx_surface_command;
+		gfx->StartFrame = rb_gfx_start_frame;
+		gfx->EndFrame = rb_gfx_end_frame;
+	}
+}
+
+static void rb_OnChannelDisconnectedEventHandler(void* context,
+                                                 const ChannelDisconnectedEventArgs* e)
+{
+	rbContext* rb = (rbContext*)context;
+
+	WINPR_ASSERT(rb);
+	WINPR_ASSERT(e);
+
+	freerdp_client_OnChannelDisconnectedEventHandler(&rb->common, e);
+}
+
+static BOOL rb_pre_connect(freerdp* instance)
+{
+	WINPR_ASSERT(instance);
+	WINPR_ASSERT(instance->context);
+
+	rdpSettings* settings = instance->context->settings;
+	WINPR_ASSERT(settings);
+
+	if (!freerdp_settings_set_uint32(settings, FreeRDP_OsMajorType, OSMAJORTYPE_UNIX))
+		return FALSE;
+	if (!freerdp_settings_set_uint32(settings, FreeRDP_OsMinorType, OSMINORTYPE_NATIVE_XSERVER))
+		return FALSE;
+
+	if (PubSub_SubscribeChannelConnected(instance->context->pubSub,
+	                                     rb_OnChannelConnectedEventHandler) < 0)
+		return FALSE;
+	if (PubSub_SubscribeChannelDisconnected(instance->context->pubSub,
+	                                        rb_OnChannelDisconnectedEventHandler) < 0)
+		return FALSE;
+	return TRUE;
+}
+
+static BOOL rb_post_connect(freerdp* instance)
+{
+	WINPR_ASSERT(instance);
+
+	if (!gdi_init(instance, PIXEL_FORMAT_BGRX32))
+		return FALSE;
+
+	rbContext* rb = (rbContext*)instance->context;
+	WINPR_ASSERT(rb);
+
+	rdpUpdate* update = rb->common.context.update;
+	WINPR_ASSERT(update);
+
+	rb->SurfaceBits = update->SurfaceBits;
+	update->SurfaceBits = rb_surface_bits;
+	update->BeginPaint = rb_begin_paint;
+	update->EndPaint = rb_end_paint;
+	update->DesktopResize = rb_desktop_resize;
+	return TRUE;
+}
+
+static void rb_post_disconnect(freerdp* instance)
+{
+	if (!instance || !instance->context)
+		return;
+
+	PubSub_UnsubscribeChannelConnected(instance->context->pubSub,
+	                                   rb_OnChannelConnectedEventHandler);
+	PubSub_UnsubscribeChannelDisconnected(instance->context->pubSub,
+	                                      rb_OnChannelDisconnectedEventHandler);
+	gdi_free(instance);
+}
+
+static DWORD rb_client_run(freerdp* instance)
+{
+	DWORD result = 0;
+	HANDLE handles[MAXIMUM_WAIT_OBJECTS] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(instance);
+
+	if (!freerdp_connect(instance))
+	{
+		result = freerdp_get_last_error(instance->context);
+		WLog_ERR(TAG, "connection failure 0x%08" PRIx32, result);
+		goto disconnect;
+	}
+
+	/* A replay ends with a read error once the recording is exhausted */
+	while (!freerdp_shall_disconnect_context(instance->context))
+	{
+		const DWORD nCount =
+		    freerdp_get_event_handles(instance->context, handles, ARRAYSIZE(handles));
+
+		if (nCount == 0)
+		{
+			WLog_ERR(TAG, "freerdp_get_event_handles failed");
+			break;
+		}
+
+		const DWORD status = WaitForMultipleObjects(nCount, handles, FALSE, INFINITE);
+
+		if (status == WAIT_FAILED)
+		{
+			WLog_ERR(TAG, "WaitForMultipleObjects failed with %" PRIu32 "", status);
+			break;
+		}
+
+		if (!freerdp_check_event_handles(instance->context))
+			break;
+	}
+
+disconnect:
+	freerdp_disconnect(instance);
+	return result;
+}
+
+static BOOL rb_client_new(freerdp* instance, rdpContext* context)
+{
+	rbContext* rb = (rbContext*)context;
+
+	if (!instance || !context)
+		return FALSE;
+
+	if (!InitializeCriticalSectionAndSpinCount(&rb->lock, 4000))
+		return FALSE;
+
+	for (size_t x = 0; x < RB_STAGE_COUNT; x++)
+		rb->stages[x].name = rb_stage_names[x];
+
+	instance->PreConnect = rb_pre_connect;
+	instance->PostConnect = rb_post_connect;
+	instance->PostDisconnect = rb_post_disconnect;
+	return TRUE;
+}
+
+static void rb_client_free(WINPR_ATTR_UNUSED freerdp* instance, rdpContext* context)
+{
+	rbContext* rb = (rbContext*)context;
+
+	if (!rb)
+		return;
+
+	for (size_t x = 0; x < RB_STAGE_COUNT; x++)
+		free(rb->stages[x].samples);
+	DeleteCriticalSection(&rb->lock);
+}
+
+static int RdpClientEntry(RDP_CLIENT_ENTRY_POINTS* pEntryPoints)
+{
+	WINPR_ASSERT(pEntryPoints);
+
+	ZeroMemory(pEntryPoints, sizeof(RDP_CLIENT_ENTRY_POINTS));
+	pEntryPoints->Version = RDP_CLIENT_INTERFACE_VERSION;
+	pEntryPoints->Size = sizeof(RDP_CLIENT_ENTRY_POINTS_V1);
+	pEntryPoints->ContextSize = sizeof(rbContext);
+	pEntryPoints->ClientNew = rb_client_new;
+	pEntryPoints->ClientFree = rb_client_free;
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	int rc = -1;
+	RDP_CLIENT_ENTRY_POINTS clientEntryPoints = WINPR_C_ARRAY_INIT;
+
+	RdpClientEntry(&clientEntryPoints);
+	rdpContext* context = freerdp_client_context_new(&clientEntryPoints);
+	if (!context)
+		goto fail;
+
+	rdpSettings* settings = context->settings;
+	{
+		const int status = freerdp_client_settings_parse_command_line(settings, argc, argv, FALSE);
+		if (status)
+		{
+			rc = freerdp_client_settings_command_line_status_print(settings, status, argc, argv);
+			goto fail;
+		}
+	}
+
+	/* Without /dump:replay the tool benchmarks a live connection (and can record one with
+	 * /dump:record), a replay always runs as fast as possible. */
+	if (freerdp_settings_get_bool(settings, FreeRDP_TransportDumpReplay))
+	{
+		if (!freerdp_settings_set_bool(settings, FreeRDP_TransportDumpReplayNodelay, TRUE))
+			goto fail;
+		if (!freerdp_settings_get_string(settings, FreeRDP_ServerHostname) &&
+		    !freerdp_settings_set_string(settings, FreeRDP_ServerHostname, "replay"))
+			goto fail;
+	}
+
+	if (!stream_dump_register_handlers(context, CONNECTION_STATE_MCS_CREATE_REQUEST, FALSE))
+		goto fail;
+	if (!rb_register_io((rbContext*)context))
+		goto fail;
+
+	if (freerdp_client_start(context) != 0)
+		goto fail;
+
+	{
+		const UINT64 start = winpr_GetTickCount64NS();
+		const DWORD res = rb_client_run(context->instance);
+		const UINT64 wall = winpr_GetTickCount64NS() - start;
+
+		rbContext* rb = (rbContext*)context;
+		if (rb->pduPending)
+			rb_stage_end(rb, RB_STAGE_PDU, rb->pduBytes);
+
+		rb_print_report(rb, wall);
+		rc = (int)res;
+	}
+
+	if (freerdp_client_stop(context) != 0)
+		rc = -1;
+
+fail:
+	freerdp_client_context_free(context);
+	return rc;
+}
@@ -54,6 +54,8 @@
 
 #include <freerdp/client/client_cliprdr_file.h>
 
+#include "client_cliprdr_read_ahead.h"
+
 #define NO_CLIP_DATA_ID (UINT64_C(1) << 32)
 #define WIN32_FILETIME_TO_UNIX_EPOCH INT64_C(11644473600)
 
@@ -73,6 +75,7 @@ typedef enum eFuseLowlevelOperationType
 	FUSE_LL_OPERATION_LOOKUP,
 	FUSE_LL_OPERATION_GETATTR,
 	FUSE_LL_OPERATION_READ,
+	FUSE_LL_OPERATION_READ_AHEAD,
 } FuseLowlevelOperationType;
 
 typedef struct sCliprdrFuseFile CliprdrFuseFile;
@@ -101,6 +104,9 @@ struct sCliprdrFuseFile
 
 	BOOL has_clip_data_id;
 	UINT32 clip_data_id;
+
+	/* read-ahead state, protected by the inode_table lock */
+	CliprdrReadAhead* read_ahead;
 };
 
 typedef struct
@@ -130,6 +136,7 @@ typedef struct
 	CliprdrFuseFile* fuse_file;
 	fuse_req_t fuse_req;
 	UINT32 stream_id;
+	CliprdrReadAheadChunk* chunk;
 } CliprdrFuseRequest;
 #endif
 
@@ -201,6 +208,13 @@ static void fuse_file_free(void* data)
 	if (!fuse_file)
 		return;
 
+	if (fuse_file->read_ahead)
+	{
+		CliprdrReadAheadRead read = WINPR_C_ARRAY_INIT;
+		while (cliprdr_read_ahead_pop_read(fuse_file->read_ahead, &read))
+			fuse_reply_err(read.req, EIO);
+	}
+	cliprdr_read_ahead_free(fuse_file->read_ahead);
 	ArrayList_Free(fuse_file->children);
 	free(fuse_file->filename_with_root);
 
@@ -217,7 +231,8 @@ static CliprdrFuseFile* fuse_file_new(WINPR_FORMAT_ARG const char* fmt, ...)
 		return nullptr;
 
 	file->children = ArrayList_New(FALSE);
-	if (!file->children)
+	file->read_ahead = cliprdr_read_ahead_new();
+	if (!file->children || !file->read_ahead)
 		goto fail;
 
 	WINPR_ASSERT(fmt);
@@ -372,7 +387,9 @@ static BOOL maybe_clear_fuse_request(const void* key, void* value, void* arg)
 	DEBUG_CLIPRDR(file_context->log, "Clearing FileContentsRequest for file \"%s\"",
 	              fuse_file->filename_with_root);
 
-	fuse_reply_err(fuse_request->fuse_req, EIO);
+	/* read-ahead requests have no FUSE request, waiting reads are failed with the file */
+	if (fuse_request->operation_type != FUSE_LL_OPERATION_READ_AHEAD)
+		fuse_reply_err(fuse_request->fuse_req, EIO);
 	HashTable_Remove(file_context->request_table, key);
 
 	return TRUE;
@@ -1005,6 +1022,151 @@ static BOOL request_file_range_async(CliprdrFileContext* file_context, CliprdrFu
 	// NOLINTEND(clang-analyzer-unix.Malloc)
 }
 
+static void fuse_file_reply_segments(fuse_req_t fuse_req,
+                                     const CliprdrReadAheadSegment* segments, size_t count)
+{
+	struct iovec iov[CLIPRDR_READ_AHEAD_MAX_SEGMENTS] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(count <= ARRAYSIZE(iov));
+
+	if (count == 0)
+	{
+		fuse_reply_buf(fuse_req, nullptr, 0);
+		return;
+	}
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const BYTE* data = segments[x].data;
+		iov[x].iov_base = WINPR_CAST_CONST_PTR_AWAY(data, void*);
+		iov[x].iov_len = segments[x].length;
+	}
+	fuse_reply_iov(fuse_req, iov, WINPR_ASSERTING_INT_CAST(int, count));
+}
+
+static BOOL request_file_chunk_async(CliprdrFileContext* file_context, CliprdrFuseFile* fuse_file,
+                                     UINT64 offset)
+{
+	CLIPRDR_FILE_CONTENTS_REQUEST file_contents_request = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(file_context);
+	WINPR_ASSERT(fuse_file);
+
+	CliprdrReadAheadChunk* chunk =
+	    cliprdr_read_ahead_add_chunk(fuse_file->read_ahead, fuse_file->size, offset);
+	if (!chunk)
+		return FALSE;
+
+	CliprdrFuseRequest* fuse_request =
+	    cliprdr_fuse_request_new(file_context, fuse_file, nullptr, FUSE_LL_OPERATION_READ_AHEAD);
+	if (!fuse_request)
+	{
+		cliprdr_read_ahead_remove_chunk(fuse_file->read_ahead, chunk);
+		return FALSE;
+	}
+	fuse_request->chunk = chunk;
+
+	file_contents_request.common.msgType = CB_FILECONTENTS_REQUEST;
+	file_contents_request.streamId = fuse_request->stream_id;
+	file_contents_request.listIndex = fuse_file->list_idx;
+	file_contents_request.dwFlags = FILECONTENTS_RANGE;
+	file_contents_request.nPositionLow = (UINT32)(offset & 0xFFFFFFFF);
+	file_contents_request.nPositionHigh = (UINT32)((offset >> 32) & 0xFFFFFFFF);
+	file_contents_request.cbRequested = chunk->size;
+	file_contents_request.haveClipDataId = fuse_file->has_clip_data_id;
+	file_contents_request.clipDataId = fuse_file->clip_data_id;
+
+	if (file_context->context->ClientFileContentsRequest(file_context->context,
+	                                                     &file_contents_request))
+	{
+		WLog_Print(file_context->log, WLOG_ERROR,
+		           "Failed to send FileContentsRequest for file \"%s\"",
+		           fuse_file->filename_with_root);
+		HashTable_Remove(file_context->request_table, (void*)(uintptr_t)fuse_request->stream_id);
+		cliprdr_read_ahead_remove_chunk(fuse_file->read_ahead, chunk);
+		return FALSE;
+	}
+
+	// file_context->request_table owns fuse_request
+	// NOLINTBEGIN(clang-analyzer-unix.Malloc)
+	DEBUG_CLIPRDR(file_context->log,
+	              "Requested read-ahead chunk (%" PRIu32 " Bytes at offset %" PRIu64
+	              ") for file \"%s\" with stream id %u",
+	              chunk->size, offset, fuse_file->filename, fuse_request->stream_id);
+
+	return TRUE;
+	// NOLINTEND(clang-analyzer-unix.Malloc)
+}
+
+static void fuse_file_read_ahead(CliprdrFileContext* file_context, CliprdrFuseFile* fuse_file,
+                                 UINT64 offset)
+{
+	UINT64 missing[CLIPRDR_READ_AHEAD_CHUNKS] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(fuse_file);
+
+	const size_t count =
+	    cliprdr_read_ahead_move_window(fuse_file->read_ahead, fuse_file->size, offset, missing);
+	for (size_t x = 0; x < count; x++)
+	{
+		if (!request_file_chunk_async(file_context, fuse_file, missing[x]))
+			break;
+	}
+}
+
+/**
+ * Replies to the reads waiting for chunks that completed. Reads no longer
+ * covered by the cache fall back to a request of their own.
+ */
+static void fuse_file_complete_pending_reads(CliprdrFileContext* file_context,
+                                             CliprdrFuseFile* fuse_file)
+{
+	CliprdrReadAheadRead read = WINPR_C_ARRAY_INIT;
+	CliprdrReadAheadResult result = CLIPRDR_READ_AHEAD_MISS;
+	CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	WINPR_ASSERT(file_context);
+	WINPR_ASSERT(fuse_file);
+
+	while (cliprdr_read_ahead_pop_ready(fuse_file->read_ahead, fuse_file->size, &read, &result,
+	                                    segments, &count))
+	{
+		if (result == CLIPRDR_READ_AHEAD_DONE)
+			fuse_file_reply_segments(read.req, segments, count);
+		else if (!request_file_range_async(file_context, fuse_file, read.req, (off_t)read.offset,
+		                                   read.size))
+			fuse_reply_err(read.req, EIO);
+	}
+}
+
+static BOOL fuse_file_read_chunked(CliprdrFileContext* file_context, CliprdrFuseFile* fuse_file,
+                                   fuse_req_t fuse_req, UINT64 offset, size_t size)
+{
+	CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	WINPR_ASSERT(file_context);
+	WINPR_ASSERT(fuse_file);
+
+	if (cliprdr_read_ahead_sequential(fuse_file->read_ahead, offset, size))
+		fuse_file_read_ahead(file_context, fuse_file, offset);
+
+	switch (cliprdr_read_ahead_lookup(fuse_file->read_ahead, fuse_file->size, offset, size,
+	                                  segments, &count))
+	{
+		case CLIPRDR_READ_AHEAD_DONE:
+			fuse_file_reply_segments(fuse_req, segments, count);
+			return TRUE;
+		case CLIPRDR_READ_AHEAD_PENDING:
+			return cliprdr_read_ahead_queue_read(fuse_file->read_ahead, fuse_req, offset, size);
+		case CLIPRDR_READ_AHEAD_MISS:
+		default:
+			return request_file_range_async(file_context, fuse_file, fuse_req, (off_t)offset,
+			                                size);
+	}
+}
+
 static void cliprdr_file_fuse_read(fuse_req_t fuse_req, fuse_ino_t fuse_ino, size_t size,
                                    off_t offset, WINPR_ATTR_UNUSED struct fuse_file_info* file_info)
 {
@@ -1036,7 +1198,7 @@ static void cliprdr_file_fuse_read(fuse_req_t fuse_req, fuse_ino_t fuse_ino, siz
 
 	size = MIN(size, 8ULL * 1024ULL * 1024ULL);
 
-	result = request_file_range_async(file_context, fuse_file, fuse_req, offset, size);
+	result = fuse_file_read_chunked(file_context, fuse_file, fuse_req, (UINT64)offset, size);
 	HashTable_Unlock(file_context->inode_table);
 
 	if (!result)
@@ -1226,6 +1388,38 @@ static DWORD WINAPI cliprdr_file_fuse_thread(LPVOID arg)
 	return 0;
 }
 
+static void cliprdr_file_context_chunk_response(
+    CliprdrFileContext* file_context, CliprdrFuseRequest* fuse_request,
+    const CLIPRDR_FILE_CONTENTS_RESPONSE* file_contents_response)
+{
+	WINPR_ASSERT(file_context);
+	WINPR_ASSERT(fuse_request);
+	WINPR_ASSERT(file_contents_response);
+
+	CliprdrFuseFile* fuse_file = fuse_request->fuse_file;
+	WINPR_ASSERT(fuse_file);
+
+	const BOOL success = (file_contents_response->common.msgFlags & CB_RESPONSE_OK) != 0;
+	if (!success)
+	{
+		WLog_Print(file_context->log, WLOG_WARN,
+		           "FileContentsRequests for file \"%s\" was unsuccessful", fuse_file->filename);
+	}
+	else
+	{
+		DEBUG_CLIPRDR(file_context->log,
+		              "Received read-ahead chunk for file \"%s\" with stream id %u",
+		              fuse_file->filename, file_contents_response->streamId);
+	}
+
+	cliprdr_read_ahead_chunk_done(fuse_file->read_ahead, fuse_request->chunk, success,
+	                              file_contents_response->requestedData,
+	                              file_contents_response->cbRequested);
+	fuse_request->chunk = nullptr;
+
+	fuse_file_complete_pending_reads(file_context, fuse_file);
+}
+
 static UINT cliprdr_file_context_server_file_contents_response(
     CliprdrClientContext* cliprdr_context,
     const CLIPRDR_FILE_CONTENTS_RESPONSE* file_contents_response)
@@ -1249,6 +1443,15 @@ static UINT cliprdr_file_context_server_file_contents_response(
 		return CHANNEL_RC_OK;
 	}
 
+	if (fuse_request->operation_type == FUSE_LL_OPERATION_READ_AHEAD)
+	{
+		cliprdr_file_context_chunk_response(file_context, fuse_request, file_contents_response);
+		HashTable_Remove(file_context->request_table,
+		                 (void*)(uintptr_t)file_contents_response->streamId);
+		HashTable_Unlock(file_context->inode_table);
+		return CHANNEL_RC_OK;
+	}
+
 	if (!(file_contents_response->common.msgFlags & CB_RESPONSE_OK))
 	{
 		WLog_Print(file_context->log, WLOG_WARN,
@@ -0,0 +1,310 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Clipboard File Read-Ahead Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/collections.h>
+
+#include <freerdp/types.h>
+
+#include "client_cliprdr_read_ahead.h"
+
+struct s_cliprdr_read_ahead
+{
+	UINT64 next_read_offset;
+	UINT32 sequential_reads;
+	wArrayList* chunks;
+	wArrayList* reads;
+};
+
+static void read_ahead_chunk_free(void* data)
+{
+	CliprdrReadAheadChunk* chunk = data;
+
+	if (!chunk)
+		return;
+
+	free(chunk->data);
+	free(chunk);
+}
+
+void cliprdr_read_ahead_free(CliprdrReadAhead* ra)
+{
+	if (!ra)
+		return;
+
+	ArrayList_Free(ra->reads);
+	ArrayList_Free(ra->chunks);
+	free(ra);
+}
+
+CliprdrReadAhead* cliprdr_read_ahead_new(void)
+{
+	CliprdrReadAhead* ra = calloc(1, sizeof(CliprdrReadAhead));
+	if (!ra)
+		return nullptr;
+
+	ra->chunks = ArrayList_New(FALSE);
+	ra->reads = ArrayList_New(FALSE);
+	if (!ra->chunks || !ra->reads)
+		goto fail;
+
+	{
+		wObject* obj = ArrayList_Object(ra->chunks);
+		WINPR_ASSERT(obj);
+		obj->fnObjectFree = read_ahead_chunk_free;
+
+		obj = ArrayList_Object(ra->reads);
+		WINPR_ASSERT(obj);
+		obj->fnObjectFree = free;
+	}
+
+	return ra;
+fail:
+	cliprdr_read_ahead_free(ra);
+	return nullptr;
+}
+
+static CliprdrReadAheadChunk* read_ahead_find_chunk(CliprdrReadAhead* ra, UINT64 offset)
+{
+	WINPR_ASSERT(ra);
+
+	const UINT64 chunk_offset = offset - (offset % CLIPRDR_READ_AHEAD_CHUNK_SIZE);
+	for (size_t x = 0; x < ArrayList_Count(ra->chunks); x++)
+	{
+		CliprdrReadAheadChunk* chunk = ArrayList_GetItem(ra->chunks, x);
+		if (chunk->offset == chunk_offset)
+			return chunk;
+	}
+	return nullptr;
+}
+
+static BOOL read_ahead_chunk_is_waited_for(CliprdrReadAhead* ra,
+                                           const CliprdrReadAheadChunk* chunk)
+{
+	WINPR_ASSERT(ra);
+	WINPR_ASSERT(chunk);
+
+	for (size_t x = 0; x < ArrayList_Count(ra->reads); x++)
+	{
+		const CliprdrReadAheadRead* read = ArrayList_GetItem(ra->reads, x);
+		if ((read->offset < chunk->offset + chunk->size) &&
+		    (read->offset + read->size > chunk->offset))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+BOOL cliprdr_read_ahead_sequential(CliprdrReadAhead* ra, UINT64 offset, size_t size)
+{
+	WINPR_ASSERT(ra);
+
+	if (offset == ra->next_read_offset)
+		ra->sequential_reads++;
+	else
+		ra->sequential_reads = 0;
+	ra->next_read_offset = offset + size;
+
+	return (ra->sequential_reads >= CLIPRDR_READ_AHEAD_SEQUENTIAL_READS) &&
+	       (size <= CLIPRDR_READ_AHEAD_CHUNK_SIZE);
+}
+
+size_t cliprdr_read_ahead_move_window(CliprdrReadAhead* ra, UINT64 fileSize, UINT64 offset,
+                                      UINT64 missing[CLIPRDR_READ_AHEAD_CHUNKS])
+{
+	size_t count = 0;
+
+	WINPR_ASSERT(ra);
+	WINPR_ASSERT(missing);
+
+	const UINT64 first = offset - (offset % CLIPRDR_READ_AHEAD_CHUNK_SIZE);
+	const UINT64 last = first + CLIPRDR_READ_AHEAD_CHUNKS * CLIPRDR_READ_AHEAD_CHUNK_SIZE;
+
+	for (size_t x = ArrayList_Count(ra->chunks); x > 0; x--)
+	{
+		CliprdrReadAheadChunk* chunk = ArrayList_GetItem(ra->chunks, x - 1);
+		if (chunk->pending || ((chunk->offset >= first) && (chunk->offset < last)))
+			continue;
+		if (read_ahead_chunk_is_waited_for(ra, chunk))
+			continue;
+		ArrayList_RemoveAt(ra->chunks, x - 1);
+	}
+
+	size_t chunks = ArrayList_Count(ra->chunks);
+	for (UINT64 pos = first; (pos < last) && (pos < fileSize); pos += CLIPRDR_READ_AHEAD_CHUNK_SIZE)
+	{
+		if (read_ahead_find_chunk(ra, pos))
+			continue;
+		if (chunks >= CLIPRDR_READ_AHEAD_MAX_CHUNKS)
+			break;
+		missing[count++] = pos;
+		chunks++;
+	}
+	return count;
+}
+
+CliprdrReadAheadChunk* cliprdr_read_ahead_add_chunk(CliprdrReadAhead* ra, UINT64 fileSize,
+                                                    UINT64 offset)
+{
+	WINPR_ASSERT(ra);
+	WINPR_ASSERT(offset < fileSize);
+	WINPR_ASSERT((offset % CLIPRDR_READ_AHEAD_CHUNK_SIZE) == 0);
+
+	CliprdrReadAheadChunk* chunk = calloc(1, sizeof(CliprdrReadAheadChunk));
+	if (!chunk)
+		return nullptr;
+
+	chunk->offset = offset;
+	chunk->size = (UINT32)MIN(CLIPRDR_READ_AHEAD_CHUNK_SIZE, fileSize - offset);
+	chunk->pending = TRUE;
+	if (!ArrayList_Append(ra->chunks, chunk))
+	{
+		read_ahead_chunk_free(chunk);
+		return nullptr;
+	}
+	return chunk;
+}
+
+void cliprdr_read_ahead_remove_chunk(CliprdrReadAhead* ra, CliprdrReadAheadChunk* chunk)
+{
+	WINPR_ASSERT(ra);
+
+	ArrayList_Remove(ra->chunks, chunk);
+}
+
+void cliprdr_read_ahead_chunk_done(CliprdrReadAhead* ra, CliprdrReadAheadChunk* chunk,
+                                   BOOL success, const BYTE* data, UINT32 length)
+{
+	WINPR_ASSERT(ra);
+	WINPR_ASSERT(chunk);
+	WINPR_ASSERT(chunk->pending);
+
+	chunk->pending = FALSE;
+	if (success)
+	{
+		chunk->length = MIN(chunk->size, length);
+		if (chunk->length > 0)
+		{
+			WINPR_ASSERT(data);
+			chunk->data = malloc(chunk->length);
+			if (chunk->data)
+				memcpy(chunk->data, data, chunk->length);
+			else
+				success = FALSE;
+		}
+	}
+
+	/* Reads of a failed range are requested directly */
+	if (!success)
+		cliprdr_read_ahead_remove_chunk(ra, chunk);
+}
+
+CliprdrReadAheadResult
+cliprdr_read_ahead_lookup(CliprdrReadAhead* ra, UINT64 fileSize, UINT64 offset, size_t size,
+                          CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS],
+                          size_t* count)
+{
+	WINPR_ASSERT(ra);
+	WINPR_ASSERT(segments);
+	WINPR_ASSERT(count);
+
+	*count = 0;
+
+	const UINT64 end = MIN(offset + size, fileSize);
+	UINT64 pos = offset;
+	while (pos < end)
+	{
+		const CliprdrReadAheadChunk* chunk = read_ahead_find_chunk(ra, pos);
+		if (!chunk || (*count >= CLIPRDR_READ_AHEAD_MAX_SEGMENTS))
+			return CLIPRDR_READ_AHEAD_MISS;
+		if (chunk->pending)
+			return CLIPRDR_READ_AHEAD_PENDING;
+		if (pos >= chunk->offset + chunk->length)
+		{
+			if (pos == offset)
+				return CLIPRDR_READ_AHEAD_MISS;
+			break;
+		}
+
+		const UINT64 chunk_end = MIN(end, chunk->offset + chunk->length);
+		segments[*count].data = &chunk->data[pos - chunk->offset];
+		segments[*count].length = (size_t)(chunk_end - pos);
+		(*count)++;
+
+		pos = chunk_end;
+		if (chunk->length < chunk->size)
+			break;
+	}
+	return CLIPRDR_READ_AHEAD_DONE;
+}
+
+BOOL cliprdr_read_ahead_queue_read(CliprdrReadAhead* ra, void* req, UINT64 offset, size_t size)
+{
+	WINPR_ASSERT(ra);
+
+	CliprdrReadAheadRead* read = calloc(1, sizeof(CliprdrReadAheadRead));
+	if (!read)
+		return FALSE;
+
+	read->req = req;
+	read->offset = offset;
+	read->size = size;
+	if (!ArrayList_Append(ra->reads, read))
+	{
+		free(read);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL cliprdr_read_ahead_pop_ready(CliprdrReadAhead* ra, UINT64 fileSize,
+                                  CliprdrReadAheadRead* read, CliprdrReadAheadResult* result,
+                                  CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS],
+                                  size_t* count)
+{
+	WINPR_ASSERT(ra);
+	WINPR_ASSERT(read);
+	WINPR_ASSERT(result);
+
+	for (size_t x = 0; x < ArrayList_Count(ra->reads); x++)
+	{
+		const CliprdrReadAheadRead* cur = ArrayList_GetItem(ra->reads, x);
+		*result = cliprdr_read_ahead_lookup(ra, fileSize, cur->offset, cur->size, segments, count);
+		if (*result == CLIPRDR_READ_AHEAD_PENDING)
+			continue;
+
+		*read = *cur;
+		ArrayList_RemoveAt(ra->reads, x);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+BOOL cliprdr_read_ahead_pop_read(CliprdrReadAhead* ra, CliprdrReadAheadRead* read)
+{
+	WINPR_ASSERT(ra);
+	WINPR_ASSERT(read);
+
+	if (ArrayList_Count(ra->reads) == 0)
+		return FALSE;
+
+	const CliprdrReadAheadRead* cur = ArrayList_GetItem(ra->reads, 0);
+	*read = *cur;
+	ArrayList_RemoveAt(ra->reads, 0);
+	return TRUE;
+}
@@ -0,0 +1,147 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Clipboard File Read-Ahead Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CLIENT_COMMON_CLIPRDR_READ_AHEAD_H
+#define CLIENT_COMMON_CLIPRDR_READ_AHEAD_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/api.h>
+
+/* Sequential reads are served from chunks of this size, requested ahead of the reader */
+#define CLIPRDR_READ_AHEAD_CHUNK_SIZE (1024ULL * 1024ULL)
+#define CLIPRDR_READ_AHEAD_CHUNKS 4
+#define CLIPRDR_READ_AHEAD_MAX_CHUNKS (2 * CLIPRDR_READ_AHEAD_CHUNKS)
+#define CLIPRDR_READ_AHEAD_SEQUENTIAL_READS 2
+
+typedef struct
+{
+	UINT64 offset;
+	UINT32 size;
+
+	BOOL pending;
+	BYTE* data;
+	UINT32 length;
+} CliprdrReadAheadChunk;
+
+/* A read waiting for a chunk in flight, req is the request of the caller */
+typedef struct
+{
+	void* req;
+	UINT64 offset;
+	size_t size;
+} CliprdrReadAheadRead;
+
+typedef struct
+{
+	const BYTE* data;
+	size_t length;
+} CliprdrReadAheadSegment;
+
+typedef enum
+{
+	CLIPRDR_READ_AHEAD_MISS,
+	CLIPRDR_READ_AHEAD_PENDING,
+	CLIPRDR_READ_AHEAD_DONE,
+} CliprdrReadAheadResult;
+
+/* A read spans at most two chunks as long as it is not larger than a chunk */
+#define CLIPRDR_READ_AHEAD_MAX_SEGMENTS 2
+
+/**
+ * The chunks of a single file. The cache does not lock, the caller
+ * serializes all calls for a file.
+ */
+typedef struct s_cliprdr_read_ahead CliprdrReadAhead;
+
+FREERDP_LOCAL void cliprdr_read_ahead_free(CliprdrReadAhead* ra);
+
+WINPR_ATTR_MALLOC(cliprdr_read_ahead_free, 1)
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL CliprdrReadAhead* cliprdr_read_ahead_new(void);
+
+/** @brief Records a read, returns if the reads are sequential enough to read ahead */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL cliprdr_read_ahead_sequential(CliprdrReadAhead* ra, UINT64 offset,
+                                                 size_t size);
+
+/**
+ * @brief Moves the read-ahead window to the chunk containing offset
+ *
+ * Completed chunks outside of the window are dropped unless a queued read
+ * still needs them.
+ *
+ * @param missing receives the offsets of the chunks to request
+ * @return the number of offsets written to missing
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL size_t cliprdr_read_ahead_move_window(CliprdrReadAhead* ra, UINT64 fileSize,
+                                                    UINT64 offset,
+                                                    UINT64 missing[CLIPRDR_READ_AHEAD_CHUNKS]);
+
+/** @brief Adds a pending chunk at offset, to be completed by cliprdr_read_ahead_chunk_done */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL CliprdrReadAheadChunk* cliprdr_read_ahead_add_chunk(CliprdrReadAhead* ra,
+                                                                  UINT64 fileSize, UINT64 offset);
+
+/** @brief Drops a chunk, for example when its request could not be sent */
+FREERDP_LOCAL void cliprdr_read_ahead_remove_chunk(CliprdrReadAhead* ra,
+                                                   CliprdrReadAheadChunk* chunk);
+
+/**
+ * @brief Completes a pending chunk with the received data
+ *
+ * A failed chunk is dropped so that later reads request the range directly.
+ */
+FREERDP_LOCAL void cliprdr_read_ahead_chunk_done(CliprdrReadAhead* ra,
+                                                 CliprdrReadAheadChunk* chunk, BOOL success,
+                                                 const BYTE* data, UINT32 length);
+
+/**
+ * @brief Looks up [offset, offset + size) in the completed chunks
+ *
+ * A chunk shorter than requested ends the data available, the result is
+ * short then. The segments point into the chunks and are valid until the
+ * next call modifying the cache.
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL CliprdrReadAheadResult cliprdr_read_ahead_lookup(
+    CliprdrReadAhead* ra, UINT64 fileSize, UINT64 offset, size_t size,
+    CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS], size_t* count);
+
+/** @brief Queues a read that got CLIPRDR_READ_AHEAD_PENDING */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL cliprdr_read_ahead_queue_read(CliprdrReadAhead* ra, void* req, UINT64 offset,
+                                                 size_t size);
+
+/**
+ * @brief Removes the first queued read that no longer waits for a chunk
+ *
+ * @param result CLIPRDR_READ_AHEAD_DONE with the segments to reply, or
+ * CLIPRDR_READ_AHEAD_MISS if the read has to be requested directly
+ * @return FALSE if no queued read is ready
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL cliprdr_read_ahead_pop_ready(
+    CliprdrReadAhead* ra, UINT64 fileSize, CliprdrReadAheadRead* read,
+    CliprdrReadAheadResult* result,
+    CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS], size_t* count);
+
+/** @brief Removes the first queued read regardless of its chunks, FALSE if none is queued */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL cliprdr_read_ahead_pop_read(CliprdrReadAhead* ra, CliprdrReadAheadRead* read);
+
+#endif /* CLIENT_COMMON_CLIPRDR_READ_AHEAD_H */
@@ -5095,6 +5095,14 @@ static int parse_command_line(rdpSettings* settings, const COMMAND_LINE_ARGUMENT
 			if (rc != 0)
 				return fail_at(arg, rc);
 		}
+		CommandLineSwitchCase(arg, "compression-effort")
+		{
+			const int rc = parse_command_line_option_uint32(
+			    settings, arg, FreeRDP_CompressionEffort, COMPRESSION_EFFORT_FAST,
+			    COMPRESSION_EFFORT_BEST);
+			if (rc != 0)
+				return fail_at(arg, rc);
+		}
 		CommandLineSwitchCase(arg, "drives")
 		{
 			if (!freerdp_settings_set_bool(settings, FreeRDP_RedirectDrives, enable))
@@ -142,6 +142,8 @@ static const COMMAND_LINE_ARGUMENT_A global_cmd_args[] = {
 #endif
 	{ "compression", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, "z",
 	  "compression" },
+	{ "compression-effort", COMMAND_LINE_VALUE_REQUIRED, "<effort>", nullptr, nullptr, -1, nullptr,
+	  "Bulk compressor effort (0 fast, 1 default, 2 best)" },
 	{ "compression-level", COMMAND_LINE_VALUE_REQUIRED, "<level>", nullptr, nullptr, -1, nullptr,
 	  "Compression level (0,1,2)" },
 	{ "credentials-delegation", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueFalse, nullptr, -1,
@@ -473,7 +475,7 @@ static const COMMAND_LINE_ARGUMENT_A global_cmd_args[] = {
 	  "Activates Smartcard (optional certificate) Logon authentication." },
 	{ "sound", COMMAND_LINE_VALUE_OPTIONAL,
 	  "[sys:<sys>,][dev:<dev>,][format:<format>,][rate:<rate>,][channel:<channel>,][latency:<"
-	  "latency>,][quality:<quality>]",
+	  "latency>,][quality:<quality>,][jitter:<max delay>]",
 	  nullptr, nullptr, -1, "audio", "Audio output (sound)" },
 	{ "span", COMMAND_LINE_VALUE_FLAG, nullptr, nullptr, nullptr, -1, nullptr,
 	  "Span screen over multiple monitors" },
@@ -0,0 +1,332 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include "../client_cliprdr_read_ahead.h"
+
+#define CHUNK CLIPRDR_READ_AHEAD_CHUNK_SIZE
+
+/* A file of 5.5 chunks, each byte is derived from its offset */
+#define FILE_SIZE (5 * CHUNK + CHUNK / 2)
+
+static BYTE test_byte(UINT64 offset)
+{
+	return (BYTE)((offset * 7) ^ (offset >> 16));
+}
+
+static BOOL test_fail(const char* what)
+{
+	(void)fprintf(stderr, "%s\n", what);
+	return FALSE;
+}
+
+/* Completes the chunk with length bytes of the file starting at the chunk offset */
+static BOOL test_complete(CliprdrReadAhead* ra, CliprdrReadAheadChunk* chunk, UINT32 length)
+{
+	BYTE* data = malloc(length);
+	if (!data)
+		return FALSE;
+
+	for (UINT32 x = 0; x < length; x++)
+		data[x] = test_byte(chunk->offset + x);
+	cliprdr_read_ahead_chunk_done(ra, chunk, TRUE, data, length);
+	free(data);
+	return TRUE;
+}
+
+static BOOL test_segments(const CliprdrReadAheadSegment* segments, size_t count, UINT64 offset,
+                          size_t expected)
+{
+	size_t total = 0;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		for (size_t y = 0; y < segments[x].length; y++)
+		{
+			if (segments[x].data[y] != test_byte(offset + total + y))
+				return test_fail("segment data mismatch");
+		}
+		total += segments[x].length;
+	}
+
+	if (total != expected)
+	{
+		(void)fprintf(stderr, "read %" PRIuz " bytes at %" PRIu64 ", expected %" PRIuz "\n",
+		              total, offset, expected);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL test_lookup(CliprdrReadAhead* ra, UINT64 offset, size_t size,
+                        CliprdrReadAheadResult expected, size_t length)
+{
+	CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	const CliprdrReadAheadResult result =
+	    cliprdr_read_ahead_lookup(ra, FILE_SIZE, offset, size, segments, &count);
+	if (result != expected)
+	{
+		(void)fprintf(stderr, "lookup at %" PRIu64 " returned %d, expected %d\n", offset, result,
+		              expected);
+		return FALSE;
+	}
+
+	if (result != CLIPRDR_READ_AHEAD_DONE)
+		return TRUE;
+	return test_segments(segments, count, offset, length);
+}
+
+/* The window starts after a couple of back to back reads and restarts on a seek */
+static BOOL test_sequential(void)
+{
+	BOOL rc = FALSE;
+	CliprdrReadAhead* ra = cliprdr_read_ahead_new();
+	if (!ra)
+		return FALSE;
+
+	/* A read from the start of the file continues the (empty) previous one */
+	if (cliprdr_read_ahead_sequential(ra, 0, 4096))
+	{
+		test_fail("read ahead before the reads were sequential");
+		goto fail;
+	}
+	if (!cliprdr_read_ahead_sequential(ra, 4096, 4096))
+	{
+		test_fail("no read ahead for sequential reads");
+		goto fail;
+	}
+	if (cliprdr_read_ahead_sequential(ra, 3 * CHUNK, 4096))
+	{
+		test_fail("read ahead after a seek");
+		goto fail;
+	}
+	if (cliprdr_read_ahead_sequential(ra, 3 * CHUNK + 4096, 2 * CHUNK) ||
+	    cliprdr_read_ahead_sequential(ra, 5 * CHUNK + 4096, 2 * CHUNK))
+	{
+		test_fail("read ahead for reads larger than a chunk");
+		goto fail;
+	}
+	if (!cliprdr_read_ahead_sequential(ra, 7 * CHUNK + 4096, 4096))
+	{
+		test_fail("large sequential reads restarted the count");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	cliprdr_read_ahead_free(ra);
+	return rc;
+}
+
+/* Requests the missing chunks of the window at offset, returns how many were requested */
+static size_t test_move(CliprdrReadAhead* ra, UINT64 offset, CliprdrReadAheadChunk** chunks)
+{
+	UINT64 missing[CLIPRDR_READ_AHEAD_CHUNKS] = WINPR_C_ARRAY_INIT;
+
+	const size_t count = cliprdr_read_ahead_move_window(ra, FILE_SIZE, offset, missing);
+	for (size_t x = 0; x < count; x++)
+	{
+		chunks[x] = cliprdr_read_ahead_add_chunk(ra, FILE_SIZE, missing[x]);
+		if (!chunks[x] || (chunks[x]->offset != missing[x]))
+			return 0;
+	}
+	return count;
+}
+
+static BOOL test_window(void)
+{
+	BOOL rc = FALSE;
+	CliprdrReadAheadChunk* chunks[CLIPRDR_READ_AHEAD_CHUNKS] = WINPR_C_ARRAY_INIT;
+	CliprdrReadAheadChunk* next[CLIPRDR_READ_AHEAD_CHUNKS] = WINPR_C_ARRAY_INIT;
+	CliprdrReadAhead* ra = cliprdr_read_ahead_new();
+	if (!ra)
+		return FALSE;
+
+	/* Nothing is cached before the first window */
+	if (!test_lookup(ra, 0, 4096, CLIPRDR_READ_AHEAD_MISS, 0))
+		goto fail;
+
+	if (test_move(ra, 4096, chunks) != CLIPRDR_READ_AHEAD_CHUNKS)
+	{
+		test_fail("the first window did not request all chunks");
+		goto fail;
+	}
+	for (size_t x = 0; x < CLIPRDR_READ_AHEAD_CHUNKS; x++)
+	{
+		if ((chunks[x]->offset != x * CHUNK) || (chunks[x]->size != CHUNK) || !chunks[x]->pending)
+		{
+			test_fail("unexpected chunk in the first window");
+			goto fail;
+		}
+	}
+
+	/* Requested chunks are not requested again */
+	if (test_move(ra, 8192, next) != 0)
+	{
+		test_fail("the same window requested chunks again");
+		goto fail;
+	}
+
+	if (!test_lookup(ra, 4096, 4096, CLIPRDR_READ_AHEAD_PENDING, 0))
+		goto fail;
+	if (!test_complete(ra, chunks[0], CHUNK))
+		goto fail;
+	if (!test_lookup(ra, 4096, 4096, CLIPRDR_READ_AHEAD_DONE, 4096))
+		goto fail;
+
+	/* A read across the first two chunks waits for the second one */
+	int req = 0;
+	const UINT64 across = CHUNK - 1000;
+	if (!test_lookup(ra, across, 4096, CLIPRDR_READ_AHEAD_PENDING, 0) ||
+	    !cliprdr_read_ahead_queue_read(ra, &req, across, 4096))
+		goto fail;
+
+	{
+		CliprdrReadAheadRead read = WINPR_C_ARRAY_INIT;
+		CliprdrReadAheadResult result = CLIPRDR_READ_AHEAD_MISS;
+		CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS] = WINPR_C_ARRAY_INIT;
+		size_t count = 0;
+
+		if (cliprdr_read_ahead_pop_ready(ra, FILE_SIZE, &read, &result, segments, &count))
+		{
+			test_fail("a read was ready before its chunks completed");
+			goto fail;
+		}
+
+		/* The waiting read keeps the first chunk even when the reader moved on */
+		if (test_move(ra, 2 * CHUNK, next) != 2)
+		{
+			test_fail("the window did not advance");
+			goto fail;
+		}
+
+		if (!test_complete(ra, chunks[1], CHUNK))
+			goto fail;
+		if (!cliprdr_read_ahead_pop_ready(ra, FILE_SIZE, &read, &result, segments, &count) ||
+		    (read.req != &req) || (result != CLIPRDR_READ_AHEAD_DONE) || (count != 2))
+		{
+			test_fail("the waiting read did not complete from both chunks");
+			goto fail;
+		}
+		if (!test_segments(segments, count, across, 4096))
+			goto fail;
+		if (cliprdr_read_ahead_pop_ready(ra, FILE_SIZE, &read, &result, segments, &count))
+			goto fail;
+	}
+
+	/* Nothing waits for the first chunk any more, it is dropped with the next move */
+	if (test_move(ra, 3 * CHUNK, chunks) != 0)
+		goto fail;
+	if (!test_lookup(ra, 0, 4096, CLIPRDR_READ_AHEAD_MISS, 0))
+		goto fail;
+	if (!test_lookup(ra, CHUNK, 4096, CLIPRDR_READ_AHEAD_MISS, 0))
+	{
+		test_fail("a completed chunk behind the window was kept");
+		goto fail;
+	}
+	/* Chunks still in flight are kept, their responses complete them */
+	if (!test_lookup(ra, 2 * CHUNK, 4096, CLIPRDR_READ_AHEAD_PENDING, 0))
+		goto fail;
+
+	/* The last chunk ends with the file */
+	if ((next[0]->offset != 4 * CHUNK) || (next[1]->offset != 5 * CHUNK) ||
+	    (next[1]->size != CHUNK / 2))
+	{
+		test_fail("unexpected chunks at the end of the file");
+		goto fail;
+	}
+	if (!test_complete(ra, next[1], CHUNK / 2))
+		goto fail;
+	if (!test_lookup(ra, FILE_SIZE - 100, 4096, CLIPRDR_READ_AHEAD_DONE, 100))
+		goto fail;
+	if (!test_lookup(ra, FILE_SIZE, 4096, CLIPRDR_READ_AHEAD_DONE, 0))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	cliprdr_read_ahead_free(ra);
+	return rc;
+}
+
+/* Failed and short chunks do not hand out data they do not have */
+static BOOL test_errors(void)
+{
+	BOOL rc = FALSE;
+	CliprdrReadAheadChunk* chunks[CLIPRDR_READ_AHEAD_CHUNKS] = WINPR_C_ARRAY_INIT;
+	CliprdrReadAhead* ra = cliprdr_read_ahead_new();
+	if (!ra)
+		return FALSE;
+
+	if (test_move(ra, 0, chunks) != CLIPRDR_READ_AHEAD_CHUNKS)
+		goto fail;
+
+	/* A waiting read of a failed chunk is requested directly */
+	int req = 0;
+	if (!cliprdr_read_ahead_queue_read(ra, &req, 100, 4096))
+		goto fail;
+	cliprdr_read_ahead_chunk_done(ra, chunks[0], FALSE, nullptr, 0);
+	{
+		CliprdrReadAheadRead read = WINPR_C_ARRAY_INIT;
+		CliprdrReadAheadResult result = CLIPRDR_READ_AHEAD_DONE;
+		CliprdrReadAheadSegment segments[CLIPRDR_READ_AHEAD_MAX_SEGMENTS] = WINPR_C_ARRAY_INIT;
+		size_t count = 0;
+
+		if (!cliprdr_read_ahead_pop_ready(ra, FILE_SIZE, &read, &result, segments, &count) ||
+		    (read.req != &req) || (result != CLIPRDR_READ_AHEAD_MISS))
+		{
+			test_fail("the read of a failed chunk was not handed back");
+			goto fail;
+		}
+	}
+	if (!test_lookup(ra, 0, 4096, CLIPRDR_READ_AHEAD_MISS, 0))
+		goto fail;
+
+	/* The failed chunk is requested again with the next move */
+	if (test_move(ra, 0, chunks) != 1)
+	{
+		test_fail("the failed chunk was not requested again");
+		goto fail;
+	}
+
+	/* A short response ends the data, reads past it are not served from the cache */
+	if (!test_complete(ra, chunks[0], 1000))
+		goto fail;
+	if (!test_lookup(ra, 500, 4096, CLIPRDR_READ_AHEAD_DONE, 500))
+		goto fail;
+	if (!test_lookup(ra, 1000, 4096, CLIPRDR_READ_AHEAD_MISS, 0))
+		goto fail;
+
+	/* Reads still queued when the file goes away are handed back for an error reply */
+	if (!cliprdr_read_ahead_queue_read(ra, &req, 2 * CHUNK, 4096))
+		goto fail;
+	{
+		CliprdrReadAheadRead read = WINPR_C_ARRAY_INIT;
+		if (!cliprdr_read_ahead_pop_read(ra, &read) || (read.req != &req) ||
+		    cliprdr_read_ahead_pop_read(ra, &read))
+		{
+			test_fail("queued reads were not handed back");
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	cliprdr_read_ahead_free(ra);
+	return rc;
+}
+
+int TestClientCliprdrReadAhead(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_sequential())
+		return -1;
+	if (!test_window())
+		return -1;
+	if (!test_errors())
+		return -1;
+	return 0;
+}
@@ -107,6 +107,18 @@ static BOOL check_settings_smartcard_no_redirection(rdpSettings* settings)
 	return result;
 }
 
+/* Kernel TLS offload is a server setting, client connections always use user space TLS */
+static BOOL check_settings_no_kernel_tls(rdpSettings* settings)
+{
+	if (freerdp_settings_get_bool(settings, FreeRDP_TlsKernelOffload))
+	{
+		TEST_FAILURE("Expected TlsKernelOffload = FALSE,  but TlsKernelOffload = TRUE!\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 typedef struct
 {
 	int expected_status;
@@ -205,6 +217,10 @@ static const test tests[] = {
 	  check_settings_smartcard_no_redirection,
 	  { "testfreerdp", "/sound", "/drive:media,/foo/bar/blabla", "/v:test.freerdp.com", nullptr },
 	  { WINPR_C_ARRAY_INIT } },
+	{ COMMAND_LINE_ERROR_UNEXPECTED_VALUE,
+	  check_settings_no_kernel_tls,
+	  { "testfreerdp", "/tls:kernel-offload", "/v:test.freerdp.com", nullptr },
+	  { WINPR_C_ARRAY_INIT } },
 };
 // NOLINTEND(bugprone-suspicious-missing-comma)
 
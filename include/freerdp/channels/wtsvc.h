@@ -38,6 +38,7 @@
 #include <winpr/winpr.h>
 #include <winpr/wtypes.h>
 #include <winpr/wtsapi.h>
+#include <winpr/stream.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -122,6 +123,36 @@ extern "C"
 	WINPR_ATTR_NODISCARD
 	FREERDP_API UINT32 WTSChannelGetIdByHandle(HANDLE hChannelHandle);
 
+	/** @brief Allocate a stream to be sent with \b WTSVirtualChannelWriteStream
+	 *
+	 *  The stream is taken from a pool of the channel manager and has room in front of the
+	 *  current position for the channel PDU headers, which allows sending the data without
+	 *  copying it again.
+	 *
+	 *  @param hChannelHandle The channel the stream will be written to
+	 *  @param size The number of bytes the stream must hold
+	 *
+	 *  @return A stream positioned at the start of the payload or \b nullptr on failure.
+	 *  Release it with \b Stream_Release if it is not written.
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API wStream* WTSVirtualChannelStreamNew(HANDLE hChannelHandle, size_t size);
+
+	/** @brief Write the data of a stream allocated by \b WTSVirtualChannelStreamNew
+	 *
+	 *  The data from the start of the payload up to the current position is queued without
+	 *  copying, the stream is released once it has been sent.
+	 *
+	 *  @param hChannelHandle The channel to write to
+	 *  @param s The stream to write, ownership is always transferred
+	 *
+	 *  @return \b TRUE if the data was queued, \b FALSE otherwise
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL WTSVirtualChannelWriteStream(HANDLE hChannelHandle, wStream* s);
+
 #ifdef __cplusplus
 }
 #endif
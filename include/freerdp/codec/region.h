@@ -159,6 +159,24 @@ extern "C"
 	FREERDP_API BOOL region16_union_rect(REGION16* dst, const REGION16* src,
 	                                     const RECTANGLE_16* rect);
 
+	/** adds a set of rectangles to src and stores the resulting region in dst
+	 *
+	 * The result covers the same area as calling \b region16_union_rect for each rectangle,
+	 * but all rectangles are merged in a single sweep. Empty rectangles (zero or negative
+	 * width or height) cover nothing and are skipped: they neither appear in \b dst nor
+	 * extend its extents.
+	 *
+	 * @param dst destination region
+	 * @param src source region
+	 * @param rects the rectangles to add
+	 * @param count the number of rectangles in \b rects
+	 * @return if the operation was successful (false meaning out-of-memory)
+	 * @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL region16_union_rects(REGION16* dst, const REGION16* src,
+	                                      const RECTANGLE_16* rects, size_t count);
+
 	/** returns if a rectangle intersects the region
 	 * @param src the region
 	 * @param arg2 the rectangle
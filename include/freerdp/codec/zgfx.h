@@ -57,6 +57,28 @@ extern "C"
 	                                        const BYTE* WINPR_RESTRICT pUncompressed,
 	                                        UINT32 uncompressedSize, UINT32* WINPR_RESTRICT pFlags);
 
+	/** @brief Compress several buffers as a single message
+	 *
+	 *  The result is the same as compressing the concatenation of all buffers with
+	 *  \b zgfx_compress_to_stream, without creating the concatenation first.
+	 *
+	 *  @param zgfx The compressor
+	 *  @param sDst The stream the message is appended to
+	 *  @param ppUncompressed The buffers to compress
+	 *  @param pUncompressedSizes The size of each buffer
+	 *  @param count The number of buffers
+	 *  @param pFlags Receives the flags of the compressed segments
+	 *
+	 *  @return 0 on success, a negative value on failure
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API int zgfx_compress_gather_to_stream(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+	                                               wStream* WINPR_RESTRICT sDst,
+	                                               const BYTE* const* WINPR_RESTRICT ppUncompressed,
+	                                               const UINT32* WINPR_RESTRICT pUncompressedSizes,
+	                                               size_t count, UINT32* WINPR_RESTRICT pFlags);
+
 	FREERDP_API void zgfx_context_reset(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, BOOL flush);
 
 	FREERDP_API void zgfx_context_free(ZGFX_CONTEXT* zgfx);
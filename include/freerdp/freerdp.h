@@ -797,6 +797,30 @@ owned by rdpRdp */
 	WINPR_ATTR_NODISCARD
 	FREERDP_API ULONG freerdp_get_transport_sent(const rdpContext* context, BOOL resetCount);
 
+	/** @brief Categories of connection state reported by \b freerdp_get_memory_usage
+	 *  \since version 3.31.0
+	 */
+	typedef enum
+	{
+		FREERDP_MEMORY_USAGE_BULK = 0x01,   /**< bulk (de)compressor contexts */
+		FREERDP_MEMORY_USAGE_CODECS = 0x02, /**< graphics codecs in rdpContext::codecs */
+		FREERDP_MEMORY_USAGE_ALL = 0xFF
+	} FreeRDP_MemoryUsageFlags;
+
+	/** Approximates the heap memory held by the state of a connection
+	 *
+	 *  Compressor and codec state is created on demand, so the value grows with the
+	 *  features actually used by the connection. Memory held by external libraries,
+	 *  e.g. the H.264 decoder, is not included.
+	 *
+	 *	\param context the RDP context
+	 *	\param flags a combination of \b FreeRDP_MemoryUsageFlags
+	 *	\returns the number of bytes
+	 *	\since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API size_t freerdp_get_memory_usage(const rdpContext* context, UINT32 flags);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API BOOL freerdp_nla_impersonate(rdpContext* context);
 
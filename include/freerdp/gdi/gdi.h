@@ -28,6 +28,8 @@
 #include <freerdp/types.h>
 
 #include <freerdp/log.h>
+#include <freerdp/metrics.h>
+#include <freerdp/constants.h>
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/region.h>
 
@@ -520,6 +522,10 @@ extern "C"
 		GeometryClientContext* geometry;
 
 		wLog* log;
+
+		/* freerdp_decode_seconds by codec ID, @since version 3.31.0 */
+		rdpMetric* surfaceBitsDecode[RDP_CODEC_ID_IMAGE_REMOTEFX + 1];
+		rdpMetric* gfxDecode[RDPGFX_CODECID_MAX];
 	};
 	typedef struct rdp_gdi rdpGdi;
 
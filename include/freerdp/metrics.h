@@ -25,6 +25,10 @@
 #include <freerdp/api.h>
 #include <freerdp/types.h>
 
+/** The path served by a \b rdpMetricsEndpoint
+ *  @since version 3.31.0 */
+#define METRICS_ENDPOINT_PATH "/metrics"
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -40,10 +44,195 @@ extern "C"
 	};
 	typedef struct rdp_metrics rdpMetrics;
 
+	/** @since version 3.31.0 */
+	typedef enum
+	{
+		FREERDP_METRIC_COUNTER,  /**< monotonic counter, only increased with \b metric_add */
+		FREERDP_METRIC_GAUGE,    /**< value that can go up and down */
+		FREERDP_METRIC_HISTOGRAM /**< distribution of observed durations in nanoseconds */
+	} FREERDP_METRIC_TYPE;
+
+	/** @since version 3.31.0 */
+	typedef struct rdp_metric rdpMetric;
+
+	/** @since version 3.31.0 */
+	typedef struct rdp_metrics_endpoint rdpMetricsEndpoint;
+
+	/** @brief Callback returning the OpenMetrics text served by a \b rdpMetricsEndpoint
+	 *
+	 *  @param arg the argument supplied to \b metrics_endpoint_new
+	 *  @param plength the length of the returned string
+	 *  @return a string allocated with \b malloc or \b nullptr in case of failure
+	 *  @since version 3.31.0
+	 */
+	typedef char* (*pMetricsEndpointExport)(void* arg, size_t* plength);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes,
 	                                       UINT32 CompressedBytes);
 
+	/** @brief Get a metric of the session, create it if it does not exist yet
+	 *
+	 *  The name follows the OpenMetrics syntax and may contain a label set, e.g.
+	 *  \b freerdp_decode_seconds{codec="planar"}. All metrics sharing the name before the
+	 *  label set form a family and must have the same type.
+	 *
+	 *  The returned metric is valid as long as \b metrics is.
+	 *
+	 *  @param metrics the metrics of the session
+	 *  @param name the name of the metric
+	 *  @param type the type of the metric
+	 *  @param help an optional description of the family
+	 *  @return the metric or \b nullptr in case of failure or a type mismatch
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API rdpMetric* metrics_get_metric(rdpMetrics* metrics, const char* name,
+	                                          FREERDP_METRIC_TYPE type, const char* help);
+
+	/** @brief Number of metrics registered with the session
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API size_t metrics_get_count(rdpMetrics* metrics);
+
+	/** @brief Get a metric by index, \b index must be less than \b metrics_get_count
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API rdpMetric* metrics_get_metric_by_index(rdpMetrics* metrics, size_t index);
+
+	/** @brief Add \b value to a counter or gauge
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API void metric_add(rdpMetric* metric, INT64 value);
+
+	/** @brief Set the value of a gauge
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API void metric_set(rdpMetric* metric, INT64 value);
+
+	/** @brief Record a duration in nanoseconds in a histogram
+	 *
+	 *  Values are kept in logarithmic buckets with 16 linear sub buckets each, the
+	 *  relative error of reported percentiles is below 1/16.
+	 *
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API void metric_observe(rdpMetric* metric, UINT64 value);
+
+	/** @brief Get or register the histogram \b family{label="value"}
+	 *
+	 *  The lookup takes a lock, hot paths should keep the returned histogram.
+	 *
+	 *  @param metrics the metrics of the session
+	 *  @param family the name of the histogram without labels
+	 *  @param label an optional label name, e.g. \b codec
+	 *  @param value the value of \b label
+	 *  @param help an optional description of the family
+	 *  @return the histogram or \b nullptr in case of failure
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API rdpMetric* metrics_get_histogram(rdpMetrics* metrics, const char* family,
+	                                             const char* label, const char* value,
+	                                             const char* help);
+
+	/** @brief Record a duration in the histogram \b family{label="value"}
+	 *
+	 *  Convenience for \b metrics_get_histogram followed by \b metric_observe.
+	 *
+	 *  @param metrics the metrics of the session
+	 *  @param family the name of the histogram without labels
+	 *  @param label an optional label name, e.g. \b codec
+	 *  @param value the value of \b label
+	 *  @param help an optional description of the family
+	 *  @param duration the duration in nanoseconds
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API void metrics_observe_duration(rdpMetrics* metrics, const char* family,
+	                                          const char* label, const char* value,
+	                                          const char* help, UINT64 duration);
+
+	/** @since version 3.31.0 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API const char* metric_get_name(const rdpMetric* metric);
+
+	/** @since version 3.31.0 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API FREERDP_METRIC_TYPE metric_get_type(const rdpMetric* metric);
+
+	/** @brief The value of a counter or gauge, the sum of all observed values of a histogram
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API INT64 metric_get_value(const rdpMetric* metric);
+
+	/** @brief The number of values observed by a histogram
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API UINT64 metric_get_count(const rdpMetric* metric);
+
+	/** @brief The value below which \b percentile percent of the observed values lie
+	 *
+	 *  @param metric a histogram
+	 *  @param percentile the percentile in the range [0, 100]
+	 *  @return the value in nanoseconds, \b 0 if nothing was observed
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API UINT64 metric_get_percentile(const rdpMetric* metric, double percentile);
+
+	/** @brief Note that input was sent, used for the input to display latency
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API void metrics_input_sent(rdpMetrics* metrics);
+
+	/** @brief Note that a frame was presented, observes the latency of pending input
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API void metrics_frame_presented(rdpMetrics* metrics);
+
+	/** @brief Format the metrics of one or more sessions as OpenMetrics text
+	 *
+	 *  Histograms are exported as summaries with 0.5, 0.9 and 0.99 quantiles in seconds.
+	 *
+	 *  @param metrics the sessions to export
+	 *  @param labels an optional label set per session, e.g. \b session="1", used to
+	 *                tell apart the sessions. May be \b nullptr
+	 *  @param count the number of sessions
+	 *  @param plength optional, receives the length of the returned string
+	 *  @return the text terminated by \b # \b EOF, to be released with \b free
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_MALLOC(free, 1)
+	WINPR_ATTR_NODISCARD
+	FREERDP_API char* metrics_to_openmetrics(rdpMetrics* const* metrics,
+	                                         const char* const* labels, size_t count,
+	                                         size_t* plength);
+
+	/** @since version 3.31.0 */
+	FREERDP_API void metrics_endpoint_free(rdpMetricsEndpoint* endpoint);
+
+	/** @brief Serve OpenMetrics text via HTTP
+	 *
+	 *  A background thread answers GET and HEAD requests for \b METRICS_ENDPOINT_PATH on
+	 *  \b address:port with the text returned by \b fkt. Other paths are answered with
+	 *  404, other methods with 405.
+	 *
+	 *  @param address the address to bind to, \b nullptr for localhost
+	 *  @param port the TCP port to listen on
+	 *  @param fkt the callback producing the metrics text
+	 *  @param arg an argument passed to \b fkt
+	 *  @return the endpoint or \b nullptr in case of failure
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_MALLOC(metrics_endpoint_free, 1)
+	WINPR_ATTR_NODISCARD
+	FREERDP_API rdpMetricsEndpoint* metrics_endpoint_new(const char* address, UINT16 port,
+	                                                     pMetricsEndpointExport fkt, void* arg);
+
 	FREERDP_API void metrics_free(rdpMetrics* metrics);
 
 	WINPR_ATTR_MALLOC(metrics_free, 1)
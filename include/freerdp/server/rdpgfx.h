@@ -155,6 +155,32 @@ extern "C"
 	WINPR_ATTR_NODISCARD
 	FREERDP_API UINT rdpgfx_server_handle_messages(RdpgfxServerContext* context);
 
+	/** @brief Start collecting the PDUs of a frame
+	 *
+	 *  All PDUs sent by the calling thread until \b rdpgfx_server_batch_end are
+	 *  collected and sent as a single compressed channel message. Large batches
+	 *  are flushed early.
+	 *
+	 *  @param context The rdpgfx server context
+	 *
+	 *  @return \b TRUE if successful, \b FALSE if a batch is already active or on failure
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL rdpgfx_server_batch_begin(RdpgfxServerContext* context);
+
+	/** @brief Send the PDUs collected since \b rdpgfx_server_batch_begin
+	 *
+	 *  Must be called from the thread that started the batch.
+	 *
+	 *  @param context The rdpgfx server context
+	 *
+	 *  @return 0 on success, otherwise a Win32 error code
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API UINT rdpgfx_server_batch_end(RdpgfxServerContext* context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,7 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/settings.h>
 #include <freerdp/listener.h>
+#include <freerdp/metrics.h>
 
 #include <freerdp/channels/wtsvc.h>
 #include <freerdp/channels/channels.h>
@@ -187,6 +188,8 @@ extern "C"
 #else
 	    UINT32 reservedAV1[2];
 #endif
+		UINT16 metricsPort;                  /** @since version 3.31.0 */
+		rdpMetricsEndpoint* metricsEndpoint; /** @since version 3.31.0 */
 	};
 
 	struct rdp_shadow_surface
@@ -330,6 +330,14 @@ extern "C"
 #define PACKET_COMPR_TYPE_RDP61 0x03
 #define PACKET_COMPR_TYPE_RDP8 0x04
 
+/* Bulk compressor effort, @since version 3.31.0 */
+#define COMPRESSION_EFFORT_FAST 0
+#define COMPRESSION_EFFORT_DEFAULT 1
+#define COMPRESSION_EFFORT_BEST 2
+
+/* Default of FreeRDP_GdiInvalidRectLimit, @since version 3.31.0 */
+#define GDI_INVALID_RECT_LIMIT 64
+
 	/* Desktop Rotation Flags */
 	enum FreeRDP_DesktopRotationFlags
 	{
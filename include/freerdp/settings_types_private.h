@@ -216,7 +216,9 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL HiDefRemoteApp);         /* 720 */
 	SETTINGS_DEPRECATED(ALIGN64 UINT32 CompressionLevel);     /* 721 */
 	SETTINGS_DEPRECATED(ALIGN64 UINT32 RemoteAppFeatureFlags); /* 722 */
-	UINT64 padding0768[768 - 723];                             /* 723 */
+	SETTINGS_DEPRECATED(ALIGN64 UINT32 CompressionEffort);     /** 723
+	                                                            * @since version 3.31.0 */
+	UINT64 padding0768[768 - 724];                             /* 724 */
 
 	/* Client Info (Extra) */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL IPv6Enabled);       /* 768 */
@@ -303,7 +305,11 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL RemoteCredentialGuard);        /* 1114 */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL RestrictedAdminModeSupported); /** 1115
 		                                                             * @since version 3.16.0 */
-	UINT64 padding1152[1152 - 1116];                                /* 1116 */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL TlsKernelOffload);             /** 1116
+		                                                             * @since version 3.31.0 */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL TlsSessionTickets);            /** 1117
+		                                                             * @since version 3.31.0 */
+	UINT64 padding1152[1152 - 1118];                                /* 1118 */
 
 	/* Connection Cookie */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL MstscCookieMode);      /* 1152 */
@@ -434,7 +440,9 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL MouseUseRelativeMove);    /* 1607 */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL UseCommonStdioCallbacks); /* 1608 */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL ConnectChildSession);     /* 1609 */
-	UINT64 padding1664[1664 - 1610];                           /* 1610 */
+	SETTINGS_DEPRECATED(ALIGN64 UINT32 GdiInvalidRectLimit);   /** 1610
+	                                                            * @since version 3.31.0 */
+	UINT64 padding1664[1664 - 1611];                           /* 1611 */
 
 	/* Names */
 	SETTINGS_DEPRECATED(ALIGN64 char* ComputerName); /* 1664 */
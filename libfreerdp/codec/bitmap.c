@@ -19,11 +19,20 @@
 
 #include <winpr/assert.h>
 #include <winpr/cast.h>
+#include <winpr/endian.h>
+#include <winpr/synch.h>
 
 #include <freerdp/config.h>
 
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/planar.h>
+#include <freerdp/log.h>
+
+#include "bitmap_encode.h"
+#include "sse/bitmap_sse2.h"
+#include "neon/bitmap_neon.h"
+
+#define TAG FREERDP_TAG("codec")
 
 struct count
 {
@@ -36,1080 +45,618 @@ struct count
 	ALIGN64 BOOL bicolor_spin;
 };
 
-static inline void reset_counts(struct count* counts)
+typedef struct
 {
-	const struct count empty = WINPR_C_ARRAY_INIT;
-	WINPR_ASSERT(counts);
-	*counts = empty;
-}
-
-static inline UINT16 GETPIXEL16(const void* WINPR_RESTRICT d, UINT32 x, UINT32 y, UINT32 w)
+	wStream* s;
+	wStream* temp_s;
+	const BITMAP_ENCODE_FUNCTIONS* fn;
+	size_t bpp; /**< bytes per pixel in the output */
+	UINT32 mix;
+	UINT16 count; /**< pixels in temp_s */
+	UINT32 last_pixel;
+	UINT32 bicolor1;
+	UINT32 bicolor2;
+	struct count counts;
+	uint8_t fom_mask[8192]; /* good for up to 64K bitmap */
+} BITMAP_ENCODER;
+
+static BITMAP_ENCODE_FUNCTIONS bitmap_encode_fn = WINPR_C_ARRAY_INIT;
+static INIT_ONCE bitmap_encode_InitOnce = INIT_ONCE_STATIC_INIT;
+
+static void bitmap_classify_line_c(const UINT32* WINPR_RESTRICT line,
+                                   const UINT32* WINPR_RESTRICT prev, UINT32 mix,
+                                   BYTE* WINPR_RESTRICT classes, size_t width)
 {
-	const BYTE* WINPR_RESTRICT src = (const BYTE*)d + ((y * w + x) * sizeof(UINT16));
-	return WINPR_ASSERTING_INT_CAST(UINT16, ((UINT16)src[1] << 8) | (UINT16)src[0]);
+	bitmap_classify_line_generic(line, prev, mix, classes, 2, width);
 }
 
-static inline UINT32 GETPIXEL32(const void* WINPR_RESTRICT d, UINT32 x, UINT32 y, UINT32 w)
+static BOOL CALLBACK bitmap_encode_init_cb(PINIT_ONCE once, PVOID param, PVOID* context)
 {
-	const BYTE* WINPR_RESTRICT src = (const BYTE*)d + ((y * w + x) * sizeof(UINT32));
-	return (((UINT32)src[3]) << 24) | (((UINT32)src[2]) << 16) | (((UINT32)src[1]) << 8) |
-	       (src[0] & 0xFF);
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+	bitmap_encode_fn.classify_line = bitmap_classify_line_c;
+	bitmap_encode_fn.scan_class = bitmap_scan_class_generic;
+	bitmap_encode_init_sse2(&bitmap_encode_fn);
+	bitmap_encode_init_neon(&bitmap_encode_fn);
+	return TRUE;
 }
 
-/*****************************************************************************/
-static inline UINT16 IN_PIXEL16(const void* WINPR_RESTRICT in_ptr, UINT32 in_x, UINT32 in_y,
-                                UINT32 in_w, UINT16 in_last_pixel)
+static inline void reset_counts(struct count* counts)
 {
-	if (in_ptr == nullptr)
-		return 0;
-	else if (in_x < in_w)
-		return GETPIXEL16(in_ptr, in_x, in_y, in_w);
-	else
-		return in_last_pixel;
+	const struct count empty = WINPR_C_ARRAY_INIT;
+	WINPR_ASSERT(counts);
+	*counts = empty;
 }
 
-/*****************************************************************************/
-static inline UINT32 IN_PIXEL32(const void* WINPR_RESTRICT in_ptr, UINT32 in_x, UINT32 in_y,
-                                UINT32 in_w, UINT32 in_last_pixel)
+/* An order runs while its count does not lose against any other one */
+static inline BOOL count_wins(const struct count* counts, UINT16 value)
 {
-	if (in_ptr == nullptr)
-		return 0;
-	else if (in_x < in_w)
-		return GETPIXEL32(in_ptr, in_x, in_y, in_w);
-	else
-		return in_last_pixel;
+	return (value > 3) && (value >= counts->fill_count) && (value >= counts->mix_count) &&
+	       (value >= counts->color_count) && (value >= counts->bicolor_count) &&
+	       (value >= counts->fom_count);
 }
 
 /*****************************************************************************/
-/* color */
-static inline UINT16 out_color_count_2(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                       UINT16 in_data)
+static inline void out_pixel(wStream* WINPR_RESTRICT s, UINT32 pixel, size_t bpp)
 {
-	if (in_count > 0)
-	{
-		if (in_count < 32)
-		{
-			const BYTE temp = ((0x3u << 5) | in_count) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x60);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf3);
-			Stream_Write_UINT16(in_s, in_count);
-		}
-
-		Stream_Write_UINT16(in_s, in_data);
-	}
+	Stream_Write_UINT8(s, pixel & 0xFF);
+	Stream_Write_UINT8(s, (pixel >> 8) & 0xFF);
 
-	return 0;
+	if (bpp > 2)
+		Stream_Write_UINT8(s, (pixel >> 16) & 0xFF);
 }
 
 /*****************************************************************************/
-/* color */
-static inline UINT16 out_color_count_3(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                       UINT32 in_data)
+/* regular orders: fill, mix, color and copy */
+static inline BOOL out_order(wStream* WINPR_RESTRICT s, BYTE code, BYTE megaCode, UINT16 in_count,
+                             size_t length)
 {
-	if (in_count > 0)
-	{
-		if (in_count < 32)
-		{
-			const BYTE temp = ((0x3u << 5) | in_count) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x60);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf3);
-			Stream_Write_UINT16(in_s, in_count);
-		}
-
-		Stream_Write_UINT8(in_s, in_data & 0xFF);
+	if (!Stream_CheckAndLogRequiredCapacity(TAG, s, 3 + length))
+		return FALSE;
 
-		Stream_Write_UINT8(in_s, (in_data >> 8) & 0xFF);
-		Stream_Write_UINT8(in_s, (in_data >> 16) & 0xFF);
+	if (in_count < 32)
+	{
+		Stream_Write_UINT8(s, (code | in_count) & 0xFF);
+	}
+	else if (in_count < 256 + 32)
+	{
+		Stream_Write_UINT8(s, code);
+		Stream_Write_UINT8(s, (in_count - 32) & 0xFF);
+	}
+	else
+	{
+		Stream_Write_UINT8(s, megaCode);
+		Stream_Write_UINT16(s, in_count);
 	}
 
-	return 0;
+	return TRUE;
 }
 
 /*****************************************************************************/
-/* copy */
-static inline UINT16 out_copy_count_2(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                      wStream* WINPR_RESTRICT in_data)
-
+/* color */
+static inline BOOL out_color_count(BITMAP_ENCODER* WINPR_RESTRICT enc, UINT16 in_count,
+                                   UINT32 in_data)
 {
 	if (in_count > 0)
 	{
-		if (in_count < 32)
-		{
-			const BYTE temp = ((0x4u << 5) | in_count) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x80);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf4);
-			Stream_Write_UINT16(in_s, in_count);
-		}
+		if (!out_order(enc->s, 0x60, 0xf3, in_count, enc->bpp))
+			return FALSE;
 
-		Stream_Write(in_s, Stream_Buffer(in_data), 2ULL * in_count);
+		out_pixel(enc->s, in_data, enc->bpp);
 	}
 
-	Stream_ResetPosition(in_data);
-	return 0;
+	return TRUE;
 }
 
 /*****************************************************************************/
-/* copy */
-static inline UINT16 out_copy_count_3(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                      wStream* WINPR_RESTRICT in_data)
+/* copy, the literal pixels are the first in_count ones of temp_s */
+static inline BOOL out_copy_count(BITMAP_ENCODER* WINPR_RESTRICT enc, UINT16 in_count)
 {
+	const size_t length = enc->bpp * in_count;
+
 	if (in_count > 0)
 	{
-		if (in_count < 32)
-		{
-			const BYTE temp = ((0x4u << 5) | in_count) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x80);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf4);
-			Stream_Write_UINT16(in_s, in_count);
-		}
+		if (!out_order(enc->s, 0x80, 0xf4, in_count, length))
+			return FALSE;
 
-		Stream_Write(in_s, Stream_Pointer(in_data), 3ULL * in_count);
+		Stream_Write(enc->s, Stream_Buffer(enc->temp_s), length);
 	}
 
-	Stream_ResetPosition(in_data);
-	return 0;
+	Stream_ResetPosition(enc->temp_s);
+	enc->count = 0;
+	return TRUE;
 }
 
 /*****************************************************************************/
 /* bicolor */
-static inline UINT16 out_bicolor_count_2(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                         UINT16 in_color1, UINT16 in_color2)
+static inline BOOL out_bicolor_count(BITMAP_ENCODER* WINPR_RESTRICT enc, UINT16 in_count,
+                                     UINT32 in_color1, UINT32 in_color2)
 {
+	wStream* s = enc->s;
+
 	if (in_count > 0)
 	{
+		if (!Stream_CheckAndLogRequiredCapacity(TAG, s, 3 + 2 * enc->bpp))
+			return FALSE;
+
 		if (in_count / 2 < 16)
 		{
-			const BYTE temp = ((0xe << 4) | (in_count / 2)) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
+			Stream_Write_UINT8(s, ((0xe << 4) | (in_count / 2)) & 0xFF);
 		}
 		else if (in_count / 2 < 256 + 16)
 		{
-			const BYTE temp = (in_count / 2 - 16) & 0xFF;
-			Stream_Write_UINT8(in_s, 0xe0);
-			Stream_Write_UINT8(in_s, temp);
+			Stream_Write_UINT8(s, 0xe0);
+			Stream_Write_UINT8(s, (in_count / 2 - 16) & 0xFF);
 		}
 		else
 		{
-			Stream_Write_UINT8(in_s, 0xf8);
-			Stream_Write_UINT16(in_s, in_count / 2);
+			Stream_Write_UINT8(s, 0xf8);
+			Stream_Write_UINT16(s, in_count / 2);
 		}
 
-		Stream_Write_UINT16(in_s, in_color1);
-		Stream_Write_UINT16(in_s, in_color2);
+		out_pixel(s, in_color1, enc->bpp);
+		out_pixel(s, in_color2, enc->bpp);
 	}
 
-	return 0;
+	return TRUE;
 }
 
 /*****************************************************************************/
-/* bicolor */
-static inline UINT16 out_bicolor_count_3(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                         UINT32 in_color1, UINT32 in_color2)
+/* fill or mix (fom) */
+static inline BOOL out_fom_count(BITMAP_ENCODER* WINPR_RESTRICT enc, UINT16 in_count)
 {
+	wStream* s = enc->s;
+	const size_t length = enc->counts.fom_mask_len;
+
 	if (in_count > 0)
 	{
-		if (in_count / 2 < 16)
+		if (!Stream_CheckAndLogRequiredCapacity(TAG, s, 3 + length))
+			return FALSE;
+
+		if ((in_count % 8) == 0 && in_count < 249)
 		{
-			const BYTE temp = ((0xe << 4) | (in_count / 2)) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
+			Stream_Write_UINT8(s, ((0x2u << 5) | (in_count / 8)) & 0xFF);
 		}
-		else if (in_count / 2 < 256 + 16)
+		else if (in_count < 256)
 		{
-			const BYTE temp = (in_count / 2 - 16) & 0xFF;
-			Stream_Write_UINT8(in_s, 0xe0);
-			Stream_Write_UINT8(in_s, temp);
+			Stream_Write_UINT8(s, 0x40);
+			Stream_Write_UINT8(s, (in_count - 1) & 0xFF);
 		}
 		else
 		{
-			Stream_Write_UINT8(in_s, 0xf8);
-			Stream_Write_UINT16(in_s, in_count / 2);
+			Stream_Write_UINT8(s, 0xf2);
+			Stream_Write_UINT16(s, in_count);
 		}
 
-		Stream_Write_UINT8(in_s, in_color1 & 0xFF);
-		Stream_Write_UINT8(in_s, (in_color1 >> 8) & 0xFF);
-		Stream_Write_UINT8(in_s, (in_color1 >> 16) & 0xFF);
-		Stream_Write_UINT8(in_s, in_color2 & 0xFF);
-		Stream_Write_UINT8(in_s, (in_color2 >> 8) & 0xFF);
-		Stream_Write_UINT8(in_s, (in_color2 >> 16) & 0xFF);
+		Stream_Write(s, enc->fom_mask, length);
 	}
 
-	return 0;
+	return TRUE;
 }
 
 /*****************************************************************************/
-/* fill */
-static inline UINT16 out_fill_count_2(UINT16 in_count, wStream* WINPR_RESTRICT in_s)
+/* Emit the literal pixels preceding a run of in_count pixels and the run itself */
+static inline BOOL out_literals(BITMAP_ENCODER* WINPR_RESTRICT enc, UINT16 in_count)
 {
-	if (in_count > 0)
-	{
-		if (in_count < 32)
-		{
-			Stream_Write_UINT8(in_s, in_count & 0xFF);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x0);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf0);
-			Stream_Write_UINT16(in_s, in_count);
-		}
-	}
+	if (in_count > enc->count)
+		return FALSE;
 
-	return 0;
+	return out_copy_count(enc, enc->count - in_count);
 }
 
-/*****************************************************************************/
-/* fill */
-static inline UINT16 out_fill_count_3(UINT16 in_count, wStream* WINPR_RESTRICT in_s)
+static BOOL flush_fill(BITMAP_ENCODER* WINPR_RESTRICT enc)
 {
-	if (in_count > 0)
-	{
-		if (in_count < 32)
-		{
-			Stream_Write_UINT8(in_s, in_count & 0xFF);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x0);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf0);
-			Stream_Write_UINT16(in_s, in_count);
-		}
-	}
+	const UINT16 fill_count = enc->counts.fill_count;
+	if (!out_literals(enc, fill_count) || !out_order(enc->s, 0x00, 0xf0, fill_count, 0))
+		return FALSE;
+	reset_counts(&enc->counts);
+	return TRUE;
+}
 
-	return 0;
+static BOOL flush_mix(BITMAP_ENCODER* WINPR_RESTRICT enc)
+{
+	const UINT16 mix_count = enc->counts.mix_count;
+	if (!out_literals(enc, mix_count) || !out_order(enc->s, 0x20, 0xf1, mix_count, 0))
+		return FALSE;
+	reset_counts(&enc->counts);
+	return TRUE;
 }
 
-/*****************************************************************************/
-/* mix */
-static inline UINT16 out_counts_mix_count_2(UINT16 in_count, wStream* WINPR_RESTRICT in_s)
+static BOOL flush_color(BITMAP_ENCODER* WINPR_RESTRICT enc)
 {
-	if (in_count > 0)
-	{
-		if (in_count < 32)
-		{
-			const BYTE temp = ((0x1u << 5) | in_count) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x20);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf1);
-			Stream_Write_UINT16(in_s, in_count);
-		}
-	}
+	const UINT16 color_count = enc->counts.color_count;
+	if (!out_literals(enc, color_count) || !out_color_count(enc, color_count, enc->last_pixel))
+		return FALSE;
+	reset_counts(&enc->counts);
+	return TRUE;
+}
+
+static BOOL flush_bicolor(BITMAP_ENCODER* WINPR_RESTRICT enc)
+{
+	UINT16 bicolor_count = enc->counts.bicolor_count;
+
+	/* The run starts with bicolor1, an odd first pixel is sent as literal */
+	const BOOL odd = (bicolor_count % 2) != 0;
+	if (odd)
+		bicolor_count--;
+
+	const UINT32 color1 = odd ? enc->bicolor2 : enc->bicolor1;
+	const UINT32 color2 = odd ? enc->bicolor1 : enc->bicolor2;
+	if (!out_literals(enc, bicolor_count) ||
+	    !out_bicolor_count(enc, bicolor_count, color1, color2))
+		return FALSE;
+	reset_counts(&enc->counts);
+	return TRUE;
+}
 
-	return 0;
+static BOOL flush_fom(BITMAP_ENCODER* WINPR_RESTRICT enc)
+{
+	const UINT16 fom_count = enc->counts.fom_count;
+	if (!out_literals(enc, fom_count) || !out_fom_count(enc, fom_count))
+		return FALSE;
+	reset_counts(&enc->counts);
+	return TRUE;
 }
 
-/*****************************************************************************/
-/* mix */
-static inline UINT16 out_counts_mix_count_3(UINT16 in_count, wStream* WINPR_RESTRICT in_s)
+/* Append in_count bits to the fill or mix mask, set bits select mix */
+static inline BOOL fom_mask_append(BITMAP_ENCODER* WINPR_RESTRICT enc, BOOL mix, size_t in_count)
 {
-	if (in_count > 0)
+	struct count* counts = &enc->counts;
+
+	while (in_count > 0)
 	{
-		if (in_count < 32)
-		{
-			const BYTE temp = ((0x1u << 5) | in_count) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256 + 32)
-		{
-			const BYTE temp = (in_count - 32) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x20);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
+		const size_t offset = counts->fom_count % 8;
+
+		if (offset == 0)
 		{
-			Stream_Write_UINT8(in_s, 0xf1);
-			Stream_Write_UINT16(in_s, in_count);
+			if (counts->fom_mask_len >= sizeof(enc->fom_mask))
+				return FALSE;
+			enc->fom_mask[counts->fom_mask_len++] = 0;
 		}
+
+		const size_t bits = MIN(8 - offset, in_count);
+		if (mix)
+			enc->fom_mask[counts->fom_mask_len - 1] |= (uint8_t)(((1u << bits) - 1) << offset);
+
+		counts->fom_count = (UINT16)(counts->fom_count + bits);
+		in_count -= bits;
 	}
 
-	return 0;
+	return TRUE;
 }
 
-/*****************************************************************************/
-/* fom */
-static inline UINT16 out_from_count_2(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                      const uint8_t* WINPR_RESTRICT in_mask, size_t in_mask_len)
+static inline BOOL test_bicolor(const BITMAP_ENCODER* WINPR_RESTRICT enc, UINT32 pixel)
 {
-	if (in_count > 0)
-	{
-		if ((in_count % 8) == 0 && in_count < 249)
-		{
-			const BYTE temp = ((0x2u << 5) | (in_count / 8)) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256)
-		{
-			const BYTE temp = (in_count - 1) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x40);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf2);
-			Stream_Write_UINT16(in_s, in_count);
-		}
+	const struct count* counts = &enc->counts;
+	const UINT32 last_pixel = enc->last_pixel;
 
-		Stream_Write(in_s, in_mask, in_mask_len);
-	}
+	return (pixel != last_pixel) &&
+	       ((!counts->bicolor_spin && (pixel == enc->bicolor1) && (last_pixel == enc->bicolor2)) ||
+	        (counts->bicolor_spin && (pixel == enc->bicolor2) && (last_pixel == enc->bicolor1)));
+}
 
-	return 0;
+static inline void temp_write_pixel(BITMAP_ENCODER* WINPR_RESTRICT enc, UINT32 pixel)
+{
+	out_pixel(enc->temp_s, pixel, enc->bpp);
+	enc->count++;
+	enc->last_pixel = pixel;
 }
 
-/*****************************************************************************/
-/* fill or mix (fom) */
-static inline UINT16 out_from_count_3(UINT16 in_count, wStream* WINPR_RESTRICT in_s,
-                                      const uint8_t* WINPR_RESTRICT in_mask, size_t in_mask_len)
+/* Feed a single pixel to the encoder, ypixel is the pixel of the previous line */
+static BOOL encode_pixel(BITMAP_ENCODER* WINPR_RESTRICT enc, UINT32 pixel, UINT32 ypixel)
 {
-	if (in_count > 0)
+	struct count* counts = &enc->counts;
+	const BOOL fill = (pixel == ypixel);
+	const BOOL mix = (pixel == (ypixel ^ enc->mix));
+	const BOOL color = (pixel == enc->last_pixel);
+
+	if (!fill)
 	{
-		if ((in_count % 8) == 0 && in_count < 249)
-		{
-			const BYTE temp = ((0x2u << 5) | (in_count / 8)) & 0xFF;
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else if (in_count < 256)
-		{
-			const BYTE temp = (in_count - 1) & 0xFF;
-			Stream_Write_UINT8(in_s, 0x40);
-			Stream_Write_UINT8(in_s, temp);
-		}
-		else
-		{
-			Stream_Write_UINT8(in_s, 0xf2);
-			Stream_Write_UINT16(in_s, in_count);
-		}
+		if (count_wins(counts, counts->fill_count) && !flush_fill(enc))
+			return FALSE;
+		counts->fill_count = 0;
+	}
 
-		Stream_Write(in_s, in_mask, in_mask_len);
+	if (!mix)
+	{
+		if (count_wins(counts, counts->mix_count) && !flush_mix(enc))
+			return FALSE;
+		counts->mix_count = 0;
 	}
 
-	return 0;
-}
+	if (!color)
+	{
+		if (count_wins(counts, counts->color_count) && !flush_color(enc))
+			return FALSE;
+		counts->color_count = 0;
+	}
 
-#define TEST_FILL ((last_line == 0 && pixel == 0) || (last_line != 0 && pixel == ypixel))
-#define TEST_MIX ((last_line == 0 && pixel == mix) || (last_line != 0 && pixel == (ypixel ^ mix)))
-#define TEST_FOM TEST_FILL || TEST_MIX
-#define TEST_COLOR pixel == last_pixel
-
-#define test_bicolor(counts)                                                          \
-	((pixel != last_pixel) &&                                                         \
-	 ((!(counts)->bicolor_spin && (pixel == bicolor1) && (last_pixel == bicolor2)) || \
-	  ((counts)->bicolor_spin && (pixel == bicolor2) && (last_pixel == bicolor1))))
-
-static inline SSIZE_T freerdp_bitmap_compress_24(const void* WINPR_RESTRICT srcData, UINT32 width,
-                                                 WINPR_ATTR_UNUSED UINT32 height,
-                                                 wStream* WINPR_RESTRICT s, UINT32 byte_limit,
-                                                 UINT32 start_line, wStream* WINPR_RESTRICT temp_s,
-                                                 UINT32 e)
-{
-	uint8_t fom_mask[8192] = WINPR_C_ARRAY_INIT; /* good for up to 64K bitmap */
-	SSIZE_T lines_sent = 0;
-	UINT16 count = 0;
-	UINT32 last_pixel = 0;
-	UINT32 last_ypixel = 0;
-	struct count counts = WINPR_C_ARRAY_INIT;
-	UINT32 bicolor1 = 0;
-	UINT32 bicolor2 = 0;
-	UINT32 end = width + e;
-	UINT32 out_count = end * 3;
-	const UINT32 mix = 0xFFFFFF;
-	const char* start = (const char*)srcData;
-	const char* line = start + 4ULL * width * start_line;
-	const char* last_line = nullptr;
-
-	while ((line >= start) && (out_count < 32768))
+	if (!test_bicolor(enc, pixel))
 	{
-		size_t i = Stream_GetPosition(s) + 3ULL * count;
+		if (count_wins(counts, counts->bicolor_count) && !flush_bicolor(enc))
+			return FALSE;
+		counts->bicolor_count = 0;
+		enc->bicolor1 = enc->last_pixel;
+		enc->bicolor2 = pixel;
+		counts->bicolor_spin = FALSE;
+	}
 
-		if ((i - (3ULL * counts.color_count) >= byte_limit) &&
-		    (i - (3ULL * counts.bicolor_count) >= byte_limit) &&
-		    (i - (3ULL * counts.fill_count) >= byte_limit) &&
-		    (i - (3ULL * counts.mix_count) >= byte_limit) &&
-		    (i - (3ULL * counts.fom_count) >= byte_limit))
-		{
-			break;
-		}
+	if (!fill && !mix)
+	{
+		if (count_wins(counts, counts->fom_count) && !flush_fom(enc))
+			return FALSE;
+		counts->fom_count = 0;
+		counts->fom_mask_len = 0;
+	}
 
-		out_count += end * 3;
+	if (fill)
+		counts->fill_count++;
 
-		for (UINT32 j = 0; j < end; j++)
-		{
-			/* read next pixel */
-			const UINT32 pixel = IN_PIXEL32(line, j, 0, width, last_pixel);
-			const UINT32 ypixel = IN_PIXEL32(last_line, j, 0, width, last_ypixel);
-
-			if (!TEST_FILL)
-			{
-				if (counts.fill_count > 3 && counts.fill_count >= counts.color_count &&
-				    counts.fill_count >= counts.bicolor_count &&
-				    counts.fill_count >= counts.mix_count && counts.fill_count >= counts.fom_count)
-				{
-					if (counts.fill_count > count)
-						return -1;
-
-					count -= counts.fill_count;
-					count = out_copy_count_3(count, s, temp_s);
-					counts.fill_count = out_fill_count_3(counts.fill_count, s);
-					reset_counts(&counts);
-				}
-
-				counts.fill_count = 0;
-			}
-
-			if (!TEST_MIX)
-			{
-				if (counts.mix_count > 3 && counts.mix_count >= counts.fill_count &&
-				    counts.mix_count >= counts.bicolor_count &&
-				    counts.mix_count >= counts.color_count && counts.mix_count >= counts.fom_count)
-				{
-					if (counts.mix_count > count)
-						return -1;
-
-					count -= counts.mix_count;
-					count = out_copy_count_3(count, s, temp_s);
-					counts.mix_count = out_counts_mix_count_3(counts.mix_count, s);
-					reset_counts(&counts);
-				}
-
-				counts.mix_count = 0;
-			}
-
-			if (!(TEST_COLOR))
-			{
-				if (counts.color_count > 3 && counts.color_count >= counts.fill_count &&
-				    counts.color_count >= counts.bicolor_count &&
-				    counts.color_count >= counts.mix_count &&
-				    counts.color_count >= counts.fom_count)
-				{
-					if (counts.color_count > count)
-						return -1;
-
-					count -= counts.color_count;
-					count = out_copy_count_3(count, s, temp_s);
-					counts.color_count = out_color_count_3(counts.color_count, s, last_pixel);
-					reset_counts(&counts);
-				}
-
-				counts.color_count = 0;
-			}
-
-			if (!test_bicolor(&counts))
-			{
-				if (counts.bicolor_count > 3 && counts.bicolor_count >= counts.fill_count &&
-				    counts.bicolor_count >= counts.color_count &&
-				    counts.bicolor_count >= counts.mix_count &&
-				    counts.bicolor_count >= counts.fom_count)
-				{
-					if ((counts.bicolor_count % 2) != 0)
-						counts.bicolor_count--;
-
-					if (counts.bicolor_count > count)
-						return -1;
-
-					count -= counts.bicolor_count;
-					count = out_copy_count_3(count, s, temp_s);
-					counts.bicolor_count =
-					    out_bicolor_count_3(counts.bicolor_count, s, bicolor2, bicolor1);
-					reset_counts(&counts);
-				}
-
-				counts.bicolor_count = 0;
-				bicolor1 = last_pixel;
-				bicolor2 = pixel;
-				counts.bicolor_spin = FALSE;
-			}
-
-			if (!(TEST_FOM))
-			{
-				if (counts.fom_count > 3 && counts.fom_count >= counts.fill_count &&
-				    counts.fom_count >= counts.color_count &&
-				    counts.fom_count >= counts.mix_count &&
-				    counts.fom_count >= counts.bicolor_count)
-				{
-					if (counts.fom_count > count)
-						return -1;
-
-					count -= counts.fom_count;
-					count = out_copy_count_3(count, s, temp_s);
-					counts.fom_count =
-					    out_from_count_3(counts.fom_count, s, fom_mask, counts.fom_mask_len);
-					reset_counts(&counts);
-				}
-
-				counts.fom_count = 0;
-				counts.fom_mask_len = 0;
-			}
-
-			if (TEST_FILL)
-			{
-				counts.fill_count++;
-			}
-
-			if (TEST_MIX)
-			{
-				counts.mix_count++;
-			}
-
-			if (TEST_COLOR)
-			{
-				counts.color_count++;
-			}
-
-			if (test_bicolor(&counts))
-			{
-				counts.bicolor_spin = !counts.bicolor_spin;
-				counts.bicolor_count++;
-			}
-
-			if (TEST_FOM)
-			{
-				if ((counts.fom_count % 8) == 0)
-				{
-					fom_mask[counts.fom_mask_len] = 0;
-					counts.fom_mask_len++;
-				}
-
-				if (pixel == (ypixel ^ mix))
-				{
-					const uint8_t tmp = (1u << (counts.fom_count % 8)) & 0xFF;
-					const uint8_t val = fom_mask[counts.fom_mask_len - 1] | tmp;
-					fom_mask[counts.fom_mask_len - 1] = val;
-				}
-
-				counts.fom_count++;
-			}
-
-			Stream_Write_UINT8(temp_s, pixel & 0xff);
-			Stream_Write_UINT8(temp_s, (pixel >> 8) & 0xff);
-			Stream_Write_UINT8(temp_s, (pixel >> 16) & 0xff);
-			count++;
-			last_pixel = pixel;
-			last_ypixel = ypixel;
-		}
+	if (mix)
+		counts->mix_count++;
 
-		/* can't take fix, mix, or fom past first line */
-		if (last_line == nullptr)
-		{
-			if (counts.fill_count > 3 && counts.fill_count >= counts.color_count &&
-			    counts.fill_count >= counts.bicolor_count &&
-			    counts.fill_count >= counts.mix_count && counts.fill_count >= counts.fom_count)
-			{
-				if (counts.fill_count > count)
-					return -1;
-
-				count -= counts.fill_count;
-				count = out_copy_count_3(count, s, temp_s);
-				counts.fill_count = out_fill_count_3(counts.fill_count, s);
-				reset_counts(&counts);
-			}
-
-			counts.fill_count = 0;
-
-			if (counts.mix_count > 3 && counts.mix_count >= counts.fill_count &&
-			    counts.mix_count >= counts.bicolor_count &&
-			    counts.mix_count >= counts.color_count && counts.mix_count >= counts.fom_count)
-			{
-				if (counts.mix_count > count)
-					return -1;
-
-				count -= counts.mix_count;
-				count = out_copy_count_3(count, s, temp_s);
-				counts.mix_count = out_counts_mix_count_3(counts.mix_count, s);
-				reset_counts(&counts);
-			}
-
-			counts.mix_count = 0;
-
-			if (counts.fom_count > 3 && counts.fom_count >= counts.fill_count &&
-			    counts.fom_count >= counts.color_count && counts.fom_count >= counts.mix_count &&
-			    counts.fom_count >= counts.bicolor_count)
-			{
-				if (counts.fom_count > count)
-					return -1;
-
-				count -= counts.fom_count;
-				count = out_copy_count_3(count, s, temp_s);
-				counts.fom_count =
-				    out_from_count_3(counts.fom_count, s, fom_mask, counts.fom_mask_len);
-				reset_counts(&counts);
-			}
-
-			counts.fom_count = 0;
-			counts.fom_mask_len = 0;
-		}
+	if (color)
+		counts->color_count++;
 
-		last_line = line;
-		line = line - 4ULL * width;
-		start_line--;
-		lines_sent++;
+	if (test_bicolor(enc, pixel))
+	{
+		counts->bicolor_spin = !counts->bicolor_spin;
+		counts->bicolor_count++;
 	}
 
-	Stream_ResetPosition(temp_s);
+	if ((fill || mix) && !fom_mask_append(enc, mix, 1))
+		return FALSE;
 
-	if (counts.fill_count > 3 && counts.fill_count >= counts.color_count &&
-	    counts.fill_count >= counts.bicolor_count && counts.fill_count >= counts.mix_count &&
-	    counts.fill_count >= counts.fom_count)
-	{
-		if (counts.fill_count > count)
-			return -1;
+	temp_write_pixel(enc, pixel);
+	return TRUE;
+}
 
-		count -= counts.fill_count;
-		(void)out_copy_count_3(count, s, temp_s);
-		counts.fill_count = out_fill_count_3(counts.fill_count, s);
-	}
-	else if (counts.mix_count > 3 && counts.mix_count >= counts.color_count &&
-	         counts.mix_count >= counts.bicolor_count && counts.mix_count >= counts.fill_count &&
-	         counts.mix_count >= counts.fom_count)
-	{
-		if (counts.mix_count > count)
-			return -1;
+/* Feed a run of pixels sharing the class of the previous pixel to the encoder.
+ * The state after that pixel only changes by the run length, so nothing is flushed. */
+static BOOL encode_run(BITMAP_ENCODER* WINPR_RESTRICT enc, const UINT32* WINPR_RESTRICT line,
+                       size_t x, size_t run, BYTE pixelClass)
+{
+	struct count* counts = &enc->counts;
+	const UINT16 length = (UINT16)run;
 
-		count -= counts.mix_count;
-		(void)out_copy_count_3(count, s, temp_s);
-		counts.mix_count = out_counts_mix_count_3(counts.mix_count, s);
-	}
-	else if (counts.color_count > 3 && counts.color_count >= counts.mix_count &&
-	         counts.color_count >= counts.bicolor_count &&
-	         counts.color_count >= counts.fill_count && counts.color_count >= counts.fom_count)
-	{
-		if (counts.color_count > count)
-			return -1;
+	WINPR_ASSERT(x >= 1);
+	WINPR_ASSERT(run <= UINT16_MAX);
 
-		count -= counts.color_count;
-		(void)out_copy_count_3(count, s, temp_s);
-		counts.color_count = out_color_count_3(counts.color_count, s, last_pixel);
-	}
-	else if (counts.bicolor_count > 3 && counts.bicolor_count >= counts.mix_count &&
-	         counts.bicolor_count >= counts.color_count &&
-	         counts.bicolor_count >= counts.fill_count && counts.bicolor_count >= counts.fom_count)
-	{
-		if ((counts.bicolor_count % 2) != 0)
-			counts.bicolor_count--;
+	if (pixelClass & BITMAP_CLASS_FILL)
+		counts->fill_count = (UINT16)(counts->fill_count + length);
 
-		if (counts.bicolor_count > count)
-			return -1;
+	if (pixelClass & BITMAP_CLASS_MIX)
+		counts->mix_count = (UINT16)(counts->mix_count + length);
 
-		count -= counts.bicolor_count;
-		count = out_copy_count_3(count, s, temp_s);
-		counts.bicolor_count = out_bicolor_count_3(counts.bicolor_count, s, bicolor2, bicolor1);
+	if (pixelClass & BITMAP_CLASS_COLOR)
+		counts->color_count = (UINT16)(counts->color_count + length);
 
-		if (counts.bicolor_count > count)
-			return -1;
+	if ((pixelClass & (BITMAP_CLASS_FILL | BITMAP_CLASS_MIX)) &&
+	    !fom_mask_append(enc, (pixelClass & BITMAP_CLASS_MIX) != 0, run))
+		return FALSE;
 
-		count -= counts.bicolor_count;
-		(void)out_copy_count_3(count, s, temp_s);
-		counts.bicolor_count = out_bicolor_count_3(counts.bicolor_count, s, bicolor1, bicolor2);
-	}
-	else if (counts.fom_count > 3 && counts.fom_count >= counts.mix_count &&
-	         counts.fom_count >= counts.color_count && counts.fom_count >= counts.fill_count &&
-	         counts.fom_count >= counts.bicolor_count)
-	{
-		if (counts.fom_count > count)
-			return -1;
+	/* No bicolor run, the candidate pair restarts on every pixel */
+	enc->bicolor1 = line[x + run - 2];
+	enc->bicolor2 = line[x + run - 1];
+	counts->bicolor_spin = FALSE;
+
+	for (size_t i = 0; i < run; i++)
+		out_pixel(enc->temp_s, line[x + i], enc->bpp);
+
+	enc->count = (UINT16)(enc->count + length);
+	enc->last_pixel = line[x + run - 1];
+	return TRUE;
+}
 
-		count -= counts.fom_count;
-		(void)out_copy_count_3(count, s, temp_s);
-		counts.fom_count = out_from_count_3(counts.fom_count, s, fom_mask, counts.fom_mask_len);
+static void load_line(const BYTE* WINPR_RESTRICT src, size_t srcBpp, UINT32 width, UINT32 end,
+                      UINT32* WINPR_RESTRICT line)
+{
+	if (srcBpp == 4)
+	{
+		for (size_t x = 0; x < width; x++)
+			line[x] = winpr_Data_Get_UINT32(&src[4 * x]);
 	}
 	else
 	{
-		(void)out_copy_count_3(count, s, temp_s);
+		for (size_t x = 0; x < width; x++)
+			line[x] = winpr_Data_Get_UINT16(&src[2 * x]);
 	}
 
-	return lines_sent;
+	/* pixels past the end repeat the last one */
+	for (size_t x = width; x < end; x++)
+		line[x] = line[width - 1];
 }
 
-static inline SSIZE_T freerdp_bitmap_compress_16(const void* WINPR_RESTRICT srcData, UINT32 width,
-                                                 WINPR_ATTR_UNUSED UINT32 height,
-                                                 wStream* WINPR_RESTRICT s, UINT32 bpp,
-                                                 UINT32 byte_limit, UINT32 start_line,
-                                                 wStream* WINPR_RESTRICT temp_s, UINT32 e)
+/* Encode the pixels of a line. A pixel whose class says it continues the orders of its
+ * predecessor starts a run of pixels with the same class which is fed in one step. */
+static BOOL encode_line(BITMAP_ENCODER* WINPR_RESTRICT enc, const UINT32* WINPR_RESTRICT line,
+                        const UINT32* WINPR_RESTRICT prev, BYTE* WINPR_RESTRICT classes,
+                        size_t end)
 {
-	uint8_t fom_mask[8192] = WINPR_C_ARRAY_INIT; /* good for up to 64K bitmap */
-	SSIZE_T lines_sent = 0;
-	UINT16 count = 0;
-	UINT16 last_pixel = 0;
-	UINT16 last_ypixel = 0;
-	struct count counts = WINPR_C_ARRAY_INIT;
-	UINT16 bicolor1 = 0;
-	UINT16 bicolor2 = 0;
-	UINT32 end = width + e;
-	UINT32 out_count = end * 2;
-	const UINT32 mix = (bpp == 15) ? 0xBA1F : 0xFFFF;
-	const char* start = (const char*)srcData;
-	const char* line = start + 2ULL * width * start_line;
-	const char* last_line = nullptr;
-
-	while ((line >= start) && (out_count < 32768))
-	{
-		size_t i = Stream_GetPosition(s) + 2ULL * count;
+	const BITMAP_ENCODE_FUNCTIONS* fn = enc->fn;
 
-		if ((i - (2ULL * counts.color_count) >= byte_limit) &&
-		    (i - (2ULL * counts.bicolor_count) >= byte_limit) &&
-		    (i - (2ULL * counts.fill_count) >= byte_limit) &&
-		    (i - (2ULL * counts.mix_count) >= byte_limit) &&
-		    (i - (2ULL * counts.fom_count) >= byte_limit))
-		{
-			break;
-		}
+	if (end > 2)
+		fn->classify_line(line, prev, enc->mix, classes, end);
 
-		out_count += end * 2;
+	for (size_t x = 0; x < end; x++)
+	{
+		if (!encode_pixel(enc, line[x], prev[x]))
+			return FALSE;
 
-		for (UINT32 j = 0; j < end; j++)
-		{
-			/* read next pixel */
-			const UINT16 pixel = IN_PIXEL16(line, j, 0, width, last_pixel);
-			const UINT16 ypixel = IN_PIXEL16(last_line, j, 0, width, last_ypixel);
-
-			if (!TEST_FILL)
-			{
-				if (counts.fill_count > 3 && counts.fill_count >= counts.color_count &&
-				    counts.fill_count >= counts.bicolor_count &&
-				    counts.fill_count >= counts.mix_count && counts.fill_count >= counts.fom_count)
-				{
-					if (counts.fill_count > count)
-						return -1;
-
-					count -= counts.fill_count;
-					count = out_copy_count_2(count, s, temp_s);
-					counts.fill_count = out_fill_count_2(counts.fill_count, s);
-					reset_counts(&counts);
-				}
-
-				counts.fill_count = 0;
-			}
-
-			if (!TEST_MIX)
-			{
-				if (counts.mix_count > 3 && counts.mix_count >= counts.fill_count &&
-				    counts.mix_count >= counts.bicolor_count &&
-				    counts.mix_count >= counts.color_count && counts.mix_count >= counts.fom_count)
-				{
-					if (counts.mix_count > count)
-						return -1;
-
-					count -= counts.mix_count;
-					count = out_copy_count_2(count, s, temp_s);
-					counts.mix_count = out_counts_mix_count_2(counts.mix_count, s);
-					reset_counts(&counts);
-				}
-
-				counts.mix_count = 0;
-			}
-
-			if (!(TEST_COLOR))
-			{
-				if (counts.color_count > 3 && counts.color_count >= counts.fill_count &&
-				    counts.color_count >= counts.bicolor_count &&
-				    counts.color_count >= counts.mix_count &&
-				    counts.color_count >= counts.fom_count)
-				{
-					if (counts.color_count > count)
-						return -1;
-
-					count -= counts.color_count;
-					count = out_copy_count_2(count, s, temp_s);
-					counts.color_count = out_color_count_2(counts.color_count, s, last_pixel);
-					reset_counts(&counts);
-				}
-
-				counts.color_count = 0;
-			}
-
-			if (!test_bicolor(&counts))
-			{
-				if ((counts.bicolor_count > 3) && (counts.bicolor_count >= counts.fill_count) &&
-				    (counts.bicolor_count >= counts.color_count) &&
-				    (counts.bicolor_count >= counts.mix_count) &&
-				    (counts.bicolor_count >= counts.fom_count))
-				{
-					if ((counts.bicolor_count % 2) != 0)
-						counts.bicolor_count--;
-
-					if (counts.bicolor_count > count)
-						return -1;
-
-					count -= counts.bicolor_count;
-					count = out_copy_count_2(count, s, temp_s);
-					counts.bicolor_count =
-					    out_bicolor_count_2(counts.bicolor_count, s, bicolor2, bicolor1);
-					reset_counts(&counts);
-				}
-
-				counts.bicolor_count = 0;
-				bicolor1 = last_pixel;
-				bicolor2 = pixel;
-				counts.bicolor_spin = FALSE;
-			}
-
-			if (!(TEST_FOM))
-			{
-				if (counts.fom_count > 3 && counts.fom_count >= counts.fill_count &&
-				    counts.fom_count >= counts.color_count &&
-				    counts.fom_count >= counts.mix_count &&
-				    counts.fom_count >= counts.bicolor_count)
-				{
-					if (counts.fom_count > count)
-						return -1;
-
-					count -= counts.fom_count;
-					count = out_copy_count_2(count, s, temp_s);
-					counts.fom_count =
-					    out_from_count_2(counts.fom_count, s, fom_mask, counts.fom_mask_len);
-					reset_counts(&counts);
-				}
-
-				counts.fom_count = 0;
-				counts.fom_mask_len = 0;
-			}
-
-			if (TEST_FILL)
-			{
-				counts.fill_count++;
-			}
-
-			if (TEST_MIX)
-			{
-				counts.mix_count++;
-			}
-
-			if (TEST_COLOR)
-			{
-				counts.color_count++;
-			}
-
-			if (test_bicolor(&counts))
-			{
-				counts.bicolor_spin = !counts.bicolor_spin;
-				counts.bicolor_count++;
-			}
-
-			if (TEST_FOM)
-			{
-				if ((counts.fom_count % 8) == 0)
-				{
-					fom_mask[counts.fom_mask_len] = 0;
-					counts.fom_mask_len++;
-				}
-
-				if (pixel == (ypixel ^ mix))
-				{
-					const uint8_t tmp = (1u << (counts.fom_count % 8)) & 0xFF;
-					const uint8_t val = fom_mask[counts.fom_mask_len - 1] | tmp;
-					fom_mask[counts.fom_mask_len - 1] = val;
-				}
-
-				counts.fom_count++;
-			}
-
-			Stream_Write_UINT16(temp_s, pixel);
-			count++;
-			last_pixel = pixel;
-			last_ypixel = ypixel;
-		}
+		if (x < 2)
+			continue;
 
-		/* can't take fix, mix, or fom past first line */
-		if (last_line == nullptr)
-		{
-			if (counts.fill_count > 3 && counts.fill_count >= counts.color_count &&
-			    counts.fill_count >= counts.bicolor_count &&
-			    counts.fill_count >= counts.mix_count && counts.fill_count >= counts.fom_count)
-			{
-				if (counts.fill_count > count)
-					return -1;
-
-				count -= counts.fill_count;
-				count = out_copy_count_2(count, s, temp_s);
-				counts.fill_count = out_fill_count_2(counts.fill_count, s);
-				reset_counts(&counts);
-			}
-
-			counts.fill_count = 0;
-
-			if (counts.mix_count > 3 && counts.mix_count >= counts.fill_count &&
-			    counts.mix_count >= counts.bicolor_count &&
-			    counts.mix_count >= counts.color_count && counts.mix_count >= counts.fom_count)
-			{
-				if (counts.mix_count > count)
-					return -1;
-
-				count -= counts.mix_count;
-				count = out_copy_count_2(count, s, temp_s);
-				counts.mix_count = out_counts_mix_count_2(counts.mix_count, s);
-				reset_counts(&counts);
-			}
-
-			counts.mix_count = 0;
-
-			if (counts.fom_count > 3 && counts.fom_count >= counts.fill_count &&
-			    counts.fom_count >= counts.color_count && counts.fom_count >= counts.mix_count &&
-			    counts.fom_count >= counts.bicolor_count)
-			{
-				if (counts.fom_count > count)
-					return -1;
-
-				count -= counts.fom_count;
-				count = out_copy_count_2(count, s, temp_s);
-				counts.fom_count =
-				    out_from_count_2(counts.fom_count, s, fom_mask, counts.fom_mask_len);
-				reset_counts(&counts);
-			}
-
-			counts.fom_count = 0;
-			counts.fom_mask_len = 0;
-		}
+		/* A bicolor run changes its state with every pixel */
+		const BYTE pixelClass = classes[x];
+		if ((pixelClass & (BITMAP_CLASS_COLOR | BITMAP_CLASS_BICOLOR)) == BITMAP_CLASS_BICOLOR)
+			continue;
 
-		last_line = line;
-		line = line - 2ULL * width;
-		start_line--;
-		lines_sent++;
+		const size_t run = fn->scan_class(&classes[x + 1], end - x - 1, pixelClass);
+		if (run == 0)
+			continue;
+
+		if (!encode_run(enc, line, x + 1, run, pixelClass))
+			return FALSE;
+		x += run;
 	}
 
-	Stream_ResetPosition(temp_s);
+	return TRUE;
+}
 
-	if (counts.fill_count > 3 && counts.fill_count >= counts.color_count &&
-	    counts.fill_count >= counts.bicolor_count && counts.fill_count >= counts.mix_count &&
-	    counts.fill_count >= counts.fom_count)
-	{
-		if (counts.fill_count > count)
-			return -1;
+/* Flush the fill, mix and fill or mix orders, these can not take the first line */
+static BOOL encode_first_line_end(BITMAP_ENCODER* WINPR_RESTRICT enc)
+{
+	struct count* counts = &enc->counts;
 
-		count -= counts.fill_count;
-		(void)out_copy_count_2(count, s, temp_s);
-		counts.fill_count = out_fill_count_2(counts.fill_count, s);
-	}
-	else if (counts.mix_count > 3 && counts.mix_count >= counts.color_count &&
-	         counts.mix_count >= counts.bicolor_count && counts.mix_count >= counts.fill_count &&
-	         counts.mix_count >= counts.fom_count)
-	{
-		if (counts.mix_count > count)
-			return -1;
+	if (count_wins(counts, counts->fill_count) && !flush_fill(enc))
+		return FALSE;
+	counts->fill_count = 0;
 
-		count -= counts.mix_count;
-		(void)out_copy_count_2(count, s, temp_s);
-		counts.mix_count = out_counts_mix_count_2(counts.mix_count, s);
-	}
-	else if (counts.color_count > 3 && counts.color_count >= counts.mix_count &&
-	         counts.color_count >= counts.bicolor_count &&
-	         counts.color_count >= counts.fill_count && counts.color_count >= counts.fom_count)
-	{
-		if (counts.color_count > count)
-			return -1;
+	if (count_wins(counts, counts->mix_count) && !flush_mix(enc))
+		return FALSE;
+	counts->mix_count = 0;
 
-		count -= counts.color_count;
-		(void)out_copy_count_2(count, s, temp_s);
-		counts.color_count = out_color_count_2(counts.color_count, s, last_pixel);
-	}
-	else if (counts.bicolor_count > 3 && counts.bicolor_count >= counts.mix_count &&
-	         counts.bicolor_count >= counts.color_count &&
-	         counts.bicolor_count >= counts.fill_count && counts.bicolor_count >= counts.fom_count)
-	{
-		if ((counts.bicolor_count % 2) != 0)
-			counts.bicolor_count--;
+	if (count_wins(counts, counts->fom_count) && !flush_fom(enc))
+		return FALSE;
+	counts->fom_count = 0;
+	counts->fom_mask_len = 0;
+	return TRUE;
+}
 
-		if (counts.bicolor_count > count)
-			return -1;
+static BOOL encode_end(BITMAP_ENCODER* WINPR_RESTRICT enc)
+{
+	const struct count* counts = &enc->counts;
 
-		count -= counts.bicolor_count;
-		count = out_copy_count_2(count, s, temp_s);
-		counts.bicolor_count = out_bicolor_count_2(counts.bicolor_count, s, bicolor2, bicolor1);
+	if (count_wins(counts, counts->fill_count))
+		return flush_fill(enc);
 
-		if (counts.bicolor_count > count)
-			return -1;
+	if (count_wins(counts, counts->mix_count))
+		return flush_mix(enc);
 
-		count -= counts.bicolor_count;
-		(void)out_copy_count_2(count, s, temp_s);
-		counts.bicolor_count = out_bicolor_count_2(counts.bicolor_count, s, bicolor1, bicolor2);
-	}
-	else if (counts.fom_count > 3 && counts.fom_count >= counts.mix_count &&
-	         counts.fom_count >= counts.color_count && counts.fom_count >= counts.fill_count &&
-	         counts.fom_count >= counts.bicolor_count)
-	{
-		if (counts.fom_count > count)
-			return -1;
+	if (count_wins(counts, counts->color_count))
+		return flush_color(enc);
 
-		count -= counts.fom_count;
-		(void)out_copy_count_2(count, s, temp_s);
-		counts.fom_count = out_from_count_2(counts.fom_count, s, fom_mask, counts.fom_mask_len);
-	}
-	else
+	if (count_wins(counts, counts->bicolor_count))
+		return flush_bicolor(enc);
+
+	if (count_wins(counts, counts->fom_count))
+		return flush_fom(enc);
+
+	return out_copy_count(enc, enc->count);
+}
+
+static SSIZE_T freerdp_bitmap_compress_lines(BITMAP_ENCODER* WINPR_RESTRICT enc,
+                                             const BYTE* WINPR_RESTRICT srcData, UINT32 width,
+                                             UINT32 byte_limit, UINT32 start_line, UINT32 e,
+                                             size_t srcBpp)
+{
+	SSIZE_T lines_sent = 0;
+	const UINT32 end = width + e;
+	const size_t lineSize = enc->bpp * end;
+	size_t out_count = lineSize;
+	const struct count* counts = &enc->counts;
+
+	UINT32* lines = calloc(2ULL * end, sizeof(UINT32));
+	BYTE* classes = calloc(end, sizeof(BYTE));
+	if (!lines || !classes)
+		goto fail;
+
+	/* The first line is compared against a line of 0 pixels */
+	UINT32* prev = &lines[0];
+	UINT32* line = &lines[end];
+
+	for (INT64 y = start_line; (y >= 0) && (out_count < 32768); y--)
 	{
-		(void)out_copy_count_2(count, s, temp_s);
+		const size_t i = Stream_GetPosition(enc->s) + enc->bpp * enc->count;
+
+		if ((i - (enc->bpp * counts->color_count) >= byte_limit) &&
+		    (i - (enc->bpp * counts->bicolor_count) >= byte_limit) &&
+		    (i - (enc->bpp * counts->fill_count) >= byte_limit) &&
+		    (i - (enc->bpp * counts->mix_count) >= byte_limit) &&
+		    (i - (enc->bpp * counts->fom_count) >= byte_limit))
+		{
+			break;
+		}
+
+		out_count += lineSize;
+
+		if (!Stream_EnsureRemainingCapacity(enc->temp_s, lineSize))
+			goto fail;
+
+		load_line(&srcData[srcBpp * width * (size_t)y], srcBpp, width, end, line);
+
+		if (!encode_line(enc, line, prev, classes, end))
+			goto fail;
+
+		if ((lines_sent == 0) && !encode_first_line_end(enc))
+			goto fail;
+
+		UINT32* tmp = prev;
+		prev = line;
+		line = tmp;
+		lines_sent++;
 	}
 
+	if (!encode_end(enc))
+		goto fail;
+
+	free(lines);
+	free(classes);
 	return lines_sent;
+
+fail:
+	free(lines);
+	free(classes);
+	return -1;
 }
 
-SSIZE_T freerdp_bitmap_compress(const void* WINPR_RESTRICT srcData, UINT32 width, UINT32 height,
-                                wStream* WINPR_RESTRICT s, UINT32 bpp, UINT32 byte_limit,
-                                UINT32 start_line, wStream* WINPR_RESTRICT temp_s, UINT32 e)
+SSIZE_T freerdp_bitmap_compress(const void* WINPR_RESTRICT srcData, UINT32 width,
+                                WINPR_ATTR_UNUSED UINT32 height, wStream* WINPR_RESTRICT s,
+                                UINT32 bpp, UINT32 byte_limit, UINT32 start_line,
+                                wStream* WINPR_RESTRICT temp_s, UINT32 e)
 {
+	size_t srcBpp = 0;
+	SSIZE_T rc = -1;
+
+	if (!srcData || !s || !temp_s || (width == 0))
+		return -1;
+
 	Stream_ResetPosition(temp_s);
 
+	if (!InitOnceExecuteOnce(&bitmap_encode_InitOnce, bitmap_encode_init_cb, nullptr, nullptr))
+		return -1;
+
+	BITMAP_ENCODER* enc = calloc(1, sizeof(BITMAP_ENCODER));
+	if (!enc)
+		return -1;
+
+	enc->s = s;
+	enc->temp_s = temp_s;
+	enc->fn = &bitmap_encode_fn;
+
 	switch (bpp)
 	{
 		case 15:
 		case 16:
-			return freerdp_bitmap_compress_16(srcData, width, height, s, bpp, byte_limit,
-			                                  start_line, temp_s, e);
+			srcBpp = 2;
+			enc->bpp = 2;
+			enc->mix = (bpp == 15) ? 0xBA1F : 0xFFFF;
+			break;
 
 		case 24:
-			return freerdp_bitmap_compress_24(srcData, width, height, s, byte_limit, start_line,
-			                                  temp_s, e);
+			srcBpp = 4;
+			enc->bpp = 3;
+			enc->mix = 0xFFFFFF;
+			break;
 
 		default:
-			return -1;
+			goto fail;
 	}
+
+	rc = freerdp_bitmap_compress_lines(enc, srcData, width, byte_limit, start_line, e, srcBpp);
+fail:
+	free(enc);
+	return rc;
 }
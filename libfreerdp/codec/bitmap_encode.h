@@ -0,0 +1,79 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Interleaved RLE Bitmap Encoder
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_BITMAP_ENCODE_H
+#define FREERDP_LIB_CODEC_BITMAP_ENCODE_H
+
+#include <winpr/wtypes.h>
+#include <freerdp/api.h>
+
+/* Pixel classes, the encoder state only depends on these */
+#define BITMAP_CLASS_FILL 0x01    /**< pixel equals the pixel of the previous line */
+#define BITMAP_CLASS_MIX 0x02     /**< pixel equals the pixel of the previous line ^ mix */
+#define BITMAP_CLASS_COLOR 0x04   /**< pixel equals its predecessor */
+#define BITMAP_CLASS_BICOLOR 0x08 /**< pixel equals the pixel two positions before */
+
+/** Classify the pixels x of a line with 2 <= x < width */
+typedef void (*bitmap_classify_line_fn)(const UINT32* WINPR_RESTRICT line,
+                                        const UINT32* WINPR_RESTRICT prev, UINT32 mix,
+                                        BYTE* WINPR_RESTRICT classes, size_t width);
+
+/** @return the number of bytes x < max with in[x] == value in a row from the start */
+typedef size_t (*bitmap_scan_class_fn)(const BYTE* WINPR_RESTRICT in, size_t max, BYTE value);
+
+typedef struct
+{
+	bitmap_classify_line_fn classify_line;
+	bitmap_scan_class_fn scan_class;
+} BITMAP_ENCODE_FUNCTIONS;
+
+static inline BYTE bitmap_classify_pixel(const UINT32* WINPR_RESTRICT line,
+                                         const UINT32* WINPR_RESTRICT prev, UINT32 mix, size_t x)
+{
+	const UINT32 pixel = line[x];
+	BYTE value = 0;
+
+	if (pixel == prev[x])
+		value |= BITMAP_CLASS_FILL;
+	if (pixel == (prev[x] ^ mix))
+		value |= BITMAP_CLASS_MIX;
+	if (pixel == line[x - 1])
+		value |= BITMAP_CLASS_COLOR;
+	if (pixel == line[x - 2])
+		value |= BITMAP_CLASS_BICOLOR;
+	return value;
+}
+
+static inline void bitmap_classify_line_generic(const UINT32* WINPR_RESTRICT line,
+                                                const UINT32* WINPR_RESTRICT prev, UINT32 mix,
+                                                BYTE* WINPR_RESTRICT classes, size_t start,
+                                                size_t width)
+{
+	for (size_t x = start; x < width; x++)
+		classes[x] = bitmap_classify_pixel(line, prev, mix, x);
+}
+
+static inline size_t bitmap_scan_class_generic(const BYTE* WINPR_RESTRICT in, size_t max,
+                                               BYTE value)
+{
+	size_t x = 0;
+	while ((x < max) && (in[x] == value))
+		x++;
+	return x;
+}
+
+#endif /* FREERDP_LIB_CODEC_BITMAP_ENCODE_H */
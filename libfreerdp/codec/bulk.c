@@ -33,6 +33,8 @@
 
 //#define WITH_BULK_DEBUG 1
 
+#define BULK_OUTPUT_BUFFER_SIZE 65536
+
 struct rdp_bulk
 {
 	ALIGN64 rdpContext* context;
@@ -44,7 +46,7 @@ struct rdp_bulk
 	ALIGN64 NCRUSH_CONTEXT* ncrushSend;
 	ALIGN64 XCRUSH_CONTEXT* xcrushRecv;
 	ALIGN64 XCRUSH_CONTEXT* xcrushSend;
-	ALIGN64 BYTE OutputBuffer[65536];
+	ALIGN64 BYTE* OutputBuffer;
 };
 
 #if defined(WITH_BULK_DEBUG)
@@ -152,6 +154,67 @@ static inline int bulk_compress_validate(rdpBulk* bulk, const BYTE* pSrcData, UI
 }
 #endif
 
+/* The compressor contexts hold history buffers and hash tables of several hundred KB each.
+ * Only the ones required by the negotiated compression type are created, on first use. */
+WINPR_ATTR_NODISCARD
+static MPPC_CONTEXT* bulk_get_mppc(rdpBulk* WINPR_RESTRICT bulk, BOOL Compressor)
+{
+	WINPR_ASSERT(bulk);
+
+	MPPC_CONTEXT** ppContext = Compressor ? &bulk->mppcSend : &bulk->mppcRecv;
+	if (!*ppContext)
+	{
+		*ppContext = mppc_context_new(1, Compressor);
+		if (!*ppContext)
+			WLog_ERR(TAG, "failed to allocate MPPC context");
+	}
+	return *ppContext;
+}
+
+WINPR_ATTR_NODISCARD
+static NCRUSH_CONTEXT* bulk_get_ncrush(rdpBulk* WINPR_RESTRICT bulk, BOOL Compressor)
+{
+	WINPR_ASSERT(bulk);
+
+	NCRUSH_CONTEXT** ppContext = Compressor ? &bulk->ncrushSend : &bulk->ncrushRecv;
+	if (!*ppContext)
+	{
+		*ppContext = ncrush_context_new(Compressor);
+		if (!*ppContext)
+			WLog_ERR(TAG, "failed to allocate NCRUSH context");
+		else if (Compressor)
+		{
+			const UINT32 effort =
+			    freerdp_settings_get_uint32(bulk->context->settings, FreeRDP_CompressionEffort);
+			if (!ncrush_context_set_effort(*ppContext, effort))
+				WLog_WARN(TAG, "keeping the default NCRUSH compression effort");
+		}
+	}
+	return *ppContext;
+}
+
+WINPR_ATTR_NODISCARD
+static XCRUSH_CONTEXT* bulk_get_xcrush(rdpBulk* WINPR_RESTRICT bulk, BOOL Compressor)
+{
+	WINPR_ASSERT(bulk);
+
+	XCRUSH_CONTEXT** ppContext = Compressor ? &bulk->xcrushSend : &bulk->xcrushRecv;
+	if (!*ppContext)
+	{
+		*ppContext = xcrush_context_new(Compressor);
+		if (!*ppContext)
+			WLog_ERR(TAG, "failed to allocate XCRUSH context");
+		else if (Compressor)
+		{
+			const UINT32 effort =
+			    freerdp_settings_get_uint32(bulk->context->settings, FreeRDP_CompressionEffort);
+			if (!xcrush_context_set_effort(*ppContext, effort))
+				WLog_WARN(TAG, "keeping the default XCRUSH compression effort");
+		}
+	}
+	return *ppContext;
+}
+
 int bulk_decompress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcData,
                     UINT32 SrcSize, const BYTE** WINPR_RESTRICT ppDstData,
                     UINT32* WINPR_RESTRICT pDstSize, UINT32 flags)
@@ -175,26 +238,33 @@ int bulk_decompress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSr
 		switch (type)
 		{
 			case PACKET_COMPR_TYPE_8K:
-				mppc_set_compression_level(bulk->mppcRecv, 0);
-				status =
-				    mppc_decompress(bulk->mppcRecv, pSrcData, SrcSize, ppDstData, pDstSize, flags);
-				break;
-
 			case PACKET_COMPR_TYPE_64K:
-				mppc_set_compression_level(bulk->mppcRecv, 1);
-				status =
-				    mppc_decompress(bulk->mppcRecv, pSrcData, SrcSize, ppDstData, pDstSize, flags);
-				break;
+			{
+				MPPC_CONTEXT* mppc = bulk_get_mppc(bulk, FALSE);
+				if (!mppc)
+					break;
+				mppc_set_compression_level(mppc, (type == PACKET_COMPR_TYPE_8K) ? 0 : 1);
+				status = mppc_decompress(mppc, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+			}
+			break;
 
 			case PACKET_COMPR_TYPE_RDP6:
-				status = ncrush_decompress(bulk->ncrushRecv, pSrcData, SrcSize, ppDstData, pDstSize,
-				                           flags);
-				break;
+			{
+				NCRUSH_CONTEXT* ncrush = bulk_get_ncrush(bulk, FALSE);
+				if (!ncrush)
+					break;
+				status = ncrush_decompress(ncrush, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+			}
+			break;
 
 			case PACKET_COMPR_TYPE_RDP61:
-				status = xcrush_decompress(bulk->xcrushRecv, pSrcData, SrcSize, ppDstData, pDstSize,
-				                           flags);
-				break;
+			{
+				XCRUSH_CONTEXT* xcrush = bulk_get_xcrush(bulk, FALSE);
+				if (!xcrush)
+					break;
+				status = xcrush_decompress(xcrush, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+			}
+			break;
 
 			case PACKET_COMPR_TYPE_RDP8:
 				WLog_ERR(TAG, "Unsupported bulk compression type %08" PRIx32,
@@ -264,7 +334,14 @@ int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcD
 		return 0;
 	}
 
-	*pDstSize = sizeof(bulk->OutputBuffer);
+	if (!bulk->OutputBuffer)
+	{
+		bulk->OutputBuffer = malloc(BULK_OUTPUT_BUFFER_SIZE);
+		if (!bulk->OutputBuffer)
+			return -1;
+	}
+
+	*pDstSize = BULK_OUTPUT_BUFFER_SIZE;
 	const UINT32 CompressionLevel = bulk_compression_level(bulk);
 	bulk_update_compression_max_size(bulk);
 
@@ -272,18 +349,33 @@ int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcD
 	{
 		case PACKET_COMPR_TYPE_8K:
 		case PACKET_COMPR_TYPE_64K:
-			mppc_set_compression_level(bulk->mppcSend, CompressionLevel);
-			status = mppc_compress(bulk->mppcSend, pSrcData, SrcSize, bulk->OutputBuffer, ppDstData,
+		{
+			MPPC_CONTEXT* mppc = bulk_get_mppc(bulk, TRUE);
+			if (!mppc)
+				break;
+			mppc_set_compression_level(mppc, CompressionLevel);
+			status = mppc_compress(mppc, pSrcData, SrcSize, bulk->OutputBuffer, ppDstData,
 			                       pDstSize, pFlags);
-			break;
+		}
+		break;
 		case PACKET_COMPR_TYPE_RDP6:
-			status = ncrush_compress(bulk->ncrushSend, pSrcData, SrcSize, bulk->OutputBuffer,
-			                         ppDstData, pDstSize, pFlags);
-			break;
+		{
+			NCRUSH_CONTEXT* ncrush = bulk_get_ncrush(bulk, TRUE);
+			if (!ncrush)
+				break;
+			status = ncrush_compress(ncrush, pSrcData, SrcSize, bulk->OutputBuffer, ppDstData,
+			                         pDstSize, pFlags);
+		}
+		break;
 		case PACKET_COMPR_TYPE_RDP61:
-			status = xcrush_compress(bulk->xcrushSend, pSrcData, SrcSize, bulk->OutputBuffer,
-			                         ppDstData, pDstSize, pFlags);
-			break;
+		{
+			XCRUSH_CONTEXT* xcrush = bulk_get_xcrush(bulk, TRUE);
+			if (!xcrush)
+				break;
+			status = xcrush_compress(xcrush, pSrcData, SrcSize, bulk->OutputBuffer, ppDstData,
+			                         pDstSize, pFlags);
+		}
+		break;
 		case PACKET_COMPR_TYPE_RDP8:
 			WLog_ERR(TAG, "Unsupported bulk compression type %08" PRIx32, CompressionLevel);
 			status = -1;
@@ -329,12 +421,33 @@ void bulk_reset(rdpBulk* WINPR_RESTRICT bulk)
 {
 	WINPR_ASSERT(bulk);
 
-	mppc_context_reset(bulk->mppcSend, FALSE);
-	mppc_context_reset(bulk->mppcRecv, FALSE);
-	ncrush_context_reset(bulk->ncrushRecv, FALSE);
-	ncrush_context_reset(bulk->ncrushSend, FALSE);
-	xcrush_context_reset(bulk->xcrushRecv, FALSE);
-	xcrush_context_reset(bulk->xcrushSend, FALSE);
+	/* contexts not created yet are in reset state anyway */
+	if (bulk->mppcSend)
+		mppc_context_reset(bulk->mppcSend, FALSE);
+	if (bulk->mppcRecv)
+		mppc_context_reset(bulk->mppcRecv, FALSE);
+	if (bulk->ncrushRecv)
+		ncrush_context_reset(bulk->ncrushRecv, FALSE);
+	if (bulk->ncrushSend)
+		ncrush_context_reset(bulk->ncrushSend, FALSE);
+	if (bulk->xcrushRecv)
+		xcrush_context_reset(bulk->xcrushRecv, FALSE);
+	if (bulk->xcrushSend)
+		xcrush_context_reset(bulk->xcrushSend, FALSE);
+}
+
+size_t bulk_memory_usage(const rdpBulk* WINPR_RESTRICT bulk)
+{
+	if (!bulk)
+		return 0;
+
+	const size_t output = bulk->OutputBuffer ? BULK_OUTPUT_BUFFER_SIZE : 0;
+	return sizeof(rdpBulk) + output + mppc_context_memory_usage(bulk->mppcSend) +
+	       mppc_context_memory_usage(bulk->mppcRecv) +
+	       ncrush_context_memory_usage(bulk->ncrushSend) +
+	       ncrush_context_memory_usage(bulk->ncrushRecv) +
+	       xcrush_context_memory_usage(bulk->xcrushSend) +
+	       xcrush_context_memory_usage(bulk->xcrushRecv);
 }
 
 rdpBulk* bulk_new(rdpContext* context)
@@ -348,24 +461,6 @@ rdpBulk* bulk_new(rdpContext* context)
 		goto fail;
 
 	bulk->context = context;
-	bulk->mppcSend = mppc_context_new(1, TRUE);
-	if (!bulk->mppcSend)
-		goto fail;
-	bulk->mppcRecv = mppc_context_new(1, FALSE);
-	if (!bulk->mppcRecv)
-		goto fail;
-	bulk->ncrushRecv = ncrush_context_new(FALSE);
-	if (!bulk->ncrushRecv)
-		goto fail;
-	bulk->ncrushSend = ncrush_context_new(TRUE);
-	if (!bulk->ncrushSend)
-		goto fail;
-	bulk->xcrushRecv = xcrush_context_new(FALSE);
-	if (!bulk->xcrushRecv)
-		goto fail;
-	bulk->xcrushSend = xcrush_context_new(TRUE);
-	if (!bulk->xcrushSend)
-		goto fail;
 	bulk->CompressionLevel =
 	    freerdp_settings_get_uint32(context->settings, FreeRDP_CompressionLevel);
 
@@ -389,5 +484,6 @@ void bulk_free(rdpBulk* bulk)
 	ncrush_context_free(bulk->ncrushSend);
 	xcrush_context_free(bulk->xcrushRecv);
 	xcrush_context_free(bulk->xcrushSend);
+	free(bulk->OutputBuffer);
 	free(bulk);
 }
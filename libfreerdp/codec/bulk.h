@@ -43,6 +43,10 @@ FREERDP_LOCAL int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_
 
 FREERDP_LOCAL void bulk_reset(rdpBulk* WINPR_RESTRICT bulk);
 
+/** @brief Heap memory held by the bulk compressor and its (lazily created) contexts in bytes */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL size_t bulk_memory_usage(const rdpBulk* WINPR_RESTRICT bulk);
+
 FREERDP_LOCAL void bulk_free(rdpBulk* bulk);
 
 WINPR_ATTR_MALLOC(bulk_free, 1)
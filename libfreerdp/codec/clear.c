@@ -29,6 +29,9 @@
 #include <freerdp/codec/clear.h>
 #include <freerdp/log.h>
 
+#include "clear.h"
+#include "nsc.h"
+
 #define TAG FREERDP_TAG("codec.clear")
 
 #define CLEARCODEC_FLAG_GLYPH_INDEX 0x01
@@ -1341,3 +1344,20 @@ void clear_context_free(CLEAR_CONTEXT* WINPR_RESTRICT clear)
 
 	winpr_aligned_free(clear);
 }
+
+size_t clear_context_memory_usage(const CLEAR_CONTEXT* clear)
+{
+	if (!clear)
+		return 0;
+
+	const size_t bpp = FreeRDPGetBytesPerPixel(clear->format);
+	size_t size = sizeof(CLEAR_CONTEXT) + clear->TempSize + nsc_context_memory_usage(clear->nsc);
+
+	for (size_t x = 0; x < ARRAYSIZE(clear->GlyphCache); x++)
+		size += 1ull * clear->GlyphCache[x].size * bpp;
+	for (size_t x = 0; x < ARRAYSIZE(clear->VBarStorage); x++)
+		size += 1ull * clear->VBarStorage[x].size * bpp;
+	for (size_t x = 0; x < ARRAYSIZE(clear->ShortVBarStorage); x++)
+		size += 1ull * clear->ShortVBarStorage[x].size * bpp;
+	return size;
+}
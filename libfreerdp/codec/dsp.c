@@ -31,6 +31,7 @@
 #include <freerdp/codec/dsp.h>
 
 #include "dsp.h"
+#include "dsp_resample.h"
 
 #if defined(WITH_FDK_AAC)
 #include "dsp_fdk_aac.h"
@@ -118,6 +119,8 @@ struct S_FREERDP_DSP_CONTEXT
 
 #if defined(WITH_SOXR)
 	soxr_t sox;
+#else
+	FREERDP_DSP_RESAMPLER* resampler;
 #endif
 };
 
@@ -145,6 +148,97 @@ static INT16 read_int16(const BYTE* WINPR_RESTRICT src)
 	return (INT16)(src[0] | (src[1] << 8));
 }
 
+static BOOL freerdp_dsp_channel_mix16(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
+                                      const INT16* WINPR_RESTRICT src, size_t frames,
+                                      UINT32 srcChannels, INT16* WINPR_RESTRICT dst)
+{
+	const UINT32 dstChannels = context->common.format.nChannels;
+
+	if ((srcChannels == 1) && (dstChannels == 2))
+	{
+		const FREERDP_DSP_RESAMPLE_PRIMITIVES* prims = freerdp_dsp_resample_primitives_get();
+		if (!prims)
+			return FALSE;
+		prims->mono_to_stereo(src, dst, frames);
+		return TRUE;
+	}
+
+	if ((srcChannels == 2) && (dstChannels == 1))
+	{
+		const FREERDP_DSP_RESAMPLE_PRIMITIVES* prims = freerdp_dsp_resample_primitives_get();
+		if (!prims)
+			return FALSE;
+		prims->stereo_to_mono(src, dst, frames);
+		return TRUE;
+	}
+
+	/* Generic layouts: Upmix by repeating source channels, downmix by averaging
+	 * all source channels mapped onto the same destination channel. */
+	for (size_t x = 0; x < frames; x++)
+	{
+		const INT16* in = &src[x * srcChannels];
+		INT16* out = &dst[x * dstChannels];
+
+		if (dstChannels > srcChannels)
+		{
+			for (UINT32 c = 0; c < dstChannels; c++)
+				out[c] = in[c % srcChannels];
+		}
+		else
+		{
+			for (UINT32 c = 0; c < dstChannels; c++)
+			{
+				INT32 sum = 0;
+				INT32 count = 0;
+				for (UINT32 y = c; y < srcChannels; y += dstChannels)
+				{
+					sum += in[y];
+					count++;
+				}
+				/* Round towards negative infinity like the stereo_to_mono primitives */
+				if (sum < 0)
+					sum -= count - 1;
+				out[c] = (INT16)(sum / count);
+			}
+		}
+	}
+	return TRUE;
+}
+
+/* 8 bit PCM is unsigned, the average of the biased samples is the biased average */
+static void freerdp_dsp_channel_mix8(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
+                                     const BYTE* WINPR_RESTRICT src, size_t frames,
+                                     UINT32 srcChannels, BYTE* WINPR_RESTRICT dst)
+{
+	const UINT32 dstChannels = context->common.format.nChannels;
+
+	for (size_t x = 0; x < frames; x++)
+	{
+		const BYTE* in = &src[x * srcChannels];
+		BYTE* out = &dst[x * dstChannels];
+
+		if (dstChannels > srcChannels)
+		{
+			for (UINT32 c = 0; c < dstChannels; c++)
+				out[c] = in[c % srcChannels];
+		}
+		else
+		{
+			for (UINT32 c = 0; c < dstChannels; c++)
+			{
+				UINT32 sum = 0;
+				UINT32 count = 0;
+				for (UINT32 y = c; y < srcChannels; y += dstChannels)
+				{
+					sum += in[y];
+					count++;
+				}
+				out[c] = (BYTE)(sum / count);
+			}
+		}
+	}
+}
+
 static BOOL freerdp_dsp_channel_mix(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
                                     const BYTE* WINPR_RESTRICT src, size_t size,
                                     const AUDIO_FORMAT* WINPR_RESTRICT srcFormat,
@@ -156,8 +250,8 @@ static BOOL freerdp_dsp_channel_mix(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 	if (srcFormat->wFormatTag != WAVE_FORMAT_PCM)
 		return FALSE;
 
-	const UINT32 bpp = srcFormat->wBitsPerSample > 8 ? 2 : 1;
-	const size_t samples = size / bpp / srcFormat->nChannels;
+	if ((srcFormat->nChannels == 0) || (context->common.format.nChannels == 0))
+		return FALSE;
 
 	if (context->common.format.nChannels == srcFormat->nChannels)
 	{
@@ -166,63 +260,31 @@ static BOOL freerdp_dsp_channel_mix(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 		return TRUE;
 	}
 
+	const UINT32 bpp = srcFormat->wBitsPerSample > 8 ? 2 : 1;
+	const size_t frames = size / bpp / srcFormat->nChannels;
+	const size_t dstSize = frames * bpp * context->common.format.nChannels;
+
 	Stream_ResetPosition(context->common.channelmix);
+	if (!Stream_EnsureCapacity(context->common.channelmix, dstSize))
+		return FALSE;
 
-	/* Destination has more channels than source */
-	if (context->common.format.nChannels > srcFormat->nChannels)
+	BYTE* dst = Stream_Buffer(context->common.channelmix);
+	if (bpp == 2)
 	{
-		switch (srcFormat->nChannels)
-		{
-			case 1:
-				if (!Stream_EnsureCapacity(context->common.channelmix, size * 2))
-					return FALSE;
-
-				for (size_t x = 0; x < samples; x++)
-				{
-					for (size_t y = 0; y < bpp; y++)
-						Stream_Write_UINT8(context->common.channelmix, src[x * bpp + y]);
-
-					for (size_t y = 0; y < bpp; y++)
-						Stream_Write_UINT8(context->common.channelmix, src[x * bpp + y]);
-				}
-
-				Stream_SealLength(context->common.channelmix);
-				*data = Stream_Buffer(context->common.channelmix);
-				*length = Stream_Length(context->common.channelmix);
-				return TRUE;
-
-			case 2:  /* We only support stereo, so we can not handle this case. */
-			default: /* Unsupported number of channels */
-				return FALSE;
-		}
+		if (!freerdp_dsp_channel_mix16(context, (const INT16*)src, frames, srcFormat->nChannels,
+		                               (INT16*)dst))
+			return FALSE;
 	}
-
-	/* Destination has less channels than source */
-	switch (srcFormat->nChannels)
+	else
 	{
-		case 2:
-			if (!Stream_EnsureCapacity(context->common.channelmix, size / 2))
-				return FALSE;
-
-			/* Simply drop second channel.
-			 * TODO: Calculate average */
-			for (size_t x = 0; x < samples; x++)
-			{
-				for (size_t y = 0; y < bpp; y++)
-					Stream_Write_UINT8(context->common.channelmix, src[2 * x * bpp + y]);
-			}
-
-			Stream_SealLength(context->common.channelmix);
-			*data = Stream_Buffer(context->common.channelmix);
-			*length = Stream_Length(context->common.channelmix);
-			return TRUE;
-
-		case 1:  /* Invalid, do we want to use a 0 channel sound? */
-		default: /* Unsupported number of channels */
-			return FALSE;
+		freerdp_dsp_channel_mix8(context, src, frames, srcFormat->nChannels, dst);
 	}
 
-	return FALSE;
+	if (!Stream_SetLength(context->common.channelmix, dstSize))
+		return FALSE;
+	*data = Stream_Buffer(context->common.channelmix);
+	*length = Stream_Length(context->common.channelmix);
+	return TRUE;
 }
 
 /**
@@ -294,8 +356,46 @@ static BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 	*length = Stream_Length(context->common.resample);
 	return (error == 0) != 0;
 #else
-	WLog_ERR(TAG, "Missing resample support, recompile -DWITH_SOXR=ON or -DWITH_DSP_FFMPEG=ON");
-	return FALSE;
+	if ((srcFormat->wBitsPerSample != 16) || (context->common.format.nChannels == 0))
+	{
+		WLog_ERR(TAG, "builtin resampler requires 16bit PCM, got %" PRIu16 "bit",
+		         srcFormat->wBitsPerSample);
+		return FALSE;
+	}
+
+	const UINT32 channels = context->common.format.nChannels;
+	const UINT32 srcRate = srcFormat->nSamplesPerSec;
+	const UINT32 dstRate = context->common.format.nSamplesPerSec;
+
+	/* The filter state is kept as long as the stream parameters do not change */
+	if (!freerdp_dsp_resampler_matches(context->resampler, srcRate, dstRate, channels))
+	{
+		freerdp_dsp_resampler_free(context->resampler);
+		context->resampler = freerdp_dsp_resampler_new(srcRate, dstRate, channels);
+		if (!context->resampler)
+			return FALSE;
+	}
+
+	const size_t frameSize = 2ull * channels;
+	const size_t frames = size / frameSize;
+	const size_t maxFrames = freerdp_dsp_resampler_max_output(context->resampler, frames);
+
+	Stream_ResetPosition(context->common.resample);
+	if (!Stream_EnsureCapacity(context->common.resample, maxFrames * frameSize))
+		return FALSE;
+
+	size_t produced = 0;
+	if (!freerdp_dsp_resampler_process(context->resampler, (const INT16*)src, frames,
+	                                   Stream_BufferAs(context->common.resample, INT16),
+	                                   &produced))
+		return FALSE;
+
+	if (!Stream_SetLength(context->common.resample, produced * frameSize))
+		return FALSE;
+
+	*data = Stream_Buffer(context->common.resample);
+	*length = Stream_Length(context->common.resample);
+	return TRUE;
 #endif
 }
 
@@ -1357,6 +1457,8 @@ void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context)
 #endif
 #if defined(WITH_SOXR)
 		soxr_delete(context->sox);
+#else
+	freerdp_dsp_resampler_free(context->resampler);
 #endif
 	    free(context);
 
@@ -1726,6 +1828,9 @@ BOOL freerdp_dsp_context_reset(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 		if (!context->sox || (error != nullptr))
 			return FALSE;
 	}
+#else
+	freerdp_dsp_resampler_free(context->resampler);
+	context->resampler = nullptr;
 #endif
 	return TRUE;
 #endif
@@ -0,0 +1,431 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - builtin resampler and channel mixer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/types.h>
+#include <freerdp/log.h>
+
+#include "dsp_resample.h"
+#include "sse/dsp_resample_sse2.h"
+#include "neon/dsp_resample_neon.h"
+
+#define TAG FREERDP_TAG("codec.dsp.resample")
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Fraction of the nyquist frequency passed by the lowpass filter */
+#define DSP_RESAMPLE_ROLLOFF 0.85
+/* Kaiser window shape, ~80dB stopband attenuation */
+#define DSP_RESAMPLE_KAISER_BETA 8.0
+
+struct S_FREERDP_DSP_RESAMPLER
+{
+	UINT32 srcRate;
+	UINT32 dstRate;
+	UINT32 channels;
+
+	/* ratio dstRate / srcRate reduced to interpolation / decimation */
+	UINT32 interpolation;
+	UINT32 decimation;
+	UINT32 phases;
+	size_t taps;
+	INT16* coeffs;
+
+	/* planar input history, one buffer per channel */
+	INT16* history[DSP_RESAMPLE_MAX_CHANNELS];
+	size_t historyCapacity;
+	size_t available;
+	size_t position;
+	UINT32 fraction;
+
+	/* per call filter positions, shared by all channels */
+	UINT32* offsets;
+	UINT32* phaseIndex;
+	size_t scratchCapacity;
+
+	const FREERDP_DSP_RESAMPLE_PRIMITIVES* prims;
+};
+
+static FREERDP_DSP_RESAMPLE_PRIMITIVES dsp_resample_prims = WINPR_C_ARRAY_INIT;
+static INIT_ONCE dsp_resample_prims_InitOnce = INIT_ONCE_STATIC_INIT;
+
+static INT16 dsp_resample_clamp(INT32 value)
+{
+	if (value > INT16_MAX)
+		return INT16_MAX;
+	if (value < INT16_MIN)
+		return INT16_MIN;
+	return (INT16)value;
+}
+
+static void dsp_resample_filter_generic(const INT16* WINPR_RESTRICT src,
+                                        const INT16* WINPR_RESTRICT coeffs, size_t taps,
+                                        const UINT32* WINPR_RESTRICT offsets,
+                                        const UINT32* WINPR_RESTRICT phases, size_t count,
+                                        INT16* WINPR_RESTRICT dst, size_t dstStep)
+{
+	for (size_t x = 0; x < count; x++)
+	{
+		const INT16* s = &src[offsets[x]];
+		const INT16* c = &coeffs[phases[x] * taps];
+		INT32 acc = 1 << (DSP_RESAMPLE_COEFF_BITS - 1);
+
+		for (size_t k = 0; k < taps; k++)
+			acc += s[k] * c[k];
+
+		dst[x * dstStep] = dsp_resample_clamp(acc >> DSP_RESAMPLE_COEFF_BITS);
+	}
+}
+
+static void dsp_mix_mono_to_stereo_generic(const INT16* WINPR_RESTRICT src,
+                                           INT16* WINPR_RESTRICT dst, size_t frames)
+{
+	for (size_t x = 0; x < frames; x++)
+	{
+		dst[2 * x] = src[x];
+		dst[2 * x + 1] = src[x];
+	}
+}
+
+static void dsp_mix_stereo_to_mono_generic(const INT16* WINPR_RESTRICT src,
+                                           INT16* WINPR_RESTRICT dst, size_t frames)
+{
+	for (size_t x = 0; x < frames; x++)
+	{
+		const INT32 sum = src[2 * x] + src[2 * x + 1];
+		dst[x] = (INT16)(sum >> 1);
+	}
+}
+
+void freerdp_dsp_resample_primitives_init_generic(
+    FREERDP_DSP_RESAMPLE_PRIMITIVES* WINPR_RESTRICT prims)
+{
+	WINPR_ASSERT(prims);
+	prims->filter = dsp_resample_filter_generic;
+	prims->mono_to_stereo = dsp_mix_mono_to_stereo_generic;
+	prims->stereo_to_mono = dsp_mix_stereo_to_mono_generic;
+}
+
+static BOOL CALLBACK dsp_resample_prims_init_cb(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+	freerdp_dsp_resample_primitives_init_generic(&dsp_resample_prims);
+	dsp_resample_init_sse2(&dsp_resample_prims);
+	dsp_resample_init_neon(&dsp_resample_prims);
+	return TRUE;
+}
+
+const FREERDP_DSP_RESAMPLE_PRIMITIVES* freerdp_dsp_resample_primitives_get(void)
+{
+	if (!InitOnceExecuteOnce(&dsp_resample_prims_InitOnce, dsp_resample_prims_init_cb, nullptr,
+	                         nullptr))
+		return nullptr;
+	return &dsp_resample_prims;
+}
+
+static UINT32 dsp_resample_gcd(UINT32 a, UINT32 b)
+{
+	while (b != 0)
+	{
+		const UINT32 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Zeroth order modified bessel function of the first kind, required by the kaiser window */
+static double dsp_resample_bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	const double halfx = x / 2.0;
+
+	for (size_t k = 1; k < 64; k++)
+	{
+		const double t = halfx / (double)k;
+		term *= t * t;
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+static double dsp_resample_sinc(double x)
+{
+	if (fabs(x) < 1e-9)
+		return 1.0;
+	return sin(M_PI * x) / (M_PI * x);
+}
+
+/**
+ * Build a windowed sinc filter bank with one branch per fractional input position.
+ * Each branch is normalized to unity DC gain so silence and constant offsets pass unchanged.
+ */
+static BOOL dsp_resample_init_coeffs(FREERDP_DSP_RESAMPLER* WINPR_RESTRICT resampler)
+{
+	const size_t taps = resampler->taps;
+	const double half = (double)taps / 2.0;
+	const double ratio = 1.0 * resampler->interpolation / resampler->decimation;
+	const double cutoff = DSP_RESAMPLE_ROLLOFF * ((ratio < 1.0) ? ratio : 1.0);
+	const double i0beta = dsp_resample_bessel_i0(DSP_RESAMPLE_KAISER_BETA);
+	const INT32 unity = 1 << DSP_RESAMPLE_COEFF_BITS;
+
+	resampler->coeffs = winpr_aligned_calloc(resampler->phases * taps, sizeof(INT16), 32);
+	if (!resampler->coeffs)
+		return FALSE;
+
+	for (UINT32 p = 0; p < resampler->phases; p++)
+	{
+		double h[DSP_RESAMPLE_MAX_TAPS] = WINPR_C_ARRAY_INIT;
+		double sum = 0.0;
+		const double delay = 1.0 * p / resampler->phases;
+
+		for (size_t k = 0; k < taps; k++)
+		{
+			const double x = (double)k - (half - 1.0) - delay;
+			const double u = x / half;
+			const double w = (fabs(u) <= 1.0)
+			                     ? dsp_resample_bessel_i0(DSP_RESAMPLE_KAISER_BETA *
+			                                              sqrt(1.0 - u * u)) /
+			                           i0beta
+			                     : 0.0;
+			h[k] = cutoff * dsp_resample_sinc(cutoff * x) * w;
+			sum += h[k];
+		}
+
+		INT16* c = &resampler->coeffs[p * taps];
+		INT32 total = 0;
+		size_t peak = 0;
+		for (size_t k = 0; k < taps; k++)
+		{
+			const long v = lround(h[k] / sum * unity);
+			c[k] = WINPR_ASSERTING_INT_CAST(INT16, v);
+			total += c[k];
+			if (abs(c[k]) > abs(c[peak]))
+				peak = k;
+		}
+
+		/* distribute the rounding error so every branch sums up to exactly unity */
+		c[peak] = WINPR_ASSERTING_INT_CAST(INT16, c[peak] + (unity - total));
+	}
+	return TRUE;
+}
+
+void freerdp_dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler)
+{
+	if (!resampler)
+		return;
+
+	for (size_t x = 0; x < ARRAYSIZE(resampler->history); x++)
+		free(resampler->history[x]);
+	free(resampler->offsets);
+	free(resampler->phaseIndex);
+	winpr_aligned_free(resampler->coeffs);
+	free(resampler);
+}
+
+FREERDP_DSP_RESAMPLER* freerdp_dsp_resampler_new(UINT32 srcRate, UINT32 dstRate, UINT32 channels)
+{
+	if ((srcRate == 0) || (dstRate == 0) || (channels == 0) ||
+	    (channels > DSP_RESAMPLE_MAX_CHANNELS))
+	{
+		WLog_ERR(TAG, "unsupported configuration %" PRIu32 "Hz -> %" PRIu32 "Hz, %" PRIu32
+		              " channels",
+		         srcRate, dstRate, channels);
+		return nullptr;
+	}
+
+	FREERDP_DSP_RESAMPLER* resampler = calloc(1, sizeof(FREERDP_DSP_RESAMPLER));
+	if (!resampler)
+		return nullptr;
+
+	const UINT32 gcd = dsp_resample_gcd(srcRate, dstRate);
+	resampler->srcRate = srcRate;
+	resampler->dstRate = dstRate;
+	resampler->channels = channels;
+	resampler->interpolation = dstRate / gcd;
+	resampler->decimation = srcRate / gcd;
+
+	/* For odd rate pairs the branch is picked with the nearest fractional position */
+	resampler->phases = MIN(resampler->interpolation, DSP_RESAMPLE_MAX_PHASES);
+	/* When decimating the filter must span DSP_RESAMPLE_TAPS samples at the output rate,
+	 * capped at DSP_RESAMPLE_MAX_TAPS for ratios above 8 */
+	size_t taps = DSP_RESAMPLE_TAPS;
+	if (resampler->decimation > resampler->interpolation)
+	{
+		taps = (1ull * DSP_RESAMPLE_TAPS * resampler->decimation + resampler->interpolation - 1) /
+		       resampler->interpolation;
+		taps = MIN((taps + 7) & ~(size_t)7, DSP_RESAMPLE_MAX_TAPS);
+	}
+	resampler->taps = taps;
+	resampler->prims = freerdp_dsp_resample_primitives_get();
+	if (!resampler->prims)
+		goto fail;
+
+	if (!dsp_resample_init_coeffs(resampler))
+		goto fail;
+
+	/* Prime the history so the first output sample is centered on the first input sample */
+	resampler->historyCapacity = MAX(4096, taps);
+	resampler->available = taps / 2 - 1;
+	for (UINT32 x = 0; x < channels; x++)
+	{
+		resampler->history[x] = calloc(resampler->historyCapacity, sizeof(INT16));
+		if (!resampler->history[x])
+			goto fail;
+	}
+
+	WLog_DBG(TAG,
+	         "%" PRIu32 "Hz -> %" PRIu32 "Hz [%" PRIu32 "/%" PRIu32 ", %" PRIu32 " phases, %" PRIuz
+	         " taps]",
+	         srcRate, dstRate, resampler->interpolation, resampler->decimation, resampler->phases,
+	         taps);
+	return resampler;
+
+fail:
+	freerdp_dsp_resampler_free(resampler);
+	return nullptr;
+}
+
+BOOL freerdp_dsp_resampler_matches(const FREERDP_DSP_RESAMPLER* resampler, UINT32 srcRate,
+                                   UINT32 dstRate, UINT32 channels)
+{
+	if (!resampler)
+		return FALSE;
+	return (resampler->srcRate == srcRate) && (resampler->dstRate == dstRate) &&
+	       (resampler->channels == channels);
+}
+
+size_t freerdp_dsp_resampler_max_output(const FREERDP_DSP_RESAMPLER* resampler, size_t frames)
+{
+	WINPR_ASSERT(resampler);
+	const size_t total = resampler->available + frames;
+	return (total * resampler->interpolation + resampler->decimation - 1) /
+	           resampler->decimation +
+	       1;
+}
+
+static BOOL dsp_resample_ensure_capacity(FREERDP_DSP_RESAMPLER* WINPR_RESTRICT resampler,
+                                         size_t frames, size_t outFrames)
+{
+	const size_t required = resampler->available + frames;
+	if (required > resampler->historyCapacity)
+	{
+		const size_t capacity = MAX(required, resampler->historyCapacity * 2);
+		for (UINT32 x = 0; x < resampler->channels; x++)
+		{
+			INT16* tmp = realloc(resampler->history[x], capacity * sizeof(INT16));
+			if (!tmp)
+				return FALSE;
+			resampler->history[x] = tmp;
+		}
+		resampler->historyCapacity = capacity;
+	}
+
+	if (outFrames > resampler->scratchCapacity)
+	{
+		UINT32* offsets = realloc(resampler->offsets, outFrames * sizeof(UINT32));
+		if (!offsets)
+			return FALSE;
+		resampler->offsets = offsets;
+
+		UINT32* phases = realloc(resampler->phaseIndex, outFrames * sizeof(UINT32));
+		if (!phases)
+			return FALSE;
+		resampler->phaseIndex = phases;
+		resampler->scratchCapacity = outFrames;
+	}
+	return TRUE;
+}
+
+BOOL freerdp_dsp_resampler_process(FREERDP_DSP_RESAMPLER* WINPR_RESTRICT resampler,
+                                   const INT16* WINPR_RESTRICT src, size_t frames,
+                                   INT16* WINPR_RESTRICT dst, size_t* WINPR_RESTRICT produced)
+{
+	if (!resampler || (!src && (frames > 0)) || !dst || !produced)
+		return FALSE;
+
+	*produced = 0;
+
+	const size_t maxOut = freerdp_dsp_resampler_max_output(resampler, frames);
+	if (resampler->available + frames > UINT32_MAX)
+		return FALSE;
+	if (!dsp_resample_ensure_capacity(resampler, frames, maxOut))
+		return FALSE;
+
+	const UINT32 channels = resampler->channels;
+	for (UINT32 c = 0; c < channels; c++)
+	{
+		INT16* history = &resampler->history[c][resampler->available];
+		for (size_t x = 0; x < frames; x++)
+			history[x] = src[x * channels + c];
+	}
+	resampler->available += frames;
+
+	/* Calculate the filter positions once, they are identical for all channels */
+	size_t count = 0;
+	const UINT32 L = resampler->interpolation;
+	const UINT32 M = resampler->decimation;
+	while ((resampler->position + resampler->taps <= resampler->available) && (count < maxOut))
+	{
+		UINT32 phase = resampler->fraction;
+		if (resampler->phases != L)
+			phase = (UINT32)((1ull * phase * resampler->phases) / L);
+
+		resampler->offsets[count] = (UINT32)resampler->position;
+		resampler->phaseIndex[count] = phase;
+		count++;
+
+		resampler->fraction += M;
+		resampler->position += resampler->fraction / L;
+		resampler->fraction %= L;
+	}
+
+	for (UINT32 c = 0; c < channels; c++)
+		resampler->prims->filter(resampler->history[c], resampler->coeffs, resampler->taps,
+		                         resampler->offsets, resampler->phaseIndex, count, &dst[c],
+		                         channels);
+
+	/* Drop consumed input, keep what is still required for the next filter windows */
+	const size_t consumed = MIN(resampler->position, resampler->available);
+	const size_t remaining = resampler->available - consumed;
+	for (UINT32 c = 0; c < channels; c++)
+		memmove(resampler->history[c], &resampler->history[c][consumed],
+		        remaining * sizeof(INT16));
+	resampler->available = remaining;
+	resampler->position -= consumed;
+
+	*produced = count;
+	return TRUE;
+}
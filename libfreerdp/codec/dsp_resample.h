@@ -0,0 +1,117 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - builtin resampler and channel mixer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_DSP_RESAMPLE_H
+#define FREERDP_LIB_CODEC_DSP_RESAMPLE_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/api.h>
+
+/** Number of filter taps per polyphase branch at the lower of both rates.
+ *  Branch lengths are always a multiple of 8 for the SIMD kernels */
+#define DSP_RESAMPLE_TAPS 32
+/** Upper bound for the number of filter taps when decimating.
+ *  Above a decimation ratio of DSP_RESAMPLE_MAX_TAPS / DSP_RESAMPLE_TAPS (8, e.g. 192kHz to
+ *  22.05kHz) the branches span fewer than DSP_RESAMPLE_TAPS output samples: the cutoff stays
+ *  below the output nyquist frequency, but the transition band widens with the ratio */
+#define DSP_RESAMPLE_MAX_TAPS 256
+/** Fixed point precision of the filter coefficients */
+#define DSP_RESAMPLE_COEFF_BITS 14
+/** Upper bound for the number of polyphase branches of a filter bank */
+#define DSP_RESAMPLE_MAX_PHASES 1024
+/** Upper bound for the number of channels handled by the resampler */
+#define DSP_RESAMPLE_MAX_CHANNELS 8
+
+typedef struct S_FREERDP_DSP_RESAMPLER FREERDP_DSP_RESAMPLER;
+
+/** @brief Apply the polyphase filter bank to a single (planar) channel
+ *
+ *  For each output sample \b x the \b taps input samples starting at \b src[offsets[x]]
+ *  are multiplied with the coefficients of branch \b phases[x] and the result is written
+ *  to \b dst[x * dstStep]
+ */
+typedef void (*dsp_resample_filter_fkt)(const INT16* WINPR_RESTRICT src,
+                                        const INT16* WINPR_RESTRICT coeffs, size_t taps,
+                                        const UINT32* WINPR_RESTRICT offsets,
+                                        const UINT32* WINPR_RESTRICT phases, size_t count,
+                                        INT16* WINPR_RESTRICT dst, size_t dstStep);
+
+/** @brief Convert \b frames interleaved 16bit mono frames to stereo */
+typedef void (*dsp_mix_mono_to_stereo_fkt)(const INT16* WINPR_RESTRICT src,
+                                           INT16* WINPR_RESTRICT dst, size_t frames);
+
+/** @brief Convert \b frames interleaved 16bit stereo frames to mono (average of both channels) */
+typedef void (*dsp_mix_stereo_to_mono_fkt)(const INT16* WINPR_RESTRICT src,
+                                           INT16* WINPR_RESTRICT dst, size_t frames);
+
+typedef struct
+{
+	dsp_resample_filter_fkt filter;
+	dsp_mix_mono_to_stereo_fkt mono_to_stereo;
+	dsp_mix_stereo_to_mono_fkt stereo_to_mono;
+} FREERDP_DSP_RESAMPLE_PRIMITIVES;
+
+/** @brief Get the (cached) resampler kernels best suited for the running CPU */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL const FREERDP_DSP_RESAMPLE_PRIMITIVES* freerdp_dsp_resample_primitives_get(void);
+
+FREERDP_LOCAL void freerdp_dsp_resample_primitives_init_generic(
+    FREERDP_DSP_RESAMPLE_PRIMITIVES* WINPR_RESTRICT prims);
+
+FREERDP_LOCAL void freerdp_dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler);
+
+/** @brief Create a streaming resampler for 16bit interleaved PCM
+ *
+ *  @param srcRate The input sample rate in Hz
+ *  @param dstRate The output sample rate in Hz
+ *  @param channels The number of interleaved channels
+ *
+ *  @return A new resampler instance or \b nullptr in case of failure
+ */
+WINPR_ATTR_MALLOC(freerdp_dsp_resampler_free, 1)
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL FREERDP_DSP_RESAMPLER* freerdp_dsp_resampler_new(UINT32 srcRate, UINT32 dstRate,
+                                                               UINT32 channels);
+
+/** @brief Check if the resampler was set up for the given configuration */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL freerdp_dsp_resampler_matches(const FREERDP_DSP_RESAMPLER* resampler,
+                                                 UINT32 srcRate, UINT32 dstRate, UINT32 channels);
+
+/** @brief Upper bound for the number of frames produced by the next call with \b frames input */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL size_t freerdp_dsp_resampler_max_output(const FREERDP_DSP_RESAMPLER* resampler,
+                                                      size_t frames);
+
+/** @brief Resample \b frames interleaved frames from \b src to \b dst
+ *
+ *  The filter history is kept between calls, so a continuous stream may be fed in
+ *  arbitrarily sized chunks.
+ *
+ *  @param dst The output buffer, must hold at least \b freerdp_dsp_resampler_max_output frames
+ *  @param produced Receives the number of frames written to \b dst
+ *
+ *  @return \b TRUE for success, \b FALSE otherwise
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL freerdp_dsp_resampler_process(FREERDP_DSP_RESAMPLER* WINPR_RESTRICT resampler,
+                                                 const INT16* WINPR_RESTRICT src, size_t frames,
+                                                 INT16* WINPR_RESTRICT dst,
+                                                 size_t* WINPR_RESTRICT produced);
+
+#endif /* FREERDP_LIB_CODEC_DSP_RESAMPLE_H */
@@ -25,6 +25,8 @@
 #include <winpr/library.h>
 #include <winpr/bitstream.h>
 #include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/pool.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/codec/h264.h>
@@ -322,6 +324,71 @@ static BOOL detect_changes(BOOL firstFrameDone, const UINT32 QP, const RECTANGLE
 	return TRUE;
 }
 
+static void CALLBACK detect_changes_work_callback(PTP_CALLBACK_INSTANCE instance, void* context,
+                                                  PTP_WORK work)
+{
+	H264_DETECT_CHANGES* param = context;
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+	WINPR_ASSERT(param);
+
+	param->rc = detect_changes(param->firstFrameDone, param->QP, param->regionRect,
+	                           param->pYUVData, param->pOldYUVData, param->iStride, param->meta);
+}
+
+BOOL h264_detect_worker_init(H264_CONTEXT* h264)
+{
+	WINPR_ASSERT(h264);
+
+	if (h264->auxDetectWork)
+		return TRUE;
+
+	h264->auxDetectWork =
+	    CreateThreadpoolWork(detect_changes_work_callback, &h264->auxDetect, nullptr);
+	return h264->auxDetectWork != nullptr;
+}
+
+void h264_detect_worker_free(H264_CONTEXT* h264)
+{
+	WINPR_ASSERT(h264);
+
+	if (h264->auxDetectWork)
+		CloseThreadpoolWork(h264->auxDetectWork);
+	h264->auxDetectWork = nullptr;
+}
+
+BOOL avc444_detect_changes(H264_CONTEXT* h264, const RECTANGLE_16* region, BYTE* pYUV444Data[3],
+                           BYTE* pOldYUV444Data[3], BYTE* pYUVData[3], BYTE* pOldYUVData[3],
+                           RDPGFX_H264_METABLOCK* meta, RDPGFX_H264_METABLOCK* auxMeta)
+{
+	WINPR_ASSERT(h264);
+
+	/* The views share one encoder and thereby one reference chain, only the
+	 * change detection of the auxiliary view can run next to the main view. */
+	H264_DETECT_CHANGES* aux = &h264->auxDetect;
+	aux->firstFrameDone = h264->firstChromaFrameDone;
+	aux->QP = h264->QP;
+	aux->regionRect = region;
+	aux->pYUVData = pYUVData;
+	aux->pOldYUVData = pOldYUVData;
+	aux->iStride = h264->iStride;
+	aux->meta = auxMeta;
+	aux->rc = FALSE;
+
+	if (h264->auxDetectWork)
+		SubmitThreadpoolWork(h264->auxDetectWork);
+
+	const BOOL rc = detect_changes(h264->firstLumaFrameDone, h264->QP, region, pYUV444Data,
+	                               pOldYUV444Data, h264->iStride, meta);
+
+	if (h264->auxDetectWork)
+		WaitForThreadpoolWorkCallbacks(h264->auxDetectWork, FALSE);
+	else
+		detect_changes_work_callback(nullptr, aux, nullptr);
+
+	return rc && aux->rc;
+}
+
 INT32 h264_get_yuv_buffer(H264_CONTEXT* h264, UINT32 nSrcStride, UINT32 nSrcWidth,
                           UINT32 nSrcHeight, BYTE* YUVData[3], UINT32 stride[3])
 {
@@ -459,11 +526,8 @@ INT32 avc444_compress(H264_CONTEXT* h264, const BYTE* pSrcData, DWORD SrcFormat,
 	                           pYUV444Data, pYUVData, region, 1))
 		goto fail;
 
-	if (!detect_changes(h264->firstLumaFrameDone, h264->QP, region, pYUV444Data, pOldYUV444Data,
-	                    h264->iStride, meta))
-		goto fail;
-	if (!detect_changes(h264->firstChromaFrameDone, h264->QP, region, pYUVData, pOldYUVData,
-	                    h264->iStride, auxMeta))
+	if (!avc444_detect_changes(h264, region, pYUV444Data, pOldYUV444Data, pYUVData, pOldYUVData,
+	                           meta, auxMeta))
 		goto fail;
 
 	/* [MS-RDPEGFX] 2.2.4.5 RFX_AVC444_BITMAP_STREAM
@@ -815,9 +879,15 @@ H264_CONTEXT* h264_context_new(BOOL Compressor)
 	h264->Compressor = Compressor;
 	if (Compressor)
 	{
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+
 		/* Default compressor settings, may be changed by caller */
 		h264->BitRate = 1000000;
 		h264->FrameRate = 30;
+
+		GetNativeSystemInfo(&sysInfos);
+		if ((sysInfos.dwNumberOfProcessors > 1) && !h264_detect_worker_init(h264))
+			goto fail;
 	}
 
 	if (!h264_context_init(h264))
@@ -847,6 +917,8 @@ void h264_context_free(H264_CONTEXT* h264)
 			h264->subsystem->Uninit(h264);
 		}
 
+		h264_detect_worker_free(h264);
+
 		for (size_t x = 0; x < 3; x++)
 		{
 			if (h264->Compressor)
@@ -942,3 +1014,28 @@ UINT32 h264_context_get_option(H264_CONTEXT* h264, H264_CONTEXT_OPTION option)
 			return 0;
 	}
 }
+
+size_t h264_context_memory_usage(const H264_CONTEXT* h264)
+{
+	if (!h264)
+		return 0;
+
+	/* see yuv_ensure_buffer and avc444_ensure_buffer */
+	const size_t height = (h264->height + 15ull) & ~15ull;
+	size_t size = sizeof(H264_CONTEXT);
+	for (size_t x = 0; x < 3; x++)
+	{
+		/* A decoder points pYUVData at the frames of the subsystem */
+		if (h264->Compressor && h264->pYUVData[x])
+			size += 1ull * h264->iStride[x] * height;
+		if (h264->Compressor && h264->pOldYUVData[x])
+			size += 1ull * h264->iStride[x] * height;
+		if (h264->pYUV444Data[x])
+			size += h264->iYUV444Size[x];
+		if (h264->pOldYUV444Data[x])
+			size += h264->iYUV444Size[x];
+	}
+	if (h264->lumaData)
+		size += 4ull * h264->iYUV444Size[0];
+	return size;
+}
@@ -21,6 +21,8 @@
 #ifndef FREERDP_LIB_CODEC_H264_H
 #define FREERDP_LIB_CODEC_H264_H
 
+#include <winpr/pool.h>
+
 #include <freerdp/api.h>
 #include <freerdp/config.h>
 #include <freerdp/codec/h264.h>
@@ -50,6 +52,19 @@ extern "C"
 		WINPR_ATTR_NODISCARD pfnH264SubsystemCompress Compress;
 	};
 
+	/* Arguments and result of the change detection of one view */
+	typedef struct
+	{
+		BOOL firstFrameDone;
+		UINT32 QP;
+		const RECTANGLE_16* regionRect;
+		BYTE** pYUVData;
+		BYTE** pOldYUVData;
+		const UINT32* iStride;
+		RDPGFX_H264_METABLOCK* meta;
+		BOOL rc;
+	} H264_DETECT_CHANGES;
+
 	struct S_H264_CONTEXT
 	{
 		BOOL Compressor;
@@ -82,6 +97,8 @@ extern "C"
 		BOOL encodingBuffer;
 		BOOL firstLumaFrameDone;
 		BOOL firstChromaFrameDone;
+		PTP_WORK auxDetectWork;
+		H264_DETECT_CHANGES auxDetect;
 
 		void* lumaData;
 		wLog* log;
@@ -90,10 +107,36 @@ extern "C"
 		UINT32 YUVHeight;
 	};
 
+	/** @brief Creates the worker comparing the auxiliary AVC444 view next to the main view
+	 *
+	 *  Without the worker both views are compared by the calling thread.
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL BOOL h264_detect_worker_init(H264_CONTEXT* h264);
+
+	FREERDP_LOCAL void h264_detect_worker_free(H264_CONTEXT* h264);
+
+	/** @brief Fills the metablocks with the tiles of the AVC444 views that changed since the
+	 *  previous frame, all of the region before the first frame of a view was encoded
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL BOOL avc444_detect_changes(H264_CONTEXT* h264, const RECTANGLE_16* region,
+	                                         BYTE* pYUV444Data[3], BYTE* pOldYUV444Data[3],
+	                                         BYTE* pYUVData[3], BYTE* pOldYUVData[3],
+	                                         RDPGFX_H264_METABLOCK* meta,
+	                                         RDPGFX_H264_METABLOCK* auxMeta);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_LOCAL BOOL avc420_ensure_buffer(H264_CONTEXT* h264, UINT32 stride, UINT32 width,
 	                                        UINT32 height);
 
+	/** @brief Heap memory held by the YUV buffers of the context in bytes
+	 *
+	 *  The state of the decoder or encoder subsystem is not included.
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL size_t h264_context_memory_usage(const H264_CONTEXT* h264);
+
 #ifdef WITH_MEDIACODEC
 	extern const H264_CONTEXT_SUBSYSTEM g_Subsystem_mediacodec;
 #endif
@@ -28,6 +28,8 @@
 #include <freerdp/codec/interleaved.h>
 #include <freerdp/log.h>
 
+#include "interleaved.h"
+
 #define TAG FREERDP_TAG("codec")
 
 #define UNROLL_BODY(_exp, _count)             \
@@ -766,3 +768,14 @@ void bitmap_interleaved_context_free(BITMAP_INTERLEAVED_CONTEXT* WINPR_RESTRICT
 	Stream_Free(interleaved->bts, TRUE);
 	winpr_aligned_free(interleaved);
 }
+
+size_t bitmap_interleaved_context_memory_usage(const BITMAP_INTERLEAVED_CONTEXT* interleaved)
+{
+	if (!interleaved)
+		return 0;
+
+	size_t size = sizeof(BITMAP_INTERLEAVED_CONTEXT) + interleaved->TempSize;
+	if (interleaved->bts)
+		size += Stream_Capacity(interleaved->bts);
+	return size;
+}
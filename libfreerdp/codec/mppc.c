@@ -820,6 +820,13 @@ void mppc_context_reset(MPPC_CONTEXT* mppc, BOOL flush)
 	}
 }
 
+size_t mppc_context_memory_usage(const MPPC_CONTEXT* mppc)
+{
+	if (!mppc)
+		return 0;
+	return sizeof(MPPC_CONTEXT);
+}
+
 MPPC_CONTEXT* mppc_context_new(DWORD CompressionLevel, BOOL Compressor)
 {
 	MPPC_CONTEXT* mppc = calloc(1, sizeof(MPPC_CONTEXT));
@@ -47,6 +47,10 @@ extern "C"
 
 	FREERDP_LOCAL void mppc_context_reset(MPPC_CONTEXT* mppc, BOOL flush);
 
+	/** @brief Heap memory held by the context in bytes */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL size_t mppc_context_memory_usage(const MPPC_CONTEXT* mppc);
+
 	FREERDP_LOCAL void mppc_context_free(MPPC_CONTEXT* mppc);
 
 	WINPR_ATTR_MALLOC(mppc_context_free, 1)
@@ -26,14 +26,21 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/bitstream.h>
+#include <winpr/synch.h>
 
 #include <freerdp/log.h>
 #include <freerdp/types.h>
 
 #include "ncrush.h"
+#include "ncrush_encode.h"
+#include "sse/ncrush_sse2.h"
+#include "neon/ncrush_neon.h"
 
 #define TAG FREERDP_TAG("codec")
 
+/* Longest match the length of match encoding (LOM index 28, 14 bits) can carry */
+#define NCRUSH_MAX_MATCH_LENGTH 16385
+
 struct s_NCRUSH_CONTEXT
 {
 	ALIGN64 BOOL Compressor;
@@ -48,8 +55,26 @@ struct s_NCRUSH_CONTEXT
 	ALIGN64 UINT16 MatchTable[65536];
 	ALIGN64 BYTE HuffTableCopyOffset[1024];
 	ALIGN64 BYTE HuffTableLOM[4096];
+	ALIGN64 UINT32 ChainDepth;
+	ALIGN64 UINT32 NiceMatchLength;
+	ALIGN64 UINT32 LazyMatchLength;
 };
 
+static NCRUSH_ENCODE_FUNCTIONS ncrush_encode_fn = WINPR_C_ARRAY_INIT;
+static INIT_ONCE ncrush_encode_InitOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK ncrush_encode_init_cb(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+	ncrush_encode_fn.match_length = ncrush_match_length_generic;
+	ncrush_encode_init_sse2(&ncrush_encode_fn);
+	ncrush_encode_init_neon(&ncrush_encode_fn);
+	return TRUE;
+}
+
 static const UINT16 HuffTableLEC[8192] = {
 	0x510B, 0x611F, 0x610D, 0x9027, 0x6000, 0x7105, 0x6117, 0xA068, 0x5111, 0x7007, 0x6113, 0x90C0,
 	0x6108, 0x8018, 0x611B, 0xA0B3, 0x510F, 0x7003, 0x6110, 0x9042, 0x6002, 0x800B, 0x6119, 0xA091,
@@ -2342,142 +2367,53 @@ static int ncrush_hash_table_add(NCRUSH_CONTEXT* ncrush, const BYTE* pSrcData, U
 	return 1;
 }
 
-static intptr_t ncrush_find_match_length(const BYTE* Ptr1, const BYTE* Ptr2, const BYTE* HistoryPtr)
-{
-	BYTE val1 = 0;
-	BYTE val2 = 0;
-	const BYTE* Ptr = Ptr1;
-
-	WINPR_ASSERT(Ptr1);
-	WINPR_ASSERT(Ptr2);
-	WINPR_ASSERT(HistoryPtr);
-
-	do
-	{
-		if (Ptr1 > HistoryPtr)
-			break;
-
-		val1 = *Ptr1++;
-		val2 = *Ptr2++;
-	} while (val1 == val2);
-
-	return Ptr1 - (Ptr + 1);
-}
-
-static int ncrush_find_best_match(NCRUSH_CONTEXT* ncrush, UINT16 HistoryOffset,
-                                  UINT32* pMatchOffset)
+/**
+ * Walk the hash chain of the 2 byte prefix at HistoryOffset, at most ChainDepth entries, for the
+ * longest match that ends before EndOffset. Length 2 matches are only taken for offsets below 64,
+ * farther ones cost more than two literals.
+ *
+ * @return the match length, 0 if there is none
+ */
+static UINT32 ncrush_find_best_match(const NCRUSH_CONTEXT* WINPR_RESTRICT ncrush,
+                                     UINT32 HistoryOffset, UINT32 EndOffset,
+                                     UINT32* WINPR_RESTRICT pMatchOffset)
 {
-	int Length = 0;
-
 	WINPR_ASSERT(ncrush);
 	WINPR_ASSERT(pMatchOffset);
+	WINPR_ASSERT(HistoryOffset < EndOffset);
 
-	if (!ncrush->MatchTable[HistoryOffset])
-		return -1;
-
-	int MatchLength = 2;
-	UINT16 Offset = HistoryOffset;
-	BYTE* HistoryBuffer = (BYTE*)ncrush->HistoryBuffer;
-
-	ncrush->MatchTable[0] = HistoryOffset;
-	UINT16 MatchOffset = ncrush->MatchTable[HistoryOffset];
-	UINT16 NextOffset = ncrush->MatchTable[Offset];
-	BYTE* MatchPtr = &HistoryBuffer[MatchLength];
+	const BYTE* HistoryBuffer = ncrush->HistoryBuffer;
+	const BYTE* Data = &HistoryBuffer[HistoryOffset];
+	const UINT32 MaxLength = MIN(EndOffset - HistoryOffset, NCRUSH_MAX_MATCH_LENGTH);
+	UINT32 MatchLength = 0;
+	UINT32 Offset = ncrush->MatchTable[HistoryOffset];
 
-	for (int i = 0; i < 4; i++)
+	/* Chains link to older positions only, offset 0 ends them */
+	for (UINT32 depth = ncrush->ChainDepth; depth > 0; depth--)
 	{
-		int j = -1;
-
-		if (j < 0)
-		{
-			Offset = ncrush->MatchTable[NextOffset];
-
-			if (MatchPtr[NextOffset] == HistoryBuffer[HistoryOffset + MatchLength])
-				j = 0;
-		}
-
-		if (j < 0)
-		{
-			NextOffset = ncrush->MatchTable[Offset];
-
-			if (MatchPtr[Offset] == HistoryBuffer[HistoryOffset + MatchLength])
-				j = 1;
-		}
-
-		if (j < 0)
-		{
-			Offset = ncrush->MatchTable[NextOffset];
-
-			if (MatchPtr[NextOffset] == HistoryBuffer[HistoryOffset + MatchLength])
-				j = 2;
-		}
-
-		if (j < 0)
-		{
-			NextOffset = ncrush->MatchTable[Offset];
-
-			if (MatchPtr[Offset] == HistoryBuffer[HistoryOffset + MatchLength])
-				j = 3;
-		}
-
-		if (j < 0)
-		{
-			Offset = ncrush->MatchTable[NextOffset];
-
-			if (MatchPtr[NextOffset] == HistoryBuffer[HistoryOffset + MatchLength])
-				j = 4;
-		}
-
-		if (j < 0)
-		{
-			NextOffset = ncrush->MatchTable[Offset];
+		if ((Offset == 0) || (Offset >= HistoryOffset))
+			break;
 
-			if (MatchPtr[Offset] == HistoryBuffer[HistoryOffset + MatchLength])
-				j = 5;
-		}
+		const BYTE* Match = &HistoryBuffer[Offset];
 
-		if (j >= 0)
+		/* Only a candidate that also matches the byte the best match stopped at can beat it */
+		if ((MatchLength == 0) || (Match[MatchLength] == Data[MatchLength]))
 		{
-			if ((j % 2) == 0)
-				Offset = NextOffset;
+			const UINT32 Length = (UINT32)ncrush_encode_fn.match_length(Match, Data, MaxLength);
 
-			if ((Offset != HistoryOffset) && Offset)
+			if ((Length > MAX(MatchLength, 1)) && ((Length > 2) || (HistoryOffset - Offset < 64)))
 			{
-				const intptr_t len =
-				    ncrush_find_match_length(&HistoryBuffer[HistoryOffset + 2],
-				                             &HistoryBuffer[Offset + 2], ncrush->HistoryPtr);
-				WINPR_ASSERT(len < INT_MAX - 2);
-				WINPR_ASSERT(len > INT_MIN + 2);
-
-				Length = (int)len + 2;
+				MatchLength = Length;
+				*pMatchOffset = Offset;
 
-				if (Length < 2)
-					return -1;
-
-				if (Length > 16)
+				if ((MatchLength >= ncrush->NiceMatchLength) || (MatchLength >= MaxLength))
 					break;
-
-				if (Length > MatchLength)
-				{
-					MatchLength = Length;
-					MatchOffset = Offset;
-				}
-
-				if ((Length <= MatchLength) ||
-				    (&HistoryBuffer[HistoryOffset + 2] < ncrush->HistoryPtr))
-				{
-					NextOffset = ncrush->MatchTable[Offset];
-					MatchPtr = &HistoryBuffer[MatchLength];
-					continue;
-				}
 			}
-
-			break;
 		}
+
+		Offset = ncrush->MatchTable[Offset];
 	}
 
-	ncrush->MatchTable[0] = 0;
-	*pMatchOffset = MatchOffset;
 	return MatchLength;
 }
 
@@ -2554,6 +2490,8 @@ int ncrush_compress(NCRUSH_CONTEXT* ncrush, const BYTE* pSrcData, UINT32 SrcSize
 	UINT32 CopyOffsetIndex = 0;
 	UINT32 CopyOffsetBits = 0;
 	UINT32 CompressionLevel = 2;
+	UINT32 PendingMatchLength = 0;
+	UINT32 PendingMatchOffset = 0;
 
 	WINPR_ASSERT(ncrush);
 
@@ -2618,6 +2556,7 @@ int ncrush_compress(NCRUSH_CONTEXT* ncrush, const BYTE* pSrcData, UINT32 SrcSize
 	ncrush_hash_table_add(ncrush, pSrcData, SrcSize, WINPR_ASSERTING_INT_CAST(UINT32, thsize));
 	CopyMemory(HistoryPtr, pSrcData, SrcSize);
 	ncrush->HistoryPtr = &HistoryPtr[SrcSize];
+	const UINT32 EndOffset = WINPR_ASSERTING_INT_CAST(UINT32, thsize) + SrcSize;
 
 	while (SrcPtr < (SrcEndPtr - 2))
 	{
@@ -2633,25 +2572,31 @@ int ncrush_compress(NCRUSH_CONTEXT* ncrush, const BYTE* pSrcData, UINT32 SrcSize
 		if (HistoryOffset >= 65536)
 			return -1004;
 
-		if (ncrush->MatchTable[HistoryOffset])
+		if (PendingMatchLength)
 		{
-			int rc = 0;
+			/* Found one position ahead by the lazy evaluation of the previous match */
+			MatchLength = PendingMatchLength;
+			MatchOffset = PendingMatchOffset;
+			PendingMatchLength = 0;
+		}
+		else
+			MatchLength = ncrush_find_best_match(ncrush, HistoryOffset, EndOffset, &MatchOffset);
 
-			MatchOffset = 0;
-			rc = ncrush_find_best_match(ncrush, WINPR_ASSERTING_INT_CAST(UINT16, HistoryOffset),
-			                            &MatchOffset);
+		if ((MatchLength > 0) && (MatchLength < ncrush->LazyMatchLength))
+		{
+			/* Emit a literal instead if the next position starts a longer match */
+			PendingMatchLength =
+			    ncrush_find_best_match(ncrush, HistoryOffset + 1, EndOffset, &PendingMatchOffset);
 
-			if (rc < 0)
-				return -1005;
-			MatchLength = (UINT32)rc;
+			if (PendingMatchLength > MatchLength)
+				MatchLength = 0;
+			else
+				PendingMatchLength = 0;
 		}
 
 		if (MatchLength)
 			CopyOffset = (HistoryBufferSize - 1) & (HistoryPtr - &HistoryBuffer[MatchOffset]);
 
-		if ((MatchLength == 2) && (CopyOffset >= 64))
-			MatchLength = 0;
-
 		if (MatchLength == 0)
 		{
 			/* Literal */
@@ -3007,6 +2952,45 @@ void ncrush_context_reset(NCRUSH_CONTEXT* ncrush, BOOL flush)
 	ncrush->HistoryPtr = &(ncrush->HistoryBuffer[ncrush->HistoryOffset]);
 }
 
+BOOL ncrush_context_set_effort(NCRUSH_CONTEXT* WINPR_RESTRICT ncrush, UINT32 effort)
+{
+	WINPR_ASSERT(ncrush);
+
+	switch (effort)
+	{
+		case NCRUSH_EFFORT_FAST:
+			ncrush->ChainDepth = 4;
+			ncrush->NiceMatchLength = 32;
+			ncrush->LazyMatchLength = 0;
+			break;
+
+		case NCRUSH_EFFORT_DEFAULT:
+			ncrush->ChainDepth = 16;
+			ncrush->NiceMatchLength = 128;
+			ncrush->LazyMatchLength = 32;
+			break;
+
+		case NCRUSH_EFFORT_BEST:
+			ncrush->ChainDepth = 128;
+			ncrush->NiceMatchLength = 1024;
+			ncrush->LazyMatchLength = 258;
+			break;
+
+		default:
+			WLog_WARN(TAG, "invalid NCRUSH compression effort %" PRIu32, effort);
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+size_t ncrush_context_memory_usage(const NCRUSH_CONTEXT* ncrush)
+{
+	if (!ncrush)
+		return 0;
+	return sizeof(NCRUSH_CONTEXT);
+}
+
 NCRUSH_CONTEXT* ncrush_context_new(BOOL Compressor)
 {
 	NCRUSH_CONTEXT* ncrush = (NCRUSH_CONTEXT*)calloc(1, sizeof(NCRUSH_CONTEXT));
@@ -3027,6 +3011,16 @@ NCRUSH_CONTEXT* ncrush_context_new(BOOL Compressor)
 		goto fail;
 	}
 
+	if (Compressor)
+	{
+		if (!InitOnceExecuteOnce(&ncrush_encode_InitOnce, ncrush_encode_init_cb, nullptr,
+		                         nullptr))
+			goto fail;
+
+		if (!ncrush_context_set_effort(ncrush, NCRUSH_EFFORT_DEFAULT))
+			goto fail;
+	}
+
 	ncrush_context_reset(ncrush, FALSE);
 
 	return ncrush;
@@ -22,6 +22,7 @@
 
 #include <freerdp/api.h>
 #include <freerdp/types.h>
+#include <freerdp/settings_types.h>
 
 #include "mppc.h"
 
@@ -29,6 +30,14 @@
 
 typedef struct s_NCRUSH_CONTEXT NCRUSH_CONTEXT;
 
+/* Compression effort of the match finder */
+#define NCRUSH_EFFORT_FAST \
+	COMPRESSION_EFFORT_FAST /**< short hash chains, greedy matching */
+#define NCRUSH_EFFORT_DEFAULT \
+	COMPRESSION_EFFORT_DEFAULT /**< longer hash chains, lazy matching of short matches */
+#define NCRUSH_EFFORT_BEST \
+	COMPRESSION_EFFORT_BEST /**< long hash chains, lazy matching of all matches */
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -45,6 +54,15 @@ extern "C"
 
 	FREERDP_LOCAL void ncrush_context_reset(NCRUSH_CONTEXT* ncrush, BOOL flush);
 
+	/** @brief Set the compression effort of a compressor, one of NCRUSH_EFFORT_* */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL BOOL ncrush_context_set_effort(NCRUSH_CONTEXT* WINPR_RESTRICT ncrush,
+	                                             UINT32 effort);
+
+	/** @brief Heap memory held by the context in bytes */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL size_t ncrush_context_memory_usage(const NCRUSH_CONTEXT* ncrush);
+
 	FREERDP_LOCAL void ncrush_context_free(NCRUSH_CONTEXT* ncrush);
 
 	WINPR_ATTR_MALLOC(ncrush_context_free, 1)
@@ -0,0 +1,47 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * NCrush (RDP6) Bulk Data Compression
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_NCRUSH_ENCODE_H
+#define FREERDP_LIB_CODEC_NCRUSH_ENCODE_H
+
+#include <winpr/wtypes.h>
+#include <winpr/endian.h>
+#include <freerdp/api.h>
+
+/** @return the number of leading bytes data and match have in common, at most max */
+typedef size_t (*ncrush_match_length_fn)(const BYTE* match, const BYTE* data, size_t max);
+
+typedef struct
+{
+	ncrush_match_length_fn match_length;
+} NCRUSH_ENCODE_FUNCTIONS;
+
+static inline size_t ncrush_match_length_generic(const BYTE* match, const BYTE* data, size_t max)
+{
+	size_t length = 0;
+
+	while ((length + 8 <= max) &&
+	       (winpr_Data_Get_UINT64_NE(&match[length]) == winpr_Data_Get_UINT64_NE(&data[length])))
+		length += 8;
+
+	while ((length < max) && (match[length] == data[length]))
+		length++;
+
+	return length;
+}
+
+#endif /* FREERDP_LIB_CODEC_NCRUSH_ENCODE_H */
@@ -0,0 +1,91 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Interleaved RLE Bitmap Encoder - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "bitmap_neon.h"
+
+#include "../../core/simd.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+static inline uint16x4_t bitmap_classify_neon(const UINT32* WINPR_RESTRICT line,
+                                              const UINT32* WINPR_RESTRICT prev, uint32x4_t mix,
+                                              size_t x)
+{
+	const uint32x4_t pixel = vld1q_u32(&line[x]);
+	const uint32x4_t above = vld1q_u32(&prev[x]);
+	const uint32x4_t fill = vceqq_u32(pixel, above);
+	const uint32x4_t fgbg = vceqq_u32(pixel, veorq_u32(above, mix));
+	const uint32x4_t color = vceqq_u32(pixel, vld1q_u32(&line[x - 1]));
+	const uint32x4_t bicolor = vceqq_u32(pixel, vld1q_u32(&line[x - 2]));
+
+	uint32x4_t c = vandq_u32(fill, vdupq_n_u32(BITMAP_CLASS_FILL));
+	c = vorrq_u32(c, vandq_u32(fgbg, vdupq_n_u32(BITMAP_CLASS_MIX)));
+	c = vorrq_u32(c, vandq_u32(color, vdupq_n_u32(BITMAP_CLASS_COLOR)));
+	c = vorrq_u32(c, vandq_u32(bicolor, vdupq_n_u32(BITMAP_CLASS_BICOLOR)));
+	return vmovn_u32(c);
+}
+
+static void bitmap_classify_line_neon(const UINT32* WINPR_RESTRICT line,
+                                      const UINT32* WINPR_RESTRICT prev, UINT32 mix,
+                                      BYTE* WINPR_RESTRICT classes, size_t width)
+{
+	const uint32x4_t vmix = vdupq_n_u32(mix);
+	size_t x = 2;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		const uint16x8_t c = vcombine_u16(bitmap_classify_neon(line, prev, vmix, x),
+		                                  bitmap_classify_neon(line, prev, vmix, x + 4));
+		vst1_u8(&classes[x], vmovn_u16(c));
+	}
+
+	bitmap_classify_line_generic(line, prev, mix, classes, x, width);
+}
+
+static size_t bitmap_scan_class_neon(const BYTE* WINPR_RESTRICT in, size_t max, BYTE value)
+{
+	const uint8x16_t v = vdupq_n_u8(value);
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const uint64x2_t eq = vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(&in[x]), v));
+		if ((vgetq_lane_u64(eq, 0) & vgetq_lane_u64(eq, 1)) != UINT64_MAX)
+			break;
+	}
+
+	return x + bitmap_scan_class_generic(&in[x], max - x, value);
+}
+#endif
+
+void bitmap_encode_init_neon_int(BITMAP_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	fn->classify_line = bitmap_classify_line_neon;
+	fn->scan_class = bitmap_scan_class_neon;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or NEON intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
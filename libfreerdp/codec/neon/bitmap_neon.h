@@ -0,0 +1,36 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Interleaved RLE Bitmap Encoder - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_BITMAP_NEON_H
+#define FREERDP_LIB_CODEC_BITMAP_NEON_H
+
+#include <winpr/sysinfo.h>
+
+#include <freerdp/api.h>
+
+#include "../bitmap_encode.h"
+
+FREERDP_LOCAL void bitmap_encode_init_neon_int(BITMAP_ENCODE_FUNCTIONS* WINPR_RESTRICT fn);
+static inline void bitmap_encode_init_neon(BITMAP_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+	if (!IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	bitmap_encode_init_neon_int(fn);
+}
+
+#endif /* FREERDP_LIB_CODEC_BITMAP_NEON_H */
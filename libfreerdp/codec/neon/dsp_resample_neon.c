@@ -0,0 +1,108 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - NEON resampler and channel mixer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "dsp_resample_neon.h"
+
+#include "../../core/simd.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+static void dsp_resample_filter_neon(const INT16* WINPR_RESTRICT src,
+                                     const INT16* WINPR_RESTRICT coeffs, size_t taps,
+                                     const UINT32* WINPR_RESTRICT offsets,
+                                     const UINT32* WINPR_RESTRICT phases, size_t count,
+                                     INT16* WINPR_RESTRICT dst, size_t dstStep)
+{
+	for (size_t x = 0; x < count; x++)
+	{
+		const INT16* s = &src[offsets[x]];
+		const INT16* c = &coeffs[phases[x] * taps];
+		int32x4_t acc = vdupq_n_s32(0);
+
+		for (size_t k = 0; k < taps; k += 8)
+		{
+			const int16x8_t sv = vld1q_s16(&s[k]);
+			const int16x8_t cv = vld1q_s16(&c[k]);
+			acc = vmlal_s16(acc, vget_low_s16(sv), vget_low_s16(cv));
+			acc = vmlal_s16(acc, vget_high_s16(sv), vget_high_s16(cv));
+		}
+
+		int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+		sum = vpadd_s32(sum, sum);
+		sum = vadd_s32(sum, vdup_n_s32(1 << (DSP_RESAMPLE_COEFF_BITS - 1)));
+		sum = vshr_n_s32(sum, DSP_RESAMPLE_COEFF_BITS);
+		const int16x4_t res = vqmovn_s32(vcombine_s32(sum, sum));
+		dst[x * dstStep] = vget_lane_s16(res, 0);
+	}
+}
+
+static void dsp_mix_mono_to_stereo_neon(const INT16* WINPR_RESTRICT src,
+                                        INT16* WINPR_RESTRICT dst, size_t frames)
+{
+	size_t x = 0;
+	for (; x + 8 <= frames; x += 8)
+	{
+		const int16x8_t v = vld1q_s16(&src[x]);
+		int16x8x2_t out;
+		out.val[0] = v;
+		out.val[1] = v;
+		vst2q_s16(&dst[2 * x], out);
+	}
+
+	for (; x < frames; x++)
+	{
+		dst[2 * x] = src[x];
+		dst[2 * x + 1] = src[x];
+	}
+}
+
+static void dsp_mix_stereo_to_mono_neon(const INT16* WINPR_RESTRICT src,
+                                        INT16* WINPR_RESTRICT dst, size_t frames)
+{
+	size_t x = 0;
+	for (; x + 8 <= frames; x += 8)
+	{
+		const int16x8x2_t v = vld2q_s16(&src[2 * x]);
+		/* vhaddq rounds towards negative infinity, identical to the generic shift */
+		vst1q_s16(&dst[x], vhaddq_s16(v.val[0], v.val[1]));
+	}
+
+	for (; x < frames; x++)
+	{
+		const INT32 sum = src[2 * x] + src[2 * x + 1];
+		dst[x] = (INT16)(sum >> 1);
+	}
+}
+#endif
+
+void dsp_resample_init_neon_int(FREERDP_DSP_RESAMPLE_PRIMITIVES* WINPR_RESTRICT prims)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	prims->filter = dsp_resample_filter_neon;
+	prims->mono_to_stereo = dsp_mix_mono_to_stereo_neon;
+	prims->stereo_to_mono = dsp_mix_stereo_to_mono_neon;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or NEON intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
@@ -0,0 +1,56 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * NCrush (RDP6) Bulk Data Compression - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "ncrush_neon.h"
+
+#include "../../core/simd.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+static size_t ncrush_match_length_neon(const BYTE* match, const BYTE* data, size_t max)
+{
+	size_t length = 0;
+
+	for (; length + 16 <= max; length += 16)
+	{
+		const uint64x2_t eq =
+		    vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(&match[length]), vld1q_u8(&data[length])));
+
+		if ((vgetq_lane_u64(eq, 0) & vgetq_lane_u64(eq, 1)) != UINT64_MAX)
+			break;
+	}
+
+	return length + ncrush_match_length_generic(&match[length], &data[length], max - length);
+}
+#endif
+
+void ncrush_encode_init_neon_int(NCRUSH_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	fn->match_length = ncrush_match_length_neon;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or NEON intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
@@ -22,22 +22,277 @@
 #include <winpr/sysinfo.h>
 #include <freerdp/config.h>
 #include <freerdp/codec/nsc.h>
+#include <freerdp/codec/color.h>
 #include <freerdp/log.h>
 
 #include "../nsc_types.h"
+#include "../nsc_encode.h"
 #include "nsc_neon.h"
 
 #include "../../core/simd.h"
 
 #if defined(NEON_INTRINSICS_ENABLED)
-#define TAG FREERDP_TAG("codec.nsc.neon")
+#include <arm_neon.h>
+
+/* (a - b) >> ccl for 16 signed values, truncated to 8bit like the generic code does */
+static inline uint8x16_t nsc_encode_chroma_neon(int16x8_t lo, int16x8_t hi, int16x8_t shift)
+{
+	const int8x8_t l = vmovn_s16(vshlq_s16(lo, shift));
+	const int8x8_t h = vmovn_s16(vshlq_s16(hi, shift));
+	return vreinterpretq_u8_s8(vcombine_s8(l, h));
+}
+
+static inline void nsc_encode_store_neon(BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         uint8x16_t r, uint8x16_t g, uint8x16_t b, uint8x16_t a,
+                                         int16x8_t shift)
+{
+	const uint8x16_t r1 = vshrq_n_u8(r, 1);
+	const uint8x16_t b1 = vshrq_n_u8(b, 1);
+	const uint8x16_t y = vaddq_u8(vaddq_u8(vshrq_n_u8(r1, 1), vshrq_n_u8(g, 1)), vshrq_n_u8(b1, 1));
+
+	const int16x8_t co_lo = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(r), vget_low_u8(b)));
+	const int16x8_t co_hi = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(r), vget_high_u8(b)));
+	const int16x8_t cg_lo = vreinterpretq_s16_u16(
+	    vsubw_u8(vsubl_u8(vget_low_u8(g), vget_low_u8(r1)), vget_low_u8(b1)));
+	const int16x8_t cg_hi = vreinterpretq_s16_u16(
+	    vsubw_u8(vsubl_u8(vget_high_u8(g), vget_high_u8(r1)), vget_high_u8(b1)));
+
+	vst1q_u8(yplane, y);
+	vst1q_u8(coplane, nsc_encode_chroma_neon(co_lo, co_hi, shift));
+	vst1q_u8(cgplane, nsc_encode_chroma_neon(cg_lo, cg_hi, shift));
+	vst1q_u8(aplane, a);
+}
+
+static inline size_t nsc_encode_row_32bpp_neon(const BYTE* WINPR_RESTRICT src,
+                                               BYTE* WINPR_RESTRICT yplane,
+                                               BYTE* WINPR_RESTRICT coplane,
+                                               BYTE* WINPR_RESTRICT cgplane,
+                                               BYTE* WINPR_RESTRICT aplane, size_t width, BYTE ccl,
+                                               size_t rpos, size_t bpos, BOOL alpha)
+{
+	const int16x8_t shift = vdupq_n_s16((int16_t)-ccl);
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const uint8x16x4_t v = vld4q_u8(&src[4 * x]);
+		const uint8x16_t a = alpha ? v.val[3] : vdupq_n_u8(0xFF);
+		nsc_encode_store_neon(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], v.val[rpos],
+		                      v.val[1], v.val[bpos], a, shift);
+	}
+
+	return x;
+}
+
+static inline size_t nsc_encode_row_24bpp_neon(const BYTE* WINPR_RESTRICT src,
+                                               BYTE* WINPR_RESTRICT yplane,
+                                               BYTE* WINPR_RESTRICT coplane,
+                                               BYTE* WINPR_RESTRICT cgplane,
+                                               BYTE* WINPR_RESTRICT aplane, size_t width, BYTE ccl,
+                                               size_t rpos, size_t bpos)
+{
+	const int16x8_t shift = vdupq_n_s16((int16_t)-ccl);
+	const uint8x16_t a = vdupq_n_u8(0xFF);
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const uint8x16x3_t v = vld3q_u8(&src[3 * x]);
+		nsc_encode_store_neon(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], v.val[rpos],
+		                      v.val[1], v.val[bpos], a, shift);
+	}
+
+	return x;
+}
+
+static size_t nsc_encode_row_bgrx32_neon(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_neon(src, yplane, coplane, cgplane, aplane, width, ccl, 2, 0,
+	                                 FALSE);
+}
+
+static size_t nsc_encode_row_bgra32_neon(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_neon(src, yplane, coplane, cgplane, aplane, width, ccl, 2, 0,
+	                                 TRUE);
+}
+
+static size_t nsc_encode_row_rgbx32_neon(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_neon(src, yplane, coplane, cgplane, aplane, width, ccl, 0, 2,
+	                                 FALSE);
+}
+
+static size_t nsc_encode_row_rgba32_neon(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_neon(src, yplane, coplane, cgplane, aplane, width, ccl, 0, 2,
+	                                 TRUE);
+}
+
+static size_t nsc_encode_row_bgr24_neon(const BYTE* WINPR_RESTRICT src,
+                                        BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                        BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                        size_t width, BYTE ccl)
+{
+	return nsc_encode_row_24bpp_neon(src, yplane, coplane, cgplane, aplane, width, ccl, 2, 0);
+}
+
+static size_t nsc_encode_row_rgb24_neon(const BYTE* WINPR_RESTRICT src,
+                                        BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                        BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                        size_t width, BYTE ccl)
+{
+	return nsc_encode_row_24bpp_neon(src, yplane, coplane, cgplane, aplane, width, ccl, 0, 2);
+}
+
+/* 16bpp and palette formats are left to the generic code */
+static nsc_encode_row_fn nsc_encode_row_neon(UINT32 format)
+{
+	switch (format)
+	{
+		case PIXEL_FORMAT_BGRX32:
+			return nsc_encode_row_bgrx32_neon;
+		case PIXEL_FORMAT_BGRA32:
+			return nsc_encode_row_bgra32_neon;
+		case PIXEL_FORMAT_RGBX32:
+			return nsc_encode_row_rgbx32_neon;
+		case PIXEL_FORMAT_RGBA32:
+			return nsc_encode_row_rgba32_neon;
+		case PIXEL_FORMAT_BGR24:
+			return nsc_encode_row_bgr24_neon;
+		case PIXEL_FORMAT_RGB24:
+			return nsc_encode_row_rgb24_neon;
+		default:
+			return nullptr;
+	}
+}
+
+/* Average 2x2 blocks of signed chroma values in place */
+static void nsc_encode_subsample_plane_neon(BYTE* WINPR_RESTRICT plane, size_t tempWidth,
+                                            size_t tempHeight)
+{
+	const size_t dstWidth = tempWidth >> 1;
+
+	for (size_t y = 0; y < tempHeight >> 1; y++)
+	{
+		BYTE* dst = plane + y * dstWidth;
+		const BYTE* src0 = plane + (y << 1) * tempWidth;
+		const BYTE* src1 = src0 + tempWidth;
+		size_t x = 0;
+
+		for (; x + 8 <= dstWidth; x += 8)
+		{
+			const int16x8_t s0 = vpaddlq_s8(vreinterpretq_s8_u8(vld1q_u8(&src0[2 * x])));
+			const int16x8_t s1 = vpaddlq_s8(vreinterpretq_s8_u8(vld1q_u8(&src1[2 * x])));
+			const int8x8_t avg = vmovn_s16(vshrq_n_s16(vaddq_s16(s0, s1), 2));
+			vst1_u8(&dst[x], vreinterpret_u8_s8(avg));
+		}
+
+		for (; x < dstWidth; x++)
+		{
+			const INT16 sum = (INT16)((INT8)src0[2 * x] + (INT8)src0[2 * x + 1] +
+			                          (INT8)src1[2 * x] + (INT8)src1[2 * x + 1]);
+			dst[x] = (BYTE)(sum >> 2);
+		}
+	}
+}
+
+static BOOL nsc_encode_subsampling_neon(NSC_CONTEXT* WINPR_RESTRICT context)
+{
+	const UINT32 tempWidth = ROUND_UP_TO(context->width, 8);
+	const UINT32 tempHeight = ROUND_UP_TO(context->height, 2);
+
+	if (tempHeight == 0)
+		return FALSE;
+
+	if (tempWidth > context->priv->PlaneBuffersLength / tempHeight)
+		return FALSE;
+
+	nsc_encode_subsample_plane_neon(context->priv->PlaneBuffers[1], tempWidth, tempHeight);
+	nsc_encode_subsample_plane_neon(context->priv->PlaneBuffers[2], tempWidth, tempHeight);
+	return TRUE;
+}
+
+static BOOL nsc_encode_neon(NSC_CONTEXT* WINPR_RESTRICT context, const BYTE* WINPR_RESTRICT data,
+                            UINT32 scanline)
+{
+	if (!nsc_encode_argb_to_aycocg(context, data, scanline, nsc_encode_row_neon(context->format)))
+		return FALSE;
+
+	if (context->ChromaSubsamplingLevel > 0)
+		return nsc_encode_subsampling_neon(context);
+
+	return TRUE;
+}
+
+static inline uint64x2_t nsc_rle_compare_neon(const BYTE* WINPR_RESTRICT in)
+{
+	return vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(in), vld1q_u8(in + 1)));
+}
+
+static size_t nsc_rle_scan_run_neon(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const uint64x2_t eq = nsc_rle_compare_neon(&in[x]);
+		if ((vgetq_lane_u64(eq, 0) & vgetq_lane_u64(eq, 1)) != UINT64_MAX)
+			break;
+	}
+
+	while ((x < max) && (in[x] == in[x + 1]))
+		x++;
+	return x;
+}
+
+static size_t nsc_rle_scan_literal_neon(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const uint64x2_t eq = nsc_rle_compare_neon(&in[x]);
+		if ((vgetq_lane_u64(eq, 0) | vgetq_lane_u64(eq, 1)) != 0)
+			break;
+	}
+
+	while ((x < max) && (in[x] != in[x + 1]))
+		x++;
+	return x;
+}
+
+static UINT32 nsc_rle_encode_neon(const BYTE* WINPR_RESTRICT in, BYTE* WINPR_RESTRICT out,
+                                  UINT32 originalSize)
+{
+	return nsc_rle_encode_plane(in, out, originalSize, nsc_rle_scan_run_neon,
+	                            nsc_rle_scan_literal_neon);
+}
 #endif
 
-void nsc_init_neon_int(WINPR_ATTR_UNUSED NSC_CONTEXT* WINPR_RESTRICT context)
+void nsc_init_neon_int(NSC_CONTEXT* WINPR_RESTRICT context)
 {
 #if defined(NEON_INTRINSICS_ENABLED)
-	WLog_WARN(TAG, "TODO: Implement neon optimized version of this function");
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	PROFILER_RENAME(context->priv->prof_nsc_encode, "nsc_encode_neon")
+	PROFILER_RENAME(context->priv->prof_nsc_rle_compress_data, "nsc_rle_compress_data_neon")
+	context->encode = nsc_encode_neon;
+	context->rle_encode = nsc_rle_encode_neon;
 #else
 	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or NEON intrinsics not available");
+	WINPR_UNUSED(context);
 #endif
 }
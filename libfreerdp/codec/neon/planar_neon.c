@@ -0,0 +1,111 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "planar_neon.h"
+
+#include "../../core/simd.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+static void planar_split_row32_neon(const BYTE* WINPR_RESTRICT src, size_t width,
+                                    const PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout,
+                                    BYTE* WINPR_RESTRICT planes[4])
+{
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const uint8x16x4_t v = vld4q_u8(&src[4 * x]);
+		vst1q_u8(&planes[0][x], layout->alpha ? v.val[layout->a] : vdupq_n_u8(0xFF));
+		vst1q_u8(&planes[1][x], v.val[layout->r]);
+		vst1q_u8(&planes[2][x], v.val[layout->g]);
+		vst1q_u8(&planes[3][x], v.val[layout->b]);
+	}
+
+	BYTE* tail[4] = { &planes[0][x], &planes[1][x], &planes[2][x], &planes[3][x] };
+	planar_split_row32_generic(&src[4 * x], width - x, layout, tail);
+}
+
+static void planar_delta_encode_row_neon(const BYTE* WINPR_RESTRICT cur,
+                                         const BYTE* WINPR_RESTRICT prev, BYTE* WINPR_RESTRICT dst,
+                                         size_t width)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const uint8x16_t delta = vsubq_u8(vld1q_u8(&cur[x]), vld1q_u8(&prev[x]));
+		const uint8x16_t sign = vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(delta), 7));
+		vst1q_u8(&dst[x], veorq_u8(vshlq_n_u8(delta, 1), sign));
+	}
+
+	planar_delta_encode_row_generic(&cur[x], &prev[x], &dst[x], width - x);
+}
+
+static inline uint64x2_t planar_rle_compare_neon(const BYTE* WINPR_RESTRICT in)
+{
+	return vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(in), vld1q_u8(in + 1)));
+}
+
+static size_t planar_rle_scan_run_neon(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const uint64x2_t eq = planar_rle_compare_neon(&in[x]);
+		if ((vgetq_lane_u64(eq, 0) & vgetq_lane_u64(eq, 1)) != UINT64_MAX)
+			break;
+	}
+
+	return x + planar_rle_scan_run_generic(&in[x], max - x);
+}
+
+static size_t planar_rle_scan_literal_neon(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const uint64x2_t eq = planar_rle_compare_neon(&in[x]);
+		if ((vgetq_lane_u64(eq, 0) | vgetq_lane_u64(eq, 1)) != 0)
+			break;
+	}
+
+	return x + planar_rle_scan_literal_generic(&in[x], max - x);
+}
+#endif
+
+void planar_init_neon_int(PLANAR_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	fn->split_row32 = planar_split_row32_neon;
+	fn->delta_encode_row = planar_delta_encode_row_neon;
+	fn->rle_scan_run = planar_rle_scan_run_neon;
+	fn->rle_scan_literal = planar_rle_scan_literal_neon;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or NEON intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
@@ -0,0 +1,78 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * XCrush (RDP6.1) Bulk Data Compressor - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "xcrush_neon.h"
+
+#include "../../core/simd.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+/* Only bytes rotated by k <= 6 or k >= 25 reach the low 7 bits of the rolling hash */
+static inline uint8x16_t xcrush_boundary_hash_neon(const BYTE* WINPR_RESTRICT data, size_t x)
+{
+	uint8x16_t hash = vdupq_n_u8(0);
+
+	for (int k = 0; k < 7; k++)
+	{
+		const uint8x16_t v = vld1q_u8(&data[x + XCRUSH_WINDOW_SIZE - (size_t)k]);
+		hash = veorq_u8(hash, vshlq_u8(v, vdupq_n_s8((int8_t)k)));
+	}
+
+	for (int s = 1; s < 8; s++)
+	{
+		const uint8x16_t v = vld1q_u8(&data[x + (size_t)s]);
+		hash = veorq_u8(hash, vshlq_u8(v, vdupq_n_s8((int8_t)-s)));
+	}
+
+	return vandq_u8(hash, vdupq_n_u8(XCRUSH_BOUNDARY_MASK));
+}
+
+static size_t xcrush_find_boundary_neon(const BYTE* WINPR_RESTRICT data, size_t offset,
+                                        size_t end)
+{
+	const uint8x16_t zero = vdupq_n_u8(0);
+	size_t x = offset;
+
+	for (; x + 16 <= end; x += 16)
+	{
+		const uint64x2_t eq =
+		    vreinterpretq_u64_u8(vceqq_u8(xcrush_boundary_hash_neon(data, x), zero));
+
+		if ((vgetq_lane_u64(eq, 0) | vgetq_lane_u64(eq, 1)) != 0)
+			break;
+	}
+
+	return xcrush_find_boundary_generic(data, x, end);
+}
+#endif
+
+void xcrush_encode_init_neon_int(XCRUSH_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	fn->find_boundary = xcrush_find_boundary_neon;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or NEON intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
@@ -34,9 +34,11 @@
 #include <freerdp/codec/color.h>
 
 #include "nsc_types.h"
+#include "nsc.h"
 #include "nsc_encode.h"
 
 #include "sse/nsc_sse2.h"
+#include "sse/nsc_avx2.h"
 #include "neon/nsc_neon.h"
 
 #include <freerdp/log.h>
@@ -354,6 +356,7 @@ NSC_CONTEXT* nsc_context_new(void)
 	context->BitmapData = nullptr;
 	context->decode = nsc_decode;
 	context->encode = nsc_encode;
+	context->rle_encode = nsc_rle_encode;
 
 	PROFILER_CREATE(context->priv->prof_nsc_rle_decompress_data, "nsc_rle_decompress_data")
 	PROFILER_CREATE(context->priv->prof_nsc_decode, "nsc_decode")
@@ -364,6 +367,9 @@ NSC_CONTEXT* nsc_context_new(void)
 	context->ChromaSubsamplingLevel = 1;
 	/* init optimized methods */
 	nsc_init_sse2(context);
+#if defined(WITH_AVX2)
+	nsc_init_avx2(context);
+#endif
 	nsc_init_neon(context);
 	return context;
 error:
@@ -539,3 +545,21 @@ BOOL nsc_process_message(NSC_CONTEXT* WINPR_RESTRICT context, UINT16 bpp, UINT32
 	                                      cheight, context->BitmapData, PIXEL_FORMAT_BGRA32, 0, 0,
 	                                      0, nullptr, flip));
 }
+
+size_t nsc_context_memory_usage(const NSC_CONTEXT* context)
+{
+	if (!context)
+		return 0;
+
+	size_t size = sizeof(NSC_CONTEXT) + sizeof(NSC_CONTEXT_PRIV);
+	if (context->BitmapData)
+		size += context->BitmapDataLength + 16;
+
+	/* The decoder reads the planes from the input stream, they are not owned */
+	for (size_t x = 0; x < ARRAYSIZE(context->priv->PlaneBuffers); x++)
+	{
+		if (context->priv->PlaneBuffers[x])
+			size += context->priv->PlaneBuffersLength;
+	}
+	return size;
+}
@@ -0,0 +1,28 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * NSCodec Codec
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_NSC_H
+#define FREERDP_LIB_CODEC_NSC_H
+
+#include <freerdp/api.h>
+#include <freerdp/codec/nsc.h>
+
+/** @brief Heap memory held by the context and its plane buffers in bytes */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL size_t nsc_context_memory_usage(const NSC_CONTEXT* context);
+
+#endif /* FREERDP_LIB_CODEC_NSC_H */
@@ -112,155 +112,178 @@ fail:
 	return FALSE;
 }
 
-static BOOL nsc_encode_argb_to_aycocg(NSC_CONTEXT* WINPR_RESTRICT context,
-                                      const BYTE* WINPR_RESTRICT data, UINT32 scanline)
+static inline void nsc_encode_write_pixel(BYTE* WINPR_RESTRICT yplane,
+                                          BYTE* WINPR_RESTRICT coplane,
+                                          BYTE* WINPR_RESTRICT cgplane,
+                                          BYTE* WINPR_RESTRICT aplane, size_t x, INT16 r_val,
+                                          INT16 g_val, INT16 b_val, BYTE a_val, BYTE ccl)
 {
-	size_t y = 0;
-	const BYTE* src = nullptr;
-	BYTE* yplane = nullptr;
-	BYTE* coplane = nullptr;
-	BYTE* cgplane = nullptr;
-	BYTE* aplane = nullptr;
-	INT16 r_val = 0;
-	INT16 g_val = 0;
-	INT16 b_val = 0;
-	BYTE a_val = 0;
-
-	UINT16 tempWidth = ROUND_UP_TO(context->width, 8);
-	const UINT16 rw = (context->ChromaSubsamplingLevel ? tempWidth : context->width);
-	const BYTE ccl = WINPR_ASSERTING_INT_CAST(BYTE, context->ColorLossLevel);
+	yplane[x] = (BYTE)((r_val >> 2) + (g_val >> 1) + (b_val >> 2));
+	/* Perform color loss reduction here */
+	coplane[x] = (BYTE)((r_val - b_val) >> ccl);
+	cgplane[x] = (BYTE)((-(r_val >> 1) + g_val - (b_val >> 1)) >> ccl);
+	aplane[x] = a_val;
+}
 
-	for (; y < context->height; y++)
+/* 24 and 32bpp formats, the channel offsets are constant for each caller */
+static inline void nsc_encode_row_rgb(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT yplane,
+                                      BYTE* WINPR_RESTRICT coplane, BYTE* WINPR_RESTRICT cgplane,
+                                      BYTE* WINPR_RESTRICT aplane, size_t x, size_t width,
+                                      BYTE ccl, size_t bpp, size_t rpos, size_t bpos, BOOL alpha)
+{
+	for (; x < width; x++)
+	{
+		const BYTE* pixel = &src[x * bpp];
+		const BYTE a_val = alpha ? pixel[3] : 0xFF;
+		nsc_encode_write_pixel(yplane, coplane, cgplane, aplane, x, pixel[rpos], pixel[1],
+		                       pixel[bpos], a_val, ccl);
+	}
+}
+
+static void nsc_encode_row_generic(const NSC_CONTEXT* WINPR_RESTRICT context,
+                                   const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT yplane,
+                                   BYTE* WINPR_RESTRICT coplane, BYTE* WINPR_RESTRICT cgplane,
+                                   BYTE* WINPR_RESTRICT aplane, size_t x, BYTE ccl)
+{
+	const size_t width = context->width;
+
+	switch (context->format)
+	{
+		case PIXEL_FORMAT_BGRX32:
+			nsc_encode_row_rgb(src, yplane, coplane, cgplane, aplane, x, width, ccl, 4, 2, 0,
+			                   FALSE);
+			return;
+
+		case PIXEL_FORMAT_BGRA32:
+			nsc_encode_row_rgb(src, yplane, coplane, cgplane, aplane, x, width, ccl, 4, 2, 0,
+			                   TRUE);
+			return;
+
+		case PIXEL_FORMAT_RGBX32:
+			nsc_encode_row_rgb(src, yplane, coplane, cgplane, aplane, x, width, ccl, 4, 0, 2,
+			                   FALSE);
+			return;
+
+		case PIXEL_FORMAT_RGBA32:
+			nsc_encode_row_rgb(src, yplane, coplane, cgplane, aplane, x, width, ccl, 4, 0, 2,
+			                   TRUE);
+			return;
+
+		case PIXEL_FORMAT_BGR24:
+			nsc_encode_row_rgb(src, yplane, coplane, cgplane, aplane, x, width, ccl, 3, 2, 0,
+			                   FALSE);
+			return;
+
+		case PIXEL_FORMAT_RGB24:
+			nsc_encode_row_rgb(src, yplane, coplane, cgplane, aplane, x, width, ccl, 3, 0, 2,
+			                   FALSE);
+			return;
+
+		default:
+			break;
+	}
+
+	for (; x < width; x++)
 	{
-		src = data + (context->height - 1 - y) * scanline;
-		yplane = context->priv->PlaneBuffers[0] + y * rw;
-		coplane = context->priv->PlaneBuffers[1] + y * rw;
-		cgplane = context->priv->PlaneBuffers[2] + y * rw;
-		aplane = context->priv->PlaneBuffers[3] + y * context->width;
-
-		UINT16 x = 0;
-		for (; x < context->width; x++)
+		INT16 r_val = 0;
+		INT16 g_val = 0;
+		INT16 b_val = 0;
+		BYTE a_val = 0xFF;
+
+		switch (context->format)
 		{
-			switch (context->format)
+			case PIXEL_FORMAT_BGR16:
+			{
+				const BYTE* pixel = &src[x * 2];
+				b_val = (INT16)(((*(pixel + 1)) & 0xF8) | ((*(pixel + 1)) >> 5));
+				g_val = (INT16)((((*(pixel + 1)) & 0x07) << 5) | (((*pixel) & 0xE0) >> 3));
+				r_val = (INT16)((((*pixel) & 0x1F) << 3) | (((*pixel) >> 2) & 0x07));
+			}
+			break;
+
+			case PIXEL_FORMAT_RGB16:
+			{
+				const BYTE* pixel = &src[x * 2];
+				r_val = (INT16)(((*(pixel + 1)) & 0xF8) | ((*(pixel + 1)) >> 5));
+				g_val = (INT16)((((*(pixel + 1)) & 0x07) << 5) | (((*pixel) & 0xE0) >> 3));
+				b_val = (INT16)((((*pixel) & 0x1F) << 3) | (((*pixel) >> 2) & 0x07));
+			}
+			break;
+
+			case PIXEL_FORMAT_A4:
+			{
+				const BYTE* pixel = &src[(x / 8) * 4];
+				const size_t shift = (7 - (x % 8));
+				BYTE idx = ((*pixel) >> shift) & 1;
+				idx |= (((*(pixel + 1)) >> shift) & 1) << 1;
+				idx |= (((*(pixel + 2)) >> shift) & 1) << 2;
+				idx |= (((*(pixel + 3)) >> shift) & 1) << 3;
+				idx *= 3;
+				r_val = (INT16)context->palette[idx];
+				g_val = (INT16)context->palette[idx + 1];
+				b_val = (INT16)context->palette[idx + 2];
+			}
+			break;
+
+			case PIXEL_FORMAT_RGB8:
 			{
-				case PIXEL_FORMAT_BGRX32:
-					b_val = *src++;
-					g_val = *src++;
-					r_val = *src++;
-					src++;
-					a_val = 0xFF;
-					break;
-
-				case PIXEL_FORMAT_BGRA32:
-					b_val = *src++;
-					g_val = *src++;
-					r_val = *src++;
-					a_val = *src++;
-					break;
-
-				case PIXEL_FORMAT_RGBX32:
-					r_val = *src++;
-					g_val = *src++;
-					b_val = *src++;
-					src++;
-					a_val = 0xFF;
-					break;
-
-				case PIXEL_FORMAT_RGBA32:
-					r_val = *src++;
-					g_val = *src++;
-					b_val = *src++;
-					a_val = *src++;
-					break;
-
-				case PIXEL_FORMAT_BGR24:
-					b_val = *src++;
-					g_val = *src++;
-					r_val = *src++;
-					a_val = 0xFF;
-					break;
-
-				case PIXEL_FORMAT_RGB24:
-					r_val = *src++;
-					g_val = *src++;
-					b_val = *src++;
-					a_val = 0xFF;
-					break;
-
-				case PIXEL_FORMAT_BGR16:
-					b_val = (INT16)(((*(src + 1)) & 0xF8) | ((*(src + 1)) >> 5));
-					g_val = (INT16)((((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3));
-					r_val = (INT16)((((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07));
-					a_val = 0xFF;
-					src += 2;
-					break;
-
-				case PIXEL_FORMAT_RGB16:
-					r_val = (INT16)(((*(src + 1)) & 0xF8) | ((*(src + 1)) >> 5));
-					g_val = (INT16)((((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3));
-					b_val = (INT16)((((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07));
-					a_val = 0xFF;
-					src += 2;
-					break;
-
-				case PIXEL_FORMAT_A4:
-				{
-					int shift = 0;
-					BYTE idx = 0;
-					shift = (7 - (x % 8));
-					idx = ((*src) >> shift) & 1;
-					idx |= (((*(src + 1)) >> shift) & 1) << 1;
-					idx |= (((*(src + 2)) >> shift) & 1) << 2;
-					idx |= (((*(src + 3)) >> shift) & 1) << 3;
-					idx *= 3;
-					r_val = (INT16)context->palette[idx];
-					g_val = (INT16)context->palette[idx + 1];
-					b_val = (INT16)context->palette[idx + 2];
-
-					if (shift == 0)
-						src += 4;
-				}
-
-					a_val = 0xFF;
-					break;
-
-				case PIXEL_FORMAT_RGB8:
-				{
-					int idx = (*src) * 3;
-					r_val = (INT16)context->palette[idx];
-					g_val = (INT16)context->palette[idx + 1];
-					b_val = (INT16)context->palette[idx + 2];
-					src++;
-				}
-
-					a_val = 0xFF;
-					break;
-
-				default:
-					r_val = g_val = b_val = a_val = 0;
-					break;
+				const size_t idx = src[x] * 3ull;
+				r_val = (INT16)context->palette[idx];
+				g_val = (INT16)context->palette[idx + 1];
+				b_val = (INT16)context->palette[idx + 2];
 			}
+			break;
 
-			*yplane++ = (BYTE)((r_val >> 2) + (g_val >> 1) + (b_val >> 2));
-			/* Perform color loss reduction here */
-			*coplane++ = (BYTE)((r_val - b_val) >> ccl);
-			*cgplane++ = (BYTE)((-(r_val >> 1) + g_val - (b_val >> 1)) >> ccl);
-			*aplane++ = a_val;
+			default:
+				a_val = 0;
+				break;
 		}
 
-		if (context->ChromaSubsamplingLevel && (x % 2) == 1)
+		nsc_encode_write_pixel(yplane, coplane, cgplane, aplane, x, r_val, g_val, b_val, a_val,
+		                       ccl);
+	}
+}
+
+BOOL nsc_encode_argb_to_aycocg(NSC_CONTEXT* WINPR_RESTRICT context,
+                               const BYTE* WINPR_RESTRICT data, UINT32 scanline,
+                               nsc_encode_row_fn row)
+{
+	size_t y = 0;
+
+	if (!context || !data || (scanline == 0))
+		return FALSE;
+
+	const UINT16 tempWidth = ROUND_UP_TO(context->width, 8);
+	const UINT16 rw = (context->ChromaSubsamplingLevel ? tempWidth : context->width);
+	const BYTE ccl = WINPR_ASSERTING_INT_CAST(BYTE, context->ColorLossLevel);
+
+	/* The format is resolved once per image, not for every pixel */
+	for (; y < context->height; y++)
+	{
+		const BYTE* src = data + (context->height - 1 - y) * scanline;
+		BYTE* yplane = context->priv->PlaneBuffers[0] + y * rw;
+		BYTE* coplane = context->priv->PlaneBuffers[1] + y * rw;
+		BYTE* cgplane = context->priv->PlaneBuffers[2] + y * rw;
+		BYTE* aplane = context->priv->PlaneBuffers[3] + y * context->width;
+
+		size_t x = 0;
+		if (row)
+			x = row(src, yplane, coplane, cgplane, aplane, context->width, ccl);
+		nsc_encode_row_generic(context, src, yplane, coplane, cgplane, aplane, x, ccl);
+
+		if (context->ChromaSubsamplingLevel && (context->width % 2) == 1)
 		{
-			*yplane = *(yplane - 1);
-			*coplane = *(coplane - 1);
-			*cgplane = *(cgplane - 1);
+			yplane[context->width] = yplane[context->width - 1];
+			coplane[context->width] = coplane[context->width - 1];
+			cgplane[context->width] = cgplane[context->width - 1];
 		}
 	}
 
 	if (context->ChromaSubsamplingLevel && (y % 2) == 1)
 	{
-		yplane = context->priv->PlaneBuffers[0] + y * rw;
-		coplane = context->priv->PlaneBuffers[1] + y * rw;
-		cgplane = context->priv->PlaneBuffers[2] + y * rw;
+		BYTE* yplane = context->priv->PlaneBuffers[0] + y * rw;
+		BYTE* coplane = context->priv->PlaneBuffers[1] + y * rw;
+		BYTE* cgplane = context->priv->PlaneBuffers[2] + y * rw;
 		CopyMemory(yplane, yplane - rw, rw);
 		CopyMemory(coplane, coplane - rw, rw);
 		CopyMemory(cgplane, cgplane - rw, rw);
@@ -319,7 +342,7 @@ BOOL nsc_encode(NSC_CONTEXT* WINPR_RESTRICT context, const BYTE* WINPR_RESTRICT
 	if (!context || !bmpdata || (rowstride == 0))
 		return FALSE;
 
-	if (!nsc_encode_argb_to_aycocg(context, bmpdata, rowstride))
+	if (!nsc_encode_argb_to_aycocg(context, bmpdata, rowstride, nullptr))
 		return FALSE;
 
 	if (context->ChromaSubsamplingLevel)
@@ -331,60 +354,25 @@ BOOL nsc_encode(NSC_CONTEXT* WINPR_RESTRICT context, const BYTE* WINPR_RESTRICT
 	return TRUE;
 }
 
-static UINT32 nsc_rle_encode(const BYTE* WINPR_RESTRICT in, BYTE* WINPR_RESTRICT out,
-                             UINT32 originalSize)
+static size_t nsc_rle_scan_run(const BYTE* WINPR_RESTRICT in, size_t max)
 {
-	UINT32 left = 0;
-	UINT32 runlength = 1;
-	UINT32 planeSize = 0;
-	left = originalSize;
-
-	/**
-	 * We quit the loop if the running compressed size is larger than the original.
-	 * In such cases data will be sent uncompressed.
-	 */
-	while (left > 4 && planeSize < originalSize - 4)
-	{
-		if (left > 5 && *in == *(in + 1))
-		{
-			runlength++;
-		}
-		else if (runlength == 1)
-		{
-			*out++ = *in;
-			planeSize++;
-		}
-		else if (runlength < 256)
-		{
-			*out++ = *in;
-			*out++ = *in;
-			WINPR_ASSERT(runlength >= 2);
-			*out++ = WINPR_ASSERTING_INT_CAST(BYTE, runlength - 2);
-			runlength = 1;
-			planeSize += 3;
-		}
-		else
-		{
-			*out++ = *in;
-			*out++ = *in;
-			*out++ = 0xFF;
-			*out++ = (runlength & 0x000000FF);
-			*out++ = (runlength & 0x0000FF00) >> 8;
-			*out++ = (runlength & 0x00FF0000) >> 16;
-			*out++ = (runlength & 0xFF000000) >> 24;
-			runlength = 1;
-			planeSize += 7;
-		}
-
-		in++;
-		left--;
-	}
+	size_t x = 0;
+	while ((x < max) && (in[x] == in[x + 1]))
+		x++;
+	return x;
+}
 
-	if (planeSize < originalSize - 4)
-		CopyMemory(out, in, 4);
+static size_t nsc_rle_scan_literal(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+	while ((x < max) && (in[x] != in[x + 1]))
+		x++;
+	return x;
+}
 
-	planeSize += 4;
-	return planeSize;
+UINT32 nsc_rle_encode(const BYTE* WINPR_RESTRICT in, BYTE* WINPR_RESTRICT out, UINT32 originalSize)
+{
+	return nsc_rle_encode_plane(in, out, originalSize, nsc_rle_scan_run, nsc_rle_scan_literal);
 }
 
 static void nsc_rle_compress_data(NSC_CONTEXT* WINPR_RESTRICT context)
@@ -402,8 +390,8 @@ static void nsc_rle_compress_data(NSC_CONTEXT* WINPR_RESTRICT context)
 		}
 		else
 		{
-			planeSize = nsc_rle_encode(context->priv->PlaneBuffers[i],
-			                           context->priv->PlaneBuffers[4], originalSize);
+			planeSize = context->rle_encode(context->priv->PlaneBuffers[i],
+			                                context->priv->PlaneBuffers[4], originalSize);
 
 			if (planeSize < originalSize)
 				CopyMemory(context->priv->PlaneBuffers[i], context->priv->PlaneBuffers[4],
@@ -22,12 +22,103 @@
 #ifndef FREERDP_LIB_CODEC_NSC_ENCODE_H
 #define FREERDP_LIB_CODEC_NSC_ENCODE_H
 
+#include <string.h>
+
 #include <winpr/wtypes.h>
 #include <freerdp/api.h>
 #include <freerdp/codec/nsc.h>
 
+/**
+ * Convert the leading pixels of a row to the luma, chroma and alpha planes.
+ *
+ * @return the number of pixels converted, the remainder is converted by the generic code
+ */
+typedef size_t (*nsc_encode_row_fn)(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT yplane,
+                                    BYTE* WINPR_RESTRICT coplane, BYTE* WINPR_RESTRICT cgplane,
+                                    BYTE* WINPR_RESTRICT aplane, size_t width, BYTE ccl);
+
+/**
+ * Count the bytes at the start of in that equal (run) or differ from (literal) their successor,
+ * looking at most at max + 1 bytes.
+ */
+typedef size_t (*nsc_rle_scan_fn)(const BYTE* WINPR_RESTRICT in, size_t max);
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL nsc_encode(NSC_CONTEXT* WINPR_RESTRICT context,
                               const BYTE* WINPR_RESTRICT bmpdata, UINT32 rowstride);
 
+/** ARGB to AYCoCg conversion of the whole image, row may be nullptr */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL nsc_encode_argb_to_aycocg(NSC_CONTEXT* WINPR_RESTRICT context,
+                                             const BYTE* WINPR_RESTRICT data, UINT32 scanline,
+                                             nsc_encode_row_fn row);
+
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL UINT32 nsc_rle_encode(const BYTE* WINPR_RESTRICT in, BYTE* WINPR_RESTRICT out,
+                                    UINT32 originalSize);
+
+/**
+ * RLE encode a plane, runs and literals are located with the scan functions.
+ *
+ * The last 4 bytes are always copied verbatim and runs do not extend into them.
+ * Returns originalSize if the encoded plane would not be smaller than the original.
+ */
+static inline UINT32 nsc_rle_encode_plane(const BYTE* WINPR_RESTRICT in, BYTE* WINPR_RESTRICT out,
+                                          UINT32 originalSize, nsc_rle_scan_fn scan_run,
+                                          nsc_rle_scan_fn scan_literal)
+{
+	if (originalSize <= 4)
+		return originalSize;
+
+	const size_t count = originalSize - 4;
+	size_t planeSize = 0;
+	size_t pos = 0;
+
+	while (pos < count)
+	{
+		const size_t max = count - 1 - pos;
+		const size_t literals = scan_literal(&in[pos], max);
+
+		if (literals > 0)
+		{
+			if (planeSize + literals >= count)
+				return originalSize;
+
+			memcpy(&out[planeSize], &in[pos], literals);
+			planeSize += literals;
+			pos += literals;
+			continue;
+		}
+
+		const BYTE value = in[pos];
+		const size_t runlength = 1 + scan_run(&in[pos], max);
+
+		if (runlength == 1)
+			out[planeSize++] = value;
+		else if (runlength < 256)
+		{
+			out[planeSize++] = value;
+			out[planeSize++] = value;
+			out[planeSize++] = (BYTE)(runlength - 2);
+		}
+		else
+		{
+			out[planeSize++] = value;
+			out[planeSize++] = value;
+			out[planeSize++] = 0xFF;
+			out[planeSize++] = (runlength & 0x000000FF);
+			out[planeSize++] = (runlength & 0x0000FF00) >> 8;
+			out[planeSize++] = (runlength & 0x00FF0000) >> 16;
+			out[planeSize++] = (runlength & 0xFF000000) >> 24;
+		}
+
+		if (planeSize >= count)
+			return originalSize;
+		pos += runlength;
+	}
+
+	memcpy(&out[planeSize], &in[count], 4);
+	return (UINT32)planeSize + 4;
+}
+
 #endif /* FREERDP_LIB_CODEC_NSC_ENCODE_H */
@@ -74,6 +74,8 @@ struct S_NSC_CONTEXT
 	WINPR_ATTR_NODISCARD BOOL (*decode)(NSC_CONTEXT* WINPR_RESTRICT context);
 	WINPR_ATTR_NODISCARD BOOL (*encode)(NSC_CONTEXT* WINPR_RESTRICT context,
 	                                    const BYTE* WINPR_RESTRICT BitmapData, UINT32 rowstride);
+	WINPR_ATTR_NODISCARD UINT32 (*rle_encode)(const BYTE* WINPR_RESTRICT in,
+	                                          BYTE* WINPR_RESTRICT out, UINT32 originalSize);
 
 	NSC_CONTEXT_PRIV* priv;
 };
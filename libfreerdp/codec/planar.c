@@ -26,14 +26,27 @@
 #include <winpr/assert.h>
 #include <winpr/cast.h>
 #include <winpr/print.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/log.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/planar.h>
+#include <freerdp/settings_types.h>
+
+#include "planar.h"
+#include "planar_encode.h"
+#include "sse/planar_sse2.h"
+#include "neon/planar_neon.h"
 
 #define TAG FREERDP_TAG("codec")
 
+/* Bitmaps are encoded in bands of at least this many pixels on the thread pool */
+#define PLANAR_BAND_MIN_PIXELS (256 * 64)
+#define PLANAR_MAX_BANDS 16
+
 #define PLANAR_ALIGN(val, align) \
 	((val) % (align) == 0) ? (val) : ((val) + (align) - (val) % (align))
 
@@ -67,6 +80,30 @@ typedef struct
 	BYTE formatHeader;
 } RDP6_BITMAP_STREAM;
 
+typedef struct
+{
+	BITMAP_PLANAR_CONTEXT* context;
+	const BYTE* data;
+	UINT32 format;
+	UINT32 width;
+	UINT32 height;
+	UINT32 scanline;
+	UINT32 y; /**< first plane line of the band */
+	UINT32 lines;
+	UINT32 rleSizes[4];
+} PLANAR_ENCODE_BAND;
+
+/* One encoding step of a bitmap, the calling thread and the BandWork callbacks each take the
+ * next band until none are left */
+typedef struct
+{
+	PLANAR_ENCODE_BAND* bands;
+	size_t count;
+	BOOL rle;
+	LONG volatile nextBand;
+	LONG volatile failed;
+} PLANAR_ENCODE_BATCH;
+
 struct S_BITMAP_PLANAR_CONTEXT
 {
 	UINT32 maxWidth;
@@ -94,8 +131,21 @@ struct S_BITMAP_PLANAR_CONTEXT
 
 	BOOL bgr;
 	BOOL topdown;
+
+	UINT32 rlePlaneSize;
+	PLANAR_ENCODE_FUNCTIONS fn;
+	BOOL UseThreads;
+	size_t maxBands;
+	PTP_WORK BandWork;
+	PLANAR_ENCODE_BATCH BandBatch;
 };
 
+/* Worst case size of a RLE encoded line, 15 raw bytes need a control byte */
+static inline size_t planar_rle_line_size(size_t width)
+{
+	return width + (width + 14) / 15;
+}
+
 static inline BYTE PLANAR_CONTROL_BYTE(UINT32 nRunLength, UINT32 cRawBytes)
 {
 	return WINPR_ASSERTING_INT_CAST(UINT8, ((nRunLength & 0x0F) | ((cRawBytes & 0x0F) << 4)));
@@ -173,14 +223,6 @@ static inline UINT32 planar_invert_format(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT
 	return DstFormat;
 }
 
-static inline BOOL freerdp_bitmap_planar_compress_plane_rle(const BYTE* WINPR_RESTRICT inPlane,
-                                                            UINT32 width, UINT32 height,
-                                                            BYTE* WINPR_RESTRICT outPlane,
-                                                            UINT32* WINPR_RESTRICT dstSize);
-static inline BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* WINPR_RESTRICT inPlane,
-                                                             UINT32 width, UINT32 height,
-                                                             BYTE* WINPR_RESTRICT outPlane);
-
 static inline INT32 planar_skip_plane_rle(const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
                                           UINT32 nWidth, UINT32 nHeight)
 {
@@ -1160,55 +1202,70 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 	return TRUE;
 }
 
-static inline BOOL freerdp_split_color_planes(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
-                                              const BYTE* WINPR_RESTRICT data, UINT32 format,
-                                              UINT32 width, UINT32 height, UINT32 scanline,
-                                              BYTE* WINPR_RESTRICT planes[4])
+static BOOL planar_pixel_layout(UINT32 format, PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout)
 {
-	WINPR_ASSERT(planar);
+	WINPR_ASSERT(layout);
 
-	if ((width > INT32_MAX) || (height > INT32_MAX) || (scanline > INT32_MAX))
-		return FALSE;
+	/* FreeRDPReadColor reads 32bpp pixels big endian, the channels are in name order */
+	switch (format)
+	{
+		case PIXEL_FORMAT_ARGB32:
+		case PIXEL_FORMAT_XRGB32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ 0, 1, 2, 3, format == PIXEL_FORMAT_ARGB32 };
+			return TRUE;
 
-	if (scanline == 0)
-		scanline = width * FreeRDPGetBytesPerPixel(format);
+		case PIXEL_FORMAT_ABGR32:
+		case PIXEL_FORMAT_XBGR32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ 0, 3, 2, 1, format == PIXEL_FORMAT_ABGR32 };
+			return TRUE;
 
-	if (planar->topdown)
-	{
-		UINT32 k = 0;
-		for (UINT32 i = 0; i < height; i++)
-		{
-			const BYTE* pixel = &data[1ULL * scanline * i];
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ 3, 2, 1, 0, format == PIXEL_FORMAT_BGRA32 };
+			return TRUE;
 
-			for (UINT32 j = 0; j < width; j++)
-			{
-				const UINT32 color = FreeRDPReadColor(pixel, format);
-				pixel += FreeRDPGetBytesPerPixel(format);
-				FreeRDPSplitColor(color, format, &planes[1][k], &planes[2][k], &planes[3][k],
-				                  &planes[0][k], nullptr);
-				k++;
-			}
-		}
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ 3, 0, 1, 2, format == PIXEL_FORMAT_RGBA32 };
+			return TRUE;
+
+		default:
+			return FALSE;
 	}
-	else
+}
+
+static void freerdp_split_color_planes_band(const PLANAR_ENCODE_BAND* WINPR_RESTRICT band)
+{
+	WINPR_ASSERT(band);
+
+	const BITMAP_PLANAR_CONTEXT* context = band->context;
+	const UINT32 format = band->format;
+	const size_t bpp = FreeRDPGetBytesPerPixel(format);
+	PLANAR_PIXEL_LAYOUT layout = WINPR_C_ARRAY_INIT;
+	const BOOL fast = planar_pixel_layout(format, &layout);
+
+	for (UINT32 y = band->y; y < band->y + band->lines; y++)
 	{
-		UINT32 k = 0;
+		const UINT32 line = context->topdown ? y : band->height - 1 - y;
+		const BYTE* pixel = &band->data[1ULL * band->scanline * line];
+		const size_t k = 1ULL * band->width * y;
+		BYTE* planes[4] = { &context->planes[0][k], &context->planes[1][k],
+			                &context->planes[2][k], &context->planes[3][k] };
 
-		for (INT64 i = (INT64)height - 1; i >= 0; i--)
+		if (fast)
 		{
-			const BYTE* pixel = &data[1ULL * scanline * (UINT32)i];
+			context->fn.split_row32(pixel, band->width, &layout, planes);
+			continue;
+		}
 
-			for (UINT32 j = 0; j < width; j++)
-			{
-				const UINT32 color = FreeRDPReadColor(pixel, format);
-				pixel += FreeRDPGetBytesPerPixel(format);
-				FreeRDPSplitColor(color, format, &planes[1][k], &planes[2][k], &planes[3][k],
-				                  &planes[0][k], nullptr);
-				k++;
-			}
+		for (UINT32 x = 0; x < band->width; x++)
+		{
+			const UINT32 color = FreeRDPReadColor(pixel, format);
+			pixel += bpp;
+			FreeRDPSplitColor(color, format, &planes[1][x], &planes[2][x], &planes[3][x],
+			                  &planes[0][x], nullptr);
 		}
 	}
-	return TRUE;
 }
 
 static inline UINT32 freerdp_bitmap_planar_write_rle_bytes(const BYTE* WINPR_RESTRICT pInBuffer,
@@ -1327,66 +1384,63 @@ static inline UINT32 freerdp_bitmap_planar_write_rle_bytes(const BYTE* WINPR_RES
 	return (UINT32)diff;
 }
 
-static inline UINT32 freerdp_bitmap_planar_encode_rle_bytes(const BYTE* WINPR_RESTRICT pInBuffer,
-                                                            UINT32 inBufferSize,
-                                                            BYTE* WINPR_RESTRICT pOutBuffer,
-                                                            UINT32 outBufferSize)
+/* Encode a single line, the first byte is compared to 0 */
+static UINT32
+freerdp_bitmap_planar_encode_rle_bytes(const PLANAR_ENCODE_FUNCTIONS* WINPR_RESTRICT fn,
+                                       const BYTE* WINPR_RESTRICT pInBuffer, UINT32 inBufferSize,
+                                       BYTE* WINPR_RESTRICT pOutBuffer, UINT32 outBufferSize)
 {
-	BYTE symbol = 0;
-	const BYTE* pInput = pInBuffer;
-	BYTE* pOutput = pOutBuffer;
-	const BYTE* pBytes = nullptr;
+	size_t x = 0;
 	UINT32 cRawBytes = 0;
-	UINT32 nRunLength = 0;
-	UINT32 nBytesWritten = 0;
 	UINT32 nTotalBytesWritten = 0;
 
-	if (!outBufferSize)
-		return 0;
-
-	do
+	while (x < inBufferSize)
 	{
-		if (!inBufferSize)
+		/* Bytes differing from their predecessor */
+		size_t literal = 0;
+		if (x > 0)
+			literal = fn->rle_scan_literal(&pInBuffer[x - 1], inBufferSize - x);
+		else if (pInBuffer[0] != 0)
+			literal = 1 + fn->rle_scan_literal(pInBuffer, inBufferSize - 1);
+
+		x += literal;
+		cRawBytes += (UINT32)literal;
+
+		if (x >= inBufferSize)
 			break;
 
-		const UINT32 bSymbolMatch = (symbol == *pInput) != 0;
-		symbol = *pInput;
-		pInput++;
-		inBufferSize--;
+		/* Bytes repeating their predecessor */
+		size_t run = 0;
+		if (x > 0)
+			run = fn->rle_scan_run(&pInBuffer[x - 1], inBufferSize - x);
+		else
+			run = 1 + fn->rle_scan_run(pInBuffer, inBufferSize - 1);
+
+		x += run;
 
-		if (nRunLength && !bSymbolMatch)
+		/* Short runs are cheaper as raw bytes */
+		if ((run < 3) && (x < inBufferSize))
 		{
-			if (nRunLength < 3)
-			{
-				cRawBytes += nRunLength;
-				nRunLength = 0;
-			}
-			else
-			{
-				pBytes = pInput - (cRawBytes + nRunLength + 1);
-				nBytesWritten = freerdp_bitmap_planar_write_rle_bytes(pBytes, cRawBytes, nRunLength,
-				                                                      pOutput, outBufferSize);
-				nRunLength = 0;
+			cRawBytes += (UINT32)run;
+			continue;
+		}
 
-				if (!nBytesWritten || (nBytesWritten > outBufferSize))
-					return nRunLength;
+		const UINT32 nBytesWritten = freerdp_bitmap_planar_write_rle_bytes(
+		    &pInBuffer[x - run - cRawBytes], cRawBytes, (UINT32)run, pOutBuffer, outBufferSize);
 
-				nTotalBytesWritten += nBytesWritten;
-				outBufferSize -= nBytesWritten;
-				pOutput += nBytesWritten;
-				cRawBytes = 0;
-			}
-		}
+		if (!nBytesWritten || (nBytesWritten > outBufferSize))
+			return 0;
 
-		nRunLength += bSymbolMatch;
-		cRawBytes += (!bSymbolMatch) != 0;
-	} while (outBufferSize);
+		nTotalBytesWritten += nBytesWritten;
+		outBufferSize -= nBytesWritten;
+		pOutBuffer += nBytesWritten;
+		cRawBytes = 0;
+	}
 
-	if (cRawBytes || nRunLength)
+	if (cRawBytes)
 	{
-		pBytes = pInput - (cRawBytes + nRunLength);
-		nBytesWritten = freerdp_bitmap_planar_write_rle_bytes(pBytes, cRawBytes, nRunLength,
-		                                                      pOutput, outBufferSize);
+		const UINT32 nBytesWritten = freerdp_bitmap_planar_write_rle_bytes(
+		    &pInBuffer[inBufferSize - cRawBytes], cRawBytes, 0, pOutBuffer, outBufferSize);
 
 		if (!nBytesWritten)
 			return 0;
@@ -1394,146 +1448,142 @@ static inline UINT32 freerdp_bitmap_planar_encode_rle_bytes(const BYTE* WINPR_RE
 		nTotalBytesWritten += nBytesWritten;
 	}
 
-	if (inBufferSize)
-		return 0;
-
 	return nTotalBytesWritten;
 }
 
-BOOL freerdp_bitmap_planar_compress_plane_rle(const BYTE* WINPR_RESTRICT inPlane, UINT32 width,
-                                              UINT32 height, BYTE* WINPR_RESTRICT outPlane,
-                                              UINT32* WINPR_RESTRICT dstSize)
+/* Delta and RLE encode the lines of a band of all planes */
+static BOOL freerdp_bitmap_planar_compress_planes_band(PLANAR_ENCODE_BAND* WINPR_RESTRICT band)
 {
-	if (!outPlane)
-		return FALSE;
+	WINPR_ASSERT(band);
 
-	UINT32 index = 0;
-	const BYTE* pInput = inPlane;
-	BYTE* pOutput = outPlane;
-	UINT32 outBufferSize = *dstSize;
-	UINT32 nTotalBytesWritten = 0;
+	const BITMAP_PLANAR_CONTEXT* context = band->context;
+	const size_t width = band->width;
+	const size_t lineSize = planar_rle_line_size(band->width);
 
-	while (outBufferSize > 0)
+	for (size_t i = context->AllowSkipAlpha ? 1 : 0; i < 4; i++)
 	{
-		const UINT32 nBytesWritten =
-		    freerdp_bitmap_planar_encode_rle_bytes(pInput, width, pOutput, outBufferSize);
+		const BYTE* inPlane = context->planes[i];
+		BYTE* deltaPlane = context->deltaPlanes[i];
+		BYTE* pOutput = &context->rlePlanes[i][band->y * lineSize];
+		UINT32 outBufferSize = WINPR_ASSERTING_INT_CAST(UINT32, band->lines * lineSize);
+		UINT32 nTotalBytesWritten = 0;
 
-		if ((!nBytesWritten) || (nBytesWritten > outBufferSize))
-			return FALSE;
+		for (size_t y = band->y; y < band->y + band->lines; y++)
+		{
+			const size_t off = width * y;
 
-		outBufferSize -= nBytesWritten;
-		nTotalBytesWritten += nBytesWritten;
-		pOutput += nBytesWritten;
-		pInput += width;
-		index++;
+			// first line is copied as is
+			if (y == 0)
+				CopyMemory(deltaPlane, inPlane, width);
+			else
+				context->fn.delta_encode_row(&inPlane[off], &inPlane[off - width],
+				                             &deltaPlane[off], width);
 
-		if (index >= height)
-			break;
+			const UINT32 nBytesWritten = freerdp_bitmap_planar_encode_rle_bytes(
+			    &context->fn, &deltaPlane[off], band->width, pOutput, outBufferSize);
+
+			if ((!nBytesWritten) || (nBytesWritten > outBufferSize))
+				return FALSE;
+
+			outBufferSize -= nBytesWritten;
+			nTotalBytesWritten += nBytesWritten;
+			pOutput += nBytesWritten;
+		}
+
+		band->rleSizes[i] = nTotalBytesWritten;
 	}
 
-	*dstSize = nTotalBytesWritten;
 	return TRUE;
 }
 
-static inline BOOL freerdp_bitmap_planar_compress_planes_rle(BYTE* WINPR_RESTRICT inPlanes[4],
-                                                             UINT32 width, UINT32 height,
-                                                             BYTE* WINPR_RESTRICT outPlanes,
-                                                             UINT32* WINPR_RESTRICT dstSizes,
-                                                             BOOL skipAlpha)
+static void planar_encode_batch(PLANAR_ENCODE_BATCH* WINPR_RESTRICT batch)
 {
-	UINT32 outPlanesSize = width * height * 4;
+	WINPR_ASSERT(batch);
 
-	/* AlphaPlane */
-	if (skipAlpha)
-	{
-		dstSizes[0] = 0;
-	}
-	else
+	for (;;)
 	{
-		dstSizes[0] = outPlanesSize;
-
-		if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[0], width, height, outPlanes,
-		                                              &dstSizes[0]))
-			return FALSE;
+		const LONG next = InterlockedIncrement(&batch->nextBand) - 1;
+		if ((next < 0) || ((size_t)next >= batch->count))
+			break;
 
-		outPlanes += dstSizes[0];
-		outPlanesSize -= dstSizes[0];
+		PLANAR_ENCODE_BAND* band = &batch->bands[next];
+		if (batch->rle)
+		{
+			if (!freerdp_bitmap_planar_compress_planes_band(band))
+				(void)InterlockedIncrement(&batch->failed);
+		}
+		else
+			freerdp_split_color_planes_band(band);
 	}
+}
 
-	/* LumaOrRedPlane */
-	dstSizes[1] = outPlanesSize;
+static void CALLBACK
+planar_encode_batch_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance, void* context,
+                                  WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	planar_encode_batch((PLANAR_ENCODE_BATCH*)context);
+}
 
-	if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[1], width, height, outPlanes,
-	                                              &dstSizes[1]))
-		return FALSE;
+/**
+ * Run one encoding step for all bands. The persistent BandWork of the context is submitted
+ * once for every band but the first, the calling thread works on the bands as well.
+ */
+static BOOL planar_encode_bands(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT context,
+                                PLANAR_ENCODE_BAND* WINPR_RESTRICT bands, size_t count, BOOL rle)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(count <= PLANAR_MAX_BANDS);
 
-	outPlanes += dstSizes[1];
-	outPlanesSize -= dstSizes[1];
-	/* OrangeChromaOrGreenPlane */
-	dstSizes[2] = outPlanesSize;
+	PLANAR_ENCODE_BATCH* batch = &context->BandBatch;
+	batch->bands = bands;
+	batch->count = count;
+	batch->rle = rle;
+	batch->nextBand = 0;
+	batch->failed = 0;
 
-	if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[2], width, height, outPlanes,
-	                                              &dstSizes[2]))
-		return FALSE;
+	const size_t submit = (context->BandWork && (count > 1)) ? count - 1 : 0;
+	for (size_t i = 0; i < submit; i++)
+		SubmitThreadpoolWork(context->BandWork);
 
-	outPlanes += dstSizes[2];
-	outPlanesSize -= dstSizes[2];
-	/* GreenChromeOrBluePlane */
-	dstSizes[3] = outPlanesSize;
+	planar_encode_batch(batch);
+
+	if (submit > 0)
+		WaitForThreadpoolWorkCallbacks(context->BandWork, FALSE);
 
-	return (freerdp_bitmap_planar_compress_plane_rle(inPlanes[3], width, height, outPlanes,
-	                                                 &dstSizes[3]));
+	return batch->failed == 0;
 }
 
-BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* WINPR_RESTRICT inPlane, UINT32 width,
-                                               UINT32 height, BYTE* WINPR_RESTRICT outPlane)
+static size_t planar_encode_band_count(const BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT context,
+                                       UINT32 width, UINT32 height)
 {
-	if (!outPlane)
-	{
-		if (width * height == 0)
-			return nullptr;
-
-		outPlane = (BYTE*)calloc(height, width);
-		if (!outPlane)
-			return nullptr;
-	}
-
-	// first line is copied as is
-	CopyMemory(outPlane, inPlane, width);
+	if (!context->BandWork)
+		return 1;
 
-	for (UINT32 y = 1; y < height; y++)
-	{
-		const size_t off = 1ull * width * y;
-		BYTE* outPtr = &outPlane[off];
-		const BYTE* srcPtr = &inPlane[off];
-		const BYTE* prevLinePtr = &inPlane[off - width];
-		for (UINT32 x = 0; x < width; x++)
-		{
-			const int delta = (int)srcPtr[x] - (int)prevLinePtr[x];
-			const int s2c1i = (delta >= 0) ? delta : (INT_MAX + delta) + 1;
-			const int8_t s2c1 = WINPR_CXX_COMPAT_CAST(int8_t, s2c1i);
-			const uint32_t s2c =
-			    (s2c1 >= 0) ? ((UINT32)s2c1 << 1) : (((UINT32)(~(s2c1) + 1) << 1) - 1);
-			outPtr[x] = (BYTE)s2c;
-		}
-	}
-
-	return outPlane;
+	size_t count = (1ull * width * height) / PLANAR_BAND_MIN_PIXELS;
+	count = MIN(count, context->maxBands);
+	count = MIN(count, height);
+	return MAX(count, 1);
 }
 
-static inline BOOL freerdp_bitmap_planar_delta_encode_planes(BYTE* WINPR_RESTRICT inPlanes[4],
-                                                             UINT32 width, UINT32 height,
-                                                             BYTE* WINPR_RESTRICT outPlanes[4])
+static BOOL planar_rle_buffer_resize(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT context, UINT32 width,
+                                     UINT32 height)
 {
-	for (UINT32 i = 0; i < 4; i++)
-	{
-		outPlanes[i] =
-		    freerdp_bitmap_planar_delta_encode_plane(inPlanes[i], width, height, outPlanes[i]);
+	const size_t planeSize = planar_rle_line_size(width) * height;
+
+	if (planeSize > UINT32_MAX / 4)
+		return FALSE;
 
-		if (!outPlanes[i])
+	if (planeSize > context->rlePlaneSize)
+	{
+		void* tmp = winpr_aligned_recalloc(context->rlePlanesBuffer, planeSize, 4, 32);
+		if (!tmp)
 			return FALSE;
+		context->rlePlanesBuffer = tmp;
+		context->rlePlaneSize = (UINT32)planeSize;
 	}
 
+	for (size_t i = 0; i < 4; i++)
+		context->rlePlanes[i] = &context->rlePlanesBuffer[i * context->rlePlaneSize];
 	return TRUE;
 }
 
@@ -1553,36 +1603,66 @@ BYTE* freerdp_bitmap_compress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT conte
 	if (context->AllowSkipAlpha)
 		FormatHeader |= PLANAR_FORMAT_HEADER_NA;
 
-	const UINT32 planeSize = width * height;
+	if ((width > INT32_MAX) || (height > INT32_MAX) || (scanline > INT32_MAX))
+		return nullptr;
+
+	const UINT64 planeSize64 = 1ull * width * height;
+	if (planeSize64 > context->maxPlaneSize)
+		return nullptr;
+	const UINT32 planeSize = (UINT32)planeSize64;
+
+	if (scanline == 0)
+		scanline = width * FreeRDPGetBytesPerPixel(format);
 
 	if (!context->AllowSkipAlpha)
 		format = planar_invert_format(context, TRUE, format);
 
-	if (!freerdp_split_color_planes(context, data, format, width, height, scanline,
-	                                context->planes))
+	/* Large bitmaps are split into horizontal bands encoded in parallel */
+	PLANAR_ENCODE_BAND bands[PLANAR_MAX_BANDS] = WINPR_C_ARRAY_INIT;
+	const size_t count = planar_encode_band_count(context, width, height);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const UINT32 first = (UINT32)(height * i / count);
+		const UINT32 next = (UINT32)(height * (i + 1) / count);
+		bands[i] = (PLANAR_ENCODE_BAND){ .context = context,
+			                             .data = data,
+			                             .format = format,
+			                             .width = width,
+			                             .height = height,
+			                             .scanline = scanline,
+			                             .y = first,
+			                             .lines = next - first };
+	}
+
+	if (!planar_encode_bands(context, bands, count, FALSE))
 		return nullptr;
 
 	if (context->AllowRunLengthEncoding)
 	{
-		if (!freerdp_bitmap_planar_delta_encode_planes(context->planes, width, height,
-		                                               context->deltaPlanes))
+		if (!planar_rle_buffer_resize(context, width, height))
 			return nullptr;
 
-		if (!freerdp_bitmap_planar_compress_planes_rle(context->deltaPlanes, width, height,
-		                                               context->rlePlanesBuffer, dstSizes,
-		                                               context->AllowSkipAlpha))
+		/* The delta encoding of the first line of a band needs the planes of the previous one */
+		if (!planar_encode_bands(context, bands, count, TRUE))
 			return nullptr;
 
 		{
-			uint32_t offset = 0;
+			const size_t lineSize = planar_rle_line_size(width);
 			FormatHeader |= PLANAR_FORMAT_HEADER_RLE;
-			context->rlePlanes[0] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[0];
-			context->rlePlanes[1] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[1];
-			context->rlePlanes[2] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[2];
-			context->rlePlanes[3] = &context->rlePlanesBuffer[offset];
+
+			/* Join the bands, each one was encoded at the worst case offset of its first line */
+			for (size_t i = context->AllowSkipAlpha ? 1 : 0; i < 4; i++)
+			{
+				dstSizes[i] = bands[0].rleSizes[i];
+
+				for (size_t x = 1; x < count; x++)
+				{
+					MoveMemory(&context->rlePlanes[i][dstSizes[i]],
+					           &context->rlePlanes[i][bands[x].y * lineSize], bands[x].rleSizes[i]);
+					dstSizes[i] += bands[x].rleSizes[i];
+				}
+			}
 
 #if defined(WITH_DEBUG_CODECS)
 			WLog_DBG(TAG,
@@ -1758,10 +1838,8 @@ BOOL freerdp_bitmap_planar_context_reset(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT c
 			return FALSE;
 		context->deltaPlanesBuffer = tmp;
 
-		tmp = winpr_aligned_recalloc(context->rlePlanesBuffer, context->maxPlaneSize, 4, 32);
-		if (!tmp)
+		if (!planar_rle_buffer_resize(context, context->maxWidth, context->maxHeight))
 			return FALSE;
-		context->rlePlanesBuffer = tmp;
 
 		context->planes[0] = &context->planesBuffer[0ULL * context->maxPlaneSize];
 		context->planes[1] = &context->planesBuffer[1ULL * context->maxPlaneSize];
@@ -1777,6 +1855,39 @@ BOOL freerdp_bitmap_planar_context_reset(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT c
 
 BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 maxWidth,
                                                          UINT32 maxHeight)
+{
+	return freerdp_bitmap_planar_context_new_ex(flags, maxWidth, maxHeight,
+	                                            THREADING_FLAGS_DISABLE_THREADS);
+}
+
+BOOL freerdp_bitmap_planar_context_set_band_count(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT context,
+                                                  size_t count)
+{
+	WINPR_ASSERT(context);
+
+	if (!context->UseThreads || (count == 0) || (count > PLANAR_MAX_BANDS))
+		return FALSE;
+
+	if (context->BandWork)
+		CloseThreadpoolWork(context->BandWork);
+	context->BandWork = nullptr;
+	context->maxBands = count;
+
+	if (count == 1)
+		return TRUE;
+
+	context->BandWork =
+	    CreateThreadpoolWork(planar_encode_batch_work_callback, &context->BandBatch, nullptr);
+	if (!context->BandWork)
+	{
+		context->maxBands = 1;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new_ex(DWORD flags, UINT32 maxWidth,
+                                                            UINT32 maxHeight, UINT32 ThreadingFlags)
 {
 	BITMAP_PLANAR_CONTEXT* context =
 	    (BITMAP_PLANAR_CONTEXT*)winpr_aligned_calloc(1, sizeof(BITMAP_PLANAR_CONTEXT), 32);
@@ -1784,6 +1895,31 @@ BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 max
 	if (!context)
 		return nullptr;
 
+	context->fn.split_row32 = planar_split_row32_generic;
+	context->fn.delta_encode_row = planar_delta_encode_row_generic;
+	context->fn.rle_scan_run = planar_rle_scan_run_generic;
+	context->fn.rle_scan_literal = planar_rle_scan_literal_generic;
+	planar_init_sse2(&context->fn);
+	planar_init_neon(&context->fn);
+
+	context->maxBands = 1;
+	if (!(ThreadingFlags & THREADING_FLAGS_DISABLE_THREADS))
+	{
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+		GetNativeSystemInfo(&sysInfos);
+		context->UseThreads = TRUE;
+
+		if (!freerdp_bitmap_planar_context_set_band_count(
+		        context, MIN(PLANAR_MAX_BANDS, sysInfos.dwNumberOfProcessors)))
+		{
+			WINPR_PRAGMA_DIAG_PUSH
+			WINPR_PRAGMA_DIAG_IGNORED_MISMATCHED_DEALLOC
+			freerdp_bitmap_planar_context_free(context);
+			WINPR_PRAGMA_DIAG_POP
+			return nullptr;
+		}
+	}
+
 	if (flags & PLANAR_FORMAT_HEADER_NA)
 		context->AllowSkipAlpha = TRUE;
 
@@ -1815,6 +1951,8 @@ void freerdp_bitmap_planar_context_free(BITMAP_PLANAR_CONTEXT* context)
 	if (!context)
 		return;
 
+	if (context->BandWork)
+		CloseThreadpoolWork(context->BandWork);
 	winpr_aligned_free(context->pTempData);
 	winpr_aligned_free(context->planesBuffer);
 	winpr_aligned_free(context->deltaPlanesBuffer);
@@ -1833,3 +1971,20 @@ void freerdp_planar_topdown_image(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
 	WINPR_ASSERT(planar);
 	planar->topdown = topdown;
 }
+
+size_t freerdp_bitmap_planar_context_memory_usage(const BITMAP_PLANAR_CONTEXT* context)
+{
+	if (!context)
+		return 0;
+
+	size_t size = sizeof(BITMAP_PLANAR_CONTEXT);
+	if (context->planesBuffer)
+		size += 4ull * context->maxPlaneSize;
+	if (context->deltaPlanesBuffer)
+		size += 4ull * context->maxPlaneSize;
+	if (context->pTempData)
+		size += 6ull * context->maxPlaneSize;
+	if (context->rlePlanesBuffer)
+		size += 4ull * context->rlePlaneSize;
+	return size;
+}
@@ -0,0 +1,111 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec Encoder
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_PLANAR_ENCODE_H
+#define FREERDP_LIB_CODEC_PLANAR_ENCODE_H
+
+#include <winpr/wtypes.h>
+#include <freerdp/api.h>
+#include <freerdp/codec/planar.h>
+
+/** Byte offsets of the channels in a 32bpp pixel */
+typedef struct
+{
+	size_t a;
+	size_t r;
+	size_t g;
+	size_t b;
+	BOOL alpha; /**< FALSE if the format has no alpha, the alpha plane is filled with 0xFF */
+} PLANAR_PIXEL_LAYOUT;
+
+/** Split a line of 32bpp pixels into the alpha, red, green and blue planes */
+typedef void (*planar_split_row32_fn)(const BYTE* WINPR_RESTRICT src, size_t width,
+                                      const PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout,
+                                      BYTE* WINPR_RESTRICT planes[4]);
+
+/** Delta encode a plane line against the previous one */
+typedef void (*planar_delta_row_fn)(const BYTE* WINPR_RESTRICT cur, const BYTE* WINPR_RESTRICT prev,
+                                    BYTE* WINPR_RESTRICT dst, size_t width);
+
+/** @return the number of bytes x < max with in[x] == in[x + 1] (run) or in[x] != in[x + 1]
+ * (literal) in a row from the start */
+typedef size_t (*planar_rle_scan_fn)(const BYTE* WINPR_RESTRICT in, size_t max);
+
+typedef struct
+{
+	planar_split_row32_fn split_row32;
+	planar_delta_row_fn delta_encode_row;
+	planar_rle_scan_fn rle_scan_run;
+	planar_rle_scan_fn rle_scan_literal;
+} PLANAR_ENCODE_FUNCTIONS;
+
+static inline BYTE planar_delta_encode_byte(BYTE cur, BYTE prev)
+{
+	/* The two's complement delta is stored as 2 * |delta| - (delta < 0) */
+	const BYTE delta = (BYTE)(cur - prev);
+	const BYTE sign = (delta & 0x80) ? 0xFF : 0x00;
+	return (BYTE)((delta << 1) ^ sign);
+}
+
+static inline void planar_delta_encode_row_generic(const BYTE* WINPR_RESTRICT cur,
+                                                   const BYTE* WINPR_RESTRICT prev,
+                                                   BYTE* WINPR_RESTRICT dst, size_t width)
+{
+	for (size_t x = 0; x < width; x++)
+		dst[x] = planar_delta_encode_byte(cur[x], prev[x]);
+}
+
+static inline void planar_split_row32_generic(const BYTE* WINPR_RESTRICT src, size_t width,
+                                              const PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout,
+                                              BYTE* WINPR_RESTRICT planes[4])
+{
+	for (size_t x = 0; x < width; x++)
+	{
+		const BYTE* pixel = &src[4 * x];
+		planes[0][x] = layout->alpha ? pixel[layout->a] : 0xFF;
+		planes[1][x] = pixel[layout->r];
+		planes[2][x] = pixel[layout->g];
+		planes[3][x] = pixel[layout->b];
+	}
+}
+
+static inline size_t planar_rle_scan_run_generic(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+	while ((x < max) && (in[x] == in[x + 1]))
+		x++;
+	return x;
+}
+
+static inline size_t planar_rle_scan_literal_generic(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+	while ((x < max) && (in[x] != in[x + 1]))
+		x++;
+	return x;
+}
+
+/**
+ * Set the number of bands large bitmaps are split into, the bands are encoded on the thread
+ * pool by a work object of the context. Fails if the context was created without threads.
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL
+freerdp_bitmap_planar_context_set_band_count(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT context,
+                                             size_t count);
+
+#endif /* FREERDP_LIB_CODEC_PLANAR_ENCODE_H */
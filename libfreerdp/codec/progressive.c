@@ -353,44 +353,57 @@ static void progressive_surface_context_free(void* ptr)
 	winpr_aligned_free(surface);
 }
 
+#define PROGRESSIVE_TILE_COEFF_SIZE ((8192ULL + 32ULL) * 3ULL)
+
 static inline RFX_PROGRESSIVE_TILE* progressive_tile_new(void)
 {
 	RFX_PROGRESSIVE_TILE* tile = winpr_aligned_calloc(1, sizeof(RFX_PROGRESSIVE_TILE), 32);
 	if (!tile)
-		goto fail;
+		return nullptr;
 
 	tile->width = 64;
 	tile->height = 64;
 	tile->stride = 4 * tile->width;
+	return tile;
+}
 
-	{
-		const size_t dataLen = 1ull * tile->stride * tile->height;
-		tile->data = (BYTE*)winpr_aligned_malloc(dataLen, 16);
-		if (!tile->data)
-			goto fail;
-		memset(tile->data, 0xFF, dataLen);
-	}
-
-	{
-		const size_t signLen = (8192ULL + 32ULL) * 3ULL;
-		tile->sign = (BYTE*)winpr_aligned_malloc(signLen, 16);
-	}
+/* The pixel and coefficient buffers (~66KB per tile) are only allocated once the server
+ * sends data for a tile, most surfaces are never fully covered by progressive updates. */
+static inline BOOL progressive_tile_allocate_buffers(RFX_PROGRESSIVE_TILE* WINPR_RESTRICT tile)
+{
+	WINPR_ASSERT(tile);
 
-	if (!tile->sign)
-		goto fail;
+	if (tile->data)
+		return TRUE;
 
+	const size_t dataLen = 1ull * tile->stride * tile->height;
+	tile->data = (BYTE*)winpr_aligned_malloc(dataLen, 16);
+	tile->sign = (BYTE*)winpr_aligned_malloc(PROGRESSIVE_TILE_COEFF_SIZE, 16);
+	tile->current = (BYTE*)winpr_aligned_malloc(PROGRESSIVE_TILE_COEFF_SIZE, 16);
+	if (!tile->data || !tile->sign || !tile->current)
 	{
-		const size_t currentLen = (8192ULL + 32ULL) * 3ULL;
-		tile->current = (BYTE*)winpr_aligned_malloc(currentLen, 16);
+		winpr_aligned_free(tile->data);
+		winpr_aligned_free(tile->sign);
+		winpr_aligned_free(tile->current);
+		tile->data = nullptr;
+		tile->sign = nullptr;
+		tile->current = nullptr;
+		return FALSE;
 	}
-	if (!tile->current)
-		goto fail;
 
-	return tile;
+	memset(tile->data, 0xFF, dataLen);
+	return TRUE;
+}
 
-fail:
-	progressive_tile_free(tile);
-	return nullptr;
+static size_t progressive_tile_memory_usage(const RFX_PROGRESSIVE_TILE* tile)
+{
+	if (!tile)
+		return 0;
+
+	size_t size = sizeof(RFX_PROGRESSIVE_TILE);
+	if (tile->data)
+		size += 1ull * tile->stride * tile->height + 2ull * PROGRESSIVE_TILE_COEFF_SIZE;
+	return size;
 }
 
 static inline BOOL
@@ -477,6 +490,11 @@ progressive_surface_tile_replace(PROGRESSIVE_SURFACE_CONTEXT* WINPR_RESTRICT sur
 	}
 
 	t = surface->tiles[zIdx];
+	if (!progressive_tile_allocate_buffers(t))
+	{
+		WLog_ERR(TAG, "Failed to allocate tile buffers");
+		return FALSE;
+	}
 
 	t->blockType = tile->blockType;
 	t->blockLen = tile->blockLen;
@@ -1814,6 +1832,8 @@ progressive_process_tiles(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
 		}
 	}
 
+fail:
+	/* always drain submitted work, the callbacks reference the shared parameter array */
 	if (progressive->rfx_context->priv->UseThreads)
 	{
 		for (UINT32 idx = 0; idx < close_cnt; idx++)
@@ -1823,8 +1843,6 @@ progressive_process_tiles(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
 		}
 	}
 
-fail:
-
 	if (status < 0)
 		return -1;
 
@@ -2021,6 +2039,54 @@ static inline SSIZE_T progressive_wb_context(PROGRESSIVE_CONTEXT* WINPR_RESTRICT
 	return 0;
 }
 
+/* Grow the per region rectangle, tile and work arrays to the counts announced by the
+ * region header. Sizing them for the protocol maximum would cost ~3.5MB per context. */
+static BOOL progressive_region_reserve(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                       PROGRESSIVE_BLOCK_REGION* WINPR_RESTRICT region)
+{
+	WINPR_ASSERT(progressive);
+	WINPR_ASSERT(region);
+
+	if (region->numRects > region->rectsCapacity)
+	{
+		RFX_RECT* rects = winpr_aligned_recalloc(region->rects, region->numRects,
+		                                         sizeof(RFX_RECT), 32);
+		if (!rects)
+			return FALSE;
+		region->rects = rects;
+		region->rectsCapacity = region->numRects;
+	}
+
+	if (region->numTiles > region->tilesCapacity)
+	{
+		RFX_PROGRESSIVE_TILE** tiles = winpr_aligned_recalloc(
+		    (void*)region->tiles, region->numTiles, sizeof(RFX_PROGRESSIVE_TILE*), 32);
+		if (!tiles)
+			return FALSE;
+		region->tiles = tiles;
+		region->tilesCapacity = region->numTiles;
+	}
+
+	if (region->numTiles > progressive->workCapacity)
+	{
+		PROGRESSIVE_TILE_PROCESS_WORK_PARAM* params =
+		    winpr_aligned_recalloc(progressive->params, region->numTiles,
+		                           sizeof(PROGRESSIVE_TILE_PROCESS_WORK_PARAM), 32);
+		if (!params)
+			return FALSE;
+		progressive->params = params;
+
+		PTP_WORK* work = winpr_aligned_recalloc((void*)progressive->work_objects,
+		                                        region->numTiles, sizeof(PTP_WORK), 32);
+		if (!work)
+			return FALSE;
+		progressive->work_objects = work;
+		progressive->workCapacity = region->numTiles;
+	}
+
+	return TRUE;
+}
+
 static inline SSIZE_T
 progressive_wb_read_region_header(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
                                   wStream* WINPR_RESTRICT s, UINT16 blockType, UINT32 blockLen,
@@ -2106,6 +2172,12 @@ progressive_wb_read_region_header(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressiv
 			           "Unused bytes detected, %" PRIdz " bytes not processed", len);
 	}
 
+	if (!progressive_region_reserve(progressive, region))
+	{
+		WLog_Print(progressive->log, WLOG_ERROR, "ProgressiveRegion allocation failed");
+		return -1;
+	}
+
 	return rc;
 }
 
@@ -2637,6 +2709,39 @@ BOOL progressive_context_reset(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive)
 	return (progressive != nullptr);
 }
 
+static BOOL progressive_surface_memory_usage(WINPR_ATTR_UNUSED const void* key, void* value,
+                                             void* arg)
+{
+	const PROGRESSIVE_SURFACE_CONTEXT* surface = value;
+	size_t* size = arg;
+
+	WINPR_ASSERT(surface);
+	WINPR_ASSERT(size);
+
+	*size += sizeof(PROGRESSIVE_SURFACE_CONTEXT);
+	*size += surface->tilesSize * sizeof(RFX_PROGRESSIVE_TILE*);
+	*size += 1ull * surface->gridSize * sizeof(UINT32);
+	for (size_t x = 0; x < surface->tilesSize; x++)
+		*size += progressive_tile_memory_usage(surface->tiles[x]);
+	return TRUE;
+}
+
+size_t progressive_context_memory_usage(PROGRESSIVE_CONTEXT* progressive)
+{
+	if (!progressive)
+		return 0;
+
+	size_t size = sizeof(PROGRESSIVE_CONTEXT);
+	size += 1ull * progressive->region.rectsCapacity * sizeof(RFX_RECT);
+	size += 1ull * progressive->region.tilesCapacity * sizeof(RFX_PROGRESSIVE_TILE*);
+	size += 1ull * progressive->workCapacity *
+	        (sizeof(PROGRESSIVE_TILE_PROCESS_WORK_PARAM) + sizeof(PTP_WORK));
+	size += Stream_Capacity(progressive->buffer) + Stream_Capacity(progressive->rects);
+	if (!HashTable_Foreach(progressive->SurfaceContexts, progressive_surface_memory_usage, &size))
+		return 0;
+	return size;
+}
+
 PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
 {
 	return progressive_context_new_ex(Compressor, 0);
@@ -2694,6 +2799,11 @@ void progressive_context_free(PROGRESSIVE_CONTEXT* progressive)
 	Stream_Free(progressive->rects, TRUE);
 	rfx_context_free(progressive->rfx_context);
 
+	winpr_aligned_free(progressive->region.rects);
+	winpr_aligned_free((void*)progressive->region.tiles);
+	winpr_aligned_free(progressive->params);
+	winpr_aligned_free((void*)progressive->work_objects);
+
 	BufferPool_Free(progressive->bufferPool);
 	HashTable_Free(progressive->SurfaceContexts);
 
@@ -164,10 +164,12 @@ struct S_PROGRESSIVE_BLOCK_REGION
 	UINT16 numTiles;
 	UINT16 usedTiles;
 	UINT32 tileDataSize;
-	RFX_RECT rects[0x10000];
+	RFX_RECT* rects;
+	UINT32 rectsCapacity;
 	RFX_COMPONENT_CODEC_QUANT quantVals[0x100];
 	RFX_PROGRESSIVE_CODEC_QUANT quantProgVals[0x100];
-	RFX_PROGRESSIVE_TILE* tiles[0x10000];
+	RFX_PROGRESSIVE_TILE** tiles;
+	UINT32 tilesCapacity;
 };
 
 typedef struct
@@ -228,8 +230,13 @@ struct S_PROGRESSIVE_CONTEXT
 	wStream* buffer;
 	wStream* rects;
 	RFX_CONTEXT* rfx_context;
-	PROGRESSIVE_TILE_PROCESS_WORK_PARAM params[0x10000];
-	PTP_WORK work_objects[0x10000];
+	PROGRESSIVE_TILE_PROCESS_WORK_PARAM* params;
+	PTP_WORK* work_objects;
+	UINT32 workCapacity;
 };
 
+/** @brief Heap memory held by the context, its surfaces and tile caches in bytes */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL size_t progressive_context_memory_usage(PROGRESSIVE_CONTEXT* progressive);
+
 #endif /* INTERNAL_CODEC_PROGRESSIVE_H */
@@ -24,6 +24,8 @@
 #include <freerdp/log.h>
 #include <freerdp/codec/region.h>
 
+#include "region.h"
+
 #define TAG FREERDP_TAG("codec")
 
 /*
@@ -833,6 +835,205 @@ BOOL region16_union_rect(REGION16* dst, const REGION16* src, const RECTANGLE_16*
 	return region16_simplify_bands(dst);
 }
 
+static int rectangle_compare_top(const void* pva, const void* pvb)
+{
+	const RECTANGLE_16* a = pva;
+	const RECTANGLE_16* b = pvb;
+
+	if (a->top != b->top)
+		return (a->top < b->top) ? -1 : 1;
+	if (a->left != b->left)
+		return (a->left < b->left) ? -1 : 1;
+	return 0;
+}
+
+static int uint16_compare(const void* pva, const void* pvb)
+{
+	const UINT16* a = pva;
+	const UINT16* b = pvb;
+	return (int)*a - (int)*b;
+}
+
+static BOOL region16_push_rect(RECTANGLE_16** rects, size_t* count, size_t* capacity,
+                               UINT16 left, UINT16 top, UINT16 right, UINT16 bottom)
+{
+	WINPR_ASSERT(rects);
+	WINPR_ASSERT(count);
+	WINPR_ASSERT(capacity);
+
+	if (*count >= *capacity)
+	{
+		const size_t newCapacity = MAX(16, *capacity * 2);
+		RECTANGLE_16* tmp = realloc(*rects, newCapacity * sizeof(RECTANGLE_16));
+		if (!tmp)
+			return FALSE;
+		*rects = tmp;
+		*capacity = newCapacity;
+	}
+
+	RECTANGLE_16* rect = &(*rects)[(*count)++];
+	rect->left = left;
+	rect->top = top;
+	rect->right = right;
+	rect->bottom = bottom;
+	return TRUE;
+}
+
+/** replaces the content of the region with the given y-x banded rectangles */
+static BOOL region16_assign_bands(REGION16* region, RECTANGLE_16* rects, size_t count,
+                                  const RECTANGLE_16* extents)
+{
+	WINPR_ASSERT(region);
+	WINPR_ASSERT(extents);
+
+	if (count == 0)
+	{
+		free(rects);
+		region16_clear(region);
+		return TRUE;
+	}
+
+	REGION16_DATA* data = allocateRegion(0);
+	if (!data)
+	{
+		free(rects);
+		return FALSE;
+	}
+
+	data->rects = rects;
+	data->nbRects = count;
+	freeRegion(region->data);
+	region->data = data;
+	region->extents = *extents;
+	return region16_simplify_bands(region);
+}
+
+BOOL region16_union_rects(REGION16* dst, const REGION16* src, const RECTANGLE_16* rects,
+                          size_t count)
+{
+	BOOL rc = FALSE;
+	UINT32 srcNbRects = 0;
+	RECTANGLE_16* input = nullptr;
+	RECTANGLE_16* active = nullptr;
+	RECTANGLE_16* output = nullptr;
+	UINT16* bounds = nullptr;
+	size_t outputCount = 0;
+	size_t outputCapacity = 0;
+
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(src);
+	WINPR_ASSERT(rects || (count == 0));
+
+	if (count == 0)
+		return region16_copy(dst, src);
+
+	const RECTANGLE_16* srcRects = region16_rects(src, &srcNbRects);
+	const size_t total = 1ull * srcNbRects + count;
+
+	input = calloc(total, sizeof(RECTANGLE_16));
+	bounds = calloc(2 * total, sizeof(UINT16));
+	active = calloc(total, sizeof(RECTANGLE_16));
+	if (!input || !bounds || !active)
+		goto fail;
+
+	size_t nbInput = 0;
+	for (size_t x = 0; x < srcNbRects; x++)
+		input[nbInput++] = srcRects[x];
+	for (size_t x = 0; x < count; x++)
+	{
+		if (!rectangle_is_empty(&rects[x]))
+			input[nbInput++] = rects[x];
+	}
+
+	RECTANGLE_16 extents = WINPR_C_ARRAY_INIT;
+	size_t nbBounds = 0;
+	for (size_t x = 0; x < nbInput; x++)
+	{
+		const RECTANGLE_16* cur = &input[x];
+		if (x == 0)
+			extents = *cur;
+		else
+		{
+			extents.left = MIN(extents.left, cur->left);
+			extents.top = MIN(extents.top, cur->top);
+			extents.right = MAX(extents.right, cur->right);
+			extents.bottom = MAX(extents.bottom, cur->bottom);
+		}
+		bounds[nbBounds++] = cur->top;
+		bounds[nbBounds++] = cur->bottom;
+	}
+
+	/* Sweep once from top to bottom: between two consecutive y boundaries the set of
+	 * covering rectangles does not change, so each interval is a band made of the merged
+	 * x spans of the active rectangles. Identical touching bands are merged afterwards. */
+	qsort(input, nbInput, sizeof(RECTANGLE_16), rectangle_compare_top);
+	qsort(bounds, nbBounds, sizeof(UINT16), uint16_compare);
+
+	size_t nbActive = 0;
+	size_t next = 0;
+	for (size_t x = 0; x + 1 < nbBounds; x++)
+	{
+		const UINT16 top = bounds[x];
+		const UINT16 bottom = bounds[x + 1];
+		if (top == bottom)
+			continue;
+
+		/* drop rectangles ending above the band */
+		size_t kept = 0;
+		for (size_t y = 0; y < nbActive; y++)
+		{
+			if (active[y].bottom > top)
+				active[kept++] = active[y];
+		}
+		nbActive = kept;
+
+		/* insert rectangles starting at the band, keeping the active list sorted by left */
+		while ((next < nbInput) && (input[next].top == top))
+		{
+			size_t pos = nbActive;
+			while ((pos > 0) && (active[pos - 1].left > input[next].left))
+			{
+				active[pos] = active[pos - 1];
+				pos--;
+			}
+			active[pos] = input[next++];
+			nbActive++;
+		}
+
+		if (nbActive == 0)
+			continue;
+
+		UINT16 left = active[0].left;
+		UINT16 right = active[0].right;
+		for (size_t y = 1; y < nbActive; y++)
+		{
+			/* items of a band must not touch */
+			if (active[y].left <= right)
+				right = MAX(right, active[y].right);
+			else
+			{
+				if (!region16_push_rect(&output, &outputCount, &outputCapacity, left, top, right,
+				                        bottom))
+					goto fail;
+				left = active[y].left;
+				right = active[y].right;
+			}
+		}
+		if (!region16_push_rect(&output, &outputCount, &outputCapacity, left, top, right, bottom))
+			goto fail;
+	}
+
+	rc = region16_assign_bands(dst, output, outputCount, &extents);
+	output = nullptr;
+
+fail:
+	free(output);
+	free(active);
+	free(bounds);
+	free(input);
+	return rc;
+}
+
 BOOL region16_intersects_rect(const REGION16* src, const RECTANGLE_16* arg2)
 {
 	const RECTANGLE_16* endPtr = nullptr;
@@ -952,3 +1153,175 @@ void region16_uninit(REGION16* region)
 	freeRegion(region->data);
 	region->data = nullptr;
 }
+
+struct S_REGION16_TILE_MAP
+{
+	UINT16 width;
+	UINT16 height;
+	UINT16 tileSize;
+	size_t tilesX;
+	size_t tilesY;
+	size_t wordsPerRow;
+	UINT64* bits;
+	size_t firstRow; /* dirty rows are in [firstRow, lastRow) */
+	size_t lastRow;
+};
+
+REGION16_TILE_MAP* region16_tile_map_new(UINT16 width, UINT16 height, UINT16 tileSize)
+{
+	if ((width == 0) || (height == 0) || (tileSize == 0))
+		return nullptr;
+
+	REGION16_TILE_MAP* map = calloc(1, sizeof(REGION16_TILE_MAP));
+	if (!map)
+		return nullptr;
+
+	map->width = width;
+	map->height = height;
+	map->tileSize = tileSize;
+	map->tilesX = (1ull * width + tileSize - 1) / tileSize;
+	map->tilesY = (1ull * height + tileSize - 1) / tileSize;
+	map->wordsPerRow = (map->tilesX + 63) / 64;
+	map->bits = calloc(map->wordsPerRow * map->tilesY, sizeof(UINT64));
+	if (!map->bits)
+	{
+		region16_tile_map_free(map);
+		return nullptr;
+	}
+	return map;
+}
+
+void region16_tile_map_free(REGION16_TILE_MAP* map)
+{
+	if (!map)
+		return;
+	free(map->bits);
+	free(map);
+}
+
+void region16_tile_map_clear(REGION16_TILE_MAP* map)
+{
+	WINPR_ASSERT(map);
+
+	if (map->firstRow < map->lastRow)
+	{
+		UINT64* row = &map->bits[map->firstRow * map->wordsPerRow];
+		memset(row, 0, (map->lastRow - map->firstRow) * map->wordsPerRow * sizeof(UINT64));
+	}
+	map->firstRow = 0;
+	map->lastRow = 0;
+}
+
+BOOL region16_tile_map_is_empty(const REGION16_TILE_MAP* map)
+{
+	WINPR_ASSERT(map);
+	return map->firstRow >= map->lastRow;
+}
+
+void region16_tile_map_mark(REGION16_TILE_MAP* map, const RECTANGLE_16* rect)
+{
+	WINPR_ASSERT(map);
+	WINPR_ASSERT(rect);
+
+	const UINT16 right = MIN(rect->right, map->width);
+	const UINT16 bottom = MIN(rect->bottom, map->height);
+	if ((rect->left >= right) || (rect->top >= bottom))
+		return;
+
+	const size_t x0 = rect->left / map->tileSize;
+	const size_t x1 = (right - 1u) / map->tileSize;
+	const size_t y0 = rect->top / map->tileSize;
+	const size_t y1 = (bottom - 1u) / map->tileSize;
+
+	if (map->firstRow >= map->lastRow)
+	{
+		map->firstRow = y0;
+		map->lastRow = y1 + 1;
+	}
+	else
+	{
+		map->firstRow = MIN(map->firstRow, y0);
+		map->lastRow = MAX(map->lastRow, y1 + 1);
+	}
+
+	const size_t w0 = x0 / 64;
+	const size_t w1 = x1 / 64;
+	const UINT64 first = UINT64_MAX << (x0 % 64);
+	const UINT64 last = UINT64_MAX >> (63 - (x1 % 64));
+
+	for (size_t y = y0; y <= y1; y++)
+	{
+		UINT64* row = &map->bits[y * map->wordsPerRow];
+		if (w0 == w1)
+			row[w0] |= first & last;
+		else
+		{
+			row[w0] |= first;
+			for (size_t w = w0 + 1; w < w1; w++)
+				row[w] = UINT64_MAX;
+			row[w1] |= last;
+		}
+	}
+}
+
+BOOL region16_tile_map_to_region(const REGION16_TILE_MAP* map, REGION16* dst)
+{
+	RECTANGLE_16* output = nullptr;
+	size_t count = 0;
+	size_t capacity = 0;
+	RECTANGLE_16 extents = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(map);
+	WINPR_ASSERT(dst);
+
+	/* every tile row is a band of maximal runs, so the result is already y-x banded and
+	 * only identical consecutive rows need to be merged */
+	for (size_t y = map->firstRow; y < map->lastRow; y++)
+	{
+		const UINT64* row = &map->bits[y * map->wordsPerRow];
+		const UINT16 top = WINPR_ASSERTING_INT_CAST(UINT16, y * map->tileSize);
+		const UINT16 bottom =
+		    WINPR_ASSERTING_INT_CAST(UINT16, MIN((y + 1) * map->tileSize, map->height));
+
+		size_t x = 0;
+		while (x < map->tilesX)
+		{
+			const UINT64 word = row[x / 64] >> (x % 64);
+			if (word == 0)
+			{
+				x = (x / 64 + 1) * 64;
+				continue;
+			}
+			if ((word & 1) == 0)
+			{
+				x++;
+				continue;
+			}
+
+			const size_t start = x;
+			while ((x < map->tilesX) && (row[x / 64] & (1ull << (x % 64))))
+				x++;
+
+			const UINT16 left = WINPR_ASSERTING_INT_CAST(UINT16, start * map->tileSize);
+			const UINT16 right =
+			    WINPR_ASSERTING_INT_CAST(UINT16, MIN(x * map->tileSize, map->width));
+			if (count == 0)
+			{
+				extents.left = left;
+				extents.top = top;
+				extents.right = right;
+			}
+			extents.left = MIN(extents.left, left);
+			extents.right = MAX(extents.right, right);
+			extents.bottom = bottom;
+
+			if (!region16_push_rect(&output, &count, &capacity, left, top, right, bottom))
+			{
+				free(output);
+				return FALSE;
+			}
+		}
+	}
+
+	return region16_assign_bands(dst, output, count, &extents);
+}
@@ -0,0 +1,69 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Region tile map
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_REGION_H
+#define FREERDP_LIB_CODEC_REGION_H
+
+#include <freerdp/api.h>
+#include <freerdp/codec/region.h>
+
+typedef struct S_REGION16_TILE_MAP REGION16_TILE_MAP;
+
+/** releases a tile map
+ * @param map the map to free, may be nullptr
+ */
+FREERDP_LOCAL void region16_tile_map_free(REGION16_TILE_MAP* map);
+
+/** allocates a damage map of \b width x \b height pixels tracked in tiles
+ *
+ * Marking a rectangle only sets bits, so damage can be accumulated at constant cost per
+ * tile row and converted to a region when needed. The resulting region covers whole
+ * tiles (clipped to the map size).
+ *
+ * @param width the width of the tracked area
+ * @param height the height of the tracked area
+ * @param tileSize the width and height of a tile in pixels
+ * @return the new map or nullptr in case of failure
+ */
+WINPR_ATTR_MALLOC(region16_tile_map_free, 1)
+FREERDP_LOCAL REGION16_TILE_MAP* region16_tile_map_new(UINT16 width, UINT16 height,
+                                                       UINT16 tileSize);
+
+/** marks all tiles touched by the rectangle as damaged
+ * @param map the tile map
+ * @param rect the rectangle, clipped to the map size
+ */
+FREERDP_LOCAL void region16_tile_map_mark(REGION16_TILE_MAP* map, const RECTANGLE_16* rect);
+
+/** resets all tiles of the map to undamaged
+ * @param map the tile map
+ */
+FREERDP_LOCAL void region16_tile_map_clear(REGION16_TILE_MAP* map);
+
+/** @return if no tile of the map is damaged */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL region16_tile_map_is_empty(const REGION16_TILE_MAP* map);
+
+/** replaces the content of \b dst with the damaged tiles of the map
+ * @param map the tile map
+ * @param dst destination region
+ * @return if the operation was successful (false meaning out-of-memory)
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL region16_tile_map_to_region(const REGION16_TILE_MAP* map, REGION16* dst);
+
+#endif /* FREERDP_LIB_CODEC_REGION_H */
@@ -31,6 +31,7 @@
 #include <winpr/tchar.h>
 #include <winpr/sysinfo.h>
 #include <winpr/registry.h>
+#include <winpr/interlocked.h>
 
 #include <freerdp/log.h>
 #include <freerdp/settings.h>
@@ -47,9 +48,11 @@
 #include "rfx_quantization.h"
 #include "rfx_dwt.h"
 #include "rfx_rlgr.h"
+#include "rfx.h"
 #include "../core/utils.h"
 
 #include "sse/rfx_sse2.h"
+#include "sse/rfx_avx2.h"
 #include "neon/rfx_neon.h"
 
 #define TAG FREERDP_TAG("codec")
@@ -199,6 +202,118 @@ static inline void rfx_encoder_tile_free(void* obj)
 	winpr_aligned_free(obj);
 }
 
+static void rfx_process_tile_batch(RFX_TILE_BATCH* WINPR_RESTRICT batch)
+{
+	WINPR_ASSERT(batch);
+	WINPR_ASSERT(batch->context);
+	WINPR_ASSERT(batch->rangeSize > 0);
+
+	RFX_CONTEXT* context = batch->context;
+	const LONG rangeSize = WINPR_ASSERTING_INT_CAST(LONG, batch->rangeSize);
+
+	for (;;)
+	{
+		const LONG start = InterlockedExchangeAdd(&batch->nextTile, rangeSize);
+		if ((start < 0) || ((UINT32)start >= batch->numTiles))
+			break;
+
+		const UINT32 end = MIN((UINT32)start + batch->rangeSize, batch->numTiles);
+
+		for (UINT32 i = (UINT32)start; i < end; i++)
+		{
+			RFX_TILE* tile = batch->tiles[i];
+			BOOL rc = 0;
+
+			if (batch->encode)
+				rc = rfx_encode_rgb(context, tile);
+			else
+				rc = rfx_decode_rgb(context, tile, tile->data, 64 * 4);
+
+			if (!rc)
+			{
+				WLog_Print(context->priv->log, WLOG_ERROR, "%s failed for tile %" PRIu32,
+				           batch->encode ? "rfx_encode_rgb" : "rfx_decode_rgb", i);
+				(void)InterlockedIncrement(&batch->failed);
+			}
+		}
+	}
+}
+
+static void CALLBACK
+rfx_process_tile_batch_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
+                                     void* context, WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	rfx_process_tile_batch((RFX_TILE_BATCH*)context);
+}
+
+/**
+ * Encode or decode the tiles of a message. With threads the persistent TileWork of the context is
+ * submitted once per extra worker, the tiles are handed out in ranges to it and the calling
+ * thread, so no work objects are created per frame or per tile.
+ */
+static BOOL rfx_process_tiles(RFX_CONTEXT* WINPR_RESTRICT context, RFX_TILE** tiles,
+                              UINT32 numTiles, BOOL encode)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->priv);
+	WINPR_ASSERT(tiles || (numTiles == 0));
+
+	RFX_CONTEXT_PRIV* priv = context->priv;
+	RFX_TILE_BATCH* batch = &priv->TileBatch;
+	const UINT32 threads = priv->TileWork ? priv->WorkerCount + 1 : 1;
+
+	batch->context = context;
+	batch->tiles = tiles;
+	batch->numTiles = numTiles;
+	batch->encode = encode;
+	batch->nextTile = 0;
+	batch->failed = 0;
+
+	/* A few ranges per thread even out tiles of different cost */
+	batch->rangeSize = MAX(1, numTiles / (threads * 4));
+
+	const UINT32 ranges = (numTiles + batch->rangeSize - 1) / batch->rangeSize;
+	const UINT32 submit = MIN(threads, ranges) - (ranges > 0 ? 1 : 0);
+
+	for (UINT32 i = 0; i < submit; i++)
+		SubmitThreadpoolWork(priv->TileWork);
+
+	rfx_process_tile_batch(batch);
+
+	if (submit > 0)
+		WaitForThreadpoolWorkCallbacks(priv->TileWork, FALSE);
+
+	return batch->failed == 0;
+}
+
+BOOL rfx_context_set_worker_count(RFX_CONTEXT* WINPR_RESTRICT context, UINT32 count)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->priv);
+
+	RFX_CONTEXT_PRIV* priv = context->priv;
+
+	if (!priv->UseThreads)
+		return FALSE;
+
+	if (priv->TileWork)
+		CloseThreadpoolWork(priv->TileWork);
+	priv->TileWork = nullptr;
+	priv->WorkerCount = count;
+
+	if (count == 0)
+		return TRUE;
+
+	priv->TileWork =
+	    CreateThreadpoolWork(rfx_process_tile_batch_work_callback, &priv->TileBatch, nullptr);
+	if (!priv->TileWork)
+	{
+		priv->WorkerCount = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
 RFX_CONTEXT* rfx_context_new(BOOL encoder)
 {
 	return rfx_context_new_ex(encoder, 0);
@@ -294,6 +409,13 @@ RFX_CONTEXT* rfx_context_new_ex(BOOL encoder, UINT32 ThreadingFlags)
 		/* before any decoding threads are started */
 		if (!primitives_get())
 			goto fail;
+
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+		GetNativeSystemInfo(&sysInfos);
+
+		/* The calling thread processes tiles as well */
+		if (!rfx_context_set_worker_count(context, MAX(1, sysInfos.dwNumberOfProcessors) - 1))
+			goto fail;
 	}
 
 	/* initialize the default pixel format */
@@ -304,12 +426,16 @@ RFX_CONTEXT* rfx_context_new_ex(BOOL encoder, UINT32 ThreadingFlags)
 	context->quantization_decode = rfx_quantization_decode;
 	context->quantization_encode = rfx_quantization_encode;
 	context->dwt_2d_decode = rfx_dwt_2d_decode;
+	context->quantization_dwt_2d_decode = nullptr;
 	context->dwt_2d_extrapolate_decode = rfx_dwt_2d_extrapolate_decode;
 	context->dwt_2d_encode = rfx_dwt_2d_encode;
 	context->rlgr_decode = rfx_rlgr_decode;
 	context->rlgr_encode = rfx_rlgr_encode;
 	rfx_init_sse2(context);
 	rfx_init_neon(context);
+#if defined(WITH_AVX2)
+	rfx_init_avx2(context);
+#endif
 	context->state = RFX_STATE_SEND_HEADERS;
 	context->expectedDataBlockType = WBT_FRAME_BEGIN;
 	return context;
@@ -343,11 +469,12 @@ void rfx_context_free(RFX_CONTEXT* context)
 
 	if (priv)
 	{
+		if (priv->TileWork)
+			CloseThreadpoolWork(priv->TileWork);
+
 		ObjectPool_Free(priv->TilePool);
 		if (priv->UseThreads)
 		{
-			winpr_aligned_free((void*)priv->workObjects);
-			winpr_aligned_free(priv->tileWorkParams);
 #ifdef WITH_PROFILER
 			WLog_VRB(
 			    TAG,
@@ -767,25 +894,6 @@ static inline BOOL rfx_process_message_region(RFX_CONTEXT* WINPR_RESTRICT contex
 	return TRUE;
 }
 
-typedef struct
-{
-	RFX_TILE* tile;
-	RFX_CONTEXT* context;
-} RFX_TILE_PROCESS_WORK_PARAM;
-
-static inline void CALLBACK
-rfx_process_message_tile_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
-                                       void* context, WINPR_ATTR_UNUSED PTP_WORK work)
-{
-	RFX_TILE_PROCESS_WORK_PARAM* param = (RFX_TILE_PROCESS_WORK_PARAM*)context;
-	WINPR_ASSERT(param);
-	WINPR_ASSERT(param->context);
-	WINPR_ASSERT(param->context->priv);
-
-	if (!rfx_decode_rgb(param->context, param->tile, param->tile->data, 64 * 4))
-		WLog_Print(param->context->priv->log, WLOG_ERROR, "rfx_decode_rgb failed");
-}
-
 static inline BOOL rfx_allocate_tiles(RFX_MESSAGE* WINPR_RESTRICT message, size_t count,
                                       BOOL allocOnly)
 {
@@ -814,7 +922,6 @@ static inline BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
                                                UINT16* WINPR_RESTRICT pExpectedBlockType)
 {
 	BOOL rc = 0;
-	size_t close_cnt = 0;
 	BYTE quant = 0;
 	RFX_TILE* tile = nullptr;
 	UINT32* quants = nullptr;
@@ -823,8 +930,6 @@ static inline BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
 	UINT32 blockLen = 0;
 	UINT32 blockType = 0;
 	UINT32 tilesDataSize = 0;
-	PTP_WORK* work_objects = nullptr;
-	RFX_TILE_PROCESS_WORK_PARAM* params = nullptr;
 	void* pmem = nullptr;
 
 	WINPR_ASSERT(context);
@@ -918,27 +1023,7 @@ static inline BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
 	if (!rfx_allocate_tiles(message, numTiles, FALSE))
 		return FALSE;
 
-	if (context->priv->UseThreads)
-	{
-		work_objects = (PTP_WORK*)winpr_aligned_calloc(message->numTiles, sizeof(PTP_WORK), 32);
-		params = (RFX_TILE_PROCESS_WORK_PARAM*)winpr_aligned_recalloc(
-		    nullptr, message->numTiles, sizeof(RFX_TILE_PROCESS_WORK_PARAM), 32);
-
-		if (!work_objects)
-		{
-			winpr_aligned_free(params);
-			return FALSE;
-		}
-
-		if (!params)
-		{
-			winpr_aligned_free((void*)work_objects);
-			return FALSE;
-		}
-	}
-
 	/* tiles */
-	close_cnt = 0;
 	rc = FALSE;
 
 	if (Stream_GetRemainingLength(s) >= tilesDataSize)
@@ -1052,51 +1137,11 @@ static inline BOOL rfx_process_message_tileset(RFX_CONTEXT* WINPR_RESTRICT conte
 			}
 			tile->x = tile->xIdx * 64;
 			tile->y = tile->yIdx * 64;
-
-			if (context->priv->UseThreads)
-			{
-				if (!params)
-				{
-					rc = FALSE;
-					break;
-				}
-
-				params[i].context = context;
-				params[i].tile = message->tiles[i];
-
-				if (!(work_objects[i] = CreateThreadpoolWork(rfx_process_message_tile_work_callback,
-				                                             (void*)&params[i], nullptr)))
-				{
-					WLog_Print(context->priv->log, WLOG_ERROR, "CreateThreadpoolWork failed.");
-					rc = FALSE;
-					break;
-				}
-
-				SubmitThreadpoolWork(work_objects[i]);
-				close_cnt = i + 1;
-			}
-			else
-			{
-				if (!rfx_decode_rgb(context, tile, tile->data, 64 * 4))
-				{
-					rc = FALSE;
-					break;
-				}
-			}
 		}
 	}
 
-	if (context->priv->UseThreads)
-	{
-		for (size_t i = 0; i < close_cnt; i++)
-		{
-			WaitForThreadpoolWorkCallbacks(work_objects[i], FALSE);
-			CloseThreadpoolWork(work_objects[i]);
-		}
-	}
-
-	winpr_aligned_free((void*)work_objects);
-	winpr_aligned_free(params);
+	if (rc)
+		rc = rfx_process_tiles(context, message->tiles, message->numTiles, FALSE);
 
 	for (size_t i = 0; i < message->numTiles; i++)
 	{
@@ -1577,25 +1622,6 @@ static inline BOOL rfx_write_tile(wStream* WINPR_RESTRICT s, const RFX_TILE* WIN
 	return TRUE;
 }
 
-struct S_RFX_TILE_COMPOSE_WORK_PARAM
-{
-	RFX_TILE* tile;
-	RFX_CONTEXT* context;
-};
-
-static inline void CALLBACK
-rfx_compose_message_tile_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
-                                       void* context, WINPR_ATTR_UNUSED PTP_WORK work)
-{
-	RFX_TILE_COMPOSE_WORK_PARAM* param = (RFX_TILE_COMPOSE_WORK_PARAM*)context;
-	WINPR_ASSERT(param);
-	WINPR_ASSERT(param->context);
-	WINPR_ASSERT(param->context->priv);
-
-	if (!rfx_encode_rgb(param->context, param->tile))
-		WLog_Print(param->context->priv->log, WLOG_ERROR, "rfx_encode_rgb failed");
-}
-
 static inline BOOL computeRegion(const RFX_RECT* WINPR_RESTRICT rects, size_t numRects,
                                  REGION16* WINPR_RESTRICT region, size_t width, size_t height)
 {
@@ -1621,31 +1647,6 @@ static inline BOOL computeRegion(const RFX_RECT* WINPR_RESTRICT rects, size_t nu
 
 #define TILE_NO(v) ((v) / 64)
 
-static inline BOOL setupWorkers(RFX_CONTEXT* WINPR_RESTRICT context, size_t nbTiles)
-{
-	WINPR_ASSERT(context);
-
-	RFX_CONTEXT_PRIV* priv = context->priv;
-	WINPR_ASSERT(priv);
-
-	void* pmem = nullptr;
-
-	if (!context->priv->UseThreads)
-		return TRUE;
-
-	if (!(pmem = winpr_aligned_recalloc((void*)priv->workObjects, nbTiles, sizeof(PTP_WORK), 32)))
-		return FALSE;
-
-	priv->workObjects = (PTP_WORK*)pmem;
-
-	if (!(pmem = winpr_aligned_recalloc(priv->tileWorkParams, nbTiles,
-	                                    sizeof(RFX_TILE_COMPOSE_WORK_PARAM), 32)))
-		return FALSE;
-
-	priv->tileWorkParams = (RFX_TILE_COMPOSE_WORK_PARAM*)pmem;
-	return TRUE;
-}
-
 static inline BOOL rfx_ensure_tiles(RFX_MESSAGE* WINPR_RESTRICT message, size_t count)
 {
 	WINPR_ASSERT(message);
@@ -1665,8 +1666,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* WINPR_RESTRICT context,
 	const UINT32 height = h;
 	const UINT32 scanline = (UINT32)s;
 	RFX_MESSAGE* message = nullptr;
-	PTP_WORK* workObject = nullptr;
-	RFX_TILE_COMPOSE_WORK_PARAM* workParam = nullptr;
 	BOOL success = FALSE;
 	REGION16 rectsRegion = WINPR_C_ARRAY_INIT;
 	REGION16 tilesRegion = WINPR_C_ARRAY_INIT;
@@ -1725,15 +1724,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* WINPR_RESTRICT context,
 
 			if (!rfx_ensure_tiles(message, maxNbTiles))
 				goto skip_encoding_loop;
-
-			if (!setupWorkers(context, maxNbTiles))
-				goto skip_encoding_loop;
-		}
-
-		if (context->priv->UseThreads)
-		{
-			workObject = context->priv->workObjects;
-			workParam = context->priv->tileWorkParams;
 		}
 
 		{
@@ -1833,28 +1823,6 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* WINPR_RESTRICT context,
 							goto skip_encoding_loop;
 						message->tiles[message->numTiles++] = tile;
 
-						if (context->priv->UseThreads)
-						{
-							workParam->context = context;
-							workParam->tile = tile;
-
-							if (!(*workObject =
-							          CreateThreadpoolWork(rfx_compose_message_tile_work_callback,
-							                               (void*)workParam, nullptr)))
-							{
-								goto skip_encoding_loop;
-							}
-
-							SubmitThreadpoolWork(*workObject);
-							workObject++;
-							workParam++;
-						}
-						else
-						{
-							if (!rfx_encode_rgb(context, tile))
-								goto skip_encoding_loop;
-						}
-
 						if (!region16_union_rect(&tilesRegion, &tilesRegion, &currentTileRect))
 							goto skip_encoding_loop;
 					} /* xIdx */
@@ -1863,28 +1831,15 @@ RFX_MESSAGE* rfx_encode_message(RFX_CONTEXT* WINPR_RESTRICT context,
 		}
 	}
 
-	success = TRUE;
+	success = rfx_process_tiles(context, message->tiles, message->numTiles, TRUE);
 skip_encoding_loop:
 
-	/* when using threads ensure all computations are done */
 	if (success)
 	{
 		message->tilesDataSize = 0;
-		workObject = context->priv->workObjects;
 
 		for (UINT32 i = 0; i < message->numTiles; i++)
 		{
-			if (context->priv->UseThreads)
-			{
-				if (*workObject)
-				{
-					WaitForThreadpoolWorkCallbacks(*workObject, FALSE);
-					CloseThreadpoolWork(*workObject);
-				}
-
-				workObject++;
-			}
-
 			const RFX_TILE* tile = message->tiles[i];
 			const size_t tlen = rfx_tile_length(tile);
 			message->tilesDataSize += WINPR_ASSERTING_INT_CAST(uint32_t, tlen);
@@ -2506,3 +2461,25 @@ BOOL rfx_write_message_progressive_simple(RFX_CONTEXT* WINPR_RESTRICT rfx,
 
 	return TRUE;
 }
+
+size_t rfx_context_memory_usage(RFX_CONTEXT* context)
+{
+	if (!context)
+		return 0;
+
+	WINPR_ASSERT(context->priv);
+
+	/* Decoder tiles carry their 64x64 pixels, encoder tiles point into the caller buffers */
+	const size_t tileSize = sizeof(RFX_TILE) + (context->encoder ? 0 : 4ull * 64ull * 64ull);
+	const struct S_RFX_MESSAGE* message = &context->currentMessage;
+	const SSIZE_T buffers = BufferPool_GetPoolSize(context->priv->BufferPool);
+
+	size_t size = sizeof(RFX_CONTEXT) + sizeof(RFX_CONTEXT_PRIV);
+	size += 1ull * context->numQuant * NR_QUANT_VALUES * sizeof(UINT32);
+	size += 1ull * message->numRects * sizeof(RFX_RECT);
+	size += message->allocatedTiles * sizeof(RFX_TILE*) + 1ull * message->numTiles * tileSize;
+	size += ObjectPool_GetPoolSize(context->priv->TilePool) * tileSize;
+	if (buffers > 0)
+		size += (size_t)buffers * (8192ull + 32ull) * 3ull;
+	return size;
+}
@@ -39,11 +39,10 @@ WINPR_ATTR_NODISCARD
 static inline BOOL rfx_decode_component(RFX_CONTEXT* WINPR_RESTRICT context,
                                         const UINT32* WINPR_RESTRICT quantization_values,
                                         size_t nrQuantValues, const BYTE* WINPR_RESTRICT data,
-                                        size_t size, INT16* WINPR_RESTRICT buffer)
+                                        size_t size, INT16* WINPR_RESTRICT buffer,
+                                        INT16* WINPR_RESTRICT dwt_buffer)
 {
 	BOOL res = FALSE;
-	INT16* dwt_buffer = BufferPool_Take(context->priv->BufferPool, -1); /* dwt_buffer */
-	WINPR_ASSERT(dwt_buffer);
 
 	PROFILER_ENTER(context->priv->prof_rfx_decode_component)
 	PROFILER_ENTER(context->priv->prof_rfx_rlgr_decode)
@@ -51,6 +50,7 @@ static inline BOOL rfx_decode_component(RFX_CONTEXT* WINPR_RESTRICT context,
 
 	{
 		const int rc = context->rlgr_decode(context->mode, data, (UINT32)size, buffer, 4096);
+		PROFILER_EXIT(context->priv->prof_rfx_rlgr_decode)
 		if (rc < 0)
 		{
 			WLog_Print(context->priv->log, WLOG_ERROR, "context->rlgr_decode failed: %d", rc);
@@ -58,28 +58,43 @@ static inline BOOL rfx_decode_component(RFX_CONTEXT* WINPR_RESTRICT context,
 		}
 	}
 
-	PROFILER_EXIT(context->priv->prof_rfx_rlgr_decode)
 	PROFILER_ENTER(context->priv->prof_rfx_differential_decode)
 	rfx_differential_decode(buffer + 4032, 64);
 	PROFILER_EXIT(context->priv->prof_rfx_differential_decode)
-	PROFILER_ENTER(context->priv->prof_rfx_quantization_decode)
-	if (!context->quantization_decode(buffer, quantization_values, nrQuantValues))
-		goto fail;
-	PROFILER_EXIT(context->priv->prof_rfx_quantization_decode)
-	PROFILER_ENTER(context->priv->prof_rfx_dwt_2d_decode)
-	context->dwt_2d_decode(buffer, dwt_buffer);
-	PROFILER_EXIT(context->priv->prof_rfx_dwt_2d_decode)
-	PROFILER_EXIT(context->priv->prof_rfx_decode_component)
+
+	if (context->quantization_dwt_2d_decode)
+	{
+		PROFILER_ENTER(context->priv->prof_rfx_dwt_2d_decode)
+		const BOOL rc = context->quantization_dwt_2d_decode(buffer, quantization_values,
+		                                                    nrQuantValues, dwt_buffer);
+		PROFILER_EXIT(context->priv->prof_rfx_dwt_2d_decode)
+		if (!rc)
+			goto fail;
+	}
+	else
+	{
+		PROFILER_ENTER(context->priv->prof_rfx_quantization_decode)
+		const BOOL rc = context->quantization_decode(buffer, quantization_values, nrQuantValues);
+		PROFILER_EXIT(context->priv->prof_rfx_quantization_decode)
+		if (!rc)
+			goto fail;
+
+		PROFILER_ENTER(context->priv->prof_rfx_dwt_2d_decode)
+		context->dwt_2d_decode(buffer, dwt_buffer);
+		PROFILER_EXIT(context->priv->prof_rfx_dwt_2d_decode)
+	}
 
 	res = TRUE;
 fail:
-	BufferPool_Return(context->priv->BufferPool, dwt_buffer);
+	PROFILER_EXIT(context->priv->prof_rfx_decode_component)
 	return res;
 }
 
 /* rfx_decode_ycbcr_to_rgb code now resides in the primitives library. */
 
-/* stride is bytes between rows in the output buffer. */
+/* The three components share one DWT scratch buffer and the colour conversion writes straight
+ * to rgb_buffer, so the whole tile is decoded out of two pool buffers that stay in cache.
+ * stride is bytes between rows in the output buffer. */
 BOOL rfx_decode_rgb(RFX_CONTEXT* WINPR_RESTRICT context, const RFX_TILE* WINPR_RESTRICT tile,
                     BYTE* WINPR_RESTRICT rgb_buffer, UINT32 stride)
 {
@@ -90,6 +105,7 @@ BOOL rfx_decode_rgb(RFX_CONTEXT* WINPR_RESTRICT context, const RFX_TILE* WINPR_R
 	} cnv;
 	BOOL rc = FALSE;
 	BYTE* pBuffer = nullptr;
+	INT16* dwt_buffer = nullptr;
 	INT16* pSrcDst[3];
 	UINT32* y_quants = nullptr;
 	UINT32* cb_quants = nullptr;
@@ -101,30 +117,38 @@ BOOL rfx_decode_rgb(RFX_CONTEXT* WINPR_RESTRICT context, const RFX_TILE* WINPR_R
 	cb_quants = context->quants + (NR_QUANT_VALUES * tile->quantIdxCb);
 	cr_quants = context->quants + (NR_QUANT_VALUES * tile->quantIdxCr);
 	pBuffer = (BYTE*)BufferPool_Take(context->priv->BufferPool, -1);
+	dwt_buffer = (INT16*)BufferPool_Take(context->priv->BufferPool, -1);
+	if (!pBuffer || !dwt_buffer)
+		goto fail;
 	pSrcDst[0] = (INT16*)((&pBuffer[((8192ULL + 32ULL) * 0ULL) + 16ULL]));        /* y_r_buffer */
 	pSrcDst[1] = (INT16*)((&pBuffer[((8192ULL + 32ULL) * 1ULL) + 16ULL]));        /* cb_g_buffer */
 	pSrcDst[2] = (INT16*)((&pBuffer[((8192ULL + 32ULL) * 2ULL) + 16ULL]));        /* cr_b_buffer */
 	if (!rfx_decode_component(context, y_quants, NR_QUANT_VALUES, tile->YData, tile->YLen,
-	                          pSrcDst[0])) /* YData */
+	                          pSrcDst[0], dwt_buffer)) /* YData */
 		goto fail;
 	if (!rfx_decode_component(context, cb_quants, NR_QUANT_VALUES, tile->CbData, tile->CbLen,
-	                          pSrcDst[1])) /* CbData */
+	                          pSrcDst[1], dwt_buffer)) /* CbData */
 		goto fail;
 	if (!rfx_decode_component(context, cr_quants, NR_QUANT_VALUES, tile->CrData, tile->CrLen,
-	                          pSrcDst[2])) /* CrData */
+	                          pSrcDst[2], dwt_buffer)) /* CrData */
 		goto fail;
 	PROFILER_ENTER(context->priv->prof_rfx_ycbcr_to_rgb)
 
 	cnv.pv = pSrcDst;
-	if (prims->yCbCrToRGB_16s8u_P3AC4R(cnv.cpv, 64 * sizeof(INT16), rgb_buffer, stride,
-	                                   context->pixel_format, &roi_64x64) != PRIMITIVES_SUCCESS)
-		goto fail;
-
-	PROFILER_EXIT(context->priv->prof_rfx_ycbcr_to_rgb)
-	PROFILER_EXIT(context->priv->prof_rfx_decode_rgb)
+	{
+		const pstatus_t status = prims->yCbCrToRGB_16s8u_P3AC4R(
+		    cnv.cpv, 64 * sizeof(INT16), rgb_buffer, stride, context->pixel_format, &roi_64x64);
+		PROFILER_EXIT(context->priv->prof_rfx_ycbcr_to_rgb)
+		if (status != PRIMITIVES_SUCCESS)
+			goto fail;
+	}
 
 	rc = TRUE;
 fail:
-	BufferPool_Return(context->priv->BufferPool, pBuffer);
+	PROFILER_EXIT(context->priv->prof_rfx_decode_rgb)
+	if (dwt_buffer)
+		BufferPool_Return(context->priv->BufferPool, dwt_buffer);
+	if (pBuffer)
+		BufferPool_Return(context->priv->BufferPool, pBuffer);
 	return rc;
 }
@@ -57,7 +57,18 @@ typedef enum
 	RFX_STATE_FINAL
 } RFX_STATE;
 
-typedef struct S_RFX_TILE_COMPOSE_WORK_PARAM RFX_TILE_COMPOSE_WORK_PARAM;
+/* Tiles of a message processed by the calling thread and WorkerCount threadpool callbacks.
+ * Each of them takes rangeSize tiles at a time until none are left. */
+typedef struct
+{
+	RFX_CONTEXT* context;
+	RFX_TILE** tiles;
+	UINT32 numTiles;
+	UINT32 rangeSize;
+	BOOL encode;
+	LONG volatile nextTile;
+	LONG volatile failed;
+} RFX_TILE_BATCH;
 
 typedef struct S_RFX_CONTEXT_PRIV RFX_CONTEXT_PRIV;
 struct S_RFX_CONTEXT_PRIV
@@ -66,8 +77,9 @@ struct S_RFX_CONTEXT_PRIV
 	wObjectPool* TilePool;
 
 	BOOL UseThreads;
-	PTP_WORK* workObjects;
-	RFX_TILE_COMPOSE_WORK_PARAM* tileWorkParams;
+	UINT32 WorkerCount;
+	PTP_WORK TileWork;
+	RFX_TILE_BATCH TileBatch;
 
 	wBufferPool* BufferPool;
 
@@ -170,6 +182,11 @@ struct S_RFX_CONTEXT
 	                            size_t nrQuantValues);
 
 	void (*dwt_2d_decode)(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer);
+	/* quantization_decode and dwt_2d_decode in one pass, optional */
+	WINPR_ATTR_NODISCARD
+	BOOL (*quantization_dwt_2d_decode)(INT16* WINPR_RESTRICT buffer,
+	                                   const UINT32* WINPR_RESTRICT quantization_values,
+	                                   size_t nrQuantValues, INT16* WINPR_RESTRICT dwt_buffer);
 	void (*dwt_2d_extrapolate_decode)(INT16* WINPR_RESTRICT src, INT16* WINPR_RESTRICT temp);
 	void (*dwt_2d_encode)(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer);
 	WINPR_ATTR_NODISCARD int (*rlgr_decode)(RLGR_MODE mode, const BYTE* WINPR_RESTRICT data,
@@ -183,4 +200,10 @@ struct S_RFX_CONTEXT
 	RFX_CONTEXT_PRIV* priv;
 };
 
+/** Set the number of threadpool callbacks that process tiles next to the calling thread.
+ *  Fails if the context was created without threads. */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL rfx_context_set_worker_count(RFX_CONTEXT* WINPR_RESTRICT context,
+                                                UINT32 count);
+
 #endif /* FREERDP_LIB_CODEC_RFX_TYPES_H */
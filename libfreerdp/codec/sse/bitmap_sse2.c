@@ -0,0 +1,93 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Interleaved RLE Bitmap Encoder - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "bitmap_sse2.h"
+
+#include "../../core/simd.h"
+#include "../../primitives/sse/prim_avxsse.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+static inline __m128i bitmap_classify_sse2(const UINT32* WINPR_RESTRICT line,
+                                           const UINT32* WINPR_RESTRICT prev, __m128i mix,
+                                           size_t x)
+{
+	const __m128i pixel = LOAD_SI128(&line[x]);
+	const __m128i above = LOAD_SI128(&prev[x]);
+	const __m128i fill = _mm_cmpeq_epi32(pixel, above);
+	const __m128i fgbg = _mm_cmpeq_epi32(pixel, _mm_xor_si128(above, mix));
+	const __m128i color = _mm_cmpeq_epi32(pixel, LOAD_SI128(&line[x - 1]));
+	const __m128i bicolor = _mm_cmpeq_epi32(pixel, LOAD_SI128(&line[x - 2]));
+
+	const __m128i c0 = _mm_or_si128(_mm_and_si128(fill, _mm_set1_epi32(BITMAP_CLASS_FILL)),
+	                                _mm_and_si128(fgbg, _mm_set1_epi32(BITMAP_CLASS_MIX)));
+	const __m128i c1 = _mm_or_si128(_mm_and_si128(color, _mm_set1_epi32(BITMAP_CLASS_COLOR)),
+	                                _mm_and_si128(bicolor, _mm_set1_epi32(BITMAP_CLASS_BICOLOR)));
+	return _mm_or_si128(c0, c1);
+}
+
+static void bitmap_classify_line_sse2(const UINT32* WINPR_RESTRICT line,
+                                      const UINT32* WINPR_RESTRICT prev, UINT32 mix,
+                                      BYTE* WINPR_RESTRICT classes, size_t width)
+{
+	const __m128i vmix = _mm_set1_epi32((int)mix);
+	size_t x = 2;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i c0 = _mm_packs_epi32(bitmap_classify_sse2(line, prev, vmix, x),
+		                                   bitmap_classify_sse2(line, prev, vmix, x + 4));
+		const __m128i c1 = _mm_packs_epi32(bitmap_classify_sse2(line, prev, vmix, x + 8),
+		                                   bitmap_classify_sse2(line, prev, vmix, x + 12));
+		STORE_SI128(&classes[x], _mm_packus_epi16(c0, c1));
+	}
+
+	bitmap_classify_line_generic(line, prev, mix, classes, x, width);
+}
+
+static size_t bitmap_scan_class_sse2(const BYTE* WINPR_RESTRICT in, size_t max, BYTE value)
+{
+	const __m128i v = _mm_set1_epi8((char)value);
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(LOAD_SI128(&in[x]), v)) != 0xFFFF)
+			break;
+	}
+
+	return x + bitmap_scan_class_generic(&in[x], max - x, value);
+}
+#endif
+
+void bitmap_encode_init_sse2_int(BITMAP_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2/SSE3 optimizations");
+	fn->classify_line = bitmap_classify_line_sse2;
+	fn->scan_class = bitmap_scan_class_sse2;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
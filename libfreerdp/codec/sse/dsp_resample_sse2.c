@@ -0,0 +1,111 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - SSE2 resampler and channel mixer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "dsp_resample_sse2.h"
+
+#include "../../core/simd.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+static void dsp_resample_filter_sse2(const INT16* WINPR_RESTRICT src,
+                                     const INT16* WINPR_RESTRICT coeffs, size_t taps,
+                                     const UINT32* WINPR_RESTRICT offsets,
+                                     const UINT32* WINPR_RESTRICT phases, size_t count,
+                                     INT16* WINPR_RESTRICT dst, size_t dstStep)
+{
+	const __m128i round = _mm_set1_epi32(1 << (DSP_RESAMPLE_COEFF_BITS - 1));
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const __m128i* s = (const __m128i*)&src[offsets[x]];
+		const __m128i* c = (const __m128i*)&coeffs[phases[x] * taps];
+		__m128i acc = _mm_setzero_si128();
+
+		for (size_t k = 0; k < taps / 8; k++)
+		{
+			const __m128i sv = _mm_loadu_si128(&s[k]);
+			const __m128i cv = _mm_load_si128(&c[k]);
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(sv, cv));
+		}
+
+		/* horizontal sum of the 4 partial sums */
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+		acc = _mm_srai_epi32(_mm_add_epi32(acc, round), DSP_RESAMPLE_COEFF_BITS);
+		acc = _mm_packs_epi32(acc, acc);
+		dst[x * dstStep] = (INT16)_mm_cvtsi128_si32(acc);
+	}
+}
+
+static void dsp_mix_mono_to_stereo_sse2(const INT16* WINPR_RESTRICT src,
+                                        INT16* WINPR_RESTRICT dst, size_t frames)
+{
+	size_t x = 0;
+	for (; x + 8 <= frames; x += 8)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+		_mm_storeu_si128((__m128i*)&dst[2 * x], _mm_unpacklo_epi16(v, v));
+		_mm_storeu_si128((__m128i*)&dst[2 * x + 8], _mm_unpackhi_epi16(v, v));
+	}
+
+	for (; x < frames; x++)
+	{
+		dst[2 * x] = src[x];
+		dst[2 * x + 1] = src[x];
+	}
+}
+
+static void dsp_mix_stereo_to_mono_sse2(const INT16* WINPR_RESTRICT src,
+                                        INT16* WINPR_RESTRICT dst, size_t frames)
+{
+	const __m128i one = _mm_set1_epi16(1);
+
+	size_t x = 0;
+	for (; x + 8 <= frames; x += 8)
+	{
+		const __m128i lo = _mm_loadu_si128((const __m128i*)&src[2 * x]);
+		const __m128i hi = _mm_loadu_si128((const __m128i*)&src[2 * x + 8]);
+		const __m128i slo = _mm_srai_epi32(_mm_madd_epi16(lo, one), 1);
+		const __m128i shi = _mm_srai_epi32(_mm_madd_epi16(hi, one), 1);
+		_mm_storeu_si128((__m128i*)&dst[x], _mm_packs_epi32(slo, shi));
+	}
+
+	for (; x < frames; x++)
+	{
+		const INT32 sum = src[2 * x] + src[2 * x + 1];
+		dst[x] = (INT16)(sum >> 1);
+	}
+}
+#endif
+
+void dsp_resample_init_sse2_int(FREERDP_DSP_RESAMPLE_PRIMITIVES* WINPR_RESTRICT prims)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2 optimizations");
+	prims->filter = dsp_resample_filter_sse2;
+	prims->mono_to_stereo = dsp_mix_mono_to_stereo_sse2;
+	prims->stereo_to_mono = dsp_mix_stereo_to_mono_sse2;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
@@ -0,0 +1,64 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * NCrush (RDP6) Bulk Data Compression - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "ncrush_sse2.h"
+
+#include "../../core/simd.h"
+#include "../../primitives/sse/prim_avxsse.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+static size_t ncrush_match_length_sse2(const BYTE* match, const BYTE* data, size_t max)
+{
+	size_t length = 0;
+
+	for (; length + 16 <= max; length += 16)
+	{
+		const __m128i a = LOAD_SI128(&match[length]);
+		const __m128i b = LOAD_SI128(&data[length]);
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+
+		if (mask != 0xFFFF)
+		{
+			for (size_t i = 0; i < 16; i++)
+			{
+				if ((mask & (1 << i)) == 0)
+					return length + i;
+			}
+		}
+	}
+
+	return length + ncrush_match_length_generic(&match[length], &data[length], max - length);
+}
+#endif
+
+void ncrush_encode_init_sse2_int(NCRUSH_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2/SSE3 optimizations");
+	fn->match_length = ncrush_match_length_sse2;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
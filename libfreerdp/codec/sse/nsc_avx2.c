@@ -0,0 +1,344 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * NSCodec Library - AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "../nsc_types.h"
+#include "../nsc_encode.h"
+#include "nsc_avx2.h"
+
+#include "../../core/simd.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <immintrin.h>
+
+#include <freerdp/codec/color.h>
+
+/* Convert 32 pixels given as 2x16 16bit values per channel.
+ * The packed bytes are put back in pixel order with the permutation index order */
+static inline void nsc_encode_store_avx2(BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         const __m256i r[2], const __m256i g[2], const __m256i b[2],
+                                         __m256i a, __m128i ccl, __m256i order)
+{
+	const __m256i mask = _mm256_set1_epi16(0xFF);
+	__m256i y_val[2];
+	__m256i co_val[2];
+	__m256i cg_val[2];
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		y_val[i] = _mm256_add_epi16(_mm256_srai_epi16(r[i], 2), _mm256_srai_epi16(g[i], 1));
+		y_val[i] = _mm256_add_epi16(y_val[i], _mm256_srai_epi16(b[i], 2));
+		/* The chroma values are truncated to 8bit like the generic code does */
+		co_val[i] = _mm256_sra_epi16(_mm256_sub_epi16(r[i], b[i]), ccl);
+		co_val[i] = _mm256_and_si256(co_val[i], mask);
+		cg_val[i] = _mm256_sub_epi16(g[i], _mm256_srai_epi16(r[i], 1));
+		cg_val[i] = _mm256_sra_epi16(_mm256_sub_epi16(cg_val[i], _mm256_srai_epi16(b[i], 1)), ccl);
+		cg_val[i] = _mm256_and_si256(cg_val[i], mask);
+	}
+
+	const __m256i yv = _mm256_packus_epi16(y_val[0], y_val[1]);
+	const __m256i cov = _mm256_packus_epi16(co_val[0], co_val[1]);
+	const __m256i cgv = _mm256_packus_epi16(cg_val[0], cg_val[1]);
+	_mm256_storeu_si256((__m256i*)yplane, _mm256_permutevar8x32_epi32(yv, order));
+	_mm256_storeu_si256((__m256i*)coplane, _mm256_permutevar8x32_epi32(cov, order));
+	_mm256_storeu_si256((__m256i*)cgplane, _mm256_permutevar8x32_epi32(cgv, order));
+	_mm256_storeu_si256((__m256i*)aplane, _mm256_permutevar8x32_epi32(a, order));
+}
+
+static inline __m256i nsc_encode_channel_avx2(__m256i v0, __m256i v1, size_t shift)
+{
+	const __m256i mask = _mm256_set1_epi32(0xFF);
+	const __m128i count = _mm_cvtsi32_si128((int)shift);
+	return _mm256_packs_epi32(_mm256_and_si256(_mm256_srl_epi32(v0, count), mask),
+	                          _mm256_and_si256(_mm256_srl_epi32(v1, count), mask));
+}
+
+static inline size_t nsc_encode_row_32bpp_avx2(const BYTE* WINPR_RESTRICT src,
+                                               BYTE* WINPR_RESTRICT yplane,
+                                               BYTE* WINPR_RESTRICT coplane,
+                                               BYTE* WINPR_RESTRICT cgplane,
+                                               BYTE* WINPR_RESTRICT aplane, size_t width, BYTE ccl,
+                                               size_t rshift, size_t bshift, BOOL alpha)
+{
+	/* packs and packus work per 128bit lane, every output dword holds 4 pixels of one load */
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	const __m128i cclv = _mm_cvtsi32_si128(ccl);
+	size_t x = 0;
+
+	for (; x + 32 <= width; x += 32)
+	{
+		__m256i v[4];
+		for (size_t i = 0; i < 4; i++)
+			v[i] = _mm256_loadu_si256((const __m256i*)&src[4 * x + 32 * i]);
+
+		const __m256i r[2] = { nsc_encode_channel_avx2(v[0], v[1], rshift),
+			                   nsc_encode_channel_avx2(v[2], v[3], rshift) };
+		const __m256i g[2] = { nsc_encode_channel_avx2(v[0], v[1], 8),
+			                   nsc_encode_channel_avx2(v[2], v[3], 8) };
+		const __m256i b[2] = { nsc_encode_channel_avx2(v[0], v[1], bshift),
+			                   nsc_encode_channel_avx2(v[2], v[3], bshift) };
+		__m256i a = _mm256_set1_epi8((char)0xFF);
+		if (alpha)
+			a = _mm256_packus_epi16(nsc_encode_channel_avx2(v[0], v[1], 24),
+			                        nsc_encode_channel_avx2(v[2], v[3], 24));
+
+		nsc_encode_store_avx2(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], r, g, b, a, cclv,
+		                      order);
+	}
+
+	return x;
+}
+
+static inline size_t nsc_encode_row_16bpp_avx2(const BYTE* WINPR_RESTRICT src,
+                                               BYTE* WINPR_RESTRICT yplane,
+                                               BYTE* WINPR_RESTRICT coplane,
+                                               BYTE* WINPR_RESTRICT cgplane,
+                                               BYTE* WINPR_RESTRICT aplane, size_t width, BYTE ccl,
+                                               BOOL bgr)
+{
+	/* packus works per 128bit lane, swap the middle quadwords back */
+	const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+	const __m128i cclv = _mm_cvtsi32_si128(ccl);
+	const __m256i a = _mm256_set1_epi8((char)0xFF);
+	size_t x = 0;
+
+	for (; x + 32 <= width; x += 32)
+	{
+		__m256i hi[2];
+		__m256i mid[2];
+		__m256i lo[2];
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			const __m256i p = _mm256_loadu_si256((const __m256i*)&src[2 * x + 32 * i]);
+			hi[i] = _mm256_or_si256(
+			    _mm256_and_si256(_mm256_srli_epi16(p, 8), _mm256_set1_epi16(0xF8)),
+			    _mm256_srli_epi16(p, 13));
+			mid[i] = _mm256_and_si256(_mm256_srli_epi16(p, 3), _mm256_set1_epi16(0xFC));
+			lo[i] = _mm256_or_si256(
+			    _mm256_slli_epi16(_mm256_and_si256(p, _mm256_set1_epi16(0x1F)), 3),
+			    _mm256_and_si256(_mm256_srli_epi16(p, 2), _mm256_set1_epi16(0x07)));
+		}
+
+		if (bgr)
+			nsc_encode_store_avx2(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], lo, mid, hi,
+			                      a, cclv, order);
+		else
+			nsc_encode_store_avx2(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], hi, mid, lo,
+			                      a, cclv, order);
+	}
+
+	return x;
+}
+
+static size_t nsc_encode_row_bgrx32_avx2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_avx2(src, yplane, coplane, cgplane, aplane, width, ccl, 16, 0,
+	                                 FALSE);
+}
+
+static size_t nsc_encode_row_bgra32_avx2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_avx2(src, yplane, coplane, cgplane, aplane, width, ccl, 16, 0,
+	                                 TRUE);
+}
+
+static size_t nsc_encode_row_rgbx32_avx2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_avx2(src, yplane, coplane, cgplane, aplane, width, ccl, 0, 16,
+	                                 FALSE);
+}
+
+static size_t nsc_encode_row_rgba32_avx2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
+{
+	return nsc_encode_row_32bpp_avx2(src, yplane, coplane, cgplane, aplane, width, ccl, 0, 16,
+	                                 TRUE);
+}
+
+static size_t nsc_encode_row_bgr16_avx2(const BYTE* WINPR_RESTRICT src,
+                                        BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                        BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                        size_t width, BYTE ccl)
+{
+	return nsc_encode_row_16bpp_avx2(src, yplane, coplane, cgplane, aplane, width, ccl, TRUE);
+}
+
+static size_t nsc_encode_row_rgb16_avx2(const BYTE* WINPR_RESTRICT src,
+                                        BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                        BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                        size_t width, BYTE ccl)
+{
+	return nsc_encode_row_16bpp_avx2(src, yplane, coplane, cgplane, aplane, width, ccl, FALSE);
+}
+
+/* 24bpp and palette formats are left to the generic code */
+static nsc_encode_row_fn nsc_encode_row_avx2(UINT32 format)
+{
+	switch (format)
+	{
+		case PIXEL_FORMAT_BGRX32:
+			return nsc_encode_row_bgrx32_avx2;
+		case PIXEL_FORMAT_BGRA32:
+			return nsc_encode_row_bgra32_avx2;
+		case PIXEL_FORMAT_RGBX32:
+			return nsc_encode_row_rgbx32_avx2;
+		case PIXEL_FORMAT_RGBA32:
+			return nsc_encode_row_rgba32_avx2;
+		case PIXEL_FORMAT_BGR16:
+			return nsc_encode_row_bgr16_avx2;
+		case PIXEL_FORMAT_RGB16:
+			return nsc_encode_row_rgb16_avx2;
+		default:
+			return nullptr;
+	}
+}
+
+/* Average 2x2 blocks of signed chroma values in place */
+static void nsc_encode_subsample_plane_avx2(BYTE* WINPR_RESTRICT plane, size_t tempWidth,
+                                            size_t tempHeight)
+{
+	const size_t dstWidth = tempWidth >> 1;
+
+	for (size_t y = 0; y < tempHeight >> 1; y++)
+	{
+		BYTE* dst = plane + y * dstWidth;
+		const BYTE* src0 = plane + (y << 1) * tempWidth;
+		const BYTE* src1 = src0 + tempWidth;
+		size_t x = 0;
+
+		for (; x + 16 <= dstWidth; x += 16)
+		{
+			const __m256i t0 = _mm256_loadu_si256((const __m256i*)&src0[2 * x]);
+			const __m256i t1 = _mm256_loadu_si256((const __m256i*)&src1[2 * x]);
+			/* sign extend the even and odd bytes to 16bit */
+			__m256i sum = _mm256_add_epi16(_mm256_srai_epi16(_mm256_slli_epi16(t0, 8), 8),
+			                               _mm256_srai_epi16(t0, 8));
+			sum = _mm256_add_epi16(sum, _mm256_srai_epi16(_mm256_slli_epi16(t1, 8), 8));
+			sum = _mm256_add_epi16(sum, _mm256_srai_epi16(t1, 8));
+			sum = _mm256_srai_epi16(sum, 2);
+			sum = _mm256_permute4x64_epi64(_mm256_packs_epi16(sum, sum), 0xD8);
+			_mm_storeu_si128((__m128i*)&dst[x], _mm256_castsi256_si128(sum));
+		}
+
+		for (; x < dstWidth; x++)
+		{
+			const INT16 sum = (INT16)((INT8)src0[2 * x] + (INT8)src0[2 * x + 1] +
+			                          (INT8)src1[2 * x] + (INT8)src1[2 * x + 1]);
+			dst[x] = (BYTE)(sum >> 2);
+		}
+	}
+}
+
+static BOOL nsc_encode_subsampling_avx2(NSC_CONTEXT* WINPR_RESTRICT context)
+{
+	const UINT32 tempWidth = ROUND_UP_TO(context->width, 8);
+	const UINT32 tempHeight = ROUND_UP_TO(context->height, 2);
+
+	if (tempHeight == 0)
+		return FALSE;
+
+	if (tempWidth > context->priv->PlaneBuffersLength / tempHeight)
+		return FALSE;
+
+	nsc_encode_subsample_plane_avx2(context->priv->PlaneBuffers[1], tempWidth, tempHeight);
+	nsc_encode_subsample_plane_avx2(context->priv->PlaneBuffers[2], tempWidth, tempHeight);
+	return TRUE;
+}
+
+static BOOL nsc_encode_avx2(NSC_CONTEXT* WINPR_RESTRICT context, const BYTE* WINPR_RESTRICT data,
+                            UINT32 scanline)
+{
+	if (!nsc_encode_argb_to_aycocg(context, data, scanline, nsc_encode_row_avx2(context->format)))
+		return FALSE;
+
+	if (context->ChromaSubsamplingLevel > 0)
+		return nsc_encode_subsampling_avx2(context);
+
+	return TRUE;
+}
+
+static size_t nsc_rle_scan_run_avx2(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 32 <= max; x += 32)
+	{
+		const __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&in[x]),
+		                                     _mm256_loadu_si256((const __m256i*)&in[x + 1]));
+		if ((UINT32)_mm256_movemask_epi8(eq) != UINT32_MAX)
+			break;
+	}
+
+	while ((x < max) && (in[x] == in[x + 1]))
+		x++;
+	return x;
+}
+
+static size_t nsc_rle_scan_literal_avx2(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 32 <= max; x += 32)
+	{
+		const __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&in[x]),
+		                                     _mm256_loadu_si256((const __m256i*)&in[x + 1]));
+		if (_mm256_movemask_epi8(eq) != 0)
+			break;
+	}
+
+	while ((x < max) && (in[x] != in[x + 1]))
+		x++;
+	return x;
+}
+
+static UINT32 nsc_rle_encode_avx2(const BYTE* WINPR_RESTRICT in, BYTE* WINPR_RESTRICT out,
+                                  UINT32 originalSize)
+{
+	return nsc_rle_encode_plane(in, out, originalSize, nsc_rle_scan_run_avx2,
+	                            nsc_rle_scan_literal_avx2);
+}
+#endif
+
+void nsc_init_avx2_int(NSC_CONTEXT* WINPR_RESTRICT context)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+	PROFILER_RENAME(context->priv->prof_nsc_encode, "nsc_encode_avx2")
+	PROFILER_RENAME(context->priv->prof_nsc_rle_compress_data, "nsc_rle_compress_data_avx2")
+	context->encode = nsc_encode_avx2;
+	context->rle_encode = nsc_rle_encode_avx2;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or WITH_AVX2 or AVX2 intrinsics not available");
+	WINPR_UNUSED(context);
+#endif
+}
@@ -23,6 +23,7 @@
 #include <freerdp/config.h>
 
 #include "../nsc_types.h"
+#include "../nsc_encode.h"
 #include "nsc_sse2.h"
 
 #include "../../core/simd.h"
@@ -40,349 +41,223 @@
 #include <winpr/crt.h>
 #include <winpr/sysinfo.h>
 
-static inline size_t nsc_encode_next_bgrx32(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                            __m128i* b_val, __m128i* a_val)
+/* Convert 16 pixels given as 2x8 16bit values per channel */
+static inline void nsc_encode_store_sse2(BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         const __m128i r[2], const __m128i g[2], const __m128i b[2],
+                                         __m128i a, __m128i ccl)
 {
-	*b_val = _mm_set_epi16(*(src + 28), *(src + 24), *(src + 20), *(src + 16), *(src + 12),
-	                       *(src + 8), *(src + 4), *src);
-	*g_val = _mm_set_epi16(*(src + 29), *(src + 25), *(src + 21), *(src + 17), *(src + 13),
-	                       *(src + 9), *(src + 5), *(src + 1));
-	*r_val = _mm_set_epi16(*(src + 30), *(src + 26), *(src + 22), *(src + 18), *(src + 14),
-	                       *(src + 10), *(src + 6), *(src + 2));
-	*a_val = _mm_set1_epi16(0xFF);
-	return 32;
+	const __m128i mask = _mm_set1_epi16(0xFF);
+	__m128i y_val[2];
+	__m128i co_val[2];
+	__m128i cg_val[2];
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		y_val[i] = _mm_add_epi16(_mm_srai_epi16(r[i], 2), _mm_srai_epi16(g[i], 1));
+		y_val[i] = _mm_add_epi16(y_val[i], _mm_srai_epi16(b[i], 2));
+		/* The chroma values are truncated to 8bit like the generic code does */
+		co_val[i] = _mm_sra_epi16(_mm_sub_epi16(r[i], b[i]), ccl);
+		co_val[i] = _mm_and_si128(co_val[i], mask);
+		cg_val[i] = _mm_sub_epi16(g[i], _mm_srai_epi16(r[i], 1));
+		cg_val[i] = _mm_sra_epi16(_mm_sub_epi16(cg_val[i], _mm_srai_epi16(b[i], 1)), ccl);
+		cg_val[i] = _mm_and_si128(cg_val[i], mask);
+	}
+
+	STORE_SI128(yplane, _mm_packus_epi16(y_val[0], y_val[1]));
+	STORE_SI128(coplane, _mm_packus_epi16(co_val[0], co_val[1]));
+	STORE_SI128(cgplane, _mm_packus_epi16(cg_val[0], cg_val[1]));
+	STORE_SI128(aplane, a);
 }
 
-static inline size_t nsc_encode_next_bgra32(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                            __m128i* b_val, __m128i* a_val)
+static inline __m128i nsc_encode_channel_sse2(__m128i v0, __m128i v1, size_t shift)
 {
-	*b_val = _mm_set_epi16(*(src + 28), *(src + 24), *(src + 20), *(src + 16), *(src + 12),
-	                       *(src + 8), *(src + 4), *src);
-	*g_val = _mm_set_epi16(*(src + 29), *(src + 25), *(src + 21), *(src + 17), *(src + 13),
-	                       *(src + 9), *(src + 5), *(src + 1));
-	*r_val = _mm_set_epi16(*(src + 30), *(src + 26), *(src + 22), *(src + 18), *(src + 14),
-	                       *(src + 10), *(src + 6), *(src + 2));
-	*a_val = _mm_set_epi16(*(src + 31), *(src + 27), *(src + 23), *(src + 19), *(src + 15),
-	                       *(src + 11), *(src + 7), *(src + 3));
-	return 32;
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i count = _mm_cvtsi32_si128((int)shift);
+	return _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(v0, count), mask),
+	                       _mm_and_si128(_mm_srl_epi32(v1, count), mask));
 }
 
-static inline size_t nsc_encode_next_rgbx32(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                            __m128i* b_val, __m128i* a_val)
+static inline size_t nsc_encode_row_32bpp_sse2(const BYTE* WINPR_RESTRICT src,
+                                               BYTE* WINPR_RESTRICT yplane,
+                                               BYTE* WINPR_RESTRICT coplane,
+                                               BYTE* WINPR_RESTRICT cgplane,
+                                               BYTE* WINPR_RESTRICT aplane, size_t width, BYTE ccl,
+                                               size_t rshift, size_t bshift, BOOL alpha)
 {
-	*r_val = _mm_set_epi16(*(src + 28), *(src + 24), *(src + 20), *(src + 16), *(src + 12),
-	                       *(src + 8), *(src + 4), *src);
-	*g_val = _mm_set_epi16(*(src + 29), *(src + 25), *(src + 21), *(src + 17), *(src + 13),
-	                       *(src + 9), *(src + 5), *(src + 1));
-	*b_val = _mm_set_epi16(*(src + 30), *(src + 26), *(src + 22), *(src + 18), *(src + 14),
-	                       *(src + 10), *(src + 6), *(src + 2));
-	*a_val = _mm_set1_epi16(0xFF);
-	return 32;
+	const __m128i cclv = _mm_cvtsi32_si128(ccl);
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i v[4] = { LOAD_SI128(&src[4 * x]), LOAD_SI128(&src[4 * x + 16]),
+			                   LOAD_SI128(&src[4 * x + 32]), LOAD_SI128(&src[4 * x + 48]) };
+		const __m128i r[2] = { nsc_encode_channel_sse2(v[0], v[1], rshift),
+			                   nsc_encode_channel_sse2(v[2], v[3], rshift) };
+		const __m128i g[2] = { nsc_encode_channel_sse2(v[0], v[1], 8),
+			                   nsc_encode_channel_sse2(v[2], v[3], 8) };
+		const __m128i b[2] = { nsc_encode_channel_sse2(v[0], v[1], bshift),
+			                   nsc_encode_channel_sse2(v[2], v[3], bshift) };
+		__m128i a = _mm_set1_epi8((char)0xFF);
+		if (alpha)
+			a = _mm_packus_epi16(nsc_encode_channel_sse2(v[0], v[1], 24),
+			                     nsc_encode_channel_sse2(v[2], v[3], 24));
+
+		nsc_encode_store_sse2(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], r, g, b, a, cclv);
+	}
+
+	return x;
 }
 
-static inline size_t nsc_encode_next_rgba32(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                            __m128i* b_val, __m128i* a_val)
+static inline size_t nsc_encode_row_16bpp_sse2(const BYTE* WINPR_RESTRICT src,
+                                               BYTE* WINPR_RESTRICT yplane,
+                                               BYTE* WINPR_RESTRICT coplane,
+                                               BYTE* WINPR_RESTRICT cgplane,
+                                               BYTE* WINPR_RESTRICT aplane, size_t width, BYTE ccl,
+                                               BOOL bgr)
 {
-	*r_val = _mm_set_epi16(*(src + 28), *(src + 24), *(src + 20), *(src + 16), *(src + 12),
-	                       *(src + 8), *(src + 4), *src);
-	*g_val = _mm_set_epi16(*(src + 29), *(src + 25), *(src + 21), *(src + 17), *(src + 13),
-	                       *(src + 9), *(src + 5), *(src + 1));
-	*b_val = _mm_set_epi16(*(src + 30), *(src + 26), *(src + 22), *(src + 18), *(src + 14),
-	                       *(src + 10), *(src + 6), *(src + 2));
-	*a_val = _mm_set_epi16(*(src + 31), *(src + 27), *(src + 23), *(src + 19), *(src + 15),
-	                       *(src + 11), *(src + 7), *(src + 3));
-	return 32;
+	const __m128i cclv = _mm_cvtsi32_si128(ccl);
+	const __m128i a = _mm_set1_epi8((char)0xFF);
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i hi[2];
+		__m128i mid[2];
+		__m128i lo[2];
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			const __m128i p = LOAD_SI128(&src[2 * x + 16 * i]);
+			hi[i] = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(p, 8), _mm_set1_epi16(0xF8)),
+			                     _mm_srli_epi16(p, 13));
+			mid[i] = _mm_and_si128(_mm_srli_epi16(p, 3), _mm_set1_epi16(0xFC));
+			lo[i] = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(p, _mm_set1_epi16(0x1F)), 3),
+			                     _mm_and_si128(_mm_srli_epi16(p, 2), _mm_set1_epi16(0x07)));
+		}
+
+		if (bgr)
+			nsc_encode_store_sse2(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], lo, mid, hi,
+			                      a, cclv);
+		else
+			nsc_encode_store_sse2(&yplane[x], &coplane[x], &cgplane[x], &aplane[x], hi, mid, lo,
+			                      a, cclv);
+	}
+
+	return x;
 }
 
-static inline size_t nsc_encode_next_bgr24(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                           __m128i* b_val, __m128i* a_val)
+static size_t nsc_encode_row_bgrx32_sse2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
 {
-	*b_val = _mm_set_epi16(*(src + 21), *(src + 18), *(src + 15), *(src + 12), *(src + 9),
-	                       *(src + 6), *(src + 3), *src);
-	*g_val = _mm_set_epi16(*(src + 22), *(src + 19), *(src + 16), *(src + 13), *(src + 10),
-	                       *(src + 7), *(src + 4), *(src + 1));
-	*r_val = _mm_set_epi16(*(src + 23), *(src + 20), *(src + 17), *(src + 14), *(src + 11),
-	                       *(src + 8), *(src + 5), *(src + 2));
-	*a_val = _mm_set1_epi16(0xFF);
-	return 24;
+	return nsc_encode_row_32bpp_sse2(src, yplane, coplane, cgplane, aplane, width, ccl, 16, 0,
+	                                 FALSE);
 }
 
-static inline size_t nsc_encode_next_rgb24(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                           __m128i* b_val, __m128i* a_val)
+static size_t nsc_encode_row_bgra32_sse2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
 {
-	*r_val = _mm_set_epi16(*(src + 21), *(src + 18), *(src + 15), *(src + 12), *(src + 9),
-	                       *(src + 6), *(src + 3), *src);
-	*g_val = _mm_set_epi16(*(src + 22), *(src + 19), *(src + 16), *(src + 13), *(src + 10),
-	                       *(src + 7), *(src + 4), *(src + 1));
-	*b_val = _mm_set_epi16(*(src + 23), *(src + 20), *(src + 17), *(src + 14), *(src + 11),
-	                       *(src + 8), *(src + 5), *(src + 2));
-	*a_val = _mm_set1_epi16(0xFF);
-	return 24;
+	return nsc_encode_row_32bpp_sse2(src, yplane, coplane, cgplane, aplane, width, ccl, 16, 0,
+	                                 TRUE);
 }
 
-static inline size_t nsc_encode_next_bgr16(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                           __m128i* b_val, __m128i* a_val)
+static size_t nsc_encode_row_rgbx32_sse2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
 {
-	*b_val = _mm_set_epi16(
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 15)) & 0xF8) | ((*(src + 15)) >> 5)),
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 13)) & 0xF8) | ((*(src + 13)) >> 5)),
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 11)) & 0xF8) | ((*(src + 11)) >> 5)),
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 9)) & 0xF8) | ((*(src + 9)) >> 5)),
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 7)) & 0xF8) | ((*(src + 7)) >> 5)),
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 5)) & 0xF8) | ((*(src + 5)) >> 5)),
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 3)) & 0xF8) | ((*(src + 3)) >> 5)),
-	    WINPR_ASSERTING_INT_CAST(INT16, ((*(src + 1)) & 0xF8) | ((*(src + 1)) >> 5)));
-	*g_val = _mm_set_epi16(
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 15)) & 0x07) << 5) | (((*(src + 14)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 13)) & 0x07) << 5) | (((*(src + 12)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 11)) & 0x07) << 5) | (((*(src + 10)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 9)) & 0x07) << 5) | (((*(src + 8)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 7)) & 0x07) << 5) | (((*(src + 6)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 5)) & 0x07) << 5) | (((*(src + 4)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 3)) & 0x07) << 5) | (((*(src + 2)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16, (((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3)));
-	*r_val = _mm_set_epi16(
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 14)) & 0x1F) << 3) | (((*(src + 14)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 12)) & 0x1F) << 3) | (((*(src + 12)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 10)) & 0x1F) << 3) | (((*(src + 10)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 8)) & 0x1F) << 3) | (((*(src + 8)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 6)) & 0x1F) << 3) | (((*(src + 6)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 4)) & 0x1F) << 3) | (((*(src + 4)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 2)) & 0x1F) << 3) | (((*(src + 2)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16, (((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07)));
-	*a_val = _mm_set1_epi16(0xFF);
-	return 16;
+	return nsc_encode_row_32bpp_sse2(src, yplane, coplane, cgplane, aplane, width, ccl, 0, 16,
+	                                 FALSE);
 }
 
-static inline size_t nsc_encode_next_rgb16(const BYTE* src, __m128i* r_val, __m128i* g_val,
-                                           __m128i* b_val, __m128i* a_val)
+static size_t nsc_encode_row_rgba32_sse2(const BYTE* WINPR_RESTRICT src,
+                                         BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                         BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                         size_t width, BYTE ccl)
 {
-	*r_val = _mm_set_epi16(WINPR_ASSERTING_INT_CAST(INT16, ((src[15] & 0xF8) | (src[15] >> 5))),
-	                       WINPR_ASSERTING_INT_CAST(INT16, ((src[13] & 0xF8) | (src[13] >> 5))),
-	                       WINPR_ASSERTING_INT_CAST(INT16, ((src[11] & 0xF8) | (src[11] >> 5))),
-	                       WINPR_ASSERTING_INT_CAST(INT16, ((src[9] & 0xF8) | (src[9] >> 5))),
-	                       WINPR_ASSERTING_INT_CAST(INT16, ((src[7] & 0xF8) | (src[7] >> 5))),
-	                       WINPR_ASSERTING_INT_CAST(INT16, ((src[5] & 0xF8) | (src[5] >> 5))),
-	                       WINPR_ASSERTING_INT_CAST(INT16, ((src[3] & 0xF8) | (src[3] >> 5))),
-	                       WINPR_ASSERTING_INT_CAST(INT16, ((src[1] & 0xF8) | (src[1] >> 5))));
-	*g_val = _mm_set_epi16(
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 15)) & 0x07) << 5) | (((*(src + 14)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 13)) & 0x07) << 5) | (((*(src + 12)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 11)) & 0x07) << 5) | (((*(src + 10)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 9)) & 0x07) << 5) | (((*(src + 8)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 7)) & 0x07) << 5) | (((*(src + 6)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 5)) & 0x07) << 5) | (((*(src + 4)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 3)) & 0x07) << 5) | (((*(src + 2)) & 0xE0) >> 3)),
-	    WINPR_ASSERTING_INT_CAST(INT16, (((*(src + 1)) & 0x07) << 5) | (((*src) & 0xE0) >> 3)));
-	*b_val = _mm_set_epi16(
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 14)) & 0x1F) << 3) | (((*(src + 14)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 12)) & 0x1F) << 3) | (((*(src + 12)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 10)) & 0x1F) << 3) | (((*(src + 10)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 8)) & 0x1F) << 3) | (((*(src + 8)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 6)) & 0x1F) << 3) | (((*(src + 6)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 4)) & 0x1F) << 3) | (((*(src + 4)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16,
-	                             (((*(src + 2)) & 0x1F) << 3) | (((*(src + 2)) >> 2) & 0x07)),
-	    WINPR_ASSERTING_INT_CAST(INT16, (((*src) & 0x1F) << 3) | (((*src) >> 2) & 0x07)));
-	*a_val = _mm_set1_epi16(0xFF);
-	return 16;
+	return nsc_encode_row_32bpp_sse2(src, yplane, coplane, cgplane, aplane, width, ccl, 0, 16,
+	                                 TRUE);
 }
 
-static inline size_t nsc_encode_next_a4(const BYTE* src, const BYTE* palette, __m128i* r_val,
-                                        __m128i* g_val, __m128i* b_val, __m128i* a_val)
+static size_t nsc_encode_row_bgr16_sse2(const BYTE* WINPR_RESTRICT src,
+                                        BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                        BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                        size_t width, BYTE ccl)
 {
-	BYTE idx[8] = WINPR_C_ARRAY_INIT;
-
-	for (int shift = 7; shift >= 0; shift--)
-	{
-		idx[shift] = ((*src) >> shift) & 1;
-		idx[shift] |= (((*(src + 1)) >> shift) & 1) << 1;
-		idx[shift] |= (((*(src + 2)) >> shift) & 1) << 2;
-		idx[shift] |= (((*(src + 3)) >> shift) & 1) << 3;
-		idx[shift] *= 3;
-	}
-
-	*r_val = _mm_set_epi16(palette[idx[0]], palette[idx[1]], palette[idx[2]], palette[idx[3]],
-	                       palette[idx[4]], palette[idx[5]], palette[idx[6]], palette[idx[7]]);
-	*g_val = _mm_set_epi16(palette[idx[0] + 1], palette[idx[1] + 1], palette[idx[2] + 1],
-	                       palette[idx[3] + 1], palette[idx[4] + 1], palette[idx[5] + 1],
-	                       palette[idx[6] + 1], palette[idx[7] + 1]);
-	*b_val = _mm_set_epi16(palette[idx[0] + 2], palette[idx[1] + 2], palette[idx[2] + 2],
-	                       palette[idx[3] + 2], palette[idx[4] + 2], palette[idx[5] + 2],
-	                       palette[idx[6] + 2], palette[idx[7] + 2]);
-	*a_val = _mm_set1_epi16(0xFF);
-	return 4;
+	return nsc_encode_row_16bpp_sse2(src, yplane, coplane, cgplane, aplane, width, ccl, TRUE);
 }
 
-static inline size_t nsc_encode_next_rgb8(const BYTE* src, const BYTE* palette, __m128i* r_val,
-                                          __m128i* g_val, __m128i* b_val, __m128i* a_val)
+static size_t nsc_encode_row_rgb16_sse2(const BYTE* WINPR_RESTRICT src,
+                                        BYTE* WINPR_RESTRICT yplane, BYTE* WINPR_RESTRICT coplane,
+                                        BYTE* WINPR_RESTRICT cgplane, BYTE* WINPR_RESTRICT aplane,
+                                        size_t width, BYTE ccl)
 {
-	*r_val = _mm_set_epi16(palette[(*(src + 7ULL)) * 3ULL], palette[(*(src + 6ULL)) * 3ULL],
-	                       palette[(*(src + 5ULL)) * 3ULL], palette[(*(src + 4ULL)) * 3ULL],
-	                       palette[(*(src + 3ULL)) * 3ULL], palette[(*(src + 2ULL)) * 3ULL],
-	                       palette[(*(src + 1ULL)) * 3ULL], palette[(*src) * 3ULL]);
-	*g_val = _mm_set_epi16(
-	    palette[(*(src + 7ULL)) * 3ULL + 1ULL], palette[(*(src + 6ULL)) * 3ULL + 1ULL],
-	    palette[(*(src + 5ULL)) * 3ULL + 1ULL], palette[(*(src + 4ULL)) * 3ULL + 1ULL],
-	    palette[(*(src + 3ULL)) * 3ULL + 1ULL], palette[(*(src + 2ULL)) * 3ULL + 1ULL],
-	    palette[(*(src + 1ULL)) * 3ULL + 1ULL], palette[(*src) * 3ULL + 1ULL]);
-	*b_val = _mm_set_epi16(
-	    palette[(*(src + 7ULL)) * 3ULL + 2ULL], palette[(*(src + 6ULL)) * 3ULL + 2ULL],
-	    palette[(*(src + 5ULL)) * 3ULL + 2ULL], palette[(*(src + 4ULL)) * 3ULL + 2ULL],
-	    palette[(*(src + 3ULL)) * 3ULL + 2ULL], palette[(*(src + 2ULL)) * 3ULL + 2ULL],
-	    palette[(*(src + 1ULL)) * 3ULL + 2ULL], palette[(*src) * 3ULL + 2ULL]);
-	*a_val = _mm_set1_epi16(0xFF);
-	return 8;
+	return nsc_encode_row_16bpp_sse2(src, yplane, coplane, cgplane, aplane, width, ccl, FALSE);
 }
 
-static inline size_t nsc_encode_next_rgba(UINT32 format, const BYTE* src, const BYTE* palette,
-                                          __m128i* r_val, __m128i* g_val, __m128i* b_val,
-                                          __m128i* a_val)
+/* 24bpp and palette formats are left to the generic code */
+static nsc_encode_row_fn nsc_encode_row_sse2(UINT32 format)
 {
 	switch (format)
 	{
 		case PIXEL_FORMAT_BGRX32:
-			return nsc_encode_next_bgrx32(src, r_val, g_val, b_val, a_val);
-
+			return nsc_encode_row_bgrx32_sse2;
 		case PIXEL_FORMAT_BGRA32:
-			return nsc_encode_next_bgra32(src, r_val, g_val, b_val, a_val);
-
+			return nsc_encode_row_bgra32_sse2;
 		case PIXEL_FORMAT_RGBX32:
-			return nsc_encode_next_rgbx32(src, r_val, g_val, b_val, a_val);
-
+			return nsc_encode_row_rgbx32_sse2;
 		case PIXEL_FORMAT_RGBA32:
-			return nsc_encode_next_rgba32(src, r_val, g_val, b_val, a_val);
-
-		case PIXEL_FORMAT_BGR24:
-			return nsc_encode_next_bgr24(src, r_val, g_val, b_val, a_val);
-
-		case PIXEL_FORMAT_RGB24:
-			return nsc_encode_next_rgb24(src, r_val, g_val, b_val, a_val);
-
+			return nsc_encode_row_rgba32_sse2;
 		case PIXEL_FORMAT_BGR16:
-			return nsc_encode_next_bgr16(src, r_val, g_val, b_val, a_val);
-
+			return nsc_encode_row_bgr16_sse2;
 		case PIXEL_FORMAT_RGB16:
-			return nsc_encode_next_rgb16(src, r_val, g_val, b_val, a_val);
-
-		case PIXEL_FORMAT_A4:
-			return nsc_encode_next_a4(src, palette, r_val, g_val, b_val, a_val);
-
-		case PIXEL_FORMAT_RGB8:
-			return nsc_encode_next_rgb8(src, palette, r_val, g_val, b_val, a_val);
-
+			return nsc_encode_row_rgb16_sse2;
 		default:
-			return 0;
+			return nullptr;
 	}
 }
 
-static BOOL nsc_encode_argb_to_aycocg_sse2(NSC_CONTEXT* context, const BYTE* data, UINT32 scanline)
+/* Average 2x2 blocks of signed chroma values in place */
+static void nsc_encode_subsample_plane_sse2(BYTE* WINPR_RESTRICT plane, size_t tempWidth,
+                                            size_t tempHeight)
 {
-	size_t y = 0;
-
-	if (!context || !data || (scanline == 0))
-		return FALSE;
-
-	const UINT16 tempWidth = ROUND_UP_TO(context->width, 8);
-	const UINT16 rw = (context->ChromaSubsamplingLevel > 0 ? tempWidth : context->width);
+	const size_t dstWidth = tempWidth >> 1;
 
-	const BYTE ccl = WINPR_ASSERTING_INT_CAST(BYTE, context->ColorLossLevel);
-
-	for (; y < context->height; y++)
+	for (size_t y = 0; y < tempHeight >> 1; y++)
 	{
-		const BYTE* src = data + (context->height - 1 - y) * scanline;
-		BYTE* yplane = context->priv->PlaneBuffers[0] + y * rw;
-		BYTE* coplane = context->priv->PlaneBuffers[1] + y * rw;
-		BYTE* cgplane = context->priv->PlaneBuffers[2] + y * rw;
-		BYTE* aplane = context->priv->PlaneBuffers[3] + y * context->width;
+		BYTE* dst = plane + y * dstWidth;
+		const BYTE* src0 = plane + (y << 1) * tempWidth;
+		const BYTE* src1 = src0 + tempWidth;
+		size_t x = 0;
 
-		for (UINT16 x = 0; x < context->width; x += 8)
+		for (; x + 8 <= dstWidth; x += 8)
 		{
-			__m128i r_val = WINPR_C_ARRAY_INIT;
-			__m128i g_val = WINPR_C_ARRAY_INIT;
-			__m128i b_val = WINPR_C_ARRAY_INIT;
-			__m128i a_val = WINPR_C_ARRAY_INIT;
-
-			const size_t rc = nsc_encode_next_rgba(context->format, src, context->palette, &r_val,
-			                                       &g_val, &b_val, &a_val);
-			src += rc;
-
-			__m128i y_val = _mm_srai_epi16(r_val, 2);
-			y_val = _mm_add_epi16(y_val, _mm_srai_epi16(g_val, 1));
-			y_val = _mm_add_epi16(y_val, _mm_srai_epi16(b_val, 2));
-			__m128i co_val = _mm_sub_epi16(r_val, b_val);
-			co_val = _mm_srai_epi16(co_val, ccl);
-			__m128i cg_val = _mm_sub_epi16(g_val, _mm_srai_epi16(r_val, 1));
-			cg_val = _mm_sub_epi16(cg_val, _mm_srai_epi16(b_val, 1));
-			cg_val = _mm_srai_epi16(cg_val, ccl);
-			y_val = _mm_packus_epi16(y_val, y_val);
-			STORE_SI128(yplane, y_val);
-			co_val = _mm_packs_epi16(co_val, co_val);
-			STORE_SI128(coplane, co_val);
-			cg_val = _mm_packs_epi16(cg_val, cg_val);
-			STORE_SI128(cgplane, cg_val);
-			a_val = _mm_packus_epi16(a_val, a_val);
-			STORE_SI128(aplane, a_val);
-			yplane += 8;
-			coplane += 8;
-			cgplane += 8;
-			aplane += 8;
+			const __m128i t0 = LOAD_SI128(&src0[2 * x]);
+			const __m128i t1 = LOAD_SI128(&src1[2 * x]);
+			/* sign extend the even and odd bytes to 16bit */
+			__m128i sum = _mm_add_epi16(_mm_srai_epi16(_mm_slli_epi16(t0, 8), 8),
+			                            _mm_srai_epi16(t0, 8));
+			sum = _mm_add_epi16(sum, _mm_srai_epi16(_mm_slli_epi16(t1, 8), 8));
+			sum = _mm_add_epi16(sum, _mm_srai_epi16(t1, 8));
+			sum = _mm_srai_epi16(sum, 2);
+			_mm_storel_epi64((__m128i*)&dst[x], _mm_packs_epi16(sum, sum));
 		}
 
-		if (context->ChromaSubsamplingLevel > 0 && (context->width % 2) == 1)
+		for (; x < dstWidth; x++)
 		{
-			context->priv->PlaneBuffers[0][y * rw + context->width] =
-			    context->priv->PlaneBuffers[0][y * rw + context->width - 1];
-			context->priv->PlaneBuffers[1][y * rw + context->width] =
-			    context->priv->PlaneBuffers[1][y * rw + context->width - 1];
-			context->priv->PlaneBuffers[2][y * rw + context->width] =
-			    context->priv->PlaneBuffers[2][y * rw + context->width - 1];
+			const INT16 sum = (INT16)((INT8)src0[2 * x] + (INT8)src0[2 * x + 1] +
+			                          (INT8)src1[2 * x] + (INT8)src1[2 * x + 1]);
+			dst[x] = (BYTE)(sum >> 2);
 		}
 	}
-
-	if (context->ChromaSubsamplingLevel > 0 && (y % 2) == 1)
-	{
-		BYTE* yplane = context->priv->PlaneBuffers[0] + y * rw;
-		BYTE* coplane = context->priv->PlaneBuffers[1] + y * rw;
-		BYTE* cgplane = context->priv->PlaneBuffers[2] + y * rw;
-		CopyMemory(yplane, yplane - rw, rw);
-		CopyMemory(coplane, coplane - rw, rw);
-		CopyMemory(cgplane, cgplane - rw, rw);
-	}
-
-	return TRUE;
 }
 
-static BOOL nsc_encode_subsampling_sse2(NSC_CONTEXT* context)
+static BOOL nsc_encode_subsampling_sse2(NSC_CONTEXT* WINPR_RESTRICT context)
 {
-	__m128i mask = _mm_set1_epi16(0xFF);
 	const UINT32 tempWidth = ROUND_UP_TO(context->width, 8);
 	const UINT32 tempHeight = ROUND_UP_TO(context->height, 2);
 
@@ -392,48 +267,15 @@ static BOOL nsc_encode_subsampling_sse2(NSC_CONTEXT* context)
 	if (tempWidth > context->priv->PlaneBuffersLength / tempHeight)
 		return FALSE;
 
-	for (size_t y = 0; y < tempHeight >> 1; y++)
-	{
-		BYTE* co_dst = context->priv->PlaneBuffers[1] + y * (tempWidth >> 1);
-		BYTE* cg_dst = context->priv->PlaneBuffers[2] + y * (tempWidth >> 1);
-		INT8* co_src0 = (INT8*)context->priv->PlaneBuffers[1] + (y << 1) * tempWidth;
-		INT8* co_src1 = co_src0 + tempWidth;
-		INT8* cg_src0 = (INT8*)context->priv->PlaneBuffers[2] + (y << 1) * tempWidth;
-		INT8* cg_src1 = cg_src0 + tempWidth;
-
-		for (UINT32 x = 0; x < tempWidth >> 1; x += 8)
-		{
-			{
-				__m128i t = LOAD_SI128(co_src0);
-				t = _mm_avg_epu8(t, LOAD_SI128(co_src1));
-				__m128i val = _mm_and_si128(_mm_srli_si128(t, 1), mask);
-				val = _mm_avg_epu16(val, _mm_and_si128(t, mask));
-				val = _mm_packus_epi16(val, val);
-				STORE_SI128(co_dst, val);
-				co_dst += 8;
-				co_src0 += 16;
-				co_src1 += 16;
-			}
-			{
-				__m128i t = LOAD_SI128(cg_src0);
-				t = _mm_avg_epu8(t, LOAD_SI128(cg_src1));
-				__m128i val = _mm_and_si128(_mm_srli_si128(t, 1), mask);
-				val = _mm_avg_epu16(val, _mm_and_si128(t, mask));
-				val = _mm_packus_epi16(val, val);
-				STORE_SI128(cg_dst, val);
-				cg_dst += 8;
-				cg_src0 += 16;
-				cg_src1 += 16;
-			}
-		}
-	}
+	nsc_encode_subsample_plane_sse2(context->priv->PlaneBuffers[1], tempWidth, tempHeight);
+	nsc_encode_subsample_plane_sse2(context->priv->PlaneBuffers[2], tempWidth, tempHeight);
 	return TRUE;
 }
 
 static BOOL nsc_encode_sse2(NSC_CONTEXT* WINPR_RESTRICT context, const BYTE* WINPR_RESTRICT data,
                             UINT32 scanline)
 {
-	if (!nsc_encode_argb_to_aycocg_sse2(context, data, scanline))
+	if (!nsc_encode_argb_to_aycocg(context, data, scanline, nsc_encode_row_sse2(context->format)))
 		return FALSE;
 
 	if (context->ChromaSubsamplingLevel > 0)
@@ -441,6 +283,45 @@ static BOOL nsc_encode_sse2(NSC_CONTEXT* WINPR_RESTRICT context, const BYTE* WIN
 
 	return TRUE;
 }
+
+static size_t nsc_rle_scan_run_sse2(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const __m128i eq = _mm_cmpeq_epi8(LOAD_SI128(&in[x]), LOAD_SI128(&in[x + 1]));
+		if (_mm_movemask_epi8(eq) != 0xFFFF)
+			break;
+	}
+
+	while ((x < max) && (in[x] == in[x + 1]))
+		x++;
+	return x;
+}
+
+static size_t nsc_rle_scan_literal_sse2(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const __m128i eq = _mm_cmpeq_epi8(LOAD_SI128(&in[x]), LOAD_SI128(&in[x + 1]));
+		if (_mm_movemask_epi8(eq) != 0)
+			break;
+	}
+
+	while ((x < max) && (in[x] != in[x + 1]))
+		x++;
+	return x;
+}
+
+static UINT32 nsc_rle_encode_sse2(const BYTE* WINPR_RESTRICT in, BYTE* WINPR_RESTRICT out,
+                                  UINT32 originalSize)
+{
+	return nsc_rle_encode_plane(in, out, originalSize, nsc_rle_scan_run_sse2,
+	                            nsc_rle_scan_literal_sse2);
+}
 #endif
 
 void nsc_init_sse2_int(NSC_CONTEXT* WINPR_RESTRICT context)
@@ -448,7 +329,9 @@ void nsc_init_sse2_int(NSC_CONTEXT* WINPR_RESTRICT context)
 #if defined(SSE_AVX_INTRINSICS_ENABLED)
 	WLog_VRB(PRIM_TAG, "SSE2/SSE3 optimizations");
 	PROFILER_RENAME(context->priv->prof_nsc_encode, "nsc_encode_sse2")
+	PROFILER_RENAME(context->priv->prof_nsc_rle_compress_data, "nsc_rle_compress_data_sse2")
 	context->encode = nsc_encode_sse2;
+	context->rle_encode = nsc_rle_encode_sse2;
 #else
 	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
 	WINPR_UNUSED(context);
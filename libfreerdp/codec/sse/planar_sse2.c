@@ -0,0 +1,124 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "planar_sse2.h"
+
+#include "../../core/simd.h"
+#include "../../primitives/sse/prim_avxsse.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+static inline __m128i planar_channel_sse2(const __m128i v[4], size_t offset)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	const __m128i count = _mm_cvtsi32_si128((int)(offset * 8));
+	const __m128i c0 = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(v[0], count), mask),
+	                                   _mm_and_si128(_mm_srl_epi32(v[1], count), mask));
+	const __m128i c1 = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(v[2], count), mask),
+	                                   _mm_and_si128(_mm_srl_epi32(v[3], count), mask));
+	return _mm_packus_epi16(c0, c1);
+}
+
+static void planar_split_row32_sse2(const BYTE* WINPR_RESTRICT src, size_t width,
+                                    const PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout,
+                                    BYTE* WINPR_RESTRICT planes[4])
+{
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i v[4] = { LOAD_SI128(&src[4 * x]), LOAD_SI128(&src[4 * x + 16]),
+			                   LOAD_SI128(&src[4 * x + 32]), LOAD_SI128(&src[4 * x + 48]) };
+
+		if (layout->alpha)
+			STORE_SI128(&planes[0][x], planar_channel_sse2(v, layout->a));
+		else
+			STORE_SI128(&planes[0][x], _mm_set1_epi8((char)0xFF));
+		STORE_SI128(&planes[1][x], planar_channel_sse2(v, layout->r));
+		STORE_SI128(&planes[2][x], planar_channel_sse2(v, layout->g));
+		STORE_SI128(&planes[3][x], planar_channel_sse2(v, layout->b));
+	}
+
+	BYTE* tail[4] = { &planes[0][x], &planes[1][x], &planes[2][x], &planes[3][x] };
+	planar_split_row32_generic(&src[4 * x], width - x, layout, tail);
+}
+
+static void planar_delta_encode_row_sse2(const BYTE* WINPR_RESTRICT cur,
+                                         const BYTE* WINPR_RESTRICT prev, BYTE* WINPR_RESTRICT dst,
+                                         size_t width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const __m128i delta = _mm_sub_epi8(LOAD_SI128(&cur[x]), LOAD_SI128(&prev[x]));
+		const __m128i sign = _mm_cmpgt_epi8(zero, delta);
+		STORE_SI128(&dst[x], _mm_xor_si128(_mm_add_epi8(delta, delta), sign));
+	}
+
+	planar_delta_encode_row_generic(&cur[x], &prev[x], &dst[x], width - x);
+}
+
+static size_t planar_rle_scan_run_sse2(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const __m128i eq = _mm_cmpeq_epi8(LOAD_SI128(&in[x]), LOAD_SI128(&in[x + 1]));
+		if (_mm_movemask_epi8(eq) != 0xFFFF)
+			break;
+	}
+
+	return x + planar_rle_scan_run_generic(&in[x], max - x);
+}
+
+static size_t planar_rle_scan_literal_sse2(const BYTE* WINPR_RESTRICT in, size_t max)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= max; x += 16)
+	{
+		const __m128i eq = _mm_cmpeq_epi8(LOAD_SI128(&in[x]), LOAD_SI128(&in[x + 1]));
+		if (_mm_movemask_epi8(eq) != 0)
+			break;
+	}
+
+	return x + planar_rle_scan_literal_generic(&in[x], max - x);
+}
+#endif
+
+void planar_init_sse2_int(PLANAR_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2/SSE3 optimizations");
+	fn->split_row32 = planar_split_row32_sse2;
+	fn->delta_encode_row = planar_delta_encode_row_sse2;
+	fn->rle_scan_run = planar_rle_scan_run_sse2;
+	fn->rle_scan_literal = planar_rle_scan_literal_sse2;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
@@ -0,0 +1,238 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX Codec Library - AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "../rfx_types.h"
+#include "../rfx_quantization.h"
+#include "rfx_avx2.h"
+
+#include "../../core/simd.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <immintrin.h>
+
+static inline __m256i rfx_load_avx2(const INT16* WINPR_RESTRICT ptr, __m128i shift)
+{
+	return _mm256_sll_epi16(_mm256_loadu_si256((const __m256i*)ptr), shift);
+}
+
+/* Selects the lanes of the 16 coefficients starting at offset that are in the given column */
+static inline __m256i rfx_column_mask_avx2(size_t subband_width, size_t offset, size_t column)
+{
+	INT16 mask[16] = WINPR_C_ARRAY_INIT;
+
+	for (size_t k = 0; k < ARRAYSIZE(mask); k++)
+	{
+		if (((offset + k) % subband_width) == column)
+			mask[k] = -1;
+	}
+
+	return _mm256_loadu_si256((const __m256i*)mask);
+}
+
+/* The rows of a sub-band are consecutive, so the horizontal pass runs over the whole sub-band
+ * 16 coefficients at a time. The first and last column masks apply the row edge rules.
+ * The coefficients are dequantised on load by lshift and hshift. */
+static void rfx_dwt_2d_decode_block_horiz_avx2(INT16* WINPR_RESTRICT l,
+                                               const INT16* WINPR_RESTRICT h,
+                                               INT16* WINPR_RESTRICT dst, size_t subband_width,
+                                               __m128i lshift, __m128i hshift)
+{
+	const size_t count = subband_width * subband_width;
+	const size_t period = (subband_width > 16) ? subband_width / 16 : 1;
+	const __m256i one = _mm256_set1_epi16(1);
+	__m256i first[2];
+	__m256i last[2];
+
+	WINPR_ASSERT(period <= ARRAYSIZE(first));
+
+	for (size_t p = 0; p < period; p++)
+	{
+		first[p] = rfx_column_mask_avx2(subband_width, 16 * p, 0);
+		last[p] = rfx_column_mask_avx2(subband_width, 16 * p, subband_width - 1);
+	}
+
+	/* Even coefficients, dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1) with h[-1] = h[0] */
+	for (size_t i = 0; i < count; i += 16)
+	{
+		const size_t p = (i / 16) % period;
+		const __m256i h_n_raw = _mm256_loadu_si256((const __m256i*)&h[i]);
+		const __m256i h_n_m_raw = _mm256_loadu_si256((const __m256i*)(h + i - 1));
+		const __m256i h_n = _mm256_sll_epi16(h_n_raw, hshift);
+		const __m256i h_n_m =
+		    _mm256_sll_epi16(_mm256_blendv_epi8(h_n_m_raw, h_n_raw, first[p]), hshift);
+		const __m256i l_n = rfx_load_avx2(&l[i], lshift);
+
+		__m256i tmp = _mm256_add_epi16(_mm256_add_epi16(h_n, h_n_m), one);
+		tmp = _mm256_srai_epi16(tmp, 1);
+		_mm256_storeu_si256((__m256i*)&l[i], _mm256_sub_epi16(l_n, tmp));
+	}
+
+	/* Odd coefficients, dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1) with
+	 * dst[2 * subband_width] = dst[2 * subband_width - 2] */
+	for (size_t i = 0; i < count; i += 16)
+	{
+		const size_t p = (i / 16) % period;
+		const __m256i h_n = _mm256_slli_epi16(rfx_load_avx2(&h[i], hshift), 1);
+		const __m256i dst_n = _mm256_loadu_si256((const __m256i*)&l[i]);
+		const __m256i dst_n_p =
+		    _mm256_blendv_epi8(_mm256_loadu_si256((const __m256i*)&l[i + 1]), dst_n, last[p]);
+
+		__m256i tmp = _mm256_srai_epi16(_mm256_add_epi16(dst_n_p, dst_n), 1);
+		tmp = _mm256_add_epi16(tmp, h_n);
+
+		const __m256i lo = _mm256_unpacklo_epi16(dst_n, tmp);
+		const __m256i hi = _mm256_unpackhi_epi16(dst_n, tmp);
+		_mm256_storeu_si256((__m256i*)&dst[2 * i], _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*)&dst[2 * i + 16], _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+}
+
+static inline void rfx_dwt_2d_decode_odd_row_avx2(const INT16* WINPR_RESTRICT h,
+                                                  INT16* WINPR_RESTRICT dst, size_t total_width,
+                                                  BOOL lastRow)
+{
+	for (size_t x = 0; x < total_width; x += 16)
+	{
+		/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+		const __m256i h_n = _mm256_slli_epi16(_mm256_loadu_si256((const __m256i*)&h[x]), 1);
+		const __m256i dst_n_m = _mm256_loadu_si256((const __m256i*)(dst + x - total_width));
+		const __m256i dst_n_p =
+		    lastRow ? dst_n_m : _mm256_loadu_si256((const __m256i*)(dst + x + total_width));
+
+		const __m256i tmp = _mm256_srai_epi16(_mm256_add_epi16(dst_n_m, dst_n_p), 1);
+		_mm256_storeu_si256((__m256i*)&dst[x], _mm256_add_epi16(tmp, h_n));
+	}
+}
+
+/* Each odd row is computed as soon as the even row below it is available. */
+static void rfx_dwt_2d_decode_block_vert_avx2(const INT16* WINPR_RESTRICT l,
+                                              const INT16* WINPR_RESTRICT h,
+                                              INT16* WINPR_RESTRICT dst, size_t subband_width)
+{
+	const size_t total_width = subband_width + subband_width;
+	const __m256i one = _mm256_set1_epi16(1);
+
+	for (size_t n = 0; n < subband_width; n++)
+	{
+		const INT16* l_row = &l[n * total_width];
+		const INT16* h_row = &h[n * total_width];
+		const INT16* h_row_m = (n == 0) ? h_row : h_row - total_width;
+		INT16* dst_row = &dst[2 * n * total_width];
+
+		for (size_t x = 0; x < total_width; x += 16)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+			const __m256i l_n = _mm256_loadu_si256((const __m256i*)&l_row[x]);
+			const __m256i h_n = _mm256_loadu_si256((const __m256i*)&h_row[x]);
+			const __m256i h_n_m = _mm256_loadu_si256((const __m256i*)&h_row_m[x]);
+
+			__m256i tmp = _mm256_add_epi16(_mm256_add_epi16(h_n, one), h_n_m);
+			tmp = _mm256_srai_epi16(tmp, 1);
+			_mm256_storeu_si256((__m256i*)&dst_row[x], _mm256_sub_epi16(l_n, tmp));
+		}
+
+		if (n > 0)
+			rfx_dwt_2d_decode_odd_row_avx2(h_row_m, dst_row - total_width, total_width, FALSE);
+	}
+
+	rfx_dwt_2d_decode_odd_row_avx2(&h[(subband_width - 1) * total_width],
+	                               &dst[(2 * subband_width - 1) * total_width], total_width, TRUE);
+}
+
+/* The 4 sub-bands are stored in HL(0), LH(1), HH(2), LL(3) order, shift holds the
+ * dequantisation factors in the same order. */
+static void rfx_dwt_2d_decode_block_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT idwt,
+                                         size_t subband_width, const UINT32 shift[4])
+{
+	const size_t size = subband_width * subband_width;
+	INT16* hl = buffer;
+	INT16* lh = &buffer[size];
+	INT16* hh = &buffer[2 * size];
+	INT16* ll = &buffer[3 * size];
+	INT16* l_dst = idwt;
+	INT16* h_dst = &idwt[2 * size];
+
+	rfx_dwt_2d_decode_block_horiz_avx2(ll, hl, l_dst, subband_width,
+	                                   _mm_cvtsi32_si128(WINPR_ASSERTING_INT_CAST(int, shift[3])),
+	                                   _mm_cvtsi32_si128(WINPR_ASSERTING_INT_CAST(int, shift[0])));
+	rfx_dwt_2d_decode_block_horiz_avx2(lh, hh, h_dst, subband_width,
+	                                   _mm_cvtsi32_si128(WINPR_ASSERTING_INT_CAST(int, shift[1])),
+	                                   _mm_cvtsi32_si128(WINPR_ASSERTING_INT_CAST(int, shift[2])));
+	rfx_dwt_2d_decode_block_vert_avx2(l_dst, h_dst, buffer, subband_width);
+}
+
+static void rfx_dwt_2d_decode_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer)
+{
+	const UINT32 shift[4] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(dwt_buffer);
+
+	rfx_dwt_2d_decode_block_avx2(&buffer[3840], dwt_buffer, 8, shift);
+	rfx_dwt_2d_decode_block_avx2(&buffer[3072], dwt_buffer, 16, shift);
+	rfx_dwt_2d_decode_block_avx2(&buffer[0], dwt_buffer, 32, shift);
+}
+
+/* Same result as rfx_quantization_decode followed by rfx_dwt_2d_decode. The LL band of
+ * levels 2 and 1 is the output of the previous level and is not shifted. */
+WINPR_ATTR_NODISCARD
+static BOOL rfx_quantization_dwt_2d_decode_avx2(INT16* WINPR_RESTRICT buffer,
+                                                const UINT32* WINPR_RESTRICT quantVals,
+                                                size_t nrQuantValues,
+                                                INT16* WINPR_RESTRICT dwt_buffer)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(quantVals);
+	WINPR_ASSERT(dwt_buffer);
+	WINPR_ASSERT(nrQuantValues == NR_QUANT_VALUES);
+
+	for (size_t x = 0; x < nrQuantValues; x++)
+	{
+		if (quantVals[x] < 1)
+			return FALSE;
+	}
+
+	const UINT32 shift3[4] = { quantVals[2] - 1, quantVals[1] - 1, quantVals[3] - 1,
+		                       quantVals[0] - 1 };
+	const UINT32 shift2[4] = { quantVals[5] - 1, quantVals[4] - 1, quantVals[6] - 1, 0 };
+	const UINT32 shift1[4] = { quantVals[8] - 1, quantVals[7] - 1, quantVals[9] - 1, 0 };
+
+	rfx_dwt_2d_decode_block_avx2(&buffer[3840], dwt_buffer, 8, shift3);
+	rfx_dwt_2d_decode_block_avx2(&buffer[3072], dwt_buffer, 16, shift2);
+	rfx_dwt_2d_decode_block_avx2(&buffer[0], dwt_buffer, 32, shift1);
+	return TRUE;
+}
+#endif
+
+void rfx_init_avx2_int(RFX_CONTEXT* WINPR_RESTRICT context)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_decode, "rfx_dwt_2d_decode_avx2")
+	context->dwt_2d_decode = rfx_dwt_2d_decode_avx2;
+	context->quantization_dwt_2d_decode = rfx_quantization_dwt_2d_decode_avx2;
+#else
+	WINPR_UNUSED(context);
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or WITH_AVX2 or AVX2 intrinsics not available");
+#endif
+}
@@ -0,0 +1,88 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * XCrush (RDP6.1) Bulk Data Compressor - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+#include <freerdp/log.h>
+
+#include "xcrush_sse2.h"
+
+#include "../../core/simd.h"
+#include "../../primitives/sse/prim_avxsse.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+/* Only bytes rotated by k <= 6 or k >= 25 reach the low 7 bits of the rolling hash. The 16 bit
+ * shifts carry bits over from the neighbouring byte, the masks drop them. */
+static inline __m128i xcrush_boundary_hash_sse2(const BYTE* WINPR_RESTRICT data, size_t x)
+{
+	__m128i hash = _mm_setzero_si128();
+
+	for (int k = 0; k < 7; k++)
+	{
+		const __m128i v = LOAD_SI128(&data[x + XCRUSH_WINDOW_SIZE - (size_t)k]);
+		const __m128i mask = _mm_set1_epi8((char)((0xFF << k) & XCRUSH_BOUNDARY_MASK));
+		hash = _mm_xor_si128(hash, _mm_and_si128(_mm_sll_epi16(v, _mm_cvtsi32_si128(k)), mask));
+	}
+
+	for (int s = 1; s < 8; s++)
+	{
+		const __m128i v = LOAD_SI128(&data[x + (size_t)s]);
+		const __m128i mask = _mm_set1_epi8((char)((0xFF >> s) & XCRUSH_BOUNDARY_MASK));
+		hash = _mm_xor_si128(hash, _mm_and_si128(_mm_srl_epi16(v, _mm_cvtsi32_si128(s)), mask));
+	}
+
+	return hash;
+}
+
+static size_t xcrush_find_boundary_sse2(const BYTE* WINPR_RESTRICT data, size_t offset,
+                                        size_t end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t x = offset;
+
+	for (; x + 16 <= end; x += 16)
+	{
+		const __m128i hash = xcrush_boundary_hash_sse2(data, x);
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(hash, zero));
+
+		if (mask != 0)
+		{
+			for (size_t i = 0; i < 16; i++)
+			{
+				if (mask & (1 << i))
+					return x + i;
+			}
+		}
+	}
+
+	return xcrush_find_boundary_generic(data, x, end);
+}
+#endif
+
+void xcrush_encode_init_sse2_int(XCRUSH_ENCODE_FUNCTIONS* WINPR_RESTRICT fn)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2/SSE3 optimizations");
+	fn->find_boundary = xcrush_find_boundary_sse2;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+	WINPR_UNUSED(fn);
+#endif
+}
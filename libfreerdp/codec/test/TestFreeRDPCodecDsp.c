@@ -0,0 +1,373 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/types.h>
+#include <freerdp/codec/audio.h>
+#include <freerdp/codec/dsp.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* number of output frames at the start of the stream ignored for signal level checks */
+#define SETTLE_FRAMES 64
+
+static AUDIO_FORMAT pcm_format(UINT16 channels, UINT32 rate)
+{
+	const AUDIO_FORMAT format = { .wFormatTag = WAVE_FORMAT_PCM,
+		                          .nChannels = channels,
+		                          .nSamplesPerSec = rate,
+		                          .nAvgBytesPerSec = rate * channels * 2,
+		                          .nBlockAlign = channels * 2,
+		                          .wBitsPerSample = 16,
+		                          .cbSize = 0,
+		                          .data = nullptr };
+	return format;
+}
+
+static INT16* create_tone(const AUDIO_FORMAT* format, double frequency, size_t frames)
+{
+	INT16* data = calloc(frames * format->nChannels, sizeof(INT16));
+	if (!data)
+		return nullptr;
+
+	for (size_t x = 0; x < frames; x++)
+	{
+		const double v = sin(2.0 * M_PI * frequency * (double)x / format->nSamplesPerSec);
+		for (size_t c = 0; c < format->nChannels; c++)
+			data[x * format->nChannels + c] = (INT16)lround(16000.0 * v);
+	}
+	return data;
+}
+
+static double channel_rms(const INT16* data, size_t frames, size_t channels, size_t channel)
+{
+	double sum = 0.0;
+	if (frames <= SETTLE_FRAMES)
+		return 0.0;
+
+	for (size_t x = SETTLE_FRAMES; x < frames; x++)
+	{
+		const double v = data[x * channels + channel];
+		sum += v * v;
+	}
+	return sqrt(sum / (double)(frames - SETTLE_FRAMES));
+}
+
+/* Convert one second of a sine tone in 10ms chunks and check length and signal level */
+static BOOL test_convert(UINT16 srcChannels, UINT32 srcRate, UINT16 dstChannels, UINT32 dstRate,
+                         double frequency, BOOL expectSignal)
+{
+	BOOL rc = FALSE;
+	const AUDIO_FORMAT srcFormat = pcm_format(srcChannels, srcRate);
+	const AUDIO_FORMAT dstFormat = pcm_format(dstChannels, dstRate);
+	const size_t chunk = srcRate / 100;
+	INT16* tone = create_tone(&srcFormat, frequency, srcRate);
+	wStream* out = Stream_New(nullptr, 1024);
+	FREERDP_DSP_CONTEXT* dsp = freerdp_dsp_context_new(TRUE);
+
+	if (!tone || !out || !dsp)
+		goto fail;
+
+	if (!freerdp_dsp_context_reset(dsp, &dstFormat, 0))
+		goto fail;
+
+	for (size_t x = 0; x < srcRate; x += chunk)
+	{
+		const BYTE* data = (const BYTE*)&tone[x * srcChannels];
+		const size_t frames = MIN(chunk, srcRate - x);
+		if (!freerdp_dsp_encode(dsp, &srcFormat, data, frames * srcChannels * sizeof(INT16), out))
+		{
+			(void)fprintf(stderr, "freerdp_dsp_encode failed\n");
+			goto fail;
+		}
+	}
+
+	{
+		const size_t frames = Stream_GetPosition(out) / sizeof(INT16) / dstChannels;
+		/* The filter delays the stream by half its length */
+		if ((frames > dstRate) || (frames + 64 < dstRate))
+		{
+			(void)fprintf(stderr, "%" PRIu32 "Hz -> %" PRIu32 "Hz: got %" PRIuz " frames\n",
+			              srcRate, dstRate, frames);
+			goto fail;
+		}
+
+		const double inRms = channel_rms(tone, srcRate, srcChannels, 0);
+		for (size_t c = 0; c < dstChannels; c++)
+		{
+			const double outRms = channel_rms(Stream_BufferAs(out, INT16), frames, dstChannels, c);
+			const double gain = outRms / inRms;
+			if (expectSignal && ((gain < 0.95) || (gain > 1.05)))
+			{
+				(void)fprintf(stderr, "%" PRIu32 "Hz -> %" PRIu32 "Hz: channel %" PRIuz
+				                      " gain %lf\n",
+				              srcRate, dstRate, c, gain);
+				goto fail;
+			}
+			if (!expectSignal && (gain > 0.01))
+			{
+				(void)fprintf(stderr, "%" PRIu32 "Hz -> %" PRIu32 "Hz: channel %" PRIuz
+				                      " alias not suppressed, gain %lf\n",
+				              srcRate, dstRate, c, gain);
+				goto fail;
+			}
+		}
+	}
+
+	rc = TRUE;
+fail:
+	freerdp_dsp_context_free(dsp);
+	Stream_Free(out, TRUE);
+	free(tone);
+	return rc;
+}
+
+static BOOL test_passthrough(void)
+{
+	BOOL rc = FALSE;
+	const AUDIO_FORMAT format = pcm_format(2, 48000);
+	INT16* tone = create_tone(&format, 440.0, 4800);
+	wStream* out = Stream_New(nullptr, 1024);
+	FREERDP_DSP_CONTEXT* dsp = freerdp_dsp_context_new(TRUE);
+
+	if (!tone || !out || !dsp)
+		goto fail;
+
+	if (!freerdp_dsp_context_reset(dsp, &format, 0))
+		goto fail;
+
+	if (!freerdp_dsp_encode(dsp, &format, (const BYTE*)tone, 4800 * 2 * sizeof(INT16), out))
+		goto fail;
+
+	if (Stream_GetPosition(out) != 4800 * 2 * sizeof(INT16))
+		goto fail;
+
+	if (memcmp(Stream_Buffer(out), tone, Stream_GetPosition(out)) != 0)
+		goto fail;
+
+	rc = TRUE;
+fail:
+	freerdp_dsp_context_free(dsp);
+	Stream_Free(out, TRUE);
+	free(tone);
+	return rc;
+}
+
+static INT32 downmix_sample(UINT16 bits, size_t channel)
+{
+	/* 8 bit PCM is unsigned with a bias of 128 */
+	if (bits == 8)
+		return 128 + ((channel & 1) ? -1 : 1) * (INT32)(10 * channel + 5);
+	return ((channel & 1) ? -1 : 1) * (INT32)(1000 * channel + 500);
+}
+
+/* Averages are rounded towards negative infinity */
+static INT32 downmix_average(INT32 sum, INT32 count)
+{
+	if (sum < 0)
+		sum -= count - 1;
+	return sum / count;
+}
+
+/* Every destination channel must be the average of the source channels folded onto it */
+static BOOL test_downmix(UINT16 bits, UINT16 srcChannels, UINT16 dstChannels)
+{
+	BOOL rc = FALSE;
+	const size_t frames = 480;
+	const size_t bpp = bits / 8;
+	AUDIO_FORMAT srcFormat = pcm_format(srcChannels, 48000);
+	AUDIO_FORMAT dstFormat = pcm_format(dstChannels, 48000);
+	BYTE* data = calloc(frames * srcChannels, bpp);
+	wStream* out = Stream_New(nullptr, 1024);
+	FREERDP_DSP_CONTEXT* dsp = freerdp_dsp_context_new(TRUE);
+
+	srcFormat.wBitsPerSample = bits;
+	srcFormat.nBlockAlign = (UINT16)(srcChannels * bpp);
+	srcFormat.nAvgBytesPerSec = 48000u * srcFormat.nBlockAlign;
+	dstFormat.wBitsPerSample = bits;
+	dstFormat.nBlockAlign = (UINT16)(dstChannels * bpp);
+	dstFormat.nAvgBytesPerSec = 48000u * dstFormat.nBlockAlign;
+
+	if (!data || !out || !dsp)
+		goto fail;
+
+	for (size_t x = 0; x < frames; x++)
+	{
+		for (size_t c = 0; c < srcChannels; c++)
+		{
+			const size_t pos = x * srcChannels + c;
+			if (bits == 8)
+				data[pos] = (BYTE)downmix_sample(bits, c);
+			else
+				((INT16*)data)[pos] = (INT16)downmix_sample(bits, c);
+		}
+	}
+
+	if (!freerdp_dsp_context_reset(dsp, &dstFormat, 0))
+		goto fail;
+
+	if (!freerdp_dsp_encode(dsp, &srcFormat, data, frames * srcChannels * bpp, out))
+		goto fail;
+
+	if (Stream_GetPosition(out) != frames * dstChannels * bpp)
+	{
+		(void)fprintf(stderr, "%" PRIu16 "bit %" PRIu16 " -> %" PRIu16 " channels: got %" PRIuz
+		                      " bytes\n",
+		              bits, srcChannels, dstChannels, Stream_GetPosition(out));
+		goto fail;
+	}
+
+	const BYTE* pcm8 = Stream_Buffer(out);
+	const INT16* pcm16 = Stream_BufferAs(out, INT16);
+	for (size_t c = 0; c < dstChannels; c++)
+	{
+		INT32 sum = 0;
+		INT32 count = 0;
+		for (size_t y = c; y < srcChannels; y += dstChannels)
+		{
+			sum += downmix_sample(bits, y);
+			count++;
+		}
+		const INT32 expected = downmix_average(sum, count);
+
+		for (size_t x = 0; x < frames; x++)
+		{
+			const size_t pos = x * dstChannels + c;
+			const INT32 value = (bits == 8) ? pcm8[pos] : pcm16[pos];
+			if (value != expected)
+			{
+				(void)fprintf(stderr,
+				              "%" PRIu16 "bit %" PRIu16 " -> %" PRIu16 " channels: channel %" PRIuz
+				              " is %" PRId32 ", expected %" PRId32 "\n",
+				              bits, srcChannels, dstChannels, c, value, expected);
+				goto fail;
+			}
+		}
+	}
+
+	rc = TRUE;
+fail:
+	freerdp_dsp_context_free(dsp);
+	Stream_Free(out, TRUE);
+	free(data);
+	return rc;
+}
+
+/* Stereo to mono uses dedicated kernels, it must round like the generic 4 -> 2 downmix */
+static BOOL test_downmix_rounding(void)
+{
+	BOOL rc = FALSE;
+	const size_t frames = 251;
+	const AUDIO_FORMAT stereo = pcm_format(2, 48000);
+	const AUDIO_FORMAT quad = pcm_format(4, 48000);
+	const AUDIO_FORMAT mono = pcm_format(1, 48000);
+	INT16* src2 = calloc(frames * 2, sizeof(INT16));
+	INT16* src4 = calloc(frames * 4, sizeof(INT16));
+	wStream* out1 = Stream_New(nullptr, 1024);
+	wStream* out2 = Stream_New(nullptr, 1024);
+	FREERDP_DSP_CONTEXT* dsp1 = freerdp_dsp_context_new(TRUE);
+	FREERDP_DSP_CONTEXT* dsp2 = freerdp_dsp_context_new(TRUE);
+
+	if (!src2 || !src4 || !out1 || !out2 || !dsp1 || !dsp2)
+		goto fail;
+
+	/* odd and negative sums, including the extremes */
+	for (size_t x = 0; x < frames; x++)
+	{
+		const INT16 left = (INT16)((INT32)((x * 7919u) % 65536u) - 32768);
+		const INT16 right = (INT16)((INT32)((x * 104729u + 1u) % 65536u) - 32768);
+		src2[2 * x] = left;
+		src2[2 * x + 1] = right;
+		src4[4 * x] = left;
+		src4[4 * x + 1] = left;
+		src4[4 * x + 2] = right;
+		src4[4 * x + 3] = right;
+	}
+
+	if (!freerdp_dsp_context_reset(dsp1, &mono, 0) ||
+	    !freerdp_dsp_context_reset(dsp2, &stereo, 0))
+		goto fail;
+	if (!freerdp_dsp_encode(dsp1, &stereo, (const BYTE*)src2, frames * 2 * sizeof(INT16), out1))
+		goto fail;
+	if (!freerdp_dsp_encode(dsp2, &quad, (const BYTE*)src4, frames * 4 * sizeof(INT16), out2))
+		goto fail;
+
+	if ((Stream_GetPosition(out1) != frames * sizeof(INT16)) ||
+	    (Stream_GetPosition(out2) != frames * 2 * sizeof(INT16)))
+		goto fail;
+
+	const INT16* pcm1 = Stream_BufferAs(out1, INT16);
+	const INT16* pcm2 = Stream_BufferAs(out2, INT16);
+	for (size_t x = 0; x < frames; x++)
+	{
+		const INT32 expected = downmix_average(src2[2 * x] + src2[2 * x + 1], 2);
+		if ((pcm1[x] != expected) || (pcm2[2 * x] != expected) || (pcm2[2 * x + 1] != expected))
+		{
+			(void)fprintf(stderr,
+			              "frame %" PRIuz ": stereo -> mono %" PRId16 ", 4 -> 2 %" PRId16
+			              ", expected %" PRId32 "\n",
+			              x, pcm1[x], pcm2[2 * x], expected);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	freerdp_dsp_context_free(dsp1);
+	freerdp_dsp_context_free(dsp2);
+	Stream_Free(out1, TRUE);
+	Stream_Free(out2, TRUE);
+	free(src2);
+	free(src4);
+	return rc;
+}
+
+int TestFreeRDPCodecDsp(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_passthrough())
+		return -1;
+
+	/* generic channel layouts, 16 bit and 8 bit */
+	for (UINT16 bits = 8; bits <= 16; bits += 8)
+	{
+		if (!test_downmix(bits, 6, 2))
+			return -1;
+		if (!test_downmix(bits, 3, 2))
+			return -1;
+		if (!test_downmix(bits, 4, 1))
+			return -1;
+	}
+
+	if (!test_downmix_rounding())
+		return -1;
+
+	/* common rate pairs, with and without channel mixing */
+	if (!test_convert(2, 44100, 2, 48000, 1000.0, TRUE))
+		return -1;
+	if (!test_convert(2, 48000, 2, 44100, 1000.0, TRUE))
+		return -1;
+	if (!test_convert(2, 48000, 1, 16000, 1000.0, TRUE))
+		return -1;
+	if (!test_convert(1, 16000, 2, 48000, 1000.0, TRUE))
+		return -1;
+	if (!test_convert(1, 22050, 1, 44100, 1000.0, TRUE))
+		return -1;
+	if (!test_convert(2, 44100, 1, 44100, 1000.0, TRUE))
+		return -1;
+
+	/* content above the target nyquist frequency must be filtered */
+	if (!test_convert(1, 48000, 1, 16000, 12000.0, FALSE))
+		return -1;
+	if (!test_convert(2, 44100, 2, 22050, 15000.0, FALSE))
+		return -1;
+
+	return 0;
+}
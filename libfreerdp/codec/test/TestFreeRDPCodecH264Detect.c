@@ -0,0 +1,161 @@
+#include <winpr/crt.h>
+
+#include <freerdp/codec/h264.h>
+
+#include "../h264.h"
+
+#define TEST_SIZE 128
+
+typedef struct
+{
+	BYTE* planes[4][3];
+	BYTE* cur444[3];
+	BYTE* old444[3];
+	BYTE* cur[3];
+	BYTE* old[3];
+} test_views_t;
+
+static void test_views_free(test_views_t* views)
+{
+	for (size_t x = 0; x < 4; x++)
+	{
+		for (size_t y = 0; y < 3; y++)
+			free(views->planes[x][y]);
+	}
+}
+
+/* Change detection reads every plane with the full height */
+static BOOL test_views_init(test_views_t* views, const UINT32 iStride[3])
+{
+	for (size_t x = 0; x < 4; x++)
+	{
+		for (size_t y = 0; y < 3; y++)
+		{
+			views->planes[x][y] = calloc(iStride[y], TEST_SIZE);
+			if (!views->planes[x][y])
+				return FALSE;
+		}
+	}
+
+	for (size_t y = 0; y < 3; y++)
+	{
+		views->cur444[y] = views->planes[0][y];
+		views->old444[y] = views->planes[1][y];
+		views->cur[y] = views->planes[2][y];
+		views->old[y] = views->planes[3][y];
+	}
+	return TRUE;
+}
+
+static BOOL test_meta(const char* name, size_t frame, const RDPGFX_H264_METABLOCK* meta,
+                      const RECTANGLE_16* expected)
+{
+	const UINT32 count = expected ? 1 : 0;
+
+	if ((meta->numRegionRects != count) ||
+	    (expected && (memcmp(meta->regionRects, expected, sizeof(RECTANGLE_16)) != 0)))
+	{
+		(void)fprintf(stderr, "frame %" PRIuz ": %s view has %" PRIu32 " rects, expected %" PRIu32
+		                      "\n",
+		              frame, name, meta->numRegionRects, count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL test_detect(H264_CONTEXT* h264, test_views_t* views, size_t frame,
+                        const RECTANGLE_16* main, const RECTANGLE_16* aux)
+{
+	const RECTANGLE_16 region = { 0, 0, TEST_SIZE, TEST_SIZE };
+	RDPGFX_H264_METABLOCK meta = WINPR_C_ARRAY_INIT;
+	RDPGFX_H264_METABLOCK auxMeta = WINPR_C_ARRAY_INIT;
+
+	const BOOL rc = avc444_detect_changes(h264, &region, views->cur444, views->old444, views->cur,
+	                                      views->old, &meta, &auxMeta) &&
+	                test_meta("main", frame, &meta, main) && test_meta("aux", frame, &auxMeta, aux);
+	free_h264_metablock(&meta);
+	free_h264_metablock(&auxMeta);
+	return rc;
+}
+
+static BOOL test_detect_changes(BOOL worker)
+{
+	BOOL rc = FALSE;
+	test_views_t views = WINPR_C_ARRAY_INIT;
+	const RECTANGLE_16 region = { 0, 0, TEST_SIZE, TEST_SIZE };
+	const RECTANGLE_16 topRight = { 64, 0, 128, 64 };
+	const RECTANGLE_16 bottomLeft = { 0, 64, 64, 128 };
+
+	H264_CONTEXT* h264 = calloc(1, sizeof(H264_CONTEXT));
+	if (!h264)
+		return FALSE;
+
+	h264->iStride[0] = TEST_SIZE;
+	h264->iStride[1] = TEST_SIZE / 2;
+	h264->iStride[2] = TEST_SIZE / 2;
+
+	if (!test_views_init(&views, h264->iStride))
+		goto fail;
+	if (worker && !h264_detect_worker_init(h264))
+		goto fail;
+
+	/* Nothing was encoded yet, both views are sent completely */
+	if (!test_detect(h264, &views, 0, &region, &region))
+		goto fail;
+
+	h264->firstLumaFrameDone = TRUE;
+	h264->firstChromaFrameDone = TRUE;
+
+	/* The worker is reused for every frame, each result belongs to its own view */
+	for (size_t frame = 1; frame < 200; frame++)
+	{
+		const BYTE value = (BYTE)frame;
+
+		switch (frame % 4)
+		{
+			case 0:
+				if (!test_detect(h264, &views, frame, nullptr, nullptr))
+					goto fail;
+				break;
+			case 1:
+				views.cur[0][10 * TEST_SIZE + 70] = value;
+				if (!test_detect(h264, &views, frame, nullptr, &topRight))
+					goto fail;
+				views.old[0][10 * TEST_SIZE + 70] = value;
+				break;
+			case 2:
+				views.cur444[1][80 * TEST_SIZE / 2 + 5] = value;
+				if (!test_detect(h264, &views, frame, &bottomLeft, nullptr))
+					goto fail;
+				views.old444[1][80 * TEST_SIZE / 2 + 5] = value;
+				break;
+			default:
+				views.cur444[0][100 * TEST_SIZE + 20] = value;
+				views.cur[2][5 * TEST_SIZE / 2 + 40] = value;
+				if (!test_detect(h264, &views, frame, &bottomLeft, &topRight))
+					goto fail;
+				views.old444[0][100 * TEST_SIZE + 20] = value;
+				views.old[2][5 * TEST_SIZE / 2 + 40] = value;
+				break;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	h264_detect_worker_free(h264);
+	free(h264);
+	test_views_free(&views);
+	return rc;
+}
+
+int TestFreeRDPCodecH264Detect(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_detect_changes(FALSE))
+		return -1;
+	if (!test_detect_changes(TRUE))
+		return -1;
+	return 0;
+}
@@ -19,7 +19,49 @@
 
 // #define CREATE_TEST_OUTPUT
 
-static bool run_encode_decode_single(UINT16 bpp, BITMAP_INTERLEAVED_CONTEXT* encoder,
+/* Fill a bitmap with the runs the encoder looks for: repeated lines, single colour runs,
+ * alternating colour pairs and random pixels */
+static bool fill_runs(BYTE* data, UINT32 w, UINT32 h, size_t step)
+{
+	UINT32 colors[4] = WINPR_C_ARRAY_INIT;
+
+	for (UINT32 y = 0; y < h; y++)
+	{
+		BYTE* line = &data[y * step];
+		BYTE kind = 0;
+
+		if (winpr_RAND(&kind, sizeof(kind)) < 0)
+			return false;
+
+		if ((y > 0) && ((kind % 4) == 0))
+		{
+			memcpy(line, &data[(y - 1) * step], 4ULL * w);
+			continue;
+		}
+
+		for (UINT32 x = 0; x < w;)
+		{
+			BYTE len = 0;
+			if ((winpr_RAND(&len, sizeof(len)) < 0) || (winpr_RAND(colors, sizeof(colors)) < 0))
+				return false;
+
+			const UINT32 end = MIN(w, x + 1 + (len % 24));
+			for (; x < end; x++)
+			{
+				UINT32 color = colors[0];
+				if ((len % 3) == 1)
+					color = colors[x % 2];
+				else if ((len % 3) == 2)
+					color = colors[x % 4];
+				FreeRDPWriteColor(&line[4ULL * x], PIXEL_FORMAT_RGBX32, color);
+			}
+		}
+	}
+
+	return true;
+}
+
+static bool run_encode_decode_single(UINT16 bpp, bool runs, BITMAP_INTERLEAVED_CONTEXT* encoder,
                                      BITMAP_INTERLEAVED_CONTEXT* decoder
 #if defined(WITH_PROFILER)
                                      ,
@@ -46,7 +88,12 @@ static bool run_encode_decode_single(UINT16 bpp, BITMAP_INTERLEAVED_CONTEXT* enc
 	if (!pSrcData || !pDstData || !tmp)
 		goto fail;
 
-	if (winpr_RAND(pSrcData, SrcSize) < 0)
+	if (runs)
+	{
+		if (!fill_runs(pSrcData, w, h, step))
+			goto fail;
+	}
+	else if (winpr_RAND(pSrcData, SrcSize) < 0)
 		goto fail;
 
 	if (!bitmap_interleaved_context_reset(encoder) || !bitmap_interleaved_context_reset(decoder))
@@ -143,7 +190,7 @@ static bool run_encode_decode(UINT16 bpp, BITMAP_INTERLEAVED_CONTEXT* encoder,
 
 	for (UINT32 x = 0; x < 50; x++)
 	{
-		if (!run_encode_decode_single(bpp, encoder, decoder
+		if (!run_encode_decode_single(bpp, (x % 2) != 0, encoder, decoder
 #if defined(WITH_PROFILER)
 		                              ,
 		                              profiler_comp, profiler_decomp
@@ -2,6 +2,7 @@
 #include <winpr/print.h>
 
 #include "../ncrush.h"
+#include "TestFreeRDPHelpers.h"
 
 static const BYTE TEST_BELLS_DATA[] = "for.whom.the.bell.tolls,.the.bell.tolls.for.thee!";
 
@@ -107,6 +108,37 @@ fail:
 	return rc;
 }
 
+static int test_ncrush_compress(void* context, const BYTE* pSrcData, UINT32 SrcSize,
+                                BYTE* pDstBuffer, const BYTE** ppDstData, UINT32* pDstSize,
+                                UINT32* pFlags)
+{
+	return ncrush_compress(context, pSrcData, SrcSize, pDstBuffer, ppDstData, pDstSize, pFlags);
+}
+
+static int test_ncrush_decompress(void* context, const BYTE* pSrcData, UINT32 SrcSize,
+                                  const BYTE** ppDstData, UINT32* pDstSize, UINT32 flags)
+{
+	return ncrush_decompress(context, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+}
+
+/* Compress a stream of packets and check ncrush_decompress restores them */
+static BOOL test_NCrushRoundtrip(UINT32 effort, const char* name)
+{
+	BOOL rc = FALSE;
+	NCRUSH_CONTEXT* encoder = ncrush_context_new(TRUE);
+	NCRUSH_CONTEXT* decoder = ncrush_context_new(FALSE);
+
+	if (!encoder || !decoder || !ncrush_context_set_effort(encoder, effort))
+		goto fail;
+
+	rc = test_codec_helper_bulk_roundtrip(name, encoder, test_ncrush_compress, decoder,
+	                                      test_ncrush_decompress);
+fail:
+	ncrush_context_free(encoder);
+	ncrush_context_free(decoder);
+	return rc;
+}
+
 int TestFreeRDPCodecNCrush(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -118,5 +150,14 @@ int TestFreeRDPCodecNCrush(int argc, char* argv[])
 	if (!test_NCrushDecompressBells())
 		return -1;
 
+	if (!test_NCrushRoundtrip(NCRUSH_EFFORT_FAST, "NCrushRoundtripFast"))
+		return -1;
+
+	if (!test_NCrushRoundtrip(NCRUSH_EFFORT_DEFAULT, "NCrushRoundtripDefault"))
+		return -1;
+
+	if (!test_NCrushRoundtrip(NCRUSH_EFFORT_BEST, "NCrushRoundtripBest"))
+		return -1;
+
 	return 0;
 }
@@ -0,0 +1,306 @@
+#include <stdio.h>
+
+#include <winpr/assert.h>
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+
+#include <freerdp/codec/nsc.h>
+#include <freerdp/codec/color.h>
+
+#if defined(BUILD_TESTING_INTERNAL)
+#include "../nsc_types.h"
+#include "../nsc_encode.h"
+#include "../sse/nsc_sse2.h"
+#include "../sse/nsc_avx2.h"
+#endif
+
+static BOOL fill_image(BYTE* data, UINT32 format, UINT32 width, UINT32 height, UINT32 stride)
+{
+	WINPR_ASSERT((width <= 128) && (height <= 85));
+
+	const size_t bpp = FreeRDPGetBytesPerPixel(format);
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			/* Smooth gradients, subsampling must not destroy them */
+			const BYTE r = (BYTE)(2 * x);
+			const BYTE g = (BYTE)(255 - 3 * y);
+			const BYTE b = (BYTE)((x + y) / 2);
+			const BYTE a = (BYTE)(7 * x + y);
+			const UINT32 color = FreeRDPGetColor(format, r, g, b, a);
+			if (!FreeRDPWriteColor(&data[y * stride + x * bpp], format, color))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static BOOL compare_image(const BYTE* src, UINT32 srcFormat, UINT32 srcStride, const BYTE* dst,
+                          UINT32 dstStride, UINT32 width, UINT32 height, UINT32 tolerance)
+{
+	const size_t srcBpp = FreeRDPGetBytesPerPixel(srcFormat);
+	const BOOL alpha = FreeRDPColorHasAlpha(srcFormat);
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			BYTE sr = 0;
+			BYTE sg = 0;
+			BYTE sb = 0;
+			BYTE sa = 0;
+			BYTE dr = 0;
+			BYTE dg = 0;
+			BYTE db = 0;
+			BYTE da = 0;
+			const UINT32 scolor = FreeRDPReadColor(&src[y * srcStride + x * srcBpp], srcFormat);
+			const UINT32 dcolor = FreeRDPReadColor(&dst[y * dstStride + x * 4ull],
+			                                       PIXEL_FORMAT_BGRA32);
+			FreeRDPSplitColor(scolor, srcFormat, &sr, &sg, &sb, &sa, nullptr);
+			FreeRDPSplitColor(dcolor, PIXEL_FORMAT_BGRA32, &dr, &dg, &db, &da, nullptr);
+
+			if ((abs(sr - dr) > (int)tolerance) || (abs(sg - dg) > (int)tolerance) ||
+			    (abs(sb - db) > (int)tolerance) || (alpha && (sa != da)))
+			{
+				(void)fprintf(stderr,
+				              "[%s] pixel %" PRIu32 "x%" PRIu32 " %02" PRIx8 "%02" PRIx8
+				              "%02" PRIx8 "%02" PRIx8 " decoded as %02" PRIx8 "%02" PRIx8
+				              "%02" PRIx8 "%02" PRIx8 "\n",
+				              FreeRDPGetColorFormatName(srcFormat), x, y, sr, sg, sb, sa, dr,
+				              dg, db, da);
+				return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+static BOOL test_roundtrip(UINT32 format, UINT32 width, UINT32 height, UINT32 colorLoss,
+                           BOOL subsampling)
+{
+	BOOL rc = FALSE;
+	/* The color loss level removes low bits of the chroma planes,
+	 * the encoder does not replicate the high bits of 16bpp colors into the low ones */
+	const UINT32 bpp = FreeRDPGetBytesPerPixel(format);
+	const UINT32 tolerance = (1u << colorLoss) + (subsampling ? 6 : 2) + ((bpp == 2) ? 4 : 0);
+	const UINT32 stride = width * bpp + 4;
+	const UINT32 dstStride = width * 4;
+	BYTE* src = calloc(stride, height);
+	BYTE* dst = calloc(dstStride, height);
+	wStream* s = Stream_New(nullptr, 1024);
+	NSC_CONTEXT* context = nsc_context_new();
+
+	if (!src || !dst || !s || !context)
+		goto fail;
+
+	if (!fill_image(src, format, width, height, stride))
+		goto fail;
+
+	if (!nsc_context_set_parameters(context, NSC_COLOR_FORMAT, format) ||
+	    !nsc_context_set_parameters(context, NSC_COLOR_LOSS_LEVEL, colorLoss) ||
+	    !nsc_context_set_parameters(context, NSC_ALLOW_SUBSAMPLING, subsampling ? 1 : 0))
+		goto fail;
+
+	if (!nsc_context_reset(context, width, height))
+		goto fail;
+
+	if (!nsc_compose_message(context, s, src, width, height, stride))
+		goto fail;
+
+	/* The encoder stores the lines bottom up */
+	if (!nsc_process_message(context, 32, width, height, Stream_Buffer(s),
+	                         (UINT32)Stream_GetPosition(s), dst, PIXEL_FORMAT_BGRA32, dstStride, 0,
+	                         0, width, height, FREERDP_FLIP_VERTICAL))
+		goto fail;
+
+	rc = compare_image(src, format, stride, dst, dstStride, width, height, tolerance);
+fail:
+	if (!rc)
+		(void)fprintf(stderr,
+		              "NSCodec roundtrip %s %" PRIu32 "x%" PRIu32 " loss %" PRIu32
+		              " subsampling %d failed\n",
+		              FreeRDPGetColorFormatName(format), width, height, colorLoss, subsampling);
+	nsc_context_free(context);
+	Stream_Free(s, TRUE);
+	free(src);
+	free(dst);
+	return rc;
+}
+
+#if defined(BUILD_TESTING_INTERNAL)
+typedef enum
+{
+	NSC_TEST_GENERIC,
+	NSC_TEST_SSE2,
+	NSC_TEST_AVX2
+} nsc_test_impl;
+
+static const char* nsc_test_impl_name(nsc_test_impl impl)
+{
+	switch (impl)
+	{
+		case NSC_TEST_SSE2:
+			return "SSE2";
+		case NSC_TEST_AVX2:
+			return "AVX2";
+		case NSC_TEST_GENERIC:
+		default:
+			return "generic";
+	}
+}
+
+/* Select the encoder kernels like nsc_context_new does, limited to impl */
+static BOOL nsc_test_select(NSC_CONTEXT* context, nsc_test_impl impl)
+{
+	context->encode = nsc_encode;
+	context->rle_encode = nsc_rle_encode;
+
+	switch (impl)
+	{
+		case NSC_TEST_GENERIC:
+			return TRUE;
+
+		case NSC_TEST_SSE2:
+			if (!IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE) ||
+			    !IsProcessorFeaturePresent(PF_SSE3_INSTRUCTIONS_AVAILABLE))
+				return FALSE;
+			nsc_init_sse2(context);
+			break;
+
+		case NSC_TEST_AVX2:
+#if defined(WITH_AVX2)
+			if (!IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+				return FALSE;
+			nsc_init_sse2(context);
+			nsc_init_avx2(context);
+			break;
+#else
+			return FALSE;
+#endif
+
+		default:
+			return FALSE;
+	}
+
+	/* Without intrinsics support the init functions keep the generic code */
+	return (context->encode != nsc_encode) && (context->rle_encode != nsc_rle_encode);
+}
+
+static wStream* nsc_test_encode(const BYTE* src, UINT32 format, UINT32 width, UINT32 height,
+                                UINT32 stride, UINT32 colorLoss, BOOL subsampling,
+                                nsc_test_impl impl, BOOL* skipped)
+{
+	wStream* s = Stream_New(nullptr, 1024);
+	NSC_CONTEXT* context = nsc_context_new();
+
+	*skipped = FALSE;
+	if (!s || !context)
+		goto fail;
+
+	if (!nsc_test_select(context, impl))
+	{
+		*skipped = TRUE;
+		goto fail;
+	}
+
+	if (!nsc_context_set_parameters(context, NSC_COLOR_FORMAT, format) ||
+	    !nsc_context_set_parameters(context, NSC_COLOR_LOSS_LEVEL, colorLoss) ||
+	    !nsc_context_set_parameters(context, NSC_ALLOW_SUBSAMPLING, subsampling ? 1 : 0))
+		goto fail;
+
+	if (!nsc_context_reset(context, width, height))
+		goto fail;
+
+	if (!nsc_compose_message(context, s, src, width, height, stride))
+		goto fail;
+
+	nsc_context_free(context);
+	return s;
+fail:
+	nsc_context_free(context);
+	Stream_Free(s, TRUE);
+	return nullptr;
+}
+
+/* The SIMD encoders must produce exactly the bytes of the generic encoder */
+static BOOL test_encoder_parity(UINT32 format, UINT32 width, UINT32 height, UINT32 colorLoss,
+                                BOOL subsampling)
+{
+	BOOL rc = FALSE;
+	BOOL skipped = FALSE;
+	const UINT32 bpp = FreeRDPGetBytesPerPixel(format);
+	const UINT32 stride = width * bpp + 4;
+	BYTE* src = calloc(stride, height);
+	wStream* reference = nullptr;
+
+	if (!src || !fill_image(src, format, width, height, stride))
+		goto fail;
+
+	reference = nsc_test_encode(src, format, width, height, stride, colorLoss, subsampling,
+	                            NSC_TEST_GENERIC, &skipped);
+	if (!reference)
+		goto fail;
+
+	rc = TRUE;
+	for (nsc_test_impl impl = NSC_TEST_SSE2; impl <= NSC_TEST_AVX2; impl++)
+	{
+		wStream* s = nsc_test_encode(src, format, width, height, stride, colorLoss, subsampling,
+		                             impl, &skipped);
+		if (skipped)
+			continue;
+
+		if (!s || (Stream_GetPosition(s) != Stream_GetPosition(reference)) ||
+		    (memcmp(Stream_Buffer(s), Stream_Buffer(reference), Stream_GetPosition(s)) != 0))
+		{
+			(void)fprintf(stderr,
+			              "NSCodec %s encoder differs from generic for %s %" PRIu32 "x%" PRIu32
+			              " loss %" PRIu32 " subsampling %d\n",
+			              nsc_test_impl_name(impl), FreeRDPGetColorFormatName(format), width,
+			              height, colorLoss, subsampling);
+			rc = FALSE;
+		}
+		Stream_Free(s, TRUE);
+	}
+
+fail:
+	Stream_Free(reference, TRUE);
+	free(src);
+	return rc;
+}
+#endif
+
+int TestFreeRDPCodecNSCodec(int argc, char* argv[])
+{
+	const UINT32 formats[] = { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_RGBX32,
+		                       PIXEL_FORMAT_RGBA32, PIXEL_FORMAT_BGR24,  PIXEL_FORMAT_RGB24,
+		                       PIXEL_FORMAT_BGR16,  PIXEL_FORMAT_RGB16 };
+	/* Odd sizes exercise the scalar tails and the padding of the vector code */
+	const UINT32 sizes[][2] = { { 64, 64 }, { 67, 35 }, { 1, 1 }, { 128, 3 } };
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (size_t f = 0; f < ARRAYSIZE(formats); f++)
+	{
+		for (size_t x = 0; x < ARRAYSIZE(sizes); x++)
+		{
+			for (UINT32 loss = 1; loss <= 3; loss += 2)
+			{
+				if (!test_roundtrip(formats[f], sizes[x][0], sizes[x][1], loss, FALSE))
+					return -1;
+				if (!test_roundtrip(formats[f], sizes[x][0], sizes[x][1], loss, TRUE))
+					return -1;
+#if defined(BUILD_TESTING_INTERNAL)
+				if (!test_encoder_parity(formats[f], sizes[x][0], sizes[x][1], loss, FALSE))
+					return -1;
+				if (!test_encoder_parity(formats[f], sizes[x][0], sizes[x][1], loss, TRUE))
+					return -1;
+#endif
+			}
+		}
+	}
+
+	return 0;
+}
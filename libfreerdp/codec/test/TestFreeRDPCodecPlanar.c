@@ -14,6 +14,10 @@
 
 #include "TestFreeRDPHelpers.h"
 
+#if defined(BUILD_TESTING_INTERNAL)
+#include "../planar_encode.h"
+#endif
+
 static const UINT32 colorFormatList[] = {
 	PIXEL_FORMAT_RGB15,  PIXEL_FORMAT_BGR15,  PIXEL_FORMAT_RGB16,  PIXEL_FORMAT_BGR16,
 	PIXEL_FORMAT_RGB24,  PIXEL_FORMAT_BGR24,  PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_ABGR32,
@@ -406,6 +410,88 @@ fail:
 	return rc;
 }
 
+static BOOL TestPlanarBands(UINT32 format, DWORD flags)
+{
+	/* Large enough to be split into bands encoded in parallel */
+	const UINT32 width = 700;
+	const UINT32 height = 500;
+	const UINT32 bpp = FreeRDPGetBytesPerPixel(format);
+	const UINT32 stride = width * bpp;
+	const BOOL alpha = FreeRDPColorHasAlpha(format);
+	BOOL rc = FALSE;
+	UINT32 size = 0;
+	UINT32 threadedSize = 0;
+	BYTE* compressed = nullptr;
+	BYTE* threaded = nullptr;
+	BYTE* src = calloc(height, stride);
+	BYTE* dst = calloc(height, stride);
+	BITMAP_PLANAR_CONTEXT* encplanar =
+	    freerdp_bitmap_planar_context_new_ex(flags, width, height, THREADING_FLAGS_DISABLE_THREADS);
+	BITMAP_PLANAR_CONTEXT* threadplanar =
+	    freerdp_bitmap_planar_context_new_ex(flags, width, height, 0);
+	BITMAP_PLANAR_CONTEXT* decplanar = freerdp_bitmap_planar_context_new(flags, width, height);
+
+	if (!src || !dst || !encplanar || !threadplanar || !decplanar)
+		goto fail;
+
+#if defined(BUILD_TESTING_INTERNAL)
+	/* Split into bands on any machine, even without a second processor */
+	if (!freerdp_bitmap_planar_context_set_band_count(threadplanar, 4))
+		goto fail;
+#endif
+
+	/* Flat areas, gradients and noise to get runs as well as raw bytes */
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			UINT32 color =
+			    FreeRDPGetColor(format, (BYTE)x, (BYTE)(y / 4), 0x40, alpha ? (BYTE)(y / 2) : 0xFF);
+			if ((y > height / 2) && (x % 7 == 0))
+				color = FreeRDPGetColor(format, (BYTE)prand(256), (BYTE)prand(256),
+				                        (BYTE)prand(256), alpha ? (BYTE)prand(256) : 0xFF);
+			if (!FreeRDPWriteColor(&src[y * stride + x * bpp], format, color))
+				goto fail;
+		}
+	}
+
+	compressed = freerdp_bitmap_compress_planar(encplanar, src, format, width, height, stride,
+	                                            nullptr, &size);
+	threaded = freerdp_bitmap_compress_planar(threadplanar, src, format, width, height, stride,
+	                                          nullptr, &threadedSize);
+	if (!compressed || !threaded)
+		goto fail;
+
+	if ((size != threadedSize) || (memcmp(compressed, threaded, size) != 0))
+	{
+		(void)fprintf(stderr, "[%s] threaded encoding differs\n",
+		              FreeRDPGetColorFormatName(format));
+		goto fail;
+	}
+
+	/* The encoder stores the lines bottom up */
+	if (!freerdp_bitmap_decompress_planar(decplanar, compressed, size, width, height, dst, format,
+	                                      stride, 0, 0, width, height, TRUE))
+		goto fail;
+
+	if (memcmp(src, dst, 1ull * height * stride) != 0)
+	{
+		(void)fprintf(stderr, "[%s] roundtrip mismatch\n", FreeRDPGetColorFormatName(format));
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	free(compressed);
+	free(threaded);
+	free(src);
+	free(dst);
+	freerdp_bitmap_planar_context_free(encplanar);
+	freerdp_bitmap_planar_context_free(threadplanar);
+	freerdp_bitmap_planar_context_free(decplanar);
+	return rc;
+}
+
 int TestFreeRDPCodecPlanar(int argc, char* argv[])
 {
 	int rc = -1;
@@ -415,6 +501,12 @@ int TestFreeRDPCodecPlanar(int argc, char* argv[])
 	if (!FuzzPlanar())
 		goto fail;
 
+	if (!TestPlanarBands(PIXEL_FORMAT_BGRX32, PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE))
+		goto fail;
+
+	if (!TestPlanarBands(PIXEL_FORMAT_BGRA32, PLANAR_FORMAT_HEADER_RLE))
+		goto fail;
+
 	for (UINT32 x = 0; x < colorFormatCount; x++)
 	{
 		if (!TestPlanar(colorFormatList[x]))
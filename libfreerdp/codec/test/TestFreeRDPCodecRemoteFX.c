@@ -4,6 +4,10 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/rfx.h>
 
+#if defined(BUILD_TESTING_INTERNAL)
+#include "../rfx_types.h"
+#endif
+
 static BYTE encodeHeaderSample[] = {
 	/* as in 4.2.2 */
 	0xc0, 0xcc, 0x0c, 0x00, 0x00, 0x00, 0xca, 0xac, 0xcc, 0xca, 0x00, 0x01, 0xc3, 0xcc, 0x0d, 0x00,
@@ -842,6 +846,136 @@ static BOOL fuzzyCompareImage(const UINT32* crefImage, const BYTE* img, size_t n
 	return TRUE;
 }
 
+#if defined(BUILD_TESTING_INTERNAL)
+#define MT_WIDTH 1024
+#define MT_HEIGHT 768
+#define MT_WORKERS 7
+
+static RFX_CONTEXT* test_rfx_context_new(BOOL encoder, UINT32 workers)
+{
+	RFX_CONTEXT* context =
+	    rfx_context_new_ex(encoder, workers == 0 ? THREADING_FLAGS_DISABLE_THREADS : 0);
+	if (!context)
+		return nullptr;
+
+	if ((workers > 0) && !rfx_context_set_worker_count(context, workers))
+	{
+		rfx_context_free(context);
+		return nullptr;
+	}
+
+	rfx_context_set_pixel_format(context, FORMAT);
+	if (!rfx_context_reset(context, MT_WIDTH, MT_HEIGHT))
+	{
+		rfx_context_free(context);
+		return nullptr;
+	}
+	return context;
+}
+
+static wStream* test_rfx_encode(const BYTE* image, UINT32 workers)
+{
+	const RFX_RECT rect = { 0, 0, MT_WIDTH, MT_HEIGHT };
+	RFX_CONTEXT* context = test_rfx_context_new(TRUE, workers);
+	wStream* s = Stream_New(nullptr, 1024);
+
+	if (!context || !s)
+		goto fail;
+
+	if (!rfx_compose_message(context, s, &rect, 1, image, MT_WIDTH, MT_HEIGHT,
+	                         MT_WIDTH * FORMAT_SIZE))
+		goto fail;
+
+	rfx_context_free(context);
+	return s;
+fail:
+	rfx_context_free(context);
+	Stream_Free(s, TRUE);
+	return nullptr;
+}
+
+static BOOL test_rfx_decode(wStream* s, BYTE* image, UINT32 workers)
+{
+	BOOL rc = FALSE;
+	REGION16 region = WINPR_C_ARRAY_INIT;
+	RFX_CONTEXT* context = test_rfx_context_new(FALSE, workers);
+
+	region16_init(&region);
+	if (!context)
+		goto fail;
+
+	rc = rfx_process_message(context, Stream_Buffer(s),
+	                         WINPR_ASSERTING_INT_CAST(UINT32, Stream_GetPosition(s)), 0, 0, image,
+	                         FORMAT, MT_WIDTH * FORMAT_SIZE, MT_HEIGHT, &region);
+fail:
+	region16_uninit(&region);
+	rfx_context_free(context);
+	return rc;
+}
+
+/* Encoding and decoding with several tile workers must give the same result as a single thread,
+ * independent of the number of processors of the host */
+static BOOL test_rfx_workers(void)
+{
+	BOOL rc = FALSE;
+	const size_t size = 1ULL * MT_WIDTH * MT_HEIGHT * FORMAT_SIZE;
+	BYTE* image = malloc(size);
+	BYTE* single = calloc(1, size);
+	BYTE* multi = calloc(1, size);
+	wStream* sSingle = nullptr;
+	wStream* sMulti = nullptr;
+
+	if (!image || !single || !multi)
+		goto fail;
+
+	/* Gradients with some noise, so tiles differ in content and cost */
+	if (winpr_RAND(image, size) < 0)
+		goto fail;
+	for (size_t y = 0; y < MT_HEIGHT; y++)
+	{
+		for (size_t x = 0; x < MT_WIDTH; x++)
+		{
+			BYTE* px = &image[(y * MT_WIDTH + x) * FORMAT_SIZE];
+			px[1] = (BYTE)((x + (px[1] & 0x0f)) & 0xff);
+			px[2] = (BYTE)((y + (px[2] & 0x0f)) & 0xff);
+			px[3] = (BYTE)(((x ^ y) + (px[3] & 0x0f)) & 0xff);
+		}
+	}
+
+	sSingle = test_rfx_encode(image, 0);
+	sMulti = test_rfx_encode(image, MT_WORKERS);
+	if (!sSingle || !sMulti)
+		goto fail;
+
+	if ((Stream_GetPosition(sSingle) != Stream_GetPosition(sMulti)) ||
+	    (memcmp(Stream_Buffer(sSingle), Stream_Buffer(sMulti), Stream_GetPosition(sSingle)) != 0))
+	{
+		(void)fprintf(stderr, "RemoteFX encoding with %d workers differs\n", MT_WORKERS);
+		goto fail;
+	}
+
+	if (!test_rfx_decode(sSingle, single, 0))
+		goto fail;
+	if (!test_rfx_decode(sSingle, multi, MT_WORKERS))
+		goto fail;
+
+	if (memcmp(single, multi, size) != 0)
+	{
+		(void)fprintf(stderr, "RemoteFX decoding with %d workers differs\n", MT_WORKERS);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(sSingle, TRUE);
+	Stream_Free(sMulti, TRUE);
+	free(image);
+	free(single);
+	free(multi);
+	return rc;
+}
+#endif
+
 int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 {
 	int rc = -1;
@@ -877,6 +1011,11 @@ int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 	if (!fuzzyCompareImage(srefImage, dest, IMG_WIDTH * IMG_HEIGHT))
 		goto fail;
 
+#if defined(BUILD_TESTING_INTERNAL)
+	if (!test_rfx_workers())
+		goto fail;
+#endif
+
 	rc = 0;
 fail:
 	region16_uninit(&region);
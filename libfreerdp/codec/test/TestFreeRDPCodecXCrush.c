@@ -2,6 +2,7 @@
 #include <winpr/print.h>
 
 #include "../xcrush.h"
+#include "TestFreeRDPHelpers.h"
 
 static const BYTE TEST_BELLS_DATA[] = "for.whom.the.bell.tolls,.the.bell.tolls.for.thee!";
 
@@ -109,6 +110,37 @@ static const struct test_argument tests[] = {
 	  sizeof(TEST_BELLS_DATA_XCRUSH) - 1 }
 };
 
+static int test_xcrush_compress(void* context, const BYTE* pSrcData, UINT32 SrcSize,
+                                BYTE* pDstBuffer, const BYTE** ppDstData, UINT32* pDstSize,
+                                UINT32* pFlags)
+{
+	return xcrush_compress(context, pSrcData, SrcSize, pDstBuffer, ppDstData, pDstSize, pFlags);
+}
+
+static int test_xcrush_decompress(void* context, const BYTE* pSrcData, UINT32 SrcSize,
+                                  const BYTE** ppDstData, UINT32* pDstSize, UINT32 flags)
+{
+	return xcrush_decompress(context, pSrcData, SrcSize, ppDstData, pDstSize, flags);
+}
+
+/* Compress a stream of packets and check xcrush_decompress restores them */
+static BOOL test_roundtrip(UINT32 effort, const char* name)
+{
+	BOOL rc = FALSE;
+	XCRUSH_CONTEXT* encoder = xcrush_context_new(TRUE);
+	XCRUSH_CONTEXT* decoder = xcrush_context_new(FALSE);
+
+	if (!encoder || !decoder || !xcrush_context_set_effort(encoder, effort))
+		goto fail;
+
+	rc = test_codec_helper_bulk_roundtrip(name, encoder, test_xcrush_compress, decoder,
+	                                      test_xcrush_decompress);
+fail:
+	xcrush_context_free(encoder);
+	xcrush_context_free(decoder);
+	return rc;
+}
+
 int TestFreeRDPCodecXCrush(int argc, char* argv[])
 {
 	int rc = 0;
@@ -124,5 +156,14 @@ int TestFreeRDPCodecXCrush(int argc, char* argv[])
 			rc = -1;
 	}
 
+	if (!test_roundtrip(XCRUSH_EFFORT_FAST, "XCrushRoundtripFast"))
+		rc = -1;
+
+	if (!test_roundtrip(XCRUSH_EFFORT_DEFAULT, "XCrushRoundtripDefault"))
+		rc = -1;
+
+	if (!test_roundtrip(XCRUSH_EFFORT_BEST, "XCrushRoundtripBest"))
+		rc = -1;
+
 	return rc;
 }
@@ -6,6 +6,10 @@
 #include <freerdp/codec/zgfx.h>
 #include <freerdp/log.h>
 
+#if defined(BUILD_TESTING_INTERNAL)
+#include "../zgfx.h"
+#endif
+
 /* Sample from [MS-RDPEGFX] */
 static const BYTE TEST_FOX_DATA[] = "The quick brown "
                                     "fox jumps over t"
@@ -253,6 +257,215 @@ fail:
 	return rc;
 }
 
+/**
+ * Round trip more than the history size, a mix of repeated text and incompressible noise.
+ * The RDP 8.0 compressor used by rdpgfx sends raw segments, the RDP 8.0 Lite one must
+ * compress the text.
+ */
+static int test_ZGfxCompressHistory(ZGFX_CONTEXT* compressor, ZGFX_CONTEXT* decompressor,
+                                    BOOL compress)
+{
+	int rc = -1;
+	UINT32 AllFlags = 0;
+	UINT64 compressedTotal = 0;
+	UINT64 uncompressedTotal = 0;
+	BYTE* buffer = malloc(70000);
+
+	if (!buffer || !compressor || !decompressor)
+		goto fail;
+
+	for (UINT32 x = 0; x < 96; x++)
+	{
+		UINT32 Flags = 0;
+		UINT32 DstSize = 0;
+		BYTE* pDstData = nullptr;
+		UINT32 OutSize = 0;
+		BYTE* pOutData = nullptr;
+		const UINT32 SrcSize = 1 + ((x * 7919u) % 70000);
+
+		for (UINT32 y = 0; y < SrcSize; y++)
+		{
+			if ((x % 3) == 0)
+				buffer[y] = (BYTE)(rand() & 0xFF);
+			else
+				buffer[y] = TEST_FOX_DATA[(y + x) % (sizeof(TEST_FOX_DATA) - 1)] ^ (BYTE)(y / 512);
+		}
+
+		if (zgfx_compress(compressor, buffer, SrcSize, &pDstData, &DstSize, &Flags) < 0)
+			goto fail;
+
+		const int status = zgfx_decompress(decompressor, pDstData, DstSize, &pOutData, &OutSize, 0);
+		const BOOL equal =
+		    (status >= 0) && (OutSize == SrcSize) && (memcmp(pOutData, buffer, SrcSize) == 0);
+		free(pDstData);
+		free(pOutData);
+
+		if (!equal)
+		{
+			printf("test_ZGfxCompressHistory: round trip %" PRIu32 " failed\n", x);
+			goto fail;
+		}
+
+		AllFlags |= Flags;
+		compressedTotal += DstSize;
+		uncompressedTotal += SrcSize;
+	}
+
+	printf("test_ZGfxCompressHistory: %" PRIu64 " -> %" PRIu64 " bytes\n", uncompressedTotal,
+	       compressedTotal);
+
+	if (compress)
+	{
+		if (compressedTotal >= uncompressedTotal / 2)
+			goto fail;
+	}
+	else if ((AllFlags & PACKET_COMPRESSED) || (compressedTotal <= uncompressedTotal))
+		goto fail;
+
+	rc = 0;
+fail:
+	free(buffer);
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	return rc;
+}
+
+/**
+ * Compressing a list of buffers, including an empty one and buffers crossing the segment
+ * size, must give the same message as compressing their concatenation.
+ */
+static int test_ZGfxCompressGather(ZGFX_CONTEXT* gather, ZGFX_CONTEXT* single)
+{
+	int rc = -1;
+	const UINT32 sizes[] = { 40000, 0, 30000, 17, 70000 };
+	const BYTE* data[ARRAYSIZE(sizes)] = WINPR_C_ARRAY_INIT;
+	UINT32 total = 0;
+	UINT32 gatherFlags = 0;
+	UINT32 singleFlags = 0;
+	wStream* sGather = Stream_New(nullptr, 1024);
+	wStream* sSingle = Stream_New(nullptr, 1024);
+
+	for (size_t x = 0; x < ARRAYSIZE(sizes); x++)
+		total += sizes[x];
+
+	BYTE* buffer = malloc(total);
+	if (!buffer || !sGather || !sSingle || !gather || !single)
+		goto fail;
+
+	for (UINT32 y = 0; y < total; y++)
+		buffer[y] = TEST_FOX_DATA[y % (sizeof(TEST_FOX_DATA) - 1)] ^ (BYTE)(y / 1024);
+
+	{
+		size_t offset = 0;
+		for (size_t x = 0; x < ARRAYSIZE(sizes); x++)
+		{
+			data[x] = &buffer[offset];
+			offset += sizes[x];
+		}
+	}
+
+	if (zgfx_compress_gather_to_stream(gather, sGather, data, sizes, ARRAYSIZE(sizes),
+	                                   &gatherFlags) < 0)
+		goto fail;
+	if (zgfx_compress_to_stream(single, sSingle, buffer, total, &singleFlags) < 0)
+		goto fail;
+
+	if ((gatherFlags != singleFlags) ||
+	    (Stream_GetPosition(sGather) != Stream_GetPosition(sSingle)) ||
+	    (memcmp(Stream_Buffer(sGather), Stream_Buffer(sSingle), Stream_GetPosition(sSingle)) !=
+	     0))
+	{
+		printf("test_ZGfxCompressGather: the messages differ\n");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	free(buffer);
+	Stream_Free(sGather, TRUE);
+	Stream_Free(sSingle, TRUE);
+	zgfx_context_free(gather);
+	zgfx_context_free(single);
+	return rc;
+}
+
+#if defined(BUILD_TESTING_INTERNAL)
+/**
+ * Compress DVC sized messages with RDP 8.0 Lite. Even messages repeat every 8 messages
+ * (12720 bytes), odd ones every 4 messages (6360 bytes), so only the odd ones are within
+ * the 8 KB history. The lite decompressor only keeps 8 KB, so any match further back than
+ * that breaks the round trip.
+ */
+static int test_ZGfxCompressLite(void)
+{
+	int rc = -1;
+	UINT64 compressedTotal = 0;
+	UINT64 uncompressedTotal = 0;
+	const UINT32 blockSize = 1590;
+	BYTE* blocks = malloc(6ull * blockSize);
+	ZGFX_CONTEXT* compressor = zgfx_context_new_lite(TRUE);
+	ZGFX_CONTEXT* decompressor = zgfx_context_new_lite(FALSE);
+	ZGFX_CONTEXT* full = zgfx_context_new(FALSE);
+
+	if (!blocks || !compressor || !decompressor || !full)
+		goto fail;
+
+	for (size_t x = 0; x < 6ull * blockSize; x++)
+		blocks[x] = (BYTE)(rand() & 0xFF);
+
+	for (UINT32 x = 0; x < 256; x++)
+	{
+		UINT32 Flags = 0;
+		UINT32 DstSize = 0;
+		BYTE* pDstData = nullptr;
+		UINT32 LiteSize = 0;
+		BYTE* pLiteData = nullptr;
+		UINT32 FullSize = 0;
+		BYTE* pFullData = nullptr;
+
+		const UINT32 block = (x % 2 == 0) ? (x / 2) % 4 : 4 + (x / 2) % 2;
+		const BYTE* pSrcData = &blocks[1ull * block * blockSize];
+
+		if (zgfx_compress(compressor, pSrcData, blockSize, &pDstData, &DstSize, &Flags) < 0)
+			goto fail;
+
+		const int liteStatus =
+		    zgfx_decompress(decompressor, pDstData, DstSize, &pLiteData, &LiteSize, 0);
+		const int fullStatus = zgfx_decompress(full, pDstData, DstSize, &pFullData, &FullSize, 0);
+		const BOOL equal = (liteStatus >= 0) && (LiteSize == blockSize) &&
+		                   (memcmp(pLiteData, pSrcData, blockSize) == 0) && (fullStatus >= 0) &&
+		                   (FullSize == blockSize) && (memcmp(pFullData, pSrcData, blockSize) == 0);
+		free(pDstData);
+		free(pLiteData);
+		free(pFullData);
+
+		if (!equal)
+		{
+			printf("test_ZGfxCompressLite: round trip %" PRIu32 " failed\n", x);
+			goto fail;
+		}
+
+		compressedTotal += DstSize;
+		uncompressedTotal += blockSize;
+	}
+
+	printf("test_ZGfxCompressLite: %" PRIu64 " -> %" PRIu64 " bytes\n", uncompressedTotal,
+	       compressedTotal);
+
+	/* Only the copies within 8 KB can be compressed */
+	if ((compressedTotal >= uncompressedTotal * 3 / 4) || (compressedTotal < uncompressedTotal / 4))
+		goto fail;
+
+	rc = 0;
+fail:
+	free(blocks);
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	zgfx_context_free(full);
+	return rc;
+}
+#endif
+
 int TestFreeRDPCodecZGfx(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -270,5 +483,23 @@ int TestFreeRDPCodecZGfx(int argc, char* argv[])
 	if (test_ZGfxCompressConsistent() < 0)
 		return -1;
 
+	if (test_ZGfxCompressHistory(zgfx_context_new(TRUE), zgfx_context_new(FALSE), FALSE) < 0)
+		return -1;
+
+	if (test_ZGfxCompressGather(zgfx_context_new(TRUE), zgfx_context_new(TRUE)) < 0)
+		return -1;
+
+#if defined(BUILD_TESTING_INTERNAL)
+	if (test_ZGfxCompressGather(zgfx_context_new_lite(TRUE), zgfx_context_new_lite(TRUE)) < 0)
+		return -1;
+
+	if (test_ZGfxCompressHistory(zgfx_context_new_lite(TRUE), zgfx_context_new_lite(FALSE),
+	                             TRUE) < 0)
+		return -1;
+
+	if (test_ZGfxCompressLite() < 0)
+		return -1;
+#endif
+
 	return 0;
 }
@@ -24,6 +24,9 @@
 #include <winpr/file.h>
 #include <winpr/debug.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/bulk.h>
 
 #include "TestFreeRDPHelpers.h"
 
@@ -147,3 +150,119 @@ fail:
 	free(cmp);
 	return rc;
 }
+
+UINT32 test_codec_helper_fill_packet(BYTE* data, UINT32 size, const BYTE* pool, size_t poolSize,
+                                     UINT32* seed)
+{
+	WINPR_ASSERT(data);
+	WINPR_ASSERT(pool);
+	WINPR_ASSERT(poolSize > 1024);
+	WINPR_ASSERT(seed);
+
+	UINT32 offset = 0;
+
+	while (offset < size)
+	{
+		*seed = *seed * 1103515245 + 12345;
+		const UINT32 kind = (*seed >> 16) % 8;
+		const UINT32 length = MIN(size - offset, 16 + ((*seed >> 3) % 1024));
+
+		if (kind == 0)
+			memset(&data[offset], (int)(*seed >> 24), length);
+		else if (kind == 1)
+		{
+			for (UINT32 x = 0; x < length; x++)
+			{
+				*seed = *seed * 1103515245 + 12345;
+				data[offset + x] = (BYTE)(*seed >> 16);
+			}
+		}
+		else
+			memcpy(&data[offset], &pool[(*seed >> 8) % (poolSize - 1024)], length);
+
+		offset += length;
+	}
+
+	return size;
+}
+
+bool test_codec_helper_bulk_roundtrip(const char* name, void* encoder,
+                                      test_codec_bulk_compress_fn compress, void* decoder,
+                                      test_codec_bulk_decompress_fn decompress)
+{
+	WINPR_ASSERT(name);
+	WINPR_ASSERT(compress);
+	WINPR_ASSERT(decompress);
+
+	bool rc = false;
+	UINT32 seed = 42;
+	UINT64 total = 0;
+	UINT64 compressed = 0;
+	UINT64 duration = 0;
+	BYTE* pool = calloc(65536, 1);
+	BYTE* packet = calloc(16384, 1);
+	BYTE* OutputBuffer = calloc(16384 + 64, 1);
+
+	if (!encoder || !decoder || !pool || !packet || !OutputBuffer)
+		goto fail;
+
+	for (size_t x = 0; x < 65536; x++)
+	{
+		seed = seed * 1103515245 + 12345;
+		pool[x] = (BYTE)(seed >> 16);
+	}
+
+	for (UINT32 x = 0; x < 2000; x++)
+	{
+		UINT32 Flags = 0;
+		const BYTE* pDstData = nullptr;
+		const BYTE* pPlainData = nullptr;
+		UINT32 DstSize = 16384 + 64;
+		UINT32 PlainSize = 0;
+		const UINT32 SrcSize =
+		    test_codec_helper_fill_packet(packet, 1 + (seed % 16384), pool, 65536, &seed);
+
+		const UINT64 start = winpr_GetTickCount64NS();
+		const int status =
+		    compress(encoder, packet, SrcSize, OutputBuffer, &pDstData, &DstSize, &Flags);
+		duration += winpr_GetTickCount64NS() - start;
+
+		if (status < 0)
+		{
+			(void)printf("[%s] compress failed with %d at packet %" PRIu32 "\n", name, status, x);
+			goto fail;
+		}
+
+		if (Flags & (PACKET_COMPRESSED | PACKET_AT_FRONT | PACKET_FLUSHED))
+		{
+			if (decompress(decoder, pDstData, DstSize, &pPlainData, &PlainSize, Flags) < 0)
+			{
+				(void)printf("[%s] decompress failed at packet %" PRIu32 "\n", name, x);
+				goto fail;
+			}
+		}
+		else
+		{
+			pPlainData = pDstData;
+			PlainSize = DstSize;
+		}
+
+		if ((PlainSize != SrcSize) || (memcmp(pPlainData, packet, SrcSize) != 0))
+		{
+			(void)printf("[%s] roundtrip mismatch at packet %" PRIu32 "\n", name, x);
+			goto fail;
+		}
+
+		total += SrcSize;
+		compressed += DstSize;
+	}
+
+	(void)printf("[%s] %" PRIu64 " -> %" PRIu64 " bytes, %.2f MB/s\n", name, total, compressed,
+	             (1000.0 * (double)total) / (double)MAX(duration, 1));
+	rc = true;
+fail:
+	free(pool);
+	free(packet);
+	free(OutputBuffer);
+	return rc;
+}
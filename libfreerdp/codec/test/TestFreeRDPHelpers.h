@@ -22,9 +22,28 @@
 #include <stdlib.h>
 #include <stdbool.h>
 
+#include <winpr/wtypes.h>
+
 void* test_codec_helper_read_data(const char* codec, const char* type, const char* name,
                                   size_t* plength);
 void test_codec_helper_write_data(const char* codec, const char* type, const char* name,
                                   const void* data, size_t length);
 bool test_codec_helper_compare(const char* codec, const char* type, const char* name,
                                const void* data, size_t length);
+
+typedef int (*test_codec_bulk_compress_fn)(void* context, const BYTE* pSrcData, UINT32 SrcSize,
+                                           BYTE* pDstBuffer, const BYTE** ppDstData,
+                                           UINT32* pDstSize, UINT32* pFlags);
+typedef int (*test_codec_bulk_decompress_fn)(void* context, const BYTE* pSrcData, UINT32 SrcSize,
+                                             const BYTE** ppDstData, UINT32* pDstSize,
+                                             UINT32 flags);
+
+/* Fill data with fastpath like payloads: fragments repeated from pool, byte runs and fresh
+ * random data */
+UINT32 test_codec_helper_fill_packet(BYTE* data, UINT32 size, const BYTE* pool, size_t poolSize,
+                                     UINT32* seed);
+
+/* Compress a stream of generated packets with encoder and check decoder restores them */
+bool test_codec_helper_bulk_roundtrip(const char* name, void* encoder,
+                                      test_codec_bulk_compress_fn compress, void* decoder,
+                                      test_codec_bulk_decompress_fn decompress);
@@ -828,6 +828,199 @@ out:
 	return retCode;
 }
 
+#define COVERAGE_SIZE 256
+
+static void region_coverage(const REGION16* region, BYTE* coverage)
+{
+	UINT32 nbRects = 0;
+	const RECTANGLE_16* rects = region16_rects(region, &nbRects);
+
+	memset(coverage, 0, COVERAGE_SIZE * COVERAGE_SIZE);
+	for (UINT32 i = 0; i < nbRects; i++)
+	{
+		for (UINT16 y = rects[i].top; y < rects[i].bottom; y++)
+		{
+			for (UINT16 x = rects[i].left; x < rects[i].right; x++)
+				coverage[y * COVERAGE_SIZE + x]++;
+		}
+	}
+}
+
+static int test_union_rects(void)
+{
+	int retCode = -1;
+	REGION16 single;
+	REGION16 batch;
+	RECTANGLE_16 rects[200] = { 0 };
+	BYTE* coverage1 = calloc(COVERAGE_SIZE * COVERAGE_SIZE, 1);
+	BYTE* coverage2 = calloc(COVERAGE_SIZE * COVERAGE_SIZE, 1);
+	UINT32 seed = 42;
+
+	region16_init(&single);
+	region16_init(&batch);
+	if (!coverage1 || !coverage2)
+		goto out;
+
+	for (size_t i = 0; i < ARRAYSIZE(rects); i++)
+	{
+		UINT16 v[4] = { 0 };
+		for (size_t j = 0; j < ARRAYSIZE(v); j++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			v[j] = (UINT16)((seed >> 16) % COVERAGE_SIZE);
+		}
+		rects[i].left = MIN(v[0], v[1]);
+		rects[i].right = MAX(v[0], v[1]);
+		rects[i].top = MIN(v[2], v[3]);
+		rects[i].bottom = MAX(v[2], v[3]);
+	}
+
+	/* start with some content in the source region */
+	for (size_t i = 0; i < 10; i++)
+	{
+		if (rectangle_is_empty(&rects[i]))
+			continue;
+		if (!region16_union_rect(&single, &single, &rects[i]))
+			goto out;
+	}
+	if (!region16_copy(&batch, &single))
+		goto out;
+
+	for (size_t i = 10; i < ARRAYSIZE(rects); i++)
+	{
+		if (rectangle_is_empty(&rects[i]))
+			continue;
+		if (!region16_union_rect(&single, &single, &rects[i]))
+			goto out;
+	}
+	if (!region16_union_rects(&batch, &batch, &rects[10], ARRAYSIZE(rects) - 10))
+		goto out;
+
+	if (!compareRectangles(region16_extents(&batch), region16_extents(&single), 1))
+		goto out;
+
+	region_coverage(&single, coverage1);
+	region_coverage(&batch, coverage2);
+	for (size_t i = 0; i < COVERAGE_SIZE * COVERAGE_SIZE; i++)
+	{
+		/* same area, and the rectangles of the region must not overlap */
+		if ((coverage2[i] > 1) || ((coverage1[i] != 0) != (coverage2[i] != 0)))
+		{
+			(void)fprintf(stderr, "coverage mismatch at %" PRIuz "x%" PRIuz "\n",
+			              i % COVERAGE_SIZE, i / COVERAGE_SIZE);
+			goto out;
+		}
+	}
+
+	/* the sweep produces the same minimal banded form */
+	if (region16_n_rects(&batch) != region16_n_rects(&single))
+		goto out;
+	if (!compareRectangles(region16_rects(&batch, nullptr), region16_rects(&single, nullptr),
+	                       region16_n_rects(&single)))
+		goto out;
+
+	retCode = 0;
+out:
+	free(coverage1);
+	free(coverage2);
+	region16_uninit(&single);
+	region16_uninit(&batch);
+	return retCode;
+}
+
+static BOOL compare_union_rects(const RECTANGLE_16* srcRect, const RECTANGLE_16* rects,
+                                size_t count, BYTE* coverage1, BYTE* coverage2)
+{
+	BOOL rc = FALSE;
+	REGION16 single;
+	REGION16 batch;
+
+	region16_init(&single);
+	region16_init(&batch);
+
+	if (srcRect && !region16_union_rect(&single, &single, srcRect))
+		goto out;
+	if (!region16_copy(&batch, &single))
+		goto out;
+
+	/* the iterative reference gets every rectangle, degenerate ones included */
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!region16_union_rect(&single, &single, &rects[i]))
+			goto out;
+	}
+	if (!region16_union_rects(&batch, &batch, rects, count))
+		goto out;
+
+	region_coverage(&single, coverage1);
+	region_coverage(&batch, coverage2);
+	for (size_t i = 0; i < COVERAGE_SIZE * COVERAGE_SIZE; i++)
+	{
+		if ((coverage2[i] > 1) || ((coverage1[i] != 0) != (coverage2[i] != 0)))
+		{
+			(void)fprintf(stderr, "coverage mismatch at %" PRIuz "x%" PRIuz "\n",
+			              i % COVERAGE_SIZE, i / COVERAGE_SIZE);
+			goto out;
+		}
+	}
+
+	/* empty rectangles must not show up in the batch result */
+	UINT32 nbRects = 0;
+	const RECTANGLE_16* result = region16_rects(&batch, &nbRects);
+	for (UINT32 i = 0; i < nbRects; i++)
+	{
+		if (rectangle_is_empty(&result[i]))
+			goto out;
+	}
+
+	rc = TRUE;
+out:
+	region16_uninit(&single);
+	region16_uninit(&batch);
+	return rc;
+}
+
+static int test_union_rects_degenerate(void)
+{
+	int retCode = -1;
+	const RECTANGLE_16 srcRect = { 20, 20, 60, 60 };
+	const RECTANGLE_16 rects[] = {
+		{ 0, 0, 0, 0 },       { 10, 10, 10, 50 },   { 10, 10, 50, 10 },   { 40, 40, 100, 100 },
+		{ 100, 0, 100, 200 }, { 0, 150, 200, 150 }, { 30, 30, 30, 30 },   { 120, 5, 130, 70 },
+		{ 60, 60, 60, 90 },   { 80, 20, 90, 25 },   { 200, 200, 200, 200 }
+	};
+	const RECTANGLE_16 emptyOnly[] = { { 0, 0, 0, 0 }, { 5, 5, 5, 50 }, { 5, 5, 50, 5 } };
+	BYTE* coverage1 = calloc(COVERAGE_SIZE * COVERAGE_SIZE, 1);
+	BYTE* coverage2 = calloc(COVERAGE_SIZE * COVERAGE_SIZE, 1);
+
+	if (!coverage1 || !coverage2)
+		goto out;
+
+	if (!compare_union_rects(&srcRect, rects, ARRAYSIZE(rects), coverage1, coverage2))
+		goto out;
+	if (!compare_union_rects(&srcRect, emptyOnly, ARRAYSIZE(emptyOnly), coverage1, coverage2))
+		goto out;
+	if (!compare_union_rects(nullptr, emptyOnly, ARRAYSIZE(emptyOnly), coverage1, coverage2))
+		goto out;
+
+	/* only empty rectangles leave an empty source region empty */
+	{
+		REGION16 region;
+		region16_init(&region);
+		const BOOL ok = region16_union_rects(&region, &region, emptyOnly, ARRAYSIZE(emptyOnly)) &&
+		                region16_is_empty(&region);
+		region16_uninit(&region);
+		if (!ok)
+			goto out;
+	}
+
+	retCode = 0;
+out:
+	free(coverage1);
+	free(coverage2);
+	return retCode;
+}
+
 typedef int (*TestFunction)(void);
 struct UnitaryTest
 {
@@ -849,6 +1042,9 @@ static struct UnitaryTest tests[] = { { "Basic trivial tests", test_basic },
 	                                  { "norbert's case", test_norbert_case },
 	                                  { "norbert's case 2", test_norbert2_case },
 	                                  { "empty rectangle case", test_empty_rectangle },
+	                                  { "batch union", test_union_rects },
+	                                  { "batch union with empty rectangles",
+	                                    test_union_rects_degenerate },
 
 	                                  { nullptr, nullptr } };
 
@@ -0,0 +1,72 @@
+#include <winpr/crt.h>
+
+#include <freerdp/codec/region.h>
+
+#include "../region.h"
+
+static BOOL compareRectangles(const RECTANGLE_16* src1, const RECTANGLE_16* src2, size_t nb)
+{
+	return memcmp(src1, src2, nb * sizeof(RECTANGLE_16)) == 0;
+}
+
+static int test_tile_map(void)
+{
+	int retCode = -1;
+	REGION16 region;
+	const RECTANGLE_16 marks[] = { { 10, 10, 20, 20 }, { 70, 5, 130, 6 }, { 0, 70, 60, 200 } };
+	const RECTANGLE_16 expected[] = { { 0, 0, 150, 64 }, { 0, 64, 64, 90 } };
+	REGION16_TILE_MAP* map = region16_tile_map_new(150, 90, 64);
+
+	region16_init(&region);
+	if (!map || !region16_tile_map_is_empty(map))
+		goto out;
+
+	for (size_t i = 0; i < ARRAYSIZE(marks); i++)
+		region16_tile_map_mark(map, &marks[i]);
+
+	if (region16_tile_map_is_empty(map))
+		goto out;
+	if (!region16_tile_map_to_region(map, &region))
+		goto out;
+
+	/* touching tiles of a row are merged, the last row and column are clipped */
+	{
+		UINT32 nbRects = 0;
+		const RECTANGLE_16* rects = region16_rects(&region, &nbRects);
+		if ((nbRects != ARRAYSIZE(expected)) ||
+		    !compareRectangles(rects, expected, ARRAYSIZE(expected)))
+			goto out;
+	}
+
+	region16_tile_map_clear(map);
+	if (!region16_tile_map_is_empty(map))
+		goto out;
+
+	{
+		const RECTANGLE_16 mark = { 65, 70, 66, 71 };
+		const RECTANGLE_16 tile = { 64, 64, 128, 90 };
+		UINT32 nbRects = 0;
+
+		region16_tile_map_mark(map, &mark);
+		if (!region16_tile_map_to_region(map, &region))
+			goto out;
+		const RECTANGLE_16* rects = region16_rects(&region, &nbRects);
+		if ((nbRects != 1) || !compareRectangles(rects, &tile, 1) ||
+		    !compareRectangles(region16_extents(&region), &tile, 1))
+			goto out;
+	}
+
+	retCode = 0;
+out:
+	region16_tile_map_free(map);
+	region16_uninit(&region);
+	return retCode;
+}
+
+int TestFreeRDPRegionTileMap(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	return test_tile_map();
+}
@@ -28,8 +28,23 @@
 #include <winpr/print.h>
 #include <winpr/bitstream.h>
 
+#include <winpr/endian.h>
+#include <winpr/synch.h>
+
 #include <freerdp/log.h>
 #include "xcrush.h"
+#include "xcrush_encode.h"
+#include "sse/xcrush_sse2.h"
+#include "neon/xcrush_neon.h"
+
+#define TAG FREERDP_TAG("codec")
+
+#define XCRUSH_CHUNK_BUCKET_BITS 13
+#define XCRUSH_CHUNK_BUCKETS (1 << XCRUSH_CHUNK_BUCKET_BITS)
+#define XCRUSH_CHUNK_WAYS 8
+#define XCRUSH_MAX_MATCHES 1000
+#define XCRUSH_MIN_CHUNK_SIZE 15
+#define XCRUSH_MIN_MATCH_LENGTH 11
 
 #pragma pack(push, 1)
 
@@ -40,18 +55,6 @@ typedef struct
 	UINT32 MatchLength;
 } XCRUSH_MATCH_INFO;
 
-typedef struct
-{
-	UINT32 offset;
-	UINT32 next;
-} XCRUSH_CHUNK;
-
-typedef struct
-{
-	UINT16 seed;
-	UINT16 size;
-} XCRUSH_SIGNATURE;
-
 typedef struct
 {
 	UINT16 MatchLength;
@@ -70,6 +73,14 @@ typedef struct
 
 #pragma pack(pop)
 
+/* The chunks of the history sharing the high bits of their hash, most recent first.
+ * A bucket fills a cache line. */
+typedef struct
+{
+	UINT32 hash[XCRUSH_CHUNK_WAYS];
+	UINT32 offset[XCRUSH_CHUNK_WAYS];
+} XCRUSH_CHUNK_BUCKET;
+
 struct s_XCRUSH_CONTEXT
 {
 	ALIGN64 BOOL Compressor;
@@ -80,19 +91,28 @@ struct s_XCRUSH_CONTEXT
 	ALIGN64 BYTE HistoryBuffer[2000000];
 	ALIGN64 BYTE BlockBuffer[16384];
 	ALIGN64 UINT32 CompressionFlags;
-	ALIGN64 UINT32 SignatureIndex;
-	ALIGN64 UINT32 SignatureCount;
-	ALIGN64 XCRUSH_SIGNATURE Signatures[1000];
-	ALIGN64 UINT32 ChunkHead;
-	ALIGN64 UINT32 ChunkTail;
-	ALIGN64 XCRUSH_CHUNK Chunks[65534];
-	ALIGN64 UINT16 NextChunks[65536];
-	ALIGN64 UINT32 OriginalMatchCount;
-	ALIGN64 UINT32 OptimizedMatchCount;
-	ALIGN64 XCRUSH_MATCH_INFO OriginalMatches[1000];
-	ALIGN64 XCRUSH_MATCH_INFO OptimizedMatches[1000];
+	ALIGN64 UINT32 Candidates;
+	ALIGN64 UINT32 GoodMatchLength;
+	ALIGN64 UINT32 MatchCount;
+	ALIGN64 XCRUSH_MATCH_INFO Matches[XCRUSH_MAX_MATCHES];
+	ALIGN64 XCRUSH_CHUNK_BUCKET Chunks[XCRUSH_CHUNK_BUCKETS];
 };
 
+static XCRUSH_ENCODE_FUNCTIONS xcrush_encode_fn = WINPR_C_ARRAY_INIT;
+static INIT_ONCE xcrush_encode_InitOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK xcrush_encode_init_cb(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+	xcrush_encode_fn.find_boundary = xcrush_find_boundary_generic;
+	xcrush_encode_init_sse2(&xcrush_encode_fn);
+	xcrush_encode_init_neon(&xcrush_encode_fn);
+	return TRUE;
+}
+
 //#define DEBUG_XCRUSH 1
 #if defined(DEBUG_XCRUSH)
 static const char* xcrush_get_level_2_compression_flags_string(UINT32 flags)
@@ -161,517 +181,179 @@ static const char* xcrush_get_level_1_compression_flags_string(UINT32 flags)
 }
 #endif
 
-static UINT16 xcrush_update_hash(const BYTE* WINPR_RESTRICT data, UINT32 size)
+static UINT32 xcrush_chunk_hash(const BYTE* WINPR_RESTRICT data, UINT32 size)
 {
-	const BYTE* end = nullptr;
-	UINT16 seed = 5381; /* same value as in djb2 */
+	const UINT32 length = MIN(size, XCRUSH_WINDOW_SIZE);
+	UINT32 hash = 0x811C9DC5 ^ length;
+	UINT32 i = 0;
 
 	WINPR_ASSERT(data);
-	WINPR_ASSERT(size >= 4);
 
-	if (size > 32)
-	{
-		size = 32;
-		seed = 5413;
-	}
+	for (; i + 4 <= length; i += 4)
+		hash = (hash ^ winpr_Data_Get_UINT32(&data[i])) * 0x9E3779B1;
 
-	end = &data[size - 4];
+	for (; i < length; i++)
+		hash = (hash ^ data[i]) * 0x9E3779B1;
 
-	while (data < end)
-	{
-		seed += (data[3] ^ data[0]) + (data[1] << 8);
-		data += 4;
-	}
-
-	return seed;
+	return hash ^ (hash >> 15);
 }
 
-static int xcrush_append_chunk(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
-                               const BYTE* WINPR_RESTRICT data, UINT32* WINPR_RESTRICT beg,
-                               UINT32 end)
+/* a and b point into the history buffer and may overlap */
+static inline UINT32 xcrush_match_forward(const BYTE* a, const BYTE* b, UINT32 max)
 {
-	UINT32 size = 0;
-
-	WINPR_ASSERT(xcrush);
-	WINPR_ASSERT(data);
-	WINPR_ASSERT(beg);
+	UINT32 length = 0;
 
-	if (xcrush->SignatureIndex >= xcrush->SignatureCount)
-		return 0;
+	while ((length + 8 <= max) &&
+	       (winpr_Data_Get_UINT64_NE(&a[length]) == winpr_Data_Get_UINT64_NE(&b[length])))
+		length += 8;
 
-	size = end - *beg;
+	while ((length < max) && (a[length] == b[length]))
+		length++;
 
-	if (size > 65535)
-		return 0;
-
-	if (size >= 15)
-	{
-		const UINT16 seed = xcrush_update_hash(&data[*beg], WINPR_ASSERTING_INT_CAST(UINT16, size));
-		xcrush->Signatures[xcrush->SignatureIndex].size = WINPR_ASSERTING_INT_CAST(UINT16, size);
-		xcrush->Signatures[xcrush->SignatureIndex].seed = seed;
-		xcrush->SignatureIndex++;
-		*beg = end;
-	}
-
-	return 1;
+	return length;
 }
 
-static int xcrush_compute_chunks(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
-                                 const BYTE* WINPR_RESTRICT data, UINT32 size,
-                                 UINT32* WINPR_RESTRICT pIndex)
+/**
+ * Extend the match of the chunk at MatchOffset with the older chunk at ChunkOffset in both
+ * directions. The match neither reaches back into the previous match nor past the end of the
+ * packet.
+ *
+ * @return the match length, 0 if the chunks do not match
+ */
+static UINT32 xcrush_extend_match(const XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 MatchOffset,
+                                  UINT32 ChunkOffset, UINT32 PrevMatchEnd, UINT32 HistoryEnd,
+                                  XCRUSH_MATCH_INFO* WINPR_RESTRICT MatchInfo)
 {
-	UINT32 offset = 0;
-	UINT32 rotation = 0;
-	UINT32 accumulator = 0;
-
-	WINPR_ASSERT(xcrush);
-	WINPR_ASSERT(data);
-	WINPR_ASSERT(pIndex);
-
-	*pIndex = 0;
-	xcrush->SignatureIndex = 0;
+	const BYTE* HistoryBuffer = xcrush->HistoryBuffer;
 
-	if (size < 128)
+	/* The decoder copies from data it already has */
+	if (ChunkOffset >= MatchOffset)
 		return 0;
 
-	for (UINT32 i = 0; i < 32; i++)
-	{
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i] ^ rotation;
-	}
+	const UINT32 MaxMatchLength = HistoryEnd - MatchOffset;
+	UINT32 MatchLength = xcrush_match_forward(&HistoryBuffer[ChunkOffset],
+	                                          &HistoryBuffer[MatchOffset], MaxMatchLength);
 
-	for (UINT32 i = 0; i < size - 64; i++)
+	if (MatchOffset < PrevMatchEnd)
 	{
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
-
-		if (!(accumulator & 0x7F))
-		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
+		/* The chunk starts inside the previous match, only its remainder is left */
+		const UINT32 skip = PrevMatchEnd - MatchOffset;
 
-		i++;
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
+		if (MatchLength <= skip)
+			return 0;
 
-		if (!(accumulator & 0x7F))
-		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
-
-		i++;
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
-
-		if (!(accumulator & 0x7F))
-		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
-		}
-
-		i++;
-		rotation = _rotl(accumulator, 1);
-		accumulator = data[i + 32] ^ data[i] ^ rotation;
-
-		if (!(accumulator & 0x7F))
+		MatchLength -= skip;
+		MatchOffset += skip;
+		ChunkOffset += skip;
+	}
+	else
+	{
+		while ((MatchOffset > PrevMatchEnd) && (ChunkOffset > 0) &&
+		       (HistoryBuffer[MatchOffset - 1] == HistoryBuffer[ChunkOffset - 1]))
 		{
-			if (!xcrush_append_chunk(xcrush, data, &offset, i + 32))
-				return 0;
+			MatchOffset--;
+			ChunkOffset--;
+			MatchLength++;
 		}
 	}
 
-	if ((size == offset) || xcrush_append_chunk(xcrush, data, &offset, size))
-	{
-		*pIndex = xcrush->SignatureIndex;
-		return 1;
-	}
+	if (MatchLength < XCRUSH_MIN_MATCH_LENGTH)
+		return 0;
 
-	return 0;
+	MatchInfo->MatchOffset = MatchOffset;
+	MatchInfo->ChunkOffset = ChunkOffset;
+	MatchInfo->MatchLength = MatchLength;
+	return MatchLength;
 }
 
-static UINT32 xcrush_compute_signatures(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
-                                        const BYTE* WINPR_RESTRICT data, UINT32 size)
+/* Match a chunk of the packet against the chunks of the history with the same hash and add it
+ * to the chunk table */
+static void xcrush_process_chunk(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 offset,
+                                 UINT32 size, UINT32 HistoryEnd,
+                                 UINT32* WINPR_RESTRICT PrevMatchEnd)
 {
-	UINT32 index = 0;
+	const UINT32 hash = xcrush_chunk_hash(&xcrush->HistoryBuffer[offset], size);
+	XCRUSH_CHUNK_BUCKET* bucket = &xcrush->Chunks[hash >> (32 - XCRUSH_CHUNK_BUCKET_BITS)];
 
-	if (xcrush_compute_chunks(xcrush, data, size, &index))
-		return index;
+	if ((offset + size > *PrevMatchEnd) && (xcrush->MatchCount < XCRUSH_MAX_MATCHES))
+	{
+		XCRUSH_MATCH_INFO best = WINPR_C_ARRAY_INIT;
 
-	return 0;
-}
+		for (size_t i = 0; i < xcrush->Candidates; i++)
+		{
+			XCRUSH_MATCH_INFO MatchInfo = WINPR_C_ARRAY_INIT;
 
-static void xcrush_clear_hash_table_range(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 beg,
-                                          UINT32 end)
-{
-	WINPR_ASSERT(xcrush);
+			if (bucket->hash[i] != hash)
+				continue;
 
-	for (UINT32 index = 0; index < 65536; index++)
-	{
-		if (xcrush->NextChunks[index] >= beg)
-		{
-			if (xcrush->NextChunks[index] <= end)
+			if (xcrush_extend_match(xcrush, offset, bucket->offset[i], *PrevMatchEnd, HistoryEnd,
+			                        &MatchInfo) > best.MatchLength)
 			{
-				xcrush->NextChunks[index] = 0;
-			}
-		}
-	}
+				best = MatchInfo;
 
-	for (UINT32 index = 0; index < 65534; index++)
-	{
-		if (xcrush->Chunks[index].next >= beg)
-		{
-			if (xcrush->Chunks[index].next <= end)
-			{
-				xcrush->Chunks[index].next = 0;
+				if (best.MatchLength >= xcrush->GoodMatchLength)
+					break;
 			}
 		}
-	}
-}
-
-static int xcrush_find_next_matching_chunk(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
-                                           XCRUSH_CHUNK* WINPR_RESTRICT chunk,
-                                           XCRUSH_CHUNK** WINPR_RESTRICT pNextChunk)
-{
-	XCRUSH_CHUNK* next = nullptr;
-
-	WINPR_ASSERT(xcrush);
-
-	if (!chunk)
-		return -4001; /* error */
 
-	if (chunk->next)
-	{
-		// NOLINTNEXTLINE(bugprone-sizeof-expression)
-		const intptr_t diff = (chunk - xcrush->Chunks);
-		if (diff < 0)
-			return -4011;
-
-		const size_t index = (size_t)diff / sizeof(XCRUSH_CHUNK);
-		if (index >= 65534)
-			return -4002; /* error */
-
-		if ((index < xcrush->ChunkHead) || (chunk->next >= xcrush->ChunkHead))
+		if (best.MatchLength > 0)
 		{
-			if (chunk->next >= 65534)
-				return -4003; /* error */
-
-			next = &xcrush->Chunks[chunk->next];
+			xcrush->Matches[xcrush->MatchCount++] = best;
+			*PrevMatchEnd = best.MatchOffset + best.MatchLength;
 		}
 	}
 
-	WINPR_ASSERT(pNextChunk);
-	*pNextChunk = next;
-	return 1;
-}
-
-static int xcrush_insert_chunk(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
-                               XCRUSH_SIGNATURE* WINPR_RESTRICT signature, UINT32 offset,
-                               XCRUSH_CHUNK** WINPR_RESTRICT pPrevChunk)
-{
-	WINPR_ASSERT(xcrush);
-
-	if (xcrush->ChunkHead >= 65530)
-	{
-		xcrush->ChunkHead = 1;
-		xcrush->ChunkTail = 1;
-	}
-
-	if (xcrush->ChunkHead >= xcrush->ChunkTail)
-	{
-		xcrush_clear_hash_table_range(xcrush, xcrush->ChunkTail, xcrush->ChunkTail + 10000);
-		xcrush->ChunkTail += 10000;
-	}
-
-	const UINT32 index = xcrush->ChunkHead++;
-
-	if (xcrush->ChunkHead >= 65534)
-		return -3001; /* error */
-
-	xcrush->Chunks[index].offset = offset;
-	const UINT16 seed = signature->seed;
-
-	if (xcrush->NextChunks[seed])
-	{
-		if (xcrush->NextChunks[seed] >= 65534)
-			return -3003; /* error */
-
-		WINPR_ASSERT(pPrevChunk);
-		*pPrevChunk = &xcrush->Chunks[xcrush->NextChunks[seed]];
-	}
-
-	xcrush->Chunks[index].next = xcrush->NextChunks[seed] & 0xFFFF;
-	xcrush->NextChunks[seed] = WINPR_ASSERTING_INT_CAST(UINT16, index);
-	return 1;
+	memmove(&bucket->hash[1], &bucket->hash[0], sizeof(bucket->hash) - sizeof(bucket->hash[0]));
+	memmove(&bucket->offset[1], &bucket->offset[0],
+	        sizeof(bucket->offset) - sizeof(bucket->offset[0]));
+	bucket->hash[0] = hash;
+	bucket->offset[0] = offset;
 }
 
-static int xcrush_find_match_length(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 MatchOffset,
-                                    UINT32 ChunkOffset, UINT32 HistoryOffset, UINT32 SrcSize,
-                                    UINT32 MaxMatchLength,
-                                    XCRUSH_MATCH_INFO* WINPR_RESTRICT MatchInfo)
-{
-	UINT32 MatchSymbol = 0;
-	UINT32 ChunkSymbol = 0;
-	BYTE* ChunkBuffer = nullptr;
-	BYTE* MatchBuffer = nullptr;
-	BYTE* MatchStartPtr = nullptr;
-	BYTE* ForwardChunkPtr = nullptr;
-	BYTE* ReverseChunkPtr = nullptr;
-	BYTE* ForwardMatchPtr = nullptr;
-	BYTE* ReverseMatchPtr = nullptr;
-	BYTE* HistoryBufferEnd = nullptr;
-	UINT32 ReverseMatchLength = 0;
-	UINT32 ForwardMatchLength = 0;
-	UINT32 TotalMatchLength = 0;
-	BYTE* HistoryBuffer = nullptr;
-	UINT32 HistoryBufferSize = 0;
-
-	WINPR_ASSERT(xcrush);
-	WINPR_ASSERT(MatchInfo);
-
-	HistoryBuffer = xcrush->HistoryBuffer;
-	HistoryBufferSize = xcrush->HistoryBufferSize;
-	HistoryBufferEnd = &HistoryBuffer[HistoryOffset + SrcSize];
-
-	if (MatchOffset > HistoryBufferSize)
-		return -2001; /* error */
-
-	MatchBuffer = &HistoryBuffer[MatchOffset];
-
-	if (ChunkOffset > HistoryBufferSize)
-		return -2002; /* error */
-
-	ChunkBuffer = &HistoryBuffer[ChunkOffset];
-
-	if (MatchOffset == ChunkOffset)
-		return -2003; /* error */
-
-	if (MatchBuffer < HistoryBuffer)
-		return -2004; /* error */
-
-	if (ChunkBuffer < HistoryBuffer)
-		return -2005; /* error */
-
-	ForwardMatchPtr = &HistoryBuffer[MatchOffset];
-	ForwardChunkPtr = &HistoryBuffer[ChunkOffset];
-
-	if ((&MatchBuffer[MaxMatchLength + 1] < HistoryBufferEnd) &&
-	    (MatchBuffer[MaxMatchLength + 1] != ChunkBuffer[MaxMatchLength + 1]))
-	{
-		return 0;
-	}
-
-	while (1)
-	{
-		MatchSymbol = *ForwardMatchPtr++;
-		ChunkSymbol = *ForwardChunkPtr++;
-
-		if (MatchSymbol != ChunkSymbol)
-			break;
-
-		if (ForwardMatchPtr > HistoryBufferEnd)
-			break;
-
-		ForwardMatchLength++;
-	}
-
-	ReverseMatchPtr = MatchBuffer - 1;
-	ReverseChunkPtr = ChunkBuffer - 1;
-
-	while ((ReverseMatchPtr > &HistoryBuffer[HistoryOffset]) && (ReverseChunkPtr > HistoryBuffer) &&
-	       (*ReverseMatchPtr == *ReverseChunkPtr))
-	{
-		ReverseMatchLength++;
-		ReverseMatchPtr--;
-		ReverseChunkPtr--;
-	}
-
-	MatchStartPtr = MatchBuffer - ReverseMatchLength;
-	TotalMatchLength = ReverseMatchLength + ForwardMatchLength;
-
-	if (TotalMatchLength < 11)
-		return 0;
-
-	if (MatchStartPtr < HistoryBuffer)
-		return -2006; /* error */
-
-	const intptr_t diff = MatchStartPtr - HistoryBuffer;
-	const intptr_t cdiff = ChunkBuffer - ReverseMatchLength - HistoryBuffer;
-	if ((diff > UINT32_MAX) || (diff < 0) || (cdiff < 0) || (cdiff > UINT32_MAX))
-		return -1;
-	MatchInfo->MatchOffset = (UINT32)diff;
-	MatchInfo->ChunkOffset = (UINT32)cdiff;
-	MatchInfo->MatchLength = TotalMatchLength;
-	return (int)TotalMatchLength;
-}
-
-static int xcrush_find_all_matches(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 SignatureIndex,
-                                   UINT32 HistoryOffset, UINT32 SrcOffset, UINT32 SrcSize)
+/**
+ * Split the packet at HistoryOffset into content defined chunks and match them against the
+ * history. The matches are ordered and do not overlap.
+ *
+ * @return the number of matches
+ */
+static UINT32 xcrush_find_matches(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 HistoryOffset,
+                                  UINT32 SrcSize)
 {
-	UINT32 j = 0;
-	int status = 0;
-	UINT32 ChunkIndex = 0;
-	UINT32 ChunkCount = 0;
-	XCRUSH_CHUNK* chunk = nullptr;
-	UINT32 MatchLength = 0;
-	UINT32 MaxMatchLength = 0;
-	UINT32 PrevMatchEnd = 0;
-	XCRUSH_SIGNATURE* Signatures = nullptr;
-	XCRUSH_MATCH_INFO MaxMatchInfo = WINPR_C_ARRAY_INIT;
+	const BYTE* data = &xcrush->HistoryBuffer[HistoryOffset];
+	const UINT32 HistoryEnd = HistoryOffset + SrcSize;
+	UINT32 PrevMatchEnd = HistoryOffset;
+	UINT32 ChunkStart = 0;
 
-	WINPR_ASSERT(xcrush);
+	WINPR_ASSERT(xcrush_encode_fn.find_boundary);
 
-	Signatures = xcrush->Signatures;
+	xcrush->MatchCount = 0;
 
-	for (UINT32 i = 0; i < SignatureIndex; i++)
+	if (SrcSize > 2 * XCRUSH_WINDOW_SIZE)
 	{
-		XCRUSH_MATCH_INFO MatchInfo = WINPR_C_ARRAY_INIT;
-		UINT32 offset = SrcOffset + HistoryOffset;
+		const size_t end = SrcSize - 2 * XCRUSH_WINDOW_SIZE;
+		size_t i = 0;
 
-		if (!Signatures[i].size)
-			return -1001; /* error */
-
-		status = xcrush_insert_chunk(xcrush, &Signatures[i], offset, &chunk);
-
-		if (status < 0)
-			return status;
-
-		if (chunk && (SrcOffset + HistoryOffset + Signatures[i].size >= PrevMatchEnd))
+		while ((i = xcrush_encode_fn.find_boundary(data, i, end)) < end)
 		{
-			ChunkCount = 0;
-			MaxMatchLength = 0;
+			const UINT32 ChunkEnd = (UINT32)i + XCRUSH_WINDOW_SIZE;
 
-			while (chunk)
+			/* Short chunks are merged into the next one */
+			if (ChunkEnd - ChunkStart >= XCRUSH_MIN_CHUNK_SIZE)
 			{
-				if ((chunk->offset < HistoryOffset) || (chunk->offset < offset) ||
-				    (chunk->offset > SrcSize + HistoryOffset))
-				{
-					status = xcrush_find_match_length(xcrush, offset, chunk->offset, HistoryOffset,
-					                                  SrcSize, MaxMatchLength, &MatchInfo);
-
-					if (status < 0)
-						return status; /* error */
-
-					MatchLength = (UINT32)status;
-
-					if (MatchLength > MaxMatchLength)
-					{
-						MaxMatchLength = MatchLength;
-						MaxMatchInfo.MatchOffset = MatchInfo.MatchOffset;
-						MaxMatchInfo.ChunkOffset = MatchInfo.ChunkOffset;
-						MaxMatchInfo.MatchLength = MatchInfo.MatchLength;
-
-						if (MatchLength > 256)
-							break;
-					}
-				}
-
-				ChunkIndex = ChunkCount++;
-
-				if (ChunkIndex > 4)
-					break;
-
-				status = xcrush_find_next_matching_chunk(xcrush, chunk, &chunk);
-
-				if (status < 0)
-					return status; /* error */
+				xcrush_process_chunk(xcrush, HistoryOffset + ChunkStart, ChunkEnd - ChunkStart,
+				                     HistoryEnd, &PrevMatchEnd);
+				ChunkStart = ChunkEnd;
 			}
 
-			if (MaxMatchLength)
-			{
-				xcrush->OriginalMatches[j].MatchOffset = MaxMatchInfo.MatchOffset;
-				xcrush->OriginalMatches[j].ChunkOffset = MaxMatchInfo.ChunkOffset;
-				xcrush->OriginalMatches[j].MatchLength = MaxMatchInfo.MatchLength;
-
-				if (xcrush->OriginalMatches[j].MatchOffset < HistoryOffset)
-					return -1002; /* error */
-
-				PrevMatchEnd =
-				    xcrush->OriginalMatches[j].MatchLength + xcrush->OriginalMatches[j].MatchOffset;
-				j++;
-
-				if (j >= 1000)
-					return -1003; /* error */
-			}
+			i++;
 		}
-
-		SrcOffset += Signatures[i].size;
-
-		if (SrcOffset > SrcSize)
-			return -1004; /* error */
 	}
 
-	if (SrcOffset > SrcSize)
-		return -1005; /* error */
-
-	return (int)j;
-}
-
-static int xcrush_optimize_matches(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush)
-{
-	UINT32 j = 0;
-	UINT32 MatchDiff = 0;
-	UINT32 PrevMatchEnd = 0;
-	UINT32 TotalMatchLength = 0;
-	UINT32 OriginalMatchCount = 0;
-	UINT32 OptimizedMatchCount = 0;
-	XCRUSH_MATCH_INFO* OriginalMatch = nullptr;
-	XCRUSH_MATCH_INFO* OptimizedMatch = nullptr;
-	XCRUSH_MATCH_INFO* OriginalMatches = nullptr;
-	XCRUSH_MATCH_INFO* OptimizedMatches = nullptr;
-
-	WINPR_ASSERT(xcrush);
-
-	OriginalMatches = xcrush->OriginalMatches;
-	OriginalMatchCount = xcrush->OriginalMatchCount;
-	OptimizedMatches = xcrush->OptimizedMatches;
-
-	for (UINT32 i = 0; i < OriginalMatchCount; i++)
-	{
-		if (OriginalMatches[i].MatchOffset <= PrevMatchEnd)
-		{
-			if ((OriginalMatches[i].MatchOffset < PrevMatchEnd) &&
-			    (OriginalMatches[i].MatchLength + OriginalMatches[i].MatchOffset >
-			     PrevMatchEnd + 6))
-			{
-				MatchDiff = PrevMatchEnd - OriginalMatches[i].MatchOffset;
-				OriginalMatch = &OriginalMatches[i];
-				OptimizedMatch = &OptimizedMatches[j];
-				OptimizedMatch->MatchOffset = OriginalMatch->MatchOffset;
-				OptimizedMatch->ChunkOffset = OriginalMatch->ChunkOffset;
-				OptimizedMatch->MatchLength = OriginalMatch->MatchLength;
-
-				if (OptimizedMatches[j].MatchLength <= MatchDiff)
-					return -5001; /* error */
-
-				if (MatchDiff >= 20000)
-					return -5002; /* error */
-
-				OptimizedMatches[j].MatchLength -= MatchDiff;
-				OptimizedMatches[j].MatchOffset += MatchDiff;
-				OptimizedMatches[j].ChunkOffset += MatchDiff;
-				PrevMatchEnd = OptimizedMatches[j].MatchLength + OptimizedMatches[j].MatchOffset;
-				TotalMatchLength += OptimizedMatches[j].MatchLength;
-				j++;
-			}
-		}
-		else
-		{
-			OriginalMatch = &OriginalMatches[i];
-			OptimizedMatch = &OptimizedMatches[j];
-			OptimizedMatch->MatchOffset = OriginalMatch->MatchOffset;
-			OptimizedMatch->ChunkOffset = OriginalMatch->ChunkOffset;
-			OptimizedMatch->MatchLength = OriginalMatch->MatchLength;
-			PrevMatchEnd = OptimizedMatches[j].MatchLength + OptimizedMatches[j].MatchOffset;
-			TotalMatchLength += OptimizedMatches[j].MatchLength;
-			j++;
-		}
-	}
+	if (SrcSize - ChunkStart >= XCRUSH_MIN_CHUNK_SIZE)
+		xcrush_process_chunk(xcrush, HistoryOffset + ChunkStart, SrcSize - ChunkStart, HistoryEnd,
+		                     &PrevMatchEnd);
 
-	OptimizedMatchCount = j;
-	xcrush->OptimizedMatchCount = OptimizedMatchCount;
-	return (int)TotalMatchLength;
+	return xcrush->MatchCount;
 }
 
 static int xcrush_generate_output(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
@@ -693,7 +375,7 @@ static int xcrush_generate_output(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
 	WINPR_ASSERT(OutputSize >= 2);
 	WINPR_ASSERT(pDstSize);
 
-	const UINT32 MatchCount = xcrush->OptimizedMatchCount;
+	const UINT32 MatchCount = xcrush->MatchCount;
 	OutputEnd = &OutputBuffer[OutputSize];
 
 	if (&OutputBuffer[2] >= &OutputBuffer[OutputSize])
@@ -708,26 +390,26 @@ static int xcrush_generate_output(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
 
 	for (MatchIndex = 0; MatchIndex < MatchCount; MatchIndex++)
 	{
-		const UINT32 len = xcrush->OptimizedMatches[MatchIndex].MatchLength;
+		const UINT32 len = xcrush->Matches[MatchIndex].MatchLength;
 		winpr_Data_Write_UINT16(&MatchDetails[MatchIndex].MatchLength,
 		                        WINPR_ASSERTING_INT_CAST(UINT16, len));
 
-		const UINT32 moff = xcrush->OptimizedMatches[MatchIndex].MatchOffset;
+		const UINT32 moff = xcrush->Matches[MatchIndex].MatchOffset;
 		WINPR_ASSERT(moff >= HistoryOffset);
 
 		const UINT32 off = moff - HistoryOffset;
 		winpr_Data_Write_UINT16(&MatchDetails[MatchIndex].MatchOutputOffset,
 		                        WINPR_ASSERTING_INT_CAST(UINT16, off));
 		winpr_Data_Write_UINT32(&MatchDetails[MatchIndex].MatchHistoryOffset,
-		                        xcrush->OptimizedMatches[MatchIndex].ChunkOffset);
+		                        xcrush->Matches[MatchIndex].ChunkOffset);
 	}
 
 	CurrentOffset = HistoryOffset;
 
 	for (MatchIndex = 0; MatchIndex < MatchCount; MatchIndex++)
 	{
-		MatchLength = (UINT16)(xcrush->OptimizedMatches[MatchIndex].MatchLength);
-		MatchOffset = xcrush->OptimizedMatches[MatchIndex].MatchOffset;
+		MatchLength = (UINT16)(xcrush->Matches[MatchIndex].MatchLength);
+		MatchOffset = xcrush->Matches[MatchIndex].MatchOffset;
 
 		if (MatchOffset <= CurrentOffset)
 		{
@@ -977,6 +659,22 @@ int xcrush_decompress(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, const BYTE* WINPR_R
 	return status;
 }
 
+/* The packet is sent uncompressed and never reaches the decoder history. Unless the packet
+ * wrapped the history the next one overwrites it, chunks only reference data before them, so
+ * only the level 2 history has to be flushed. */
+static void xcrush_discard_packet(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 HistoryOffset,
+                                  UINT32 Level1ComprFlags)
+{
+	if (Level1ComprFlags & L1_PACKET_AT_FRONT)
+	{
+		xcrush_context_reset(xcrush, TRUE);
+		return;
+	}
+
+	xcrush->HistoryOffset = HistoryOffset;
+	mppc_context_reset(xcrush->mppc, TRUE);
+}
+
 static int xcrush_compress_l1(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
                               const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
                               BYTE* WINPR_RESTRICT pDstData, UINT32* WINPR_RESTRICT pDstSize,
@@ -987,7 +685,6 @@ static int xcrush_compress_l1(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
 	UINT32 HistoryOffset = 0;
 	BYTE* HistoryPtr = nullptr;
 	BYTE* HistoryBuffer = nullptr;
-	UINT32 SignatureIndex = 0;
 
 	WINPR_ASSERT(xcrush);
 	WINPR_ASSERT(pSrcData);
@@ -1010,35 +707,14 @@ static int xcrush_compress_l1(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
 
 	if (SrcSize > 50)
 	{
-		SignatureIndex = xcrush_compute_signatures(xcrush, pSrcData, SrcSize);
-
-		if (SignatureIndex)
+		if (xcrush_find_matches(xcrush, HistoryOffset, SrcSize) > 0)
 		{
-			status = xcrush_find_all_matches(xcrush, SignatureIndex, HistoryOffset, 0, SrcSize);
+			status = xcrush_generate_output(xcrush, pDstData, SrcSize, HistoryOffset, pDstSize);
 
 			if (status < 0)
 				return status;
 
-			xcrush->OriginalMatchCount = (UINT32)status;
-			xcrush->OptimizedMatchCount = 0;
-
-			if (xcrush->OriginalMatchCount)
-			{
-				status = xcrush_optimize_matches(xcrush);
-
-				if (status < 0)
-					return status;
-			}
-
-			if (xcrush->OptimizedMatchCount)
-			{
-				status = xcrush_generate_output(xcrush, pDstData, SrcSize, HistoryOffset, pDstSize);
-
-				if (status < 0)
-					return status;
-
-				Flags |= L1_COMPRESSED;
-			}
+			Flags |= L1_COMPRESSED;
 		}
 	}
 
@@ -1086,6 +762,7 @@ int xcrush_compress(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, const BYTE* WINPR_RES
 	OriginalDataSize = SrcSize;
 	pDstData = xcrush->BlockBuffer;
 	CompressedDataSize = SrcSize;
+	const UINT32 PrevHistoryOffset = xcrush->HistoryOffset;
 	status = xcrush_compress_l1(xcrush, pSrcData, SrcSize, pDstData, &CompressedDataSize,
 	                            &Level1ComprFlags);
 
@@ -1121,11 +798,13 @@ int xcrush_compress(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, const BYTE* WINPR_RES
 	if (status < 0)
 		return status;
 
-	if (!status || (Level2ComprFlags & PACKET_FLUSHED))
+	/* A flushed level 2 history is signalled with compressed packets too, only a packet without
+	 * PACKET_COMPRESSED failed to compress */
+	if (!status || !(Level2ComprFlags & PACKET_COMPRESSED))
 	{
 		if (CompressedDataSize > DstSize)
 		{
-			xcrush_context_reset(xcrush, TRUE);
+			xcrush_discard_packet(xcrush, PrevHistoryOffset, Level1ComprFlags);
 			*ppDstData = pSrcData;
 			*pDstSize = SrcSize;
 			*pFlags = 0;
@@ -1167,15 +846,11 @@ void xcrush_context_reset(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, BOOL flush)
 {
 	WINPR_ASSERT(xcrush);
 
-	xcrush->SignatureIndex = 0;
-	xcrush->SignatureCount = 1000;
-	ZeroMemory(&(xcrush->Signatures), sizeof(XCRUSH_SIGNATURE) * xcrush->SignatureCount);
 	xcrush->CompressionFlags = 0;
-	xcrush->ChunkHead = xcrush->ChunkTail = 1;
-	ZeroMemory(&(xcrush->Chunks), sizeof(xcrush->Chunks));
-	ZeroMemory(&(xcrush->NextChunks), sizeof(xcrush->NextChunks));
-	ZeroMemory(&(xcrush->OriginalMatches), sizeof(xcrush->OriginalMatches));
-	ZeroMemory(&(xcrush->OptimizedMatches), sizeof(xcrush->OptimizedMatches));
+	xcrush->MatchCount = 0;
+
+	if (xcrush->Compressor)
+		ZeroMemory(&(xcrush->Chunks), sizeof(xcrush->Chunks));
 
 	if (flush)
 		xcrush->HistoryOffset = xcrush->HistoryBufferSize + 1;
@@ -1185,6 +860,42 @@ void xcrush_context_reset(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, BOOL flush)
 	mppc_context_reset(xcrush->mppc, flush);
 }
 
+BOOL xcrush_context_set_effort(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, UINT32 effort)
+{
+	WINPR_ASSERT(xcrush);
+
+	switch (effort)
+	{
+		case XCRUSH_EFFORT_FAST:
+			xcrush->Candidates = 1;
+			xcrush->GoodMatchLength = 64;
+			break;
+
+		case XCRUSH_EFFORT_DEFAULT:
+			xcrush->Candidates = 4;
+			xcrush->GoodMatchLength = 256;
+			break;
+
+		case XCRUSH_EFFORT_BEST:
+			xcrush->Candidates = XCRUSH_CHUNK_WAYS;
+			xcrush->GoodMatchLength = UINT32_MAX;
+			break;
+
+		default:
+			WLog_WARN(TAG, "invalid XCRUSH compression effort %" PRIu32, effort);
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+size_t xcrush_context_memory_usage(const XCRUSH_CONTEXT* xcrush)
+{
+	if (!xcrush)
+		return 0;
+	return sizeof(XCRUSH_CONTEXT) + mppc_context_memory_usage(xcrush->mppc);
+}
+
 XCRUSH_CONTEXT* xcrush_context_new(BOOL Compressor)
 {
 	XCRUSH_CONTEXT* xcrush = (XCRUSH_CONTEXT*)calloc(1, sizeof(XCRUSH_CONTEXT));
@@ -1197,6 +908,17 @@ XCRUSH_CONTEXT* xcrush_context_new(BOOL Compressor)
 	if (!xcrush->mppc)
 		goto fail;
 	xcrush->HistoryBufferSize = 2000000;
+
+	if (Compressor)
+	{
+		if (!InitOnceExecuteOnce(&xcrush_encode_InitOnce, xcrush_encode_init_cb, nullptr,
+		                         nullptr))
+			goto fail;
+
+		if (!xcrush_context_set_effort(xcrush, XCRUSH_EFFORT_DEFAULT))
+			goto fail;
+	}
+
 	xcrush_context_reset(xcrush, FALSE);
 
 	return xcrush;
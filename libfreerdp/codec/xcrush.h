@@ -22,11 +22,17 @@
 
 #include <freerdp/api.h>
 #include <freerdp/types.h>
+#include <freerdp/settings_types.h>
 
 #include "mppc.h"
 
 typedef struct s_XCRUSH_CONTEXT XCRUSH_CONTEXT;
 
+/* Compression effort of the level 1 match finder */
+#define XCRUSH_EFFORT_FAST COMPRESSION_EFFORT_FAST       /**< first matching chunk only */
+#define XCRUSH_EFFORT_DEFAULT COMPRESSION_EFFORT_DEFAULT /**< up to 4 candidate chunks */
+#define XCRUSH_EFFORT_BEST COMPRESSION_EFFORT_BEST       /**< all candidate chunks, longest match */
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -48,6 +54,15 @@ extern "C"
 
 	FREERDP_LOCAL void xcrush_context_reset(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, BOOL flush);
 
+	/** @brief Set the compression effort of a compressor, one of XCRUSH_EFFORT_* */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL BOOL xcrush_context_set_effort(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush,
+	                                             UINT32 effort);
+
+	/** @brief Heap memory held by the context in bytes */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL size_t xcrush_context_memory_usage(const XCRUSH_CONTEXT* xcrush);
+
 	FREERDP_LOCAL void xcrush_context_free(XCRUSH_CONTEXT* xcrush);
 
 	WINPR_ATTR_MALLOC(xcrush_context_free, 1)
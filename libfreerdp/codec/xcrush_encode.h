@@ -0,0 +1,67 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * XCrush (RDP6.1) Bulk Data Compressor
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_XCRUSH_ENCODE_H
+#define FREERDP_LIB_CODEC_XCRUSH_ENCODE_H
+
+#include <winpr/wtypes.h>
+#include <freerdp/api.h>
+
+/* Chunks end where the rolling hash of the 32 bytes before the end has the low 7 bits clear */
+#define XCRUSH_WINDOW_SIZE 32
+#define XCRUSH_BOUNDARY_MASK 0x7F
+
+/** @return the first position i in [offset, end) whose window data[i + 1] to data[i + 32]
+ * ends a chunk, end if there is none. data must be readable up to data[end + 32]. */
+typedef size_t (*xcrush_find_boundary_fn)(const BYTE* WINPR_RESTRICT data, size_t offset,
+                                          size_t end);
+
+typedef struct
+{
+	xcrush_find_boundary_fn find_boundary;
+} XCRUSH_ENCODE_FUNCTIONS;
+
+static inline UINT32 xcrush_rotl1(UINT32 value)
+{
+	return (value << 1) | (value >> 31);
+}
+
+/* The rolling hash of position i is the XOR of data[i + 32 - k] rotated left by k for
+ * k = 0 to 31, so it can be computed for any position without rolling up to it. */
+static inline size_t xcrush_find_boundary_generic(const BYTE* WINPR_RESTRICT data, size_t offset,
+                                                  size_t end)
+{
+	UINT32 accumulator = 0;
+
+	if (offset >= end)
+		return end;
+
+	for (size_t j = 1; j <= XCRUSH_WINDOW_SIZE; j++)
+		accumulator = xcrush_rotl1(accumulator) ^ data[offset + j];
+
+	for (size_t i = offset; i < end; i++)
+	{
+		if ((accumulator & XCRUSH_BOUNDARY_MASK) == 0)
+			return i;
+
+		accumulator = xcrush_rotl1(accumulator) ^ data[i + XCRUSH_WINDOW_SIZE + 1] ^ data[i + 1];
+	}
+
+	return end;
+}
+
+#endif /* FREERDP_LIB_CODEC_XCRUSH_ENCODE_H */
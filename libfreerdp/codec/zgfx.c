@@ -30,6 +30,8 @@
 #include <freerdp/log.h>
 #include <freerdp/codec/zgfx.h>
 
+#include "zgfx.h"
+
 #define TAG FREERDP_TAG("codec")
 
 /**
@@ -42,6 +44,18 @@
  * Minimum match length: 3 bytes
  */
 
+#define ZGFX_HISTORY_SIZE 2500000u
+
+/**
+ * The RDP 8.0 Lite compressor keeps its history linear instead of as a ring, it holds
+ * two windows. Matches are found with a hash of the next 3 bytes, the chain of older
+ * positions with the same hash is only kept for the last ChainSize bytes.
+ */
+#define ZGFX_MAX_CHAIN 16
+#define ZGFX_LITE_HASH_BITS 12
+#define ZGFX_LITE_CHAIN_SIZE ZGFX_LITE_HISTORY_SIZE
+#define ZGFX_MIN_MATCH 3
+
 typedef struct
 {
 	UINT32 prefixLength;
@@ -66,11 +80,39 @@ struct S_ZGFX_CONTEXT
 	BYTE OutputBuffer[65536];
 	UINT32 OutputCount;
 
-	BYTE HistoryBuffer[2500000];
+	BYTE* HistoryBuffer;
 	UINT32 HistoryIndex;
 	UINT32 HistoryBufferSize;
+
+	/* compressor only, positions are stored + 1, 0 is an empty slot */
+	UINT32* HashTable;
+	UINT32* HashChain;
+	UINT32 HashBits;
+	UINT32 ChainSize;
+	UINT32 MaxDistance;
+	UINT16 LiteralCode[256];
+	BYTE LiteralBits[256];
 };
 
+typedef struct
+{
+	BYTE* data;
+	size_t size;
+	size_t position;
+	UINT32 bits;
+	UINT32 count;
+} ZGFX_BIT_WRITER;
+
+/* The uncompressed data of a message, read in order across all buffers */
+typedef struct
+{
+	const BYTE* const* data;
+	const UINT32* sizes;
+	size_t count;
+	size_t index;
+	UINT32 offset;
+} ZGFX_GATHER;
+
 static const ZGFX_TOKEN ZGFX_TOKEN_TABLE[] = {
 	// len code vbits type  vbase
 	{ 1, 0, 8, 0, 0 },           // 0
@@ -488,36 +530,321 @@ fail:
 	return status;
 }
 
-static BOOL zgfx_compress_segment(WINPR_ATTR_UNUSED ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
-                                  wStream* WINPR_RESTRICT s, const BYTE* WINPR_RESTRICT pSrcData,
-                                  UINT32 SrcSize, UINT32* WINPR_RESTRICT pFlags)
+static inline BOOL zgfx_put_bits(ZGFX_BIT_WRITER* WINPR_RESTRICT writer, UINT32 value,
+                                 UINT32 nbits)
 {
-	/* FIXME: Currently compression not implemented. Just copy the raw source */
-	if (!Stream_EnsureRemainingCapacity(s, SrcSize + 1))
+	WINPR_ASSERT(nbits <= 24);
+
+	writer->bits = (writer->bits << nbits) | (value & ((1u << nbits) - 1u));
+	writer->count += nbits;
+
+	while (writer->count >= 8)
+	{
+		if (writer->position >= writer->size)
+			return FALSE;
+
+		writer->count -= 8;
+		writer->data[writer->position++] = (BYTE)(writer->bits >> writer->count);
+	}
+
+	writer->bits &= (1u << writer->count) - 1u;
+	return TRUE;
+}
+
+static inline UINT32 zgfx_hash(const BYTE* WINPR_RESTRICT data, UINT32 hashBits)
+{
+	const UINT32 value = ((UINT32)data[0] << 16) | ((UINT32)data[1] << 8) | data[2];
+	return (value * 2654435761u) >> (32 - hashBits);
+}
+
+static inline void zgfx_hash_insert(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 position)
+{
+	const UINT32 hash = zgfx_hash(&zgfx->HistoryBuffer[position], zgfx->HashBits);
+	zgfx->HashChain[position % zgfx->ChainSize] = zgfx->HashTable[hash];
+	zgfx->HashTable[hash] = position + 1;
+}
+
+/* Drop the oldest history if a segment of size bytes does not fit anymore */
+static void zgfx_history_reserve(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 size)
+{
+	if (zgfx->HistoryIndex + size <= zgfx->HistoryBufferSize)
+		return;
+
+	/* Keep half the history, the chain slots stay valid for multiples of ChainSize */
+	UINT32 delta = zgfx->HistoryIndex - zgfx->HistoryBufferSize / 2;
+	delta = (delta + zgfx->ChainSize - 1) / zgfx->ChainSize * zgfx->ChainSize;
+	delta = MIN(delta, zgfx->HistoryIndex);
+
+	MoveMemory(zgfx->HistoryBuffer, &zgfx->HistoryBuffer[delta], zgfx->HistoryIndex - delta);
+	zgfx->HistoryIndex -= delta;
+
+	for (size_t x = 0; x < (1ull << zgfx->HashBits); x++)
+		zgfx->HashTable[x] = (zgfx->HashTable[x] > delta) ? zgfx->HashTable[x] - delta : 0;
+
+	for (size_t x = 0; x < zgfx->ChainSize; x++)
+		zgfx->HashChain[x] = (zgfx->HashChain[x] > delta) ? zgfx->HashChain[x] - delta : 0;
+}
+
+static UINT32 zgfx_find_match(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 position,
+                              UINT32 end, UINT32* WINPR_RESTRICT pDistance)
+{
+	UINT32 bestLength = 0;
+	UINT32 candidate =
+	    zgfx->HashTable[zgfx_hash(&zgfx->HistoryBuffer[position], zgfx->HashBits)];
+	const UINT32 maxLength = end - position;
+
+	for (size_t chain = 0; (chain < ZGFX_MAX_CHAIN) && (candidate != 0); chain++)
+	{
+		const UINT32 match = candidate - 1;
+
+		/* The decompressor does not keep anything older, the chain only gets older */
+		if (position - match > zgfx->MaxDistance)
+			break;
+
+		const BYTE* cur = &zgfx->HistoryBuffer[position];
+		const BYTE* ref = &zgfx->HistoryBuffer[match];
+
+		if (ref[bestLength] == cur[bestLength])
+		{
+			UINT32 length = 0;
+
+			while ((length < maxLength) && (ref[length] == cur[length]))
+				length++;
+
+			if (length > bestLength)
+			{
+				bestLength = length;
+				*pDistance = position - match;
+
+				if (length == maxLength)
+					break;
+			}
+		}
+
+		/* Older chain slots have been reused by newer positions */
+		if (position - match >= zgfx->ChainSize)
+			break;
+
+		candidate = zgfx->HashChain[match % zgfx->ChainSize];
+
+		if (candidate > match)
+			break;
+	}
+
+	return (bestLength >= ZGFX_MIN_MATCH) ? bestLength : 0;
+}
+
+static inline const ZGFX_TOKEN* zgfx_distance_token(UINT32 distance)
+{
+	for (size_t x = 0; ZGFX_TOKEN_TABLE[x].prefixLength != 0; x++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[x];
+
+		if ((token->tokenType == 1) && (distance >= token->valueBase) &&
+		    (distance - token->valueBase < (1u << token->valueBits)))
+			return token;
+	}
+
+	return nullptr;
+}
+
+/* Match lengths are 3 or 4..7, 8..15, 16..31, ... with a unary coded range */
+static inline UINT32 zgfx_count_bits(UINT32 count, UINT32* WINPR_RESTRICT pRange)
+{
+	UINT32 range = 0;
+
+	if (count == 3)
+		return 1;
+
+	while (count >= (8u << range))
+		range++;
+
+	*pRange = range;
+	return 2 * range + 4;
+}
+
+static inline BOOL zgfx_put_count(ZGFX_BIT_WRITER* WINPR_RESTRICT writer, UINT32 count)
+{
+	UINT32 range = 0;
+
+	if (zgfx_count_bits(count, &range) == 1)
+		return zgfx_put_bits(writer, 0, 1);
+
+	if (!zgfx_put_bits(writer, ((1u << (range + 1)) - 1u) << 1, range + 2))
+		return FALSE;
+
+	return zgfx_put_bits(writer, count - (4u << range), range + 2);
+}
+
+/**
+ * Compress the history between start and end into OutputBuffer.
+ *
+ * @return the size of the compressed segment data (including the trailing padding
+ * byte) or 0 if it would not be smaller than the uncompressed data.
+ */
+static UINT32 zgfx_compress_history(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 start, UINT32 end)
+{
+	const UINT32 size = end - start;
+	ZGFX_BIT_WRITER writer = { zgfx->OutputBuffer, MIN(size - 1, sizeof(zgfx->OutputBuffer)), 0,
+		                       0, 0 };
+	UINT32 position = start;
+	BOOL fits = TRUE;
+
+	while (fits && (position < end))
+	{
+		UINT32 distance = 0;
+		UINT32 length = 0;
+
+		if (end - position >= ZGFX_MIN_MATCH)
+			length = zgfx_find_match(zgfx, position, end, &distance);
+
+		if (length > 0)
+		{
+			const ZGFX_TOKEN* token = zgfx_distance_token(distance);
+			UINT32 range = 0;
+			UINT32 literalBits = 0;
+
+			for (UINT32 x = 0; x < length; x++)
+				literalBits += zgfx->LiteralBits[zgfx->HistoryBuffer[position + x]];
+
+			if (!token || (token->prefixLength + token->valueBits +
+			                   zgfx_count_bits(length, &range) >=
+			               literalBits))
+				length = 0;
+			else
+			{
+				fits = zgfx_put_bits(&writer, token->prefixCode, token->prefixLength) &&
+				       zgfx_put_bits(&writer, distance - token->valueBase, token->valueBits) &&
+				       zgfx_put_count(&writer, length);
+			}
+		}
+
+		if (length == 0)
+		{
+			const BYTE c = zgfx->HistoryBuffer[position];
+			fits = zgfx_put_bits(&writer, zgfx->LiteralCode[c], zgfx->LiteralBits[c]);
+			length = 1;
+		}
+
+		for (UINT32 x = 0; x < length; x++, position++)
+		{
+			if (position + ZGFX_MIN_MATCH <= end)
+				zgfx_hash_insert(zgfx, position);
+		}
+	}
+
+	/* The history must know about every position, even if the data is sent uncompressed */
+	for (; position + ZGFX_MIN_MATCH <= end; position++)
+		zgfx_hash_insert(zgfx, position);
+
+	if (!fits)
+		return 0;
+
+	/* Last byte is the number of unused bits in the byte before */
+	const UINT32 unused = (8 - writer.count) % 8;
+
+	if ((unused > 0) && !zgfx_put_bits(&writer, 0, unused))
+		return 0;
+
+	if (writer.position >= writer.size)
+		return 0;
+
+	writer.data[writer.position++] = (BYTE)unused;
+	return (UINT32)writer.position;
+}
+
+static void zgfx_gather_read(ZGFX_GATHER* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT dst,
+                             UINT32 size)
+{
+	while (size > 0)
+	{
+		WINPR_ASSERT(src->index < src->count);
+
+		const UINT32 chunk = MIN(src->sizes[src->index] - src->offset, size);
+		CopyMemory(dst, &src->data[src->index][src->offset], chunk);
+		dst += chunk;
+		size -= chunk;
+		src->offset += chunk;
+
+		if (src->offset == src->sizes[src->index])
+		{
+			src->index++;
+			src->offset = 0;
+		}
+	}
+}
+
+static BOOL zgfx_compress_segment(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RESTRICT s,
+                                  ZGFX_GATHER* WINPR_RESTRICT src, UINT32 SrcSize,
+                                  UINT32* WINPR_RESTRICT pFlags)
+{
+	UINT32 compressedSize = 0;
+	const BYTE* pSrcData = nullptr;
+
+	/* Uncompressed segments are part of the history of the decompressor as well, a
+	 * compressor without a match finder does not need to keep it */
+	if (zgfx->HashTable && (SrcSize > 0))
+	{
+		zgfx_history_reserve(zgfx, SrcSize);
+
+		const UINT32 start = zgfx->HistoryIndex;
+		zgfx_gather_read(src, &zgfx->HistoryBuffer[start], SrcSize);
+		zgfx->HistoryIndex += SrcSize;
+		pSrcData = &zgfx->HistoryBuffer[start];
+
+		if (SrcSize > ZGFX_MIN_MATCH)
+			compressedSize = zgfx_compress_history(zgfx, start, zgfx->HistoryIndex);
+	}
+
+	if (!Stream_EnsureRemainingCapacity(s, 1ull + (compressedSize ? compressedSize : SrcSize)))
 	{
 		WLog_ERR(TAG, "Stream_EnsureRemainingCapacity failed!");
 		return FALSE;
 	}
 
-	(*pFlags) |= ZGFX_PACKET_COMPR_TYPE_RDP8; /* RDP 8.0 compression format */
-	Stream_Write_UINT8(s, WINPR_ASSERTING_INT_CAST(uint8_t, *pFlags)); /* header (1 byte) */
-	Stream_Write(s, pSrcData, SrcSize);
+	const BYTE header =
+	    ZGFX_PACKET_COMPR_TYPE_RDP8 | ((compressedSize > 0) ? PACKET_COMPRESSED : 0); /* RDP 8.0 */
+	(*pFlags) |= header;
+	Stream_Write_UINT8(s, header); /* header (1 byte) */
+
+	if (compressedSize > 0)
+		Stream_Write(s, zgfx->OutputBuffer, compressedSize);
+	else if (pSrcData)
+		Stream_Write(s, pSrcData, SrcSize);
+	else
+	{
+		zgfx_gather_read(src, Stream_Pointer(s), SrcSize);
+		Stream_Seek(s, SrcSize);
+	}
 	return TRUE;
 }
 
-int zgfx_compress_to_stream(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RESTRICT sDst,
-                            const BYTE* WINPR_RESTRICT pUncompressed, UINT32 uncompressedSize,
-                            UINT32* WINPR_RESTRICT pFlags)
+int zgfx_compress_gather_to_stream(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RESTRICT sDst,
+                                   const BYTE* const* WINPR_RESTRICT ppUncompressed,
+                                   const UINT32* WINPR_RESTRICT pUncompressedSizes, size_t count,
+                                   UINT32* WINPR_RESTRICT pFlags)
 {
 	int fragment = 0;
 	UINT16 maxLength = 0;
 	UINT32 totalLength = 0;
 	size_t posSegmentCount = 0;
-	const BYTE* pSrcData = nullptr;
 	int status = 0;
-	maxLength = ZGFX_SEGMENTED_MAXSIZE;
-	totalLength = uncompressedSize;
-	pSrcData = pUncompressed;
+	ZGFX_GATHER src = { ppUncompressed, pUncompressedSizes, count, 0, 0 };
+
+	WINPR_ASSERT(zgfx);
+	WINPR_ASSERT(ppUncompressed || (count == 0));
+	WINPR_ASSERT(pUncompressedSizes || (count == 0));
+
+	for (size_t x = 0; x < count; x++)
+	{
+		if (pUncompressedSizes[x] > UINT32_MAX - totalLength)
+			return -1;
+		totalLength += pUncompressedSizes[x];
+	}
+
+	const UINT32 uncompressedSize = totalLength;
+	/* zgfx_history_reserve keeps half the history of a compressor */
+	maxLength = (UINT16)MIN(ZGFX_SEGMENTED_MAXSIZE, zgfx->HistoryBufferSize / 2);
 
 	for (; (totalLength > 0) || (fragment == 0); fragment++)
 	{
@@ -559,7 +886,7 @@ int zgfx_compress_to_stream(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RE
 
 		posDataStart = Stream_GetPosition(sDst);
 
-		if (!zgfx_compress_segment(zgfx, sDst, pSrcData, SrcSize, pFlags))
+		if (!zgfx_compress_segment(zgfx, sDst, &src, SrcSize, pFlags))
 			return -1;
 
 		if (posDstSize)
@@ -574,8 +901,6 @@ int zgfx_compress_to_stream(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RE
 			if (!Stream_SetPosition(sDst, posDataStart + DstSize))
 				return -1;
 		}
-
-		pSrcData += SrcSize;
 	}
 
 	Stream_SealLength(sDst);
@@ -593,6 +918,14 @@ int zgfx_compress_to_stream(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RE
 	return status;
 }
 
+int zgfx_compress_to_stream(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RESTRICT sDst,
+                            const BYTE* WINPR_RESTRICT pUncompressed, UINT32 uncompressedSize,
+                            UINT32* WINPR_RESTRICT pFlags)
+{
+	const BYTE* data = pUncompressed;
+	return zgfx_compress_gather_to_stream(zgfx, sDst, &data, &uncompressedSize, 1, pFlags);
+}
+
 int zgfx_compress(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, const BYTE* WINPR_RESTRICT pSrcData,
                   UINT32 SrcSize, BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize,
                   UINT32* WINPR_RESTRICT pFlags)
@@ -615,24 +948,94 @@ int zgfx_compress(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, const BYTE* WINPR_RESTRICT
 void zgfx_context_reset(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, WINPR_ATTR_UNUSED BOOL flush)
 {
 	zgfx->HistoryIndex = 0;
+
+	if (zgfx->HashTable)
+		ZeroMemory(zgfx->HashTable, (1ull << zgfx->HashBits) * sizeof(UINT32));
+
+	if (zgfx->HashChain)
+		ZeroMemory(zgfx->HashChain, 1ull * zgfx->ChainSize * sizeof(UINT32));
 }
 
-ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
+static void zgfx_init_literals(ZGFX_CONTEXT* WINPR_RESTRICT zgfx)
+{
+	for (size_t x = 0; ZGFX_TOKEN_TABLE[x].prefixLength != 0; x++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[x];
+
+		if (token->tokenType != 0)
+			continue;
+
+		for (UINT32 value = 0; value < (1u << token->valueBits); value++)
+		{
+			const UINT32 c = token->valueBase + value;
+			const UINT32 bits = token->prefixLength + token->valueBits;
+
+			if ((zgfx->LiteralBits[c] == 0) || (bits < zgfx->LiteralBits[c]))
+			{
+				zgfx->LiteralBits[c] = (BYTE)bits;
+				zgfx->LiteralCode[c] = (UINT16)((token->prefixCode << token->valueBits) | value);
+			}
+		}
+	}
+}
+
+/* The history follows the context in the same allocation */
+static ZGFX_CONTEXT* zgfx_context_new_ex(BOOL Compressor, UINT32 historySize, UINT32 hashBits,
+                                         UINT32 chainSize, UINT32 maxDistance)
 {
-	ZGFX_CONTEXT* zgfx = nullptr;
-	zgfx = (ZGFX_CONTEXT*)calloc(1, sizeof(ZGFX_CONTEXT));
+	ZGFX_CONTEXT* zgfx = (ZGFX_CONTEXT*)calloc(1, sizeof(ZGFX_CONTEXT) + historySize);
 
 	if (zgfx)
 	{
 		zgfx->Compressor = Compressor;
-		zgfx->HistoryBufferSize = sizeof(zgfx->HistoryBuffer);
+		zgfx->HistoryBuffer = (BYTE*)&zgfx[1];
+		zgfx->HistoryBufferSize = historySize;
+		zgfx->HashBits = hashBits;
+		zgfx->ChainSize = chainSize;
+		zgfx->MaxDistance = maxDistance;
+
+		if (Compressor && (hashBits > 0))
+		{
+			zgfx->HashTable = calloc(1ull << hashBits, sizeof(UINT32));
+			zgfx->HashChain = calloc(chainSize, sizeof(UINT32));
+
+			if (!zgfx->HashTable || !zgfx->HashChain)
+			{
+				zgfx_context_free(zgfx);
+				return nullptr;
+			}
+
+			zgfx_init_literals(zgfx);
+		}
+
 		zgfx_context_reset(zgfx, FALSE);
 	}
 
 	return zgfx;
 }
 
+/* The RDP 8.0 compressor (rdpgfx) does not search for matches, it sends raw segments */
+ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
+{
+	return zgfx_context_new_ex(Compressor, ZGFX_HISTORY_SIZE, 0, 0, ZGFX_HISTORY_SIZE);
+}
+
+ZGFX_CONTEXT* zgfx_context_new_lite(BOOL Compressor)
+{
+	if (!Compressor)
+		return zgfx_context_new_ex(FALSE, ZGFX_LITE_HISTORY_SIZE, 0, 0, ZGFX_LITE_HISTORY_SIZE);
+
+	/* The linear history holds a full window on top of the segment being compressed */
+	return zgfx_context_new_ex(TRUE, 2 * ZGFX_LITE_HISTORY_SIZE, ZGFX_LITE_HASH_BITS,
+	                           ZGFX_LITE_CHAIN_SIZE, ZGFX_LITE_HISTORY_SIZE);
+}
+
 void zgfx_context_free(ZGFX_CONTEXT* zgfx)
 {
+	if (!zgfx)
+		return;
+
+	free(zgfx->HashTable);
+	free(zgfx->HashChain);
 	free(zgfx);
 }
@@ -0,0 +1,35 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * ZGFX (RDP8) Bulk Data Compression
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_ZGFX_H
+#define FREERDP_LIB_CODEC_ZGFX_H
+
+#include <freerdp/api.h>
+#include <freerdp/codec/zgfx.h>
+
+/* [MS-RDPEDYC] 2.2.3.3 compressed DVC data uses RDP 8.0 Lite, which has a history of 8 KB */
+#define ZGFX_LITE_HISTORY_SIZE 8192
+
+/**
+ * Create an RDP 8.0 Lite context. The compressor never refers to data more than
+ * ZGFX_LITE_HISTORY_SIZE bytes back and the decompressor only keeps that much history.
+ */
+WINPR_ATTR_MALLOC(zgfx_context_free, 1)
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL ZGFX_CONTEXT* zgfx_context_new_lite(BOOL Compressor);
+
+#endif /* FREERDP_LIB_CODEC_ZGFX_H */
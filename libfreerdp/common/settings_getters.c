@@ -608,6 +608,12 @@ BOOL freerdp_settings_get_bool(WINPR_ATTR_UNUSED const rdpSettings* settings,
 		case FreeRDP_TcpKeepAlive:
 			return settings->TcpKeepAlive;
 
+		case FreeRDP_TlsKernelOffload:
+			return settings->TlsKernelOffload;
+
+		case FreeRDP_TlsSessionTickets:
+			return settings->TlsSessionTickets;
+
 		case FreeRDP_TlsSecurity:
 			return settings->TlsSecurity;
 
@@ -1405,6 +1411,14 @@ BOOL freerdp_settings_set_bool(WINPR_ATTR_UNUSED rdpSettings* settings,
 			settings->TcpKeepAlive = cnv.c;
 			break;
 
+		case FreeRDP_TlsKernelOffload:
+			settings->TlsKernelOffload = cnv.c;
+			break;
+
+		case FreeRDP_TlsSessionTickets:
+			settings->TlsSessionTickets = cnv.c;
+			break;
+
 		case FreeRDP_TlsSecurity:
 			settings->TlsSecurity = cnv.c;
 			break;
@@ -1700,6 +1714,9 @@ UINT32 freerdp_settings_get_uint32(WINPR_ATTR_UNUSED const rdpSettings* settings
 		case FreeRDP_CompDeskSupportLevel:
 			return settings->CompDeskSupportLevel;
 
+		case FreeRDP_CompressionEffort:
+			return settings->CompressionEffort;
+
 		case FreeRDP_CompressionLevel:
 			return settings->CompressionLevel;
 
@@ -1787,6 +1804,9 @@ UINT32 freerdp_settings_get_uint32(WINPR_ATTR_UNUSED const rdpSettings* settings
 		case FreeRDP_GatewayUsageMethod:
 			return settings->GatewayUsageMethod;
 
+		case FreeRDP_GdiInvalidRectLimit:
+			return settings->GdiInvalidRectLimit;
+
 		case FreeRDP_GfxCapsFilter:
 			return settings->GfxCapsFilter;
 
@@ -2129,6 +2149,10 @@ BOOL freerdp_settings_set_uint32(WINPR_ATTR_UNUSED rdpSettings* settings,
 			settings->CompDeskSupportLevel = cnv.c;
 			break;
 
+		case FreeRDP_CompressionEffort:
+			settings->CompressionEffort = cnv.c;
+			break;
+
 		case FreeRDP_CompressionLevel:
 			settings->CompressionLevel = cnv.c;
 			break;
@@ -2245,6 +2269,10 @@ BOOL freerdp_settings_set_uint32(WINPR_ATTR_UNUSED rdpSettings* settings,
 			settings->GatewayUsageMethod = cnv.c;
 			break;
 
+		case FreeRDP_GdiInvalidRectLimit:
+			settings->GdiInvalidRectLimit = cnv.c;
+			break;
+
 		case FreeRDP_GfxCapsFilter:
 			settings->GfxCapsFilter = cnv.c;
 			break;
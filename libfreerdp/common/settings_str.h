@@ -257,6 +257,8 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_SynchronousStaticChannels, FREERDP_SETTINGS_TYPE_BOOL,
 	  "FreeRDP_SynchronousStaticChannels" },
 	{ FreeRDP_TcpKeepAlive, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_TcpKeepAlive" },
+	{ FreeRDP_TlsKernelOffload, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_TlsKernelOffload" },
+	{ FreeRDP_TlsSessionTickets, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_TlsSessionTickets" },
 	{ FreeRDP_TlsSecurity, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_TlsSecurity" },
 	{ FreeRDP_ToggleFullscreen, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_ToggleFullscreen" },
 	{ FreeRDP_TransportDump, FREERDP_SETTINGS_TYPE_BOOL, "FreeRDP_TransportDump" },
@@ -312,6 +314,7 @@ static const struct settings_str_entry settings_map[] = {
 	{ FreeRDP_ColorPointerCacheSize, FREERDP_SETTINGS_TYPE_UINT32,
 	  "FreeRDP_ColorPointerCacheSize" },
 	{ FreeRDP_CompDeskSupportLevel, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_CompDeskSupportLevel" },
+	{ FreeRDP_CompressionEffort, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_CompressionEffort" },
 	{ FreeRDP_CompressionLevel, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_CompressionLevel" },
 	{ FreeRDP_ConnectionType, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_ConnectionType" },
 	{ FreeRDP_CookieMaxLength, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_CookieMaxLength" },
@@ -348,6 +351,7 @@ static const struct settings_str_entry settings_map[] = {
 	  "FreeRDP_GatewayCredentialsSource" },
 	{ FreeRDP_GatewayPort, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_GatewayPort" },
 	{ FreeRDP_GatewayUsageMethod, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_GatewayUsageMethod" },
+	{ FreeRDP_GdiInvalidRectLimit, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_GdiInvalidRectLimit" },
 	{ FreeRDP_GfxCapsFilter, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_GfxCapsFilter" },
 	{ FreeRDP_GfxCodecAV1Profile, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_GfxCodecAV1Profile" },
 	{ FreeRDP_GlyphSupportLevel, FREERDP_SETTINGS_TYPE_UINT32, "FreeRDP_GlyphSupportLevel" },
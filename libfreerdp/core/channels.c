@@ -84,6 +84,10 @@ BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channelId, const BYTE* data, size_
 
 	const UINT32 VCChunkSize = freerdp_settings_get_uint32(rdp->settings, FreeRDP_VCChunkSize);
 	const BOOL ServerMode = freerdp_settings_get_bool(rdp->settings, FreeRDP_ServerMode);
+
+	/* Coalesce the chunks of one channel PDU into full size TLS records */
+	BOOL rc = TRUE;
+	transport_cork(rdp->transport);
 	while (left > 0)
 	{
 		if (left > VCChunkSize)
@@ -102,14 +106,19 @@ BOOL freerdp_channel_send(rdpRdp* rdp, UINT16 channelId, const BYTE* data, size_
 		}
 
 		if (!freerdp_channel_send_packet(rdp, channelId, size, flags, data, chunkSize))
-			return FALSE;
+		{
+			rc = FALSE;
+			break;
+		}
 
 		data += chunkSize;
 		left -= chunkSize;
 		flags = 0;
 	}
 
-	return TRUE;
+	if (!transport_uncork(rdp->transport))
+		return FALSE;
+	return rc;
 }
 
 BOOL freerdp_channel_process(freerdp* instance, wStream* s, UINT16 channelId, size_t packetLength)
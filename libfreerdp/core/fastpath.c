@@ -1185,8 +1185,8 @@ wStream* fastpath_update_pdu_init_new(WINPR_ATTR_UNUSED rdpFastPath* fastpath)
 	return s;
 }
 
-BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s,
-                              BOOL skipCompression)
+static BOOL fastpath_send_update_pdu_int(rdpFastPath* fastpath, BYTE updateCode, wStream* s,
+                                         BOOL skipCompression)
 {
 	BOOL status = TRUE;
 	wStream* fs = nullptr;
@@ -1397,6 +1397,21 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 	return status;
 }
 
+BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s,
+                              BOOL skipCompression)
+{
+	if (!fastpath || !fastpath->rdp)
+		return FALSE;
+
+	/* Send all fragments of the update as few TLS records as possible */
+	rdpTransport* transport = fastpath->rdp->transport;
+	transport_cork(transport);
+	const BOOL rc = fastpath_send_update_pdu_int(fastpath, updateCode, s, skipCompression);
+	if (!transport_uncork(transport))
+		return FALSE;
+	return rc;
+}
+
 rdpFastPath* fastpath_new(rdpRdp* rdp)
 {
 	rdpFastPath* fastpath = nullptr;
@@ -58,6 +58,14 @@
 #include <freerdp/utils/signal.h>
 
 #include "../cache/pointer.h"
+#include "../codec/bulk.h"
+#include "../codec/clear.h"
+#include "../codec/h264.h"
+#include "../codec/interleaved.h"
+#include "../codec/nsc.h"
+#include "../codec/planar.h"
+#include "../codec/progressive.h"
+#include "../codec/rfx.h"
 #include "utils.h"
 
 #define TAG FREERDP_TAG("core")
@@ -1284,6 +1292,30 @@ ULONG freerdp_get_transport_sent(const rdpContext* context, BOOL resetCount)
 	return WINPR_CXX_COMPAT_CAST(ULONG, MIN(rc, UINT32_MAX));
 }
 
+size_t freerdp_get_memory_usage(const rdpContext* context, UINT32 flags)
+{
+	size_t size = 0;
+
+	WINPR_ASSERT(context);
+
+	if ((flags & FREERDP_MEMORY_USAGE_BULK) && context->rdp)
+		size += bulk_memory_usage(context->rdp->bulk);
+
+	if ((flags & FREERDP_MEMORY_USAGE_CODECS) && context->codecs)
+	{
+		const rdpCodecs* codecs = context->codecs;
+		size += rfx_context_memory_usage(codecs->rfx);
+		size += nsc_context_memory_usage(codecs->nsc);
+		size += h264_context_memory_usage(codecs->h264);
+		size += clear_context_memory_usage(codecs->clear);
+		size += progressive_context_memory_usage(codecs->progressive);
+		size += freerdp_bitmap_planar_context_memory_usage(codecs->planar);
+		size += bitmap_interleaved_context_memory_usage(codecs->interleaved);
+	}
+
+	return size;
+}
+
 BOOL freerdp_nla_impersonate(rdpContext* context)
 {
 	rdpNla* nla = nullptr;
@@ -25,6 +25,7 @@
 
 #include <freerdp/input.h>
 #include <freerdp/log.h>
+#include <freerdp/metrics.h>
 
 #include "message.h"
 
@@ -957,6 +958,8 @@ static BOOL input_update_last_event(rdpInput* input, BOOL mouse, UINT16 x, UINT1
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 
+	metrics_input_sent(input->context->metrics);
+
 	if (freerdp_settings_get_uint32(input->context->settings, FreeRDP_FakeMouseMotionInterval) > 0)
 	{
 		const time_t now = time(nullptr);
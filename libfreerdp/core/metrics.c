@@ -19,12 +19,107 @@
 
 #include <freerdp/config.h>
 
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/assert.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/winsock.h>
+
+#include <freerdp/log.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif
+
 #include "rdp.h"
+#include "tcp.h"
+
+#define TAG FREERDP_TAG("core.metrics")
+
+/* Histograms keep 16 linear sub buckets per power of two (like HDR histograms with one
+ * significant decimal digit), values below 32 are counted exactly. */
+#define METRIC_SUB_BUCKET_BITS 4
+#define METRIC_SUB_BUCKETS (1ull << METRIC_SUB_BUCKET_BITS)
+#define METRIC_BUCKETS ((64 - METRIC_SUB_BUCKET_BITS + 1) * METRIC_SUB_BUCKETS)
+
+struct rdp_metric
+{
+	char* name;
+	size_t familyLength;
+	char* help;
+	FREERDP_METRIC_TYPE type;
+	LONGLONG value;
+	LONGLONG count;
+	LONGLONG* buckets;
+};
+
+typedef struct
+{
+	rdpMetrics common;
+
+	CRITICAL_SECTION lock;
+	rdpMetric** list;
+	size_t count;
+	size_t capacity;
+
+	rdpMetric* inputToDisplay;
+	LONGLONG inputPending;
+} rdp_metrics_internal;
+
+struct rdp_metrics_endpoint
+{
+	SOCKET sockfd;
+	HANDLE event;
+	HANDLE stopEvent;
+	HANDLE thread;
+	pMetricsEndpointExport fkt;
+	void* arg;
+};
+
+static inline rdp_metrics_internal* metrics_cast(rdpMetrics* metrics)
+{
+	WINPR_ASSERT(metrics);
+	return (rdp_metrics_internal*)metrics;
+}
+
+static inline LONGLONG metric_load(const LONGLONG* value)
+{
+	WINPR_ASSERT(value);
+	return InterlockedCompareExchange64(WINPR_CAST_CONST_PTR_AWAY(value, LONGLONG*), 0, 0);
+}
+
+static inline void metric_store(LONGLONG* value, LONGLONG newValue)
+{
+	LONGLONG old = 0;
+	do
+	{
+		old = metric_load(value);
+	} while (InterlockedCompareExchange64(value, newValue, old) != old);
+}
+
+static inline void metric_add_value(LONGLONG* value, LONGLONG add)
+{
+	LONGLONG old = 0;
+	do
+	{
+		old = metric_load(value);
+	} while (InterlockedCompareExchange64(value, old + add, old) != old);
+}
 
 double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32 CompressedBytes)
 {
 	double CompressionRatio = 0.0;
+	rdp_metrics_internal* internal = metrics_cast(metrics);
 
+	/* The totals are exported from the endpoint thread */
+	EnterCriticalSection(&internal->lock);
 	metrics->TotalUncompressedBytes += UncompressedBytes;
 	metrics->TotalCompressedBytes += CompressedBytes;
 
@@ -33,25 +128,820 @@ double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32
 	if (metrics->TotalUncompressedBytes != 0)
 		metrics->TotalCompressionRatio =
 		    ((double)metrics->TotalCompressedBytes) / ((double)metrics->TotalUncompressedBytes);
+	LeaveCriticalSection(&internal->lock);
 
 	return CompressionRatio;
 }
 
+static size_t metric_bucket_index(UINT64 value)
+{
+	if (value < 2 * METRIC_SUB_BUCKETS)
+		return (size_t)value;
+
+	size_t msb = 0;
+	for (UINT64 v = value; v > 1; v >>= 1)
+		msb++;
+
+	const size_t shift = msb - METRIC_SUB_BUCKET_BITS;
+	const size_t sub = (size_t)(value >> shift) - METRIC_SUB_BUCKETS;
+	return (shift + 1) * METRIC_SUB_BUCKETS + sub;
+}
+
+/* The value in the middle of the range covered by a bucket */
+static UINT64 metric_bucket_value(size_t index)
+{
+	if (index < 2 * METRIC_SUB_BUCKETS)
+		return index;
+
+	const size_t shift = index / METRIC_SUB_BUCKETS - 1;
+	const UINT64 sub = (index % METRIC_SUB_BUCKETS) + METRIC_SUB_BUCKETS;
+	const UINT64 lower = sub << shift;
+	return lower + (((1ull << shift) - 1) / 2);
+}
+
+static void metric_free(rdpMetric* metric)
+{
+	if (!metric)
+		return;
+
+	free(metric->name);
+	free(metric->help);
+	free(metric->buckets);
+	free(metric);
+}
+
+static rdpMetric* metric_new(const char* name, FREERDP_METRIC_TYPE type, const char* help)
+{
+	WINPR_ASSERT(name);
+
+	rdpMetric* metric = calloc(1, sizeof(rdpMetric));
+	if (!metric)
+		return nullptr;
+
+	metric->type = type;
+	metric->name = _strdup(name);
+	if (!metric->name)
+		goto fail;
+
+	metric->familyLength = strcspn(name, "{");
+	if (help)
+	{
+		metric->help = _strdup(help);
+		if (!metric->help)
+			goto fail;
+	}
+
+	if (type == FREERDP_METRIC_HISTOGRAM)
+	{
+		metric->buckets = calloc(METRIC_BUCKETS, sizeof(LONGLONG));
+		if (!metric->buckets)
+			goto fail;
+	}
+	return metric;
+
+fail:
+	metric_free(metric);
+	return nullptr;
+}
+
+static BOOL metric_same_family(const rdpMetric* metric, const char* name)
+{
+	WINPR_ASSERT(metric);
+	WINPR_ASSERT(name);
+
+	const size_t len = strcspn(name, "{");
+	return (len == metric->familyLength) && (strncmp(metric->name, name, len) == 0);
+}
+
+rdpMetric* metrics_get_metric(rdpMetrics* metrics, const char* name, FREERDP_METRIC_TYPE type,
+                              const char* help)
+{
+	rdpMetric* metric = nullptr;
+
+	if (!metrics || !name)
+		return nullptr;
+
+	rdp_metrics_internal* internal = metrics_cast(metrics);
+	EnterCriticalSection(&internal->lock);
+
+	for (size_t x = 0; x < internal->count; x++)
+	{
+		rdpMetric* cur = internal->list[x];
+		if (!metric_same_family(cur, name))
+			continue;
+
+		if (cur->type != type)
+		{
+			WLog_ERR(TAG, "metric %s registered with a different type", name);
+			goto out;
+		}
+
+		if (strcmp(cur->name, name) == 0)
+		{
+			metric = cur;
+			goto out;
+		}
+	}
+
+	if (internal->count == internal->capacity)
+	{
+		const size_t capacity = MAX(16, internal->capacity * 2);
+		rdpMetric** list = realloc(internal->list, capacity * sizeof(rdpMetric*));
+		if (!list)
+			goto out;
+		internal->list = list;
+		internal->capacity = capacity;
+	}
+
+	metric = metric_new(name, type, help);
+	if (metric)
+		internal->list[internal->count++] = metric;
+
+out:
+	LeaveCriticalSection(&internal->lock);
+	return metric;
+}
+
+size_t metrics_get_count(rdpMetrics* metrics)
+{
+	if (!metrics)
+		return 0;
+
+	rdp_metrics_internal* internal = metrics_cast(metrics);
+	EnterCriticalSection(&internal->lock);
+	const size_t count = internal->count;
+	LeaveCriticalSection(&internal->lock);
+	return count;
+}
+
+rdpMetric* metrics_get_metric_by_index(rdpMetrics* metrics, size_t index)
+{
+	rdpMetric* metric = nullptr;
+
+	if (!metrics)
+		return nullptr;
+
+	rdp_metrics_internal* internal = metrics_cast(metrics);
+	EnterCriticalSection(&internal->lock);
+	if (index < internal->count)
+		metric = internal->list[index];
+	LeaveCriticalSection(&internal->lock);
+	return metric;
+}
+
+void metric_add(rdpMetric* metric, INT64 value)
+{
+	if (!metric)
+		return;
+
+	WINPR_ASSERT(metric->type != FREERDP_METRIC_HISTOGRAM);
+	WINPR_ASSERT((metric->type != FREERDP_METRIC_COUNTER) || (value >= 0));
+	metric_add_value(&metric->value, value);
+}
+
+void metric_set(rdpMetric* metric, INT64 value)
+{
+	if (!metric)
+		return;
+
+	WINPR_ASSERT(metric->type == FREERDP_METRIC_GAUGE);
+	metric_store(&metric->value, value);
+}
+
+void metric_observe(rdpMetric* metric, UINT64 value)
+{
+	if (!metric)
+		return;
+
+	WINPR_ASSERT(metric->type == FREERDP_METRIC_HISTOGRAM);
+	WINPR_ASSERT(metric->buckets);
+
+	const size_t index = metric_bucket_index(value);
+	WINPR_ASSERT(index < METRIC_BUCKETS);
+
+	metric_add_value(&metric->buckets[index], 1);
+	metric_add_value(&metric->value, (LONGLONG)MIN(value, INT64_MAX));
+	metric_add_value(&metric->count, 1);
+}
+
+rdpMetric* metrics_get_histogram(rdpMetrics* metrics, const char* family, const char* label,
+                                 const char* value, const char* help)
+{
+	char name[128] = WINPR_C_ARRAY_INIT;
+
+	if (!metrics || !family)
+		return nullptr;
+
+	if (label && value)
+		(void)_snprintf(name, sizeof(name), "%s{%s=\"%s\"}", family, label, value);
+	else
+		(void)_snprintf(name, sizeof(name), "%s", family);
+
+	return metrics_get_metric(metrics, name, FREERDP_METRIC_HISTOGRAM, help);
+}
+
+void metrics_observe_duration(rdpMetrics* metrics, const char* family, const char* label,
+                              const char* value, const char* help, UINT64 duration)
+{
+	metric_observe(metrics_get_histogram(metrics, family, label, value, help), duration);
+}
+
+const char* metric_get_name(const rdpMetric* metric)
+{
+	if (!metric)
+		return nullptr;
+	return metric->name;
+}
+
+FREERDP_METRIC_TYPE metric_get_type(const rdpMetric* metric)
+{
+	WINPR_ASSERT(metric);
+	return metric->type;
+}
+
+INT64 metric_get_value(const rdpMetric* metric)
+{
+	if (!metric)
+		return 0;
+	return metric_load(&metric->value);
+}
+
+UINT64 metric_get_count(const rdpMetric* metric)
+{
+	if (!metric)
+		return 0;
+	return (UINT64)metric_load(&metric->count);
+}
+
+UINT64 metric_get_percentile(const rdpMetric* metric, double percentile)
+{
+	if (!metric || !metric->buckets)
+		return 0;
+
+	/* The buckets are updated concurrently, use their sum instead of the counter */
+	UINT64 total = 0;
+	for (size_t x = 0; x < METRIC_BUCKETS; x++)
+		total += (UINT64)metric_load(&metric->buckets[x]);
+	if (total == 0)
+		return 0;
+
+	const double p = MIN(MAX(percentile, 0.0), 100.0);
+	UINT64 target = (UINT64)((double)total * p / 100.0 + 0.5);
+	if (target == 0)
+		target = 1;
+
+	UINT64 seen = 0;
+	for (size_t x = 0; x < METRIC_BUCKETS; x++)
+	{
+		seen += (UINT64)metric_load(&metric->buckets[x]);
+		if (seen >= target)
+			return metric_bucket_value(x);
+	}
+	return metric_bucket_value(METRIC_BUCKETS - 1);
+}
+
+void metrics_input_sent(rdpMetrics* metrics)
+{
+	if (!metrics)
+		return;
+
+	/* Only the oldest input not yet followed by a frame is tracked */
+	rdp_metrics_internal* internal = metrics_cast(metrics);
+	const LONGLONG now = (LONGLONG)winpr_GetTickCount64NS();
+	const LONGLONG prev = InterlockedCompareExchange64(&internal->inputPending, now, 0);
+	WINPR_UNUSED(prev);
+}
+
+void metrics_frame_presented(rdpMetrics* metrics)
+{
+	if (!metrics)
+		return;
+
+	rdp_metrics_internal* internal = metrics_cast(metrics);
+	const LONGLONG sent = metric_load(&internal->inputPending);
+	if (sent == 0)
+		return;
+	if (InterlockedCompareExchange64(&internal->inputPending, 0, sent) != sent)
+		return;
+
+	const UINT64 now = winpr_GetTickCount64NS();
+	metric_observe(internal->inputToDisplay, now - (UINT64)sent);
+}
+
+typedef struct
+{
+	const rdpMetric* metric;
+	size_t session;
+} metric_entry;
+
+static int metric_entry_compare(const void* a, const void* b)
+{
+	const metric_entry* ea = a;
+	const metric_entry* eb = b;
+
+	const size_t la = ea->metric->familyLength;
+	const size_t lb = eb->metric->familyLength;
+	const int rc = strncmp(ea->metric->name, eb->metric->name, MIN(la, lb));
+	if (rc != 0)
+		return rc;
+	if (la != lb)
+		return (la < lb) ? -1 : 1;
+	if (ea->session != eb->session)
+		return (ea->session < eb->session) ? -1 : 1;
+	return strcmp(ea->metric->name, eb->metric->name);
+}
+
+static const char* metric_type_string(FREERDP_METRIC_TYPE type)
+{
+	switch (type)
+	{
+		case FREERDP_METRIC_COUNTER:
+			return "counter";
+		case FREERDP_METRIC_GAUGE:
+			return "gauge";
+		case FREERDP_METRIC_HISTOGRAM:
+		default:
+			return "summary";
+	}
+}
+
+WINPR_ATTR_FORMAT_ARG(2, 3)
+static BOOL metrics_printf(wStream* s, WINPR_FORMAT_ARG const char* fmt, ...)
+{
+	va_list ap = WINPR_C_ARRAY_INIT;
+	va_start(ap, fmt);
+	const int rc = vsnprintf(nullptr, 0, fmt, ap);
+	va_end(ap);
+	if (rc < 0)
+		return FALSE;
+
+	if (!Stream_EnsureRemainingCapacity(s, (size_t)rc + 1))
+		return FALSE;
+
+	va_start(ap, fmt);
+	(void)vsnprintf(Stream_Pointer(s), (size_t)rc + 1, fmt, ap);
+	va_end(ap);
+	Stream_Seek(s, (size_t)rc);
+	return TRUE;
+}
+
+/* Write the name of a sample, merging the labels of the metric, the session and the suffix */
+static BOOL metrics_write_sample_name(wStream* s, const rdpMetric* metric, const char* suffix,
+                                      const char* session, const char* extra)
+{
+	const char* labels = &metric->name[metric->familyLength];
+	size_t labelsLength = strlen(labels);
+	if (labelsLength >= 2)
+	{
+		/* strip the braces */
+		labels++;
+		labelsLength -= 2;
+	}
+	else
+		labelsLength = 0;
+
+	const char* parts[] = { session, extra };
+	if (!metrics_printf(s, "%.*s%s", (int)metric->familyLength, metric->name, suffix))
+		return FALSE;
+
+	BOOL open = FALSE;
+	if (labelsLength > 0)
+	{
+		if (!metrics_printf(s, "{%.*s", (int)labelsLength, labels))
+			return FALSE;
+		open = TRUE;
+	}
+
+	for (size_t x = 0; x < ARRAYSIZE(parts); x++)
+	{
+		if (!parts[x] || (strlen(parts[x]) == 0))
+			continue;
+		if (!metrics_printf(s, "%s%s", open ? "," : "{", parts[x]))
+			return FALSE;
+		open = TRUE;
+	}
+
+	if (open && !metrics_printf(s, "}"))
+		return FALSE;
+	return TRUE;
+}
+
+static BOOL metrics_write_metric(wStream* s, const rdpMetric* metric, const char* session)
+{
+	WINPR_ASSERT(metric);
+
+	switch (metric->type)
+	{
+		case FREERDP_METRIC_COUNTER:
+			return metrics_write_sample_name(s, metric, "_total", session, nullptr) &&
+			       metrics_printf(s, " %" PRId64 "\n", metric_get_value(metric));
+		case FREERDP_METRIC_GAUGE:
+			return metrics_write_sample_name(s, metric, "", session, nullptr) &&
+			       metrics_printf(s, " %" PRId64 "\n", metric_get_value(metric));
+		case FREERDP_METRIC_HISTOGRAM:
+		default:
+		{
+			const double quantiles[] = { 0.5, 0.9, 0.99 };
+			const char* names[] = { "quantile=\"0.5\"", "quantile=\"0.9\"", "quantile=\"0.99\"" };
+			for (size_t x = 0; x < ARRAYSIZE(quantiles); x++)
+			{
+				const UINT64 ns = metric_get_percentile(metric, quantiles[x] * 100.0);
+				if (!metrics_write_sample_name(s, metric, "", session, names[x]) ||
+				    !metrics_printf(s, " %.9f\n", (double)ns / 1000000000.0))
+					return FALSE;
+			}
+			return metrics_write_sample_name(s, metric, "_sum", session, nullptr) &&
+			       metrics_printf(s, " %.9f\n",
+			                      (double)metric_get_value(metric) / 1000000000.0) &&
+			       metrics_write_sample_name(s, metric, "_count", session, nullptr) &&
+			       metrics_printf(s, " %" PRIu64 "\n", metric_get_count(metric));
+		}
+	}
+}
+
+/* The compression statistics are plain fields of rdpMetrics, keep them in the registry
+ * so they are exported like every other metric. */
+static void metrics_update_bulk(rdpMetrics* metrics)
+{
+	rdp_metrics_internal* internal = metrics_cast(metrics);
+
+	/* metrics_write_bytes updates the fields from the session thread */
+	EnterCriticalSection(&internal->lock);
+	const UINT64 compressed = metrics->TotalCompressedBytes;
+	const UINT64 uncompressed = metrics->TotalUncompressedBytes;
+	const double ratio = metrics->TotalCompressionRatio;
+	LeaveCriticalSection(&internal->lock);
+
+	metric_set(metrics_get_metric(metrics, "freerdp_bulk_compressed_bytes", FREERDP_METRIC_GAUGE,
+	                              "Bytes after bulk compression"),
+	           (INT64)compressed);
+	metric_set(metrics_get_metric(metrics, "freerdp_bulk_uncompressed_bytes",
+	                              FREERDP_METRIC_GAUGE, "Bytes before bulk compression"),
+	           (INT64)uncompressed);
+	metric_set(metrics_get_metric(metrics, "freerdp_bulk_compression_ratio_percent",
+	                              FREERDP_METRIC_GAUGE,
+	                              "Compressed size in percent of the uncompressed size"),
+	           (INT64)(ratio * 100.0));
+}
+
+char* metrics_to_openmetrics(rdpMetrics* const* metrics, const char* const* labels, size_t count,
+                             size_t* plength)
+{
+	char* text = nullptr;
+	metric_entry* entries = nullptr;
+	size_t nentries = 0;
+	size_t capacity = 0;
+
+	wStream* s = Stream_New(nullptr, 4096);
+	if (!s)
+		return nullptr;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		rdpMetrics* cur = metrics ? metrics[x] : nullptr;
+		if (!cur)
+			continue;
+
+		metrics_update_bulk(cur);
+
+		rdp_metrics_internal* internal = metrics_cast(cur);
+		EnterCriticalSection(&internal->lock);
+		if (nentries + internal->count > capacity)
+		{
+			const size_t ncapacity = MAX(capacity * 2, nentries + internal->count);
+			metric_entry* tmp = realloc(entries, ncapacity * sizeof(metric_entry));
+			if (!tmp)
+			{
+				LeaveCriticalSection(&internal->lock);
+				goto fail;
+			}
+			entries = tmp;
+			capacity = ncapacity;
+		}
+
+		/* metrics are never removed, the pointers stay valid without the lock */
+		for (size_t y = 0; y < internal->count; y++)
+		{
+			metric_entry* entry = &entries[nentries++];
+			entry->metric = internal->list[y];
+			entry->session = x;
+		}
+		LeaveCriticalSection(&internal->lock);
+	}
+
+	if (nentries > 0)
+		qsort(entries, nentries, sizeof(metric_entry), metric_entry_compare);
+
+	for (size_t x = 0; x < nentries; x++)
+	{
+		const rdpMetric* metric = entries[x].metric;
+		const BOOL first = (x == 0) || !metric_same_family(entries[x - 1].metric, metric->name);
+		if (first)
+		{
+			const int len = (int)metric->familyLength;
+			if (!metrics_printf(s, "# TYPE %.*s %s\n", len, metric->name,
+			                    metric_type_string(metric->type)))
+				goto fail;
+			if (metric->help &&
+			    !metrics_printf(s, "# HELP %.*s %s\n", len, metric->name, metric->help))
+				goto fail;
+		}
+
+		const char* session = labels ? labels[entries[x].session] : nullptr;
+		if (!metrics_write_metric(s, metric, session))
+			goto fail;
+	}
+
+	if (!metrics_printf(s, "# EOF\n"))
+		goto fail;
+
+	if (plength)
+		*plength = Stream_GetPosition(s);
+	Stream_SealLength(s);
+	text = Stream_BufferAs(s, char);
+	Stream_Free(s, FALSE);
+	s = nullptr;
+
+fail:
+	free(entries);
+	Stream_Free(s, TRUE);
+	return text;
+}
+
 rdpMetrics* metrics_new(rdpContext* context)
 {
-	rdpMetrics* metrics = nullptr;
+	rdp_metrics_internal* internal = calloc(1, sizeof(rdp_metrics_internal));
+	if (!internal)
+		return nullptr;
 
-	metrics = (rdpMetrics*)calloc(1, sizeof(rdpMetrics));
+	internal->common.context = context;
+	if (!InitializeCriticalSectionAndSpinCount(&internal->lock, 4000))
+	{
+		free(internal);
+		return nullptr;
+	}
 
-	if (metrics)
+	internal->inputToDisplay =
+	    metrics_get_metric(&internal->common, "freerdp_input_to_display_seconds",
+	                       FREERDP_METRIC_HISTOGRAM, "Time from sending input to the next frame");
+	if (!internal->inputToDisplay)
 	{
-		metrics->context = context;
+		metrics_free(&internal->common);
+		return nullptr;
 	}
 
-	return metrics;
+	return &internal->common;
 }
 
 void metrics_free(rdpMetrics* metrics)
 {
-	free(metrics);
+	if (!metrics)
+		return;
+
+	rdp_metrics_internal* internal = metrics_cast(metrics);
+	for (size_t x = 0; x < internal->count; x++)
+		metric_free(internal->list[x]);
+	free(internal->list);
+	DeleteCriticalSection(&internal->lock);
+	free(internal);
+}
+
+static BOOL metrics_endpoint_send(SOCKET sockfd, const char* data, size_t length)
+{
+	size_t sent = 0;
+	while (sent < length)
+	{
+		const int rc = _send(sockfd, &data[sent], (int)MIN(length - sent, INT32_MAX), 0);
+		if (rc <= 0)
+			return FALSE;
+		sent += (size_t)rc;
+	}
+	return TRUE;
+}
+
+static void metrics_endpoint_error(SOCKET sockfd, const char* status)
+{
+	char response[256] = WINPR_C_ARRAY_INIT;
+	const int length = _snprintf(response, sizeof(response),
+	                             "HTTP/1.0 %s\r\n"
+	                             "Content-Type: text/plain; charset=utf-8\r\n"
+	                             "Content-Length: %" PRIuz "\r\n"
+	                             "Connection: close\r\n\r\n%s\n",
+	                             status, strlen(status) + 1, status);
+	if ((length > 0) && ((size_t)length < sizeof(response)))
+		(void)metrics_endpoint_send(sockfd, response, (size_t)length);
+}
+
+/* Checks the request line "<method> <path>[?<query>] HTTP/<version>", returns the HTTP status
+ * line for a request that is not answered with the metrics */
+static const char* metrics_endpoint_check_request(const char* request, BOOL* head)
+{
+	WINPR_ASSERT(request);
+	WINPR_ASSERT(head);
+
+	const char* path = strchr(request, ' ');
+	const char* end = path ? strchr(path + 1, ' ') : nullptr;
+	if (!end || (strncmp(end + 1, "HTTP/", 5) != 0))
+		return "400 Bad Request";
+	path++;
+
+	const size_t methodLength = (size_t)(path - 1 - request);
+	size_t pathLength = (size_t)(end - path);
+	const char* query = memchr(path, '?', pathLength);
+	if (query)
+		pathLength = (size_t)(query - path);
+
+	if ((pathLength != strlen(METRICS_ENDPOINT_PATH)) ||
+	    (strncmp(path, METRICS_ENDPOINT_PATH, pathLength) != 0))
+		return "404 Not Found";
+
+	*head = (methodLength == 4) && (strncmp(request, "HEAD", 4) == 0);
+	if (!*head && ((methodLength != 3) || (strncmp(request, "GET", 3) != 0)))
+		return "405 Method Not Allowed";
+	return nullptr;
+}
+
+static void metrics_endpoint_serve(rdpMetricsEndpoint* endpoint, SOCKET sockfd)
+{
+	WINPR_ASSERT(endpoint);
+
+	char request[1024] = WINPR_C_ARRAY_INIT;
+	size_t length = 0;
+	BOOL head = FALSE;
+
+	/* Only the request line is interpreted, wait for the end of the header */
+	while (length < sizeof(request) - 1)
+	{
+		const int rc = _recv(sockfd, &request[length], (int)(sizeof(request) - 1 - length), 0);
+		if (rc <= 0)
+			return;
+		length += (size_t)rc;
+		request[length] = '\0';
+		if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+			break;
+	}
+
+	const char* error = metrics_endpoint_check_request(request, &head);
+	if (error)
+	{
+		metrics_endpoint_error(sockfd, error);
+		return;
+	}
+
+	size_t textLength = 0;
+	char* text = endpoint->fkt(endpoint->arg, &textLength);
+	if (!text)
+		return;
+
+	char header[256] = WINPR_C_ARRAY_INIT;
+	const int headerLength =
+	    _snprintf(header, sizeof(header),
+	              "HTTP/1.0 200 OK\r\n"
+	              "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+	              "Content-Length: %" PRIuz "\r\n"
+	              "Connection: close\r\n\r\n",
+	              textLength);
+
+	if ((headerLength > 0) && metrics_endpoint_send(sockfd, header, (size_t)headerLength) &&
+	    !head)
+		(void)metrics_endpoint_send(sockfd, text, textLength);
+	free(text);
+}
+
+static DWORD WINAPI metrics_endpoint_thread(LPVOID arg)
+{
+	rdpMetricsEndpoint* endpoint = arg;
+	WINPR_ASSERT(endpoint);
+
+	HANDLE events[] = { endpoint->stopEvent, endpoint->event };
+	while (WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE) ==
+	       WAIT_OBJECT_0 + 1)
+	{
+		(void)WSAResetEvent(endpoint->event);
+
+		for (;;)
+		{
+			struct sockaddr_storage peer = WINPR_C_ARRAY_INIT;
+			int peerLength = sizeof(peer);
+			const SOCKET sockfd = _accept(endpoint->sockfd, (struct sockaddr*)&peer, &peerLength);
+			if (sockfd == INVALID_SOCKET)
+				break;
+
+			/* Requests are served one by one, do not let a client stall the endpoint */
+			const DWORD timeout = 1000;
+#ifdef _WIN32
+			u_long mode = 0;
+			(void)ioctlsocket(sockfd, FIONBIO, &mode);
+			(void)setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout,
+			                 sizeof(timeout));
+#else
+			(void)fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) & ~O_NONBLOCK);
+			const struct timeval tv = { .tv_sec = timeout / 1000, .tv_usec = 0 };
+			(void)setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+			(void)setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#endif
+			metrics_endpoint_serve(endpoint, sockfd);
+			closesocket(sockfd);
+		}
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+void metrics_endpoint_free(rdpMetricsEndpoint* endpoint)
+{
+	if (!endpoint)
+		return;
+
+	if (endpoint->thread)
+	{
+		(void)SetEvent(endpoint->stopEvent);
+		(void)WaitForSingleObject(endpoint->thread, INFINITE);
+		(void)CloseHandle(endpoint->thread);
+	}
+
+	if (endpoint->sockfd != INVALID_SOCKET)
+		closesocket(endpoint->sockfd);
+	if (endpoint->event)
+		(void)CloseHandle(endpoint->event);
+	if (endpoint->stopEvent)
+		(void)CloseHandle(endpoint->stopEvent);
+	free(endpoint);
+}
+
+rdpMetricsEndpoint* metrics_endpoint_new(const char* address, UINT16 port,
+                                         pMetricsEndpointExport fkt, void* arg)
+{
+	struct addrinfo* res = nullptr;
+
+	if (!fkt)
+		return nullptr;
+
+	rdpMetricsEndpoint* endpoint = calloc(1, sizeof(rdpMetricsEndpoint));
+	if (!endpoint)
+		return nullptr;
+
+	endpoint->sockfd = INVALID_SOCKET;
+	endpoint->fkt = fkt;
+	endpoint->arg = arg;
+
+	res = freerdp_tcp_resolve_host(address ? address : "localhost", port, 0);
+	if (!res)
+	{
+		WLog_ERR(TAG, "failed to resolve metrics endpoint address %s", address);
+		goto fail;
+	}
+
+	for (struct addrinfo* ai = res; ai; ai = ai->ai_next)
+	{
+		if ((ai->ai_family != AF_INET) && (ai->ai_family != AF_INET6))
+			continue;
+
+		const SOCKET sockfd = _socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (sockfd == INVALID_SOCKET)
+			continue;
+
+		const int option_value = 1;
+		(void)setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const void*)&option_value,
+		                 sizeof(option_value));
+
+		if ((_bind(sockfd, ai->ai_addr, WINPR_ASSERTING_INT_CAST(int, ai->ai_addrlen)) != 0) ||
+		    (_listen(sockfd, 4) != 0))
+		{
+			closesocket(sockfd);
+			continue;
+		}
+
+		endpoint->sockfd = sockfd;
+		break;
+	}
+
+	if (endpoint->sockfd == INVALID_SOCKET)
+	{
+		WLog_ERR(TAG, "failed to listen for metrics requests on port %" PRIu16, port);
+		goto fail;
+	}
+
+	endpoint->event = WSACreateEvent();
+	endpoint->stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!endpoint->event || !endpoint->stopEvent)
+		goto fail;
+
+	if (WSAEventSelect(endpoint->sockfd, endpoint->event, FD_READ | FD_ACCEPT) != 0)
+		goto fail;
+
+	endpoint->thread = CreateThread(nullptr, 0, metrics_endpoint_thread, endpoint, 0, nullptr);
+	if (!endpoint->thread)
+		goto fail;
+
+	WLog_INFO(TAG, "serving metrics on port %" PRIu16, port);
+	freeaddrinfo(res);
+	return endpoint;
+
+fail:
+	if (res)
+		freeaddrinfo(res);
+	metrics_endpoint_free(endpoint);
+	return nullptr;
 }
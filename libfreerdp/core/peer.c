@@ -157,13 +157,19 @@ static int freerdp_peer_virtual_channel_write(freerdp_peer* client, HANDLE hChan
 	totalLength = length;
 	flags = CHANNEL_FLAG_FIRST;
 
+	/* Coalesce the chunks into full size TLS records */
+	int rc = 1;
+	transport_cork(rdp->transport);
 	while (length > 0)
 	{
 		UINT16 sec_flags = 0;
 		s = rdp_send_stream_init(rdp, &sec_flags);
 
 		if (!s)
-			return -1;
+		{
+			rc = -1;
+			break;
+		}
 
 		if (length > maxChunkSize)
 		{
@@ -184,21 +190,27 @@ static int freerdp_peer_virtual_channel_write(freerdp_peer* client, HANDLE hChan
 		if (!Stream_EnsureRemainingCapacity(s, chunkSize))
 		{
 			Stream_Release(s);
-			return -1;
+			rc = -1;
+			break;
 		}
 
 		Stream_Write(s, buffer, chunkSize);
 
 		WINPR_ASSERT(peerChannel->channelId <= UINT16_MAX);
 		if (!rdp_send(rdp, s, (UINT16)peerChannel->channelId, sec_flags))
-			return -1;
+		{
+			rc = -1;
+			break;
+		}
 
 		buffer += chunkSize;
 		length -= chunkSize;
 		flags = 0;
 	}
 
-	return 1;
+	if (!transport_uncork(rdp->transport))
+		return -1;
+	return rc;
 }
 
 static void* freerdp_peer_virtual_channel_get_data(WINPR_ATTR_UNUSED freerdp_peer* client,
@@ -322,8 +334,18 @@ static BOOL freerdp_peer_check_fds(freerdp_peer* peer)
 	WINPR_ASSERT(peer->context);
 
 	rdp = peer->context->rdp;
+
+	/* Responses generated while processing the received data are coalesced.
+	 * During the connection sequence blocking handshakes must not be delayed */
+	const BOOL cork = rdp_get_state(rdp) == CONNECTION_STATE_ACTIVE;
+	if (cork)
+		transport_cork(rdp->transport);
+
 	status = rdp_check_fds(rdp);
 
+	if (cork && !transport_uncork(rdp->transport))
+		return FALSE;
+
 	return (status >= 0);
 }
 
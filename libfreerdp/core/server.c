@@ -41,6 +41,7 @@
 #include <freerdp/utils/drdynvc.h>
 
 #include "rdp.h"
+#include "../codec/zgfx.h"
 
 #include "server.h"
 
@@ -55,6 +56,17 @@
 #endif
 
 #define DVC_MAX_DATA_PDU_SIZE 1600
+#define DVC_MAX_VERSION 3
+/* Cmd, ChannelId and Length of a DATA_FIRST PDU */
+#define DVC_MAX_HEADER_SIZE 9
+
+/* Messages smaller than this are not worth compressing */
+#define DVC_COMPRESS_MIN_SIZE 64
+/* Number of messages sent uncompressed after compression did not pay off */
+#define DVC_COMPRESS_SKIP 16
+
+/* Bandwidth share of the priority classes, 70%, 20%, 7% and 3% as 65536 / share */
+static const UINT16 DVC_PRIORITY_CHARGES[DVC_PRIORITY_CLASSES] = { 936, 3276, 9362, 21845 };
 
 typedef struct
 {
@@ -64,6 +76,25 @@ typedef struct
 	UINT32 offset;
 } wtsChannelMessage;
 
+/* A PDU sent from a slice of a wtsSendBuffer, the header is written in front of it when sent */
+typedef struct
+{
+	size_t offset;
+	size_t length;
+	BYTE header[DVC_MAX_HEADER_SIZE];
+	BYTE headerLength;
+} wtsSendSlice;
+
+/* Stream shared by all the PDUs sliced from it, released when the last one was sent */
+typedef struct
+{
+	wStream* s;
+	LONG refs;
+	UINT16 channelId;
+	size_t count;
+	wtsSendSlice* slices;
+} wtsSendBuffer;
+
 static const DWORD g_err_oom = WINPR_CXX_COMPAT_CAST(DWORD, E_OUTOFMEMORY);
 
 static DWORD g_SessionId = 1;
@@ -101,20 +132,121 @@ static BOOL wts_queue_receive_data(rdpPeerChannel* channel, const BYTE* Buffer1,
 	return MessageQueue_Post(channel->queue, messageCtx, 0, nullptr, nullptr);
 }
 
-static BOOL wts_queue_send_item(rdpPeerChannel* channel, BYTE* Buffer, UINT32 Length)
+static wtsSendBuffer* wts_send_buffer_new(rdpPeerChannel* channel, wStream* s, size_t count)
 {
-	BYTE* buffer = nullptr;
-	UINT32 length = 0;
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(s);
+
+	wtsSendBuffer* buffer = calloc(1, sizeof(wtsSendBuffer) + count * sizeof(wtsSendSlice));
+	if (!buffer)
+		return nullptr;
+
+	WINPR_ASSERT(channel->channelId <= UINT16_MAX);
+	buffer->s = s;
+	buffer->refs = WINPR_ASSERTING_INT_CAST(LONG, count);
+	buffer->channelId = (UINT16)channel->channelId;
+	buffer->count = count;
+	buffer->slices = (wtsSendSlice*)&buffer[1];
+	return buffer;
+}
+
+static void wts_send_buffer_unref(wtsSendBuffer* buffer)
+{
+	if (!buffer)
+		return;
+
+	if (InterlockedDecrement(&buffer->refs) > 0)
+		return;
+
+	Stream_Release(buffer->s);
+	free(buffer);
+}
 
+/**
+ * Queue every slice of a buffer, the buffer belongs to the queue afterwards.
+ * Slices are sent in order, so a header may overwrite the end of the previous slice.
+ */
+static BOOL wts_queue_send_buffer(WTSVirtualChannelManager* vcm, BYTE priorityClass,
+                                  wtsSendBuffer* buffer)
+{
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(priorityClass < DVC_PRIORITY_CLASSES);
+
+	if (buffer->count == 0)
+	{
+		Stream_Release(buffer->s);
+		free(buffer);
+		return TRUE;
+	}
+
+	for (size_t x = 0; x < buffer->count; x++)
+	{
+		if (!MessageQueue_Post(vcm->queue, (void*)(UINT_PTR)buffer->channelId, priorityClass,
+		                       buffer, (void*)(UINT_PTR)x))
+		{
+			for (size_t y = x; y < buffer->count; y++)
+				wts_send_buffer_unref(buffer);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* Queue length bytes at offset of s unmodified, takes ownership of s */
+static BOOL wts_queue_send_stream(rdpPeerChannel* channel, BYTE priorityClass, wStream* s,
+                                  size_t offset, size_t length)
+{
 	WINPR_ASSERT(channel);
 	WINPR_ASSERT(channel->vcm);
-	buffer = Buffer;
-	length = Length;
 
-	WINPR_ASSERT(channel->channelId <= UINT16_MAX);
-	const UINT16 channelId = (UINT16)channel->channelId;
-	return MessageQueue_Post(channel->vcm->queue, (void*)(UINT_PTR)channelId, 0, (void*)buffer,
-	                         (void*)(UINT_PTR)length);
+	wtsSendBuffer* buffer = wts_send_buffer_new(channel, s, (length > 0) ? 1 : 0);
+	if (!buffer)
+	{
+		Stream_Release(s);
+		return FALSE;
+	}
+
+	if (length > 0)
+	{
+		buffer->slices[0].offset = offset;
+		buffer->slices[0].length = length;
+	}
+
+	return wts_queue_send_buffer(channel->vcm, priorityClass, buffer);
+}
+
+static void wts_virtual_channel_manager_free_message(void* obj)
+{
+	wMessage* msg = (wMessage*)obj;
+
+	if (msg)
+		wts_send_buffer_unref((wtsSendBuffer*)msg->wParam);
+}
+
+static BYTE wts_channel_priority_class(UINT16 type, UINT32 flags, UINT32 options)
+{
+	switch (flags & WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL)
+	{
+		case WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL:
+			return 0;
+		case WTS_CHANNEL_OPTION_DYNAMIC_PRI_HIGH:
+			return 1;
+		case WTS_CHANNEL_OPTION_DYNAMIC_PRI_MED:
+			return 2;
+		default:
+			break;
+	}
+
+	/* Dynamic channels default to low priority, static ones to what the client requested */
+	if (type == RDP_PEER_CHANNEL_TYPE_DVC)
+		return 3;
+	if (options & CHANNEL_OPTION_PRI_HIGH)
+		return 1;
+	if (options & CHANNEL_OPTION_PRI_LOW)
+		return 3;
+	return 2;
 }
 
 static unsigned wts_read_variable_uint(wStream* s, int cbLen, UINT32* val)
@@ -172,8 +304,7 @@ static BOOL wts_read_drdynvc_capabilities_response(rdpPeerChannel* channel, UINT
 	WTSVirtualChannelManager* vcm = channel->vcm;
 	vcm->drdynvc_state = DRDYNVC_STATE_READY;
 
-	/* we only support version 1 for now (no compression yet) */
-	vcm->dvc_spoken_version = MAX(Version, 1);
+	vcm->dvc_spoken_version = MIN(Version, DVC_MAX_VERSION);
 
 	return SetEvent(MessageQueue_Event(vcm->queue));
 }
@@ -620,13 +751,16 @@ BOOL WTSVirtualChannelManagerOpen(HANDLE hServer)
 			wStream staticS = WINPR_C_ARRAY_INIT;
 			wStream* s = Stream_StaticInit(&staticS, capaBuffer, sizeof(capaBuffer));
 
+			/* Channel setup must not wait for bulk data */
+			channel->priorityClass = 0;
 			vcm->drdynvc_channel = channel;
 			vcm->dvc_spoken_version = 1;
-			Stream_Write_UINT8(s, 0x50);    /* Cmd=5 sp=0 cbId=0 */
-			Stream_Write_UINT8(s, 0x00);    /* Pad */
-			Stream_Write_UINT16(s, 0x0001); /* Version */
+			Stream_Write_UINT8(s, 0x50);             /* Cmd=5 sp=0 cbId=0 */
+			Stream_Write_UINT8(s, 0x00);             /* Pad */
+			Stream_Write_UINT16(s, DVC_MAX_VERSION); /* Version */
 
-			/* TODO: shall implement version 2 and 3 */
+			for (size_t x = 0; x < DVC_PRIORITY_CLASSES; x++)
+				Stream_Write_UINT16(s, DVC_PRIORITY_CHARGES[x]); /* PriorityChargeX */
 
 			const size_t pos = Stream_GetPosition(s);
 			WINPR_ASSERT(pos <= UINT32_MAX);
@@ -639,10 +773,59 @@ BOOL WTSVirtualChannelManagerOpen(HANDLE hServer)
 	return TRUE;
 }
 
+/* Move newly queued items to the queue of their priority class */
+static BOOL wts_sort_send_queue(WTSVirtualChannelManager* vcm)
+{
+	wMessage message = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(vcm);
+	while (MessageQueue_Peek(vcm->queue, &message, TRUE))
+	{
+		const size_t priorityClass = MIN(message.id, DVC_PRIORITY_CLASSES - 1);
+		wMessageQueue* queue = vcm->sendQueues[priorityClass];
+
+		/* An idle class must not make up for the time it did not send anything */
+		if (MessageQueue_Size(queue) == 0)
+			vcm->sendTime[priorityClass] = MAX(vcm->sendTime[priorityClass], vcm->sendClock);
+
+		if (!MessageQueue_Dispatch(queue, &message))
+		{
+			wts_virtual_channel_manager_free_message(&message);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Pick the class to send from next. Every class is charged the size of the data sent
+ * times its PriorityCharge, the one with the lowest charge so far goes first.
+ */
+static BOOL wts_next_send_class(const WTSVirtualChannelManager* vcm, size_t* pPriorityClass)
+{
+	BOOL found = FALSE;
+
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(pPriorityClass);
+	for (size_t x = 0; x < DVC_PRIORITY_CLASSES; x++)
+	{
+		if (MessageQueue_Size(vcm->sendQueues[x]) == 0)
+			continue;
+
+		if (!found || (vcm->sendTime[x] < vcm->sendTime[*pPriorityClass]))
+			*pPriorityClass = x;
+		found = TRUE;
+	}
+
+	return found;
+}
+
 BOOL WTSVirtualChannelManagerCheckFileDescriptorEx(HANDLE hServer, BOOL autoOpen)
 {
 	wMessage message = WINPR_C_ARRAY_INIT;
 	BOOL status = TRUE;
+	size_t priorityClass = 0;
 	WTSVirtualChannelManager* vcm = nullptr;
 
 	if (!hServer || hServer == INVALID_HANDLE_VALUE)
@@ -656,28 +839,43 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptorEx(HANDLE hServer, BOOL autoOpen
 			return FALSE;
 	}
 
-	while (MessageQueue_Peek(vcm->queue, &message, TRUE))
+	/* Send all queued channel data in as few TLS records as possible */
+	WINPR_ASSERT(vcm->rdp);
+	transport_cork(vcm->rdp->transport);
+	status = wts_sort_send_queue(vcm);
+	while (status && wts_next_send_class(vcm, &priorityClass) &&
+	       MessageQueue_Peek(vcm->sendQueues[priorityClass], &message, TRUE))
 	{
-		BYTE* buffer = nullptr;
-		UINT32 length = 0;
-		UINT16 channelId = 0;
-		channelId = (UINT16)(UINT_PTR)message.context;
-		buffer = (BYTE*)message.wParam;
-		length = (UINT32)(UINT_PTR)message.lParam;
+		wtsSendBuffer* buffer = (wtsSendBuffer*)message.wParam;
+		const size_t index = (size_t)(UINT_PTR)message.lParam;
+		WINPR_ASSERT(buffer);
+		WINPR_ASSERT(index < buffer->count);
+
+		/* The previous slice was already sent, the header may overwrite its end */
+		const wtsSendSlice* slice = &buffer->slices[index];
+		WINPR_ASSERT(slice->offset >= slice->headerLength);
+		BYTE* data = Stream_Buffer(buffer->s) + slice->offset - slice->headerLength;
+		const size_t length = slice->headerLength + slice->length;
+		CopyMemory(data, slice->header, slice->headerLength);
 
 		WINPR_ASSERT(vcm->client);
 		WINPR_ASSERT(vcm->client->SendChannelData);
-		if (!vcm->client->SendChannelData(vcm->client, channelId, buffer, length))
+		if (!vcm->client->SendChannelData(vcm->client, buffer->channelId, data, length))
 		{
 			status = FALSE;
 		}
 
-		free(buffer);
+		vcm->sendClock = vcm->sendTime[priorityClass];
+		vcm->sendTime[priorityClass] += 1ull * length * DVC_PRIORITY_CHARGES[priorityClass];
+		wts_send_buffer_unref(buffer);
 
-		if (!status)
-			break;
+		/* Data queued meanwhile may have a higher priority */
+		if (status)
+			status = wts_sort_send_queue(vcm);
 	}
 
+	if (!transport_uncork(vcm->rdp->transport))
+		status = FALSE;
 	return status;
 }
 
@@ -1007,19 +1205,6 @@ HANDLE WINAPI FreeRDP_WTSOpenServerW(WINPR_ATTR_UNUSED LPWSTR pServerName)
 	return INVALID_HANDLE_VALUE;
 }
 
-static void wts_virtual_channel_manager_free_message(void* obj)
-{
-	wMessage* msg = (wMessage*)obj;
-
-	if (msg)
-	{
-		BYTE* buffer = (BYTE*)msg->wParam;
-
-		if (buffer)
-			free(buffer);
-	}
-}
-
 static void channel_free(rdpPeerChannel* channel)
 {
 	server_channel_common_free(channel);
@@ -1092,6 +1277,9 @@ static void wtsCloseVCM(WTSVirtualChannelManager* vcm, bool closeDrdynvc)
 		}
 
 		MessageQueue_Free(vcm->queue);
+		for (size_t x = 0; x < DVC_PRIORITY_CLASSES; x++)
+			MessageQueue_Free(vcm->sendQueues[x]);
+		StreamPool_Free(vcm->streamPool);
 		free(vcm);
 	}
 	HashTable_Unlock(g_ServerHandles);
@@ -1128,6 +1316,17 @@ HANDLE WINAPI FreeRDP_WTSOpenServerA(LPSTR pServerName)
 	if (!vcm->queue)
 		goto fail;
 
+	for (size_t x = 0; x < DVC_PRIORITY_CLASSES; x++)
+	{
+		vcm->sendQueues[x] = MessageQueue_New(&queueCallbacks);
+		if (!vcm->sendQueues[x])
+			goto fail;
+	}
+
+	vcm->streamPool = StreamPool_New(TRUE, DVC_MAX_DATA_PDU_SIZE);
+	if (!vcm->streamPool)
+		goto fail;
+
 	vcm->dvc_channel_id_seq = 0;
 	vcm->dynamicVirtualChannels = HashTable_New(TRUE);
 
@@ -1397,7 +1596,7 @@ static void peer_channel_queue_free_message(void* obj)
 
 static rdpPeerChannel* channel_new(WTSVirtualChannelManager* vcm, freerdp_peer* client,
                                    UINT32 ChannelId, UINT16 index, UINT16 type, size_t chunkSize,
-                                   const char* name, UINT32 flags)
+                                   const char* name, UINT32 flags, UINT32 options)
 {
 	wObject queueCallbacks = WINPR_C_ARRAY_INIT;
 	queueCallbacks.fnObjectFree = peer_channel_queue_free_message;
@@ -1416,6 +1615,7 @@ static rdpPeerChannel* channel_new(WTSVirtualChannelManager* vcm, freerdp_peer*
 	channel->creationStatus =
 	    (type == RDP_PEER_CHANNEL_TYPE_SVC) ? ERROR_SUCCESS : ERROR_OPERATION_IN_PROGRESS;
 	channel->channelFlags = flags;
+	channel->priorityClass = wts_channel_priority_class(type, flags, options);
 
 	return channel;
 fail:
@@ -1478,7 +1678,8 @@ static HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenStatic(HANDLE hServer,
 
 		WINPR_ASSERT(index <= UINT16_MAX);
 		channel = channel_new(vcm, client, joined_channel->ChannelId, (UINT16)index,
-		                      RDP_PEER_CHANNEL_TYPE_SVC, VCChunkSize, pVirtualName, Flags);
+		                      RDP_PEER_CHANNEL_TYPE_SVC, VCChunkSize, pVirtualName, Flags,
+		                      joined_channel->options);
 
 		if (!channel)
 			goto fail;
@@ -1504,7 +1705,6 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 	wStream* s = nullptr;
 	rdpPeerChannel* channel = nullptr;
 	BOOL joined = FALSE;
-	ULONG written = 0;
 
 	if (!setup())
 		return nullptr;
@@ -1562,8 +1762,8 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 
 	const UINT32 VCChunkSize =
 	    freerdp_settings_get_uint32(client->context->settings, FreeRDP_VCChunkSize);
-	channel =
-	    channel_new(vcm, client, 0, 0, RDP_PEER_CHANNEL_TYPE_DVC, VCChunkSize, pVirtualName, flags);
+	channel = channel_new(vcm, client, 0, 0, RDP_PEER_CHANNEL_TYPE_DVC, VCChunkSize, pVirtualName,
+	                      flags, 0);
 
 	if (!channel)
 	{
@@ -1589,10 +1789,12 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 		goto fail;
 
 	{
+		/* Queue with the channel data, the client drops data of channels it does not know */
 		const size_t pos = Stream_GetPosition(s);
-		WINPR_ASSERT(pos <= UINT32_MAX);
-		if (!WTSVirtualChannelWrite(vcm->drdynvc_channel, Stream_BufferAs(s, char), (UINT32)pos,
-		                            &written))
+		const BOOL queued =
+		    wts_queue_send_stream(vcm->drdynvc_channel, channel->priorityClass, s, 0, pos);
+		s = nullptr;
+		if (!queued)
 			goto fail;
 	}
 
@@ -1643,23 +1845,20 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelClose(HANDLE hChannelHandle)
 		{
 			if (channel->dvc_open_state == DVC_OPEN_STATE_SUCCEEDED)
 			{
-				ULONG written = 0;
-				s = Stream_New(nullptr, 8);
+				s = StreamPool_Take(vcm->streamPool, 8);
 
 				if (!s)
 				{
-					WLog_ERR(TAG, "Stream_New failed!");
+					WLog_ERR(TAG, "StreamPool_Take failed!");
 					ret = FALSE;
 				}
 				else
 				{
 					wts_write_drdynvc_header(s, CLOSE_REQUEST_PDU, channel->channelId);
 
-					const size_t pos = Stream_GetPosition(s);
-					WINPR_ASSERT(pos <= UINT32_MAX);
-					ret = WTSVirtualChannelWrite(vcm->drdynvc_channel, Stream_BufferAs(s, char),
-					                             (UINT32)pos, &written);
-					Stream_Free(s, TRUE);
+					/* Queue with the channel data so it does not overtake what is still pending */
+					ret = wts_queue_send_stream(vcm->drdynvc_channel, channel->priorityClass, s, 0,
+					                            Stream_GetPosition(s));
 				}
 			}
 			HashTable_Remove(vcm->dynamicVirtualChannels, &channel->channelId);
@@ -1716,101 +1915,261 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelRead(HANDLE hChannelHandle, WINPR_ATTR_UNUS
 	return TRUE;
 }
 
-BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer, ULONG uLength,
-                                           PULONG pBytesWritten)
+/* Compress outgoing data of a dynamic channel, only possible with DRDYNVC version 3 */
+static BOOL wts_dvc_compress(rdpPeerChannel* channel, size_t length)
 {
-	wStream* s = nullptr;
-	int cbLen = 0;
-	int cbChId = 0;
-	int first = 0;
-	BYTE* buffer = nullptr;
-	size_t totalWritten = 0;
-	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
-	BOOL ret = FALSE;
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->vcm);
 
-	if (!channel)
+	if (channel->vcm->dvc_spoken_version < 3)
 		return FALSE;
 
-	EnterCriticalSection(&channel->writeLock);
+	if ((channel->channelFlags & WTS_CHANNEL_OPTION_DYNAMIC_NO_COMPRESS) ||
+	    (length < DVC_COMPRESS_MIN_SIZE))
+		return FALSE;
+
+	if (channel->compressSkip > 0)
+	{
+		channel->compressSkip--;
+		return FALSE;
+	}
+
+	/* Only channels that actually send larger messages pay for the history */
+	if (!channel->compressor)
+		channel->compressor = zgfx_context_new_lite(TRUE);
+
+	return channel->compressor != nullptr;
+}
+
+/**
+ * Write ChannelId and for a DATA_FIRST PDU the Length of a DVC data PDU, skipping the Cmd byte.
+ * A DATA_FIRST PDU is only used for the first PDU of a message that does not fit a single PDU.
+ *
+ * @return the Cmd byte of the PDU
+ */
+static BYTE wts_write_dvc_data_header(wStream* s, BOOL compressed, UINT32 ChannelId, BOOL first,
+                                      size_t left, size_t overhead)
+{
+	WINPR_ASSERT(s);
+
+	const size_t start = Stream_GetPosition(s);
+	Stream_Seek_UINT8(s);
+	const int cbChId = wts_write_variable_uint(s, ChannelId);
+	const size_t headerLength = Stream_GetPosition(s) - start;
+
+	if (!first || (left + overhead <= DVC_MAX_DATA_PDU_SIZE - headerLength))
+	{
+		const BYTE Cmd = compressed ? DATA_COMPRESSED_PDU : DATA_PDU;
+		return ((Cmd << 4) | cbChId) & 0xFF;
+	}
+
+	const BYTE Cmd = compressed ? DATA_FIRST_COMPRESSED_PDU : DATA_FIRST_PDU;
+	const int cbLen = wts_write_variable_uint(s, WINPR_ASSERTING_INT_CAST(uint32_t, left));
+	return ((Cmd << 4) | (cbLen << 2) | cbChId) & 0xFF;
+}
+
+/**
+ * Slice length bytes at offset of s into DATA_FIRST/DATA PDUs, takes ownership of s.
+ * There must be DVC_MAX_HEADER_SIZE bytes in front of offset for the header of the first PDU.
+ */
+static BOOL wts_queue_dvc_data(rdpPeerChannel* channel, wStream* s, size_t offset, size_t length)
+{
+	WINPR_ASSERT(channel);
 	WINPR_ASSERT(channel->vcm);
-	if (channel->channelType == RDP_PEER_CHANNEL_TYPE_SVC)
+	WINPR_ASSERT(offset >= DVC_MAX_HEADER_SIZE);
+
+	const size_t maxCount = length / (DVC_MAX_DATA_PDU_SIZE - DVC_MAX_HEADER_SIZE) + 1;
+	wtsSendBuffer* buffer = wts_send_buffer_new(channel->vcm->drdynvc_channel, s, maxCount);
+	if (!buffer)
 	{
-		buffer = (BYTE*)malloc(uLength);
+		Stream_Release(s);
+		return FALSE;
+	}
 
-		if (!buffer)
+	size_t count = 0;
+	for (size_t left = length; left > 0; count++)
+	{
+		wStream sbuffer = WINPR_C_ARRAY_INIT;
+		wtsSendSlice* slice = &buffer->slices[count];
+		wStream* hs = Stream_StaticInit(&sbuffer, slice->header, sizeof(slice->header));
+
+		slice->header[0] =
+		    wts_write_dvc_data_header(hs, FALSE, channel->channelId, count == 0, left, 0);
+		slice->headerLength = (BYTE)Stream_GetPosition(hs);
+		slice->offset = offset;
+		slice->length = MIN(left, DVC_MAX_DATA_PDU_SIZE - slice->headerLength);
+		offset += slice->length;
+		left -= slice->length;
+	}
+
+	WINPR_ASSERT(count <= maxCount);
+	buffer->count = count;
+	buffer->refs = WINPR_ASSERTING_INT_CAST(LONG, count);
+	return wts_queue_send_buffer(channel->vcm, channel->priorityClass, buffer);
+}
+
+/* Compress data into DATA_FIRST_COMPRESSED/DATA_COMPRESSED PDUs laid out in one stream */
+static BOOL wts_queue_dvc_compressed(rdpPeerChannel* channel, const BYTE* data, size_t length)
+{
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->vcm);
+	WINPR_ASSERT(data);
+
+	/* segment descriptor and header of the RDP8 compressed data */
+	const size_t overhead = 2;
+	const size_t maxCount =
+	    length / (DVC_MAX_DATA_PDU_SIZE - DVC_MAX_HEADER_SIZE - overhead) + 1;
+	wStream* s = StreamPool_Take(channel->vcm->streamPool, maxCount * DVC_MAX_DATA_PDU_SIZE);
+	if (!s)
+		return FALSE;
+
+	wtsSendBuffer* buffer = wts_send_buffer_new(channel->vcm->drdynvc_channel, s, maxCount);
+	if (!buffer)
+	{
+		Stream_Release(s);
+		return FALSE;
+	}
+
+	size_t count = 0;
+	for (size_t left = length; left > 0; count++)
+	{
+		UINT32 flags = 0;
+		wtsSendSlice* slice = &buffer->slices[count];
+		const size_t start = Stream_GetPosition(s);
+		const BYTE header =
+		    wts_write_dvc_data_header(s, TRUE, channel->channelId, count == 0, left, overhead);
+		const size_t chunk =
+		    MIN(left, DVC_MAX_DATA_PDU_SIZE - (Stream_GetPosition(s) - start) - overhead);
+
+		if (zgfx_compress_to_stream(channel->compressor, s, data, (UINT32)chunk, &flags) < 0)
 		{
-			SetLastError(g_err_oom);
-			goto fail;
+			buffer->count = count;
+			buffer->refs = 1;
+			wts_send_buffer_unref(buffer);
+			return FALSE;
 		}
 
-		CopyMemory(buffer, Buffer, uLength);
-		totalWritten = uLength;
-		if (!wts_queue_send_item(channel, buffer, uLength))
-			goto fail;
+		Stream_Buffer(s)[start] = header;
+		slice->offset = start;
+		slice->length = Stream_GetPosition(s) - start;
+		data += chunk;
+		left -= chunk;
 	}
-	else if (!channel->vcm->drdynvc_channel || (channel->vcm->drdynvc_state != DRDYNVC_STATE_READY))
+
+	/* Already compressed data, do not waste time on the next few messages */
+	if (Stream_GetPosition(s) * 16 > length * 15)
+		channel->compressSkip = DVC_COMPRESS_SKIP;
+
+	WINPR_ASSERT(count <= maxCount);
+	buffer->count = count;
+	buffer->refs = WINPR_ASSERTING_INT_CAST(LONG, count);
+	return wts_queue_send_buffer(channel->vcm, channel->priorityClass, buffer);
+}
+
+/**
+ * Queue length bytes of data, either from the stream s (which then starts with
+ * DVC_MAX_HEADER_SIZE reserved bytes) or copied from data. Takes ownership of s.
+ */
+static BOOL wts_channel_write(rdpPeerChannel* channel, wStream* s, const BYTE* data, size_t length)
+{
+	BOOL ret = FALSE;
+
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->vcm);
+	WINPR_ASSERT(data || (length == 0));
+
+	EnterCriticalSection(&channel->writeLock);
+	if ((channel->channelType == RDP_PEER_CHANNEL_TYPE_DVC) &&
+	    (!channel->vcm->drdynvc_channel || (channel->vcm->drdynvc_state != DRDYNVC_STATE_READY)))
 	{
 		DEBUG_DVC("drdynvc not ready");
 		goto fail;
 	}
-	else
+
+	if ((channel->channelType == RDP_PEER_CHANNEL_TYPE_DVC) && wts_dvc_compress(channel, length))
 	{
-		first = TRUE;
+		/* The compressor reads from the data directly */
+		ret = wts_queue_dvc_compressed(channel, data, length);
+		goto fail;
+	}
 
-		size_t Length = uLength;
-		while (Length > 0)
+	if (!s)
+	{
+		s = StreamPool_Take(channel->vcm->streamPool, DVC_MAX_HEADER_SIZE + length);
+		if (!s)
 		{
-			s = Stream_New(nullptr, DVC_MAX_DATA_PDU_SIZE);
-
-			if (!s)
-			{
-				WLog_ERR(TAG, "Stream_New failed!");
-				SetLastError(g_err_oom);
-				goto fail;
-			}
-
-			buffer = Stream_Buffer(s);
-			Stream_Seek_UINT8(s);
-			cbChId = wts_write_variable_uint(s, channel->channelId);
-
-			if (first && (Length > Stream_GetRemainingLength(s)))
-			{
-				cbLen = wts_write_variable_uint(s, WINPR_ASSERTING_INT_CAST(uint32_t, Length));
-				buffer[0] = ((DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId) & 0xFF;
-			}
-			else
-			{
-				buffer[0] = ((DATA_PDU << 4) | cbChId) & 0xFF;
-			}
-
-			first = FALSE;
-			size_t written = Stream_GetRemainingLength(s);
-
-			if (written > Length)
-				written = Length;
-
-			Stream_Write(s, Buffer, written);
-			const size_t length = Stream_GetPosition(s);
-			Stream_Free(s, FALSE);
-			if (length > UINT32_MAX)
-				goto fail;
-			Length -= written;
-			Buffer += written;
-			totalWritten += written;
-			if (!wts_queue_send_item(channel->vcm->drdynvc_channel, buffer, (UINT32)length))
-				goto fail;
+			SetLastError(g_err_oom);
+			goto fail;
 		}
+
+		Stream_Seek(s, DVC_MAX_HEADER_SIZE);
+		Stream_Write(s, data, length);
 	}
 
-	if (pBytesWritten)
-		*pBytesWritten = WINPR_ASSERTING_INT_CAST(uint32_t, totalWritten);
+	if (channel->channelType == RDP_PEER_CHANNEL_TYPE_SVC)
+		ret = wts_queue_send_stream(channel, channel->priorityClass, s, DVC_MAX_HEADER_SIZE,
+		                            length);
+	else
+		ret = wts_queue_dvc_data(channel, s, DVC_MAX_HEADER_SIZE, length);
+	s = nullptr;
 
-	ret = TRUE;
 fail:
+	if (s)
+		Stream_Release(s);
 	LeaveCriticalSection(&channel->writeLock);
 	return ret;
 }
 
+wStream* WTSVirtualChannelStreamNew(HANDLE hChannelHandle, size_t size)
+{
+	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
+
+	if (!channel)
+		return nullptr;
+
+	WINPR_ASSERT(channel->vcm);
+	wStream* s = StreamPool_Take(channel->vcm->streamPool, DVC_MAX_HEADER_SIZE + size);
+	if (!s)
+		return nullptr;
+
+	Stream_Seek(s, DVC_MAX_HEADER_SIZE);
+	return s;
+}
+
+BOOL WTSVirtualChannelWriteStream(HANDLE hChannelHandle, wStream* s)
+{
+	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
+
+	if (!s)
+		return FALSE;
+
+	const size_t pos = Stream_GetPosition(s);
+	if (!channel || (pos < DVC_MAX_HEADER_SIZE) || (pos - DVC_MAX_HEADER_SIZE > UINT32_MAX))
+	{
+		Stream_Release(s);
+		return FALSE;
+	}
+
+	return wts_channel_write(channel, s, Stream_Buffer(s) + DVC_MAX_HEADER_SIZE,
+	                         pos - DVC_MAX_HEADER_SIZE);
+}
+
+BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer, ULONG uLength,
+                                           PULONG pBytesWritten)
+{
+	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
+
+	if (!channel || (!Buffer && (uLength > 0)))
+		return FALSE;
+
+	if (!wts_channel_write(channel, nullptr, (const BYTE*)Buffer, uLength))
+		return FALSE;
+
+	if (pBytesWritten)
+		*pBytesWritten = uLength;
+	return TRUE;
+}
+
 BOOL WINAPI FreeRDP_WTSVirtualChannelPurgeInput(WINPR_ATTR_UNUSED HANDLE hChannelHandle)
 {
 	WLog_ERR("TODO", "TODO: implement");
@@ -2170,6 +2529,7 @@ void server_channel_common_free(rdpPeerChannel* channel)
 		return;
 	MessageQueue_Free(channel->queue);
 	Stream_Free(channel->receiveData, TRUE);
+	zgfx_context_free(channel->compressor);
 	DeleteCriticalSection(&channel->writeLock);
 	free(channel);
 }
@@ -24,6 +24,7 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/api.h>
 #include <freerdp/channels/wtsvc.h>
+#include <freerdp/codec/zgfx.h>
 
 #include <winpr/synch.h>
 #include <winpr/stream.h>
@@ -49,6 +50,9 @@ enum
 	DVC_OPEN_STATE_CLOSED = 3
 };
 
+/* [MS-RDPEDYC] priority classes, 0 is the highest */
+#define DVC_PRIORITY_CLASSES 4
+
 struct rdp_peer_channel
 {
 	WTSVirtualChannelManager* vcm;
@@ -70,6 +74,10 @@ struct rdp_peer_channel
 
 	char channelName[128];
 	CRITICAL_SECTION writeLock;
+
+	BYTE priorityClass;
+	ZGFX_CONTEXT* compressor;
+	UINT32 compressSkip;
 };
 
 struct WTSVirtualChannelManager
@@ -89,6 +97,12 @@ struct WTSVirtualChannelManager
 	void* dvc_creation_status_userdata;
 
 	wHashTable* dynamicVirtualChannels;
+
+	wMessageQueue* sendQueues[DVC_PRIORITY_CLASSES];
+	UINT64 sendTime[DVC_PRIORITY_CLASSES];
+	UINT64 sendClock;
+
+	wStreamPool* streamPool;
 };
 
 WINPR_ATTR_NODISCARD
@@ -1000,6 +1000,8 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 	    !freerdp_settings_set_uint32(settings, FreeRDP_DesktopPosX, UINT32_MAX) ||
 	    !freerdp_settings_set_uint32(settings, FreeRDP_DesktopPosY, UINT32_MAX) ||
 	    !freerdp_settings_set_bool(settings, FreeRDP_SoftwareGdi, TRUE) ||
+	    !freerdp_settings_set_uint32(settings, FreeRDP_GdiInvalidRectLimit,
+	                                 GDI_INVALID_RECT_LIMIT) ||
 	    !freerdp_settings_set_bool(settings, FreeRDP_UnmapButtons, FALSE) ||
 	    !freerdp_settings_set_uint32(settings, FreeRDP_PerformanceFlags, PERF_FLAG_NONE) ||
 	    !freerdp_settings_set_bool(settings, FreeRDP_AllowFontSmoothing, TRUE) ||
@@ -1018,6 +1020,8 @@ rdpSettings* freerdp_settings_new(DWORD flags)
 	    !freerdp_settings_set_bool(settings, FreeRDP_LogonNotify, TRUE) ||
 	    !freerdp_settings_set_uint32(settings, FreeRDP_BrushSupportLevel, BRUSH_COLOR_FULL) ||
 	    !freerdp_settings_set_uint32(settings, FreeRDP_CompressionLevel, PACKET_COMPR_TYPE_RDP61) ||
+	    !freerdp_settings_set_uint32(settings, FreeRDP_CompressionEffort,
+	                                 COMPRESSION_EFFORT_DEFAULT) ||
 	    !freerdp_settings_set_bool(settings, FreeRDP_Authentication, TRUE) ||
 	    !freerdp_settings_set_bool(settings, FreeRDP_AuthenticationOnly, FALSE) ||
 	    !freerdp_settings_set_bool(settings, FreeRDP_CredentialsFromStdin, FALSE) ||
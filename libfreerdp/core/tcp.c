@@ -39,6 +39,7 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <net/if.h>
@@ -183,6 +184,59 @@ static int transport_bio_simple_gets(WINPR_ATTR_UNUSED BIO* bio, WINPR_ATTR_UNUS
 	return 1;
 }
 
+static long transport_bio_simple_writev(BIO* bio, const DataChunk* chunks, long count)
+{
+	WINPR_BIO_SIMPLE_SOCKET* ptr = (WINPR_BIO_SIMPLE_SOCKET*)BIO_get_data(bio);
+
+	if (!chunks || (count <= 0) || (count > 2))
+		return -1;
+
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
+#if defined(_WIN32)
+	WSABUF buffers[2] = WINPR_C_ARRAY_INIT;
+	for (long x = 0; x < count; x++)
+	{
+		const BYTE* data = chunks[x].data;
+		buffers[x].buf = WINPR_CAST_CONST_PTR_AWAY(data, CHAR*);
+		buffers[x].len = (ULONG)MIN(INT32_MAX, chunks[x].size);
+	}
+
+	DWORD sent = 0;
+	const int rc = WSASend(ptr->socket, buffers, (DWORD)count, &sent, 0, nullptr, nullptr);
+	const long status = (rc == 0) ? (long)sent : -1;
+#else
+	struct iovec iov[2] = WINPR_C_ARRAY_INIT;
+	for (long x = 0; x < count; x++)
+	{
+		const BYTE* data = chunks[x].data;
+		iov[x].iov_base = WINPR_CAST_CONST_PTR_AWAY(data, void*);
+		iov[x].iov_len = MIN(INT32_MAX, chunks[x].size);
+	}
+
+	struct msghdr msg = WINPR_C_ARRAY_INIT;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = (size_t)count;
+	const long status = (long)sendmsg((int)ptr->socket, &msg, MSG_NOSIGNAL);
+#endif
+
+	if (status <= 0)
+	{
+		const int error = WSAGetLastError();
+
+		if ((error == WSAEWOULDBLOCK) || (error == WSAEINTR) || (error == WSAEINPROGRESS) ||
+		    (error == WSAEALREADY))
+		{
+			BIO_set_flags(bio, (BIO_FLAGS_WRITE | BIO_FLAGS_SHOULD_RETRY));
+		}
+		else
+		{
+			BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+		}
+	}
+
+	return status;
+}
+
 static long transport_bio_simple_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
 {
 	int status = -1;
@@ -206,6 +260,10 @@ static long transport_bio_simple_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
 
 			*((HANDLE*)arg2) = ptr->hEvent;
 			return 1;
+		case BIO_C_WRITEV:
+			if (!BIO_get_init(bio))
+				return -1;
+			return transport_bio_simple_writev(bio, (const DataChunk*)arg2, arg1);
 		case BIO_C_SET_NONBLOCK:
 		{
 #ifndef _WIN32
@@ -486,6 +544,42 @@ static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
 	nchunks = ringbuffer_peek(&ptr->xmitBuffer, chunks, ringbuffer_used(&ptr->xmitBuffer));
 	next_bio = BIO_next(bio);
 
+	/* The data wraps around the end of the ring buffer, send both parts with one syscall */
+	if ((nchunks == 2) && (BIO_method_type(next_bio) == BIO_TYPE_SIMPLE))
+	{
+		ERR_clear_error();
+
+		const long status = BIO_writev(next_bio, chunks, nchunks);
+		if (status <= 0)
+		{
+			if (!BIO_should_retry(next_bio))
+			{
+				BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+				ret = -1; /* fatal error */
+				goto out;
+			}
+
+			if (BIO_should_write(next_bio))
+			{
+				BIO_set_flags(bio, BIO_FLAGS_WRITE);
+				ptr->writeBlocked = TRUE;
+				goto out; /* EWOULDBLOCK */
+			}
+		}
+		else
+		{
+			size_t left = (size_t)status;
+			for (int i = 0; i < nchunks; i++)
+			{
+				const size_t consumed = MIN(left, chunks[i].size);
+				chunks[i].size -= consumed;
+				chunks[i].data += consumed;
+				committedBytes += consumed;
+				left -= consumed;
+			}
+		}
+	}
+
 	for (int i = 0; i < nchunks; i++)
 	{
 		while (chunks[i].size)
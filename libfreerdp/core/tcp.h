@@ -30,6 +30,7 @@
 #include <freerdp/transport_io.h>
 
 #include <winpr/crt.h>
+#include <winpr/cast.h>
 #include <winpr/synch.h>
 #include <winpr/stream.h>
 #include <winpr/winsock.h>
@@ -53,6 +54,7 @@
 #define BIO_C_WAIT_READ 1107
 #define BIO_C_WAIT_WRITE 1108
 #define BIO_C_SET_HANDLE 1109
+#define BIO_C_WRITEV 1110
 
 WINPR_ATTR_NODISCARD
 static inline long BIO_set_socket(BIO* b, SOCKET s, long c)
@@ -103,6 +105,16 @@ static inline long BIO_wait_write(BIO* b, long c)
 	return BIO_ctrl(b, BIO_C_WAIT_WRITE, c, nullptr);
 }
 
+/** @brief Write \b count chunks with a single vectored write, only supported by BIO_TYPE_SIMPLE
+ *
+ *  @return the number of bytes written or <= 0 in case of error (check BIO_should_retry)
+ */
+WINPR_ATTR_NODISCARD
+static inline long BIO_writev(BIO* b, const DataChunk* chunks, long count)
+{
+	return BIO_ctrl(b, BIO_C_WRITEV, count, WINPR_CAST_CONST_PTR_AWAY(chunks, void*));
+}
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BIO_METHOD* BIO_s_simple_socket(void);
 
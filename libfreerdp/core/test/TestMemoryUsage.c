@@ -0,0 +1,96 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codecs.h>
+
+/* Every codec adds its state to the codec memory usage when it is created */
+static BOOL test_codec(rdpContext* context, UINT32 codec, const char* name)
+{
+	const size_t before = freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_CODECS);
+	if (!freerdp_client_codecs_prepare(context->codecs, codec, 64, 64))
+	{
+		(void)fprintf(stderr, "%s: failed to prepare the codec\n", name);
+		return FALSE;
+	}
+
+	const size_t after = freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_CODECS);
+	if (after <= before)
+	{
+		(void)fprintf(stderr, "%s: usage %" PRIuz " not above %" PRIuz "\n", name, after,
+		              before);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* The planar buffers grow with the surface */
+static BOOL test_planar_resize(rdpContext* context)
+{
+	const size_t small = freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_CODECS);
+	if (!freerdp_client_codecs_reset(context->codecs, FREERDP_CODEC_PLANAR, 1024, 768))
+		return FALSE;
+
+	/* 4 plane, 4 delta and 6 temporary bytes per pixel at least */
+	const size_t large = freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_CODECS);
+	if (large < small + 14ull * 1024ull * 768ull)
+	{
+		(void)fprintf(stderr, "planar: usage %" PRIuz " after resize, %" PRIuz " before\n",
+		              large, small);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int TestMemoryUsage(int argc, char* argv[])
+{
+	int rc = -1;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	const struct
+	{
+		UINT32 codec;
+		const char* name;
+	} codecs[] = { { FREERDP_CODEC_INTERLEAVED, "interleaved" },
+		           { FREERDP_CODEC_PLANAR, "planar" },
+		           { FREERDP_CODEC_NSCODEC, "nsc" },
+		           { FREERDP_CODEC_REMOTEFX, "rfx" },
+		           { FREERDP_CODEC_CLEARCODEC, "clear" },
+		           { FREERDP_CODEC_PROGRESSIVE, "progressive" } };
+
+	freerdp* instance = freerdp_new();
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	rdpContext* context = instance->context;
+	context->codecs = freerdp_client_codecs_new(0);
+	if (!context->codecs)
+		goto fail;
+
+	if (freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_CODECS) != 0)
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(codecs); x++)
+	{
+		if (!test_codec(context, codecs[x].codec, codecs[x].name))
+			goto fail;
+	}
+
+	if (!test_planar_resize(context))
+		goto fail;
+
+	/* The categories add up */
+	const size_t all = freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_ALL);
+	if (all != freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_BULK) +
+	               freerdp_get_memory_usage(context, FREERDP_MEMORY_USAGE_CODECS))
+		goto fail;
+
+	rc = 0;
+fail:
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+	return rc;
+}
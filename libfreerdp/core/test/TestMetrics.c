@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/metrics.h>
+
+#define TEST_WRITES 100000
+
+static BOOL test_histogram(rdpMetrics* metrics)
+{
+	rdpMetric* metric = metrics_get_metric(metrics, "test_latency_seconds{stage=\"decode\"}",
+	                                       FREERDP_METRIC_HISTOGRAM, "Test latency");
+	if (!metric)
+		return FALSE;
+
+	/* 1µs .. 1ms in 1µs steps */
+	for (UINT64 x = 1; x <= 1000; x++)
+		metric_observe(metric, x * 1000);
+
+	if (metric_get_count(metric) != 1000)
+	{
+		(void)fprintf(stderr, "count %" PRIu64 " != 1000\n", metric_get_count(metric));
+		return FALSE;
+	}
+
+	const struct
+	{
+		double percentile;
+		UINT64 expected;
+	} checks[] = { { 50.0, 500000 }, { 90.0, 900000 }, { 99.0, 990000 }, { 100.0, 1000000 } };
+
+	for (size_t x = 0; x < ARRAYSIZE(checks); x++)
+	{
+		const UINT64 value = metric_get_percentile(metric, checks[x].percentile);
+		const UINT64 error = checks[x].expected / 16;
+		if ((value + error < checks[x].expected) || (value > checks[x].expected + error))
+		{
+			(void)fprintf(stderr, "p%.0f %" PRIu64 " not within 1/16 of %" PRIu64 "\n",
+			              checks[x].percentile, value, checks[x].expected);
+			return FALSE;
+		}
+	}
+
+	/* The same name returns the same metric, a different type is refused */
+	if (metrics_get_metric(metrics, "test_latency_seconds{stage=\"decode\"}",
+	                       FREERDP_METRIC_HISTOGRAM, nullptr) != metric)
+		return FALSE;
+	if (metrics_get_histogram(metrics, "test_latency_seconds", "stage", "decode", nullptr) !=
+	    metric)
+		return FALSE;
+	if (metrics_get_metric(metrics, "test_latency_seconds{stage=\"encode\"}",
+	                       FREERDP_METRIC_COUNTER, nullptr))
+		return FALSE;
+	return TRUE;
+}
+
+static BOOL test_openmetrics(rdpMetrics* first, rdpMetrics* second)
+{
+	BOOL rc = FALSE;
+	size_t length = 0;
+	rdpMetrics* const metrics[] = { first, second };
+	const char* const labels[] = { "session=\"1\"", "session=\"2\"" };
+
+	metric_add(metrics_get_metric(first, "test_frames", FREERDP_METRIC_COUNTER, "Test frames"), 3);
+	metric_add(metrics_get_metric(second, "test_frames", FREERDP_METRIC_COUNTER, "Test frames"), 4);
+	metrics_observe_duration(second, "test_latency_seconds", "stage", "decode", nullptr, 2000000);
+
+	char* text = metrics_to_openmetrics(metrics, labels, ARRAYSIZE(metrics), &length);
+	if (!text || (strlen(text) != length))
+		goto fail;
+
+	const char* expected[] = { "# TYPE test_frames counter\n",
+		                       "# HELP test_frames Test frames\n",
+		                       "test_frames_total{session=\"1\"} 3\n",
+		                       "test_frames_total{session=\"2\"} 4\n",
+		                       "# TYPE test_latency_seconds summary\n",
+		                       "test_latency_seconds{stage=\"decode\",session=\"1\",quantile=\"0.5\"}",
+		                       "test_latency_seconds_count{stage=\"decode\",session=\"2\"} 1\n",
+		                       "# EOF\n" };
+	for (size_t x = 0; x < ARRAYSIZE(expected); x++)
+	{
+		if (!strstr(text, expected[x]))
+		{
+			(void)fprintf(stderr, "missing '%s' in:\n%s", expected[x], text);
+			goto fail;
+		}
+	}
+
+	/* Every family is described once */
+	const char* type = strstr(text, "# TYPE test_frames ");
+	if (!type || strstr(type + 1, "# TYPE test_frames "))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(text);
+	return rc;
+}
+
+static DWORD WINAPI test_writer(LPVOID arg)
+{
+	rdpMetrics* metrics = arg;
+
+	for (size_t x = 0; x < TEST_WRITES; x++)
+		(void)metrics_write_bytes(metrics, 4, 1);
+
+	ExitThread(0);
+	return 0;
+}
+
+/* The totals are updated from two session threads while they are exported */
+static BOOL test_write_bytes(rdpMetrics* metrics)
+{
+	BOOL rc = FALSE;
+	HANDLE threads[2] = WINPR_C_ARRAY_INIT;
+
+	for (size_t x = 0; x < ARRAYSIZE(threads); x++)
+	{
+		threads[x] = CreateThread(nullptr, 0, test_writer, metrics, 0, nullptr);
+		if (!threads[x])
+			goto fail;
+	}
+
+	for (size_t x = 0; x < 100; x++)
+	{
+		char* text = metrics_to_openmetrics(&metrics, nullptr, 1, nullptr);
+		if (!text)
+			goto fail;
+		free(text);
+	}
+
+	rc = TRUE;
+fail:
+	for (size_t x = 0; x < ARRAYSIZE(threads); x++)
+	{
+		if (!threads[x])
+			continue;
+		(void)WaitForSingleObject(threads[x], INFINITE);
+		(void)CloseHandle(threads[x]);
+	}
+
+	if ((metrics->TotalUncompressedBytes != 8ull * TEST_WRITES) ||
+	    (metrics->TotalCompressedBytes != 2ull * TEST_WRITES))
+	{
+		(void)fprintf(stderr, "totals %" PRIu64 "/%" PRIu64 "\n", metrics->TotalCompressedBytes,
+		              metrics->TotalUncompressedBytes);
+		return FALSE;
+	}
+	return rc;
+}
+
+#if !defined(_WIN32)
+static char* test_export(void* arg, size_t* plength)
+{
+	rdpMetrics* metrics = arg;
+	return metrics_to_openmetrics(&metrics, nullptr, 1, plength);
+}
+
+/* Sends request to the endpoint and returns the response */
+static char* test_request(UINT16 port, const char* request)
+{
+	char service[8] = WINPR_C_ARRAY_INIT;
+	struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+	struct addrinfo* res = nullptr;
+	char* response = nullptr;
+	size_t length = 0;
+	int fd = -1;
+
+	(void)_snprintf(service, sizeof(service), "%" PRIu16, port);
+	if (getaddrinfo("localhost", service, &hints, &res) != 0)
+		return nullptr;
+
+	for (struct addrinfo* ai = res; ai; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if ((fd >= 0) && (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0))
+			break;
+		if (fd >= 0)
+			close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if ((fd < 0) || (send(fd, request, strlen(request), 0) != (ssize_t)strlen(request)))
+		goto fail;
+
+	for (;;)
+	{
+		char* tmp = realloc(response, length + 4096 + 1);
+		if (!tmp)
+			goto fail;
+		response = tmp;
+
+		const ssize_t rc = recv(fd, &response[length], 4096, 0);
+		if (rc < 0)
+			goto fail;
+		response[length + (size_t)rc] = '\0';
+		if (rc == 0)
+			break;
+		length += (size_t)rc;
+	}
+
+	close(fd);
+	return response;
+
+fail:
+	if (fd >= 0)
+		close(fd);
+	free(response);
+	return nullptr;
+}
+
+static BOOL test_response(UINT16 port, const char* request, const char* status,
+                          const char* content)
+{
+	char* response = test_request(port, request);
+	const BOOL rc = response && (strncmp(response, status, strlen(status)) == 0) &&
+	                (!content || strstr(response, content));
+	if (!rc)
+		(void)fprintf(stderr, "'%s' expected '%s', got:\n%s\n", request, status,
+		              response ? response : "nothing");
+	free(response);
+	return rc;
+}
+
+static BOOL test_endpoint(rdpMetrics* metrics)
+{
+	BOOL rc = FALSE;
+	UINT16 port = 0;
+	rdpMetricsEndpoint* endpoint = nullptr;
+
+	/* Some port might be in use already */
+	for (port = 39213; !endpoint && (port < 39233); port++)
+		endpoint = metrics_endpoint_new(nullptr, port, test_export, metrics);
+	port--;
+	if (!endpoint)
+		return FALSE;
+
+	if (!test_response(port, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n",
+	                   "HTTP/1.0 200 OK", "test_frames_total 3\n"))
+		goto fail;
+	if (!test_response(port, "GET /metrics?format=text HTTP/1.0\r\n\r\n", "HTTP/1.0 200 OK",
+	                   "# EOF\n"))
+		goto fail;
+	if (!test_response(port, "GET / HTTP/1.0\r\n\r\n", "HTTP/1.0 404 Not Found", nullptr))
+		goto fail;
+	if (!test_response(port, "GET /metrics/foo HTTP/1.0\r\n\r\n", "HTTP/1.0 404 Not Found",
+	                   nullptr))
+		goto fail;
+	if (!test_response(port, "POST /metrics HTTP/1.0\r\n\r\n", "HTTP/1.0 405", nullptr))
+		goto fail;
+	if (!test_response(port, "hello\r\n\r\n", "HTTP/1.0 400 Bad Request", nullptr))
+		goto fail;
+
+	/* HEAD gets the header only */
+	char* response = test_request(port, "HEAD /metrics HTTP/1.0\r\n\r\n");
+	const char* body = response ? strstr(response, "\r\n\r\n") : nullptr;
+	const BOOL empty = body && (body[4] == '\0');
+	free(response);
+	if (!empty)
+		goto fail;
+
+	rc = TRUE;
+fail:
+	metrics_endpoint_free(endpoint);
+	return rc;
+}
+#endif
+
+int TestMetrics(int argc, char* argv[])
+{
+	int rc = -1;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	rdpMetrics* first = metrics_new(nullptr);
+	rdpMetrics* second = metrics_new(nullptr);
+	if (!first || !second)
+		goto fail;
+
+	if (!test_histogram(first))
+		goto fail;
+	if (!test_openmetrics(first, second))
+		goto fail;
+	if (!test_write_bytes(second))
+		goto fail;
+#if !defined(_WIN32)
+	if (!test_endpoint(first))
+		goto fail;
+#endif
+
+	rc = 0;
+fail:
+	metrics_free(first);
+	metrics_free(second);
+	return rc;
+}
@@ -0,0 +1,322 @@
+#include <winpr/crt.h>
+#include <winpr/wtsapi.h>
+#include <winpr/collections.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/channels/channels.h>
+#include <freerdp/channels/drdynvc.h>
+#include <freerdp/channels/wtsvc.h>
+
+#include "../rdp.h"
+#include "../mcs.h"
+
+#define TEST_DRDYNVC_ID 1004
+#define TEST_SVC_ID 1005
+#define TEST_SVC_NAME "testsvc"
+#define TEST_MESSAGE_SIZE 5000
+#define TEST_MAX_PDU_SIZE 1600
+
+typedef struct
+{
+	UINT16 channelId;
+	uintptr_t address;
+	wStream* s;
+} test_pdu_t;
+
+static wArrayList* g_Sent = nullptr;
+
+static void test_free_pdu(void* obj)
+{
+	test_pdu_t* pdu = obj;
+
+	if (!pdu)
+		return;
+	Stream_Free(pdu->s, TRUE);
+	free(pdu);
+}
+
+/* Keep a copy of every PDU and where it was sent from */
+static BOOL test_send_channel_data(WINPR_ATTR_UNUSED freerdp_peer* peer, UINT16 channelId,
+                                   const BYTE* data, size_t size)
+{
+	test_pdu_t* pdu = calloc(1, sizeof(test_pdu_t));
+	if (!pdu)
+		return FALSE;
+
+	pdu->channelId = channelId;
+	pdu->address = (uintptr_t)data;
+	pdu->s = Stream_New(nullptr, size);
+	if (!pdu->s)
+		goto fail;
+
+	Stream_Write(pdu->s, data, size);
+	Stream_SealLength(pdu->s);
+	Stream_ResetPosition(pdu->s);
+	if (!ArrayList_Append(g_Sent, pdu))
+		goto fail;
+	return TRUE;
+
+fail:
+	test_free_pdu(pdu);
+	return FALSE;
+}
+
+static UINT32 test_read_variable_uint(wStream* s, BYTE cbLen)
+{
+	switch (cbLen)
+	{
+		case 0:
+			return Stream_Get_UINT8(s);
+		case 1:
+			return Stream_Get_UINT16(s);
+		default:
+			return Stream_Get_UINT32(s);
+	}
+}
+
+static BOOL test_fail(const char* what)
+{
+	(void)fprintf(stderr, "%s\n", what);
+	return FALSE;
+}
+
+/* Send the queued data and collect what was sent */
+static BOOL test_flush(HANDLE hServer)
+{
+	ArrayList_Clear(g_Sent);
+	return WTSVirtualChannelManagerCheckFileDescriptor(hServer);
+}
+
+/**
+ * Reassemble a message sent on a dynamic channel and compare it with what was written.
+ * If start is not 0 every PDU must have been sent from the range [start, end).
+ */
+static BOOL test_check_dvc(UINT32 id, const BYTE* buffer, size_t size, uintptr_t start,
+                           uintptr_t end)
+{
+	size_t received = 0;
+	const size_t count = ArrayList_Count(g_Sent);
+
+	if (count < 2)
+		return test_fail("the message was not split");
+
+	for (size_t x = 0; x < count; x++)
+	{
+		test_pdu_t* pdu = ArrayList_GetItem(g_Sent, x);
+		wStream* s = pdu->s;
+
+		if (pdu->channelId != TEST_DRDYNVC_ID)
+			return test_fail("data sent on the wrong channel");
+		if (Stream_Length(s) > TEST_MAX_PDU_SIZE)
+			return test_fail("PDU too large");
+		if ((start != 0) && ((pdu->address < start) || (pdu->address + Stream_Length(s) > end)))
+			return test_fail("PDU was copied out of the written stream");
+
+		const BYTE header = Stream_Get_UINT8(s);
+		const BYTE Cmd = header >> 4;
+		const BYTE Sp = (header >> 2) & 0x03;
+		const BYTE cbChId = header & 0x03;
+
+		if (Cmd != ((x == 0) ? DATA_FIRST_PDU : DATA_PDU))
+			return test_fail("unexpected PDU type");
+		if (test_read_variable_uint(s, cbChId) != id)
+			return test_fail("unexpected channel id");
+		if ((x == 0) && (test_read_variable_uint(s, Sp) != size))
+			return test_fail("unexpected total length");
+
+		const size_t length = Stream_GetRemainingLength(s);
+		if ((received + length > size) ||
+		    (memcmp(Stream_ConstPointer(s), &buffer[received], length) != 0))
+			return test_fail("unexpected data");
+		received += length;
+	}
+
+	if (received != size)
+		return test_fail("data missing");
+	return TRUE;
+}
+
+/* Data written with a stream is sent from that stream */
+static BOOL test_dvc_stream(HANDLE hServer, HANDLE hChannel, const BYTE* buffer)
+{
+	wStream* s = WTSVirtualChannelStreamNew(hChannel, TEST_MESSAGE_SIZE);
+	if (!s)
+		return test_fail("no stream");
+
+	const uintptr_t start = (uintptr_t)Stream_Buffer(s);
+	const uintptr_t end = start + Stream_Capacity(s);
+	Stream_Write(s, buffer, TEST_MESSAGE_SIZE);
+	if (!WTSVirtualChannelWriteStream(hChannel, s))
+		return test_fail("stream write failed");
+
+	if (!test_flush(hServer))
+		return FALSE;
+	return test_check_dvc(WTSChannelGetIdByHandle(hChannel), buffer, TEST_MESSAGE_SIZE, start,
+	                      end);
+}
+
+static BOOL test_dvc_write(HANDLE hServer, HANDLE hChannel, const BYTE* buffer)
+{
+	ULONG written = 0;
+
+	if (!WTSVirtualChannelWrite(hChannel, (PCHAR)buffer, TEST_MESSAGE_SIZE, &written) ||
+	    (written != TEST_MESSAGE_SIZE))
+		return test_fail("write failed");
+
+	if (!test_flush(hServer))
+		return FALSE;
+	return test_check_dvc(WTSChannelGetIdByHandle(hChannel), buffer, TEST_MESSAGE_SIZE, 0, 0);
+}
+
+/* A static channel gets the data as is, without a dynamic channel header */
+static BOOL test_svc_stream(HANDLE hServer, HANDLE hChannel, const BYTE* buffer)
+{
+	wStream* s = WTSVirtualChannelStreamNew(hChannel, TEST_MESSAGE_SIZE);
+	if (!s)
+		return test_fail("no stream");
+
+	const uintptr_t payload = (uintptr_t)Stream_Pointer(s);
+	Stream_Write(s, buffer, TEST_MESSAGE_SIZE);
+	if (!WTSVirtualChannelWriteStream(hChannel, s))
+		return test_fail("stream write failed");
+
+	if (!test_flush(hServer))
+		return FALSE;
+	if (ArrayList_Count(g_Sent) != 1)
+		return test_fail("unexpected number of PDUs");
+
+	const test_pdu_t* pdu = ArrayList_GetItem(g_Sent, 0);
+	if ((pdu->channelId != TEST_SVC_ID) || (pdu->address != payload) ||
+	    (Stream_Length(pdu->s) != TEST_MESSAGE_SIZE) ||
+	    (memcmp(Stream_Buffer(pdu->s), buffer, TEST_MESSAGE_SIZE) != 0))
+		return test_fail("unexpected static channel PDU");
+	return TRUE;
+}
+
+static BOOL test_invalid(HANDLE hServer, HANDLE hChannel)
+{
+	ULONG written = 0;
+	BYTE data = 0;
+
+	/* The stream belongs to the channel manager in any case, ASan catches leaks */
+	wStream* s = WTSVirtualChannelStreamNew(hChannel, 16);
+	if (!s)
+		return test_fail("no stream");
+	if (WTSVirtualChannelWriteStream(nullptr, s))
+		return test_fail("stream written without a channel");
+
+	s = WTSVirtualChannelStreamNew(hChannel, 16);
+	if (!s)
+		return test_fail("no stream");
+	Stream_ResetPosition(s);
+	if (WTSVirtualChannelWriteStream(hChannel, s))
+		return test_fail("stream without room for the header written");
+
+	if (WTSVirtualChannelWriteStream(hChannel, nullptr))
+		return test_fail("no stream written");
+
+	if (!WTSVirtualChannelWrite(hChannel, (PCHAR)&data, 0, &written) || (written != 0))
+		return test_fail("empty write failed");
+
+	if (!test_flush(hServer))
+		return FALSE;
+	if (ArrayList_Count(g_Sent) != 0)
+		return test_fail("data sent for invalid or empty writes");
+	return TRUE;
+}
+
+int TestServerChannelWrite(int argc, char* argv[])
+{
+	int rc = -1;
+	HANDLE hServer = INVALID_HANDLE_VALUE;
+	ULONG* pSessionId = nullptr;
+	DWORD bytesReturned = 0;
+	HANDLE hDvc = nullptr;
+	HANDLE hSvc = nullptr;
+	BYTE* buffer = calloc(TEST_MESSAGE_SIZE, 1);
+	freerdp_peer* client = calloc(1, sizeof(freerdp_peer));
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	g_Sent = ArrayList_New(FALSE);
+	if (!buffer || !client || !g_Sent)
+		goto fail;
+	ArrayList_Object(g_Sent)->fnObjectFree = test_free_pdu;
+
+	for (size_t x = 0; x < TEST_MESSAGE_SIZE; x++)
+		buffer[x] = (BYTE)(rand() & 0xFF);
+
+	client->ContextSize = sizeof(rdpContext);
+	if (!freerdp_peer_context_new(client))
+		goto fail;
+	client->SendChannelData = test_send_channel_data;
+
+	{
+		rdpMcs* mcs = client->context->rdp->mcs;
+		rdpMcsChannel* mchannel = &mcs->channels[0];
+		(void)strncpy(mchannel->Name, DRDYNVC_SVC_CHANNEL_NAME, sizeof(mchannel->Name) - 1);
+		mchannel->ChannelId = TEST_DRDYNVC_ID;
+		mchannel->joined = TRUE;
+
+		mchannel = &mcs->channels[1];
+		(void)strncpy(mchannel->Name, TEST_SVC_NAME, sizeof(mchannel->Name) - 1);
+		mchannel->ChannelId = TEST_SVC_ID;
+		mchannel->joined = TRUE;
+		mcs->channelCount = 2;
+	}
+
+	if (!WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi()))
+		goto fail;
+
+	hServer = WTSOpenServerA((LPSTR)client->context);
+	if (hServer == INVALID_HANDLE_VALUE)
+		goto fail;
+
+	/* Send the capabilities request and answer it with version 3 */
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(hServer))
+		goto fail;
+
+	{
+		const BYTE caps[] = { 0x50, 0x00, 0x03, 0x00 };
+		if (!client->ReceiveChannelData(client, TEST_DRDYNVC_ID, caps, sizeof(caps),
+		                                CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, sizeof(caps)))
+			goto fail;
+	}
+
+	if (!WTSQuerySessionInformationA(hServer, WTS_CURRENT_SESSION, WTSSessionId,
+	                                 (LPSTR*)&pSessionId, &bytesReturned))
+		goto fail;
+
+	hDvc = WTSVirtualChannelOpenEx(*pSessionId, "dvc",
+	                               WTS_CHANNEL_OPTION_DYNAMIC |
+	                                   WTS_CHANNEL_OPTION_DYNAMIC_NO_COMPRESS);
+	hSvc = WTSVirtualChannelOpen(hServer, *pSessionId, TEST_SVC_NAME);
+	if (!hDvc || !hSvc)
+		goto fail;
+
+	/* Sends the CREATE_REQUEST */
+	if (!test_flush(hServer))
+		goto fail;
+
+	if (!test_dvc_stream(hServer, hDvc, buffer))
+		goto fail;
+	if (!test_dvc_write(hServer, hDvc, buffer))
+		goto fail;
+	if (!test_svc_stream(hServer, hSvc, buffer))
+		goto fail;
+	if (!test_invalid(hServer, hDvc))
+		goto fail;
+
+	rc = 0;
+fail:
+	WTSFreeMemory(pSessionId);
+	if (hServer != INVALID_HANDLE_VALUE)
+		WTSCloseServer(hServer);
+	if (client)
+		freerdp_peer_context_free(client);
+	free(client);
+	ArrayList_Free(g_Sent);
+	free(buffer);
+	return rc;
+}
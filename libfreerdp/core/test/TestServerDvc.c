@@ -0,0 +1,365 @@
+#include <winpr/crt.h>
+#include <winpr/wtsapi.h>
+#include <winpr/collections.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/channels/channels.h>
+#include <freerdp/channels/drdynvc.h>
+#include <freerdp/channels/wtsvc.h>
+#include <freerdp/codec/zgfx.h>
+
+#include "../rdp.h"
+#include "../mcs.h"
+
+#define TEST_DRDYNVC_ID 1004
+#define TEST_RT_COUNT 64
+#define TEST_LOW_COUNT 16
+#define TEST_MED_COUNT 24
+#define TEST_MESSAGE_SIZE 1500
+
+static wArrayList* g_Sent = nullptr;
+
+static void test_free_pdu(void* obj)
+{
+	Stream_Free((wStream*)obj, TRUE);
+}
+
+static BOOL test_send_channel_data(WINPR_ATTR_UNUSED freerdp_peer* peer, UINT16 channelId,
+                                   const BYTE* data, size_t size)
+{
+	if (channelId != TEST_DRDYNVC_ID)
+		return FALSE;
+
+	wStream* s = Stream_New(nullptr, size);
+	if (!s)
+		return FALSE;
+
+	Stream_Write(s, data, size);
+	Stream_SealLength(s);
+	Stream_ResetPosition(s);
+	if (!ArrayList_Append(g_Sent, s))
+	{
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static UINT32 test_read_variable_uint(wStream* s, BYTE cbLen)
+{
+	switch (cbLen)
+	{
+		case 0:
+			return Stream_Get_UINT8(s);
+		case 1:
+			return Stream_Get_UINT16(s);
+		default:
+			return Stream_Get_UINT32(s);
+	}
+}
+
+/* Message of the medium priority channel, text that compresses well */
+static size_t test_med_message(BYTE* buffer, UINT32 index)
+{
+	const char text[] = "The quick brown fox jumps over the lazy dog. ";
+	const size_t size = 100 + (index * 997u) % 5000;
+
+	for (size_t x = 0; x < size; x++)
+		buffer[x] = (BYTE)text[(x + index) % (sizeof(text) - 1)] ^ (BYTE)(x / 700);
+	return size;
+}
+
+typedef struct
+{
+	UINT32 id;
+	BOOL created;
+	size_t messages;
+	size_t bytes;
+	size_t expected;
+	wStream* message;
+	ZGFX_CONTEXT* decompressor;
+} test_channel_t;
+
+static test_channel_t* test_find_channel(test_channel_t* channels, size_t count, UINT32 id)
+{
+	for (size_t x = 0; x < count; x++)
+	{
+		if (channels[x].id == id)
+			return &channels[x];
+	}
+	return nullptr;
+}
+
+/* Append the data of a DATA PDU to the current message of the channel, as a client would */
+static BOOL test_receive_data(test_channel_t* channel, wStream* s, BOOL compressed)
+{
+	const BYTE* data = Stream_Pointer(s);
+	UINT32 size = (UINT32)Stream_GetRemainingLength(s);
+	BYTE* decompressed = nullptr;
+
+	if (compressed)
+	{
+		if (zgfx_decompress(channel->decompressor, data, size, &decompressed, &size, 0) < 0)
+			return FALSE;
+		data = decompressed;
+	}
+
+	const BOOL rc = Stream_EnsureRemainingCapacity(channel->message, size);
+	if (rc)
+		Stream_Write(channel->message, data, size);
+	free(decompressed);
+	return rc;
+}
+
+/* Compare a complete message of the medium priority channel with what was written */
+static BOOL test_check_message(test_channel_t* channel, BYTE* buffer)
+{
+	const size_t size = test_med_message(buffer, (UINT32)channel->messages);
+	const BOOL rc = (Stream_GetPosition(channel->message) == size) &&
+	                (memcmp(Stream_Buffer(channel->message), buffer, size) == 0);
+
+	channel->messages++;
+	Stream_ResetPosition(channel->message);
+	return rc;
+}
+
+/**
+ * Check what the server sent: no data before the CREATE_REQUEST of its channel, the
+ * compressed messages decompress to what was written, and while both have data queued the
+ * real-time class gets PriorityCharge3 / PriorityCharge0 times the bytes of the low class.
+ */
+static BOOL test_check_sent(test_channel_t* channels, size_t count, BYTE* buffer)
+{
+	size_t rtBytes = 0;
+	size_t lowBytes = 0;
+	test_channel_t* rt = &channels[0];
+	test_channel_t* low = &channels[1];
+	test_channel_t* med = &channels[2];
+
+	for (size_t x = 0; x < ArrayList_Count(g_Sent); x++)
+	{
+		wStream* s = ArrayList_GetItem(g_Sent, x);
+		const BYTE header = Stream_Get_UINT8(s);
+		const BYTE Cmd = header >> 4;
+		const BYTE Sp = (header >> 2) & 0x03;
+		const BYTE cbChId = header & 0x03;
+
+		if (Cmd == CAPABILITY_REQUEST_PDU)
+			continue;
+
+		test_channel_t* channel =
+		    test_find_channel(channels, count, test_read_variable_uint(s, cbChId));
+		if (!channel)
+			return FALSE;
+
+		if (Cmd == CREATE_REQUEST_PDU)
+		{
+			channel->created = TRUE;
+			continue;
+		}
+
+		if (!channel->created)
+		{
+			printf("data of channel %" PRIu32 " sent before its CREATE_REQUEST\n", channel->id);
+			return FALSE;
+		}
+
+		switch (Cmd)
+		{
+			case DATA_FIRST_PDU:
+			case DATA_FIRST_COMPRESSED_PDU:
+				channel->expected = test_read_variable_uint(s, Sp);
+				break;
+			case DATA_PDU:
+			case DATA_COMPRESSED_PDU:
+				break;
+			default:
+				return FALSE;
+		}
+
+		/* Count only while both channels still have data left */
+		if ((rt->messages < TEST_RT_COUNT) && (low->messages < TEST_LOW_COUNT))
+		{
+			if (channel == rt)
+				rtBytes += Stream_Length(s);
+			else if (channel == low)
+				lowBytes += Stream_Length(s);
+		}
+
+		const BOOL compressed = (Cmd == DATA_FIRST_COMPRESSED_PDU) || (Cmd == DATA_COMPRESSED_PDU);
+		if ((channel != med) && compressed)
+			return FALSE;
+
+		channel->bytes += Stream_GetRemainingLength(s);
+		if (!test_receive_data(channel, s, compressed))
+			return FALSE;
+
+		/* A message without DATA_FIRST is a single PDU */
+		if ((channel->expected == 0) ||
+		    (Stream_GetPosition(channel->message) >= channel->expected))
+		{
+			channel->expected = 0;
+			if (channel == med)
+			{
+				if (!test_check_message(channel, buffer))
+					return FALSE;
+			}
+			else
+			{
+				channel->messages++;
+				Stream_ResetPosition(channel->message);
+			}
+		}
+	}
+
+	if ((rt->messages != TEST_RT_COUNT) || (low->messages != TEST_LOW_COUNT) ||
+	    (med->messages != TEST_MED_COUNT))
+		return FALSE;
+
+	printf("real-time %" PRIuz " bytes, low %" PRIuz " bytes, compressed %" PRIuz " bytes\n",
+	       rtBytes, lowBytes, med->bytes);
+
+	/* 21845 / 936, the first PDUs of both classes are sent at the same charge */
+	if ((lowBytes == 0) || (rtBytes / lowBytes < 15) || (rtBytes / lowBytes > 32))
+		return FALSE;
+
+	/* Compression did take place */
+	size_t medTotal = 0;
+	for (UINT32 x = 0; x < TEST_MED_COUNT; x++)
+		medTotal += test_med_message(buffer, x);
+	return med->bytes < medTotal / 2;
+}
+
+static BOOL test_write(HANDLE hChannel, BYTE* buffer, size_t size)
+{
+	ULONG written = 0;
+	return WTSVirtualChannelWrite(hChannel, (PCHAR)buffer, (ULONG)size, &written) &&
+	       (written == size);
+}
+
+int TestServerDvc(int argc, char* argv[])
+{
+	int rc = -1;
+	HANDLE hServer = INVALID_HANDLE_VALUE;
+	ULONG* pSessionId = nullptr;
+	DWORD bytesReturned = 0;
+	HANDLE hChannels[3] = WINPR_C_ARRAY_INIT;
+	test_channel_t channels[3] = WINPR_C_ARRAY_INIT;
+	BYTE* buffer = calloc(8192, 1);
+	freerdp_peer* client = calloc(1, sizeof(freerdp_peer));
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	g_Sent = ArrayList_New(FALSE);
+	if (!buffer || !client || !g_Sent)
+		goto fail;
+	ArrayList_Object(g_Sent)->fnObjectFree = test_free_pdu;
+
+	client->ContextSize = sizeof(rdpContext);
+	if (!freerdp_peer_context_new(client))
+		goto fail;
+	client->SendChannelData = test_send_channel_data;
+
+	{
+		rdpMcs* mcs = client->context->rdp->mcs;
+		rdpMcsChannel* mchannel = &mcs->channels[0];
+		(void)strncpy(mchannel->Name, DRDYNVC_SVC_CHANNEL_NAME, sizeof(mchannel->Name) - 1);
+		mchannel->ChannelId = TEST_DRDYNVC_ID;
+		mchannel->joined = TRUE;
+		mcs->channelCount = 1;
+	}
+
+	if (!WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi()))
+		goto fail;
+
+	hServer = WTSOpenServerA((LPSTR)client->context);
+	if (hServer == INVALID_HANDLE_VALUE)
+		goto fail;
+
+	/* Send the capabilities request and answer it with version 3 */
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(hServer))
+		goto fail;
+
+	{
+		const BYTE caps[] = { 0x50, 0x00, 0x03, 0x00 };
+		if (!client->ReceiveChannelData(client, TEST_DRDYNVC_ID, caps, sizeof(caps),
+		                                CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, sizeof(caps)))
+			goto fail;
+	}
+
+	if (WTSVirtualChannelManagerGetDrdynvcState(hServer) != DRDYNVC_STATE_READY)
+		goto fail;
+
+	if (!WTSQuerySessionInformationA(hServer, WTS_CURRENT_SESSION, WTSSessionId,
+	                                 (LPSTR*)&pSessionId, &bytesReturned))
+		goto fail;
+
+	/* Fill the real-time class before the other channels are opened */
+	hChannels[0] = WTSVirtualChannelOpenEx(*pSessionId, "rt",
+	                                       WTS_CHANNEL_OPTION_DYNAMIC |
+	                                           WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL |
+	                                           WTS_CHANNEL_OPTION_DYNAMIC_NO_COMPRESS);
+	if (!hChannels[0])
+		goto fail;
+
+	for (size_t x = 0; x < TEST_MESSAGE_SIZE; x++)
+		buffer[x] = (BYTE)(rand() & 0xFF);
+
+	for (size_t x = 0; x < TEST_RT_COUNT; x++)
+	{
+		if (!test_write(hChannels[0], buffer, TEST_MESSAGE_SIZE))
+			goto fail;
+	}
+
+	hChannels[1] = WTSVirtualChannelOpenEx(
+	    *pSessionId, "low", WTS_CHANNEL_OPTION_DYNAMIC | WTS_CHANNEL_OPTION_DYNAMIC_NO_COMPRESS);
+	hChannels[2] = WTSVirtualChannelOpenEx(
+	    *pSessionId, "med", WTS_CHANNEL_OPTION_DYNAMIC | WTS_CHANNEL_OPTION_DYNAMIC_PRI_MED);
+	if (!hChannels[1] || !hChannels[2])
+		goto fail;
+
+	for (size_t x = 0; x < TEST_LOW_COUNT; x++)
+	{
+		if (!test_write(hChannels[1], buffer, TEST_MESSAGE_SIZE))
+			goto fail;
+	}
+
+	for (UINT32 x = 0; x < TEST_MED_COUNT; x++)
+	{
+		if (!test_write(hChannels[2], buffer, test_med_message(buffer, x)))
+			goto fail;
+	}
+
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(hServer))
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(channels); x++)
+	{
+		channels[x].id = WTSChannelGetIdByHandle(hChannels[x]);
+		channels[x].message = Stream_New(nullptr, 1024);
+		channels[x].decompressor = zgfx_context_new(FALSE);
+		if (!channels[x].message || !channels[x].decompressor)
+			goto fail;
+	}
+
+	if (!test_check_sent(channels, ARRAYSIZE(channels), buffer))
+		goto fail;
+
+	rc = 0;
+fail:
+	for (size_t x = 0; x < ARRAYSIZE(channels); x++)
+	{
+		Stream_Free(channels[x].message, TRUE);
+		zgfx_context_free(channels[x].decompressor);
+	}
+	WTSFreeMemory(pSessionId);
+	if (hServer != INVALID_HANDLE_VALUE)
+		WTSCloseServer(hServer);
+	if (client)
+		freerdp_peer_context_free(client);
+	free(client);
+	ArrayList_Free(g_Sent);
+	free(buffer);
+	return rc;
+}
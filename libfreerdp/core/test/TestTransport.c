@@ -0,0 +1,345 @@
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/freerdp.h>
+
+#include "../rdp.h"
+#include "../transport.h"
+
+#define TEST_WRITE_SIZE (4ull * 1024ull * 1024ull)
+
+typedef struct
+{
+	int fd;
+	size_t received;
+} test_reader_t;
+
+static DWORD WINAPI test_reader(LPVOID arg)
+{
+	test_reader_t* reader = arg;
+	BYTE buffer[65536] = WINPR_C_ARRAY_INIT;
+
+	/* Let the writer fill the socket first */
+	Sleep(100);
+
+	while (reader->received < TEST_WRITE_SIZE)
+	{
+		const ssize_t rc = read(reader->fd, buffer, sizeof(buffer));
+		if (rc <= 0)
+			break;
+		reader->received += (size_t)rc;
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+/* A non-blocking transport writes through a buffered BIO, with kernel TLS requested the
+ * socket is used directly and a full socket must be waited for instead of failing */
+static BOOL test_transport_write(BOOL kernelTls)
+{
+	BOOL rc = FALSE;
+	int fds[2] = { -1, -1 };
+	HANDLE thread = nullptr;
+	wStream* s = nullptr;
+	test_reader_t reader = { -1, 0 };
+	freerdp* instance = freerdp_new();
+
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	rdpContext* context = instance->context;
+	if (!freerdp_settings_set_bool(context->settings, FreeRDP_TlsKernelOffload, kernelTls))
+		goto fail;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		goto fail;
+
+	rdpTransport* transport = context->rdp->transport;
+	if (!transport_attach(transport, fds[0]))
+		goto fail;
+	fds[0] = -1; /* owned by the transport now */
+
+	if (!transport_set_blocking_mode(transport, FALSE))
+		goto fail;
+
+	reader.fd = fds[1];
+	thread = CreateThread(nullptr, 0, test_reader, &reader, 0, nullptr);
+	if (!thread)
+		goto fail;
+
+	s = Stream_New(nullptr, TEST_WRITE_SIZE);
+	if (!s)
+		goto fail;
+	Stream_Fill(s, 0x42, TEST_WRITE_SIZE);
+
+	if (transport_write(transport, s) < 0)
+	{
+		(void)fprintf(stderr, "kernelTls=%d: transport_write failed\n", kernelTls);
+		goto fail;
+	}
+
+	/* The buffered BIO might still hold data, the direct socket write must be complete */
+	if (kernelTls)
+	{
+		(void)WaitForSingleObject(thread, INFINITE);
+		if (reader.received != TEST_WRITE_SIZE)
+		{
+			(void)fprintf(stderr, "received %" PRIuz " bytes\n", reader.received);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	/* Closes the transport side, the reader sees the end of the stream */
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (thread)
+	{
+		(void)WaitForSingleObject(thread, INFINITE);
+		(void)CloseHandle(thread);
+	}
+	if (fds[1] >= 0)
+		close(fds[1]);
+	return rc;
+}
+
+/* A blocking transport on one end of a socket pair, the other end is returned in peer */
+static freerdp* test_transport_new(int* peer)
+{
+	int fds[2] = { -1, -1 };
+	freerdp* instance = freerdp_new();
+
+	*peer = -1;
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		goto fail;
+
+	rdpTransport* transport = instance->context->rdp->transport;
+	if (!transport_attach(transport, fds[0]))
+		goto fail;
+	fds[0] = -1;
+
+	if (!transport_set_blocking_mode(transport, TRUE))
+		goto fail;
+
+	*peer = fds[1];
+	return instance;
+fail:
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	if (instance)
+		freerdp_context_free(instance);
+	freerdp_free(instance);
+	return nullptr;
+}
+
+static void test_transport_free(freerdp* instance, int peer)
+{
+	if (instance)
+		freerdp_context_free(instance);
+	freerdp_free(instance);
+	if (peer >= 0)
+		close(peer);
+}
+
+static int test_write_pdu(rdpTransport* transport, BYTE value, size_t length)
+{
+	wStream* s = Stream_New(nullptr, length);
+	if (!s)
+		return -1;
+	Stream_Fill(s, value, length);
+	const int rc = transport_write(transport, s);
+	Stream_Free(s, TRUE);
+	return rc;
+}
+
+/* Read whatever arrives at fd until it stays silent for 50ms */
+static size_t test_read_available(int fd, BYTE* buffer, size_t size)
+{
+	size_t received = 0;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+
+	while ((received < size) && (poll(&pfd, 1, 50) > 0))
+	{
+		const ssize_t rc = read(fd, &buffer[received], size - received);
+		if (rc <= 0)
+			break;
+		received += (size_t)rc;
+	}
+	return received;
+}
+
+static BOOL test_check_data(const BYTE* data, size_t offset, size_t length, BYTE value)
+{
+	for (size_t x = offset; x < offset + length; x++)
+	{
+		if (data[x] != value)
+		{
+			(void)fprintf(stderr, "unexpected byte 0x%02" PRIx8 " at %" PRIuz "\n", data[x], x);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* Corked PDUs are held back until the last transport_uncork and keep their order */
+static BOOL test_transport_cork(void)
+{
+	BOOL rc = FALSE;
+	int peer = -1;
+	BYTE buffer[1024] = WINPR_C_ARRAY_INIT;
+	freerdp* instance = test_transport_new(&peer);
+
+	if (!instance)
+		goto fail;
+
+	rdpTransport* transport = instance->context->rdp->transport;
+	transport_cork(transport);
+	transport_cork(transport);
+	if ((test_write_pdu(transport, 0x01, 100) != 100) ||
+	    (test_write_pdu(transport, 0x02, 200) != 200))
+		goto fail;
+
+	if (!transport_uncork(transport))
+		goto fail;
+	if (test_read_available(peer, buffer, sizeof(buffer)) != 0)
+	{
+		(void)fprintf(stderr, "corked PDUs sent before the last transport_uncork\n");
+		goto fail;
+	}
+
+	if (!transport_uncork(transport))
+		goto fail;
+	if (test_read_available(peer, buffer, sizeof(buffer)) != 300)
+	{
+		(void)fprintf(stderr, "corked PDUs not sent by transport_uncork\n");
+		goto fail;
+	}
+	rc = test_check_data(buffer, 0, 100, 0x01) && test_check_data(buffer, 100, 200, 0x02);
+fail:
+	test_transport_free(instance, peer);
+	return rc;
+}
+
+static DWORD WINAPI test_cork_writer(LPVOID arg)
+{
+	rdpTransport* transport = arg;
+
+	/* Corking while the other thread is corked must not delay this thread */
+	transport_cork(transport);
+	const int rc = test_write_pdu(transport, 0x03, 100);
+	const BOOL uncorked = transport_uncork(transport);
+	ExitThread(((rc == 100) && uncorked) ? 0 : 1);
+	return 0;
+}
+
+/* The cork of one thread does not hold back the PDUs of other threads */
+static BOOL test_transport_cork_thread(void)
+{
+	BOOL rc = FALSE;
+	int peer = -1;
+	DWORD exitCode = 1;
+	HANDLE thread = nullptr;
+	BYTE buffer[1024] = WINPR_C_ARRAY_INIT;
+	freerdp* instance = test_transport_new(&peer);
+
+	if (!instance)
+		goto fail;
+
+	rdpTransport* transport = instance->context->rdp->transport;
+	transport_cork(transport);
+	if (test_write_pdu(transport, 0x01, 100) != 100)
+		goto fail;
+
+	thread = CreateThread(nullptr, 0, test_cork_writer, transport, 0, nullptr);
+	if (!thread || (WaitForSingleObject(thread, INFINITE) != WAIT_OBJECT_0) ||
+	    !GetExitCodeThread(thread, &exitCode) || (exitCode != 0))
+		goto fail;
+
+	/* The PDU of the other thread is sent after the ones collected before it */
+	if (test_read_available(peer, buffer, sizeof(buffer)) != 200)
+	{
+		(void)fprintf(stderr, "PDU of a second thread held back by the cork\n");
+		goto fail;
+	}
+	if (!test_check_data(buffer, 0, 100, 0x01) || !test_check_data(buffer, 100, 100, 0x03))
+		goto fail;
+
+	if (!transport_uncork(transport))
+		goto fail;
+	rc = TRUE;
+fail:
+	if (thread)
+		(void)CloseHandle(thread);
+	test_transport_free(instance, peer);
+	return rc;
+}
+
+/* Once a write failed corked PDUs fail right away instead of at transport_uncork */
+static BOOL test_transport_cork_error(void)
+{
+	BOOL rc = FALSE;
+	int peer = -1;
+	freerdp* instance = test_transport_new(&peer);
+
+	if (!instance)
+		goto fail;
+
+	rdpTransport* transport = instance->context->rdp->transport;
+	close(peer);
+	peer = -1;
+
+	transport_cork(transport);
+	/* Too large to be collected, written directly to the closed socket */
+	if (test_write_pdu(transport, 0x01, 65536) >= 0)
+	{
+		(void)fprintf(stderr, "write to a closed socket succeeded\n");
+		goto fail;
+	}
+	if (test_write_pdu(transport, 0x02, 100) >= 0)
+	{
+		(void)fprintf(stderr, "corked write after a failed write succeeded\n");
+		goto fail;
+	}
+	rc = transport_uncork(transport);
+fail:
+	test_transport_free(instance, peer);
+	return rc;
+}
+
+int TestTransport(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	/* Writes to the closed socket must fail instead of terminating the test */
+	(void)signal(SIGPIPE, SIG_IGN);
+
+	if (!test_transport_cork())
+		return -1;
+	if (!test_transport_cork_thread())
+		return -1;
+	if (!test_transport_cork_error())
+		return -1;
+
+	if (!test_transport_write(FALSE))
+		return -1;
+	if (!test_transport_write(TRUE))
+		return -1;
+	return 0;
+}
@@ -185,6 +185,8 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_SynchronousDynamicChannels,
 	FreeRDP_SynchronousStaticChannels,
 	FreeRDP_TcpKeepAlive,
+	FreeRDP_TlsKernelOffload,
+	FreeRDP_TlsSessionTickets,
 	FreeRDP_TlsSecurity,
 	FreeRDP_ToggleFullscreen,
 	FreeRDP_TransportDump,
@@ -238,6 +240,7 @@ static const size_t uint32_list_indices[] = {
 	FreeRDP_ColorDepth,
 	FreeRDP_ColorPointerCacheSize,
 	FreeRDP_CompDeskSupportLevel,
+	FreeRDP_CompressionEffort,
 	FreeRDP_CompressionLevel,
 	FreeRDP_ConnectionType,
 	FreeRDP_CookieMaxLength,
@@ -267,6 +270,7 @@ static const size_t uint32_list_indices[] = {
 	FreeRDP_GatewayCredentialsSource,
 	FreeRDP_GatewayPort,
 	FreeRDP_GatewayUsageMethod,
+	FreeRDP_GdiInvalidRectLimit,
 	FreeRDP_GfxCapsFilter,
 	FreeRDP_GfxCodecAV1Profile,
 	FreeRDP_GlyphSupportLevel,
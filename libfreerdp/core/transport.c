@@ -25,6 +25,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/synch.h>
+#include <winpr/thread.h>
 #include <winpr/print.h>
 #include <winpr/stream.h>
 #include <winpr/winsock.h>
@@ -32,6 +33,7 @@
 
 #include <freerdp/log.h>
 #include <freerdp/error.h>
+#include <freerdp/metrics.h>
 #include <freerdp/utils/ringbuffer.h>
 
 #include <openssl/bio.h>
@@ -84,12 +86,17 @@ struct rdp_transport
 	BOOL RdstlsMode;
 	BOOL AadMode;
 	BOOL blocking;
+	BOOL kernelTls; /* no buffered BIO below the TLS BIO */
 	BOOL GatewayEnabled;
 	BOOL haveReadLock;
 	CRITICAL_SECTION ReadLock;
 	BOOL haveWriteLock;
 	CRITICAL_SECTION WriteLock;
 	UINT64 written;
+	rdpMetric* pendingBytes;
+	UINT32 corked;   /* nesting depth of transport_cork of corkOwner */
+	DWORD corkOwner; /* thread whose PDUs are collected in SendBuffer */
+	wStream* SendBuffer;
 	HANDLE rereadEvent;
 	BOOL haveMoreBytesToRead;
 	wLog* log;
@@ -238,10 +245,16 @@ static BOOL transport_default_attach(rdpTransport* transport, int sockfd)
 			goto fail;
 	}
 
-	bufferedBio = BIO_new(BIO_s_buffered_socket());
-	if (!bufferedBio)
-		goto fail;
+	/* Kernel TLS requires OpenSSL to use the socket directly, see tls_enable_ktls */
+	const BOOL kernelTls = freerdp_settings_get_bool(settings, FreeRDP_TlsKernelOffload);
+	if (!kernelTls)
+	{
+		bufferedBio = BIO_new(BIO_s_buffered_socket());
+		if (!bufferedBio)
+			goto fail;
+	}
 
+	BIO* frontBio = socketBio;
 	if (socketBio)
 	{
 		/* Attach the socket only when this function can no longer fail.
@@ -250,13 +263,17 @@ static BOOL transport_default_attach(rdpTransport* transport, int sockfd)
 		 * - if this function is successful, the caller MUST NOT close the socket any more.
 		 */
 		BIO_set_fd(socketBio, sockfd, BIO_CLOSE);
-		bufferedBio = BIO_push(bufferedBio, socketBio);
-		if (!bufferedBio)
-			goto fail;
+		if (bufferedBio)
+		{
+			frontBio = BIO_push(bufferedBio, socketBio);
+			if (!frontBio)
+				goto fail;
+		}
 	}
 	EnterCriticalSection(&(transport->ReadLock));
 	EnterCriticalSection(&(transport->WriteLock));
-	transport->frontBio = bufferedBio;
+	transport->frontBio = frontBio;
+	transport->kernelTls = kernelTls;
 	LeaveCriticalSection(&(transport->WriteLock));
 	LeaveCriticalSection(&(transport->ReadLock));
 
@@ -1203,6 +1220,107 @@ int transport_write(rdpTransport* transport, wStream* s)
 	return IFCALLRESULT(-1, transport->io.WritePdu, transport, s);
 }
 
+static void transport_write_failed(rdpTransport* transport)
+{
+	WINPR_ASSERT(transport);
+
+	/* A write error indicates that the peer has dropped the connection */
+	transport->layer = TRANSPORT_LAYER_CLOSED;
+	freerdp_set_last_error_if_not(transport->context, FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
+}
+
+/* Must be called with the WriteLock held */
+static int transport_write_bio(rdpTransport* transport, const BYTE* data, size_t length)
+{
+	int status = -1;
+	rdpContext* context = transport_get_context(transport);
+
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(data || (length == 0));
+
+	if (!transport->frontBio)
+		return -1;
+
+	while (length > 0)
+	{
+		ERR_clear_error();
+		const int towrite = (length > INT32_MAX) ? INT32_MAX : (int)length;
+		status = BIO_write(transport->frontBio, data, towrite);
+
+		if (status <= 0)
+		{
+			/* the buffered BIO that is at the end of the chain always says OK for writing,
+			 * so a retry means that for any reason we need to read. The most probable
+			 * is a SSL or TSG BIO in the chain.
+			 */
+			if (!BIO_should_retry(transport->frontBio))
+			{
+				WLog_ERR_BIO(transport, "BIO_should_retry", transport->frontBio);
+				return -1;
+			}
+
+			/* non-blocking can live with blocked IOs. With kernel TLS no buffered BIO
+			 * takes the data, a full socket must be waited for */
+			const BOOL socketFull = transport->kernelTls && BIO_should_write(transport->frontBio);
+			if (!transport->blocking && !socketFull)
+			{
+				WLog_ERR_BIO(transport, "BIO_write", transport->frontBio);
+				return -1;
+			}
+
+			if (BIO_wait_write(transport->frontBio, 100) < 0)
+			{
+				WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
+				return -1;
+			}
+
+			continue;
+		}
+
+		WINPR_ASSERT(context->settings);
+		if (transport->blocking || context->settings->WaitForOutputBufferFlush)
+		{
+			while (BIO_write_blocked(transport->frontBio))
+			{
+				if (BIO_wait_write(transport->frontBio, 100) < 0)
+				{
+					WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
+					return -1;
+				}
+
+				if (BIO_flush(transport->frontBio) < 1)
+				{
+					WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
+					return -1;
+				}
+			}
+		}
+
+		const size_t ustatus = (size_t)status;
+		if (ustatus > length)
+			return -1;
+
+		length -= ustatus;
+		data += ustatus;
+	}
+
+	return status;
+}
+
+/* Must be called with the WriteLock held */
+static int transport_flush_send_buffer(rdpTransport* transport)
+{
+	WINPR_ASSERT(transport);
+
+	wStream* s = transport->SendBuffer;
+	if (!s || (Stream_GetPosition(s) == 0))
+		return 0;
+
+	const int status = transport_write_bio(transport, Stream_Buffer(s), Stream_GetPosition(s));
+	Stream_ResetPosition(s);
+	return status;
+}
+
 static int transport_default_write(rdpTransport* transport, wStream* s)
 {
 	int status = -1;
@@ -1225,8 +1343,7 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 		goto out_cleanup;
 
 	{
-		size_t length = Stream_GetPosition(s);
-		size_t writtenlength = length;
+		const size_t length = Stream_GetPosition(s);
 		Stream_ResetPosition(s);
 
 		if (length > 0)
@@ -1235,83 +1352,51 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 			WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), length, WLOG_PACKET_OUTBOUND);
 		}
 
-		while (length > 0)
+		/* While corked small PDUs are collected and sent as few full size TLS records.
+		 * Only the PDUs of the corking thread are delayed, other threads write through. */
+		const BOOL corked = (transport->corked > 0) &&
+		                    (transport->corkOwner == GetCurrentThreadId());
+		if (corked && transport->SendBuffer && (length > 0) && (length <= BUFFER_SIZE))
 		{
-			ERR_clear_error();
-			const int towrite = (length > INT32_MAX) ? INT32_MAX : (int)length;
-			status = BIO_write(transport->frontBio, Stream_ConstPointer(s), towrite);
-
-			if (status <= 0)
-			{
-				/* the buffered BIO that is at the end of the chain always says OK for writing,
-				 * so a retry means that for any reason we need to read. The most probable
-				 * is a SSL or TSG BIO in the chain.
-				 */
-				if (!BIO_should_retry(transport->frontBio))
-				{
-					WLog_ERR_BIO(transport, "BIO_should_retry", transport->frontBio);
-					goto out_cleanup;
-				}
-
-				/* non-blocking can live with blocked IOs */
-				if (!transport->blocking)
-				{
-					WLog_ERR_BIO(transport, "BIO_write", transport->frontBio);
-					goto out_cleanup;
-				}
-
-				if (BIO_wait_write(transport->frontBio, 100) < 0)
-				{
-					WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
-					status = -1;
-					goto out_cleanup;
-				}
+			wStream* buffer = transport->SendBuffer;
 
-				continue;
-			}
+			/* Do not hide a failed connection behind the buffer until transport_uncork */
+			if (transport->layer == TRANSPORT_LAYER_CLOSED)
+				goto out_cleanup;
 
-			WINPR_ASSERT(context->settings);
-			if (transport->blocking || context->settings->WaitForOutputBufferFlush)
+			if (Stream_GetRemainingCapacity(buffer) < length)
 			{
-				while (BIO_write_blocked(transport->frontBio))
-				{
-					if (BIO_wait_write(transport->frontBio, 100) < 0)
-					{
-						WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
-						status = -1;
-						goto out_cleanup;
-					}
-
-					if (BIO_flush(transport->frontBio) < 1)
-					{
-						WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
-						status = -1;
-						goto out_cleanup;
-					}
-				}
+				if (transport_flush_send_buffer(transport) < 0)
+					goto out_cleanup;
 			}
 
-			const size_t ustatus = (size_t)status;
-			if (ustatus > length)
-			{
-				status = -1;
+			Stream_Write(buffer, Stream_Buffer(s), length);
+			status = (int)length;
+		}
+		else
+		{
+			/* Keep the order of PDUs, send whatever was queued first */
+			if (transport_flush_send_buffer(transport) < 0)
 				goto out_cleanup;
-			}
 
-			length -= ustatus;
-			Stream_Seek(s, ustatus);
+			status = transport_write_bio(transport, Stream_Buffer(s), length);
+			if (status >= 0)
+				Stream_Seek(s, length);
 		}
 
-		transport->written += writtenlength;
+		if (status >= 0)
+		{
+			const size_t pending = BIO_wpending(transport->frontBio) +
+			                       (transport->SendBuffer ? Stream_GetPosition(transport->SendBuffer)
+			                                              : 0);
+			transport->written += length;
+			metric_set(transport->pendingBytes, WINPR_ASSERTING_INT_CAST(INT64, pending));
+		}
 	}
 out_cleanup:
 
 	if (status < 0)
-	{
-		/* A write error indicates that the peer has dropped the connection */
-		transport->layer = TRANSPORT_LAYER_CLOSED;
-		freerdp_set_last_error_if_not(context, FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
-	}
+		transport_write_failed(transport);
 
 	LeaveCriticalSection(&(transport->WriteLock));
 fail:
@@ -1319,6 +1404,45 @@ fail:
 	return status;
 }
 
+void transport_cork(rdpTransport* transport)
+{
+	WINPR_ASSERT(transport);
+
+	const DWORD thread = GetCurrentThreadId();
+
+	EnterCriticalSection(&(transport->WriteLock));
+	if (transport->corked == 0)
+		transport->corkOwner = thread;
+
+	/* While another thread is corked the calls of this thread have no effect */
+	if (transport->corkOwner == thread)
+		transport->corked++;
+	LeaveCriticalSection(&(transport->WriteLock));
+}
+
+BOOL transport_uncork(rdpTransport* transport)
+{
+	BOOL rc = TRUE;
+
+	WINPR_ASSERT(transport);
+
+	EnterCriticalSection(&(transport->WriteLock));
+	if ((transport->corked == 0) || (transport->corkOwner != GetCurrentThreadId()))
+	{
+		LeaveCriticalSection(&(transport->WriteLock));
+		return TRUE;
+	}
+
+	transport->corked--;
+	if ((transport->corked == 0) && (transport_flush_send_buffer(transport) < 0))
+	{
+		transport_write_failed(transport);
+		rc = FALSE;
+	}
+	LeaveCriticalSection(&(transport->WriteLock));
+	return rc;
+}
+
 BOOL transport_get_public_key(rdpTransport* transport, const BYTE** data, DWORD* length)
 {
 	return IFCALLRESULT(FALSE, transport->io.GetPublicKey, transport, data, length);
@@ -1704,6 +1828,8 @@ static BOOL transport_default_disconnect(rdpTransport* transport)
 	transport->frontBio = nullptr;
 	transport->layer = TRANSPORT_LAYER_TCP;
 	transport->earlyUserAuth = FALSE;
+	if (transport->SendBuffer)
+		Stream_ResetPosition(transport->SendBuffer);
 	LeaveCriticalSection(&(transport->WriteLock));
 	LeaveCriticalSection(&(transport->ReadLock));
 	return status;
@@ -1733,6 +1859,12 @@ rdpTransport* transport_new(rdpContext* context)
 	if (!transport->ReceivePool)
 		goto fail;
 
+	/* One full size TLS record worth of corked PDUs */
+	transport->SendBuffer = Stream_New(nullptr, BUFFER_SIZE);
+
+	if (!transport->SendBuffer)
+		goto fail;
+
 	/* receive buffer for non-blocking read. */
 	transport->ReceiveBuffer = StreamPool_Take(transport->ReceivePool, 0);
 
@@ -1754,6 +1886,11 @@ rdpTransport* transport_new(rdpContext* context)
 	if (!transport->ioEvent || transport->ioEvent == INVALID_HANDLE_VALUE)
 		goto fail;
 
+	/* Resolved once, the lookup takes the lock of the metrics */
+	transport->pendingBytes = metrics_get_metric(
+	    context->metrics, "freerdp_transport_write_pending_bytes", FREERDP_METRIC_GAUGE,
+	    "Bytes written but not yet sent to the network");
+
 	transport->haveMoreBytesToRead = FALSE;
 	transport->blocking = TRUE;
 	transport->GatewayEnabled = FALSE;
@@ -1809,6 +1946,7 @@ void transport_free(rdpTransport* transport)
 
 	nla_free(transport->nla);
 	StreamPool_Free(transport->ReceivePool);
+	Stream_Free(transport->SendBuffer, TRUE);
 	(void)CloseHandle(transport->connectedEvent);
 	(void)CloseHandle(transport->rereadEvent);
 	(void)CloseHandle(transport->ioEvent);
@@ -134,6 +134,21 @@ FREERDP_LOCAL int transport_read_pdu(rdpTransport* transport, wStream* s);
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL int transport_write(rdpTransport* transport, wStream* s);
 
+/** @brief Start collecting PDUs written with \b transport_write
+ *
+ *  Until the matching \b transport_uncork small PDUs of the calling thread are copied to a
+ *  send buffer and written as a single TLS record once the buffer is full. Calls may be
+ *  nested. PDUs of other threads are written immediately, after the collected ones, and
+ *  their calls to \b transport_cork have no effect while the first thread is corked.
+ */
+FREERDP_LOCAL void transport_cork(rdpTransport* transport);
+
+/** @brief Undo one \b transport_cork, the last call flushes all collected PDUs
+ *
+ *  @return \b TRUE for success, \b FALSE if flushing failed
+ */
+FREERDP_LOCAL BOOL transport_uncork(rdpTransport* transport);
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL transport_get_public_key(rdpTransport* transport, const BYTE** data,
                                             DWORD* length);
@@ -38,6 +38,7 @@
 
 #include <freerdp/log.h>
 #include <freerdp/peer.h>
+#include <freerdp/metrics.h>
 #include <freerdp/codec/bitmap.h>
 
 #include "../cache/pointer.h"
@@ -3617,6 +3618,8 @@ BOOL update_end_paint(rdpUpdate* update)
 	IFCALLRET(update->EndPaint, rc, update->context);
 	if (!rc)
 		WLog_WARN(TAG, "EndPaint call failed");
+	else
+		metrics_frame_presented(update->context->metrics);
 
 	if (!up->withinBeginEndPaint)
 		return rc;
@@ -0,0 +1,238 @@
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/crypto/certificate.h>
+#include <freerdp/crypto/privatekey.h>
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "../certificate.h"
+#include "../privatekey.h"
+#include "../tls.h"
+
+typedef struct
+{
+	rdpTls* tls;
+	rdpSettings* settings;
+	int fd;
+	BOOL accepted;
+} test_server_t;
+
+/* A self signed certificate for the key, the common name tells the servers apart */
+static rdpCertificate* test_certificate_new(const rdpPrivateKey* key, const char* name)
+{
+	rdpCertificate* cert = nullptr;
+	EVP_PKEY* pkey = freerdp_key_get_evp_pkey(key);
+	X509* x509 = X509_new();
+
+	if (!pkey || !x509)
+		goto fail;
+
+	if ((X509_set_version(x509, 2) != 1) ||
+	    (ASN1_INTEGER_set(X509_get_serialNumber(x509), 1) != 1) ||
+	    !X509_gmtime_adj(X509_getm_notBefore(x509), 0) ||
+	    !X509_gmtime_adj(X509_getm_notAfter(x509), 60L * 60L) ||
+	    (X509_set_pubkey(x509, pkey) != 1))
+		goto fail;
+
+	X509_NAME* subject = X509_get_subject_name(x509);
+	if ((X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (const unsigned char*)name, -1,
+	                                -1, 0) != 1) ||
+	    (X509_set_issuer_name(x509, subject) != 1) || (X509_sign(x509, pkey, EVP_sha256()) <= 0))
+		goto fail;
+
+	cert = freerdp_certificate_new_from_x509(x509, nullptr);
+fail:
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+	return cert;
+}
+
+static BOOL test_server_identity(rdpSettings* settings, const char* name)
+{
+	rdpPrivateKey* key = freerdp_key_new();
+	if (!key || !freerdp_key_generate(key, "RSA", 1, 2048))
+	{
+		freerdp_key_free(key);
+		return FALSE;
+	}
+
+	rdpCertificate* cert = test_certificate_new(key, name);
+	if (!freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerRsaKey, key, 1))
+	{
+		freerdp_certificate_free(cert);
+		return FALSE;
+	}
+
+	return cert && freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerCertificate, cert, 1);
+}
+
+static DWORD WINAPI test_server_accept(LPVOID arg)
+{
+	test_server_t* server = arg;
+	BYTE data = 0x42;
+
+	BIO* bio = BIO_new_socket(server->fd, BIO_NOCLOSE);
+	if (!bio)
+		goto fail;
+
+	if (!freerdp_tls_accept(server->tls, bio, server->settings))
+		goto fail;
+
+	/* TLS 1.3 tickets are read by the client together with the first application data */
+	server->accepted = freerdp_tls_write_all(server->tls, &data, sizeof(data)) == sizeof(data);
+fail:
+	ExitThread(0);
+	return 0;
+}
+
+/* Connects a client to a server once, reused tells if the client resumed a session */
+static BOOL test_tls_connect(rdpContext* client, rdpContext* server, int port, BOOL* reused)
+{
+	BOOL rc = FALSE;
+	int fds[2] = { -1, -1 };
+	HANDLE thread = nullptr;
+	BYTE data = 0;
+	rdpTls* ctls = freerdp_tls_new(client);
+	test_server_t srv = { freerdp_tls_new(server), server->settings, -1, FALSE };
+
+	WINPR_ASSERT(reused);
+
+	if (!ctls || !srv.tls || (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0))
+		goto fail;
+
+	ctls->hostname = "localhost";
+	ctls->port = port;
+
+	srv.fd = fds[1];
+	thread = CreateThread(nullptr, 0, test_server_accept, &srv, 0, nullptr);
+	if (!thread)
+		goto fail;
+
+	BIO* bio = BIO_new_socket(fds[0], BIO_NOCLOSE);
+	if (!bio || (freerdp_tls_connect(ctls, bio) != 1))
+	{
+		BIO_free(bio);
+		(void)fprintf(stderr, "port %d: TLS connect failed\n", port);
+		goto fail;
+	}
+
+	if (BIO_read(ctls->bio, &data, sizeof(data)) != sizeof(data))
+		goto fail;
+
+	*reused = SSL_session_reused(ctls->ssl) == 1;
+	rc = TRUE;
+fail:
+	/* Unblocks a server that still waits for the handshake */
+	if (fds[0] >= 0)
+		(void)shutdown(fds[0], SHUT_RDWR);
+	if (thread)
+	{
+		(void)WaitForSingleObject(thread, INFINITE);
+		(void)CloseHandle(thread);
+	}
+	freerdp_tls_free(ctls);
+	freerdp_tls_free(srv.tls);
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	return rc && srv.accepted;
+}
+
+/* The first connection does a full handshake, the second one resumes if expected */
+static BOOL test_resume(rdpContext* client, rdpContext* first, rdpContext* second, int port,
+                        BOOL expected)
+{
+	BOOL reused = FALSE;
+
+	if (!test_tls_connect(client, first, port, &reused))
+		return FALSE;
+	if (reused)
+	{
+		(void)fprintf(stderr, "port %d: first connection resumed a session\n", port);
+		return FALSE;
+	}
+
+	if (!test_tls_connect(client, second, port, &reused))
+		return FALSE;
+	if (reused != expected)
+	{
+		(void)fprintf(stderr, "port %d: second connection resumed=%d, expected %d\n", port,
+		              reused, expected);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static freerdp* test_instance_new(BOOL serverMode, BOOL tickets, const char* name)
+{
+	freerdp* instance = freerdp_new();
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	rdpSettings* settings = instance->context->settings;
+	if (serverMode)
+	{
+		if (!freerdp_settings_set_bool(settings, FreeRDP_ServerMode, TRUE) ||
+		    !freerdp_settings_set_bool(settings, FreeRDP_TlsSessionTickets, tickets) ||
+		    !test_server_identity(settings, name))
+			goto fail;
+	}
+	else if (!freerdp_settings_set_bool(settings, FreeRDP_IgnoreCertificate, TRUE))
+		goto fail;
+
+	return instance;
+fail:
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+	return nullptr;
+}
+
+static void test_instance_free(freerdp* instance)
+{
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+}
+
+int TestTlsSession(int argc, char* argv[])
+{
+	int rc = -1;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	/* A failed handshake closes the socket pair while the peer still writes */
+	(void)signal(SIGPIPE, SIG_IGN);
+
+	freerdp* client = test_instance_new(FALSE, FALSE, nullptr);
+	freerdp* plain = test_instance_new(TRUE, FALSE, "plain");
+	freerdp* first = test_instance_new(TRUE, TRUE, "first");
+	freerdp* second = test_instance_new(TRUE, TRUE, "second");
+	if (!client || !plain || !first || !second)
+		goto fail;
+
+	/* Each case uses its own port so the client cache entries do not interfere */
+	if (!test_resume(client->context, plain->context, plain->context, 3389, FALSE))
+		goto fail;
+	if (!test_resume(client->context, first->context, first->context, 3390, TRUE))
+		goto fail;
+	/* The ticket key ring is shared, a server with another certificate must still refuse */
+	if (!test_resume(client->context, first->context, second->context, 3391, FALSE))
+		goto fail;
+
+	rc = 0;
+fail:
+	test_instance_free(client);
+	test_instance_free(plain);
+	test_instance_free(first);
+	test_instance_free(second);
+	return rc;
+}
@@ -48,6 +48,7 @@
 #include "opensslcompat.h"
 #include "certificate.h"
 #include "privatekey.h"
+#include "tls_session.h"
 
 #ifdef WINPR_HAVE_POLL_H
 #include <poll.h>
@@ -480,7 +481,9 @@ static long bio_rdp_tls_ctrl(BIO* bio, int cmd, long num, void* ptr)
 			break;
 
 		default:
-			status = BIO_ctrl(ssl_rbio, cmd, num, ptr);
+			/* With kernel TLS the SSL reads and writes the socket directly, the
+			 * socket specific controls are still served by the transport BIO chain */
+			status = BIO_ctrl(next_bio ? next_bio : ssl_rbio, cmd, num, ptr);
 			break;
 	}
 
@@ -746,6 +749,68 @@ static void SSLCTX_keylog_cb(const SSL* ssl, const char* line)
 	}
 }
 
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define TLS_HAVE_KTLS
+#endif
+
+/* Kernel TLS requires OpenSSL to operate on the socket itself. This is only possible
+ * for a socket attached with transport_attach, e.g. an accepted server connection. Client
+ * connections go through a transport layer and keep user space TLS. */
+static BOOL tls_enable_ktls(rdpTls* tls, BIO* underlying)
+{
+	WINPR_ASSERT(tls);
+
+	rdpSettings* settings = tls->context->settings;
+	if (!freerdp_settings_get_bool(settings, FreeRDP_TlsKernelOffload))
+		return TRUE;
+
+#if defined(TLS_HAVE_KTLS)
+	/* Only replace a plain socket BIO, a buffering, gateway or proxy BIO in the chain must
+	 * see the data */
+	SOCKET sockfd = INVALID_SOCKET;
+	if (!underlying || (BIO_method_type(underlying) != BIO_TYPE_SIMPLE) ||
+	    (BIO_get_socket(underlying, &sockfd) != 1))
+	{
+		WLog_INFO(TAG, "kernel TLS offload not available for this transport");
+		return TRUE;
+	}
+
+	/* OpenSSL only offloads its own socket BIO, it uses the same socket */
+	BIO* sock = BIO_new_socket((int)sockfd, BIO_NOCLOSE);
+	if (!sock)
+		return FALSE;
+
+	/* SSL_set_bio releases the reference to the transport BIO obtained by BIO_push */
+	SSL_set_bio(tls->ssl, sock, sock);
+	SSL_set_options(tls->ssl, SSL_OP_ENABLE_KTLS);
+	/* kernel TLS receive is not supported with read ahead */
+	SSL_set_read_ahead(tls->ssl, 0);
+	return TRUE;
+#else
+	WINPR_UNUSED(underlying);
+	WLog_WARN(TAG, "kernel TLS offload requested but not supported by this build");
+	return TRUE;
+#endif
+}
+
+static void tls_log_ktls(rdpTls* tls)
+{
+	WINPR_ASSERT(tls);
+
+#if defined(TLS_HAVE_KTLS)
+	if (!(SSL_get_options(tls->ssl) & SSL_OP_ENABLE_KTLS))
+		return;
+
+	/* The kernel might lack the tls module or the cipher, OpenSSL falls back to user space */
+	const BOOL tx = BIO_get_ktls_send(SSL_get_wbio(tls->ssl)) != 0;
+	const BOOL rx = BIO_get_ktls_recv(SSL_get_rbio(tls->ssl)) != 0;
+	WLog_INFO(TAG, "kernel TLS offload [%s]: send %s, receive %s", SSL_get_cipher_name(tls->ssl),
+	          tx ? "enabled" : "disabled", rx ? "enabled" : "disabled");
+#else
+	WINPR_UNUSED(tls);
+#endif
+}
+
 static void tls_reset(rdpTls* tls)
 {
 	WINPR_ASSERT(tls);
@@ -767,6 +832,7 @@ static void tls_reset(rdpTls* tls)
 
 	free_tls_public_key(tls);
 	free_tls_bindings(tls);
+	tls_session_reset(tls);
 }
 
 #if OPENSSL_VERSION_NUMBER >= 0x010000000L
@@ -854,7 +920,7 @@ static BOOL tls_prepare(rdpTls* tls, BIO* underlying, SSL_METHOD* method, int op
 	}
 
 	BIO_push(tls->bio, underlying);
-	return TRUE;
+	return tls_enable_ktls(tls, underlying);
 }
 
 static void
@@ -934,6 +1000,9 @@ TlsHandshakeResult freerdp_tls_connect_ex(rdpTls* tls, BIO* underlying, const SS
 	SSL_set_tlsext_host_name(tls->ssl, ptr);
 #endif
 
+	if (!tls_session_client_prepare(tls))
+		return TLS_HANDSHAKE_ERROR;
+
 	return freerdp_tls_handshake(tls);
 }
 
@@ -957,6 +1026,8 @@ TlsHandshakeResult freerdp_tls_handshake(rdpTls* tls)
 			wLog* log = WLog_Get(TAG);
 			WLog_Print(log, WLOG_ERROR, "BIO_do_handshake failed");
 			ERR_print_errors_cb(bio_err_print, log);
+			if (tls->isClientMode)
+				tls_session_client_invalidate(tls);
 			return TLS_HANDSHAKE_ERROR;
 		}
 
@@ -992,6 +1063,7 @@ TlsHandshakeResult freerdp_tls_handshake(rdpTls* tls)
 
 		/* server-side NLA needs public keys (keys from us, the server) but no certificate verify */
 		ret = TLS_HANDSHAKE_SUCCESS;
+		tls_log_ktls(tls);
 
 		if (tls->isClientMode)
 		{
@@ -1002,9 +1074,12 @@ TlsHandshakeResult freerdp_tls_handshake(rdpTls* tls)
 			if (verify_status < 1)
 			{
 				WLog_ERR(TAG, "certificate not trusted, aborting.");
+				tls_session_client_invalidate(tls);
 				freerdp_tls_send_alert(tls);
 				ret = TLS_HANDSHAKE_VERIFY_ERROR;
 			}
+			else
+				tls_session_client_verified(tls, cert);
 		}
 	} while (0);
 
@@ -1230,6 +1305,15 @@ TlsHandshakeResult freerdp_tls_accept_ex(rdpTls* tls, BIO* underlying, rdpSettin
 		}
 	}
 
+	if (freerdp_settings_get_bool(settings, FreeRDP_TlsSessionTickets))
+	{
+		if (!tls_session_server_prepare(tls, cert))
+		{
+			WLog_ERR(TAG, "failed to set up TLS session tickets");
+			return TLS_HANDSHAKE_ERROR;
+		}
+	}
+
 #if defined(MICROSOFT_IOS_SNI_BUG) && !defined(OPENSSL_NO_TLSEXT) && \
     !defined(LIBRESSL_VERSION_NUMBER)
 	SSL_set_tlsext_debug_callback(tls->ssl, tls_openssl_tlsext_debug_callback);
@@ -82,6 +82,8 @@ struct rdp_tls
 	int alertDescription;
 	BOOL isGatewayTransport;
 	BOOL isClientMode;
+	SSL_SESSION* pendingSession;
+	char* sessionFingerprint;
 };
 
 /** @brief result of a handshake operation */
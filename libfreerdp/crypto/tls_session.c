@@ -0,0 +1,511 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Transport Layer Security - session resumption
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+#include <time.h>
+
+#include <winpr/assert.h>
+#include <winpr/atexit.h>
+#include <winpr/crt.h>
+#include <winpr/string.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/x509.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#include "certificate.h"
+#include "tls_session.h"
+
+#define TAG FREERDP_TAG("crypto")
+
+typedef struct
+{
+	char* key;
+	char* fingerprint;
+	SSL_SESSION* session;
+	UINT64 lastUsed;
+} TLS_SESSION_CACHE_ENTRY;
+
+typedef struct
+{
+	BYTE name[16];
+	BYTE aesKey[32];
+	BYTE hmacKey[32];
+	UINT64 created;
+	BOOL valid;
+} TLS_TICKET_KEY;
+
+static INIT_ONCE tls_session_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION tls_session_lock;
+static int tls_session_idx = -1;
+static TLS_SESSION_CACHE_ENTRY tls_session_cache[TLS_SESSION_CACHE_SIZE] = WINPR_C_ARRAY_INIT;
+static TLS_TICKET_KEY tls_ticket_keys[TLS_TICKET_KEY_COUNT] = WINPR_C_ARRAY_INIT;
+static size_t tls_ticket_key_current = 0;
+
+static void tls_session_cache_entry_clear(TLS_SESSION_CACHE_ENTRY* entry)
+{
+	WINPR_ASSERT(entry);
+
+	free(entry->key);
+	free(entry->fingerprint);
+	SSL_SESSION_free(entry->session);
+
+	const TLS_SESSION_CACHE_ENTRY empty = WINPR_C_ARRAY_INIT;
+	*entry = empty;
+}
+
+static void tls_session_cleanup(void)
+{
+	EnterCriticalSection(&tls_session_lock);
+	for (size_t x = 0; x < ARRAYSIZE(tls_session_cache); x++)
+		tls_session_cache_entry_clear(&tls_session_cache[x]);
+	OPENSSL_cleanse(tls_ticket_keys, sizeof(tls_ticket_keys));
+	LeaveCriticalSection(&tls_session_lock);
+}
+
+static BOOL CALLBACK tls_session_init_cb(WINPR_ATTR_UNUSED PINIT_ONCE once,
+                                         WINPR_ATTR_UNUSED PVOID param,
+                                         WINPR_ATTR_UNUSED PVOID* context)
+{
+	if (!InitializeCriticalSectionAndSpinCount(&tls_session_lock, 4000))
+		return FALSE;
+
+	tls_session_idx = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+	(void)winpr_atexit(tls_session_cleanup);
+	return (tls_session_idx != -1);
+}
+
+static BOOL tls_session_init(void)
+{
+	return InitOnceExecuteOnce(&tls_session_once, tls_session_init_cb, nullptr, nullptr);
+}
+
+static BOOL tls_session_key(const rdpTls* tls, char* key, size_t size)
+{
+	WINPR_ASSERT(tls);
+
+	const char* host = tls->serverName ? tls->serverName : tls->hostname;
+	if (!host)
+		return FALSE;
+
+	const int rc = _snprintf(key, size, "%s:%d", host, tls->port);
+	return (rc > 0) && ((size_t)rc < size);
+}
+
+static BOOL tls_session_is_resumable(const SSL_SESSION* session)
+{
+	if (!session)
+		return FALSE;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	if (!SSL_SESSION_is_resumable(session))
+		return FALSE;
+#endif
+
+	const time_t now = time(nullptr);
+	const long start = SSL_SESSION_get_time(session);
+	const long timeout = SSL_SESSION_get_timeout(session);
+	return (now >= start) && ((now - start) < timeout);
+}
+
+/* must be called with tls_session_lock held */
+static TLS_SESSION_CACHE_ENTRY* tls_session_cache_find(const char* key)
+{
+	for (size_t x = 0; x < ARRAYSIZE(tls_session_cache); x++)
+	{
+		TLS_SESSION_CACHE_ENTRY* entry = &tls_session_cache[x];
+		if (entry->key && (strcmp(entry->key, key) == 0))
+			return entry;
+	}
+	return nullptr;
+}
+
+/* must be called with tls_session_lock held */
+static TLS_SESSION_CACHE_ENTRY* tls_session_cache_slot(void)
+{
+	TLS_SESSION_CACHE_ENTRY* oldest = &tls_session_cache[0];
+	for (size_t x = 0; x < ARRAYSIZE(tls_session_cache); x++)
+	{
+		TLS_SESSION_CACHE_ENTRY* entry = &tls_session_cache[x];
+		if (!entry->key)
+			return entry;
+		if (entry->lastUsed < oldest->lastUsed)
+			oldest = entry;
+	}
+
+	tls_session_cache_entry_clear(oldest);
+	return oldest;
+}
+
+/* takes ownership of the session reference */
+static void tls_session_cache_store(const rdpTls* tls, SSL_SESSION* session)
+{
+	char key[512] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(tls);
+	WINPR_ASSERT(tls->sessionFingerprint);
+
+	if (!tls_session_is_resumable(session) || !tls_session_key(tls, key, sizeof(key)))
+	{
+		SSL_SESSION_free(session);
+		return;
+	}
+
+	char* dkey = _strdup(key);
+	char* fingerprint = _strdup(tls->sessionFingerprint);
+	if (!dkey || !fingerprint)
+	{
+		free(dkey);
+		free(fingerprint);
+		SSL_SESSION_free(session);
+		return;
+	}
+
+	EnterCriticalSection(&tls_session_lock);
+	TLS_SESSION_CACHE_ENTRY* entry = tls_session_cache_find(key);
+	if (entry)
+		tls_session_cache_entry_clear(entry);
+	else
+		entry = tls_session_cache_slot();
+
+	entry->key = dkey;
+	entry->fingerprint = fingerprint;
+	entry->session = session;
+	entry->lastUsed = GetTickCount64();
+	LeaveCriticalSection(&tls_session_lock);
+
+	WLog_DBG(TAG, "cached TLS session for %s", key);
+}
+
+static int tls_session_new_cb(SSL* ssl, SSL_SESSION* session)
+{
+	rdpTls* tls = SSL_get_ex_data(ssl, tls_session_idx);
+	if (!tls)
+		return 0;
+
+	/* TLS 1.2 sessions are announced during the handshake, before the certificate was
+	 * verified. TLS 1.3 tickets arrive afterwards with the first application data. */
+	if (!tls->sessionFingerprint)
+	{
+		SSL_SESSION_free(tls->pendingSession);
+		tls->pendingSession = session;
+	}
+	else
+		tls_session_cache_store(tls, session);
+	return 1;
+}
+
+BOOL tls_session_client_prepare(rdpTls* tls)
+{
+	char key[512] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(tls);
+	WINPR_ASSERT(tls->ssl);
+	WINPR_ASSERT(tls->ctx);
+
+	if (SSL_is_dtls(tls->ssl))
+		return TRUE;
+
+	if (!tls_session_init())
+		return FALSE;
+
+	if (!SSL_set_ex_data(tls->ssl, tls_session_idx, tls))
+		return FALSE;
+
+	SSL_CTX_set_session_cache_mode(tls->ctx,
+	                               SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(tls->ctx, tls_session_new_cb);
+
+	if (!tls_session_key(tls, key, sizeof(key)))
+		return TRUE;
+
+	SSL_SESSION* session = nullptr;
+	EnterCriticalSection(&tls_session_lock);
+	TLS_SESSION_CACHE_ENTRY* entry = tls_session_cache_find(key);
+	if (entry)
+	{
+		if (tls_session_is_resumable(entry->session))
+		{
+			session = entry->session;
+			SSL_SESSION_up_ref(session);
+			entry->lastUsed = GetTickCount64();
+		}
+		else
+			tls_session_cache_entry_clear(entry);
+	}
+	LeaveCriticalSection(&tls_session_lock);
+
+	if (!session)
+		return TRUE;
+
+	const int rc = SSL_set_session(tls->ssl, session);
+	SSL_SESSION_free(session);
+	if (rc != 1)
+		WLog_WARN(TAG, "failed to offer the cached TLS session for %s", key);
+	else
+		WLog_DBG(TAG, "offering cached TLS session for %s", key);
+	return TRUE;
+}
+
+void tls_session_client_verified(rdpTls* tls, const rdpCertificate* cert)
+{
+	char key[512] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(tls);
+
+	if (!tls->ssl || SSL_is_dtls(tls->ssl) || (tls_session_idx == -1))
+		return;
+
+	free(tls->sessionFingerprint);
+	tls->sessionFingerprint = freerdp_certificate_get_fingerprint_by_hash(cert, "sha256");
+	if (!tls->sessionFingerprint || !tls_session_key(tls, key, sizeof(key)))
+		return;
+
+	if (SSL_session_reused(tls->ssl))
+		WLog_INFO(TAG, "resumed TLS session for %s", key);
+
+	/* The server presented a different certificate than the one the cached
+	 * session was established with, do not offer that session again. */
+	EnterCriticalSection(&tls_session_lock);
+	TLS_SESSION_CACHE_ENTRY* entry = tls_session_cache_find(key);
+	if (entry && (strcmp(entry->fingerprint, tls->sessionFingerprint) != 0))
+		tls_session_cache_entry_clear(entry);
+	LeaveCriticalSection(&tls_session_lock);
+
+	if (tls->pendingSession)
+	{
+		tls_session_cache_store(tls, tls->pendingSession);
+		tls->pendingSession = nullptr;
+	}
+}
+
+void tls_session_client_invalidate(rdpTls* tls)
+{
+	char key[512] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(tls);
+
+	tls_session_reset(tls);
+	if ((tls_session_idx == -1) || !tls_session_key(tls, key, sizeof(key)))
+		return;
+
+	EnterCriticalSection(&tls_session_lock);
+	TLS_SESSION_CACHE_ENTRY* entry = tls_session_cache_find(key);
+	if (entry)
+		tls_session_cache_entry_clear(entry);
+	LeaveCriticalSection(&tls_session_lock);
+}
+
+void tls_session_reset(rdpTls* tls)
+{
+	WINPR_ASSERT(tls);
+
+	SSL_SESSION_free(tls->pendingSession);
+	tls->pendingSession = nullptr;
+	free(tls->sessionFingerprint);
+	tls->sessionFingerprint = nullptr;
+}
+
+static BOOL tls_ticket_key_generate(TLS_TICKET_KEY* key)
+{
+	WINPR_ASSERT(key);
+
+	if ((RAND_bytes(key->name, sizeof(key->name)) != 1) ||
+	    (RAND_bytes(key->aesKey, sizeof(key->aesKey)) != 1) ||
+	    (RAND_bytes(key->hmacKey, sizeof(key->hmacKey)) != 1))
+	{
+		OPENSSL_cleanse(key, sizeof(*key));
+		return FALSE;
+	}
+
+	key->created = GetTickCount64();
+	key->valid = TRUE;
+	return TRUE;
+}
+
+/* Returns the key used to encrypt new tickets, rotating it when it got too old.
+ * must be called with tls_session_lock held */
+static const TLS_TICKET_KEY* tls_ticket_key_encrypt(void)
+{
+	TLS_TICKET_KEY* key = &tls_ticket_keys[tls_ticket_key_current];
+	const UINT64 now = GetTickCount64();
+	if (key->valid && (now - key->created < TLS_TICKET_KEY_ROTATION_INTERVAL))
+		return key;
+
+	const size_t next = (tls_ticket_key_current + 1) % ARRAYSIZE(tls_ticket_keys);
+	if (!tls_ticket_key_generate(&tls_ticket_keys[next]))
+		return nullptr;
+
+	/* the oldest key got replaced, tickets encrypted with it can no longer be resumed */
+	tls_ticket_key_current = next;
+	WLog_DBG(TAG, "rotated TLS session ticket key");
+	return &tls_ticket_keys[next];
+}
+
+/* Returns the key a ticket was encrypted with, nullptr if it is unknown or expired.
+ * must be called with tls_session_lock held */
+static const TLS_TICKET_KEY* tls_ticket_key_decrypt(const unsigned char* name, BOOL* renew)
+{
+	WINPR_ASSERT(renew);
+
+	const UINT64 now = GetTickCount64();
+	for (size_t x = 0; x < ARRAYSIZE(tls_ticket_keys); x++)
+	{
+		const TLS_TICKET_KEY* key = &tls_ticket_keys[x];
+		if (!key->valid || (memcmp(key->name, name, sizeof(key->name)) != 0))
+			continue;
+
+		if (now - key->created >= 1ull * TLS_TICKET_KEY_ROTATION_INTERVAL * TLS_TICKET_KEY_COUNT)
+			return nullptr;
+
+		*renew = (x != tls_ticket_key_current);
+		return key;
+	}
+	return nullptr;
+}
+
+/* Callback return values as documented for SSL_CTX_set_tlsext_ticket_key_evp_cb:
+ * -1 error, 0 unknown key (full handshake), 1 success, 2 success but renew the ticket */
+static int tls_ticket_key_select(const SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                                 int enc, TLS_TICKET_KEY* key)
+{
+	int rc = -1;
+	BOOL renew = FALSE;
+
+	WINPR_ASSERT(key);
+
+	EnterCriticalSection(&tls_session_lock);
+	const TLS_TICKET_KEY* cur =
+	    enc ? tls_ticket_key_encrypt() : tls_ticket_key_decrypt(key_name, &renew);
+	if (cur)
+	{
+		*key = *cur;
+		rc = renew ? 2 : 1;
+#if defined(TLS1_3_VERSION)
+		/* TLS 1.3 clients use a ticket only once, so hand out a fresh one with every
+		 * resumed handshake. OpenSSL only does that when asked to renew the ticket. */
+		if (!enc && (SSL_version(ssl) >= TLS1_3_VERSION))
+			rc = 2;
+#endif
+	}
+	else if (!enc)
+		rc = 0;
+	LeaveCriticalSection(&tls_session_lock);
+
+	if ((rc == 1) && enc)
+	{
+		memcpy(key_name, key->name, sizeof(key->name));
+		if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+			rc = -1;
+	}
+	return rc;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+static int tls_ticket_key_cb(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                             EVP_CIPHER_CTX* ctx, EVP_MAC_CTX* hctx, int enc)
+{
+	TLS_TICKET_KEY key = WINPR_C_ARRAY_INIT;
+
+	int rc = tls_ticket_key_select(ssl, key_name, iv, enc, &key);
+	if (rc > 0)
+	{
+		char digest[] = "SHA256";
+		OSSL_PARAM params[] = {
+			OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey,
+			                                  sizeof(key.hmacKey)),
+			OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+			OSSL_PARAM_construct_end()
+		};
+
+		const int init = enc ? EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aesKey, iv)
+		                     : EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aesKey, iv);
+		if ((init != 1) || (EVP_MAC_CTX_set_params(hctx, params) != 1))
+			rc = -1;
+	}
+
+	OPENSSL_cleanse(&key, sizeof(key));
+	return rc;
+}
+#else
+static int tls_ticket_key_cb(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                             EVP_CIPHER_CTX* ctx, HMAC_CTX* hctx, int enc)
+{
+	TLS_TICKET_KEY key = WINPR_C_ARRAY_INIT;
+
+	int rc = tls_ticket_key_select(ssl, key_name, iv, enc, &key);
+	if (rc > 0)
+	{
+		const int init = enc ? EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aesKey, iv)
+		                     : EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, key.aesKey, iv);
+		if ((init != 1) ||
+		    (HMAC_Init_ex(hctx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), nullptr) != 1))
+			rc = -1;
+	}
+
+	OPENSSL_cleanse(&key, sizeof(key));
+	return rc;
+}
+#endif
+
+BOOL tls_session_server_prepare(rdpTls* tls, rdpCertificate* cert)
+{
+	unsigned char sid_ctx[SSL_MAX_SID_CTX_LENGTH] = WINPR_C_ARRAY_INIT;
+	unsigned int sid_ctx_len = sizeof(sid_ctx);
+
+	WINPR_ASSERT(tls);
+	WINPR_ASSERT(tls->ctx);
+	WINPR_ASSERT(tls->ssl);
+	WINPR_ASSERT(cert);
+
+	if (!tls_session_init())
+		return FALSE;
+
+	/* The key ring is shared by all servers of the process. Bind the sessions to the
+	 * certificate so a ticket is only accepted by a server with the same identity. */
+	X509* x509 = freerdp_certificate_get_x509(cert);
+	if (!x509 || (EVP_MD_size(EVP_sha256()) > (int)sizeof(sid_ctx)) ||
+	    (X509_digest(x509, EVP_sha256(), sid_ctx, &sid_ctx_len) != 1))
+		return FALSE;
+
+	/* Every connection uses its own SSL_CTX, so the internal session cache and the
+	 * default (per context) ticket keys can never resume a session. Use stateless
+	 * tickets protected by a process wide key ring instead. */
+	SSL_CTX_set_session_cache_mode(tls->ctx, SSL_SESS_CACHE_OFF);
+	if (SSL_set_session_id_context(tls->ssl, sid_ctx, sid_ctx_len) != 1)
+		return FALSE;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+	if (SSL_CTX_set_tlsext_ticket_key_evp_cb(tls->ctx, tls_ticket_key_cb) != 1)
+		return FALSE;
+#else
+	if (SSL_CTX_set_tlsext_ticket_key_cb(tls->ctx, tls_ticket_key_cb) != 1)
+		return FALSE;
+#endif
+	return TRUE;
+}
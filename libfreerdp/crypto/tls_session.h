@@ -0,0 +1,64 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Transport Layer Security - session resumption
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CRYPTO_TLS_SESSION_H
+#define FREERDP_LIB_CRYPTO_TLS_SESSION_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/api.h>
+#include <freerdp/crypto/certificate.h>
+
+#include "tls.h"
+
+/** Maximum number of sessions kept by the process wide client cache */
+#define TLS_SESSION_CACHE_SIZE 32
+/** Interval in ms after which the server starts encrypting tickets with a fresh key */
+#define TLS_TICKET_KEY_ROTATION_INTERVAL (60 * 60 * 1000)
+/** Number of ticket keys kept, tickets stay valid for (count - 1) rotation intervals */
+#define TLS_TICKET_KEY_COUNT 3
+
+/** @brief Offer a cached session for the connection and register for new ones
+ *
+ *  Must be called after the SSL object was created and before the handshake starts.
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL tls_session_client_prepare(rdpTls* tls);
+
+/** @brief The server certificate of the connection was accepted
+ *
+ *  Sessions received from the server are only cached after the certificate was
+ *  verified. Cached sessions of the same host:port that were established with a
+ *  different certificate are dropped.
+ */
+FREERDP_LOCAL void tls_session_client_verified(rdpTls* tls, const rdpCertificate* cert);
+
+/** @brief Drop the cached session of the connection, e.g. after a failed verification */
+FREERDP_LOCAL void tls_session_client_invalidate(rdpTls* tls);
+
+/** @brief Enable stateless session tickets encrypted with the process wide key ring
+ *
+ *  Must be called after the SSL object was created. Sessions are bound to the server
+ *  certificate \b cert, tickets issued for a different certificate are not resumed.
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL tls_session_server_prepare(rdpTls* tls, rdpCertificate* cert);
+
+/** @brief Release the per connection resumption state */
+FREERDP_LOCAL void tls_session_reset(rdpTls* tls);
+
+#endif /* FREERDP_LIB_CRYPTO_TLS_SESSION_H */
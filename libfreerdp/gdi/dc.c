@@ -33,6 +33,8 @@
 
 #include <freerdp/gdi/dc.h>
 
+#include "gdi.h"
+
 /**
  * @brief Get the current device context (a new one is created each time).
  * msdn{dd144871}
@@ -92,7 +94,7 @@ HGDI_DC gdi_CreateDC(UINT32 format)
 		goto fail;
 
 	hDC->hwnd->invalid->null = TRUE;
-	hDC->hwnd->count = 32;
+	hDC->hwnd->count = GDI_INVALID_RECT_LIMIT;
 
 	if (!(hDC->hwnd->cinvalid = (GDI_RGN*)calloc(hDC->hwnd->count, sizeof(GDI_RGN))))
 		goto fail;
@@ -27,10 +27,12 @@
 #include <winpr/crt.h>
 #include <winpr/assert.h>
 #include <winpr/cast.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/api.h>
 #include <freerdp/log.h>
 #include <freerdp/freerdp.h>
+#include <freerdp/metrics.h>
 #include <freerdp/codecs.h>
 
 #include <freerdp/gdi/gdi.h>
@@ -1122,6 +1124,7 @@ static BOOL gdi_surface_bits(rdpContext* context, const SURFACE_BITS_COMMAND* cm
 	BOOL result = FALSE;
 	DWORD format = 0;
 	size_t size = 0;
+	UINT64 start = 0;
 	REGION16 region;
 	RECTANGLE_16 cmdRect = WINPR_C_ARRAY_INIT;
 
@@ -1145,6 +1148,7 @@ static BOOL gdi_surface_bits(rdpContext* context, const SURFACE_BITS_COMMAND* cm
 	if (!intersect_rect(gdi, cmd, &cmdRect))
 		goto out;
 
+	start = winpr_GetTickCount64NS();
 	switch (cmd->bmp.codecID)
 	{
 		case RDP_CODEC_ID_REMOTEFX:
@@ -1206,6 +1210,10 @@ static BOOL gdi_surface_bits(rdpContext* context, const SURFACE_BITS_COMMAND* cm
 			break;
 	}
 
+	if (cmd->bmp.codecID < ARRAYSIZE(gdi->surfaceBitsDecode))
+		metric_observe(gdi->surfaceBitsDecode[cmd->bmp.codecID],
+		               winpr_GetTickCount64NS() - start);
+
 	{
 		UINT32 nbRects = 0;
 		const RECTANGLE_16* rects = region16_rects(&region, &nbRects);
@@ -1345,7 +1353,8 @@ static BOOL gdi_init_primary(rdpGdi* gdi, UINT32 stride, UINT32 format, BYTE* bu
 		goto fail_hwnd;
 
 	gdi->primary->hdc->hwnd->invalid->null = TRUE;
-	gdi->primary->hdc->hwnd->count = 32;
+	gdi->primary->hdc->hwnd->count =
+	    MAX(1, freerdp_settings_get_uint32(gdi->context->settings, FreeRDP_GdiInvalidRectLimit));
 
 	if (!(gdi->primary->hdc->hwnd->cinvalid =
 	          (GDI_RGN*)calloc(gdi->primary->hdc->hwnd->count, sizeof(GDI_RGN))))
@@ -1430,6 +1439,24 @@ BOOL gdi_init(freerdp* instance, UINT32 format)
  *
  * @return \b TRUE for success, \b FALSE for failure
  */
+static void gdi_init_metrics(rdpGdi* gdi)
+{
+	const UINT32 codecs[] = { RDP_CODEC_ID_NONE, RDP_CODEC_ID_NSCODEC, RDP_CODEC_ID_REMOTEFX,
+		                      RDP_CODEC_ID_IMAGE_REMOTEFX };
+
+	WINPR_ASSERT(gdi);
+	WINPR_ASSERT(gdi->context);
+
+	for (size_t x = 0; x < ARRAYSIZE(codecs); x++)
+	{
+		const UINT32 id = codecs[x];
+		WINPR_ASSERT(id < ARRAYSIZE(gdi->surfaceBitsDecode));
+		gdi->surfaceBitsDecode[id] =
+		    metrics_get_histogram(gdi->context->metrics, "freerdp_decode_seconds", "codec",
+		                          freerdp_codec_id_to_str(id), "Time to decode a surface command");
+	}
+}
+
 BOOL gdi_init_ex(freerdp* instance, UINT32 format, UINT32 stride, BYTE* buffer,
                  void (*pfree)(void*))
 {
@@ -1462,6 +1489,7 @@ BOOL gdi_init_ex(freerdp* instance, UINT32 format, UINT32 stride, BYTE* buffer,
 	gdi->height = WINPR_ASSERTING_INT_CAST(
 	    int32_t, freerdp_settings_get_uint32(context->settings, FreeRDP_DesktopHeight));
 	gdi->dstFormat = format;
+	gdi_init_metrics(gdi);
 	/* default internal buffer format */
 	WLog_Print(gdi->log, WLOG_INFO, "Local framebuffer format  %s",
 	           FreeRDPGetColorFormatName(gdi->dstFormat));
@@ -25,9 +25,11 @@
 
 #include <winpr/assert.h>
 #include <winpr/cast.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/api.h>
 #include <freerdp/log.h>
+#include <freerdp/metrics.h>
 #include <freerdp/gdi/gfx.h>
 #include <freerdp/gdi/region.h>
 #include <freerdp/utils/gfx.h>
@@ -476,12 +478,9 @@ static UINT gdi_SurfaceCommand_AV1(rdpGdi* gdi, RdpgfxClientContext* context,
 		return CHANNEL_RC_OK;
 	}
 
-	for (UINT32 i = 0; i < meta->numRegionRects; i++)
-	{
-		if (!region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                         &(meta->regionRects[i])))
-			goto fail;
-	}
+	if (!region16_union_rects(&(surface->invalidRegion), &(surface->invalidRegion),
+	                          meta->regionRects, meta->numRegionRects))
+		goto fail;
 
 	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
 	                      meta->numRegionRects, meta->regionRects);
@@ -545,11 +544,8 @@ static UINT gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* contex
 	if (status != CHANNEL_RC_OK)
 		goto fail;
 
-	for (UINT32 x = 0; x < nrRects; x++)
-	{
-		if (!region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rects[x]))
-			goto fail;
-	}
+	if (!region16_union_rects(&surface->invalidRegion, &surface->invalidRegion, rects, nrRects))
+		goto fail;
 
 	status = gdi_interFrameUpdate(gdi, context);
 
@@ -735,12 +731,9 @@ static UINT gdi_SurfaceCommand_AVC420(rdpGdi* gdi, RdpgfxClientContext* context,
 		return CHANNEL_RC_OK;
 	}
 
-	for (UINT32 i = 0; i < meta->numRegionRects; i++)
-	{
-		if (!region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                         &(meta->regionRects[i])))
-			goto fail;
-	}
+	if (!region16_union_rects(&(surface->invalidRegion), &(surface->invalidRegion),
+	                          meta->regionRects, meta->numRegionRects))
+		goto fail;
 
 	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
 	                      meta->numRegionRects, meta->regionRects);
@@ -828,12 +821,9 @@ static UINT gdi_SurfaceCommand_AVC444(rdpGdi* gdi, RdpgfxClientContext* context,
 		return CHANNEL_RC_OK;
 	}
 
-	for (UINT32 i = 0; i < meta1->numRegionRects; i++)
-	{
-		if (!region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                         &(meta1->regionRects[i])))
-			goto fail;
-	}
+	if (!region16_union_rects(&(surface->invalidRegion), &(surface->invalidRegion),
+	                          meta1->regionRects, meta1->numRegionRects))
+		goto fail;
 
 	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
 	                      meta1->numRegionRects, meta1->regionRects);
@@ -841,12 +831,9 @@ static UINT gdi_SurfaceCommand_AVC444(rdpGdi* gdi, RdpgfxClientContext* context,
 	if (status != CHANNEL_RC_OK)
 		goto fail;
 
-	for (UINT32 i = 0; i < meta2->numRegionRects; i++)
-	{
-		if (!region16_union_rect(&(surface->invalidRegion), &(surface->invalidRegion),
-		                         &(meta2->regionRects[i])))
-			goto fail;
-	}
+	if (!region16_union_rects(&(surface->invalidRegion), &(surface->invalidRegion),
+	                          meta2->regionRects, meta2->numRegionRects))
+		goto fail;
 
 	status = IFCALLRESULT(CHANNEL_RC_OK, context->UpdateSurfaceArea, context, surface->surfaceId,
 	                      meta2->numRegionRects, meta2->regionRects);
@@ -1131,11 +1118,8 @@ static UINT gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* con
 		goto fail;
 
 	status = ERROR_INTERNAL_ERROR;
-	for (UINT32 x = 0; x < nrRects; x++)
-	{
-		if (!region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rects[x]))
-			goto fail;
-	}
+	if (!region16_union_rects(&surface->invalidRegion, &surface->invalidRegion, rects, nrRects))
+		goto fail;
 
 	status = gdi_interFrameUpdate(gdi, context);
 
@@ -1174,6 +1158,7 @@ static UINT gdi_SurfaceCommand(RdpgfxClientContext* context, const RDPGFX_SURFAC
 	dump_cmd(cmd, gdi->frameId);
 #endif
 
+	const UINT64 start = winpr_GetTickCount64NS();
 	switch (codecId)
 	{
 		case RDPGFX_CODECID_UNCOMPRESSED:
@@ -1226,6 +1211,8 @@ static UINT gdi_SurfaceCommand(RdpgfxClientContext* context, const RDPGFX_SURFAC
 			break;
 	}
 
+	if (codecId < ARRAYSIZE(gdi->gfxDecode))
+		metric_observe(gdi->gfxDecode[codecId], winpr_GetTickCount64NS() - start);
 	LeaveCriticalSection(&context->mux);
 	return status;
 }
@@ -1991,6 +1978,31 @@ BOOL gdi_graphics_pipeline_init(rdpGdi* gdi, RdpgfxClientContext* gfx)
 	return gdi_graphics_pipeline_init_ex(gdi, gfx, nullptr, nullptr, nullptr);
 }
 
+static void gdi_graphics_pipeline_init_metrics(rdpGdi* gdi)
+{
+	const UINT16 codecs[] = { RDPGFX_CODECID_UNCOMPRESSED,
+#if defined(WITH_GFX_AV1)
+		                      RDPGFX_CODECID_AV1,
+#endif
+		                      RDPGFX_CODECID_CAVIDEO,          RDPGFX_CODECID_CLEARCODEC,
+		                      RDPGFX_CODECID_PLANAR,           RDPGFX_CODECID_AVC420,
+		                      RDPGFX_CODECID_AVC444,           RDPGFX_CODECID_AVC444v2,
+		                      RDPGFX_CODECID_ALPHA,            RDPGFX_CODECID_CAPROGRESSIVE,
+		                      RDPGFX_CODECID_CAPROGRESSIVE_V2 };
+
+	WINPR_ASSERT(gdi);
+	WINPR_ASSERT(gdi->context);
+
+	for (size_t x = 0; x < ARRAYSIZE(codecs); x++)
+	{
+		const UINT16 id = codecs[x];
+		WINPR_ASSERT(id < ARRAYSIZE(gdi->gfxDecode));
+		gdi->gfxDecode[id] = metrics_get_histogram(
+		    gdi->context->metrics, "freerdp_decode_seconds", "codec",
+		    rdpgfx_get_codec_id_string(id), "Time to decode a surface command");
+	}
+}
+
 BOOL gdi_graphics_pipeline_init_ex(rdpGdi* gdi, RdpgfxClientContext* gfx,
                                    pcRdpgfxMapWindowForSurface map,
                                    pcRdpgfxUnmapWindowForSurface unmap,
@@ -2003,6 +2015,7 @@ BOOL gdi_graphics_pipeline_init_ex(rdpGdi* gdi, RdpgfxClientContext* gfx,
 	rdpSettings* settings = context->settings;
 
 	gdi->gfx = gfx;
+	gdi_graphics_pipeline_init_metrics(gdi);
 	gfx->custom = (void*)gdi;
 	gfx->ResetGraphics = gdi_ResetGraphics;
 	gfx->StartFrame = gdi_StartFrame;
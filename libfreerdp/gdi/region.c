@@ -26,6 +26,7 @@
 #include <stdlib.h>
 
 #include <winpr/wtypes.h>
+#include <winpr/assert.h>
 
 #include <freerdp/api.h>
 #include <freerdp/freerdp.h>
@@ -599,9 +600,50 @@ inline BOOL gdi_PtInRect(const GDI_RECT* rc, INT32 x, INT32 y)
 	return FALSE;
 }
 
+/** merge \b src into \b dst if their bounding box is not much larger than their union
+ *
+ *  Adjacent rectangles of the same height or width and rectangles covering each other merge
+ *  without any overhead, small gaps or overhangs (up to 1/4 of the union) are accepted to
+ *  keep the number of tracked rectangles low.
+ */
+static BOOL gdi_InvalidateMerge(GDI_RGN* dst, const GDI_RGN* src)
+{
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(src);
+
+	const INT64 dstRight = 1LL * dst->x + dst->w;
+	const INT64 dstBottom = 1LL * dst->y + dst->h;
+	const INT64 srcRight = 1LL * src->x + src->w;
+	const INT64 srcBottom = 1LL * src->y + src->h;
+
+	const INT64 left = MIN(dst->x, src->x);
+	const INT64 top = MIN(dst->y, src->y);
+	const INT64 right = MAX(dstRight, srcRight);
+	const INT64 bottom = MAX(dstBottom, srcBottom);
+
+	const INT64 ow = MIN(dstRight, srcRight) - MAX(dst->x, src->x);
+	const INT64 oh = MIN(dstBottom, srcBottom) - MAX(dst->y, src->y);
+	const INT64 overlap = ((ow > 0) && (oh > 0)) ? ow * oh : 0;
+	const INT64 area = 1LL * dst->w * dst->h + 1LL * src->w * src->h - overlap;
+	const INT64 bbox = (right - left) * (bottom - top);
+
+	if (bbox * 4 > area * 5)
+		return FALSE;
+
+	dst->x = (INT32)left;
+	dst->y = (INT32)top;
+	dst->w = (INT32)(right - left);
+	dst->h = (INT32)(bottom - top);
+	return TRUE;
+}
+
 /**
  * Invalidate a given region, such that it is redrawn on the next region update.
  * msdn{dd145003}
+ *
+ * Overlapping and adjacent rectangles are merged with the tracked ones. Once
+ * hwnd->count rectangles are tracked they are replaced by their bounding box.
+ *
  * @param hdc device context
  * @param x x1
  * @param y y1
@@ -624,28 +666,15 @@ inline BOOL gdi_InvalidateRegion(HGDI_DC hdc, INT32 x, INT32 y, INT32 w, INT32 h
 	if (w == 0 || h == 0)
 		return TRUE;
 
-	GDI_RGN* cinvalid = hdc->hwnd->cinvalid;
-
-	if ((hdc->hwnd->ninvalid + 1) > (INT64)hdc->hwnd->count)
-	{
-		GDI_RGN* new_rgn = nullptr;
-		size_t new_cnt = 2ULL * hdc->hwnd->count;
-		if (new_cnt > UINT32_MAX)
-			return FALSE;
-
-		new_rgn = (GDI_RGN*)realloc(cinvalid, sizeof(GDI_RGN) * new_cnt);
-
-		if (!new_rgn)
-			return FALSE;
-
-		hdc->hwnd->count = (UINT32)new_cnt;
-		cinvalid = new_rgn;
-	}
+	HGDI_WND hwnd = hdc->hwnd;
+	GDI_RGN* cinvalid = hwnd->cinvalid;
+	GDI_RGN* invalid = hwnd->invalid;
 
-	hdc->hwnd->cinvalid = cinvalid;
-	GDI_RGN* invalid = hdc->hwnd->invalid;
+	if (!cinvalid || (hwnd->count == 0))
+		return FALSE;
 
-	if (!gdi_SetRgn(&cinvalid[hdc->hwnd->ninvalid++], x, y, w, h))
+	GDI_RGN cur = WINPR_C_ARRAY_INIT;
+	if (!gdi_SetRgn(&cur, x, y, w, h))
 		return FALSE;
 
 	if (!gdi_CRgnToRect(x, y, w, h, &rgn))
@@ -658,6 +687,23 @@ inline BOOL gdi_InvalidateRegion(HGDI_DC hdc, INT32 x, INT32 y, INT32 w, INT32 h
 		return TRUE;
 	}
 
+	/* a merged rectangle grows and might now merge with rectangles it was disjoint from */
+	BOOL merged = FALSE;
+	do
+	{
+		merged = FALSE;
+		for (INT32 i = 0; i < hwnd->ninvalid;)
+		{
+			if (gdi_InvalidateMerge(&cur, &cinvalid[i]))
+			{
+				cinvalid[i] = cinvalid[--hwnd->ninvalid];
+				merged = TRUE;
+			}
+			else
+				i++;
+		}
+	} while (merged);
+
 	if (invalid->null)
 	{
 		invalid->x = x;
@@ -665,23 +711,35 @@ inline BOOL gdi_InvalidateRegion(HGDI_DC hdc, INT32 x, INT32 y, INT32 w, INT32 h
 		invalid->w = w;
 		invalid->h = h;
 		invalid->null = FALSE;
-		return TRUE;
 	}
+	else
+	{
+		if (!gdi_RgnToRect(invalid, &inv))
+			return FALSE;
 
-	if (!gdi_RgnToRect(invalid, &inv))
-		return FALSE;
+		if (rgn.left < inv.left)
+			inv.left = rgn.left;
 
-	if (rgn.left < inv.left)
-		inv.left = rgn.left;
+		if (rgn.top < inv.top)
+			inv.top = rgn.top;
 
-	if (rgn.top < inv.top)
-		inv.top = rgn.top;
+		if (rgn.right > inv.right)
+			inv.right = rgn.right;
 
-	if (rgn.right > inv.right)
-		inv.right = rgn.right;
+		if (rgn.bottom > inv.bottom)
+			inv.bottom = rgn.bottom;
+
+		if (!gdi_RectToRgn(&inv, invalid))
+			return FALSE;
+	}
 
-	if (rgn.bottom > inv.bottom)
-		inv.bottom = rgn.bottom;
+	/* too fragmented, fall back to the bounding box */
+	if ((UINT32)hwnd->ninvalid >= hwnd->count)
+	{
+		hwnd->ninvalid = 0;
+		cur = *invalid;
+	}
 
-	return gdi_RectToRgn(&inv, invalid);
+	cinvalid[hwnd->ninvalid++] = cur;
+	return TRUE;
 }
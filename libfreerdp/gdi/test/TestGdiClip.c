@@ -337,6 +337,22 @@ static int test_gdi_InvalidateRegion(void)
 	if (!gdi_EqualRgn(invalid, rgn2))
 		goto fail;
 
+	/* adjacent rectangles are merged */
+	invalid->null = TRUE;
+	hdc->hwnd->ninvalid = 0;
+	gdi_InvalidateRegion(hdc, 0, 0, 10, 10);
+	gdi_InvalidateRegion(hdc, 10, 0, 10, 10);
+	gdi_SetRgn(rgn2, 0, 0, 20, 10);
+
+	if ((hdc->hwnd->ninvalid != 1) || !gdi_EqualRgn(&hdc->hwnd->cinvalid[0], rgn2))
+		goto fail;
+
+	/* disjoint rectangles are kept separate */
+	gdi_InvalidateRegion(hdc, 500, 500, 10, 10);
+
+	if (hdc->hwnd->ninvalid != 2)
+		goto fail;
+
 	rc = 0;
 fail:
 	gdi_DeleteObject((HGDIOBJECT)rgn1);
@@ -346,6 +362,83 @@ fail:
 	return rc;
 }
 
+/* Disjoint rectangles are tracked up to the limit, one more collapses them to the bounding box */
+static int test_gdi_InvalidateRegion_collapse(void)
+{
+	int rc = -1;
+	HGDI_DC hdc = nullptr;
+	HGDI_RGN rgn = gdi_CreateRectRgn(0, 0, 0, 0);
+	rdpSettings* settings = freerdp_settings_new(0);
+
+	if (!rgn || !settings || !(hdc = gdi_CreateDC(PIXEL_FORMAT_XRGB32)))
+		goto fail;
+
+	/* device contexts without settings use the default limit */
+	const UINT32 limit = freerdp_settings_get_uint32(settings, FreeRDP_GdiInvalidRectLimit);
+	if (hdc->hwnd->count != limit)
+	{
+		(void)fprintf(stderr, "limit %" PRIu32 ", expected %" PRIu32 "\n", hdc->hwnd->count,
+		              limit);
+		goto fail;
+	}
+
+	for (UINT32 i = 0; i < limit; i++)
+	{
+		const INT32 x = WINPR_ASSERTING_INT_CAST(INT32, (i % 8) * 100);
+		const INT32 y = WINPR_ASSERTING_INT_CAST(INT32, (i / 8) * 50);
+		if (!gdi_InvalidateRegion(hdc, x, y, 5, 5))
+			goto fail;
+	}
+
+	if ((UINT32)hdc->hwnd->ninvalid != limit)
+		goto fail;
+
+	for (UINT32 i = 0; i < limit; i++)
+	{
+		const INT32 x = WINPR_ASSERTING_INT_CAST(INT32, (i % 8) * 100);
+		const INT32 y = WINPR_ASSERTING_INT_CAST(INT32, (i / 8) * 50);
+		if (!gdi_SetRgn(rgn, x, y, 5, 5))
+			goto fail;
+
+		BOOL found = FALSE;
+		for (INT32 j = 0; j < hdc->hwnd->ninvalid; j++)
+			found |= gdi_EqualRgn(&hdc->hwnd->cinvalid[j], rgn);
+		if (!found)
+		{
+			(void)fprintf(stderr, "rectangle %" PRIu32 " is not tracked\n", i);
+			goto fail;
+		}
+	}
+
+	if (!gdi_InvalidateRegion(hdc, 2000, 1000, 10, 10))
+		goto fail;
+
+	const INT32 bottom = WINPR_ASSERTING_INT_CAST(INT32, ((limit - 1) / 8) * 50 + 5);
+	if (!gdi_SetRgn(rgn, 0, 0, 2010, MAX(bottom, 1010)))
+		goto fail;
+
+	if ((hdc->hwnd->ninvalid != 1) || !gdi_EqualRgn(&hdc->hwnd->cinvalid[0], rgn) ||
+	    !gdi_EqualRgn(hdc->hwnd->invalid, rgn))
+	{
+		(void)fprintf(stderr, "%" PRId32 " rectangles after the collapse, first %" PRId32
+		                      "x%" PRId32 "\n",
+		              hdc->hwnd->ninvalid, hdc->hwnd->cinvalid[0].w, hdc->hwnd->cinvalid[0].h);
+		goto fail;
+	}
+
+	/* the collapsed box keeps absorbing damage instead of fragmenting again */
+	if (!gdi_InvalidateRegion(hdc, 5, 5, 20, 20) || (hdc->hwnd->ninvalid != 1) ||
+	    !gdi_EqualRgn(&hdc->hwnd->cinvalid[0], rgn))
+		goto fail;
+
+	rc = 0;
+fail:
+	gdi_DeleteObject((HGDIOBJECT)rgn);
+	gdi_DeleteDC(hdc);
+	freerdp_settings_free(settings);
+	return rc;
+}
+
 int TestGdiClip(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -360,5 +453,10 @@ int TestGdiClip(int argc, char* argv[])
 	if (test_gdi_InvalidateRegion() < 0)
 		return -1;
 
+	(void)fprintf(stderr, "test_gdi_InvalidateRegion_collapse()\n");
+
+	if (test_gdi_InvalidateRegion_collapse() < 0)
+		return -1;
+
 	return 0;
 }
@@ -573,4 +573,7 @@ void primitives_init_colors_opt(primitives_t* WINPR_RESTRICT prims)
 	primitives_init_colors(prims);
 	primitives_init_colors_sse2(prims);
 	primitives_init_colors_neon(prims);
+#if defined(WITH_AVX2)
+	primitives_init_colors_avx2(prims);
+#endif
 }
@@ -0,0 +1,171 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Optimized Color conversion operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_colors.h"
+
+#include "prim_internal.h"
+#include "prim_colors_sse2.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <immintrin.h>
+
+static primitives_t* generic = nullptr;
+
+static inline __m256i mm256_between_epi16(__m256i val, __m256i min, __m256i max)
+{
+	return _mm256_min_epi16(max, _mm256_max_epi16(val, min));
+}
+
+/* Converts 16 pixels, the channels are returned clipped to [0, 255] */
+static inline void avx2_yCbCrToRGB_16px(const INT16* WINPR_RESTRICT y_buf,
+                                        const INT16* WINPR_RESTRICT cb_buf,
+                                        const INT16* WINPR_RESTRICT cr_buf,
+                                        __m256i* WINPR_RESTRICT r, __m256i* WINPR_RESTRICT g,
+                                        __m256i* WINPR_RESTRICT b)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi16(255);
+	const __m256i cb = _mm256_loadu_si256((const __m256i*)cb_buf);
+	const __m256i cr = _mm256_loadu_si256((const __m256i*)cr_buf);
+
+	/* y = (y + 4096) >> 2, then see sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX for the HIWORD trick */
+	__m256i y = _mm256_loadu_si256((const __m256i*)y_buf);
+	y = _mm256_srai_epi16(_mm256_add_epi16(y, _mm256_set1_epi16(4096)), 2);
+
+	__m256i rv = _mm256_add_epi16(y, _mm256_mulhi_epi16(cr, _mm256_set1_epi16(YCBCR_R_CR)));
+	*r = mm256_between_epi16(_mm256_srai_epi16(rv, 3), zero, max);
+
+	__m256i gv = _mm256_add_epi16(y, _mm256_mulhi_epi16(cb, _mm256_set1_epi16(YCBCR_G_CB)));
+	gv = _mm256_add_epi16(gv, _mm256_mulhi_epi16(cr, _mm256_set1_epi16(YCBCR_G_CR)));
+	*g = mm256_between_epi16(_mm256_srai_epi16(gv, 3), zero, max);
+
+	__m256i bv = _mm256_add_epi16(y, _mm256_mulhi_epi16(cb, _mm256_set1_epi16(YCBCR_B_CB)));
+	*b = mm256_between_epi16(_mm256_srai_epi16(bv, 3), zero, max);
+}
+
+/* lo holds the first and hi the last two bytes of each pixel as 16 bit words. The unpacks work
+ * per 128 bit lane, the permutes put the 16 pixels back in order. */
+static inline void avx2_store_16px(BYTE* WINPR_RESTRICT dst, __m256i lo, __m256i hi)
+{
+	const __m256i p0 = _mm256_unpacklo_epi16(lo, hi); /* pixels 0-3, 8-11 */
+	const __m256i p1 = _mm256_unpackhi_epi16(lo, hi); /* pixels 4-7, 12-15 */
+	_mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(p0, p1, 0x20));
+	_mm256_storeu_si256((__m256i*)&dst[32], _mm256_permute2x128_si256(p0, p1, 0x31));
+}
+
+static pstatus_t avx2_yCbCrToRGB_16s8u_P3AC4R_X(const INT16* WINPR_RESTRICT pSrc[3],
+                                                UINT32 srcStep, BYTE* WINPR_RESTRICT pDst,
+                                                UINT32 dstStep,
+                                                const prim_size_t* WINPR_RESTRICT roi, BOOL bgr)
+{
+	const __m256i alpha = _mm256_set1_epi16((INT16)0xFF00);
+	const UINT32 pad = roi->width % 16;
+	const UINT32 width = roi->width - pad;
+
+	for (UINT32 yp = 0; yp < roi->height; ++yp)
+	{
+		const INT16* y_buf = (const INT16*)((const BYTE*)pSrc[0] + 1ULL * yp * srcStep);
+		const INT16* cb_buf = (const INT16*)((const BYTE*)pSrc[1] + 1ULL * yp * srcStep);
+		const INT16* cr_buf = (const INT16*)((const BYTE*)pSrc[2] + 1ULL * yp * srcStep);
+		BYTE* d_buf = &pDst[1ULL * yp * dstStep];
+
+		for (UINT32 x = 0; x < width; x += 16)
+		{
+			__m256i r;
+			__m256i g;
+			__m256i b;
+			avx2_yCbCrToRGB_16px(&y_buf[x], &cb_buf[x], &cr_buf[x], &r, &g, &b);
+
+			const __m256i g8 = _mm256_slli_epi16(g, 8);
+			const __m256i first = bgr ? b : r;
+			const __m256i third = bgr ? r : b;
+			avx2_store_16px(&d_buf[4ULL * x], _mm256_or_si256(first, g8),
+			                _mm256_or_si256(third, alpha));
+		}
+
+		/* The caller passes a width that is a multiple of 8 */
+		if (pad > 0)
+		{
+			__m128i r;
+			__m128i g;
+			__m128i b;
+			sse2_yCbCrToRGB_8px(&y_buf[width], &cb_buf[width], &cr_buf[width], &r, &g, &b);
+			sse2_store_8px(&d_buf[4ULL * width], bgr ? b : r, g, bgr ? r : b);
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t
+avx2_yCbCrToRGB_16s8u_P3AC4R(const INT16* WINPR_RESTRICT pSrc[3], UINT32 srcStep,
+                             BYTE* WINPR_RESTRICT pDst, UINT32 dstStep, UINT32 DstFormat,
+                             const prim_size_t* WINPR_RESTRICT roi) /* region of interest */
+{
+	/* Same fallback conditions as the SSE2 implementation */
+	if (((ULONG_PTR)(pSrc[0]) & 0x0f) || ((ULONG_PTR)(pSrc[1]) & 0x0f) ||
+	    ((ULONG_PTR)(pSrc[2]) & 0x0f) || ((ULONG_PTR)(pDst) & 0x0f) || (srcStep & 0x0f) ||
+	    (dstStep & 0x0f))
+		return generic->yCbCrToRGB_16s8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+
+	/* Split the same way as the SSE2 implementation so both give identical pixels */
+	const UINT32 tail = roi->width % 8;
+	const prim_size_t simdRoi = { roi->width - tail, roi->height };
+	pstatus_t status = PRIMITIVES_SUCCESS;
+
+	switch (DstFormat)
+	{
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			status = avx2_yCbCrToRGB_16s8u_P3AC4R_X(pSrc, srcStep, pDst, dstStep, &simdRoi, TRUE);
+			break;
+
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			status = avx2_yCbCrToRGB_16s8u_P3AC4R_X(pSrc, srcStep, pDst, dstStep, &simdRoi, FALSE);
+			break;
+
+		default:
+			return generic->yCbCrToRGB_16s8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+	}
+
+	if ((status != PRIMITIVES_SUCCESS) || (tail == 0))
+		return status;
+
+	const INT16* pTail[3] = { &pSrc[0][simdRoi.width], &pSrc[1][simdRoi.width],
+		                      &pSrc[2][simdRoi.width] };
+	const prim_size_t tailRoi = { tail, roi->height };
+	return generic->yCbCrToRGB_16s8u_P3AC4R(pTail, srcStep, &pDst[4ULL * simdRoi.width], dstStep,
+	                                        DstFormat, &tailRoi);
+}
+#endif
+
+void primitives_init_colors_avx2_int(primitives_t* WINPR_RESTRICT prims)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	generic = primitives_get_generic();
+
+	WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+	prims->yCbCrToRGB_16s8u_P3AC4R = avx2_yCbCrToRGB_16s8u_P3AC4R;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or WITH_AVX2 or AVX2 intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
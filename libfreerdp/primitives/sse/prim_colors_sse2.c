@@ -27,6 +27,7 @@
 
 #include "prim_internal.h"
 #include "prim_templates.h"
+#include "prim_colors_sse2.h"
 
 #if defined(SSE_AVX_INTRINSICS_ENABLED)
 #include <emmintrin.h>
@@ -100,7 +101,7 @@ static inline void mm_prefetch_buffer(const void* WINPR_RESTRICT buffer, size_t
 /*---------------------------------------------------------------------------*/
 static pstatus_t
 sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX(const INT16* WINPR_RESTRICT pSrc[3],
-                                  WINPR_ATTR_UNUSED UINT32 srcStep, BYTE* WINPR_RESTRICT pDst,
+                                  UINT32 srcStep, BYTE* WINPR_RESTRICT pDst,
                                   UINT32 dstStep,
                                   const prim_size_t* WINPR_RESTRICT roi) /* region of interest */
 {
@@ -122,7 +123,6 @@ sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX(const INT16* WINPR_RESTRICT pSrc[3],
 	const UINT32 step = sizeof(__m128i) / sizeof(INT16);
 	const size_t imax = (roi->width - pad) * sizeof(INT16) / sizeof(__m128i);
 	BYTE* d_buf = pDst;
-	const size_t dstPad = (dstStep - roi->width * 4);
 
 	mm_prefetch_buffer(y_buf, roi->width, (size_t)srcStep, roi->height);
 	mm_prefetch_buffer(cr_buf, roi->width, (size_t)srcStep, roi->height);
@@ -130,6 +130,11 @@ sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX(const INT16* WINPR_RESTRICT pSrc[3],
 
 	for (UINT32 yp = 0; yp < roi->height; ++yp)
 	{
+		y_buf = (const INT16*)((const BYTE*)pSrc[0] + 1ULL * yp * srcStep);
+		cb_buf = (const INT16*)((const BYTE*)pSrc[1] + 1ULL * yp * srcStep);
+		cr_buf = (const INT16*)((const BYTE*)pSrc[2] + 1ULL * yp * srcStep);
+		d_buf = &pDst[1ULL * yp * dstStep];
+
 		for (size_t i = 0; i < imax; i += 2)
 		{
 			/* In order to use SSE2 signed 16-bit integer multiplication
@@ -241,26 +246,15 @@ sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX(const INT16* WINPR_RESTRICT pSrc[3],
 			}
 		}
 
-		for (UINT32 i = 0; i < pad; i++)
+		/* The caller passes a width that is a multiple of 8 */
+		if (pad > 0)
 		{
-			const INT32 divisor = 16;
-			const INT32 Y = ((*y_buf++) + 4096) << divisor;
-			const INT32 Cb = (*cb_buf++);
-			const INT32 Cr = (*cr_buf++);
-			const INT32 CrR = Cr * ycbcr_table[divisor][0];
-			const INT32 CrG = Cr * ycbcr_table[divisor][1];
-			const INT32 CbG = Cb * ycbcr_table[divisor][2];
-			const INT32 CbB = Cb * ycbcr_table[divisor][3];
-			const INT16 R = WINPR_ASSERTING_INT_CAST(int16_t, (((CrR + Y) >> divisor) >> 5));
-			const INT16 G = WINPR_ASSERTING_INT_CAST(int16_t, (((Y - CbG - CrG) >> divisor) >> 5));
-			const INT16 B = WINPR_ASSERTING_INT_CAST(int16_t, (((CbB + Y) >> divisor) >> 5));
-			*d_buf++ = CLIP(B);
-			*d_buf++ = CLIP(G);
-			*d_buf++ = CLIP(R);
-			*d_buf++ = 0xFF;
+			__m128i r;
+			__m128i g;
+			__m128i b;
+			sse2_yCbCrToRGB_8px(y_buf, cb_buf, cr_buf, &r, &g, &b);
+			sse2_store_8px(d_buf, b, g, r);
 		}
-
-		d_buf += dstPad;
 	}
 
 	return PRIMITIVES_SUCCESS;
@@ -269,7 +263,7 @@ sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX(const INT16* WINPR_RESTRICT pSrc[3],
 /*---------------------------------------------------------------------------*/
 static pstatus_t
 sse2_yCbCrToRGB_16s8u_P3AC4R_RGBX(const INT16* WINPR_RESTRICT pSrc[3],
-                                  WINPR_ATTR_UNUSED UINT32 srcStep, BYTE* WINPR_RESTRICT pDst,
+                                  UINT32 srcStep, BYTE* WINPR_RESTRICT pDst,
                                   UINT32 dstStep,
                                   const prim_size_t* WINPR_RESTRICT roi) /* region of interest */
 {
@@ -291,7 +285,6 @@ sse2_yCbCrToRGB_16s8u_P3AC4R_RGBX(const INT16* WINPR_RESTRICT pSrc[3],
 	const UINT32 step = sizeof(__m128i) / sizeof(INT16);
 	const size_t imax = (roi->width - pad) * sizeof(INT16) / sizeof(__m128i);
 	BYTE* d_buf = pDst;
-	const size_t dstPad = (dstStep - roi->width * 4);
 
 	mm_prefetch_buffer(y_buf, roi->width, (size_t)srcStep, roi->height);
 	mm_prefetch_buffer(cb_buf, roi->width, (size_t)srcStep, roi->height);
@@ -299,6 +292,11 @@ sse2_yCbCrToRGB_16s8u_P3AC4R_RGBX(const INT16* WINPR_RESTRICT pSrc[3],
 
 	for (UINT32 yp = 0; yp < roi->height; ++yp)
 	{
+		y_buf = (const INT16*)((const BYTE*)pSrc[0] + 1ULL * yp * srcStep);
+		cb_buf = (const INT16*)((const BYTE*)pSrc[1] + 1ULL * yp * srcStep);
+		cr_buf = (const INT16*)((const BYTE*)pSrc[2] + 1ULL * yp * srcStep);
+		d_buf = &pDst[1ULL * yp * dstStep];
+
 		for (size_t i = 0; i < imax; i += 2)
 		{
 			/* In order to use SSE2 signed 16-bit integer multiplication
@@ -410,26 +408,15 @@ sse2_yCbCrToRGB_16s8u_P3AC4R_RGBX(const INT16* WINPR_RESTRICT pSrc[3],
 			}
 		}
 
-		for (UINT32 i = 0; i < pad; i++)
+		/* The caller passes a width that is a multiple of 8 */
+		if (pad > 0)
 		{
-			const INT32 divisor = 16;
-			const INT32 Y = ((*y_buf++) + 4096) << divisor;
-			const INT32 Cb = (*cb_buf++);
-			const INT32 Cr = (*cr_buf++);
-			const INT32 CrR = Cr * ycbcr_table[divisor][0];
-			const INT32 CrG = Cr * ycbcr_table[divisor][1];
-			const INT32 CbG = Cb * ycbcr_table[divisor][2];
-			const INT32 CbB = Cb * ycbcr_table[divisor][3];
-			const INT16 R = WINPR_ASSERTING_INT_CAST(int16_t, (((CrR + Y) >> divisor) >> 5));
-			const INT16 G = WINPR_ASSERTING_INT_CAST(int16_t, (((Y - CbG - CrG) >> divisor) >> 5));
-			const INT16 B = WINPR_ASSERTING_INT_CAST(int16_t, (((CbB + Y) >> divisor) >> 5));
-			*d_buf++ = CLIP(R);
-			*d_buf++ = CLIP(G);
-			*d_buf++ = CLIP(B);
-			*d_buf++ = 0xFF;
+			__m128i r;
+			__m128i g;
+			__m128i b;
+			sse2_yCbCrToRGB_8px(y_buf, cb_buf, cr_buf, &r, &g, &b);
+			sse2_store_8px(d_buf, r, g, b);
 		}
-
-		d_buf += dstPad;
 	}
 
 	return PRIMITIVES_SUCCESS;
@@ -448,19 +435,35 @@ sse2_yCbCrToRGB_16s8u_P3AC4R(const INT16* WINPR_RESTRICT pSrc[3], UINT32 srcStep
 		return generic->yCbCrToRGB_16s8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
 	}
 
+	/* Lines are converted 8 pixels at a time, the last width % 8 pixels by the generic code. */
+	const UINT32 tail = roi->width % 8;
+	const prim_size_t simdRoi = { roi->width - tail, roi->height };
+	pstatus_t status = PRIMITIVES_SUCCESS;
+
 	switch (DstFormat)
 	{
 		case PIXEL_FORMAT_BGRA32:
 		case PIXEL_FORMAT_BGRX32:
-			return sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX(pSrc, srcStep, pDst, dstStep, roi);
+			status = sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX(pSrc, srcStep, pDst, dstStep, &simdRoi);
+			break;
 
 		case PIXEL_FORMAT_RGBA32:
 		case PIXEL_FORMAT_RGBX32:
-			return sse2_yCbCrToRGB_16s8u_P3AC4R_RGBX(pSrc, srcStep, pDst, dstStep, roi);
+			status = sse2_yCbCrToRGB_16s8u_P3AC4R_RGBX(pSrc, srcStep, pDst, dstStep, &simdRoi);
+			break;
 
 		default:
 			return generic->yCbCrToRGB_16s8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
 	}
+
+	if ((status != PRIMITIVES_SUCCESS) || (tail == 0))
+		return status;
+
+	const INT16* pTail[3] = { &pSrc[0][simdRoi.width], &pSrc[1][simdRoi.width],
+		                      &pSrc[2][simdRoi.width] };
+	const prim_size_t tailRoi = { tail, roi->height };
+	return generic->yCbCrToRGB_16s8u_P3AC4R(pTail, srcStep, &pDst[4ULL * simdRoi.width], dstStep,
+	                                        DstFormat, &tailRoi);
 }
 /* The encodec YCbCr coeffectients are represented as 11.5 fixed-point
  * numbers. See the general code above.
@@ -0,0 +1,67 @@
+/* FreeRDP: A Remote Desktop Protocol Client
+ * Optimized Color conversion operations.
+ * vi:ts=4 sw=4:
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may
+ * not use this file except in compliance with the License. You may obtain
+ * a copy of the License at http://www.apache.org/licenses/LICENSE-2.0.
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+#pragma once
+
+#include <freerdp/types.h>
+
+#include "prim_avxsse.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+/* 1.403, -0.344, -0.714 and 1.770 scaled by 2^14, see sse2_yCbCrToRGB_16s8u_P3AC4R_BGRX for
+ * how they are applied with a 16 bit multiply high */
+#define YCBCR_R_CR 22987
+#define YCBCR_G_CB (-5636)
+#define YCBCR_G_CR (-11698)
+#define YCBCR_B_CB 29000
+
+/* Converts 8 pixels, the channels are returned clipped to [0, 255]. The SSE2 and AVX2
+ * implementations use this for the last 8 pixels of a line so that both give the same result
+ * for any width. */
+static inline void sse2_yCbCrToRGB_8px(const INT16* WINPR_RESTRICT y_buf,
+                                       const INT16* WINPR_RESTRICT cb_buf,
+                                       const INT16* WINPR_RESTRICT cr_buf,
+                                       __m128i* WINPR_RESTRICT r, __m128i* WINPR_RESTRICT g,
+                                       __m128i* WINPR_RESTRICT b)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(255);
+	const __m128i cb = LOAD_SI128(cb_buf);
+	const __m128i cr = LOAD_SI128(cr_buf);
+
+	__m128i y = LOAD_SI128(y_buf);
+	y = _mm_srai_epi16(_mm_add_epi16(y, _mm_set1_epi16(4096)), 2);
+
+	const __m128i rv = _mm_add_epi16(y, _mm_mulhi_epi16(cr, _mm_set1_epi16(YCBCR_R_CR)));
+	*r = _mm_min_epi16(max, _mm_max_epi16(_mm_srai_epi16(rv, 3), zero));
+
+	__m128i gv = _mm_add_epi16(y, _mm_mulhi_epi16(cb, _mm_set1_epi16(YCBCR_G_CB)));
+	gv = _mm_add_epi16(gv, _mm_mulhi_epi16(cr, _mm_set1_epi16(YCBCR_G_CR)));
+	*g = _mm_min_epi16(max, _mm_max_epi16(_mm_srai_epi16(gv, 3), zero));
+
+	const __m128i bv = _mm_add_epi16(y, _mm_mulhi_epi16(cb, _mm_set1_epi16(YCBCR_B_CB)));
+	*b = _mm_min_epi16(max, _mm_max_epi16(_mm_srai_epi16(bv, 3), zero));
+}
+
+/* Stores 8 pixels of 4 bytes, first, g and third are the channels in memory order */
+static inline void sse2_store_8px(BYTE* WINPR_RESTRICT dst, __m128i first, __m128i g,
+                                  __m128i third)
+{
+	const __m128i lo = _mm_or_si128(first, _mm_slli_epi16(g, 8));
+	const __m128i hi = _mm_or_si128(third, _mm_set1_epi16((INT16)0xFF00));
+	STORE_SI128(dst, _mm_unpacklo_epi16(lo, hi));
+	STORE_SI128(&dst[16], _mm_unpackhi_epi16(lo, hi));
+}
+#endif
@@ -8,6 +8,10 @@
 
 #include <freerdp/config.h>
 
+#if defined(BUILD_TESTING_INTERNAL) && defined(WITH_SIMD) && defined(WITH_AVX2)
+#include "prim_colors.h"
+#endif
+
 #define TAG __FILE__
 
 static const INT16 TEST_Y_COMPONENT[4096] = {
@@ -1724,6 +1728,83 @@ fail:
 	return status;
 }
 
+#if defined(BUILD_TESTING_INTERNAL) && defined(WITH_SIMD) && defined(WITH_AVX2)
+/* The SSE2 and AVX2 implementations must produce the same pixels for every width */
+static BOOL test_YCbCr_sse2_avx2(void)
+{
+	const UINT32 formats[] = { PIXEL_FORMAT_BGRX32, PIXEL_FORMAT_RGBX32 };
+	const UINT32 height = 4;
+	const UINT32 srcStep = 128 * sizeof(INT16);
+	const UINT32 dstStep = 128 * 4;
+	BOOL rc = FALSE;
+	INT16* src[3] = WINPR_C_ARRAY_INIT;
+	BYTE* dstSse2 = winpr_aligned_malloc(1ULL * dstStep * height, 16);
+	BYTE* dstAvx2 = winpr_aligned_malloc(1ULL * dstStep * height, 16);
+	primitives_t sse2 = *primitives_get_generic();
+	primitives_t avx2 = *primitives_get_generic();
+
+	if (!IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE) ||
+	    !IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+	{
+		rc = TRUE;
+		goto fail;
+	}
+
+	primitives_init_colors_sse2_int(&sse2);
+	primitives_init_colors_avx2_int(&avx2);
+
+	if (!dstSse2 || !dstAvx2)
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(src); x++)
+	{
+		src[x] = winpr_aligned_malloc(1ULL * srcStep * height, 16);
+		if (!src[x])
+			goto fail;
+		if (winpr_RAND(src[x], 1ULL * srcStep * height) < 0)
+			goto fail;
+
+		/* Keep the values in the range the RFX decoder produces */
+		for (size_t y = 0; y < 1ULL * srcStep * height / sizeof(INT16); y++)
+			src[x][y] = (INT16)(src[x][y] % 4096);
+	}
+
+	for (size_t f = 0; f < ARRAYSIZE(formats); f++)
+	{
+		for (UINT32 width = 1; width <= 128; width++)
+		{
+			const INT16* pSrc[3] = { src[0], src[1], src[2] };
+			const prim_size_t roi = { width, height };
+
+			memset(dstSse2, 0, 1ULL * dstStep * height);
+			memset(dstAvx2, 0, 1ULL * dstStep * height);
+
+			if (sse2.yCbCrToRGB_16s8u_P3AC4R(pSrc, srcStep, dstSse2, dstStep, formats[f], &roi) !=
+			    PRIMITIVES_SUCCESS)
+				goto fail;
+			if (avx2.yCbCrToRGB_16s8u_P3AC4R(pSrc, srcStep, dstAvx2, dstStep, formats[f], &roi) !=
+			    PRIMITIVES_SUCCESS)
+				goto fail;
+
+			if (memcmp(dstSse2, dstAvx2, 1ULL * dstStep * height) != 0)
+			{
+				(void)fprintf(stderr, "SSE2 and AVX2 differ for %s, width %" PRIu32 "\n",
+				              FreeRDPGetColorFormatName(formats[f]), width);
+				goto fail;
+			}
+		}
+	}
+
+	rc = TRUE;
+fail:
+	for (size_t x = 0; x < ARRAYSIZE(src); x++)
+		winpr_aligned_free(src[x]);
+	winpr_aligned_free(dstSse2);
+	winpr_aligned_free(dstAvx2);
+	return rc;
+}
+#endif
+
 int TestPrimitivesYCbCr(int argc, char* argv[])
 {
 	const UINT32 formats[] = { PIXEL_FORMAT_XRGB32, PIXEL_FORMAT_XBGR32, PIXEL_FORMAT_ARGB32,
@@ -1736,6 +1817,10 @@ int TestPrimitivesYCbCr(int argc, char* argv[])
 
 	if (argc < 2)
 	{
+#if defined(BUILD_TESTING_INTERNAL) && defined(WITH_SIMD) && defined(WITH_AVX2)
+		if (!test_YCbCr_sse2_avx2())
+			return -1;
+#endif
 		{
 			/* Do content comparison. */
 			for (UINT32 x = 0; x < sizeof(formats) / sizeof(formats[0]); x++)
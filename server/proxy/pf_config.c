@@ -70,6 +70,7 @@ static const char* section_server = "Server";
 static const char* key_host = "Host";
 static const char* key_port = "Port";
 static const char* key_sam_file = "SamFile";
+static const char* key_metrics_port = "MetricsPort";
 
 static const char* section_target = "Target";
 static const char* key_target_fixed = "FixedTarget";
@@ -289,6 +290,9 @@ static BOOL pf_config_load_server(wIniFile* ini, proxyConfig* config)
 	if (!pf_config_get_uint16(ini, section_server, key_port, &config->Port, FALSE))
 		return FALSE;
 
+	if (!pf_config_get_uint16(ini, section_server, key_metrics_port, &config->MetricsPort, FALSE))
+		return FALSE;
+
 	const char* sam = pf_config_get_str(ini, section_server, key_sam_file, FALSE);
 	if (sam)
 	{
@@ -953,6 +957,7 @@ void pf_server_config_print(const proxyConfig* config)
 	CONFIG_PRINT_STR(config, Host);
 	CONFIG_PRINT_STR(config, SamFile);
 	CONFIG_PRINT_UINT16(config, Port);
+	CONFIG_PRINT_UINT16(config, MetricsPort);
 
 	if (config->FixedTarget)
 	{
@@ -651,6 +651,9 @@ static DWORD WINAPI pf_server_handle_peer(LPVOID arg)
 	WINPR_ASSERT(ps);
 	PROXY_LOG_DBG(TAG, ps, "Added peer, %" PRIuz " connected", count);
 
+	if (!ArrayList_Append(server->sessions, ps))
+		goto out_free_peer;
+
 	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_SESSION_INITIALIZE, pdata, client))
 		goto out_free_peer;
 
@@ -795,6 +798,8 @@ out_free_peer:
 		count = ArrayList_Count(server->peer_list);
 		ArrayList_Unlock(server->peer_list);
 	}
+	if (ps)
+		ArrayList_Remove(server->sessions, ps);
 	PROXY_LOG_DBG(TAG, ps, "Removed peer, %" PRIuz " connected", count);
 	freerdp_peer_context_free(client);
 	freerdp_peer_free(client);
@@ -855,6 +860,67 @@ static BOOL pf_server_peer_accepted(freerdp_listener* listener, freerdp_peer* cl
 	return pf_server_start_peer(client);
 }
 
+WINPR_ATTR_NODISCARD
+static char* pf_server_export_metrics(void* arg, size_t* plength)
+{
+	proxyServer* server = arg;
+	char* text = nullptr;
+
+	WINPR_ASSERT(server);
+
+	/* Sessions leave the list before their context is freed */
+	ArrayList_Lock(server->sessions);
+	const size_t count = ArrayList_Count(server->sessions);
+	rdpMetrics** metrics = calloc(count + 1, sizeof(rdpMetrics*));
+	char** labels = calloc(count + 1, sizeof(char*));
+	if (!metrics || !labels)
+		goto fail;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const pServerContext* ps = ArrayList_GetItem(server->sessions, x);
+		const freerdp_peer* peer = ps->context.peer;
+		size_t len = 0;
+
+		metrics[x] = ps->context.metrics;
+		if (winpr_asprintf(&labels[x], &len, "session=\"%s\",address=\"%s\"",
+		                   ps->pdata ? ps->pdata->session_id : "", peer ? peer->hostname : "") < 0)
+			goto fail;
+	}
+
+	text = metrics_to_openmetrics(metrics, (const char* const*)labels, count, plength);
+
+fail:
+	ArrayList_Unlock(server->sessions);
+	if (labels)
+	{
+		for (size_t x = 0; x < count; x++)
+			free(labels[x]);
+	}
+	free(labels);
+	free((void*)metrics);
+	return text;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL pf_server_start_metrics(proxyServer* server)
+{
+	WINPR_ASSERT(server);
+	WINPR_ASSERT(server->config);
+
+	if ((server->config->MetricsPort == 0) || server->metricsEndpoint)
+		return TRUE;
+
+	server->metricsEndpoint = metrics_endpoint_new(nullptr, server->config->MetricsPort,
+	                                               pf_server_export_metrics, server);
+	if (!server->metricsEndpoint)
+	{
+		WLog_ERR(TAG, "failed to serve metrics on port %" PRIu16, server->config->MetricsPort);
+		return FALSE;
+	}
+	return TRUE;
+}
+
 BOOL pf_server_start(proxyServer* server)
 {
 	WSADATA wsaData;
@@ -891,6 +957,9 @@ BOOL pf_server_start(proxyServer* server)
 		goto error;
 	}
 
+	if (!pf_server_start_metrics(server))
+		goto error;
+
 	return TRUE;
 
 error:
@@ -933,6 +1002,9 @@ BOOL pf_server_start_from_socket(proxyServer* server, int socket)
 		goto error;
 	}
 
+	if (!pf_server_start_metrics(server))
+		goto error;
+
 	return TRUE;
 
 error:
@@ -1037,6 +1109,10 @@ proxyServer* pf_server_new(const proxyConfig* config)
 	if (!server->peer_list)
 		goto out;
 
+	server->sessions = ArrayList_New(TRUE);
+	if (!server->sessions)
+		goto out;
+
 	obj = ArrayList_Object(server->peer_list);
 	WINPR_ASSERT(obj);
 
@@ -1144,6 +1220,8 @@ void pf_server_free(proxyServer* server)
 			Sleep(100);
 		}
 	}
+	metrics_endpoint_free(server->metricsEndpoint);
+	ArrayList_Free(server->sessions);
 	ArrayList_Free(server->peer_list);
 	freerdp_listener_free(server->listener);
 
@@ -26,6 +26,7 @@
 
 #include <winpr/collections.h>
 #include <freerdp/listener.h>
+#include <freerdp/metrics.h>
 
 #include <freerdp/server/proxy/proxy_config.h>
 #include <freerdp/server/proxy/proxy_context.h>
@@ -39,6 +40,8 @@ struct proxy_server
 	freerdp_listener* listener;
 	HANDLE stopEvent; /* an event used to signal the main thread to stop */
 	wArrayList* peer_list;
+	wArrayList* sessions; /* pServerContext of connected peers, exported as metrics */
+	rdpMetricsEndpoint* metricsEndpoint;
 };
 
 struct p_server_context
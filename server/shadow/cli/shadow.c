@@ -55,6 +55,8 @@ int main(int argc, char** argv)
 		  "Select or list monitors" },
 		{ "max-connections", COMMAND_LINE_VALUE_REQUIRED, "<number>", nullptr, nullptr, -1, nullptr,
 		  "maximum connections allowed to server, 0 to deactivate" },
+		{ "metrics-port", COMMAND_LINE_VALUE_REQUIRED, "<number>", nullptr, nullptr, -1, nullptr,
+		  "Serve session metrics in OpenMetrics format on localhost:<number>/metrics" },
 		{ "mouse-relative", COMMAND_LINE_VALUE_BOOL, nullptr, nullptr, nullptr, -1, nullptr,
 		  "enable support for relative mouse events" },
 		{ "rect", COMMAND_LINE_VALUE_REQUIRED, "<x,y,w,h>", nullptr, nullptr, -1, nullptr,
@@ -65,6 +67,10 @@ int main(int argc, char** argv)
 		  "Remote credential guard" },
 		{ "restricted-admin", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
 		  "Restricted Admin" },
+		{ "ktls", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueFalse, nullptr, -1, nullptr,
+		  "Kernel TLS offload (Linux only)" },
+		{ "tls-tickets", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueFalse, nullptr, -1, nullptr,
+		  "Resume TLS sessions with stateless session tickets" },
 		{ "vmconnect", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueFalse,
 		  nullptr, -1, nullptr, "Hyper-V console server (bind on vsock://1)" },
 		{ "may-view", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
@@ -25,12 +25,14 @@
 #include <winpr/cast.h>
 #include <winpr/file.h>
 #include <winpr/path.h>
+#include <winpr/pool.h>
 #include <winpr/synch.h>
 #include <winpr/thread.h>
 #include <winpr/sysinfo.h>
 #include <winpr/interlocked.h>
 
 #include <freerdp/log.h>
+#include <freerdp/metrics.h>
 #include <freerdp/utils/gfx.h>
 #include <freerdp/channels/drdynvc.h>
 
@@ -44,6 +46,17 @@ typedef struct
 	BOOL gfxSurfaceCreated;
 } SHADOW_GFX_STATUS;
 
+/* RDPGFX frames are encoded on the encode stage, see shadow_encode_stage.h */
+typedef struct
+{
+	rdpShadowClient* client;
+	SHADOW_GFX_STATUS* gfxstatus;
+	rdpShadowEncodeStage* stage;
+
+	BYTE* frame;
+	size_t frameSize;
+} SHADOW_ENCODE_STAGE;
+
 WINPR_ATTR_NODISCARD
 static BOOL shadow_avc420_enabled(const rdpShadowClient* client);
 WINPR_ATTR_NODISCARD
@@ -370,12 +383,9 @@ static inline void shadow_client_mark_invalid(rdpShadowClient* client, UINT32 nu
 	/* Mark client invalid region. No rectangle means full screen */
 	if (numRects > 0)
 	{
-		for (UINT32 index = 0; index < numRects; index++)
-		{
-			if (!region16_union_rect(&(client->invalidRegion), &(client->invalidRegion),
-			                         &rects[index]))
-				goto fail;
-		}
+		if (!region16_union_rects(&(client->invalidRegion), &(client->invalidRegion), rects,
+		                          numRects))
+			goto fail;
 	}
 	else
 	{
@@ -825,6 +835,7 @@ static inline void shadow_client_common_frame_acknowledge(rdpShadowClient* clien
 	WINPR_ASSERT(client);
 	WINPR_ASSERT(client->encoder);
 	client->encoder->lastAckframeId = frameId;
+	shadow_encoder_frame_acknowledged(client->encoder, frameId);
 }
 
 WINPR_ATTR_NODISCARD
@@ -1224,6 +1235,11 @@ static UINT shadow_client_rdpgfx_caps_advertise(RdpgfxServerContext* context,
 	return CHANNEL_RC_UNSUPPORTED_VERSION;
 }
 
+static void shadow_client_observe_encode(rdpMetric* metric, UINT64 start)
+{
+	metric_observe(metric, winpr_GetTickCount64NS() - start);
+}
+
 WINPR_ATTR_NODISCARD
 static inline UINT32 rdpgfx_estimate_h264_avc420(RDPGFX_AVC420_BITMAP_STREAM* havc420)
 {
@@ -1271,8 +1287,10 @@ static BOOL shadow_client_send_av1(rdpShadowClient* client, const BYTE* pSrcData
 	regionRect.top = (UINT16)cmd->top;
 	regionRect.right = (UINT16)cmd->right;
 	regionRect.bottom = (UINT16)cmd->bottom;
+	const UINT64 start = winpr_GetTickCount64NS();
 	rc = freerdp_av1_compress(encoder->av1, pSrcData, SrcFormat, nSrcStep, nWidth, nHeight,
 	                          &regionRect, &avc420.data, &avc420.length, &avc420.meta);
+	shadow_client_observe_encode(encoder->gfxEncode[RDPGFX_CODECID_AV1], start);
 	if (rc < 0)
 	{
 		WLog_ERR(TAG, "freerdp_av1_compress failed");
@@ -1333,11 +1351,14 @@ static BOOL shadow_client_send_avc444(rdpShadowClient* client, const BYTE* pSrcD
 	regionRect.top = (UINT16)cmd->top;
 	regionRect.right = (UINT16)cmd->right;
 	regionRect.bottom = (UINT16)cmd->bottom;
+	const UINT64 start = winpr_GetTickCount64NS();
 	rc = avc444_compress(encoder->h264, pSrcData, SrcFormat, nSrcStep, nWidth, nHeight, version,
 	                     &regionRect, &avc444.LC, &avc444.bitstream[0].data,
 	                     &avc444.bitstream[0].length, &avc444.bitstream[1].data,
 	                     &avc444.bitstream[1].length, &avc444.bitstream[0].meta,
 	                     &avc444.bitstream[1].meta);
+	WINPR_ASSERT(cmd->codecId < ARRAYSIZE(encoder->gfxEncode));
+	shadow_client_observe_encode(encoder->gfxEncode[cmd->codecId], start);
 	if (rc < 0)
 	{
 		WLog_ERR(TAG, "avc420_compress failed for avc444");
@@ -1395,8 +1416,10 @@ static BOOL shadow_client_send_avc420(rdpShadowClient* client, const BYTE* pSrcD
 	regionRect.top = (UINT16)cmd->top;
 	regionRect.right = (UINT16)cmd->right;
 	regionRect.bottom = (UINT16)cmd->bottom;
+	const UINT64 start = winpr_GetTickCount64NS();
 	rc = avc420_compress(encoder->h264, pSrcData, SrcFormat, nSrcStep, nWidth, nHeight, &regionRect,
 	                     &avc420.data, &avc420.length, &avc420.meta);
+	shadow_client_observe_encode(encoder->gfxEncode[RDPGFX_CODECID_AVC420], start);
 	if (rc < 0)
 	{
 		WLog_ERR(TAG, "avc420_compress failed");
@@ -1464,7 +1487,9 @@ static BOOL shadow_client_send_rfx(rdpShadowClient* client, const BYTE* pSrcData
 	rect.width = WINPR_ASSERTING_INT_CAST(UINT16, cmd->right - cmd->left);
 	rect.height = WINPR_ASSERTING_INT_CAST(UINT16, cmd->bottom - cmd->top);
 
+	const UINT64 start = winpr_GetTickCount64NS();
 	rc = rfx_compose_message(encoder->rfx, s, &rect, 1, pSrcData, nWidth, nHeight, nSrcStep);
+	shadow_client_observe_encode(encoder->gfxEncode[RDPGFX_CODECID_CAVIDEO], start);
 
 	if (!rc)
 	{
@@ -1534,8 +1559,10 @@ static BOOL shadow_client_send_progressive(rdpShadowClient* client, const BYTE*
 		region16_uninit(&region);
 		return FALSE;
 	}
+	const UINT64 start = winpr_GetTickCount64NS();
 	rc = progressive_compress(encoder->progressive, pSrcData, nSrcStep * nHeight, SrcFormat, nWidth,
 	                          nHeight, nSrcStep, &region, &cmd->data, &cmd->length);
+	shadow_client_observe_encode(encoder->gfxEncode[RDPGFX_CODECID_CAPROGRESSIVE], start);
 	region16_uninit(&region);
 	if (rc < 0)
 	{
@@ -1590,9 +1617,11 @@ static BOOL shadow_client_send_planar(rdpShadowClient* client, const BYTE* pSrcD
 
 	freerdp_planar_topdown_image(encoder->planar, TRUE);
 
+	const UINT64 start = winpr_GetTickCount64NS();
 	cmd->data = freerdp_bitmap_compress_planar(encoder->planar, src, SrcFormat, w, h, nSrcStep,
 	                                           nullptr, &cmd->length);
 	WINPR_ASSERT(cmd->data || (cmd->length == 0));
+	shadow_client_observe_encode(encoder->gfxEncode[RDPGFX_CODECID_PLANAR], start);
 
 	cmd->codecId = RDPGFX_CODECID_PLANAR;
 
@@ -1789,6 +1818,47 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 	                                       &cmdend);
 }
 
+/**
+ * Function description
+ * Send a full screen gfx frame, creating the primary surface first if required.
+ * All PDUs of the frame are sent as a single channel message.
+ *
+ * @return TRUE on success
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_send_frame_gfx(rdpShadowClient* client, SHADOW_GFX_STATUS* pStatus,
+                                         const BYTE* pSrcData, UINT32 nSrcStep, UINT32 SrcFormat,
+                                         UINT16 nWidth, UINT16 nHeight)
+{
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(pStatus);
+
+	if (!rdpgfx_server_batch_begin(client->rdpgfx))
+		return FALSE;
+
+	BOOL ret = TRUE;
+
+	/* Create primary surface if have not */
+	if (!pStatus->gfxSurfaceCreated)
+	{
+		ret = shadow_client_rdpgfx_reset_graphic(client) &&
+		      shadow_client_rdpgfx_new_surface(client);
+		pStatus->gfxSurfaceCreated = ret;
+	}
+
+	if (ret)
+		ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, SrcFormat, 0, 0, nWidth,
+		                                     nHeight);
+
+	const UINT error = rdpgfx_server_batch_end(client->rdpgfx);
+	if (error != CHANNEL_RC_OK)
+	{
+		WLog_ERR(TAG, "rdpgfx_server_batch_end failed with error %" PRIu32 "", error);
+		ret = FALSE;
+	}
+	return ret;
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL stream_surface_bits_supported(const rdpSettings* settings)
 {
@@ -1882,11 +1952,13 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 
 		const UINT32 MultifragMaxRequestSize =
 		    freerdp_settings_get_uint32(settings, FreeRDP_MultifragMaxRequestSize);
+		const UINT64 start = winpr_GetTickCount64NS();
 		RFX_MESSAGE_LIST* messages =
 		    rfx_encode_messages(encoder->rfx, &rect, 1, pSrcData,
 		                        freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth),
 		                        freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight),
 		                        nSrcStep, &numMessages, MultifragMaxRequestSize);
+		shadow_client_observe_encode(encoder->surfaceBitsEncode[RDP_CODEC_ID_REMOTEFX], start);
 		if (!messages)
 		{
 			WLog_ERR(TAG, "rfx_encode_messages failed");
@@ -1952,7 +2024,10 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 		s = encoder->bs;
 		Stream_ResetPosition(s);
 		pSrcData = &pSrcData[(nYSrc * nSrcStep) + (nXSrc * 4)];
-		if (!nsc_compose_message(encoder->nsc, s, pSrcData, nWidth, nHeight, nSrcStep))
+		const UINT64 start = winpr_GetTickCount64NS();
+		const BOOL rc = nsc_compose_message(encoder->nsc, s, pSrcData, nWidth, nHeight, nSrcStep);
+		shadow_client_observe_encode(encoder->surfaceBitsEncode[RDP_CODEC_ID_NSCODEC], start);
+		if (!rc)
 			return FALSE;
 
 		cmd.cmdType = CMDTYPE_SET_SURFACE_BITS;
@@ -2003,7 +2078,6 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client, BYTE* pSrc
 	UINT32 xIdx = 0;
 	UINT32 rows = 0;
 	UINT32 cols = 0;
-	UINT32 DstSize = 0;
 	UINT32 SrcFormat = 0;
 	BITMAP_DATA* bitmap = nullptr;
 	rdpContext* context = (rdpContext*)client;
@@ -2101,21 +2175,16 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client, BYTE* pSrc
 
 			if (freerdp_settings_get_uint32(settings, FreeRDP_ColorDepth) < 32)
 			{
+				/* The tiles are independent, they are encoded together after the layout */
 				UINT32 bitsPerPixel = freerdp_settings_get_uint32(settings, FreeRDP_ColorDepth);
 				UINT32 bytesPerPixel = (bitsPerPixel + 7) / 8;
-				DstSize = 64 * 64 * 4;
-				buffer = encoder->grid[k];
-
-				ret = interleaved_compress(
-				    encoder->interleaved, buffer, &DstSize, bitmap->width, bitmap->height, pSrcData,
-				    SrcFormat, nSrcStep, bitmap->destLeft, bitmap->destTop, nullptr, bitsPerPixel);
-				if (!ret)
-					goto out;
-				bitmap->bitmapDataStream = buffer;
-				bitmap->bitmapLength = DstSize;
+				bitmap->bitmapDataStream = encoder->grid[k];
+				bitmap->bitmapLength = 0;
 				bitmap->bitsPerPixel = bitsPerPixel;
 				bitmap->cbScanWidth = bitmap->width * bytesPerPixel;
 				bitmap->cbUncompressedSize = bitmap->width * bitmap->height * bytesPerPixel;
+				k++;
+				continue;
 			}
 			else
 			{
@@ -2140,6 +2209,16 @@ static BOOL shadow_client_send_bitmap_update(rdpShadowClient* client, BYTE* pSrc
 		}
 	}
 
+	if (freerdp_settings_get_uint32(settings, FreeRDP_ColorDepth) < 32)
+	{
+		ret = shadow_encoder_compress_interleaved(encoder, bitmapData, k, pSrcData, nSrcStep);
+		if (!ret)
+			goto out;
+
+		for (UINT32 i = 0; i < k; i++)
+			totalBitmapSize += bitmapData[i].bitmapLength;
+	}
+
 	bitmapUpdate.number = k;
 	updateSizeEstimate = totalBitmapSize + (k * bitmapUpdate.number) + 16;
 
@@ -2200,6 +2279,54 @@ out:
 	return ret;
 }
 
+/**
+ * Function description
+ * Move the invalid region of the client and the surface to invalidRegion,
+ * clipped to the shared area. The caller holds the surface lock.
+ *
+ * @return TRUE on success
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_collect_invalid_region(rdpShadowClient* client,
+                                                 const rdpShadowSurface* surface,
+                                                 REGION16* invalidRegion)
+{
+	UINT32 numRects = 0;
+	RECTANGLE_16 surfaceRect = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->server);
+	WINPR_ASSERT(surface);
+	WINPR_ASSERT(invalidRegion);
+
+	{
+		EnterCriticalSection(&(client->lock));
+		const BOOL res = region16_copy(invalidRegion, &(client->invalidRegion));
+		region16_clear(&(client->invalidRegion));
+		LeaveCriticalSection(&(client->lock));
+		if (!res)
+			return FALSE;
+	}
+
+	const RECTANGLE_16* rects = region16_rects(&(surface->invalidRegion), &numRects);
+	if (!region16_union_rects(invalidRegion, invalidRegion, rects, numRects))
+		return FALSE;
+
+	WINPR_ASSERT(surface->width <= UINT16_MAX);
+	WINPR_ASSERT(surface->height <= UINT16_MAX);
+	surfaceRect.right = (UINT16)surface->width;
+	surfaceRect.bottom = (UINT16)surface->height;
+	if (!region16_intersect_rect(invalidRegion, invalidRegion, &surfaceRect))
+		return FALSE;
+
+	if (client->server->shareSubRect)
+	{
+		if (!region16_intersect_rect(invalidRegion, invalidRegion, &(client->server->subRect)))
+			return FALSE;
+	}
+	return TRUE;
+}
+
 /**
  * Function description
  *
@@ -2218,13 +2345,10 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 	rdpShadowServer* server = nullptr;
 	rdpShadowSurface* surface = nullptr;
 	REGION16 invalidRegion;
-	RECTANGLE_16 surfaceRect;
 	const RECTANGLE_16* extents = nullptr;
 	BYTE* pSrcData = nullptr;
 	UINT32 nSrcStep = 0;
 	UINT32 SrcFormat = 0;
-	UINT32 numRects = 0;
-	const RECTANGLE_16* rects = nullptr;
 
 	if (!context || !pStatus)
 		return FALSE;
@@ -2240,41 +2364,11 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 	if (!surface)
 		return FALSE;
 
-	{
-		EnterCriticalSection(&(client->lock));
-		region16_init(&invalidRegion);
-
-		const BOOL res = region16_copy(&invalidRegion, &(client->invalidRegion));
-		region16_clear(&(client->invalidRegion));
-		LeaveCriticalSection(&(client->lock));
-		if (!res)
-			goto out;
-	}
-
+	region16_init(&invalidRegion);
 	EnterCriticalSection(&surface->lock);
-	rects = region16_rects(&(surface->invalidRegion), &numRects);
-
-	for (UINT32 index = 0; index < numRects; index++)
-	{
-		if (!region16_union_rect(&invalidRegion, &invalidRegion, &rects[index]))
-			goto out;
-	}
-
-	surfaceRect.left = 0;
-	surfaceRect.top = 0;
-	WINPR_ASSERT(surface->width <= UINT16_MAX);
-	WINPR_ASSERT(surface->height <= UINT16_MAX);
-	surfaceRect.right = (UINT16)surface->width;
-	surfaceRect.bottom = (UINT16)surface->height;
-	if (!region16_intersect_rect(&invalidRegion, &invalidRegion, &surfaceRect))
+	if (!shadow_client_collect_invalid_region(client, surface, &invalidRegion))
 		goto out;
 
-	if (server->shareSubRect)
-	{
-		if (!region16_intersect_rect(&invalidRegion, &invalidRegion, &(server->subRect)))
-			goto out;
-	}
-
 	if (region16_is_empty(&invalidRegion))
 	{
 		/* No image region need to be updated. Success */
@@ -2318,25 +2412,12 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 			nWidth = freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth);
 			nHeight = freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight);
 
-			/* Create primary surface if have not */
-			if (!pStatus->gfxSurfaceCreated)
-			{
-				/* Only init surface when we have h264 supported */
-				if (!(ret = shadow_client_rdpgfx_reset_graphic(client)))
-					goto out;
-
-				if (!(ret = shadow_client_rdpgfx_new_surface(client)))
-					goto out;
-
-				pStatus->gfxSurfaceCreated = TRUE;
-			}
-
 			WINPR_ASSERT(nWidth >= 0);
 			WINPR_ASSERT(nWidth <= UINT16_MAX);
 			WINPR_ASSERT(nHeight >= 0);
 			WINPR_ASSERT(nHeight <= UINT16_MAX);
-			ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, SrcFormat, 0, 0,
-			                                     (UINT16)nWidth, (UINT16)nHeight);
+			ret = shadow_client_send_frame_gfx(client, pStatus, pSrcData, nSrcStep, SrcFormat,
+			                                   (UINT16)nWidth, (UINT16)nHeight);
 		}
 		else
 		{
@@ -2466,6 +2547,179 @@ static inline BOOL shadow_client_no_surface_update(rdpShadowClient* client,
 	return rc;
 }
 
+/**
+ * Function description
+ * RDPGFX frames are encoded on the encode thread, other updates are written
+ * to the transport directly and stay on the client thread.
+ *
+ * @return TRUE if the encode thread handles surface updates
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_encode_offloaded(rdpShadowClient* client,
+                                           const SHADOW_GFX_STATUS* pStatus)
+{
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(pStatus);
+
+	const rdpSettings* settings = client->context.settings;
+	return freerdp_settings_get_bool(settings, FreeRDP_SupportGraphicsPipeline) &&
+	       pStatus->gfxOpened && client->areGfxCapsReady;
+}
+
+/**
+ * Function description
+ * Copy the shared area of the surface and encode it as RDPGFX frame. Runs on
+ * the encode thread, the PDUs are queued for the client thread to write.
+ *
+ * @return TRUE on success
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_encode_surface_gfx(void* arg, BOOL* queued)
+{
+	BOOL ret = TRUE;
+	BOOL encode = FALSE;
+	REGION16 invalidRegion;
+	SHADOW_ENCODE_STAGE* stage = arg;
+
+	WINPR_ASSERT(stage);
+	WINPR_ASSERT(queued);
+
+	rdpShadowClient* client = stage->client;
+	WINPR_ASSERT(client);
+
+	const rdpSettings* settings = client->context.settings;
+	rdpShadowServer* server = client->server;
+	WINPR_ASSERT(settings);
+	WINPR_ASSERT(server);
+
+	rdpShadowSurface* surface = client->inLobby ? server->lobby : server->surface;
+	if (!surface)
+		return FALSE;
+
+	/* GFX/h264 always full screen encoded */
+	const UINT32 nWidth = freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth);
+	const UINT32 nHeight = freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight);
+	UINT32 SrcFormat = 0;
+	UINT32 nDstStep = 0;
+
+	region16_init(&invalidRegion);
+	EnterCriticalSection(&surface->lock);
+	if (!shadow_client_collect_invalid_region(client, surface, &invalidRegion))
+		goto out_unlock;
+
+	if (region16_is_empty(&invalidRegion))
+		goto out_unlock;
+
+	/* Resized since the last update, the client thread sends the resize and
+	 * the activation refreshes the whole screen */
+	if (shadow_client_recalc_desktop_size(client))
+		goto out_unlock;
+
+	{
+		const BYTE* pSrcData = surface->data;
+		const UINT32 nSrcStep = surface->scanline;
+		SrcFormat = surface->format;
+
+		const size_t bpp = FreeRDPGetBytesPerPixel(SrcFormat);
+		nDstStep = WINPR_ASSERTING_INT_CAST(UINT32, nWidth * bpp);
+
+		UINT32 subX = 0;
+		UINT32 subY = 0;
+		if (server->shareSubRect)
+		{
+			subX = server->subRect.left;
+			subY = server->subRect.top;
+			pSrcData = &pSrcData[(1ull * subY * nSrcStep) + (1ull * subX * bpp)];
+		}
+
+		const size_t size = 1ull * nDstStep * nHeight;
+		if (stage->frameSize != size)
+		{
+			free(stage->frame);
+			stage->frameSize = 0;
+			stage->frame = calloc(nHeight, nDstStep);
+			if (!stage->frame)
+			{
+				ret = FALSE;
+				goto out_unlock;
+			}
+			stage->frameSize = size;
+		}
+
+		const size_t width = 1ull * MIN(nWidth, surface->width - subX) * bpp;
+		const UINT32 height = MIN(nHeight, surface->height - subY);
+		for (UINT32 y = 0; y < height; y++)
+			memcpy(&stage->frame[1ull * y * nDstStep], &pSrcData[1ull * y * nSrcStep], width);
+		encode = TRUE;
+	}
+
+out_unlock:
+	LeaveCriticalSection(&surface->lock);
+	region16_uninit(&invalidRegion);
+
+	if (!encode)
+		return ret;
+
+	WINPR_ASSERT(nWidth <= UINT16_MAX);
+	WINPR_ASSERT(nHeight <= UINT16_MAX);
+	if (!shadow_client_send_frame_gfx(client, stage->gfxstatus, stage->frame, nDstStep, SrcFormat,
+	                                  (UINT16)nWidth, (UINT16)nHeight))
+		return FALSE;
+
+	*queued = TRUE;
+	return TRUE;
+}
+
+static void shadow_client_encode_stage_uninit(SHADOW_ENCODE_STAGE* stage)
+{
+	WINPR_ASSERT(stage);
+
+	shadow_encode_stage_free(stage->stage);
+	free(stage->frame);
+
+	const SHADOW_ENCODE_STAGE empty = WINPR_C_ARRAY_INIT;
+	*stage = empty;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_encode_stage_init(SHADOW_ENCODE_STAGE* stage, rdpShadowClient* client,
+                                            SHADOW_GFX_STATUS* pStatus)
+{
+	WINPR_ASSERT(stage);
+
+	stage->client = client;
+	stage->gfxstatus = pStatus;
+	stage->stage = shadow_encode_stage_new(shadow_client_encode_surface_gfx, stage);
+	return stage->stage != nullptr;
+}
+
+/**
+ * Function description
+ * Start encoding the pending invalid region unless a frame is already being
+ * encoded or too many encoded frames wait to be written. Updates arriving in
+ * the meantime are merged into the invalid region of the client.
+ */
+static void shadow_client_encode_stage_kick(SHADOW_ENCODE_STAGE* stage)
+{
+	WINPR_ASSERT(stage);
+
+	rdpShadowClient* client = stage->client;
+	WINPR_ASSERT(client);
+
+	if (shadow_encode_stage_busy(stage->stage) || !client->activated || client->suppressOutput)
+		return;
+	if (!shadow_client_encode_offloaded(client, stage->gfxstatus))
+		return;
+
+	EnterCriticalSection(&(client->lock));
+	const BOOL empty = region16_is_empty(&(client->invalidRegion));
+	LeaveCriticalSection(&(client->lock));
+	if (empty)
+		return;
+
+	(void)shadow_encode_stage_start(stage->stage);
+}
+
 WINPR_ATTR_NODISCARD
 static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMessage* message)
 {
@@ -2624,6 +2878,7 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	wMessageQueue* MsgQueue = nullptr;
 	/* This should only be visited in client thread */
 	SHADOW_GFX_STATUS gfxstatus = WINPR_C_ARRAY_INIT;
+	SHADOW_ENCODE_STAGE encodeStage = WINPR_C_ARRAY_INIT;
 	rdpUpdate* update = nullptr;
 
 	WINPR_ASSERT(client);
@@ -2681,11 +2936,16 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	WINPR_ASSERT(rc);
 	rc = freerdp_settings_set_bool(settings, FreeRDP_SupportMonitorLayoutPdu, TRUE);
 	WINPR_ASSERT(rc);
+
+	if (!shadow_client_encode_stage_init(&encodeStage, client, &gfxstatus))
+		goto fail;
+
 	while (1)
 	{
 		HANDLE events[MAXIMUM_WAIT_OBJECTS] = WINPR_C_ARRAY_INIT;
 		DWORD nCount = 0;
 		events[nCount++] = UpdateEvent;
+		events[nCount++] = shadow_encode_stage_get_event(encodeStage.stage);
 		{
 			DWORD tmp = peer->GetEventHandles(peer, &events[nCount], 64 - nCount);
 
@@ -2701,7 +2961,10 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 		events[nCount++] = MessageQueue_Event(MsgQueue);
 
 #if defined(CHANNEL_RDPGFX_SERVER)
-		HANDLE gfxevent = rdpgfx_server_get_event_handle(client->rdpgfx);
+		/* Client messages change the RDPGFX state, defer them until the frame is encoded */
+		HANDLE gfxevent = shadow_encode_stage_busy(encodeStage.stage)
+		                      ? nullptr
+		                      : rdpgfx_server_get_event_handle(client->rdpgfx);
 
 		if (gfxevent)
 			events[nCount++] = gfxevent;
@@ -2726,7 +2989,8 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 				/* Send screen update or resize to this client */
 
 				/* Check resize */
-				if (shadow_client_recalc_desktop_size(client))
+				if (!shadow_encode_stage_busy(encodeStage.stage) &&
+				    shadow_client_recalc_desktop_size(client))
 				{
 					/* Screen size changed, do resize */
 					if (!shadow_client_send_resize(client, &gfxstatus))
@@ -2735,6 +2999,17 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 						break;
 					}
 				}
+				else if (shadow_encode_stage_busy(encodeStage.stage) ||
+				         shadow_client_encode_offloaded(client, &gfxstatus))
+				{
+					/* Merge the update, it is encoded on the encode thread */
+					if (!shadow_client_no_surface_update(client, &gfxstatus))
+					{
+						WLog_ERR(TAG, "Failed to handle surface update");
+						break;
+					}
+					shadow_client_encode_stage_kick(&encodeStage);
+				}
 				else
 				{
 					/* Send frame */
@@ -2762,6 +3037,17 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			(void)shadow_multiclient_consume(UpdateSubscriber);
 		}
 
+		BOOL encoded = FALSE;
+		if (shadow_encode_stage_check(encodeStage.stage, &encoded))
+		{
+			if (!encoded)
+			{
+				WLog_ERR(TAG, "Failed to send surface update");
+				break;
+			}
+			shadow_client_encode_stage_kick(&encodeStage);
+		}
+
 		WINPR_ASSERT(peer->CheckFileDescriptor);
 		if (!peer->CheckFileDescriptor(peer))
 		{
@@ -2833,6 +3119,10 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 				WLog_ERR(TAG, "WTSVirtualChannelManagerCheckFileDescriptor failure");
 				goto fail;
 			}
+
+			/* The encoded frames are written, continue with merged updates */
+			shadow_encode_stage_frames_written(encodeStage.stage);
+			shadow_client_encode_stage_kick(&encodeStage);
 		}
 
 #if defined(CHANNEL_RDPGFX_SERVER)
@@ -2924,6 +3214,7 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	}
 
 fail:
+	shadow_client_encode_stage_uninit(&encodeStage);
 
 	/* Free channels early because we establish channels in post connect */
 #if defined(CHANNEL_AUDIN_SERVER)
@@ -0,0 +1,156 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/crt.h>
+#include <winpr/assert.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+
+#include "shadow_encode_stage.h"
+
+struct s_shadow_encode_stage
+{
+	pfnShadowEncodeFrame encode;
+	void* arg;
+
+	HANDLE thread;
+	HANDLE stopEvent;
+	HANDLE startEvent;
+	HANDLE doneEvent;
+
+	BOOL busy; /* only accessed by the client thread */
+	BOOL result;
+	volatile LONG queuedFrames;
+};
+
+static DWORD WINAPI shadow_encode_stage_thread(LPVOID arg)
+{
+	rdpShadowEncodeStage* stage = arg;
+	WINPR_ASSERT(stage);
+
+	HANDLE events[] = { stage->stopEvent, stage->startEvent };
+	while (WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE) ==
+	       WAIT_OBJECT_0 + 1)
+	{
+		BOOL queued = FALSE;
+		(void)ResetEvent(stage->startEvent);
+		stage->result = stage->encode(stage->arg, &queued);
+		if (queued)
+			(void)InterlockedIncrement(&stage->queuedFrames);
+		(void)SetEvent(stage->doneEvent);
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+void shadow_encode_stage_free(rdpShadowEncodeStage* stage)
+{
+	if (!stage)
+		return;
+
+	if (stage->thread)
+	{
+		(void)SetEvent(stage->stopEvent);
+		(void)WaitForSingleObject(stage->thread, INFINITE);
+		(void)CloseHandle(stage->thread);
+	}
+	if (stage->stopEvent)
+		(void)CloseHandle(stage->stopEvent);
+	if (stage->startEvent)
+		(void)CloseHandle(stage->startEvent);
+	if (stage->doneEvent)
+		(void)CloseHandle(stage->doneEvent);
+	free(stage);
+}
+
+rdpShadowEncodeStage* shadow_encode_stage_new(pfnShadowEncodeFrame encode, void* arg)
+{
+	WINPR_ASSERT(encode);
+
+	rdpShadowEncodeStage* stage = calloc(1, sizeof(rdpShadowEncodeStage));
+	if (!stage)
+		return nullptr;
+
+	stage->encode = encode;
+	stage->arg = arg;
+	/* winpr has no auto-reset events, each side resets the event it waited for */
+	stage->stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	stage->startEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	stage->doneEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!stage->stopEvent || !stage->startEvent || !stage->doneEvent)
+		goto fail;
+
+	stage->thread = CreateThread(nullptr, 0, shadow_encode_stage_thread, stage, 0, nullptr);
+	if (!stage->thread)
+		goto fail;
+	return stage;
+
+fail:
+	shadow_encode_stage_free(stage);
+	return nullptr;
+}
+
+HANDLE shadow_encode_stage_get_event(const rdpShadowEncodeStage* stage)
+{
+	WINPR_ASSERT(stage);
+	return stage->doneEvent;
+}
+
+BOOL shadow_encode_stage_busy(const rdpShadowEncodeStage* stage)
+{
+	WINPR_ASSERT(stage);
+	return stage->busy;
+}
+
+BOOL shadow_encode_stage_start(rdpShadowEncodeStage* stage)
+{
+	WINPR_ASSERT(stage);
+
+	if (stage->busy)
+		return FALSE;
+	if (InterlockedCompareExchange(&stage->queuedFrames, 0, 0) >=
+	    SHADOW_ENCODE_STAGE_MAX_QUEUED_FRAMES)
+		return FALSE;
+
+	stage->busy = TRUE;
+	return SetEvent(stage->startEvent);
+}
+
+BOOL shadow_encode_stage_check(rdpShadowEncodeStage* stage, BOOL* result)
+{
+	WINPR_ASSERT(stage);
+	WINPR_ASSERT(result);
+
+	if (WaitForSingleObject(stage->doneEvent, 0) != WAIT_OBJECT_0)
+		return FALSE;
+
+	(void)ResetEvent(stage->doneEvent);
+	stage->busy = FALSE;
+	*result = stage->result;
+	return TRUE;
+}
+
+void shadow_encode_stage_frames_written(rdpShadowEncodeStage* stage)
+{
+	WINPR_ASSERT(stage);
+
+	const LONG written = InterlockedExchange(&stage->queuedFrames, 0);
+	WINPR_UNUSED(written);
+}
@@ -0,0 +1,83 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_ENCODE_STAGE_H
+#define FREERDP_SERVER_SHADOW_ENCODE_STAGE_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/api.h>
+
+/* Encoded frames that may wait to be written before the next encode starts */
+#define SHADOW_ENCODE_STAGE_MAX_QUEUED_FRAMES 2
+
+/*
+ * Frames are encoded on a thread of their own, the client thread keeps
+ * writing to the network and handling input. Only the client thread calls
+ * the functions below, the encode callback runs on the encode thread.
+ */
+typedef struct s_shadow_encode_stage rdpShadowEncodeStage;
+
+/**
+ * Encodes a frame, sets queued if the frame was handed to the channel.
+ * Updates arriving while it runs are merged by the caller.
+ */
+typedef BOOL (*pfnShadowEncodeFrame)(void* arg, BOOL* queued);
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	FREERDP_LOCAL void shadow_encode_stage_free(rdpShadowEncodeStage* stage);
+
+	WINPR_ATTR_MALLOC(shadow_encode_stage_free, 1)
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL rdpShadowEncodeStage* shadow_encode_stage_new(pfnShadowEncodeFrame encode,
+	                                                             void* arg);
+
+	/** @brief Signaled when an encode finished, see shadow_encode_stage_check */
+	WINPR_ATTR_NODISCARD FREERDP_LOCAL HANDLE
+	shadow_encode_stage_get_event(const rdpShadowEncodeStage* stage);
+
+	WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL
+	shadow_encode_stage_busy(const rdpShadowEncodeStage* stage);
+
+	/**
+	 * @brief Starts an encode unless one is running or too many encoded
+	 * frames wait to be written
+	 *
+	 * @return TRUE if the encode was started
+	 */
+	FREERDP_LOCAL BOOL shadow_encode_stage_start(rdpShadowEncodeStage* stage);
+
+	/**
+	 * @brief Collects a finished encode
+	 *
+	 * @param result receives the return value of the encode callback
+	 * @return TRUE if an encode finished since the last call
+	 */
+	WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL shadow_encode_stage_check(rdpShadowEncodeStage* stage,
+	                                                                  BOOL* result);
+
+	/** @brief The queued frames were written, encoding may continue */
+	FREERDP_LOCAL void shadow_encode_stage_frames_written(rdpShadowEncodeStage* stage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_ENCODE_STAGE_H */
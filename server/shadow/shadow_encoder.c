@@ -19,6 +19,11 @@
 #include <freerdp/config.h>
 
 #include <winpr/assert.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/metrics.h>
+#include <freerdp/utils/gfx.h>
 
 #include "shadow.h"
 
@@ -75,9 +80,28 @@ UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
 		encoder->fps = 1;
 
 	frameId = ++encoder->frameId;
+
+	const size_t index = frameId % SHADOW_ENCODER_FRAME_HISTORY;
+	encoder->sentFrameId[index] = frameId;
+	encoder->sentFrameTime[index] = winpr_GetTickCount64NS();
 	return frameId;
 }
 
+void shadow_encoder_frame_acknowledged(rdpShadowEncoder* encoder, UINT32 frameId)
+{
+	WINPR_ASSERT(encoder);
+	WINPR_ASSERT(encoder->client);
+
+	/* Clients may skip acknowledgements, only frames still in the history are measured */
+	const size_t index = frameId % SHADOW_ENCODER_FRAME_HISTORY;
+	if ((frameId == 0) || (encoder->sentFrameId[index] != frameId))
+		return;
+	encoder->sentFrameId[index] = 0;
+
+	metric_observe(encoder->frameAckSeconds,
+	               winpr_GetTickCount64NS() - encoder->sentFrameTime[index]);
+}
+
 WINPR_ATTR_NODISCARD
 static int shadow_encoder_init_grid(rdpShadowEncoder* encoder)
 {
@@ -207,8 +231,9 @@ static int shadow_encoder_init_planar(rdpShadowEncoder* encoder)
 
 	if (!encoder->planar)
 	{
-		encoder->planar = freerdp_bitmap_planar_context_new(planarFlags, encoder->maxTileWidth,
-		                                                    encoder->maxTileHeight);
+		encoder->planar = freerdp_bitmap_planar_context_new_ex(
+		    planarFlags, encoder->maxTileWidth, encoder->maxTileHeight,
+		    freerdp_settings_get_uint32(settings, FreeRDP_ThreadingFlags));
 	}
 
 	if (!encoder->planar)
@@ -225,22 +250,139 @@ fail:
 	return -1;
 }
 
+static void shadow_encoder_interleaved_batch(SHADOW_INTERLEAVED_BATCH* batch)
+{
+	WINPR_ASSERT(batch);
+	WINPR_ASSERT(batch->encoder);
+
+	/* Every caller gets a context of its own, there are at most interleavedCount of them */
+	const LONG index = InterlockedIncrement(&batch->nextContext) - 1;
+	WINPR_ASSERT((index >= 0) && ((UINT32)index < batch->encoder->interleavedCount));
+	BITMAP_INTERLEAVED_CONTEXT* interleaved = batch->encoder->interleavedTiles[index];
+
+	for (;;)
+	{
+		const LONG next = InterlockedIncrement(&batch->nextTile) - 1;
+		if ((next < 0) || ((UINT32)next >= batch->count))
+			break;
+
+		BITMAP_DATA* bitmap = &batch->tiles[next];
+		UINT32 DstSize = 64 * 64 * 4;
+
+		if (!interleaved_compress(interleaved, bitmap->bitmapDataStream, &DstSize, bitmap->width,
+		                          bitmap->height, batch->pSrcData, PIXEL_FORMAT_BGRX32,
+		                          batch->nSrcStep, bitmap->destLeft, bitmap->destTop, nullptr,
+		                          bitmap->bitsPerPixel))
+		{
+			(void)InterlockedIncrement(&batch->failed);
+			continue;
+		}
+
+		bitmap->bitmapLength = DstSize;
+		bitmap->cbCompFirstRowSize = 0;
+		bitmap->cbCompMainBodySize = DstSize;
+	}
+}
+
+static void CALLBACK
+shadow_encoder_interleaved_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
+                                         void* context, WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	shadow_encoder_interleaved_batch((SHADOW_INTERLEAVED_BATCH*)context);
+}
+
+/**
+ * Encode the interleaved tiles of a bitmap update. interleavedWork is submitted once for every
+ * extra context, the tiles are handed out one at a time to its callbacks and the calling thread.
+ */
+BOOL shadow_encoder_compress_interleaved(rdpShadowEncoder* encoder, BITMAP_DATA* tiles,
+                                         UINT32 count, const BYTE* pSrcData, UINT32 nSrcStep)
+{
+	WINPR_ASSERT(encoder);
+	WINPR_ASSERT(tiles || (count == 0));
+	WINPR_ASSERT(encoder->interleavedCount > 0);
+
+	SHADOW_INTERLEAVED_BATCH* batch = &encoder->interleavedBatch;
+	batch->encoder = encoder;
+	batch->tiles = tiles;
+	batch->count = count;
+	batch->pSrcData = pSrcData;
+	batch->nSrcStep = nSrcStep;
+	batch->nextTile = 0;
+	batch->nextContext = 0;
+	batch->failed = 0;
+
+	const UINT32 threads = MIN(encoder->interleavedCount, count);
+	const UINT32 submit = (encoder->interleavedWork && (threads > 1)) ? threads - 1 : 0;
+	for (UINT32 i = 0; i < submit; i++)
+		SubmitThreadpoolWork(encoder->interleavedWork);
+
+	shadow_encoder_interleaved_batch(batch);
+
+	if (submit > 0)
+		WaitForThreadpoolWorkCallbacks(encoder->interleavedWork, FALSE);
+
+	return batch->failed == 0;
+}
+
 WINPR_ATTR_NODISCARD
 static int shadow_encoder_init_interleaved(rdpShadowEncoder* encoder)
 {
+	UINT32 count = 1;
+	const UINT32 ThreadingFlags =
+	    freerdp_settings_get_uint32(encoder->server->settings, FreeRDP_ThreadingFlags);
+
+	if (!(ThreadingFlags & THREADING_FLAGS_DISABLE_THREADS))
+	{
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+		GetNativeSystemInfo(&sysInfos);
+		count = MAX(1, MIN(SHADOW_ENCODER_MAX_INTERLEAVED, sysInfos.dwNumberOfProcessors));
+	}
+
 	if (!encoder->interleaved)
 		encoder->interleaved = bitmap_interleaved_context_new(TRUE);
 
-	if (!encoder->interleaved)
-		goto fail;
+	encoder->interleavedTiles[0] = encoder->interleaved;
 
-	if (!bitmap_interleaved_context_reset(encoder->interleaved))
-		goto fail;
+	for (UINT32 i = 1; i < count; i++)
+	{
+		if (!encoder->interleavedTiles[i])
+			encoder->interleavedTiles[i] = bitmap_interleaved_context_new(TRUE);
+	}
+
+	encoder->interleavedCount = count;
+
+	for (UINT32 i = 0; i < count; i++)
+	{
+		if (!encoder->interleavedTiles[i])
+			goto fail;
+
+		if (!bitmap_interleaved_context_reset(encoder->interleavedTiles[i]))
+			goto fail;
+	}
+
+	if ((count > 1) && !encoder->interleavedWork)
+	{
+		encoder->interleavedWork = CreateThreadpoolWork(shadow_encoder_interleaved_work_callback,
+		                                                &encoder->interleavedBatch, nullptr);
+		if (!encoder->interleavedWork)
+			goto fail;
+	}
 
 	encoder->codecs |= FREERDP_CODEC_INTERLEAVED;
 	return 1;
 fail:
-	bitmap_interleaved_context_free(encoder->interleaved);
+	if (encoder->interleavedWork)
+		CloseThreadpoolWork(encoder->interleavedWork);
+	encoder->interleavedWork = nullptr;
+
+	for (size_t i = 0; i < ARRAYSIZE(encoder->interleavedTiles); i++)
+	{
+		bitmap_interleaved_context_free(encoder->interleavedTiles[i]);
+		encoder->interleavedTiles[i] = nullptr;
+	}
+	encoder->interleaved = nullptr;
+	encoder->interleavedCount = 0;
 	return -1;
 }
 
@@ -391,12 +533,19 @@ static int shadow_encoder_uninit_planar(rdpShadowEncoder* encoder)
 
 static int shadow_encoder_uninit_interleaved(rdpShadowEncoder* encoder)
 {
-	if (encoder->interleaved)
+	if (encoder->interleavedWork)
+		CloseThreadpoolWork(encoder->interleavedWork);
+	encoder->interleavedWork = nullptr;
+
+	for (size_t i = 0; i < ARRAYSIZE(encoder->interleavedTiles); i++)
 	{
-		bitmap_interleaved_context_free(encoder->interleaved);
-		encoder->interleaved = nullptr;
+		bitmap_interleaved_context_free(encoder->interleavedTiles[i]);
+		encoder->interleavedTiles[i] = nullptr;
 	}
 
+	encoder->interleaved = nullptr;
+	encoder->interleavedCount = 0;
+
 	encoder->codecs &= (UINT32)~FREERDP_CODEC_INTERLEAVED;
 	return 1;
 }
@@ -570,6 +719,44 @@ int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs)
 	return 1;
 }
 
+static void shadow_encoder_init_metrics(rdpShadowEncoder* encoder)
+{
+	const UINT16 gfxCodecs[] = {
+#if defined(WITH_GFX_AV1)
+		RDPGFX_CODECID_AV1,
+#endif
+		RDPGFX_CODECID_CAVIDEO, RDPGFX_CODECID_CAPROGRESSIVE, RDPGFX_CODECID_PLANAR,
+		RDPGFX_CODECID_AVC420,  RDPGFX_CODECID_AVC444,        RDPGFX_CODECID_AVC444v2
+	};
+	const UINT32 surfaceCodecs[] = { RDP_CODEC_ID_REMOTEFX, RDP_CODEC_ID_NSCODEC };
+
+	WINPR_ASSERT(encoder);
+	WINPR_ASSERT(encoder->client);
+
+	rdpMetrics* metrics = encoder->client->context.metrics;
+	encoder->frameAckSeconds =
+	    metrics_get_histogram(metrics, "freerdp_frame_ack_seconds", nullptr, nullptr,
+	                          "Time from starting a frame to its acknowledgement");
+
+	for (size_t x = 0; x < ARRAYSIZE(gfxCodecs); x++)
+	{
+		const UINT16 id = gfxCodecs[x];
+		WINPR_ASSERT(id < ARRAYSIZE(encoder->gfxEncode));
+		encoder->gfxEncode[id] = metrics_get_histogram(metrics, "freerdp_encode_seconds", "codec",
+		                                               rdpgfx_get_codec_id_string(id),
+		                                               "Time to encode a surface update");
+	}
+
+	for (size_t x = 0; x < ARRAYSIZE(surfaceCodecs); x++)
+	{
+		const UINT32 id = surfaceCodecs[x];
+		WINPR_ASSERT(id < ARRAYSIZE(encoder->surfaceBitsEncode));
+		encoder->surfaceBitsEncode[id] =
+		    metrics_get_histogram(metrics, "freerdp_encode_seconds", "codec",
+		                          freerdp_codec_id_to_str(id), "Time to encode a surface update");
+	}
+}
+
 rdpShadowEncoder* shadow_encoder_new(rdpShadowClient* client)
 {
 	rdpShadowEncoder* encoder = nullptr;
@@ -583,6 +770,7 @@ rdpShadowEncoder* shadow_encoder_new(rdpShadowClient* client)
 	encoder->server = server;
 	encoder->fps = 16;
 	encoder->maxFps = 32;
+	shadow_encoder_init_metrics(encoder);
 
 	if (shadow_encoder_init(encoder) < 0)
 	{
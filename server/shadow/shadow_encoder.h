@@ -20,6 +20,7 @@
 #define FREERDP_SERVER_SHADOW_ENCODER_H
 
 #include <winpr/crt.h>
+#include <winpr/pool.h>
 #include <winpr/stream.h>
 
 #include <freerdp/freerdp.h>
@@ -27,6 +28,23 @@
 
 #include <freerdp/server/shadow.h>
 
+#define SHADOW_ENCODER_FRAME_HISTORY 32
+#define SHADOW_ENCODER_MAX_INTERLEAVED 16
+
+/* Interleaved tiles of a bitmap update. The calling thread and the callbacks of interleavedWork
+ * each take one of the interleaved contexts and then the next tile until none are left. */
+typedef struct
+{
+	rdpShadowEncoder* encoder;
+	BITMAP_DATA* tiles;
+	UINT32 count;
+	const BYTE* pSrcData;
+	UINT32 nSrcStep;
+	LONG volatile nextTile;
+	LONG volatile nextContext;
+	LONG volatile failed;
+} SHADOW_INTERLEAVED_BATCH;
+
 struct rdp_shadow_encoder
 {
 	rdpShadowClient* client;
@@ -49,6 +67,11 @@ struct rdp_shadow_encoder
 	NSC_CONTEXT* nsc;
 	BITMAP_PLANAR_CONTEXT* planar;
 	BITMAP_INTERLEAVED_CONTEXT* interleaved;
+	/* Contexts for encoding interleaved tiles in parallel, the first one is interleaved */
+	BITMAP_INTERLEAVED_CONTEXT* interleavedTiles[SHADOW_ENCODER_MAX_INTERLEAVED];
+	UINT32 interleavedCount;
+	PTP_WORK interleavedWork;
+	SHADOW_INTERLEAVED_BATCH interleavedBatch;
 	H264_CONTEXT* h264;
 	PROGRESSIVE_CONTEXT* progressive;
 #if defined(WITH_GFX_AV1)
@@ -60,6 +83,13 @@ struct rdp_shadow_encoder
 	UINT32 frameId;
 	UINT32 lastAckframeId;
 	UINT32 queueDepth;
+	UINT32 sentFrameId[SHADOW_ENCODER_FRAME_HISTORY];
+	UINT64 sentFrameTime[SHADOW_ENCODER_FRAME_HISTORY];
+
+	/* Resolved once, the lookup takes the lock of the metrics */
+	rdpMetric* frameAckSeconds;
+	rdpMetric* gfxEncode[RDPGFX_CODECID_MAX];                       /* by RDPGFX_CODECID */
+	rdpMetric* surfaceBitsEncode[RDP_CODEC_ID_IMAGE_REMOTEFX + 1]; /* by RDP_CODEC_ID */
 };
 
 #ifdef __cplusplus
@@ -70,6 +100,11 @@ extern "C"
 	WINPR_ATTR_NODISCARD int shadow_encoder_reset(rdpShadowEncoder* encoder);
 	WINPR_ATTR_NODISCARD int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs);
 	WINPR_ATTR_NODISCARD UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder);
+	WINPR_ATTR_NODISCARD BOOL shadow_encoder_compress_interleaved(rdpShadowEncoder* encoder,
+	                                                              BITMAP_DATA* tiles, UINT32 count,
+	                                                              const BYTE* pSrcData,
+	                                                              UINT32 nSrcStep);
+	void shadow_encoder_frame_acknowledged(rdpShadowEncoder* encoder, UINT32 frameId);
 
 	void shadow_encoder_free(rdpShadowEncoder* encoder);
 
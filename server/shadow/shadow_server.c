@@ -31,6 +31,7 @@
 #include <winpr/winsock.h>
 
 #include <freerdp/log.h>
+#include <freerdp/metrics.h>
 #include <freerdp/version.h>
 
 #include <winpr/tools/makecert.h>
@@ -244,6 +245,16 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 
 			server->port = (DWORD)val;
 		}
+		CommandLineSwitchCase(arg, "metrics-port")
+		{
+			errno = 0;
+			long val = strtol(arg->Value, nullptr, 0);
+
+			if ((errno != 0) || (val <= 0) || (val > UINT16_MAX))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+
+			server->metricsPort = (UINT16)val;
+		}
 		CommandLineSwitchCase(arg, "ipc-socket")
 		{
 			/* /bind-address is incompatible */
@@ -397,6 +408,18 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 			                               arg->Value != nullptr))
 				return fail_at(arg, COMMAND_LINE_ERROR);
 		}
+		CommandLineSwitchCase(arg, "ktls")
+		{
+			if (!freerdp_settings_set_bool(settings, FreeRDP_TlsKernelOffload,
+			                               arg->Value != nullptr))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+		}
+		CommandLineSwitchCase(arg, "tls-tickets")
+		{
+			if (!freerdp_settings_set_bool(settings, FreeRDP_TlsSessionTickets,
+			                               arg->Value != nullptr))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+		}
 		CommandLineSwitchCase(arg, "vmconnect")
 		{
 			if (!freerdp_settings_set_bool(settings, FreeRDP_VmConnectMode, arg->Value != nullptr))
@@ -725,6 +748,48 @@ static DWORD WINAPI shadow_server_thread(LPVOID arg)
 	return 0;
 }
 
+WINPR_ATTR_NODISCARD
+static char* shadow_server_export_metrics(void* arg, size_t* plength)
+{
+	rdpShadowServer* server = arg;
+	char* text = nullptr;
+
+	WINPR_ASSERT(server);
+
+	/* Clients leave the list before their context is freed */
+	ArrayList_Lock(server->clients);
+	const size_t count = ArrayList_Count(server->clients);
+	rdpMetrics** metrics = calloc(count + 1, sizeof(rdpMetrics*));
+	char** labels = calloc(count + 1, sizeof(char*));
+	if (!metrics || !labels)
+		goto fail;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const rdpShadowClient* client = ArrayList_GetItem(server->clients, x);
+		const freerdp_peer* peer = client->context.peer;
+		size_t len = 0;
+
+		metrics[x] = client->context.metrics;
+		if (winpr_asprintf(&labels[x], &len, "session=\"%" PRIuz "\",address=\"%s\"", x,
+		                   peer ? peer->hostname : "") < 0)
+			goto fail;
+	}
+
+	text = metrics_to_openmetrics(metrics, (const char* const*)labels, count, plength);
+
+fail:
+	ArrayList_Unlock(server->clients);
+	if (labels)
+	{
+		for (size_t x = 0; x < count; x++)
+			free(labels[x]);
+	}
+	free(labels);
+	free((void*)metrics);
+	return text;
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL open_port(rdpShadowServer* server, char* address)
 {
@@ -846,6 +911,17 @@ int shadow_server_start(rdpShadowServer* server)
 		}
 	}
 
+	if (server->metricsPort > 0)
+	{
+		server->metricsEndpoint = metrics_endpoint_new(nullptr, server->metricsPort,
+		                                               shadow_server_export_metrics, server);
+		if (!server->metricsEndpoint)
+		{
+			WLog_ERR(TAG, "Failed to serve metrics on port %" PRIu16, server->metricsPort);
+			return -1;
+		}
+	}
+
 	if (!(server->thread =
 	          CreateThread(nullptr, 0, shadow_server_thread, (void*)server, 0, nullptr)))
 	{
@@ -860,6 +936,9 @@ int shadow_server_stop(rdpShadowServer* server)
 	if (!server)
 		return -1;
 
+	metrics_endpoint_free(server->metricsEndpoint);
+	server->metricsEndpoint = nullptr;
+
 	if (server->thread)
 	{
 		(void)SetEvent(server->StopEvent);
@@ -0,0 +1,181 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+
+#include "../shadow_encode_stage.h"
+
+#define TEST_TIMEOUT 10000
+
+typedef struct
+{
+	HANDLE entered;
+	HANDLE release;
+	DWORD threadId;
+	volatile LONG calls;
+	BOOL queue;
+	BOOL result;
+} test_encoder_t;
+
+/* Stands in for the codecs, blocks until the test releases it */
+static BOOL test_encode(void* arg, BOOL* queued)
+{
+	test_encoder_t* encoder = arg;
+
+	encoder->threadId = GetCurrentThreadId();
+	(void)InterlockedIncrement(&encoder->calls);
+	(void)SetEvent(encoder->entered);
+
+	if (WaitForSingleObject(encoder->release, TEST_TIMEOUT) != WAIT_OBJECT_0)
+		return FALSE;
+	(void)ResetEvent(encoder->release);
+
+	*queued = encoder->queue;
+	return encoder->result;
+}
+
+static BOOL test_fail(const char* what)
+{
+	(void)fprintf(stderr, "%s\n", what);
+	return FALSE;
+}
+
+/* Waits for the running encode as the client thread does */
+static BOOL test_finish(rdpShadowEncodeStage* stage, BOOL expected)
+{
+	BOOL result = !expected;
+
+	if (WaitForSingleObject(shadow_encode_stage_get_event(stage), TEST_TIMEOUT) != WAIT_OBJECT_0)
+		return test_fail("the encode did not finish");
+	if (!shadow_encode_stage_check(stage, &result) || (result != expected))
+		return test_fail("unexpected encode result");
+	if (shadow_encode_stage_busy(stage))
+		return test_fail("busy after the encode finished");
+
+	/* A finished encode is collected once */
+	if (shadow_encode_stage_check(stage, &result))
+		return test_fail("an encode was collected twice");
+	return TRUE;
+}
+
+static BOOL test_run(rdpShadowEncodeStage* stage, test_encoder_t* encoder, BOOL expected)
+{
+	if (!shadow_encode_stage_start(stage))
+		return test_fail("the encode did not start");
+	(void)SetEvent(encoder->release);
+	return test_finish(stage, expected);
+}
+
+/* The caller goes on while a frame encodes, updates in the meantime do not start encodes */
+static BOOL test_decoupled(rdpShadowEncodeStage* stage, test_encoder_t* encoder)
+{
+	BOOL result = FALSE;
+
+	if (!shadow_encode_stage_start(stage))
+		return test_fail("the encode did not start");
+	if (WaitForSingleObject(encoder->entered, TEST_TIMEOUT) != WAIT_OBJECT_0)
+		return test_fail("the encode was not called");
+	(void)ResetEvent(encoder->entered);
+
+	if (encoder->threadId == GetCurrentThreadId())
+		return test_fail("the encode ran on the calling thread");
+	if (!shadow_encode_stage_busy(stage))
+		return test_fail("not busy while encoding");
+	if (shadow_encode_stage_check(stage, &result))
+		return test_fail("the encode finished before it was released");
+	if (shadow_encode_stage_start(stage) || shadow_encode_stage_start(stage))
+		return test_fail("an encode started while one was running");
+
+	(void)SetEvent(encoder->release);
+	if (!test_finish(stage, TRUE))
+		return FALSE;
+
+	/* The refused starts were not queued up behind the running encode */
+	Sleep(100);
+	if (InterlockedCompareExchange(&encoder->calls, 0, 0) != 1)
+		return test_fail("the encode ran more than once");
+	return TRUE;
+}
+
+/* Encoded frames that were not written yet hold off the next encode */
+static BOOL test_queue_limit(rdpShadowEncodeStage* stage, test_encoder_t* encoder)
+{
+	encoder->queue = FALSE;
+	for (size_t x = 0; x < 2 * SHADOW_ENCODE_STAGE_MAX_QUEUED_FRAMES; x++)
+	{
+		if (!test_run(stage, encoder, TRUE))
+			return FALSE;
+	}
+
+	encoder->queue = TRUE;
+	for (size_t x = 0; x < SHADOW_ENCODE_STAGE_MAX_QUEUED_FRAMES; x++)
+	{
+		if (!test_run(stage, encoder, TRUE))
+			return FALSE;
+	}
+	if (shadow_encode_stage_start(stage))
+		return test_fail("an encode started with the queue full");
+
+	shadow_encode_stage_frames_written(stage);
+	return test_run(stage, encoder, TRUE);
+}
+
+static BOOL test_failure(rdpShadowEncodeStage* stage, test_encoder_t* encoder)
+{
+	shadow_encode_stage_frames_written(stage);
+	encoder->queue = FALSE;
+	encoder->result = FALSE;
+	if (!test_run(stage, encoder, FALSE))
+		return FALSE;
+
+	/* The stage is still usable, the client decides to disconnect */
+	encoder->result = TRUE;
+	return test_run(stage, encoder, TRUE);
+}
+
+int TestShadowEncodeStage(int argc, char* argv[])
+{
+	int rc = -1;
+	rdpShadowEncodeStage* stage = nullptr;
+	test_encoder_t encoder = WINPR_C_ARRAY_INIT;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	encoder.entered = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	encoder.release = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	encoder.result = TRUE;
+	if (!encoder.entered || !encoder.release)
+		goto fail;
+
+	stage = shadow_encode_stage_new(test_encode, &encoder);
+	if (!stage)
+		goto fail;
+
+	if (shadow_encode_stage_busy(stage))
+		goto fail;
+	if (!test_decoupled(stage, &encoder))
+		goto fail;
+	if (!test_queue_limit(stage, &encoder))
+		goto fail;
+	if (!test_failure(stage, &encoder))
+		goto fail;
+
+	/* Freeing waits for a running encode */
+	if (!shadow_encode_stage_start(stage))
+		goto fail;
+	(void)SetEvent(encoder.release);
+	shadow_encode_stage_free(stage);
+	stage = nullptr;
+
+	rc = 0;
+fail:
+	shadow_encode_stage_free(stage);
+	if (encoder.entered)
+		(void)CloseHandle(encoder.entered);
+	if (encoder.release)
+		(void)CloseHandle(encoder.release);
+	return rc;
+}
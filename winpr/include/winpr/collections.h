@@ -816,6 +816,14 @@ extern "C"
 	WINPR_API void ObjectPool_Return(wObjectPool* pool, void* obj);
 	WINPR_API void ObjectPool_Clear(wObjectPool* pool);
 
+	/** @brief Get the number of objects cached in the pool
+	 *  @param pool The pool to query
+	 *  @return The number of objects available for \b ObjectPool_Take without allocation
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	WINPR_API size_t ObjectPool_GetPoolSize(wObjectPool* pool);
+
 	WINPR_ATTR_NODISCARD
 	WINPR_API wObject* ObjectPool_Object(wObjectPool* pool);
 
@@ -34,6 +34,10 @@ extern "C"
 #ifndef _WIN32
 
 #if !defined(WITHOUT_WINPR_3x_DEPRECATED)
+	/* The deprecated list types refer to each other, including this header must not warn
+	 * for callers only using the Interlocked functions. */
+	WINPR_PRAGMA_DIAG_PUSH
+	WINPR_PRAGMA_DIAG_IGNORED_DEPRECATED_DECL
 
 #ifndef CONTAINING_RECORD
 #define CONTAINING_RECORD(address, type, field) \
@@ -168,6 +172,8 @@ extern "C"
 
 	WINPR_DEPRECATED_VAR("[since 3.27.0]", WINPR_ATTR_NODISCARD WINPR_API USHORT
 	                                           QueryDepthSList(WINPR_PSLIST_HEADER ListHead));
+
+	WINPR_PRAGMA_DIAG_POP
 #endif /* WITHOUT_WINPR_3x_DEPRECATED */
 
 	WINPR_API LONG InterlockedIncrement(LONG volatile* Addend);
@@ -217,6 +223,9 @@ extern "C"
 #endif
 
 #if !defined(WITHOUT_WINPR_3x_DEPRECATED)
+	WINPR_PRAGMA_DIAG_PUSH
+	WINPR_PRAGMA_DIAG_IGNORED_DEPRECATED_DECL
+
 	/* Doubly-Linked List */
 	WINPR_DEPRECATED_VAR("[since 3.27.0]",
 	                     WINPR_API VOID InitializeListHead(WINPR_PLIST_ENTRY ListHead));
@@ -249,6 +258,8 @@ extern "C"
 
 	WINPR_DEPRECATED_VAR("[since 3.27.0]", WINPR_ATTR_NODISCARD WINPR_API WINPR_PSINGLE_LIST_ENTRY
 	                                           PopEntryList(WINPR_PSINGLE_LIST_ENTRY ListHead));
+
+	WINPR_PRAGMA_DIAG_POP
 #endif /* WITHOUT_WINPR_3x_DEPRECATED */
 
 #ifdef __cplusplus
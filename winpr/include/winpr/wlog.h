@@ -247,6 +247,46 @@ typedef struct
 	 */
 	WINPR_API BOOL WLog_SetGlobalContext(const char* globalprefix);
 
+	/** @brief Enable or disable asynchronous logging.
+	 *
+	 *  In asynchronous mode text, data and packet messages are copied to a lock free ring
+	 *  owned by the logging thread and written to the appenders by a background thread.
+	 *  If a ring is full new messages of that thread are dropped and counted, the drop is
+	 *  reported with the next drained batch. \b WLOG_FATAL messages, image messages and
+	 *  messages larger than a quarter of the ring are written synchronously after all queued
+	 *  messages. As the format string might not outlive the call, \b FormatString of queued
+	 *  text messages points to the formatted text.
+	 *
+	 *  The mode can also be enabled with the environment variable \b WLOG_ASYNC=1, the ring
+	 *  size with \b WLOG_ASYNC_RING_SIZE.
+	 *
+	 *  @param enable \b TRUE to enable, \b FALSE to disable (writes all queued messages)
+	 *  @param ringSize The size of rings created from now on in bytes, \b 0 keeps the current
+	 *  @return \b TRUE for success, \b FALSE otherwise.
+	 *  @since version 3.31.0
+	 */
+	WINPR_API BOOL WLog_SetAsync(BOOL enable, size_t ringSize);
+
+	/** @brief Check if asynchronous logging is enabled.
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	WINPR_API BOOL WLog_IsAsync(void);
+
+	/** @brief Write all messages queued by any thread before returning.
+	 *  @since version 3.31.0
+	 */
+	WINPR_API BOOL WLog_FlushAsync(void);
+
+	/** @brief Get the number of messages queued and dropped in asynchronous mode.
+	 *
+	 *  @param written Optional, receives the number of queued messages
+	 *  @param dropped Optional, receives the number of messages dropped due to full rings
+	 *  @return \b TRUE for success, \b FALSE otherwise.
+	 *  @since version 3.31.0
+	 */
+	WINPR_API BOOL WLog_GetAsyncStatistics(UINT64* written, UINT64* dropped);
+
 #define WLog_Print_unchecked(_log, _log_level, ...)                                         \
 	do                                                                                      \
 	{                                                                                       \
@@ -29,7 +29,25 @@ static const testcase_t unit_testcases[] = {
 	{ "✊🎅ęʥ꣸𑗊a", 19,
 	  (const WCHAR*)"\x0a\x27\x3c\xd8\x85\xdf\x19\x01\xa5\x02\xf8\xa8\x05\xd8\xca\xdd\x61\x00\x00"
 	                "\x00",
-	  9 }
+	  9 },
+	/* ASCII runs longer than a vector with multi byte characters at odd offsets */
+	{ "Lorem ipsum dolor sit amet, consectetur ç adipiscing elit ✊ sed do eiusmod tempor 🎅 "
+	  "incididunt a",
+	  102,
+	  (const WCHAR*)"\x4c\x00\x6f\x00\x72\x00\x65\x00\x6d\x00\x20\x00\x69\x00\x70\x00"
+	                "\x73\x00\x75\x00\x6d\x00\x20\x00\x64\x00\x6f\x00\x6c\x00\x6f\x00"
+	                "\x72\x00\x20\x00\x73\x00\x69\x00\x74\x00\x20\x00\x61\x00\x6d\x00"
+	                "\x65\x00\x74\x00\x2c\x00\x20\x00\x63\x00\x6f\x00\x6e\x00\x73\x00"
+	                "\x65\x00\x63\x00\x74\x00\x65\x00\x74\x00\x75\x00\x72\x00\x20\x00"
+	                "\xe7\x00\x20\x00\x61\x00\x64\x00\x69\x00\x70\x00\x69\x00\x73\x00"
+	                "\x63\x00\x69\x00\x6e\x00\x67\x00\x20\x00\x65\x00\x6c\x00\x69\x00"
+	                "\x74\x00\x20\x00\x0a\x27\x20\x00\x73\x00\x65\x00\x64\x00\x20\x00"
+	                "\x64\x00\x6f\x00\x20\x00\x65\x00\x69\x00\x75\x00\x73\x00\x6d\x00"
+	                "\x6f\x00\x64\x00\x20\x00\x74\x00\x65\x00\x6d\x00\x70\x00\x6f\x00"
+	                "\x72\x00\x20\x00\x3c\xd8\x85\xdf\x20\x00\x69\x00\x6e\x00\x63\x00"
+	                "\x69\x00\x64\x00\x69\x00\x64\x00\x75\x00\x6e\x00\x74\x00\x20\x00"
+	                "\x61\x00\x00\x00",
+	  97 }
 };
 
 static void create_prefix(char* prefix, size_t prefixlen, size_t buffersize, SSIZE_T rc,
@@ -45,9 +45,24 @@ See the header file "utf.h" for complete documentation.
 
 #include "unicode.h"
 
+#if !defined(__BIG_ENDIAN__)
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define UNICODE_SSE2
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define UNICODE_NEON
+#endif
+#endif
+
 #include "../log.h"
 #define TAG WINPR_TAG("unicode")
 
+#ifndef MIN
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+
 /*
  * Character Types:
  *
@@ -146,6 +161,96 @@ static WCHAR setWcharFrom(WCHAR w)
 
 /* --------------------------------------------------------------------- */
 
+/*
+ * Text is mostly ASCII, convert runs of it without decoding code points.
+ * SSE2 and NEON are part of the baseline of x86_64 and aarch64, no runtime
+ * detection is required. dst may be nullptr if only the length is computed.
+ * Returns the number of characters converted, the run ends at the first
+ * non ASCII character or after len characters.
+ */
+static size_t winpr_ConvertASCIItoUTF16(const uint8_t* src, size_t len, uint16_t* dst)
+{
+	size_t x = 0;
+
+#if defined(UNICODE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 16 <= len; x += 16)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i*)&src[x]);
+		if (_mm_movemask_epi8(v) != 0)
+			break;
+		if (dst)
+		{
+			_mm_storeu_si128((__m128i*)&dst[x], _mm_unpacklo_epi8(v, zero));
+			_mm_storeu_si128((__m128i*)&dst[x + 8], _mm_unpackhi_epi8(v, zero));
+		}
+	}
+#elif defined(UNICODE_NEON)
+	for (; x + 16 <= len; x += 16)
+	{
+		const uint8x16_t v = vld1q_u8(&src[x]);
+		if (vmaxvq_u8(v) >= 0x80)
+			break;
+		if (dst)
+		{
+			vst1q_u16(&dst[x], vmovl_u8(vget_low_u8(v)));
+			vst1q_u16(&dst[x + 8], vmovl_u8(vget_high_u8(v)));
+		}
+	}
+#endif
+
+	for (; x < len; x++)
+	{
+		if (src[x] >= 0x80)
+			break;
+		if (dst)
+			dst[x] = setWcharFrom(src[x]);
+	}
+	return x;
+}
+
+static size_t winpr_ConvertUTF16toASCII(const uint16_t* src, size_t len, uint8_t* dst)
+{
+	size_t x = 0;
+
+#if defined(UNICODE_SSE2)
+	const __m128i mask = _mm_set1_epi16((short)0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 16 <= len; x += 16)
+	{
+		const __m128i lo = _mm_loadu_si128((const __m128i*)&src[x]);
+		const __m128i hi = _mm_loadu_si128((const __m128i*)&src[x + 8]);
+		const __m128i high = _mm_and_si128(_mm_or_si128(lo, hi), mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF)
+			break;
+		if (dst)
+			_mm_storeu_si128((__m128i*)&dst[x], _mm_packus_epi16(lo, hi));
+	}
+#elif defined(UNICODE_NEON)
+	for (; x + 16 <= len; x += 16)
+	{
+		const uint16x8_t lo = vld1q_u16(&src[x]);
+		const uint16x8_t hi = vld1q_u16(&src[x + 8]);
+		if (vmaxvq_u16(vorrq_u16(lo, hi)) >= 0x80)
+			break;
+		if (dst)
+			vst1q_u8(&dst[x], vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+	}
+#endif
+
+	for (; x < len; x++)
+	{
+		const uint16_t ch = setWcharFrom(src[x]);
+		if (ch >= 0x80)
+			break;
+		if (dst)
+			dst[x] = (uint8_t)ch;
+	}
+	return x;
+}
+
+/* --------------------------------------------------------------------- */
+
 /* The interface converts a whole buffer to avoid function-call overhead.
  * Constants have been gathered. Loops & conditionals have been removed as
  * much as possible for efficiency, in favor of drop-through switches.
@@ -169,6 +274,20 @@ static ConversionResult winpr_ConvertUTF16toUTF8_Internal(const uint16_t** sourc
 
 	while (source < sourceEnd)
 	{
+		if (setWcharFrom(*source) < 0x80)
+		{
+			size_t len = WINPR_ASSERTING_INT_CAST(size_t, sourceEnd - source);
+			if (!computeLength)
+				len = MIN(len, WINPR_ASSERTING_INT_CAST(size_t, targetEnd - target));
+
+			const size_t count =
+			    winpr_ConvertUTF16toASCII(source, len, computeLength ? nullptr : target);
+			source += count;
+			target += count;
+			if (count > 0)
+				continue;
+		}
+
 		uint32_t ch = 0;
 		unsigned short bytesToWrite = 0;
 		const uint32_t byteMask = 0xBF;
@@ -419,6 +538,20 @@ static ConversionResult winpr_ConvertUTF8toUTF16_Internal(const uint8_t** source
 
 	while (source < sourceEnd)
 	{
+		if (*source < 0x80)
+		{
+			size_t len = WINPR_ASSERTING_INT_CAST(size_t, sourceEnd - source);
+			if (!computeLength)
+				len = MIN(len, WINPR_ASSERTING_INT_CAST(size_t, targetEnd - target));
+
+			const size_t count =
+			    winpr_ConvertASCIItoUTF16(source, len, computeLength ? nullptr : target);
+			source += count;
+			target += count;
+			if (count > 0)
+				continue;
+		}
+
 		uint32_t ch = 0;
 		unsigned short extraBytesToRead =
 		    WINPR_ASSERTING_INT_CAST(unsigned short, trailingBytesForUTF8[*source]);
@@ -130,6 +130,18 @@ wObject* ObjectPool_Object(wObjectPool* pool)
 	return &pool->object;
 }
 
+/**
+ * Gets the number of objects currently cached in the pool.
+ */
+
+size_t ObjectPool_GetPoolSize(wObjectPool* pool)
+{
+	ObjectPool_Lock(pool);
+	const size_t size = pool->size;
+	ObjectPool_Unlock(pool);
+	return size;
+}
+
 /**
  * Releases the buffers currently cached in the pool.
  */
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/wlog.h>
+
+#define TEST_THREADS 4
+#define TEST_MESSAGES 2000
+/* Every TEST_SYNC_INTERVAL message is fatal and written synchronously */
+#define TEST_SYNC_INTERVAL 500
+
+static const char* channel = "com.test.async";
+static UINT32 expected[TEST_THREADS] = { 0 };
+static size_t received = 0;
+static size_t receivedOther = 0;
+static size_t receivedData = 0;
+static size_t receivedSync = 0;
+static BOOL success = TRUE;
+
+static BOOL CallbackAppenderMessage(const wLogMessage* msg)
+{
+	unsigned thread = 0;
+	unsigned seq = 0;
+
+	/* Skip the report about dropped messages */
+	if (strcmp(msg->FunctionName, "test_thread") != 0)
+	{
+		receivedOther++;
+		return TRUE;
+	}
+
+	if ((sscanf(msg->TextString, "thread %u message %u", &thread, &seq) != 2) ||
+	    (thread >= TEST_THREADS))
+	{
+		(void)fprintf(stderr, "Invalid message '%s'\n", msg->TextString);
+		success = FALSE;
+		return TRUE;
+	}
+
+	/* Messages of a thread must arrive in order, drops only leave gaps */
+	if (seq < expected[thread])
+	{
+		(void)fprintf(stderr, "Thread %u message %u out of order, expected >= %" PRIu32 "\n",
+		              thread, seq, expected[thread]);
+		success = FALSE;
+	}
+	expected[thread] = seq + 1;
+	received++;
+	if (msg->Level == WLOG_FATAL)
+		receivedSync++;
+	return TRUE;
+}
+
+static DWORD WINAPI statistics_thread(LPVOID arg)
+{
+	WINPR_UNUSED(arg);
+
+	UINT64 written = 0;
+	UINT64 dropped = 0;
+	if (!WLog_GetAsyncStatistics(&written, &dropped))
+		success = FALSE;
+
+	ExitThread(0);
+	return 0;
+}
+
+static BOOL CallbackAppenderData(const wLogMessage* msg)
+{
+	const BYTE* data = msg->Data;
+	if ((msg->Length != 4) || (data[0] != 1) || (data[3] != 4))
+		success = FALSE;
+	receivedData++;
+
+	/* The queued message is written by the drainer, which must not hold the lock of the
+	 * ring list while calling the appender */
+	HANDLE thread = CreateThread(nullptr, 0, statistics_thread, nullptr, 0, nullptr);
+	if (!thread || (WaitForSingleObject(thread, 5000) != WAIT_OBJECT_0))
+	{
+		(void)fprintf(stderr, "statistics blocked while writing a queued message\n");
+		success = FALSE;
+	}
+	if (thread)
+		(void)CloseHandle(thread);
+	return TRUE;
+}
+
+static BOOL CallbackAppenderImage(const wLogMessage* msg)
+{
+	WINPR_UNUSED(msg);
+	return TRUE;
+}
+
+static BOOL CallbackAppenderPackage(const wLogMessage* msg)
+{
+	WINPR_UNUSED(msg);
+	return TRUE;
+}
+
+static DWORD WINAPI test_thread(LPVOID arg)
+{
+	const size_t index = (size_t)arg;
+	wLog* log = WLog_Get(channel);
+
+	for (size_t x = 0; x < TEST_MESSAGES; x++)
+	{
+		/* A synchronous message must come after everything the thread queued before */
+		const DWORD level = ((x + 1) % TEST_SYNC_INTERVAL) == 0 ? WLOG_FATAL : WLOG_INFO;
+		WLog_Print(log, level, "thread %" PRIuz " message %" PRIuz, index, x);
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+static BOOL run_threads(void)
+{
+	HANDLE threads[TEST_THREADS] = { 0 };
+	BOOL rc = TRUE;
+
+	for (size_t x = 0; x < TEST_THREADS; x++)
+	{
+		threads[x] = CreateThread(nullptr, 0, test_thread, (void*)x, 0, nullptr);
+		if (!threads[x])
+			rc = FALSE;
+	}
+
+	for (size_t x = 0; x < TEST_THREADS; x++)
+	{
+		if (!threads[x])
+			continue;
+		if (WaitForSingleObject(threads[x], INFINITE) != WAIT_OBJECT_0)
+			rc = FALSE;
+		(void)CloseHandle(threads[x]);
+	}
+	return rc;
+}
+
+int TestWLogAsync(int argc, char* argv[])
+{
+	wLogCallbacks callbacks = { 0 };
+	const BYTE data[] = { 1, 2, 3, 4 };
+	UINT64 written = 0;
+	UINT64 dropped = 0;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	wLog* root = WLog_GetRoot();
+	if (!WLog_SetLogAppenderType(root, WLOG_APPENDER_CALLBACK))
+		return -1;
+
+	wLogAppender* appender = WLog_GetLogAppender(root);
+	callbacks.data = CallbackAppenderData;
+	callbacks.image = CallbackAppenderImage;
+	callbacks.message = CallbackAppenderMessage;
+	callbacks.package = CallbackAppenderPackage;
+
+	if (!WLog_ConfigureAppender(appender, "callbacks", (void*)&callbacks))
+		return -1;
+	if (!WLog_OpenAppender(root))
+		return -1;
+
+	wLog* log = WLog_Get(channel);
+	if (!WLog_SetLogLevel(log, WLOG_TRACE))
+		return -1;
+
+	if (!WLog_SetAsync(TRUE, 16384) || !WLog_IsAsync())
+		return -1;
+
+	if (!run_threads())
+		return -1;
+
+	WLog_Data(log, WLOG_DEBUG, data, sizeof(data));
+
+	/* Disabling writes everything still queued */
+	if (!WLog_SetAsync(FALSE, 0) || WLog_IsAsync())
+		return -1;
+
+	if (!WLog_GetAsyncStatistics(&written, &dropped))
+		return -1;
+	(void)printf("queued %" PRIu64 " messages, dropped %" PRIu64 "\n", written, dropped);
+
+	if (received + dropped != TEST_THREADS * TEST_MESSAGES)
+	{
+		(void)fprintf(stderr, "received %" PRIuz " + dropped %" PRIu64 " != %d\n", received,
+		              dropped, TEST_THREADS * TEST_MESSAGES);
+		return -1;
+	}
+
+	if (receivedSync != TEST_THREADS * (TEST_MESSAGES / TEST_SYNC_INTERVAL))
+	{
+		(void)fprintf(stderr, "received %" PRIuz " synchronous messages\n", receivedSync);
+		return -1;
+	}
+
+	/* All queued messages were written, only the data message is not counted in received */
+	if ((written != received - receivedSync + receivedData) || (receivedData != 1))
+	{
+		(void)fprintf(stderr,
+		              "written %" PRIu64 " != received %" PRIuz " - %" PRIuz " + %" PRIuz "\n",
+		              written, received, receivedSync, receivedData);
+		return -1;
+	}
+
+	/* Back in synchronous mode messages are written immediately */
+	const size_t other = receivedOther;
+	WLog_Print(log, WLOG_INFO, "synchronous");
+	if (receivedOther != other + 1)
+		success = FALSE;
+
+	if (!WLog_CloseAppender(root))
+		return -1;
+
+	return success ? 0 : -1;
+}
@@ -0,0 +1,652 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * WinPR Logger - asynchronous message queue
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/crt.h>
+#include <winpr/assert.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/environment.h>
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#include "wlog.h"
+#include "AsyncLog.h"
+#include "../../log.h"
+
+#define TAG WINPR_TAG("utils.wlog")
+
+/**
+ * Every thread logging in asynchronous mode owns a single producer, single consumer
+ * ring of variable sized records. The producer only advances Head, the consumer only
+ * advances Tail, so queueing a message does not need any lock.
+ * The consumer of a ring is either the background drainer or the owning thread writing
+ * its own queued messages before a synchronous one, they serialize on the Lock of the
+ * ring. g_Lock protects the list of rings, g_DrainLock serializes the background drainer
+ * and explicit flushes. Appenders are never called with g_Lock held, so a thread logging
+ * for the first time does not wait for the I/O of the drainer.
+ */
+typedef struct
+{
+	UINT32 Size; /* record size including the header, 0 marks the unused end of the ring */
+	DWORD Type;
+	DWORD Level;
+	DWORD PacketFlags;
+	wLog* Log;
+	size_t LineNumber;
+	LPCSTR FileName;
+	LPCSTR FunctionName;
+	size_t Length;
+	size_t ThreadId;
+	SYSTEMTIME Time;
+} wLogAsyncRecord;
+
+typedef struct s_wLogAsyncRing wLogAsyncRing;
+
+struct s_wLogAsyncRing
+{
+	BYTE* Buffer;
+	size_t Size;
+	volatile LONGLONG Head; /* only written by the owning thread */
+	volatile LONGLONG Tail; /* only written with Lock held */
+	volatile LONGLONG Written;
+	volatile LONGLONG Dropped;
+	LONGLONG Reported;
+	volatile LONG Abandoned;
+	BOOL Retired; /* only used with g_DrainLock held */
+	size_t ThreadId;
+	CRITICAL_SECTION Lock;
+	/* Record written by the owning thread while it drains its own ring */
+	const wLogAsyncRecord* Origin;
+	wLogAsyncRing* Next;
+};
+
+static INIT_ONCE g_AsyncInitialized = INIT_ONCE_STATIC_INIT;
+static BOOL g_AsyncReady = FALSE;
+static CRITICAL_SECTION g_Lock;
+static CRITICAL_SECTION g_DrainLock;
+static wLogAsyncRing* g_Rings = nullptr;
+static UINT64 g_RetiredWritten = 0;
+static UINT64 g_RetiredDropped = 0;
+static size_t g_RingSize = WLOG_ASYNC_DEFAULT_RING_SIZE;
+
+static volatile LONG g_EnvironmentChecked = FALSE;
+static volatile LONG g_Enabled = FALSE;
+static volatile LONG g_Stop = FALSE;
+static HANDLE g_Thread = nullptr;
+static HANDLE g_Event = nullptr;
+
+static volatile DWORD g_DrainingThread = 0;
+static const wLogAsyncRecord* g_Origin = nullptr;
+
+#if defined(_WIN32)
+static DWORD g_Key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t g_Key;
+#endif
+
+static LONGLONG ring_load(volatile LONGLONG* value)
+{
+	return InterlockedCompareExchange64(value, 0, 0);
+}
+
+static void ring_store(volatile LONGLONG* value, LONGLONG newValue)
+{
+	/* Every field is only ever written by a single thread, so the first exchange succeeds.
+	 * It serves as a full memory barrier. */
+	LONGLONG old = *value;
+	LONGLONG prev = 0;
+	while ((prev = InterlockedCompareExchange64(value, newValue, old)) != old)
+		old = prev;
+}
+
+static void flag_store(volatile LONG* flag, LONG value)
+{
+	LONG old = *flag;
+	LONG prev = 0;
+	while ((prev = InterlockedCompareExchange(flag, value, old)) != old)
+		old = prev;
+}
+
+#if defined(_WIN32)
+static VOID WINAPI wlog_async_thread_exit(PVOID arg)
+#else
+static void wlog_async_thread_exit(void* arg)
+#endif
+{
+	wLogAsyncRing* ring = arg;
+	if (ring)
+		flag_store(&ring->Abandoned, TRUE);
+}
+
+static BOOL CALLBACK wlog_async_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+
+#if defined(_WIN32)
+	g_Key = FlsAlloc(wlog_async_thread_exit);
+	if (g_Key == FLS_OUT_OF_INDEXES)
+		return FALSE;
+#else
+	if (pthread_key_create(&g_Key, wlog_async_thread_exit) != 0)
+		return FALSE;
+#endif
+
+	if (!InitializeCriticalSectionAndSpinCount(&g_Lock, 4000))
+		return FALSE;
+	if (!InitializeCriticalSectionAndSpinCount(&g_DrainLock, 4000))
+	{
+		DeleteCriticalSection(&g_Lock);
+		return FALSE;
+	}
+
+	g_AsyncReady = TRUE;
+	return TRUE;
+}
+
+static BOOL wlog_async_initialize(void)
+{
+	if (!InitOnceExecuteOnce(&g_AsyncInitialized, wlog_async_init, nullptr, nullptr))
+		return FALSE;
+	return g_AsyncReady;
+}
+
+static size_t wlog_async_ring_size(size_t size)
+{
+	size_t rounded = WLOG_ASYNC_MIN_RING_SIZE;
+	while ((rounded < size) && (rounded < WLOG_ASYNC_MAX_RING_SIZE))
+		rounded <<= 1;
+	return rounded;
+}
+
+static void wlog_async_ring_free(wLogAsyncRing* ring)
+{
+	if (!ring)
+		return;
+
+	g_RetiredWritten += (UINT64)ring_load(&ring->Written);
+	g_RetiredDropped += (UINT64)ring_load(&ring->Dropped);
+	DeleteCriticalSection(&ring->Lock);
+	free(ring->Buffer);
+	free(ring);
+}
+
+static wLogAsyncRing* wlog_async_find_ring(void)
+{
+#if defined(_WIN32)
+	return FlsGetValue(g_Key);
+#else
+	return pthread_getspecific(g_Key);
+#endif
+}
+
+static wLogAsyncRing* wlog_async_get_ring(void)
+{
+	wLogAsyncRing* ring = wlog_async_find_ring();
+	if (ring)
+		return ring;
+
+	ring = calloc(1, sizeof(wLogAsyncRing));
+	if (!ring)
+		return nullptr;
+
+	ring->Size = g_RingSize;
+	ring->ThreadId = WLog_Layout_GetThreadId();
+	ring->Buffer = malloc(ring->Size);
+	if (!ring->Buffer)
+		goto fail;
+
+	if (!InitializeCriticalSectionAndSpinCount(&ring->Lock, 4000))
+		goto fail;
+
+#if defined(_WIN32)
+	if (!FlsSetValue(g_Key, ring))
+		goto fail_lock;
+#else
+	if (pthread_setspecific(g_Key, ring) != 0)
+		goto fail_lock;
+#endif
+
+	EnterCriticalSection(&g_Lock);
+	ring->Next = g_Rings;
+	g_Rings = ring;
+	LeaveCriticalSection(&g_Lock);
+	return ring;
+
+fail_lock:
+	DeleteCriticalSection(&ring->Lock);
+fail:
+	free(ring->Buffer);
+	free(ring);
+	return nullptr;
+}
+
+static void wlog_async_dispatch(const wLogAsyncRecord* record, const wLogAsyncRecord** origin)
+{
+	WINPR_ASSERT(record);
+
+	const BYTE* payload = (const BYTE*)&record[1];
+	wLogMessage message = WINPR_C_ARRAY_INIT;
+	message.Type = record->Type;
+	message.Level = record->Level;
+	message.LineNumber = record->LineNumber;
+	message.FileName = record->FileName;
+	message.FunctionName = record->FunctionName;
+
+	switch (record->Type)
+	{
+		case WLOG_MESSAGE_TEXT:
+			/* The format string may not outlive the call, only the formatted text is kept */
+			message.FormatString = (const char*)payload;
+			message.TextString = (const char*)payload;
+			break;
+		case WLOG_MESSAGE_DATA:
+			message.Data = WINPR_CAST_CONST_PTR_AWAY(payload, void*);
+			message.Length = record->Length;
+			break;
+		case WLOG_MESSAGE_PACKET:
+			message.PacketData = WINPR_CAST_CONST_PTR_AWAY(payload, void*);
+			message.PacketLength = record->Length;
+			message.PacketFlags = record->PacketFlags;
+			break;
+		default:
+			return;
+	}
+
+	*origin = record;
+	(void)WLog_WriteMessage(record->Log, &message);
+	*origin = nullptr;
+}
+
+/* The caller is the background drainer (origin is g_Origin) or the owner of the ring
+ * (origin is its Origin) */
+static void wlog_async_drain_ring(wLogAsyncRing* ring, const wLogAsyncRecord** origin)
+{
+	WINPR_ASSERT(ring);
+	WINPR_ASSERT(origin);
+
+	EnterCriticalSection(&ring->Lock);
+	LONGLONG tail = ring->Tail;
+	const LONGLONG head = ring_load(&ring->Head);
+	while (tail < head)
+	{
+		const size_t offset = (size_t)tail & (ring->Size - 1);
+		const wLogAsyncRecord* record = (const wLogAsyncRecord*)&ring->Buffer[offset];
+		if (record->Size == 0)
+		{
+			tail += (LONGLONG)(ring->Size - offset);
+			continue;
+		}
+
+		wlog_async_dispatch(record, origin);
+		tail += record->Size;
+		ring_store(&ring->Tail, tail);
+	}
+	ring_store(&ring->Tail, tail);
+
+	/* The owner would queue the report on its own ring, leave it to the drainer */
+	const LONGLONG dropped = ring_load(&ring->Dropped);
+	if ((origin == &g_Origin) && (dropped != ring->Reported))
+	{
+		WLog_WARN(TAG, "dropped %" PRId64 " log messages of thread %08" PRIxz,
+		          dropped - ring->Reported, ring->ThreadId);
+		ring->Reported = dropped;
+	}
+	LeaveCriticalSection(&ring->Lock);
+}
+
+static void wlog_async_drain(void)
+{
+	EnterCriticalSection(&g_DrainLock);
+	g_DrainingThread = GetCurrentThreadId();
+
+	/* New rings are only added in front of the list and only the drainer removes rings, so
+	 * the rings following the current head stay valid after g_Lock is released. */
+	EnterCriticalSection(&g_Lock);
+	wLogAsyncRing* first = g_Rings;
+	LeaveCriticalSection(&g_Lock);
+
+	BOOL retire = FALSE;
+	for (wLogAsyncRing* ring = first; ring; ring = ring->Next)
+	{
+		/* Check before draining: once set, the owner will not queue anything else */
+		ring->Retired = InterlockedCompareExchange(&ring->Abandoned, 0, 0) != 0;
+		wlog_async_drain_ring(ring, &g_Origin);
+		if (ring->Retired)
+			retire = TRUE;
+	}
+
+	if (retire)
+	{
+		EnterCriticalSection(&g_Lock);
+		wLogAsyncRing** pring = &g_Rings;
+		while (*pring)
+		{
+			wLogAsyncRing* ring = *pring;
+			if (ring->Retired)
+			{
+				*pring = ring->Next;
+				wlog_async_ring_free(ring);
+			}
+			else
+				pring = &ring->Next;
+		}
+		LeaveCriticalSection(&g_Lock);
+	}
+
+	g_DrainingThread = 0;
+	LeaveCriticalSection(&g_DrainLock);
+}
+
+static DWORD WINAPI wlog_async_thread(LPVOID arg)
+{
+	WINPR_UNUSED(arg);
+
+	do
+	{
+		if (WaitForSingleObject(g_Event, WLOG_ASYNC_DRAIN_INTERVAL) == WAIT_OBJECT_0)
+			(void)ResetEvent(g_Event);
+		wlog_async_drain();
+	} while (!InterlockedCompareExchange(&g_Stop, 0, 0));
+
+	ExitThread(0);
+	return 0;
+}
+
+static BOOL wlog_async_payload(const wLogMessage* message, const void** payload, size_t* length)
+{
+	WINPR_ASSERT(message);
+	WINPR_ASSERT(payload);
+	WINPR_ASSERT(length);
+
+	switch (message->Type)
+	{
+		case WLOG_MESSAGE_TEXT:
+			*payload = message->TextString;
+			*length = strlen(message->TextString) + 1;
+			return TRUE;
+		case WLOG_MESSAGE_DATA:
+			*payload = message->Data;
+			*length = message->Length;
+			return TRUE;
+		case WLOG_MESSAGE_PACKET:
+			*payload = message->PacketData;
+			*length = message->PacketLength;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+BOOL WLog_Async_Enqueue(wLog* log, const wLogMessage* message)
+{
+	WINPR_ASSERT(message);
+
+	if (!g_Enabled || !log)
+		return FALSE;
+
+	/* Messages written while draining, e.g. by an appender, are not queued again.
+	 * Independent loggers might be discarded while their messages are still queued. */
+	if ((g_DrainingThread == GetCurrentThreadId()) || log->independent)
+		return FALSE;
+
+	wLogAsyncRing* ring = wlog_async_find_ring();
+	if (ring && ring->Origin)
+		return FALSE;
+
+	const void* payload = nullptr;
+	size_t length = 0;
+	if (!wlog_async_payload(message, &payload, &length) || (message->Level >= WLOG_FATAL))
+		goto sync;
+
+	ring = wlog_async_get_ring();
+	if (!ring)
+		goto sync;
+
+	const size_t size = (sizeof(wLogAsyncRecord) + length + 7ull) & ~7ull;
+	if (size > ring->Size / 4)
+		goto sync;
+
+	LONGLONG head = ring->Head;
+	const LONGLONG tail = ring_load(&ring->Tail);
+	size_t offset = (size_t)head & (ring->Size - 1);
+	const size_t contiguous = ring->Size - offset;
+	const size_t needed = (contiguous < size) ? contiguous + size : size;
+
+	if ((size_t)(head - tail) + needed > ring->Size)
+	{
+		ring_store(&ring->Dropped, ring->Dropped + 1);
+		(void)SetEvent(g_Event);
+		return TRUE;
+	}
+
+	if (contiguous < size)
+	{
+		wLogAsyncRecord* wrap = (wLogAsyncRecord*)&ring->Buffer[offset];
+		wrap->Size = 0;
+		head += (LONGLONG)contiguous;
+		offset = 0;
+	}
+
+	wLogAsyncRecord* record = (wLogAsyncRecord*)&ring->Buffer[offset];
+	record->Size = (UINT32)size;
+	record->Type = message->Type;
+	record->Level = message->Level;
+	record->PacketFlags = message->PacketFlags;
+	record->Log = log;
+	record->LineNumber = message->LineNumber;
+	record->FileName = message->FileName;
+	record->FunctionName = message->FunctionName;
+	record->Length = length;
+	record->ThreadId = ring->ThreadId;
+	GetLocalTime(&record->Time);
+	if (length > 0)
+		memcpy(&record[1], payload, length);
+
+	head += (LONGLONG)size;
+	ring_store(&ring->Head, head);
+	ring_store(&ring->Written, ring->Written + 1);
+
+	/* Only wake up the drainer early if the ring fills up */
+	if ((size_t)(head - tail) > ring->Size / 2)
+		(void)SetEvent(g_Event);
+	return TRUE;
+
+sync:
+	/* Keep the order of messages of this thread: write what it queued first. Messages of
+	 * other threads stay queued. */
+	if (ring)
+		wlog_async_drain_ring(ring, &ring->Origin);
+	return FALSE;
+}
+
+BOOL WLog_Async_GetOrigin(SYSTEMTIME* time, size_t* tid)
+{
+	WINPR_ASSERT(time);
+	WINPR_ASSERT(tid);
+
+	const wLogAsyncRecord* origin = nullptr;
+	if (g_DrainingThread == GetCurrentThreadId())
+		origin = g_Origin;
+	else if (g_AsyncReady)
+	{
+		const wLogAsyncRing* ring = wlog_async_find_ring();
+		if (ring)
+			origin = ring->Origin;
+	}
+
+	if (!origin)
+		return FALSE;
+
+	*time = origin->Time;
+	*tid = origin->ThreadId;
+	return TRUE;
+}
+
+BOOL WLog_SetAsync(BOOL enable, size_t ringSize)
+{
+	if (!wlog_async_initialize())
+		return FALSE;
+
+	if (ringSize != 0)
+		g_RingSize = wlog_async_ring_size(ringSize);
+
+	if (enable)
+	{
+		if (g_Thread)
+			return TRUE;
+
+		flag_store(&g_Stop, FALSE);
+		g_Event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+		if (!g_Event)
+			return FALSE;
+
+		g_Thread = CreateThread(nullptr, 0, wlog_async_thread, nullptr, 0, nullptr);
+		if (!g_Thread)
+		{
+			(void)CloseHandle(g_Event);
+			g_Event = nullptr;
+			return FALSE;
+		}
+
+		flag_store(&g_Enabled, TRUE);
+		return TRUE;
+	}
+
+	if (!g_Thread)
+		return TRUE;
+
+	flag_store(&g_Enabled, FALSE);
+	flag_store(&g_Stop, TRUE);
+	(void)SetEvent(g_Event);
+	(void)WaitForSingleObject(g_Thread, INFINITE);
+	(void)CloseHandle(g_Thread);
+	(void)CloseHandle(g_Event);
+	g_Thread = nullptr;
+	g_Event = nullptr;
+
+	wlog_async_drain();
+	return TRUE;
+}
+
+BOOL WLog_IsAsync(void)
+{
+	return g_Enabled != 0;
+}
+
+BOOL WLog_FlushAsync(void)
+{
+	if (!wlog_async_initialize())
+		return FALSE;
+
+	wlog_async_drain();
+	return TRUE;
+}
+
+BOOL WLog_GetAsyncStatistics(UINT64* written, UINT64* dropped)
+{
+	if (!wlog_async_initialize())
+		return FALSE;
+
+	EnterCriticalSection(&g_Lock);
+	UINT64 w = g_RetiredWritten;
+	UINT64 d = g_RetiredDropped;
+	for (wLogAsyncRing* ring = g_Rings; ring; ring = ring->Next)
+	{
+		w += (UINT64)ring_load(&ring->Written);
+		d += (UINT64)ring_load(&ring->Dropped);
+	}
+	LeaveCriticalSection(&g_Lock);
+
+	if (written)
+		*written = w;
+	if (dropped)
+		*dropped = d;
+	return TRUE;
+}
+
+void WLog_Async_InitializeFromEnvironment(void)
+{
+	if (InterlockedCompareExchange(&g_EnvironmentChecked, TRUE, FALSE))
+		return;
+
+	char* env = GetEnvAlloc("WLOG_ASYNC");
+	if (!env)
+		return;
+
+	const BOOL enable = (_stricmp(env, "1") == 0) || (_stricmp(env, "ON") == 0) ||
+	                    (_stricmp(env, "TRUE") == 0);
+	free(env);
+	if (!enable)
+		return;
+
+	size_t ringSize = 0;
+	env = GetEnvAlloc("WLOG_ASYNC_RING_SIZE");
+	if (env)
+	{
+		errno = 0;
+		const unsigned long long val = strtoull(env, nullptr, 0);
+		if (errno == 0)
+			ringSize = (size_t)val;
+		free(env);
+	}
+
+	if (!WLog_SetAsync(TRUE, ringSize))
+		(void)fprintf(stderr, "Failed to enable asynchronous logging\n");
+}
+
+void WLog_Async_Uninit(void)
+{
+	if (!g_AsyncReady)
+		return;
+
+	(void)WLog_SetAsync(FALSE, 0);
+
+	/* The thread exit callbacks must not run once the rings are gone */
+#if defined(_WIN32)
+	(void)FlsFree(g_Key);
+	g_Key = FLS_OUT_OF_INDEXES;
+#else
+	(void)pthread_key_delete(g_Key);
+#endif
+
+	wlog_async_drain();
+
+	EnterCriticalSection(&g_Lock);
+	while (g_Rings)
+	{
+		wLogAsyncRing* ring = g_Rings;
+		g_Rings = ring->Next;
+		wlog_async_ring_free(ring);
+	}
+	g_AsyncReady = FALSE;
+	LeaveCriticalSection(&g_Lock);
+	DeleteCriticalSection(&g_Lock);
+	DeleteCriticalSection(&g_DrainLock);
+}
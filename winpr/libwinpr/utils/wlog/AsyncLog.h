@@ -0,0 +1,51 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * WinPR Logger - asynchronous message queue
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_WLOG_ASYNC_LOG_PRIVATE_H
+#define WINPR_WLOG_ASYNC_LOG_PRIVATE_H
+
+#include "wlog.h"
+
+/** Default size of the per thread ring in bytes */
+#define WLOG_ASYNC_DEFAULT_RING_SIZE (128ull * 1024ull)
+#define WLOG_ASYNC_MIN_RING_SIZE (4ull * 1024ull)
+#define WLOG_ASYNC_MAX_RING_SIZE (64ull * 1024ull * 1024ull)
+/** Interval in ms the background thread drains the rings without being woken up */
+#define WLOG_ASYNC_DRAIN_INTERVAL 10
+
+/** @brief Queue a message on the ring of the calling thread
+ *
+ *  @return \b TRUE if the message was queued (or dropped because the ring is full),
+ *          \b FALSE if the caller must write the message synchronously.
+ */
+WINPR_ATTR_NODISCARD
+WINPR_LOCAL BOOL WLog_Async_Enqueue(wLog* log, const wLogMessage* message);
+
+/** @brief Timestamp and thread id of the message currently written by the drainer
+ *
+ *  @return \b TRUE if called while writing a queued message, \b FALSE otherwise.
+ */
+WINPR_ATTR_NODISCARD
+WINPR_LOCAL BOOL WLog_Async_GetOrigin(SYSTEMTIME* time, size_t* tid);
+
+/** @brief Enable asynchronous logging if requested by WLOG_ASYNC, only checked once */
+WINPR_LOCAL void WLog_Async_InitializeFromEnvironment(void);
+
+/** @brief Stop the drainer, write all queued messages and release the rings */
+WINPR_LOCAL void WLog_Async_Uninit(void);
+
+#endif /* WINPR_WLOG_ASYNC_LOG_PRIVATE_H */
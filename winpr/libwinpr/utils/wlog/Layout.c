@@ -32,6 +32,7 @@
 #include "wlog.h"
 
 #include "Layout.h"
+#include "AsyncLog.h"
 
 #if defined __linux__ && !defined ANDROID
 #include <unistd.h>
@@ -46,6 +47,7 @@ struct format_option_recurse;
 
 struct format_tid_arg
 {
+	size_t id;
 	char tid[32];
 };
 
@@ -97,18 +99,22 @@ static void WLog_PrintMessagePrefix(char* prefix, size_t prefixlen,
 	va_end(args);
 }
 
-static const char* get_tid(void* arg)
+size_t WLog_Layout_GetThreadId(void)
 {
-	struct format_tid_arg* targ = arg;
-	WINPR_ASSERT(targ);
-
-	size_t tid = 0;
 #if defined __linux__ && !defined ANDROID
 	/* On Linux we prefer to see the LWP id */
-	tid = (size_t)syscall(SYS_gettid);
+	return (size_t)syscall(SYS_gettid);
 #else
-	tid = (size_t)GetCurrentThreadId();
+	return (size_t)GetCurrentThreadId();
 #endif
+}
+
+static const char* get_tid(void* arg)
+{
+	struct format_tid_arg* targ = arg;
+	WINPR_ASSERT(targ);
+
+	const size_t tid = (targ->id != 0) ? targ->id : WLog_Layout_GetThreadId();
 	(void)_snprintf(targ->tid, sizeof(targ->tid), "%08" PRIxz, tid);
 	return targ->tid;
 }
@@ -252,8 +258,10 @@ BOOL WLog_Layout_GetMessagePrefix(wLog* log, wLogLayout* layout, const wLogMessa
 
 	struct format_tid_arg targ = WINPR_C_ARRAY_INIT;
 
+	/* Queued messages are stamped with the time and thread they were logged from */
 	SYSTEMTIME localTime = WINPR_C_ARRAY_INIT;
-	GetLocalTime(&localTime);
+	if (!WLog_Async_GetOrigin(&localTime, &targ.id))
+		GetLocalTime(&localTime);
 
 	struct format_option_recurse recurse = {
 		.options = nullptr, .nroptions = 0, .log = log, .layout = layout, .message = message
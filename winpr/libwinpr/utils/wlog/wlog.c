@@ -38,6 +38,7 @@
 #endif
 
 #include "wlog.h"
+#include "AsyncLog.h"
 #include "../log.h"
 
 #define WLOG_MAX_STRING_SIZE 16384
@@ -85,6 +86,8 @@ static void WLog_Uninit_(void)
 	if (!root)
 		return;
 
+	WLog_Async_Uninit();
+
 	for (DWORD index = 0; index < root->ChildrenCount; index++)
 	{
 		child = root->Children[index];
@@ -230,6 +233,9 @@ out:
 
 static BOOL WLog_Write(wLog* log, const wLogMessage* message)
 {
+	if (WLog_Async_Enqueue(log, message))
+		return TRUE;
+
 	BOOL status = FALSE;
 	wLogAppender* appender = WLog_GetLogAppender(log);
 
@@ -260,6 +266,9 @@ static BOOL WLog_Write(wLog* log, const wLogMessage* message)
 
 static BOOL WLog_WriteData(wLog* log, const wLogMessage* message)
 {
+	if (WLog_Async_Enqueue(log, message))
+		return TRUE;
+
 	BOOL status = 0;
 	wLogAppender* appender = WLog_GetLogAppender(log);
 
@@ -290,6 +299,9 @@ static BOOL WLog_WriteData(wLog* log, const wLogMessage* message)
 
 static BOOL WLog_WriteImage(wLog* log, wLogMessage* message)
 {
+	if (WLog_Async_Enqueue(log, message))
+		return TRUE;
+
 	BOOL status = 0;
 	wLogAppender* appender = nullptr;
 	appender = WLog_GetLogAppender(log);
@@ -321,6 +333,9 @@ static BOOL WLog_WriteImage(wLog* log, wLogMessage* message)
 
 static BOOL WLog_WritePacket(wLog* log, wLogMessage* message)
 {
+	if (WLog_Async_Enqueue(log, message))
+		return TRUE;
+
 	BOOL status = 0;
 	wLogAppender* appender = nullptr;
 	appender = WLog_GetLogAppender(log);
@@ -350,6 +365,25 @@ static BOOL WLog_WritePacket(wLog* log, wLogMessage* message)
 	return status;
 }
 
+BOOL WLog_WriteMessage(wLog* log, wLogMessage* message)
+{
+	WINPR_ASSERT(message);
+
+	switch (message->Type)
+	{
+		case WLOG_MESSAGE_TEXT:
+			return WLog_Write(log, message);
+		case WLOG_MESSAGE_DATA:
+			return WLog_WriteData(log, message);
+		case WLOG_MESSAGE_IMAGE:
+			return WLog_WriteImage(log, message);
+		case WLOG_MESSAGE_PACKET:
+			return WLog_WritePacket(log, message);
+		default:
+			return FALSE;
+	}
+}
+
 static BOOL WLog_PrintTextMessageInternal(wLog* log, const wLogMessage* cmessage, va_list args)
 {
 	assert(cmessage);
@@ -955,6 +989,8 @@ wLog* WLog_GetRoot(void)
 	if (!InitOnceExecuteOnce(&g_WLogInitialized, WLog_InitializeRoot, nullptr, nullptr))
 		return nullptr;
 
+	/* Not part of WLog_InitializeRoot, starting the drainer thread might log itself */
+	WLog_Async_InitializeFromEnvironment();
 	return g_RootLog;
 }
 
@@ -85,9 +85,21 @@ WINPR_LOCAL BOOL WLog_Layout_GetMessagePrefix(wLog* log, wLogLayout* layout,
                                               const wLogMessage* message, char* prefix,
                                               size_t prefixlen);
 
+WINPR_ATTR_NODISCARD
+WINPR_LOCAL size_t WLog_Layout_GetThreadId(void);
+
 WINPR_ATTR_NODISCARD
 WINPR_LOCAL const char* WLog_GetGlobalPrefix(void);
 
+/** @brief Write a formatted message to \b log
+ *
+ *  In asynchronous mode the message is queued like any other message of the calling thread,
+ *  \b TRUE then only means that it was queued or dropped, not that it was written. Called
+ *  while the queued messages of a thread are written, the message goes to the appender
+ *  directly and after the message being written.
+ */
+WINPR_LOCAL BOOL WLog_WriteMessage(wLog* log, wLogMessage* message);
+
 #include "Layout.h"
 #include "Appender.h"
 